@@ -1,13 +1,26 @@
 #include "data.h"
+#include "json_stream.h"
 #include "maps.h"
 
+#include <onut/Dialogs.h>
 #include <onut/Files.h>
 #include <onut/Json.h>
 #include <onut/Log.h>
 #include <json/json.h>
+#include <stdio.h>
 
 
 std::map<std::string, game_t> games;
+bool headless = false;
+
+
+void report_error(const std::string& title, const std::string& msg)
+{
+    if (headless)
+        fprintf(stderr, "%s: %s\n", title.c_str(), msg.c_str());
+    else
+        onut::showMessageBox(title, msg);
+}
 
 
 void init_data()
@@ -202,3 +215,321 @@ const std::string& get_level_name(const level_index_t& idx)
     if (idx.map < 0 || idx.map >= (int)game->episodes[idx.ep].size()) return nullptr;
     return game->episodes[idx.ep][idx.map].name;
 }
+
+
+template<typename T>
+static std::shared_ptr<const T> share_if_equal(const T& value, const std::shared_ptr<const T>& previous)
+{
+    if (previous && *previous == value) return previous;
+    return std::make_shared<const T>(value);
+}
+
+
+map_snapshot_t make_snapshot(const map_state_t& state, const map_snapshot_t* previous)
+{
+    map_snapshot_t snapshot;
+    snapshot.pos = state.pos;
+    snapshot.angle = state.angle;
+    snapshot.selected_bb = state.selected_bb;
+    snapshot.selected_region = state.selected_region;
+    snapshot.selected_location = state.selected_location;
+    snapshot.different = state.different;
+    snapshot.check_sanity_count = state.check_sanity_count;
+
+    if (!previous)
+    {
+        static const map_snapshot_t empty;
+        previous = &empty;
+    }
+
+    snapshot.bbs = share_if_equal(state.bbs, previous->bbs);
+    snapshot.world_rules = share_if_equal(state.world_rules, previous->world_rules);
+    snapshot.exit_rules = share_if_equal(state.exit_rules, previous->exit_rules);
+    snapshot.accesses = share_if_equal(state.accesses, previous->accesses);
+    snapshot.locations = share_if_equal(state.locations, previous->locations);
+
+    // Regions are shared one by one, painting a sector only copies the
+    // regions it touched. Reordering re-shares them by position.
+    snapshot.regions.reserve(state.regions.size());
+    for (int i = 0; i < (int)state.regions.size(); ++i)
+    {
+        static const std::shared_ptr<const region_t> none;
+        snapshot.regions.push_back(share_if_equal(state.regions[i],
+            i < (int)previous->regions.size() ? previous->regions[i] : none));
+    }
+
+    return snapshot;
+}
+
+
+void restore_snapshot(const map_snapshot_t& snapshot, map_state_t& state)
+{
+    state.pos = snapshot.pos;
+    state.angle = snapshot.angle;
+    state.selected_bb = snapshot.selected_bb;
+    state.selected_region = snapshot.selected_region;
+    state.selected_location = snapshot.selected_location;
+    state.different = snapshot.different;
+    state.check_sanity_count = snapshot.check_sanity_count;
+    state.bbs = *snapshot.bbs;
+    state.world_rules = *snapshot.world_rules;
+    state.exit_rules = *snapshot.exit_rules;
+    state.accesses = *snapshot.accesses;
+    state.locations = *snapshot.locations;
+    state.regions.clear();
+    state.regions.reserve(snapshot.regions.size());
+    for (const auto& region : snapshot.regions)
+        state.regions.push_back(*region);
+}
+
+
+static std::vector<int> read_int_array(json_reader_t& reader)
+{
+    std::vector<int> values;
+    if (reader.begin_array())
+        while (reader.next_element())
+            values.push_back(reader.read_int());
+    return values;
+}
+
+
+static rule_connection_t read_connection(json_reader_t& reader)
+{
+    rule_connection_t connection;
+    std::string key;
+    if (reader.begin_object())
+    {
+        while (reader.next_key(key))
+        {
+            if (key == "target_region") connection.target_region = reader.read_int(-1);
+            else if (key == "requirements_or") connection.requirements_or = read_int_array(reader);
+            else if (key == "requirements_and") connection.requirements_and = read_int_array(reader);
+            else reader.skip();
+        }
+    }
+    return connection;
+}
+
+
+static rule_region_t read_rules(json_reader_t& reader)
+{
+    rule_region_t rules;
+    std::string key;
+    if (reader.begin_object())
+    {
+        while (reader.next_key(key))
+        {
+            if (key == "x") rules.x = reader.read_int();
+            else if (key == "y") rules.y = reader.read_int();
+            else if (key == "connections")
+            {
+                if (reader.begin_array())
+                    while (reader.next_element())
+                        rules.connections.push_back(read_connection(reader));
+            }
+            else reader.skip();
+        }
+    }
+    return rules;
+}
+
+
+static region_t read_region(json_reader_t& reader)
+{
+    region_t region;
+    region.name = "BAD_NAME";
+    std::string key;
+    if (reader.begin_object())
+    {
+        while (reader.next_key(key))
+        {
+            if (key == "name") region.name = reader.read_string("BAD_NAME");
+            else if (key == "rules") region.rules = read_rules(reader);
+            else if (key == "sectors")
+            {
+                for (auto sectori : read_int_array(reader))
+                    region.sectors.insert(sectori);
+            }
+            else if (key == "tint")
+            {
+                float* tint = &region.tint.r;
+                int i = 0;
+                if (reader.begin_array())
+                    while (reader.next_element())
+                    {
+                        float value = reader.read_float();
+                        if (i < 4) tint[i++] = value;
+                    }
+            }
+            else reader.skip();
+        }
+    }
+    return region;
+}
+
+
+static bb_t read_bb(json_reader_t& reader)
+{
+    auto values = read_int_array(reader);
+    values.resize(std::max((int)values.size(), 4), 0);
+    return {values[0], values[1], values[2], values[3], values.size() > 4 ? values[4] : -1};
+}
+
+
+static std::pair<int, location_t> read_location(json_reader_t& reader)
+{
+    std::pair<int, location_t> location = {0, {}};
+    std::string key;
+    if (reader.begin_object())
+    {
+        while (reader.next_key(key))
+        {
+            if (key == "index") location.first = reader.read_int();
+            else if (key == "death_logic") location.second.death_logic = reader.read_bool();
+            else if (key == "unreachable") location.second.unreachable = reader.read_bool();
+            else if (key == "check_sanity") location.second.check_sanity = reader.read_bool();
+            else if (key == "name") location.second.name = reader.read_string();
+            else if (key == "description") location.second.description = reader.read_string();
+            else reader.skip();
+        }
+    }
+    return location;
+}
+
+
+// Fields come in any order, the level they belong to ("ep", "map") is only
+// known once the whole object is read
+static void read_map(game_t* game, json_reader_t& reader)
+{
+    int ep = 0;
+    int lvl = 0;
+    map_state_t state;
+    std::vector<std::pair<int, location_t>> locations;
+
+    std::string key;
+    if (!reader.begin_object()) return;
+    while (reader.next_key(key))
+    {
+        if (key == "ep") ep = reader.read_int();
+        else if (key == "map") lvl = reader.read_int();
+        else if (key == "bbs")
+        {
+            if (reader.begin_array())
+                while (reader.next_element())
+                    state.bbs.push_back(read_bb(reader));
+        }
+        else if (key == "regions")
+        {
+            if (reader.begin_array())
+                while (reader.next_element())
+                    state.regions.push_back(read_region(reader));
+        }
+        else if (key == "accesses")
+        {
+            for (auto access : read_int_array(reader))
+                state.accesses.insert(access);
+        }
+        else if (key == "locations")
+        {
+            if (reader.begin_array())
+                while (reader.next_element())
+                    locations.push_back(read_location(reader));
+        }
+        else if (key == "world_rules") state.world_rules = read_rules(reader);
+        else if (key == "exit_rules") state.exit_rules = read_rules(reader);
+        else reader.skip();
+    }
+    if (reader.failed()) return;
+
+    if (ep == 0 && lvl >= (int)game->episodes[ep].size())
+    {
+        // Could be in DOOM2's old format, remap it
+        for (auto& episode : game->episodes)
+        {
+            if (lvl < (int)episode.size())
+            {
+                break;
+            }
+            lvl -= (int)episode.size();
+            ++ep;
+        }
+    }
+    auto meta = get_meta({game->name, ep, lvl});
+    if (!meta) return;
+    auto _map_state = &meta->state;
+
+    _map_state->bbs.insert(_map_state->bbs.end(), state.bbs.begin(), state.bbs.end());
+    _map_state->regions.insert(_map_state->regions.end(), state.regions.begin(), state.regions.end());
+    _map_state->accesses.insert(state.accesses.begin(), state.accesses.end());
+
+    // Default locations from maps
+    auto map = &meta->map;
+    for (int i = 0; i < (int)map->things.size(); ++i)
+    {
+        const auto& thing = map->things[i];
+        if (thing.flags & 0x0010) continue; // Thing is not in single player
+        if (game->location_doom_types.find(thing.type) != game->location_doom_types.end())
+        {
+            location_t location;
+            _map_state->locations[i] = location;
+        }
+    }
+
+    for (const auto& kv : locations)
+    {
+        int index = kv.first;
+        if (index < 0 || index >= (int)map->things.size()) continue;
+        const auto& thing = map->things[index];
+        if (thing.flags & 0x0010) continue; // Thing is not in single player
+        if (game->location_doom_types.find(thing.type) != game->location_doom_types.end())
+        {
+            if (kv.second.check_sanity) _map_state->check_sanity_count++;
+            _map_state->locations[index] = kv.second;
+        }
+    }
+
+    _map_state->world_rules = state.world_rules;
+    _map_state->exit_rules = state.exit_rules;
+
+    meta->view.cam_pos = Vector2((float)(map->bb[2] + map->bb[0]) / 2, -(float)(map->bb[3] + map->bb[1]) / 2);
+}
+
+
+void load(game_t* game)
+{
+    std::string filename = "data/" + game->name + ".json";
+    std::string data;
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (f)
+    {
+        fseek(f, 0, SEEK_END);
+        data.resize((size_t)ftell(f));
+        fseek(f, 0, SEEK_SET);
+        data.resize(fread(&data[0], 1, data.size(), f));
+        fclose(f);
+    }
+    if (!f)
+    {
+        report_error("Warning", "Warning: File not found. (If you just created this game, then it's fine. Otherwise, scream).\n" + filename);
+        return;
+    }
+
+    json_reader_t reader(data.data(), data.size());
+    std::string key;
+    if (reader.begin_object())
+    {
+        while (reader.next_key(key))
+        {
+            if (key != "maps")
+            {
+                reader.skip();
+                continue;
+            }
+            if (reader.begin_array())
+                while (reader.next_element())
+                    read_map(game, reader);
+        }
+    }
+    if (reader.failed())
+        report_error("Error", "Failed to parse " + filename + ": " + reader.error);
+}
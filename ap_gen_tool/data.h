@@ -4,6 +4,8 @@
 #include <onut/Maths.h>
 #include <onut/Vector2.h>
 #include <onut/Texture.h>
+#include <deque>
+#include <memory>
 #include <string>
 #include <vector>
 #include <set>
@@ -169,10 +171,34 @@ struct map_view_t
 };
 
 
+// One undo step. Every part that didn't change since the previous snapshot
+// points at the same data, so a step only costs the size of its edit.
+struct map_snapshot_t
+{
+    Vector2 pos;
+    float angle = 0.0f;
+    int selected_bb = -1;
+    int selected_region = -1;
+    int selected_location = -1;
+    bool different = false;
+    int check_sanity_count = 0;
+    std::shared_ptr<const std::vector<bb_t>> bbs;
+    std::vector<std::shared_ptr<const region_t>> regions;
+    std::shared_ptr<const rule_region_t> world_rules;
+    std::shared_ptr<const rule_region_t> exit_rules;
+    std::shared_ptr<const std::set<int>> accesses;
+    std::shared_ptr<const std::map<int, location_t>> locations;
+};
+
+
+#define MAP_HISTORY_MAX_SIZE 1000 // Oldest steps are dropped past this
+
+
 struct map_history_t
 {
-    std::vector<map_state_t> history;
+    std::deque<map_snapshot_t> history;
     int history_point = 0;
+    int revision = 0; // Bumped by every edit, undo and redo. See meta_t::saved_revision
 };
 
 
@@ -183,7 +209,9 @@ struct meta_t // Bad name, but everything about a level
     map_state_t state; // What we play with
     map_state_t state_new; // For diffing
     map_view_t view; // Camera zoom/position
-    map_history_t history; // History of map_state_t for undo/redo (It's infinite!)
+    map_history_t history; // History of map_state_t for undo/redo
+    std::string saved_json; // This level's part of the data file, as last saved
+    int saved_revision = -1; // history.revision when saved_json was written
 };
 
 
@@ -193,7 +221,8 @@ struct ap_item_def_t
     std::string name;
     std::string group;
     std::string sprite;
-    OTextureRef icon;
+    mutable OTextureRef icon; // See get_item_icon()
+    mutable bool icon_loaded = false;
 };
 
 
@@ -232,6 +261,7 @@ struct game_t
     std::vector<ap_item_def_t> item_requirements;
     bool check_sanity = false;
     std::map<int, int> total_doom_types; // Count of every doom types in the game
+    std::shared_ptr<wad_t> wad; // Memory mapped, for sprites. Not kept when headless
 };
 
 
@@ -261,11 +291,16 @@ enum class active_source_t
 
 
 extern std::map<std::string, game_t> games;
+extern bool headless; // Set before init_data() to only load what generation needs
 
 
 void init_data();
+void load(game_t* game); // Map states from data/<game name>.json
+void report_error(const std::string& title, const std::string& msg); // Message box, or stderr when headless
 game_t* get_game(const level_index_t& idx);
 meta_t* get_meta(const level_index_t& idx, active_source_t source = active_source_t::current);
 map_state_t* get_state(const level_index_t& idx, active_source_t source = active_source_t::current);
 map_t* get_map(const level_index_t& idx);
 const std::string& get_level_name(const level_index_t& idx);
+map_snapshot_t make_snapshot(const map_state_t& state, const map_snapshot_t* previous); // Shares unchanged parts with previous
+void restore_snapshot(const map_snapshot_t& snapshot, map_state_t& state);
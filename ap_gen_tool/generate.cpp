@@ -23,6 +23,7 @@
 #include <map>
 #include <set>
 #include <fstream>
+#include <iterator>
 #include <json/json.h>
 #include <onut/onut.h>
 #include <onut/Strings.h>
@@ -33,6 +34,10 @@
 #include "data.h"
 
 #include <algorithm>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
 
 
 enum item_classification_t
@@ -101,19 +106,41 @@ struct level_t
     bool use_skull[3] = {false};
     map_t* map = nullptr;
     map_state_t* map_state = nullptr;
+    std::vector<bool> thing_check_sanity; // By thing index
 };
 
-int64_t item_id_base = 350000;
-int64_t item_next_id = item_id_base;
-int64_t location_next_id = 351000;
+// Generation state. Thread local so every game can be generated on its own
+// thread in batch mode. Worker tasks spawned from generate() must be handed
+// references, they would see their own empty copies otherwise.
+thread_local int64_t item_id_base = 350000;
+thread_local int64_t item_next_id = item_id_base;
+thread_local int64_t location_next_id = 351000;
 
-int total_item_count = 0;
-int total_loc_count = 0;
-std::vector<ap_item_t> ap_items;
-std::vector<ap_location_t> ap_locations;
-std::map<std::string, std::set<std::string>> item_name_groups;
-std::map<uintptr_t, std::map<int, int64_t>> level_to_keycards;
-std::map<std::string, ap_item_t*> item_map;
+thread_local int total_item_count = 0;
+thread_local int total_loc_count = 0;
+thread_local std::vector<ap_item_t> ap_items;
+thread_local std::vector<ap_location_t> ap_locations;
+thread_local std::set<std::string> ap_location_names;
+thread_local std::map<std::string, std::set<std::string>> item_name_groups;
+thread_local std::map<uintptr_t, std::map<int, int64_t>> level_to_keycards;
+thread_local std::map<std::string, ap_item_t*> item_map;
+
+
+static std::mutex log_mutex;
+
+
+static void gen_log(const std::string& msg)
+{
+    std::lock_guard<std::mutex> lock(log_mutex);
+    OLog(msg);
+}
+
+
+static void gen_log_error(const std::string& msg)
+{
+    std::lock_guard<std::mutex> lock(log_mutex);
+    OLogE(msg);
+}
 
 
 const char* get_doom_type_name(int doom_type);
@@ -139,11 +166,7 @@ static std::string get_requirement_name(game_t* game, const std::string& level_n
 
 bool loc_name_taken(const std::string& name)
 {
-    for (const auto& loc : ap_locations)
-    {
-        if (loc.name == name) return true;
-    }
-    return false;
+    return ap_location_names.count(name) != 0;
 }
 
 
@@ -170,6 +193,7 @@ void add_loc(const std::string& name, const map_thing_t& thing, level_t* level,
     loc.y = y << 16;
     loc.check_sanity = level->map_state->locations[index].check_sanity;
     ap_locations.push_back(loc);
+    ap_location_names.insert(loc_name);
 
     level->location_count++;
     total_loc_count++;
@@ -267,32 +291,100 @@ std::string convert_quoted_str(const std::string& str)
 }
 
 
-// This is a mess. Many refactors. Sorry...
-int generate(game_t* game)
+// Python tuple literal, with the trailing comma a single element needs
+static std::string py_tuple(const std::vector<std::string>& values)
+{
+    if (values.size() == 1) return "(" + values[0] + ",)";
+    return "(" + onut::join(values, ", ") + ")";
+}
+
+
+// Generated files are written next to their target, then only replace it
+// if something changed. Untouched files keep their timestamps, so editing
+// one level doesn't rebuild apdoom.cpp or reload the world for the others.
+thread_local int outputs_written = 0;
+thread_local int outputs_unchanged = 0;
+
+
+static FILE* open_output(const std::string& filename)
+{
+    return fopen((filename + ".tmp").c_str(), "w");
+}
+
+
+static bool read_text_file(const std::string& filename, std::string& content)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) return false;
+    content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+
+static void close_output(FILE* fout, const std::string& filename)
 {
-    OLog("AP Gen Tool");
+    fclose(fout);
 
-    if (OArguments.size() != 3) // Minimum effort validation
+    std::string tmp_filename = filename + ".tmp";
+    std::string new_content, old_content;
+    if (read_text_file(tmp_filename, new_content) &&
+        read_text_file(filename, old_content) &&
+        new_content == old_content)
     {
-        OLogE("Usage: ap_gen_tool.exe python_py_out_dir cpp_py_out_dir poptracker_data_dir\n  i.e: ap_gen_tool.exe C:\\github\\Archipelago\\worlds C:\\github\\apdoom\\src\\archipelago C:\\github\\apdoom\\data\\poptracker");
-        return 1;
+        remove(tmp_filename.c_str());
+        outputs_unchanged++;
+        return;
     }
 
-    std::string py_out_dir = OArguments[0] + "\\" + game->world + "\\";
+    remove(filename.c_str()); // rename doesn't replace on Windows
+    if (rename(tmp_filename.c_str(), filename.c_str()) != 0)
+        gen_log_error("Failed to write " + filename);
+    outputs_written++;
+}
+
+
+bool get_output_dirs(const std::vector<std::string>& args, gen_output_dirs_t& dirs)
+{
+    if (args.size() < 3) // Minimum effort validation
+    {
+        gen_log_error("Usage: ap_gen_tool.exe python_py_out_dir cpp_py_out_dir poptracker_data_dir [--compact] [--batch]\n"
+                      "       ap_gen_tool_cli --generate python_py_out_dir cpp_py_out_dir poptracker_data_dir [--compact]\n"
+                      "  i.e: ap_gen_tool.exe C:\\github\\Archipelago\\worlds C:\\github\\apdoom\\src\\archipelago C:\\github\\apdoom\\data\\poptracker");
+        return false;
+    }
+
+    // Forward slashes work on Windows too
+    dirs.python = args[0] + "/";
+    dirs.cpp = args[1] + "/";
+    dirs.poptracker = args[2] + "/";
+    dirs.compact_python = std::find(args.begin() + 3, args.end(), "--compact") != args.end();
+    return true;
+}
+
+
+// This is a mess. Many refactors. Sorry...
+int generate(game_t* game, const gen_output_dirs_t& dirs)
+{
+    gen_log("AP Gen Tool: " + game->name);
+
+    std::string py_out_dir = dirs.python + game->world + "/";
     item_id_base = game->item_ids;
     item_next_id = item_id_base;
     location_next_id = game->loc_ids;
 
     total_item_count = 0;
     total_loc_count = 0;
+    outputs_written = 0;
+    outputs_unchanged = 0;
     ap_items.clear();
     ap_locations.clear();
+    ap_location_names.clear();
     item_name_groups.clear();
     level_to_keycards.clear();
     item_map.clear();
 
-    std::string cpp_out_dir = OArguments[1] + std::string("\\");
-    std::string pop_tracker_data_dir = OArguments[2] + std::string("\\");
+    std::string cpp_out_dir = dirs.cpp;
+    std::string pop_tracker_data_dir = dirs.poptracker;
 
     ap_locations.reserve(1000);
     ap_items.reserve(1000);
@@ -391,6 +483,7 @@ int generate(game_t* game)
                     complete_loc.region_name = region_name;
                     complete_loc.id = location_next_id++;
                     ap_locations.push_back(complete_loc);
+                    ap_location_names.insert(complete_loc.name);
                     break;
                 }
                 if (connects_to_exit) break;
@@ -419,7 +512,7 @@ int generate(game_t* game)
         }
     }
 
-    OLog(std::to_string(total_loc_count) + " locations\n" + std::to_string(total_item_count - 3) + " items");
+    gen_log(game->name + ": " + std::to_string(total_loc_count) + " locations\n" + std::to_string(total_item_count - 3) + " items");
 
     //--- Remap location's IDs
     {
@@ -473,22 +566,43 @@ int generate(game_t* game)
         }
     }
 
-    // Fill in locations into level's sectors
-    for (int i = 0, len = (int)ap_locations.size(); i < len; ++i)
+    // Fill in locations into level's sectors. Levels are independent, so
+    // they are walked in parallel, each keeping its locations in id order.
     {
-        auto& loc = ap_locations[i];
-        if (loc.doom_thing_index < 0) continue;
-        auto level = get_level(loc.idx);
-        auto subsector = point_in_subsector(loc.x, loc.y, get_map(loc.idx));
-        if (subsector)
+        auto& locations = ap_locations;
+        std::map<level_t*, std::vector<int>> level_locations;
+        for (int i = 0, len = (int)locations.size(); i < len; ++i)
         {
-            level->sectors[subsector->sector].locations.push_back(i);
-            loc.sector = subsector->sector;
+            auto& loc = locations[i];
+            if (loc.doom_thing_index < 0) continue;
+            level_locations[get_level(loc.idx)].push_back(i);
         }
-        else
+        for (auto level : levels)
         {
-            OLogE("Cannot find sector for location: " + loc.name);
+            level->thing_check_sanity.assign(level->map->things.size(), false);
+            auto& loc_indices = level_locations[level];
+            for (auto i : loc_indices)
+                level->thing_check_sanity[locations[i].doom_thing_index] = locations[i].check_sanity;
         }
+
+        parallel_for((int)levels.size(), [&](int level_i)
+        {
+            auto level = levels[level_i];
+            for (auto i : level_locations[level])
+            {
+                auto& loc = locations[i];
+                auto subsector = point_in_subsector(loc.x, loc.y, level->map);
+                if (subsector)
+                {
+                    level->sectors[subsector->sector].locations.push_back(i);
+                    loc.sector = subsector->sector;
+                }
+                else
+                {
+                    gen_log_error("Cannot find sector for location: " + loc.name);
+                }
+            }
+        });
     }
 
     //---------------------------------------------
@@ -496,7 +610,8 @@ int generate(game_t* game)
     //---------------------------------------------
     // Items
     {
-        FILE* fout = fopen((py_out_dir + "Items.py").c_str(), "w");
+        std::string out_filename = py_out_dir + "Items.py";
+        FILE* fout = open_output(out_filename);
         fprintf(fout, "# This file is auto generated. More info: https://github.com/Daivuk/apdoom\n\n");
         fprintf(fout, "from BaseClasses import ItemClassification\n\
 from typing import TypedDict, Dict, Set \n\
@@ -513,27 +628,60 @@ class ItemDict(TypedDict, total=False): \n\
 \n\
 ");
 
-        fprintf(fout, "item_table: Dict[int, ItemDict] = {\n");
-        for (const auto& item : ap_items)
+        if (dirs.compact_python)
         {
-            fprintf(fout, "    %llu: {", item.id);
-            switch (item.classification)
+            // Tuples of constants are a single constant in the .pyc, far
+            // cheaper to import than thousands of dict literals
+            fprintf(fout, "_classifications = (ItemClassification.filler, ItemClassification.progression, ItemClassification.useful,\n");
+            fprintf(fout, "                    ItemClassification.trap, ItemClassification.skip_balancing, ItemClassification.progression_skip_balancing)\n\n");
+            fprintf(fout, "# id, classification, count, name, doom_type, episode, map\n");
+            fprintf(fout, "_item_rows = (\n");
+            for (const auto& item : ap_items)
             {
-                case FILLER: fprintf(fout, "'classification': ItemClassification.filler"); break;
-                case PROGRESSION: fprintf(fout, "'classification': ItemClassification.progression"); break;
-                case USEFUL: fprintf(fout, "'classification': ItemClassification.useful"); break;
-                case TRAP: fprintf(fout, "'classification': ItemClassification.trap"); break;
-                case SKIP_BALANCING: fprintf(fout, "'classification': ItemClassification.skip_balancing"); break;
-                case PROGRESSION_SKIP_BALANCING: fprintf(fout, "'classification': ItemClassification.progression_skip_balancing"); break;
+                int classification = 0;
+                switch (item.classification)
+                {
+                    case FILLER: classification = 0; break;
+                    case PROGRESSION: classification = 1; break;
+                    case USEFUL: classification = 2; break;
+                    case TRAP: classification = 3; break;
+                    case SKIP_BALANCING: classification = 4; break;
+                    case PROGRESSION_SKIP_BALANCING: classification = 5; break;
+                }
+                fprintf(fout, "    (%" PRId64 ", %i, %i, %s, %i, %i, %i),\n", item.id, classification, item.count,
+                        convert_quoted_str(item.name).c_str(), item.doom_type, item.idx.ep + 1, item.idx.map + 1);
             }
-            fprintf(fout, ",\n             'count': %i", item.count);
-            fprintf(fout, ",\n             'name': %s", convert_quoted_str(item.name).c_str());
-            fprintf(fout, ",\n             'doom_type': %i", item.doom_type);
-            fprintf(fout, ",\n             'episode': %i", item.idx.ep + 1);
-            fprintf(fout, ",\n             'map': %i", item.idx.map + 1);
-            fprintf(fout, "},\n");
+            fprintf(fout, ")\n\n");
+            fprintf(fout, "item_table: Dict[int, ItemDict] = {\n");
+            fprintf(fout, "    row[0]: {'classification': _classifications[row[1]], 'count': row[2], 'name': row[3],\n");
+            fprintf(fout, "             'doom_type': row[4], 'episode': row[5], 'map': row[6]}\n");
+            fprintf(fout, "    for row in _item_rows\n");
+            fprintf(fout, "}\n\n\n");
+        }
+        else
+        {
+            fprintf(fout, "item_table: Dict[int, ItemDict] = {\n");
+            for (const auto& item : ap_items)
+            {
+                fprintf(fout, "    %llu: {", item.id);
+                switch (item.classification)
+                {
+                    case FILLER: fprintf(fout, "'classification': ItemClassification.filler"); break;
+                    case PROGRESSION: fprintf(fout, "'classification': ItemClassification.progression"); break;
+                    case USEFUL: fprintf(fout, "'classification': ItemClassification.useful"); break;
+                    case TRAP: fprintf(fout, "'classification': ItemClassification.trap"); break;
+                    case SKIP_BALANCING: fprintf(fout, "'classification': ItemClassification.skip_balancing"); break;
+                    case PROGRESSION_SKIP_BALANCING: fprintf(fout, "'classification': ItemClassification.progression_skip_balancing"); break;
+                }
+                fprintf(fout, ",\n             'count': %i", item.count);
+                fprintf(fout, ",\n             'name': %s", convert_quoted_str(item.name).c_str());
+                fprintf(fout, ",\n             'doom_type': %i", item.doom_type);
+                fprintf(fout, ",\n             'episode': %i", item.idx.ep + 1);
+                fprintf(fout, ",\n             'map': %i", item.idx.map + 1);
+                fprintf(fout, "},\n");
+            }
+            fprintf(fout, "}\n\n\n");
         }
-        fprintf(fout, "}\n\n\n");
 
         // item_name_groups
         fprintf(fout, "item_name_groups: Dict[str, Set[str]] = {\n");
@@ -548,12 +696,13 @@ class ItemDict(TypedDict, total=False): \n\
         }
         fprintf(fout, "}\n");
 
-        fclose(fout);
+        close_output(fout, out_filename);
     }
 
     // Generate Regions.py from regions.json (Manually entered data)
     {
-        FILE* fout = fopen((py_out_dir + "Regions.py").c_str(), "w");
+        std::string out_filename = py_out_dir + "Regions.py";
+        FILE* fout = open_output(out_filename);
         fprintf(fout, "# This file is auto generated. More info: https://github.com/Daivuk/apdoom\n\n");
         fprintf(fout, "from typing import List\n");
         fprintf(fout, "from BaseClasses import TypedDict\n\n");
@@ -649,12 +798,13 @@ class ItemDict(TypedDict, total=False): \n\
         }
         fprintf(fout, "]\n");
 
-        fclose(fout);
+        close_output(fout, out_filename);
     }
     
     // Locations
     {
-        FILE* fout = fopen((py_out_dir + "Locations.py").c_str(), "w");
+        std::string out_filename = py_out_dir + "Locations.py";
+        FILE* fout = open_output(out_filename);
 
         fprintf(fout, "# This file is auto generated. More info: https://github.com/Daivuk/apdoom\n\n");
         fprintf(fout, "from typing import Dict, TypedDict, List, Set \n\
@@ -674,24 +824,62 @@ class LocationDict(TypedDict, total=False): \n\
 ");
 
         // Location table
-        fprintf(fout, "location_table: Dict[int, LocationDict] = {\n");
-        for (const auto& loc : ap_locations)
+        if (dirs.compact_python)
         {
-            // Check from json if that location is not marked as "unreachable"
-
-
-            fprintf(fout, "    %llu: {", loc.id);
-            fprintf(fout, "'name': %s", convert_quoted_str(loc.name).c_str());
-            fprintf(fout, ",\n             'episode': %i", loc.idx.ep + 1);
+            std::vector<std::string> region_names;
+            std::map<std::string, int> region_indices;
+            for (const auto& loc : ap_locations)
+            {
+                if (region_indices.count(loc.region_name)) continue;
+                region_indices[loc.region_name] = (int)region_names.size();
+                region_names.push_back(loc.region_name);
+            }
+            fprintf(fout, "_regions = (");
+            for (const auto& region_name : region_names)
+                fprintf(fout, "\n    %s,", convert_quoted_str(region_name).c_str());
+            fprintf(fout, "\n)\n\n");
+
+            fprintf(fout, "# id, name, episode, map, index, doom_type, region%s\n", game->check_sanity ? ", check_sanity" : "");
+            fprintf(fout, "_location_rows = (\n");
+            for (const auto& loc : ap_locations)
+            {
+                fprintf(fout, "    (%" PRId64 ", %s, %i, %i, %i, %i, %i", loc.id, convert_quoted_str(loc.name).c_str(),
+                        loc.idx.ep + 1, loc.idx.map + 1, loc.doom_thing_index, loc.doom_type, region_indices[loc.region_name]);
+                if (game->check_sanity)
+                    fprintf(fout, ", %s", loc.check_sanity ? "True" : "False");
+                fprintf(fout, "),\n");
+            }
+            fprintf(fout, ")\n\n");
+            fprintf(fout, "location_table: Dict[int, LocationDict] = {\n");
+            fprintf(fout, "    row[0]: {'name': row[1], 'episode': row[2], 'map': row[3], 'index': row[4],\n");
             if (game->check_sanity)
-                fprintf(fout, ",\n             'check_sanity': %s", loc.check_sanity ? "True" : "False");
-            fprintf(fout, ",\n             'map': %i", loc.idx.map + 1);
-            fprintf(fout, ",\n             'index': %i", loc.doom_thing_index);
-            fprintf(fout, ",\n             'doom_type': %i", loc.doom_type);
-            fprintf(fout, ",\n             'region': \"%s\"", loc.region_name.c_str());
-            fprintf(fout, "},\n");
+                fprintf(fout, "             'doom_type': row[5], 'region': _regions[row[6]], 'check_sanity': row[7]}\n");
+            else
+                fprintf(fout, "             'doom_type': row[5], 'region': _regions[row[6]]}\n");
+            fprintf(fout, "    for row in _location_rows\n");
+            fprintf(fout, "}\n\n\n");
+        }
+        else
+        {
+            fprintf(fout, "location_table: Dict[int, LocationDict] = {\n");
+            for (const auto& loc : ap_locations)
+            {
+                // Check from json if that location is not marked as "unreachable"
+
+
+                fprintf(fout, "    %llu: {", loc.id);
+                fprintf(fout, "'name': %s", convert_quoted_str(loc.name).c_str());
+                fprintf(fout, ",\n             'episode': %i", loc.idx.ep + 1);
+                if (game->check_sanity)
+                    fprintf(fout, ",\n             'check_sanity': %s", loc.check_sanity ? "True" : "False");
+                fprintf(fout, ",\n             'map': %i", loc.idx.map + 1);
+                fprintf(fout, ",\n             'index': %i", loc.doom_thing_index);
+                fprintf(fout, ",\n             'doom_type': %i", loc.doom_type);
+                fprintf(fout, ",\n             'region': \"%s\"", loc.region_name.c_str());
+                fprintf(fout, "},\n");
+            }
+            fprintf(fout, "}\n\n\n");
         }
-        fprintf(fout, "}\n\n\n");
 
         // name groups
         fprintf(fout, "location_name_groups: Dict[str, Set[str]] = {\n");
@@ -733,12 +921,13 @@ class LocationDict(TypedDict, total=False): \n\
         }
         fprintf(fout, "]\n");
 
-        fclose(fout);
+        close_output(fout, out_filename);
     }
 
     // Maps
     {
-        FILE* fout = fopen((py_out_dir + "Maps.py").c_str(), "w");
+        std::string out_filename = py_out_dir + "Maps.py";
+        FILE* fout = open_output(out_filename);
 
         fprintf(fout, "# This file is auto generated. More info: https://github.com/Daivuk/apdoom\n\n");
         fprintf(fout, "from typing import List\n\n\n");
@@ -750,54 +939,128 @@ class LocationDict(TypedDict, total=False): \n\
         }
         fprintf(fout, "\n]\n");
 
-        fclose(fout);
+        close_output(fout, out_filename);
     }
 
     // Now generate apdoom_def.h so the game can map the IDs
     {
-        FILE* fout = fopen((cpp_out_dir + "ap" + game->codename + "_def.h").c_str(), "w");
+        std::string out_filename = cpp_out_dir + "ap" + game->codename + "_def.h";
+        FILE* fout = open_output(out_filename);
         
         fprintf(fout, "// This file is auto generated. More info: https://github.com/Daivuk/apdoom\n");
         fprintf(fout, "#pragma once\n\n");
         fprintf(fout, "#include \"apdoom.h\"\n");
         fprintf(fout, "#include \"apdoom_def_types.h\"\n");
-        fprintf(fout, "#include <map>\n");
-        fprintf(fout, "#include <string>\n");
         fprintf(fout, "#include <vector>\n\n\n");
 
-        std::map<int /* ep */, std::map<int /* map */, std::map<int /* index */, int64_t /* loc id */>>> location_table;
+        // Locations, sorted by episode, map then thing index. Lookups are binary searches within a level's range.
+        std::vector<const ap_location_t*> sorted_locations;
         for (const auto& loc : ap_locations)
+            sorted_locations.push_back(&loc);
+        std::sort(sorted_locations.begin(), sorted_locations.end(), [](const ap_location_t* a, const ap_location_t* b)
         {
-            location_table[loc.idx.ep + 1][loc.idx.map + 1][loc.doom_thing_index] = loc.id;
+            if (a->idx.ep != b->idx.ep) return a->idx.ep < b->idx.ep;
+            if (a->idx.map != b->idx.map) return a->idx.map < b->idx.map;
+            return a->doom_thing_index < b->doom_thing_index;
+        });
+
+        fprintf(fout, "// Locations, sorted by episode, map then thing index\n");
+        fprintf(fout, "constexpr ap_location_def_t ap_%s_locations[] = {\n", game->codename.c_str());
+        for (auto loc : sorted_locations)
+        {
+            fprintf(fout, "    {%i, %i, %i, %lli},\n", loc->idx.ep + 1, loc->idx.map + 1, loc->doom_thing_index, loc->id);
         }
+        fprintf(fout, "};\n\n\n");
 
-        // locations
-        fprintf(fout, "const std::map<int /* ep */, std::map<int /* map */, std::map<int /* index */, int64_t /* loc id */>>> ap_%s_location_table = {\n", game->codename.c_str());
-        for (const auto& kv1 : location_table)
+        // Offset tables
+        std::vector<int> episode_offsets = {0};
+        for (int ep = 0; ep < game->ep_count; ++ep)
+            episode_offsets.push_back(episode_offsets.back() + (int)game->episodes[ep].size());
+
+        std::vector<int> level_location_offsets;
         {
-            fprintf(fout, "    {%i, {\n", kv1.first);
-            for (const auto& kv2 : kv1.second)
+            int loc_i = 0;
+            for (int ep = 0; ep < game->ep_count; ++ep)
             {
-                fprintf(fout, "        {%i, {\n", kv2.first);
-                for (const auto& kv3 : kv2.second)
+                for (int map = 0; map < (int)game->episodes[ep].size(); ++map)
                 {
-                    fprintf(fout, "            {%i, %lli},\n", kv3.first, kv3.second);
+                    while (loc_i < (int)sorted_locations.size() &&
+                           (sorted_locations[loc_i]->idx.ep < ep || (sorted_locations[loc_i]->idx.ep == ep && sorted_locations[loc_i]->idx.map < map)))
+                        ++loc_i;
+                    level_location_offsets.push_back(loc_i);
                 }
-                fprintf(fout, "        }},\n");
             }
-            fprintf(fout, "    }},\n");
+            level_location_offsets.push_back((int)sorted_locations.size());
         }
+
+        std::vector<int> location_id_order;
+        for (int i = 0; i < (int)sorted_locations.size(); ++i)
+            location_id_order.push_back(i);
+        std::sort(location_id_order.begin(), location_id_order.end(), [&sorted_locations](int a, int b) { return sorted_locations[a]->id < sorted_locations[b]->id; });
+
+        auto print_int_array = [fout](const std::vector<int>& values)
+        {
+            for (int i = 0; i < (int)values.size(); ++i)
+            {
+                if (i % 16 == 0) fprintf(fout, "    ");
+                fprintf(fout, "%i,", values[i]);
+                fprintf(fout, (i % 16 == 15 || i == (int)values.size() - 1) ? "\n" : " ");
+            }
+        };
+
+        fprintf(fout, "// First level of every episode in ap_%s_level_location_offsets\n", game->codename.c_str());
+        fprintf(fout, "constexpr int ap_%s_episode_offsets[] = {", game->codename.c_str());
+        for (int i = 0; i < (int)episode_offsets.size(); ++i)
+            fprintf(fout, i ? ", %i" : "%i", episode_offsets[i]);
+        fprintf(fout, "};\n\n\n");
+
+        fprintf(fout, "// First location of every level in ap_%s_locations\n", game->codename.c_str());
+        fprintf(fout, "constexpr int ap_%s_level_location_offsets[] = {\n", game->codename.c_str());
+        print_int_array(level_location_offsets);
+        fprintf(fout, "};\n\n\n");
+
+        fprintf(fout, "// Indices into ap_%s_locations, sorted by loc id\n", game->codename.c_str());
+        fprintf(fout, "constexpr int ap_%s_location_id_order[] = {\n", game->codename.c_str());
+        print_int_array(location_id_order);
         fprintf(fout, "};\n\n\n");
 
         // items
-        fprintf(fout, "// Map item id\n");
-        fprintf(fout, "const std::map<int64_t, ap_item_t> ap_%s_item_table = {\n", game->codename.c_str());
+        std::vector<const ap_item_t*> sorted_items;
         for (const auto& item : ap_items)
+            sorted_items.push_back(&item);
+        std::sort(sorted_items.begin(), sorted_items.end(), [](const ap_item_t* a, const ap_item_t* b) { return a->id < b->id; });
+
+        fprintf(fout, "// Map item id, sorted by item id\n");
+        fprintf(fout, "constexpr ap_item_def_t ap_%s_items[] = {\n", game->codename.c_str());
+        for (auto item : sorted_items)
         {
-            fprintf(fout, "    {%llu, {%i, %i, %i}},\n", item.id, item.doom_type, item.idx.ep + 1, item.idx.map + 1);
+            fprintf(fout, "    {%llu, {%i, %i, %i}, \"%s\"},\n", item->id, item->doom_type, item->idx.ep + 1, item->idx.map + 1, item->name.c_str());
         }
         fprintf(fout, "};\n\n\n");
 
+        // Level things. Kept in their own arrays so levels aren't capped
+        // at a fixed thing count.
+        fprintf(fout, "// Things of every level, in map order (Used for sanity checks)\n");
+        for (int ep = 0; ep < game->ep_count; ++ep)
+        {
+            int map = 0;
+            for (const auto& meta : game->episodes[ep])
+            {
+                auto level = get_level({game->name, ep, map});
+                ++map;
+                if (level->map->things.empty()) continue;
+                fprintf(fout, "constexpr ap_thing_info_t ap_%s_things_e%im%i[] = {\n", game->codename.c_str(), ep + 1, map);
+                int idx = 0;
+                for (const auto& thing : level->map->things)
+                {
+                    fprintf(fout, "    {%i, %i, %i},\n", thing.type, idx, level->thing_check_sanity[idx] ? 1 : 0);
+                    ++idx;
+                }
+                fprintf(fout, "};\n\n");
+            }
+        }
+        fprintf(fout, "\n");
+
         // Level infos
         fprintf(fout, "std::vector<std::vector<ap_level_info_t>> ap_%s_level_infos = \n", game->codename.c_str());
         fprintf(fout, "{\n");
@@ -808,7 +1071,10 @@ class LocationDict(TypedDict, total=False): \n\
             for (const auto& meta : game->episodes[ep])
             {
                 auto level = get_level({game->name, ep, map});
-                fprintf(fout, "        {\"%s\", {%s, %s, %s}, {%i, %i, %i}, %i, %i, {\n", 
+                char things_name[64] = "nullptr";
+                if (!level->map->things.empty())
+                    snprintf(things_name, sizeof(things_name), "ap_%s_things_e%im%i", game->codename.c_str(), ep + 1, map + 1);
+                fprintf(fout, "        {\"%s\", {%s, %s, %s}, {%i, %i, %i}, %i, %i, %s},\n", 
                         level->name.c_str(),
                         level->keys[0] ? "true" : "false", 
                         level->keys[1] ? "true" : "false", 
@@ -817,50 +1083,51 @@ class LocationDict(TypedDict, total=False): \n\
                         level->use_skull[1] ? 1 : 0, 
                         level->use_skull[2] ? 1 : 0, 
                         level->location_count,
-                        (int)level->map->things.size());
-                int idx = 0;
-                for (const auto& thing : level->map->things)
-                {
-                    bool check_sanity = false;
-                    for (const auto& loc : ap_locations)
-                    {
-                        if (loc.idx == level->idx &&
-                            loc.doom_thing_index == idx)
-                        {
-                            check_sanity = loc.check_sanity;
-                            break;
-                        }
-                    }
-                    fprintf(fout, "            {%i, %i, %i},\n", thing.type, idx, check_sanity ? 1 : 0);
-                    ++idx;
-                }
-                fprintf(fout, "        }},\n");
+                        (int)level->map->things.size(),
+                        things_name);
                 ++map;
             }
             fprintf(fout, "    },\n");
         }
         fprintf(fout, "};\n\n\n");
 
-        // Item sprites (Used by notification icons)
-        fprintf(fout, "const std::map<int, std::string> ap_%s_type_sprites = {\n", game->codename.c_str());
+        // Item sprites (Used by notification icons). First definition of a doom type wins.
+        std::map<int, std::string> type_sprites;
         for (const auto& item : game->progressions)
-            fprintf(fout, "    {%i, \"%s\"},\n", item.doom_type, item.sprite.c_str());
+            type_sprites.insert({item.doom_type, item.sprite});
         for (const auto& item : game->fillers)
-            fprintf(fout, "    {%i, \"%s\"},\n", item.doom_type, item.sprite.c_str());
+            type_sprites.insert({item.doom_type, item.sprite});
         for (const auto& item : game->unique_progressions)
-            fprintf(fout, "    {%i, \"%s\"},\n", item.doom_type, item.sprite.c_str());
+            type_sprites.insert({item.doom_type, item.sprite});
         for (const auto& item : game->unique_fillers)
-            fprintf(fout, "    {%i, \"%s\"},\n", item.doom_type, item.sprite.c_str());
+            type_sprites.insert({item.doom_type, item.sprite});
         for (const auto& item : game->keys)
-            fprintf(fout, "    {%i, \"%s\"},\n", item.item.doom_type, item.item.sprite.c_str());
+            type_sprites.insert({item.item.doom_type, item.item.sprite});
+
+        fprintf(fout, "// Item sprites (Used by notification icons), sorted by doom type\n");
+        fprintf(fout, "constexpr ap_type_sprite_t ap_%s_type_sprites[] = {\n", game->codename.c_str());
+        for (const auto& kv : type_sprites)
+            fprintf(fout, "    {%i, \"%s\"},\n", kv.first, kv.second.c_str());
+        fprintf(fout, "};\n\n\n");
+
+        // Everything above, bundled so the game can select it once
+        const char* c = game->codename.c_str();
+        fprintf(fout, "constexpr ap_def_tables_t ap_%s_tables = {\n", c);
+        fprintf(fout, "    ap_%s_locations, (int)(sizeof(ap_%s_locations) / sizeof(ap_location_def_t)),\n", c, c);
+        fprintf(fout, "    ap_%s_episode_offsets, (int)(sizeof(ap_%s_episode_offsets) / sizeof(int)) - 1,\n", c, c);
+        fprintf(fout, "    ap_%s_level_location_offsets,\n", c);
+        fprintf(fout, "    ap_%s_location_id_order,\n", c);
+        fprintf(fout, "    ap_%s_items, (int)(sizeof(ap_%s_items) / sizeof(ap_item_def_t)),\n", c, c);
+        fprintf(fout, "    ap_%s_type_sprites, (int)(sizeof(ap_%s_type_sprites) / sizeof(ap_type_sprite_t))\n", c, c);
         fprintf(fout, "};\n");
 
-        fclose(fout);
+        close_output(fout, out_filename);
     }
 
     // We generate some stuff for doom also, C header.
     {
-        FILE* fout = fopen((cpp_out_dir + "ap" + game->codename + "_c_def.h").c_str(), "w");
+        std::string out_filename = cpp_out_dir + "ap" + game->codename + "_c_def.h";
+        FILE* fout = open_output(out_filename);
         
         fprintf(fout, "// This file is auto generated. More info: https://github.com/Daivuk/apdoom\n");
         fprintf(fout, "#ifndef _AP_%s_C_DEF_\n", game->codename.c_str());
@@ -882,12 +1149,13 @@ class LocationDict(TypedDict, total=False): \n\
         fprintf(fout, "}\n\n");
 
         fprintf(fout, "#endif\n");
-        fclose(fout);
+        close_output(fout, out_filename);
     }
 
     // Generate Rules.py from regions.json (Manually entered data)
     {
-        FILE* fout = fopen((py_out_dir + "Rules.py").c_str(), "w");
+        std::string out_filename = py_out_dir + "Rules.py";
+        FILE* fout = open_output(out_filename);
         fprintf(fout, "# This file is auto generated. More info: https://github.com/Daivuk/apdoom\n\n");
         fprintf(fout, "from typing import TYPE_CHECKING\n");
         fprintf(fout, "from worlds.generic.Rules import set_rule\n\n");
@@ -895,129 +1163,208 @@ class LocationDict(TypedDict, total=False): \n\
         fprintf(fout, "if TYPE_CHECKING:\n");
         fprintf(fout, "    from . import %sWorld\n\n", game->classname.c_str());
         
-        int prev_ep = -1;
-        for (auto level : levels)
+        if (dirs.compact_python)
         {
-            if (level->idx.ep != prev_ep)
+            // Same rules as below, as one table per episode. A closure is
+            // made per entrance at set_rules() time instead of compiling a
+            // lambda for each one.
+            fprintf(fout, "\ndef _make_rule(player, ands, ors):\n");
+            fprintf(fout, "    if not ors:\n");
+            fprintf(fout, "        return lambda state: state.has_all(ands, player)\n");
+            fprintf(fout, "    if not ands:\n");
+            fprintf(fout, "        return lambda state: state.has_any(ors, player)\n");
+            fprintf(fout, "    return lambda state: state.has_all(ands, player) and state.has_any(ors, player)\n\n\n");
+            fprintf(fout, "def _set_table_rules(player, world, pro, table):\n");
+            fprintf(fout, "    for entrance, pro_only, ands, ors in table:\n");
+            fprintf(fout, "        if pro or not pro_only:\n");
+            fprintf(fout, "            set_rule(world.get_entrance(entrance, player), _make_rule(player, ands, ors))\n\n");
+
+            int prev_ep = -1;
+            for (auto level : levels)
             {
-                prev_ep = level->idx.ep;
-                fprintf(fout, "\ndef set_episode%i_rules(player, world, pro):\n", level->idx.ep + 1);
-            }
+                if (level->idx.ep != prev_ep)
+                {
+                    if (prev_ep != -1)
+                        fprintf(fout, ")\n\n\ndef set_episode%i_rules(player, world, pro):\n    _set_table_rules(player, world, pro, _episode%i_rules)\n", prev_ep + 1, prev_ep + 1);
+                    prev_ep = level->idx.ep;
+                    fprintf(fout, "\n# entrance, pro only, all of, any of\n_episode%i_rules = (\n", level->idx.ep + 1);
+                }
 
-            const std::string& level_name = level->name;
-            fprintf(fout, "    # %s\n", level_name.c_str());
+                const std::string& level_name = level->name;
+                auto requirement = [&](int doom_type) { return convert_quoted_str(get_requirement_name(game, level_name, doom_type)); };
 
-            int region_i = 0;
-            bool has_rules = false;
-            for (const auto& region : level->map_state->regions)
-            {
-                std::string region_name = level_name + " " + region.name;
-
-                // Hub rules
-                for (const auto& world_connection : level->map_state->world_rules.connections)
+                int region_i = 0;
+                for (const auto& region : level->map_state->regions)
                 {
-                    auto world_target_region = world_connection.target_region;
-                    if (world_target_region == region_i)
+                    std::string region_name = level_name + " " + region.name;
+
+                    // Hub rules
+                    for (const auto& world_connection : level->map_state->world_rules.connections)
                     {
-                        has_rules = true;
+                        if (world_connection.target_region != region_i) continue;
 
-                        std::vector<std::string> ands = {"state.has(\"" + level_name + "\", player, 1)"};
+                        std::vector<std::string> ands = {convert_quoted_str(level_name)};
                         std::vector<std::string> ors;
+                        for (auto doom_type : world_connection.requirements_and)
+                            ands.push_back(requirement(doom_type));
+                        for (auto doom_type : world_connection.requirements_or)
+                            ors.push_back(requirement(doom_type));
 
-                        for (auto doom_type: world_connection.requirements_and)
-                        {
-                            ands.push_back("state.has(\"" + get_requirement_name(game, level_name, doom_type) + "\", player, 1)");
-                        }
-                        for (auto doom_type: world_connection.requirements_or)
+                        fprintf(fout, "    (%s, False, %s, %s),\n", convert_quoted_str("Hub -> " + region_name).c_str(), py_tuple(ands).c_str(), py_tuple(ors).c_str());
+                    }
+
+                    for (const auto& connection : region.rules.connections)
+                    {
+                        int target_region = connection.target_region;
+                        if (target_region < 0) continue; // Hub or exit
+
+                        std::vector<std::string> ands;
+                        std::vector<std::string> ors;
+                        bool pro = false;
+                        for (auto doom_type : connection.requirements_and)
                         {
-                            ors.push_back("state.has(\"" + get_requirement_name(game, level_name, doom_type) + "\", player, 1)");
+                            if (doom_type == -2) pro = true;
+                            if (doom_type >= 0) ands.push_back(requirement(doom_type));
                         }
+                        for (auto doom_type : connection.requirements_or)
+                            if (doom_type >= 0) ors.push_back(requirement(doom_type));
+                        if (ands.empty() && ors.empty()) continue;
 
-                        fprintf(fout, "    set_rule(world.get_entrance(\"Hub -> %s\", player), lambda state:\n", region_name.c_str());
-
-                        if (ands.empty())
-                            fprintf(fout, "        %s)\n", onut::join(ors, " or\n        ").c_str());
-                        else if (ors.empty())
-                            fprintf(fout, "        %s)\n", onut::join(ands, " and\n        ").c_str());
-                        else
-                            fprintf(fout, "       (%s) and\n       (%s))\n", onut::join(ands, " and\n        ").c_str(), onut::join(ors, " or\n        ").c_str());
+                        auto target_name = level_name + " " + level->map_state->regions[target_region].name;
+                        fprintf(fout, "    (%s, %s, %s, %s),\n", convert_quoted_str(region_name + " -> " + target_name).c_str(), pro ? "True" : "False", py_tuple(ands).c_str(), py_tuple(ors).c_str());
                     }
+                    ++region_i;
+                }
+            }
+            if (prev_ep != -1)
+                fprintf(fout, ")\n\n\ndef set_episode%i_rules(player, world, pro):\n    _set_table_rules(player, world, pro, _episode%i_rules)\n", prev_ep + 1, prev_ep + 1);
+        }
+        else
+        {
+            int prev_ep = -1;
+            for (auto level : levels)
+            {
+                if (level->idx.ep != prev_ep)
+                {
+                    prev_ep = level->idx.ep;
+                    fprintf(fout, "\ndef set_episode%i_rules(player, world, pro):\n", level->idx.ep + 1);
                 }
 
-                std::vector<std::string> connections;
-                for (const auto& connection : region.rules.connections)
+                const std::string& level_name = level->name;
+                fprintf(fout, "    # %s\n", level_name.c_str());
+
+                int region_i = 0;
+                bool has_rules = false;
+                for (const auto& region : level->map_state->regions)
                 {
-                    int target_region = connection.target_region;
-                    if (target_region == -2)
+                    std::string region_name = level_name + " " + region.name;
+
+                    // Hub rules
+                    for (const auto& world_connection : level->map_state->world_rules.connections)
                     {
-                        continue;
+                        auto world_target_region = world_connection.target_region;
+                        if (world_target_region == region_i)
+                        {
+                            has_rules = true;
+
+                            std::vector<std::string> ands = {"state.has(\"" + level_name + "\", player, 1)"};
+                            std::vector<std::string> ors;
+
+                            for (auto doom_type: world_connection.requirements_and)
+                            {
+                                ands.push_back("state.has(\"" + get_requirement_name(game, level_name, doom_type) + "\", player, 1)");
+                            }
+                            for (auto doom_type: world_connection.requirements_or)
+                            {
+                                ors.push_back("state.has(\"" + get_requirement_name(game, level_name, doom_type) + "\", player, 1)");
+                            }
+
+                            fprintf(fout, "    set_rule(world.get_entrance(\"Hub -> %s\", player), lambda state:\n", region_name.c_str());
+
+                            if (ands.empty())
+                                fprintf(fout, "        %s)\n", onut::join(ors, " or\n        ").c_str());
+                            else if (ors.empty())
+                                fprintf(fout, "        %s)\n", onut::join(ands, " and\n        ").c_str());
+                            else
+                                fprintf(fout, "       (%s) and\n       (%s))\n", onut::join(ands, " and\n        ").c_str(), onut::join(ors, " or\n        ").c_str());
+                        }
                     }
-                    if (target_region == -1)
+
+                    std::vector<std::string> connections;
+                    for (const auto& connection : region.rules.connections)
                     {
-                        continue;
-                    }
+                        int target_region = connection.target_region;
+                        if (target_region == -2)
+                        {
+                            continue;
+                        }
+                        if (target_region == -1)
+                        {
+                            continue;
+                        }
 
-                    int count = 0;
-                    for (auto req : connection.requirements_and)
-                        if (req >= 0)
-                            ++count;
-                    for (auto req : connection.requirements_or)
-                        if (req >= 0)
-                            ++count;
-                    if (count == 0) continue;
+                        int count = 0;
+                        for (auto req : connection.requirements_and)
+                            if (req >= 0)
+                                ++count;
+                        for (auto req : connection.requirements_or)
+                            if (req >= 0)
+                                ++count;
+                        if (count == 0) continue;
                     
-                    auto pro = false;
-                    for (auto req : connection.requirements_and)
-                    {
-                        if (req == -2)
+                        auto pro = false;
+                        for (auto req : connection.requirements_and)
                         {
-                            pro = true;
-                            break;
+                            if (req == -2)
+                            {
+                                pro = true;
+                                break;
+                            }
                         }
-                    }
 
-                    has_rules = true;
+                        has_rules = true;
 
-                    std::vector<std::string> ands;
-                    std::vector<std::string> ors;
+                        std::vector<std::string> ands;
+                        std::vector<std::string> ors;
 
-                    std::string indent = "";
-                    if (pro )
-                    {
-                        indent = "    ";
-                        fprintf(fout, "    if pro:\n");
-                    }
+                        std::string indent = "";
+                        if (pro )
+                        {
+                            indent = "    ";
+                            fprintf(fout, "    if pro:\n");
+                        }
 
-                    for (auto doom_type: connection.requirements_and)
-                    {
-                        if (doom_type >= 0)
-                            ands.push_back("state.has(\"" + get_requirement_name(game, level_name, doom_type) + "\", player, 1)");
-                    }
-                    for (auto doom_type: connection.requirements_or)
-                    {
-                        if (doom_type >= 0)
-                            ors.push_back("state.has(\"" + get_requirement_name(game, level_name, doom_type) + "\", player, 1)");
-                    }
+                        for (auto doom_type: connection.requirements_and)
+                        {
+                            if (doom_type >= 0)
+                                ands.push_back("state.has(\"" + get_requirement_name(game, level_name, doom_type) + "\", player, 1)");
+                        }
+                        for (auto doom_type: connection.requirements_or)
+                        {
+                            if (doom_type >= 0)
+                                ors.push_back("state.has(\"" + get_requirement_name(game, level_name, doom_type) + "\", player, 1)");
+                        }
 
-                    auto target_name = level_name + " " + level->map_state->regions[target_region].name;
-                    fprintf(fout, "%s    set_rule(world.get_entrance(\"%s -> %s\", player), lambda state:\n", indent.c_str(), region_name.c_str(), target_name.c_str());
+                        auto target_name = level_name + " " + level->map_state->regions[target_region].name;
+                        fprintf(fout, "%s    set_rule(world.get_entrance(\"%s -> %s\", player), lambda state:\n", indent.c_str(), region_name.c_str(), target_name.c_str());
                         
-                    if (ands.empty())
-                        fprintf(fout, "%s        %s)\n", indent.c_str(), onut::join(ors, " or\n        ").c_str());
-                    else if (ors.empty())
-                        fprintf(fout, "%s        %s)\n", indent.c_str(), onut::join(ands, " and\n        ").c_str());
-                    else
-                        fprintf(fout, "%s       (%s) and       (%s))\n", indent.c_str(), onut::join(ands, " and\n        ").c_str(), onut::join(ors, " or\n        ").c_str());
+                        if (ands.empty())
+                            fprintf(fout, "%s        %s)\n", indent.c_str(), onut::join(ors, " or\n        ").c_str());
+                        else if (ors.empty())
+                            fprintf(fout, "%s        %s)\n", indent.c_str(), onut::join(ands, " and\n        ").c_str());
+                        else
+                            fprintf(fout, "%s       (%s) and       (%s))\n", indent.c_str(), onut::join(ands, " and\n        ").c_str(), onut::join(ors, " or\n        ").c_str());
+                    }
+                    ++region_i;
+                }
+                if (!has_rules)
+                {
+                    fprintf(fout, "    # No rules...\n\n");
+                }
+                else
+                {
+                    fprintf(fout, "\n");
                 }
-                ++region_i;
-            }
-            if (!has_rules)
-            {
-                fprintf(fout, "    # No rules...\n\n");
-            }
-            else
-            {
-                fprintf(fout, "\n");
             }
         }
 
@@ -1030,12 +1377,13 @@ class LocationDict(TypedDict, total=False): \n\
             fprintf(fout, "        set_episode%i_rules(player, world, pro)\n", ep + 1);
         }
 
-        fclose(fout);
+        close_output(fout, out_filename);
     }
 
     // Generate location CSV that will be used for names
     {
-        FILE* fout = fopen((pop_tracker_data_dir + game->codename + "_location_names.csv").c_str(), "w");
+        std::string out_filename = pop_tracker_data_dir + game->codename + "_location_names.csv";
+        FILE* fout = open_output(out_filename);
 
         fprintf(fout, "Map,Type,Index,Name,Description\n");
 
@@ -1057,12 +1405,32 @@ class LocationDict(TypedDict, total=False): \n\
                 fprintf(fout, "%s,\n", escape_csv(location.description).c_str());
             }
         }
-        fclose(fout);
+        close_output(fout, out_filename);
     }
 
     // TODO: Pop tracker logic
 
+    gen_log(game->name + ": " + std::to_string(outputs_written) + " files written, " + std::to_string(outputs_unchanged) + " unchanged");
+
     // Clean up
     for (auto level : levels) delete level;
     return 0;
 }
+
+
+// Headless batch mode. Every game gets its own thread, so one game writing
+// its files overlaps with the others still being processed.
+int generate_all(const gen_output_dirs_t& dirs)
+{
+    std::vector<std::future<int>> results;
+    for (auto& kv : games)
+    {
+        auto game = &kv.second;
+        results.push_back(std::async(std::launch::async, [game, &dirs]() { return generate(game, dirs); }));
+    }
+
+    int ret = 0;
+    for (auto& result : results)
+        ret |= result.get();
+    return ret;
+}
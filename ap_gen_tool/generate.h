@@ -1,7 +1,23 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 
 struct game_t;
 
 
-int generate(game_t* game);
+struct gen_output_dirs_t
+{
+    std::string python; // Archipelago worlds directory
+    std::string cpp; // src/archipelago
+    std::string poptracker;
+    bool compact_python = false; // --compact: tables of tuples instead of dict literals, see generate.cpp
+};
+
+
+// args: python_py_out_dir cpp_py_out_dir poptracker_data_dir [--compact] [...]
+bool get_output_dirs(const std::vector<std::string>& args, gen_output_dirs_t& dirs);
+
+int generate(game_t* game, const gen_output_dirs_t& dirs);
+int generate_all(const gen_output_dirs_t& dirs); // Every loaded game, in parallel
@@ -0,0 +1,456 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+//
+// *Streaming JSON reader/writer for the world data files*
+//
+
+#include "json_stream.h"
+
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//
+// Writer
+//
+
+void json_writer_t::separate()
+{
+    if (needs_comma) out += ',';
+    needs_comma = false;
+}
+
+
+void json_writer_t::begin_object()
+{
+    separate();
+    out += '{';
+}
+
+
+void json_writer_t::end_object()
+{
+    out += '}';
+    needs_comma = true;
+}
+
+
+void json_writer_t::begin_array()
+{
+    separate();
+    out += '[';
+}
+
+
+void json_writer_t::end_array()
+{
+    out += ']';
+    needs_comma = true;
+}
+
+
+void json_writer_t::key(const char* name)
+{
+    value(std::string(name));
+    out += ':';
+    needs_comma = false;
+}
+
+
+void json_writer_t::value(int v)
+{
+    separate();
+    out += std::to_string(v);
+    needs_comma = true;
+}
+
+
+void json_writer_t::value(bool v)
+{
+    separate();
+    out += v ? "true" : "false";
+    needs_comma = true;
+}
+
+
+// Same as jsoncpp: 17 digits without the trailing zeros, so a float
+// survives the round trip
+void json_writer_t::value(float v)
+{
+    separate();
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", std::isfinite(v) ? (double)v : 0.0);
+    if (strchr(buf, '.') && !strchr(buf, 'e'))
+    {
+        auto len = strlen(buf);
+        while (buf[len - 1] == '0') buf[--len] = '\0';
+        if (buf[len - 1] == '.') buf[--len] = '\0';
+    }
+    out += buf;
+    needs_comma = true;
+}
+
+
+void json_writer_t::value(const std::string& v)
+{
+    separate();
+    out += '"';
+    for (auto c : v)
+    {
+        switch (c)
+        {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20)
+                {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)c);
+                    out += buf;
+                }
+                else
+                {
+                    out += c;
+                }
+                break;
+        }
+    }
+    out += '"';
+    needs_comma = true;
+}
+
+
+void json_writer_t::raw(const std::string& json)
+{
+    separate();
+    out += json;
+    needs_comma = true;
+}
+
+
+//
+// Reader
+//
+
+json_reader_t::json_reader_t(const char* data, size_t size)
+    : begin(data)
+    , p(data)
+    , end(data + size)
+{
+}
+
+
+void json_reader_t::fail(const char* what)
+{
+    if (failed()) return;
+    error = std::string(what) + " at offset " + std::to_string(p - begin);
+    p = end;
+}
+
+
+char json_reader_t::peek()
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+    return p < end ? *p : '\0';
+}
+
+
+bool json_reader_t::begin_object()
+{
+    if (peek() != '{')
+    {
+        skip();
+        return false;
+    }
+    ++p;
+    return true;
+}
+
+
+bool json_reader_t::next_key(std::string& key)
+{
+    auto c = peek();
+    if (c == '}')
+    {
+        ++p;
+        return false;
+    }
+    if (c == ',')
+    {
+        ++p;
+        c = peek();
+    }
+    if (c != '"')
+    {
+        fail("Expected a key");
+        return false;
+    }
+    if (!parse_string(key)) return false;
+    if (peek() != ':')
+    {
+        fail("Expected ':'");
+        return false;
+    }
+    ++p;
+    return true;
+}
+
+
+bool json_reader_t::begin_array()
+{
+    if (peek() != '[')
+    {
+        skip();
+        return false;
+    }
+    ++p;
+    return true;
+}
+
+
+bool json_reader_t::next_element()
+{
+    auto c = peek();
+    if (c == ']')
+    {
+        ++p;
+        return false;
+    }
+    if (c == ',')
+    {
+        ++p;
+        c = peek();
+    }
+    if (c == '\0' || c == ']' || c == '}')
+    {
+        fail("Expected a value");
+        return false;
+    }
+    return true;
+}
+
+
+bool json_reader_t::parse_string(std::string& str)
+{
+    str.clear();
+    ++p; // "
+    while (p < end && *p != '"')
+    {
+        if (*p != '\\')
+        {
+            str += *p++;
+            continue;
+        }
+        if (++p == end) break;
+        switch (*p++)
+        {
+            case '"': str += '"'; break;
+            case '\\': str += '\\'; break;
+            case '/': str += '/'; break;
+            case 'b': str += '\b'; break;
+            case 'f': str += '\f'; break;
+            case 'n': str += '\n'; break;
+            case 'r': str += '\r'; break;
+            case 't': str += '\t'; break;
+            case 'u':
+            {
+                auto read_hex = [this](unsigned& code) -> bool
+                {
+                    if (end - p < 4) return false;
+                    char buf[5] = {p[0], p[1], p[2], p[3], '\0'};
+                    char* hex_end;
+                    code = (unsigned)strtoul(buf, &hex_end, 16);
+                    p += 4;
+                    return hex_end == buf + 4;
+                };
+                unsigned code;
+                if (!read_hex(code))
+                {
+                    fail("Bad \\u escape");
+                    return false;
+                }
+                if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                {
+                    p += 2;
+                    unsigned low;
+                    if (!read_hex(low))
+                    {
+                        fail("Bad \\u escape");
+                        return false;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                if (code < 0x80)
+                {
+                    str += (char)code;
+                }
+                else if (code < 0x800)
+                {
+                    str += (char)(0xC0 | (code >> 6));
+                    str += (char)(0x80 | (code & 0x3F));
+                }
+                else if (code < 0x10000)
+                {
+                    str += (char)(0xE0 | (code >> 12));
+                    str += (char)(0x80 | ((code >> 6) & 0x3F));
+                    str += (char)(0x80 | (code & 0x3F));
+                }
+                else
+                {
+                    str += (char)(0xF0 | (code >> 18));
+                    str += (char)(0x80 | ((code >> 12) & 0x3F));
+                    str += (char)(0x80 | ((code >> 6) & 0x3F));
+                    str += (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                fail("Bad escape");
+                return false;
+        }
+    }
+    if (p == end)
+    {
+        fail("Unterminated string");
+        return false;
+    }
+    ++p; // "
+    return true;
+}
+
+
+bool json_reader_t::parse_number(double& number)
+{
+    char buf[64];
+    int len = 0;
+    while (p < end && len < (int)sizeof(buf) - 1 && strchr("+-.0123456789eE", *p))
+        buf[len++] = *p++;
+    buf[len] = '\0';
+    char* number_end;
+    number = strtod(buf, &number_end);
+    if (len == 0 || number_end != buf + len)
+    {
+        fail("Bad number");
+        return false;
+    }
+    return true;
+}
+
+
+int json_reader_t::read_int(int default_value)
+{
+    auto c = peek();
+    if (c == '-' || (c >= '0' && c <= '9'))
+    {
+        double number;
+        return parse_number(number) ? (int)number : default_value;
+    }
+    skip();
+    return default_value;
+}
+
+
+float json_reader_t::read_float(float default_value)
+{
+    auto c = peek();
+    if (c == '-' || (c >= '0' && c <= '9'))
+    {
+        double number;
+        return parse_number(number) ? (float)number : default_value;
+    }
+    skip();
+    return default_value;
+}
+
+
+bool json_reader_t::read_bool(bool default_value)
+{
+    auto c = peek();
+    if (c == 't' || c == 'f')
+    {
+        const char* literal = c == 't' ? "true" : "false";
+        auto len = strlen(literal);
+        if ((size_t)(end - p) < len || strncmp(p, literal, len) != 0)
+        {
+            fail("Bad literal");
+            return default_value;
+        }
+        p += len;
+        return c == 't';
+    }
+    skip();
+    return default_value;
+}
+
+
+std::string json_reader_t::read_string(const std::string& default_value)
+{
+    if (peek() == '"')
+    {
+        std::string str;
+        return parse_string(str) ? str : default_value;
+    }
+    skip();
+    return default_value;
+}
+
+
+void json_reader_t::skip()
+{
+    auto c = peek();
+    switch (c)
+    {
+        case '{':
+        {
+            ++p;
+            std::string key;
+            while (next_key(key)) skip();
+            break;
+        }
+        case '[':
+            ++p;
+            while (next_element()) skip();
+            break;
+        case '"':
+        {
+            std::string str;
+            parse_string(str);
+            break;
+        }
+        case 't':
+        case 'f':
+            read_bool();
+            break;
+        case 'n':
+            if (end - p >= 4 && strncmp(p, "null", 4) == 0) p += 4;
+            else fail("Bad literal");
+            break;
+        case '\0':
+            fail("Unexpected end");
+            break;
+        default:
+        {
+            double number;
+            parse_number(number);
+            break;
+        }
+    }
+}
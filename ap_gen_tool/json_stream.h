@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+
+// Compact JSON written straight into a string, no Json::Value in between.
+// Keys go out in the order they're given. Give them sorted, like jsoncpp
+// writes them, so saving with either doesn't churn the data files.
+struct json_writer_t
+{
+    std::string out;
+
+    void begin_object();
+    void end_object();
+    void begin_array();
+    void end_array();
+    void key(const char* name);
+    void value(int v);
+    void value(bool v);
+    void value(float v);
+    void value(const std::string& v);
+    void raw(const std::string& json); // An already written value
+
+private:
+    bool needs_comma = false;
+    void separate();
+};
+
+
+// Pull parser over a buffer that outlives it. Values of the wrong type are
+// skipped and read as the default, like Json::Value's asInt() and friends.
+// After an error every call fails, so loops on next_key()/next_element()
+// simply end.
+struct json_reader_t
+{
+    json_reader_t(const char* data, size_t size);
+
+    bool begin_object(); // Skips the value if it's not an object
+    bool next_key(std::string& key); // False at the end of the object
+    bool begin_array(); // Skips the value if it's not an array
+    bool next_element(); // False at the end of the array
+
+    int read_int(int default_value = 0);
+    float read_float(float default_value = 0.0f);
+    bool read_bool(bool default_value = false);
+    std::string read_string(const std::string& default_value = "");
+    void skip();
+
+    bool failed() const { return !error.empty(); }
+    std::string error; // With the offset where it happened
+
+private:
+    const char* begin;
+    const char* p;
+    const char* end;
+
+    char peek();
+    bool parse_string(std::string& str);
+    bool parse_number(double& number);
+    void fail(const char* what);
+};
@@ -0,0 +1,46 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+//
+// *Headless entry point. Generates every game without opening the editor*
+//   ap_gen_tool_cli --generate python_py_out_dir cpp_py_out_dir poptracker_data_dir [--compact]
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "generate.h"
+#include "data.h"
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || strcmp(argv[1], "--generate") != 0)
+    {
+        fprintf(stderr, "Usage: ap_gen_tool_cli --generate python_py_out_dir cpp_py_out_dir poptracker_data_dir [--compact]\n");
+        return 1;
+    }
+
+    std::vector<std::string> args(argv + 2, argv + argc);
+    gen_output_dirs_t dirs;
+    if (!get_output_dirs(args, dirs)) return 1;
+
+    headless = true;
+    init_data();
+    for (auto& kv : games)
+        load(&kv.second);
+
+    return generate_all(dirs);
+}
@@ -1,13 +1,24 @@
 #include "maps.h"
 
 #include <onut/onut.h>
-#include <onut/Dialogs.h>
 #include <onut/Point.h>
 
 #include "earcut.hpp"
 
 #include <stdio.h>
+#include <string.h>
 #include <algorithm>
+#include <cmath>
+#include <filesystem>
+
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "data.h"
 #include "defs.h"
@@ -70,18 +81,101 @@ struct post_t
 };
 
 
+// Read-only mapping of a whole WAD file. Lump views point straight into it,
+// so it stays open as long as the game may still decode sprites.
+struct wad_t
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    std::vector<map_directory_t> directory;
+#if defined(WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+    ~wad_t()
+    {
+#if defined(WIN32)
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap((void*)data, size);
+#endif
+    }
+};
+
+
+struct lump_view_t
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+
+static std::shared_ptr<wad_t> map_wad(const char* filename)
+{
+    auto wad = std::make_shared<wad_t>();
+#if defined(WIN32)
+    wad->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (wad->file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(wad->file, &file_size) || file_size.QuadPart == 0) return nullptr;
+    wad->mapping = CreateFileMappingA(wad->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!wad->mapping) return nullptr;
+    wad->data = (const uint8_t*)MapViewOfFile(wad->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!wad->data) return nullptr;
+    wad->size = (size_t)file_size.QuadPart;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file alive
+    if (data == MAP_FAILED) return nullptr;
+    wad->data = (const uint8_t*)data;
+    wad->size = (size_t)st.st_size;
+#endif
+    return wad;
+}
+
+
+static lump_view_t get_lump_view(const wad_t& wad, const map_directory_t& dir_entry)
+{
+    if (dir_entry.offset < 0 || dir_entry.size < 0 ||
+        (size_t)dir_entry.offset + (size_t)dir_entry.size > wad.size) return {};
+    return {wad.data + dir_entry.offset, (size_t)dir_entry.size};
+}
+
+
+static lump_view_t find_lump(const wad_t& wad, const char* lump_name)
+{
+    for (const auto& dir_entry : wad.directory)
+        if (strncmp(dir_entry.name, lump_name, 8) == 0)
+            return get_lump_view(wad, dir_entry);
+    return {};
+}
+
+
+// Map lumps are copied once out of the mapping, they get converted and
+// edited afterward
 template<typename T>
 static bool try_load_lump(const char *lump_name, 
-                          FILE *f, 
+                          const wad_t &wad, 
                           const map_directory_t &dir_entry, 
                           std::vector<T> &elements)
 {
     if (strncmp(dir_entry.name, lump_name, 8) == 0)
     {
-        auto count = dir_entry.size / sizeof(T);
+        auto lump = get_lump_view(wad, dir_entry);
+        auto count = lump.size / sizeof(T);
         elements.resize(count);
-        fseek(f, dir_entry.offset, SEEK_SET);
-        fread(elements.data(), sizeof(T), count, f);
+        if (count) memcpy(elements.data(), lump.data, count * sizeof(T));
         return true;
     }
     return false;
@@ -304,32 +398,16 @@ static void triangulate_sector(const std::vector<wall_t>& map_walls, map_t* map,
 }
 
 
-std::vector<uint8_t> load_lump(const std::vector<map_directory_t>& directory, const char* lump_name, FILE* f)
+static OTextureRef load_sprite(const lump_view_t& lump, const uint8_t* pal)
 {
-    for (const auto& dir_entry : directory)
-    {
-        if (strncmp(dir_entry.name, lump_name, 8) == 0)
-        {
-            std::vector<uint8_t> ret;
-            ret.resize(dir_entry.size);
-            fseek(f, dir_entry.offset, SEEK_SET);
-            fread(ret.data(), 1, dir_entry.size, f);
-            return ret;
-        }
-    }
-    return {};
-}
-
-
-OTextureRef load_sprite(const std::vector<map_directory_t>& directory, const char* lump_name, FILE* f, const uint8_t* pal)
-{
-    auto raw_data = load_lump(directory, lump_name, f);
-    if (raw_data.empty()) return nullptr;
+    if (lump.size < sizeof(patch_header_t)) return nullptr;
+    const uint8_t* raw_data = lump.data;
 
     patch_header_t header;
-    memcpy(&header, raw_data.data(), sizeof(patch_header_t));
-    uint32_t* columnofs = new uint32_t[header.width * sizeof(uint32_t)];
-    memcpy(columnofs, raw_data.data() + sizeof(patch_header_t), header.width * sizeof(uint32_t));
+    memcpy(&header, raw_data, sizeof(patch_header_t));
+    if (sizeof(patch_header_t) + header.width * sizeof(uint32_t) > lump.size) return nullptr;
+    std::vector<uint32_t> columnofs(header.width);
+    memcpy(columnofs.data(), raw_data + sizeof(patch_header_t), header.width * sizeof(uint32_t));
 
     std::vector<uint8_t> img_data;
     img_data.resize(header.width * header.height * 4);
@@ -356,11 +434,27 @@ OTextureRef load_sprite(const std::vector<map_directory_t>& directory, const cha
         }
     }
 
-    delete[] columnofs;
     return OTexture::createFromData(img_data.data(), {header.width, header.height}, false);
 }
 
 
+OTextureRef& get_item_icon(const game_t& game, const ap_item_def_t& item)
+{
+    if (!item.icon_loaded)
+    {
+        item.icon_loaded = true;
+        if (!item.sprite.empty() && game.wad)
+        {
+            auto pal = find_lump(*game.wad, "PLAYPAL");
+            auto lump = find_lump(*game.wad, item.sprite.c_str());
+            if (pal.size >= 256 * 3 && lump.data)
+                item.icon = load_sprite(lump, pal.data);
+        }
+    }
+    return item.icon;
+}
+
+
 Color get_color_for_line_type(int special)
 {
     switch (special)
@@ -512,31 +606,241 @@ Color get_color_for_line_type(int special)
 }
 
 
+static void count_checks(map_t* map, game_t& game)
+{
+    map->check_count = 0;
+    for (int j = 0, len = (int)map->things.size(); j < len; ++j)
+    {
+        const auto& thing = map->things[j];
+
+        // Count total thing count (Consider UV difficulty)
+        if (thing.flags & 0x0004)
+            game.total_doom_types[thing.type]++;
+
+        if (thing.flags & 0x0010) continue; // Thing is not in single player
+        auto it = game.location_doom_types.find(thing.type);
+        if (it == game.location_doom_types.end()) continue;
+        map->check_count++;
+    }
+}
+
+
+static void triangulate_map(map_t* map)
+{
+    // Create "walls" used in triangulation step
+    std::vector<wall_t> map_walls;
+    for (int j = 0; j < (int)map->linedefs.size(); ++j)
+    {
+        const auto &linedef = map->linedefs[j];
+
+        if (linedef.front_sidedef != -1)
+            create_wall(map_walls, map, j, linedef.front_sidedef);
+        if (linedef.back_sidedef != -1)
+            create_wall(map_walls, map, j, linedef.back_sidedef);
+    }
+
+    // Triangulate
+    for (int j = 0; j < (int)map->sectors.size(); ++j)
+    {
+        triangulate_sector(map_walls, map, j);
+    }
+}
+
+
+static void create_arrows(map_t* map)
+{
+    for (int j = 0; j < (int)map->linedefs.size(); ++j)
+    {
+        const auto& line_def = map->linedefs[j];
+        if (line_def.special_type != 0 && line_def.sector_tag != 0)
+        {
+            arrow_t arrow;
+            arrow.color = get_color_for_line_type(line_def.special_type);
+            const auto& v1 = map->vertexes[line_def.start_vertex];
+            const auto& v2 = map->vertexes[line_def.end_vertex];
+            arrow.from = {
+                (float)(v1.x + v2.x) * 0.5f,
+                -(float)(v1.y + v2.y) * 0.5f
+            };
+            for (int k = 0; k < (int)map->map_sectors.size(); ++k)
+            {
+                const auto& map_sector = map->map_sectors[k];
+                if (map_sector.tag == line_def.sector_tag)
+                {
+                    Vector2 bbmin, bbmax;
+                    const auto& sector = map->sectors[k];
+                    if (sector.vertices.empty()) continue;
+                    bbmin = {
+                        (float)map->vertexes[sector.vertices[0]].x,
+                        -(float)map->vertexes[sector.vertices[0]].y
+                    };
+                    bbmax = bbmin;
+                    for (int l = 1; l < (int)sector.vertices.size(); ++l)
+                    {
+                        Vector2 pt = {
+                            (float)map->vertexes[sector.vertices[l]].x,
+                            -(float)map->vertexes[sector.vertices[l]].y
+                        };
+                        bbmin = onut::min(bbmin, pt);
+                        bbmax = onut::max(bbmax, pt);
+                    }
+                    arrow.to = (bbmin + bbmax) * 0.5f;
+                    map->arrows.push_back(arrow);
+                }
+            }
+        }
+    }
+}
+
+
+// Triangles only depend on the WAD, cache them in
+// cache/<codename>.tri keyed by a hash of the whole file.
+#define TRI_CACHE_DIR "cache"
+#define TRI_CACHE_MAGIC 0x49525441 // "ATRI"
+#define TRI_CACHE_VERSION 1
+
+
+struct tri_cache_header_t
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t wad_hash;
+    uint64_t wad_size;
+    uint32_t map_count;
+};
+
+
+static uint64_t hash_wad(const wad_t& wad)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < wad.size; ++i)
+    {
+        hash ^= wad.data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+static std::string get_tri_cache_filename(const game_t& game)
+{
+    return std::string(TRI_CACHE_DIR) + "/" + game.codename + ".tri";
+}
+
+
+static bool load_tri_cache(const game_t& game, const wad_t& wad, uint64_t wad_hash, const std::vector<map_t*>& maps)
+{
+    FILE* f = fopen(get_tri_cache_filename(game).c_str(), "rb");
+    if (!f) return false;
+
+    bool valid = false;
+    tri_cache_header_t header;
+    if (fread(&header, sizeof(header), 1, f) == 1 &&
+        header.magic == TRI_CACHE_MAGIC &&
+        header.version == TRI_CACHE_VERSION &&
+        header.wad_hash == wad_hash &&
+        header.wad_size == (uint64_t)wad.size &&
+        header.map_count == (uint32_t)maps.size())
+    {
+        valid = true;
+        for (auto map : maps)
+        {
+            uint32_t sector_count = 0;
+            if (fread(&sector_count, sizeof(sector_count), 1, f) != 1 ||
+                sector_count != (uint32_t)map->sectors.size())
+            {
+                valid = false;
+                break;
+            }
+            for (auto& sector : map->sectors)
+            {
+                uint32_t vertex_count = 0;
+                if (fread(&vertex_count, sizeof(vertex_count), 1, f) != 1)
+                {
+                    valid = false;
+                    break;
+                }
+                sector.vertices.resize(vertex_count);
+                if (vertex_count && fread(sector.vertices.data(), sizeof(int), vertex_count, f) != vertex_count)
+                {
+                    valid = false;
+                    break;
+                }
+            }
+            if (!valid) break;
+        }
+    }
+    fclose(f);
+
+    if (!valid)
+        for (auto map : maps)
+            for (auto& sector : map->sectors)
+                sector.vertices.clear();
+    return valid;
+}
+
+
+static void save_tri_cache(const game_t& game, const wad_t& wad, uint64_t wad_hash, const std::vector<map_t*>& maps)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(TRI_CACHE_DIR, ec);
+
+    FILE* f = fopen(get_tri_cache_filename(game).c_str(), "wb");
+    if (!f) return; // Not fatal, we'll triangulate again next time
+
+    tri_cache_header_t header;
+    header.magic = TRI_CACHE_MAGIC;
+    header.version = TRI_CACHE_VERSION;
+    header.wad_hash = wad_hash;
+    header.wad_size = (uint64_t)wad.size;
+    header.map_count = (uint32_t)maps.size();
+    fwrite(&header, sizeof(header), 1, f);
+    for (auto map : maps)
+    {
+        uint32_t sector_count = (uint32_t)map->sectors.size();
+        fwrite(&sector_count, sizeof(sector_count), 1, f);
+        for (const auto& sector : map->sectors)
+        {
+            uint32_t vertex_count = (uint32_t)sector.vertices.size();
+            fwrite(&vertex_count, sizeof(vertex_count), 1, f);
+            if (vertex_count) fwrite(sector.vertices.data(), sizeof(int), vertex_count, f);
+        }
+    }
+    fclose(f);
+}
+
+
 void init_wad(const char* filename, game_t& game)
 {
     // Load DOOM.WAD
-    FILE* f = fopen(filename, "rb");
-    if (!f)
+    auto wad = map_wad(filename);
+    if (!wad)
     {
-        onut::showMessageBox("Error", std::string("Cannot open file: ") + filename);
+        report_error("Error", std::string("Cannot open file: ") + filename);
         exit(1); // Hard kill
     }
     
     // Read header
     map_header_t header;
-    fread(&header, sizeof(header), 1, f);
-    if (strncmp(header.identification, "PWAD", 4) != 0 && strncmp(header.identification, "IWAD", 4) != 0)
+    if (wad->size >= sizeof(header)) memcpy(&header, wad->data, sizeof(header));
+    if (wad->size < sizeof(header) ||
+        (strncmp(header.identification, "PWAD", 4) != 0 && strncmp(header.identification, "IWAD", 4) != 0) ||
+        header.num_lumps < 0 || header.directory_offset < 0 ||
+        (size_t)header.directory_offset + (size_t)header.num_lumps * sizeof(map_directory_t) > wad->size)
     {
-        onut::showMessageBox("Error", std::string("Invalid IWAD or PWAD: ") + filename);
+        report_error("Error", std::string("Invalid IWAD or PWAD: ") + filename);
         exit(1); // Hard kill
     }
     
     // Read directory
-    std::vector<map_directory_t> directory(header.num_lumps);
-    fseek(f, header.directory_offset, SEEK_SET);
-    fread(directory.data(), sizeof(map_directory_t), header.num_lumps, f);
+    auto& directory = wad->directory;
+    directory.resize(header.num_lumps);
+    if (header.num_lumps)
+        memcpy(directory.data(), wad->data + header.directory_offset, header.num_lumps * sizeof(map_directory_t));
 
     bool is_doom2 = game.codename == "doom2";
+    std::vector<map_t*> editor_maps; // Need triangles and arrows, in directory order
 
     // loop directory and find levels, then load them all. YOLO
     for (int i = 0, len = (int)directory.size(); i < len; ++i)
@@ -590,14 +894,14 @@ void init_wad(const char* filename, game_t& game)
             for (; i < len; ++i)
             {
                 const auto &dir_entry = directory[i];
-                try_load_lump("THINGS", f, dir_entry, map->things);
-                try_load_lump("LINEDEFS", f, dir_entry, map->linedefs);
-                try_load_lump("SIDEDEFS", f, dir_entry, map->sidedefs);
-                try_load_lump("VERTEXES", f, dir_entry, map->vertexes);
-                try_load_lump("SECTORS", f, dir_entry, map->map_sectors);
-                try_load_lump("SSECTORS", f, dir_entry, map->map_subsectors);
-                try_load_lump("NODES", f, dir_entry, map->map_nodes);
-                try_load_lump("SEGS", f, dir_entry, map->map_segs);
+                try_load_lump("THINGS", *wad, dir_entry, map->things);
+                try_load_lump("LINEDEFS", *wad, dir_entry, map->linedefs);
+                try_load_lump("SIDEDEFS", *wad, dir_entry, map->sidedefs);
+                if (!headless) try_load_lump("VERTEXES", *wad, dir_entry, map->vertexes); // Only drawn
+                try_load_lump("SECTORS", *wad, dir_entry, map->map_sectors);
+                try_load_lump("SSECTORS", *wad, dir_entry, map->map_subsectors);
+                try_load_lump("NODES", *wad, dir_entry, map->map_nodes);
+                try_load_lump("SEGS", *wad, dir_entry, map->map_segs);
                 if (strncmp(dir_entry.name, "BLOCKMAP", 8) == 0)
                 {
                     break;
@@ -648,6 +952,14 @@ void init_wad(const char* filename, game_t& game)
                 map->subsectors[j].sector = seg.front_sector;
             }
 
+            // Generation only needs things and the BSP to find sectors.
+            // Bounds, triangles and arrows are for the editor.
+            if (headless)
+            {
+                count_checks(map, game);
+                continue;
+            }
+
             map->bb[0] = map->vertexes[0].x;
             map->bb[1] = map->vertexes[0].y;
             map->bb[2] = map->vertexes[0].x;
@@ -660,99 +972,27 @@ void init_wad(const char* filename, game_t& game)
                 map->bb[3] = std::max(map->bb[3], map->vertexes[v].y);
             }
 
-            // Create "walls" used in triangulation step
-            std::vector<wall_t> map_walls;
-            for (int j = 0; j < (int)map->linedefs.size(); ++j)
-            {
-                const auto &linedef = map->linedefs[j];
-
-                if (linedef.front_sidedef != -1)
-                    create_wall(map_walls, map, j, linedef.front_sidedef);
-                if (linedef.back_sidedef != -1)
-                    create_wall(map_walls, map, j, linedef.back_sidedef);
-            }
-
-            // Triangulate
-            for (int j = 0; j < (int)map->sectors.size(); ++j)
-            {
-                triangulate_sector(map_walls, map, j);
-            }
-
-            // Create arrows
-            for (int j = 0; j < (int)map->linedefs.size(); ++j)
-            {
-                const auto& line_def = map->linedefs[j];
-                if (line_def.special_type != 0 && line_def.sector_tag != 0)
-                {
-                    arrow_t arrow;
-                    arrow.color = get_color_for_line_type(line_def.special_type);
-                    const auto& v1 = map->vertexes[line_def.start_vertex];
-                    const auto& v2 = map->vertexes[line_def.end_vertex];
-                    arrow.from = {
-                        (float)(v1.x + v2.x) * 0.5f,
-                        -(float)(v1.y + v2.y) * 0.5f
-                    };
-                    for (int k = 0; k < (int)map->map_sectors.size(); ++k)
-                    {
-                        const auto& map_sector = map->map_sectors[k];
-                        if (map_sector.tag == line_def.sector_tag)
-                        {
-                            Vector2 bbmin, bbmax;
-                            const auto& sector = map->sectors[k];
-                            if (sector.vertices.empty()) continue;
-                            bbmin = {
-                                (float)map->vertexes[sector.vertices[0]].x,
-                                -(float)map->vertexes[sector.vertices[0]].y
-                            };
-                            bbmax = bbmin;
-                            for (int l = 1; l < (int)sector.vertices.size(); ++l)
-                            {
-                                Vector2 pt = {
-                                    (float)map->vertexes[sector.vertices[l]].x,
-                                    -(float)map->vertexes[sector.vertices[l]].y
-                                };
-                                bbmin = onut::min(bbmin, pt);
-                                bbmax = onut::max(bbmax, pt);
-                            }
-                            arrow.to = (bbmin + bbmax) * 0.5f;
-                            map->arrows.push_back(arrow);
-                        }
-                    }
-                }
-            }
-
-            // Count checks
-            map->check_count = 0;
-            for (int j = 0, len = (int)map->things.size(); j < len; ++j)
-            {
-                const auto& thing = map->things[j];
-
-                // Count total thing count (Consider UV difficulty)
-                if (thing.flags & 0x0004)
-                    game.total_doom_types[thing.type]++;
-
-                if (thing.flags & 0x0010) continue; // Thing is not in single player
-                auto it = game.location_doom_types.find(thing.type);
-                if (it == game.location_doom_types.end()) continue;
-                map->check_count++;
-            }
+            editor_maps.push_back(map);
+            count_checks(map, game);
         }
     }
 
-    // Load palette
-    auto pal = load_lump(directory, "PLAYPAL", f);
-
-    // Load sprites for item requirements
-    for (auto& item_requirement : game.item_requirements)
+    if (!editor_maps.empty())
     {
-        if (item_requirement.sprite != "")
+        auto wad_hash = hash_wad(*wad);
+        if (!load_tri_cache(game, *wad, wad_hash, editor_maps))
         {
-            item_requirement.icon = load_sprite(directory, item_requirement.sprite.c_str(), f, pal.data());
+            parallel_for((int)editor_maps.size(), [&](int j) { triangulate_map(editor_maps[j]); });
+            save_tri_cache(game, *wad, wad_hash, editor_maps);
         }
+        for (auto map : editor_maps)
+            create_arrows(map);
     }
 
-    // close file
-    fclose(f);
+    // Sprites are only displayed by the editor, and decoded when first
+    // shown. Keep the mapping around for them.
+    if (!headless)
+        game.wad = wad;
 }
 
 
@@ -762,6 +1002,51 @@ void init_maps(game_t& game)
 }
 
 
+static int64_t pick_cell_key(int cx, int cy)
+{
+    return ((int64_t)cx << 32) | (uint32_t)cy;
+}
+
+
+void pick_grid_t::clear()
+{
+    cells.clear();
+}
+
+
+void pick_grid_t::insert(float x1, float y1, float x2, float y2, int id)
+{
+    int cx1 = (int)std::floor(x1 / cell_size);
+    int cy1 = (int)std::floor(y1 / cell_size);
+    int cx2 = (int)std::floor(x2 / cell_size);
+    int cy2 = (int)std::floor(y2 / cell_size);
+    for (int cy = cy1; cy <= cy2; ++cy)
+        for (int cx = cx1; cx <= cx2; ++cx)
+            cells[pick_cell_key(cx, cy)].push_back(id);
+}
+
+
+void pick_grid_t::query(float x1, float y1, float x2, float y2, std::vector<int>& ids) const
+{
+    ids.clear();
+    int cx1 = (int)std::floor(x1 / cell_size);
+    int cy1 = (int)std::floor(y1 / cell_size);
+    int cx2 = (int)std::floor(x2 / cell_size);
+    int cy2 = (int)std::floor(y2 / cell_size);
+    for (int cy = cy1; cy <= cy2; ++cy)
+    {
+        for (int cx = cx1; cx <= cx2; ++cx)
+        {
+            auto it = cells.find(pick_cell_key(cx, cy));
+            if (it != cells.end())
+                ids.insert(ids.end(), it->second.begin(), it->second.end());
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+
 int sector_at(int x, int y, map_t* map)
 {
     x = (int)((int16_t)x << 16);
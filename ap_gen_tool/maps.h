@@ -1,8 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
+#include <memory>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <onut/Color.h>
+#include <onut/Texture.h>
 #include <onut/Vector2.h>
 
 
@@ -153,8 +159,44 @@ struct map_t
 };
 
 
+// Sparse uniform grid for editor picking. Entries are inserted with their
+// world space bounds (x1 <= x2, y1 <= y2), query returns the ids of every
+// entry overlapping the query bounds, sorted and unique.
+struct pick_grid_t
+{
+    float cell_size = 256.0f;
+    std::unordered_map<int64_t, std::vector<int>> cells;
+
+    void clear();
+    void insert(float x1, float y1, float x2, float y2, int id);
+    void query(float x1, float y1, float x2, float y2, std::vector<int>& ids) const;
+};
+
+
+// Runs f(0) .. f(count - 1) over a few worker threads
+template<typename F>
+static void parallel_for(int count, const F& f)
+{
+    int worker_count = std::max(1, std::min(count, (int)std::thread::hardware_concurrency()));
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
+    for (int w = 0; w < worker_count; ++w)
+    {
+        workers.emplace_back([&]()
+        {
+            for (int i = next++; i < count; i = next++)
+                f(i);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+
 struct game_t;
+struct ap_item_def_t;
+struct wad_t;
 
 void init_maps(game_t& game);
+OTextureRef& get_item_icon(const game_t& game, const ap_item_def_t& item); // Decoded on first use
 int sector_at(int x, int y, map_t* map);
 subsector_t* point_in_subsector(int x, int y, map_t* map);
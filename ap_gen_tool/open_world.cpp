@@ -7,20 +7,25 @@
 #include <onut/SpriteBatch.h>
 #include <onut/Texture.h>
 #include <onut/Json.h>
+#include <onut/Log.h>
 #include <onut/Dialogs.h>
 #include <onut/Random.h>
 #include <onut/Timing.h>
 #include <onut/Font.h>
+#include <onut/VertexBuffer.h>
 
 #include <imgui/imgui.h>
 
 #include <vector>
 #include <set>
+#include <unordered_map>
 
 #include "maps.h"
 #include "generate.h"
 #include "defs.h"
 #include "data.h"
+#include "json_stream.h"
+#include "validate.h"
 
 
 enum class state_t
@@ -115,6 +120,50 @@ static int set_rule_connection = -1;
 static int mouse_hover_access = -1;
 static int mouse_hover_location = -1;
 
+// Bumped on every edit of the active map state, including the ones still
+// in progress (drags, painting) that only push_undo once done.
+static int edit_revision = 0;
+static std::map<std::string, logic_report_t> logic_reports; // By game name, from the last save
+
+// Hover picking. Things never move so their grid is built once per map.
+// Rules, bounding boxes and connections are re-indexed when edit_revision
+// changes.
+struct state_pick_index_t
+{
+    const map_state_t* state = nullptr;
+    int revision = -1;
+    pick_grid_t bbs;
+    pick_grid_t rules;
+    std::vector<int> rule_ids; // In picking order: world, exit, then regions last to first
+    pick_grid_t connections;
+    std::vector<std::pair<int, int>> connection_ids; // rule, connection. World, regions, then exit
+    std::vector<std::pair<Vector2, Vector2>> connection_segments;
+};
+static std::unordered_map<const map_t*, pick_grid_t> thing_pick_grids;
+static state_pick_index_t state_pick_index;
+static std::vector<int> pick_candidates;
+
+// Static level geometry, uploaded once per map the first time it's drawn.
+// Sector fills depend on region tints, so they are rebuilt after edits.
+struct level_vertex_t // Same layout as onut's 2D vertex shader input
+{
+    Vector2 position;
+    Vector2 tex_coord;
+    Color color;
+};
+struct level_render_cache_t
+{
+    OVertexBufferRef tool_lines; // Door and exit lines colored
+    OVertexBufferRef plain_lines;
+    uint32_t line_vertex_count = 0;
+    OVertexBufferRef sectors;
+    uint32_t sector_vertex_count = 0;
+    const map_state_t* sectors_state = nullptr;
+    int sectors_revision = -1;
+};
+static std::unordered_map<const map_t*, level_render_cache_t> level_render_caches;
+static OTextureRef white_texture;
+
 
 map_view_t* get_view(const level_index_t& idx)
 {
@@ -147,273 +196,167 @@ const char* get_doom_type_name(const level_index_t& idx, int doom_type)
 }
 
 
-Json::Value serialize_rules(const rule_region_t& rules)
+// Keys in alphabetical order, as jsoncpp used to write them
+void write_rules(json_writer_t& writer, const rule_region_t& rules)
 {
-    Json::Value json;
-
-    json["x"] = rules.x;
-    json["y"] = rules.y;
-
-    Json::Value connections_json(Json::arrayValue);
+    writer.begin_object();
+    writer.key("connections");
+    writer.begin_array();
     for (const auto& connection : rules.connections)
     {
-        Json::Value connection_json;
-
-        connection_json["target_region"] = connection.target_region;
-
-        {
-            Json::Value requirements_json(Json::arrayValue);
-            for (auto requirement : connection.requirements_or)
-            {
-                requirements_json.append(requirement);
-            }
-            connection_json["requirements_or"] = requirements_json;
-        }
-
-        {
-            Json::Value requirements_json(Json::arrayValue);
-            for (auto requirement : connection.requirements_and)
-            {
-                requirements_json.append(requirement);
-            }
-            connection_json["requirements_and"] = requirements_json;
-        }
-
-        connections_json.append(connection_json);
+        writer.begin_object();
+        writer.key("requirements_and");
+        writer.begin_array();
+        for (auto requirement : connection.requirements_and)
+            writer.value(requirement);
+        writer.end_array();
+        writer.key("requirements_or");
+        writer.begin_array();
+        for (auto requirement : connection.requirements_or)
+            writer.value(requirement);
+        writer.end_array();
+        writer.key("target_region");
+        writer.value(connection.target_region);
+        writer.end_object();
     }
-    json["connections"] = connections_json;
-
-    return json;
+    writer.end_array();
+    writer.key("x");
+    writer.value(rules.x);
+    writer.key("y");
+    writer.value(rules.y);
+    writer.end_object();
 }
 
 
-rule_region_t deserialize_rules(const Json::Value& json)
+std::string write_map(const map_state_t* state, int ep, int lvl)
 {
-    rule_region_t rules;
+    json_writer_t writer;
+    writer.begin_object();
+
+    writer.key("accesses");
+    writer.begin_array();
+    for (auto access : state->accesses)
+        writer.value(access);
+    writer.end_array();
+
+    writer.key("bbs");
+    writer.begin_array();
+    for (const auto& bb : state->bbs)
+    {
+        writer.begin_array();
+        writer.value(bb.x1);
+        writer.value(bb.y1);
+        writer.value(bb.x2);
+        writer.value(bb.y2);
+        writer.value(bb.region);
+        writer.end_array();
+    }
+    writer.end_array();
 
-    rules.x = json.get("x", 0).asInt();
-    rules.y = json.get("y", 0).asInt();
+    writer.key("ep");
+    writer.value(ep);
 
-    const auto& connections_json = json["connections"];
-    for (const auto& connection_json : connections_json)
+    writer.key("exit_rules");
+    write_rules(writer, state->exit_rules);
+
+    writer.key("locations");
+    writer.begin_array();
+    for (const auto& kv : state->locations)
     {
-        rule_connection_t connection;
+        writer.begin_object();
+        writer.key("check_sanity");
+        writer.value(kv.second.check_sanity);
+        writer.key("death_logic");
+        writer.value(kv.second.death_logic);
+        writer.key("description");
+        writer.value(kv.second.description);
+        writer.key("index");
+        writer.value(kv.first);
+        writer.key("name");
+        writer.value(kv.second.name);
+        writer.key("unreachable");
+        writer.value(kv.second.unreachable);
+        writer.end_object();
+    }
+    writer.end_array();
 
-        connection.target_region = connection_json.get("target_region", -1).asInt();
-        
-        {
-            const auto& requirements_json = connection_json["requirements_or"];
-            for (const auto& requirement_json : requirements_json)
-            {
-                connection.requirements_or.push_back(requirement_json.asInt());
-            }
-        }
-        {
-            const auto& requirements_json = connection_json["requirements_and"];
-            for (const auto& requirement_json : requirements_json)
-            {
-                connection.requirements_and.push_back(requirement_json.asInt());
-            }
-        }
+    writer.key("map");
+    writer.value(lvl);
 
-        rules.connections.push_back(connection);
+    writer.key("regions");
+    writer.begin_array();
+    for (const auto& region : state->regions)
+    {
+        writer.begin_object();
+        writer.key("name");
+        writer.value(region.name);
+        writer.key("rules");
+        write_rules(writer, region.rules);
+        writer.key("sectors");
+        writer.begin_array();
+        for (auto sectori : region.sectors)
+            writer.value(sectori);
+        writer.end_array();
+        writer.key("tint");
+        writer.begin_array();
+        writer.value(region.tint.r);
+        writer.value(region.tint.g);
+        writer.value(region.tint.b);
+        writer.value(region.tint.a);
+        writer.end_array();
+        writer.end_object();
     }
+    writer.end_array();
 
-    return rules;
+    writer.key("world_rules");
+    write_rules(writer, state->world_rules);
+
+    writer.end_object();
+    return std::move(writer.out);
 }
 
 
+// Only the levels edited since the last save are written again, the others
+// reuse their text from then
 void save(game_t* game)
 {
-    Json::Value _json;
-
-    Json::Value eps_json(Json::arrayValue);
-    int i = 0;
+    json_writer_t writer;
+    writer.begin_object();
+    writer.key("maps");
+    writer.begin_array();
     int ep = 0;
-    for (const auto& episode : game->episodes)
+    for (auto& episode : game->episodes)
     {
         int lvl = 0;
-        for (const auto& meta : episode)
+        for (auto& meta : episode)
         {
-            Json::Value _map_json;
-            Json::Value bbs_json(Json::arrayValue);
-            auto state = &meta.state;
-            for (const auto& bb : state->bbs)
-            {
-                Json::Value bb_json(Json::arrayValue);
-                bb_json.append(bb.x1);
-                bb_json.append(bb.y1);
-                bb_json.append(bb.x2);
-                bb_json.append(bb.y2);
-                bb_json.append(bb.region);
-                bbs_json.append(bb_json);
-            }
-            _map_json["bbs"] = bbs_json;
-
-            Json::Value regions_json(Json::arrayValue);
-            for (const auto& region : state->regions)
-            {
-                Json::Value region_json;
-                region_json["name"] = region.name;
-                region_json["tint"] = onut::serializeFloat4(&region.tint.r);
-
-                Json::Value sectors_json(Json::arrayValue);
-                for (auto sectori : region.sectors)
-                    sectors_json.append(sectori);
-                region_json["sectors"] = sectors_json;
-
-                region_json["rules"] = serialize_rules(region.rules);
-
-                regions_json.append(region_json);
-            }
-            _map_json["regions"] = regions_json;
-
-            Json::Value accesses_json(Json::arrayValue);
-            for (auto access : state->accesses)
+            if (meta.saved_revision != meta.history.revision)
             {
-                accesses_json.append(access);
+                meta.saved_json = write_map(&meta.state, ep, lvl);
+                meta.saved_revision = meta.history.revision;
             }
-            _map_json["accesses"] = accesses_json;
-
-            Json::Value locations_json(Json::arrayValue);
-            for (const auto& kv : state->locations)
-            {
-                Json::Value location_json;
-                location_json["index"] = kv.first;
-                location_json["death_logic"] = kv.second.death_logic;
-                location_json["unreachable"] = kv.second.unreachable;
-                location_json["check_sanity"] = kv.second.check_sanity;
-                location_json["name"] = kv.second.name;
-                location_json["description"] = kv.second.description;
-                locations_json.append(location_json);
-            }
-            _map_json["locations"] = locations_json;
-
-            _map_json["world_rules"] = serialize_rules(state->world_rules);
-            _map_json["exit_rules"] = serialize_rules(state->exit_rules);
-
-            _map_json["ep"] = ep;
-            _map_json["map"] = lvl;
-
-            eps_json.append(_map_json);
-
-            ++i;
+            writer.raw(meta.saved_json);
             ++lvl;
         }
         ++ep;
     }
-
-    _json["maps"] = eps_json;
+    writer.end_array();
+    writer.end_object();
+    writer.out += '\n';
 
     std::string filename = "data/" + game->name + ".json";
-    onut::saveJson(_json, filename, false);
-}
-
-
-void load(game_t* game)
-{
-    Json::Value json;
-    std::string filename = "data/" + game->name + ".json";
-    if (!onut::loadJson(json, filename))
-    {
-        onut::showMessageBox("Warning", "Warning: File not found. (If you just created this game, then it's fine. Otherwise, scream).\n" + filename);
-        return;
-    }
-
-    Json::Value json_maps = json["maps"];
-
-    for (const auto& _map_json : json_maps)
-    {
-        int ep = _map_json["ep"].asInt();
-        int lvl = _map_json["map"].asInt();
-        if (ep == 0 && lvl >= (int)game->episodes[ep].size())
-        {
-            // Could be in DOOM2's old format, remap it
-            for (auto& episode : game->episodes)
-            {
-                if (lvl < (int)episode.size())
-                {
-                    break;
-                }
-                lvl -= (int)episode.size();
-                ++ep;
-            }
-        }
-        auto meta = get_meta({game->name, ep, lvl});
-        auto _map_state = &meta->state;
-
-        const auto& bbs_json = _map_json["bbs"];
-        for (const auto& bb_json : bbs_json)
-        {
-            _map_state->bbs.push_back({
-                bb_json[0].asInt(),
-                bb_json[1].asInt(),
-                bb_json[2].asInt(),
-                bb_json[3].asInt(),
-                bb_json.isValidIndex(4) ? bb_json[4].asInt() : -1,
-            });
-        }
-
-        const auto& regions_json = _map_json["regions"];
-        for (const auto& region_json : regions_json)
-        {
-            region_t region;
-
-            region.name = region_json.get("name", "BAD_NAME").asString();
-            onut::deserializeFloat4(&region.tint.r, region_json["tint"]);
-
-            const auto& sectors_json = region_json["sectors"];
-            for (const auto& sector_json : sectors_json)
-                region.sectors.insert(sector_json.asInt());
-
-            region.rules = deserialize_rules(region_json["rules"]);
-
-            _map_state->regions.push_back(region);
-        }
-
-        const auto& accesses_json = _map_json["accesses"];
-        for (const auto& access_json : accesses_json)
-        {
-            _map_state->accesses.insert(access_json.asInt());
-        }
-
-        // Default locations from maps
-        auto map = &meta->map;
-        for (int i = 0; i < (int)map->things.size(); ++i)
-        {
-            const auto& thing = map->things[i];
-            if (thing.flags & 0x0010) continue; // Thing is not in single player
-            if (game->location_doom_types.find(thing.type) != game->location_doom_types.end())
-            {
-                location_t location;
-                _map_state->locations[i] = location;
-            }
-        }
-            
-        const auto& locations_json = _map_json["locations"];
-        for (const auto& location_json : locations_json)
-        {
-            location_t location;
-            int index = location_json["index"].asInt();
-            const auto& thing = map->things[index];
-            if (thing.flags & 0x0010) continue; // Thing is not in single player
-            if (game->location_doom_types.find(thing.type) != game->location_doom_types.end())
-            {
-                location.death_logic = location_json["death_logic"].asBool();
-                location.unreachable = location_json["unreachable"].asBool();
-                location.check_sanity = location_json["check_sanity"].asBool();
-                if (location.check_sanity) _map_state->check_sanity_count++;
-                location.name = location_json["name"].asString();
-                location.description = location_json["description"].asString();
-                _map_state->locations[index] = location;
-            }
-        }
-
-        _map_state->world_rules = deserialize_rules(_map_json["world_rules"]);
-        _map_state->exit_rules = deserialize_rules(_map_json["exit_rules"]);
-
-        meta->view.cam_pos = Vector2((float)(map->bb[2] + map->bb[0]) / 2, -(float)(map->bb[3] + map->bb[1]) / 2);
-    }
+    FILE* f = fopen(filename.c_str(), "wb");
+    if (!f || fwrite(writer.out.data(), 1, writer.out.size(), f) != writer.out.size())
+        report_error("Error", "Failed to save " + filename);
+    if (f) fclose(f);
+
+    auto& report = logic_reports[game->name];
+    report = validate_logic(game);
+    OLog(logic_report_summary(game, report));
+    for (const auto& error : report.errors)
+        OLogE(error);
+    for (const auto& location : report.unreachable)
+        OLogE("Unreachable: " + location);
 }
 
 
@@ -426,9 +369,13 @@ void update_window_title()
 // Undo/Redo shit
 void push_undo()
 {
+    edit_revision++;
+    if (!map_history->history.empty()) map_history->revision++; // The first one is the state as loaded
     if (map_history->history_point < (int)map_history->history.size() - 1)
         map_history->history.erase(map_history->history.begin() + (map_history->history_point + 1), map_history->history.end());
-    map_history->history.push_back(*map_state);
+    map_history->history.push_back(make_snapshot(*map_state, map_history->history.empty() ? nullptr : &map_history->history.back()));
+    if ((int)map_history->history.size() > MAP_HISTORY_MAX_SIZE)
+        map_history->history.pop_front();
     map_history->history_point = (int)map_history->history.size() - 1;
 }
 
@@ -445,6 +392,7 @@ void select_map(game_t* game, int ep, int map)
     map_state = get_state(active_level, active_source);
     map_view = get_view(active_level);
     map_history = get_history(active_level);
+    edit_revision++;
 
     update_window_title();
     if (map_history->history.empty())
@@ -457,7 +405,9 @@ void undo()
     if (map_history->history_point > 0)
     {
         map_history->history_point--;
-        *map_state = map_history->history[map_history->history_point];
+        restore_snapshot(map_history->history[map_history->history_point], *map_state);
+        edit_revision++;
+        map_history->revision++;
 
         map_state->check_sanity_count = 0;
         for (const auto& loc : map_state->locations)
@@ -471,7 +421,9 @@ void redo()
     if (map_history->history_point < (int)map_history->history.size() - 1)
     {
         map_history->history_point++;
-        *map_state = map_history->history[map_history->history_point];
+        restore_snapshot(map_history->history[map_history->history_point], *map_state);
+        edit_revision++;
+        map_history->revision++;
     }
 }
 
@@ -524,6 +476,8 @@ void init()
     ap_check_sanity_icon = OGetTexture("check_sanity.png");
     ap_player_start_icon = OGetTexture("player_start.png");
     ap_wing_icon = OGetTexture("wings.png");
+    uint32_t white = 0xFFFFFFFF;
+    white_texture = OTexture::createFromData((const uint8_t*)&white, {1, 1}, false);
 
     init_data();
 
@@ -561,6 +515,17 @@ void init()
     //    a->different = !(*a == *b);
     //}
 
+    // ap_gen_tool.exe python_py_out_dir cpp_py_out_dir poptracker_data_dir [--compact] --batch
+    // regenerates every game and quits without showing the editor
+    if (OArguments.size() >= 4 && OArguments.back() == "--batch")
+    {
+        gen_output_dirs_t dirs;
+        if (get_output_dirs(OArguments, dirs))
+            generate_all(dirs);
+        OQuit();
+        return;
+    }
+
     select_map(&games.begin()->second, 0, 0);
 
     regen();
@@ -759,6 +724,9 @@ bool test_bb(const bb_t& bb, const Vector2& pos, float zoom, int &edge)
 }
 
 
+static void update_state_pick_index();
+
+
 int get_bb_at(const Vector2& pos, float zoom, int &edge)
 {
     edge = -1;
@@ -767,7 +735,11 @@ int get_bb_at(const Vector2& pos, float zoom, int &edge)
         if (test_bb(map_state->bbs[map_state->selected_bb], pos, zoom, edge))
             return map_state->selected_bb;
     }
-    for (int i = 0; i < (int)map_state->bbs.size(); ++i)
+
+    update_state_pick_index();
+    float edge_size = 32.0f / zoom;
+    state_pick_index.bbs.query(pos.x - edge_size, pos.y - edge_size, pos.x + edge_size, pos.y + edge_size, pick_candidates);
+    for (auto i : pick_candidates)
     {
         if (test_bb(map_state->bbs[i], pos, zoom, edge))
             return i;
@@ -776,57 +748,67 @@ int get_bb_at(const Vector2& pos, float zoom, int &edge)
 }
 
 
-int get_loc_at(const Vector2& pos)
+static const pick_grid_t& get_thing_pick_grid(const map_t* map, const game_t* game)
 {
-    auto map = get_map(active_level);
-    auto game = get_game(active_level);
+    auto it = thing_pick_grids.find(map);
+    if (it != thing_pick_grids.end()) return it->second;
 
+    auto& grid = thing_pick_grids[map];
     int index = 0;
     for (const auto& thing : map->things)
     {
-        if (thing.flags & 0x0010)
+        if (!(thing.flags & 0x0010) && // Thing is not in single player
+            game->location_doom_types.find(thing.type) != game->location_doom_types.end())
         {
-            ++index;
-            continue; // Thing is not in single player
+            grid.insert((float)thing.x - 32.0f, (float)-thing.y - 32.0f,
+                        (float)thing.x + 32.0f, (float)-thing.y + 32.0f, index);
         }
-        if (game->location_doom_types.find(thing.type) != game->location_doom_types.end())
+        ++index;
+    }
+    return grid;
+}
+
+
+int get_loc_at(const Vector2& pos)
+{
+    auto map = get_map(active_level);
+    auto game = get_game(active_level);
+
+    // Candidates come out sorted, so the first hit is the lowest thing index
+    get_thing_pick_grid(map, game).query(pos.x, pos.y, pos.x, pos.y, pick_candidates);
+    for (auto index : pick_candidates)
+    {
+        const auto& thing = map->things[index];
+        Rect rect((float)thing.x - 32.0f, (float)-thing.y - 32.0f, 64.0f, 64.0f);
+        if (rect.Contains(pos))
         {
-            Rect rect((float)thing.x - 32.0f, (float)-thing.y - 32.0f, 64.0f, 64.0f);
-            if (rect.Contains(pos))
-            {
-                return index;
-            }
+            return index;
         }
-        ++index;
     }
 
     return -1;
 }
 
 
+static bool test_rules(const rule_region_t& rules, const Vector2& pos)
+{
+    return pos.x >= (float)rules.x - RULES_W * 0.5f &&
+           pos.x <= (float)rules.x + RULES_W * 0.5f &&
+           pos.y <= -(float)rules.y + RULES_H * 0.5f &&
+           pos.y >= -(float)rules.y - RULES_H * 0.5f;
+}
+
+
 // -1 = world, -2 = exit, -3 = not found
 int get_rule_at(const Vector2& pos)
 {
-    if (pos.x >= (float)map_state->world_rules.x - RULES_W * 0.5f &&
-        pos.x <= (float)map_state->world_rules.x + RULES_W * 0.5f &&
-        pos.y <= -(float)map_state->world_rules.y + RULES_H * 0.5f &&
-        pos.y >= -(float)map_state->world_rules.y - RULES_H * 0.5f)
-        return -1;
-
-    if (pos.x >= (float)map_state->exit_rules.x - RULES_W * 0.5f &&
-        pos.x <= (float)map_state->exit_rules.x + RULES_W * 0.5f &&
-        pos.y <= -(float)map_state->exit_rules.y + RULES_H * 0.5f &&
-        pos.y >= -(float)map_state->exit_rules.y - RULES_H * 0.5f)
-        return -2;
-
-    for (int i = (int)map_state->regions.size() - 1; i >= 0; --i)
+    update_state_pick_index();
+    state_pick_index.rules.query(pos.x, pos.y, pos.x, pos.y, pick_candidates);
+    for (auto i : pick_candidates)
     {
-        const auto& region = map_state->regions[i];
-        if (pos.x >= (float)region.rules.x - RULES_W * 0.5f &&
-            pos.x <= (float)region.rules.x + RULES_W * 0.5f &&
-            pos.y <= -(float)region.rules.y + RULES_H * 0.5f &&
-            pos.y >= -(float)region.rules.y - RULES_H * 0.5f)
-            return i;
+        int rule = state_pick_index.rule_ids[i];
+        if (test_rules(*get_rules(rule), pos))
+            return rule;
     }
 
     return -3;
@@ -910,9 +892,9 @@ double segment_point_distance(const Vector2& p1, const Vector2& p2, const Vector
 }
 
 
-// -1 = not found
-int get_connection_at(const Vector2& pos, const rule_region_t& rules)
+static void index_connections(int rule_idx)
 {
+    const auto& rules = *get_rules(rule_idx);
     Vector2 center((float)rules.x, -(float)rules.y);
 
     int i = 0;
@@ -924,39 +906,81 @@ int get_connection_at(const Vector2& pos, const rule_region_t& rules)
         Vector2 other_center((float)other_rules->x, -(float)other_rules->y);
         Vector2 from = get_rect_edge_pos(center, other_center, RULE_CONNECTION_OFFSET, false);
         Vector2 to = get_rect_edge_pos(other_center, center, RULE_CONNECTION_OFFSET, true);
-        auto d = segment_point_distance(from, to, {pos.x, pos.y});
-        if (d <= 24.0f / map_view->cam_zoom) return i;
+
+        int id = (int)state_pick_index.connection_ids.size();
+        state_pick_index.connection_ids.push_back({rule_idx, i});
+        state_pick_index.connection_segments.push_back({from, to});
+        state_pick_index.connections.insert(
+            std::min(from.x, to.x), std::min(from.y, to.y),
+            std::max(from.x, to.x), std::max(from.y, to.y), id);
         i++;
     }
-    return -1;
 }
 
-void get_connection_at(const Vector2& pos, int& rule, int& connection)
+
+static void index_rules(int rule_idx)
+{
+    const auto& rules = *get_rules(rule_idx);
+    int id = (int)state_pick_index.rule_ids.size();
+    state_pick_index.rule_ids.push_back(rule_idx);
+    state_pick_index.rules.insert(
+        (float)rules.x - RULES_W * 0.5f, -(float)rules.y - RULES_H * 0.5f,
+        (float)rules.x + RULES_W * 0.5f, -(float)rules.y + RULES_H * 0.5f, id);
+}
+
+
+// Ids are assigned in the same order the old linear scans tested things,
+// so the lowest candidate id that passes still wins.
+static void update_state_pick_index()
 {
-    connection = get_connection_at(pos, map_state->world_rules);
-    if (connection != -1)
+    auto& index = state_pick_index;
+    if (index.state == map_state && index.revision == edit_revision) return;
+    index.state = map_state;
+    index.revision = edit_revision;
+
+    index.bbs.clear();
+    for (int i = 0; i < (int)map_state->bbs.size(); ++i)
     {
-        rule = -1;
-        return;
+        const auto& bb = map_state->bbs[i];
+        index.bbs.insert((float)std::min(bb.x1, bb.x2), (float)-std::max(bb.y1, bb.y2),
+                         (float)std::max(bb.x1, bb.x2), (float)-std::min(bb.y1, bb.y2), i);
     }
 
+    index.rules.clear();
+    index.rule_ids.clear();
+    index_rules(-1);
+    index_rules(-2);
+    for (int i = (int)map_state->regions.size() - 1; i >= 0; --i)
+        index_rules(i);
+
+    index.connections.clear();
+    index.connection_ids.clear();
+    index.connection_segments.clear();
+    index_connections(-1);
     for (int i = 0; i < (int)map_state->regions.size(); ++i)
+        index_connections(i);
+    index_connections(-2);
+}
+
+
+void get_connection_at(const Vector2& pos, int& rule, int& connection)
+{
+    update_state_pick_index();
+
+    float max_dist = 24.0f / map_view->cam_zoom;
+    state_pick_index.connections.query(pos.x - max_dist, pos.y - max_dist, pos.x + max_dist, pos.y + max_dist, pick_candidates);
+    for (auto i : pick_candidates)
     {
-        connection = get_connection_at(pos, map_state->regions[i].rules);
-        if (connection != -1)
+        const auto& segment = state_pick_index.connection_segments[i];
+        auto d = segment_point_distance(segment.first, segment.second, {pos.x, pos.y});
+        if (d <= max_dist)
         {
-            rule = i;
+            rule = state_pick_index.connection_ids[i].first;
+            connection = state_pick_index.connection_ids[i].second;
             return;
         }
     }
 
-    connection = get_connection_at(pos, map_state->exit_rules);
-    if (connection != -1)
-    {
-        rule = -2;
-        return;
-    }
-
     rule = -3;
     connection = -1;
 }
@@ -1096,6 +1120,7 @@ void update()
                             for (auto& region : map_state->regions) region.sectors.erase(mouse_hover_sector);
                             map_state->regions[map_state->selected_region].sectors.insert(mouse_hover_sector);
                             painted = true;
+                            edit_revision++;
                         }
                     }
                     else if (OInputPressed(OMouse2))
@@ -1105,6 +1130,7 @@ void update()
                         {
                             for (auto& region : map_state->regions) region.sectors.erase(mouse_hover_sector);
                             painted = true;
+                            edit_revision++;
                         }
                     }
                     else if (OInputJustPressed(OKeyF) && map_state->selected_region != -1)
@@ -1114,6 +1140,7 @@ void update()
                         for (int i = 0, len = (int)get_map(active_level)->sectors.size(); i < len; ++i)
                             map_state->regions[map_state->selected_region].sectors.insert(i);
                         painted = true;
+                        edit_revision++;
                     }
                 }
                 else if (tool == tool_t::rules)
@@ -1226,6 +1253,7 @@ void update()
                     map_state->bbs[map_state->selected_bb].y2 = bb_on_down.y2 - (int)diff.y;
                     break;
             }
+            edit_revision++;
             if (OInputJustReleased(OMouse1))
             {
                 push_undo();
@@ -1239,6 +1267,7 @@ void update()
             auto rules = get_rules(moving_rule);
             rules->x = rule_pos_on_down.x + (int)diff.x;
             rules->y = rule_pos_on_down.y - (int)diff.y;
+            edit_revision++;
             if (OInputJustReleased(OMouse1))
             {
                 push_undo();
@@ -1428,7 +1457,7 @@ OTextureRef get_requirement_icon(game_t* game, int doom_type)
 {
     for (const auto& requirement : game->item_requirements)
         if (requirement.doom_type == doom_type)
-            return requirement.icon;
+            return get_item_icon(*game, requirement);
     return nullptr;
 }
 
@@ -1538,10 +1567,168 @@ void draw_rules()
 }
 
 
-void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool draw_tools)
+static Color get_line_color(const game_t* game, const map_linedefs_t& line, bool draw_tools)
 {
     Color bound_color(1.0f);
     Color step_color(0.35f);
+
+    Color color = bound_color;
+    if (line.back_sidedef != -1) color = step_color;
+    if (!draw_tools) return color;
+
+    bool is_heretic = game->codename == "heretic";
+    if (is_heretic)
+    {
+        if (line.special_type == LT_DR_DOOR_RED_OPEN_WAIT_CLOSE ||
+            line.special_type == LT_D1_DOOR_RED_OPEN_STAY ||
+            line.special_type == LT_SR_DOOR_RED_OPEN_STAY_FAST ||
+            line.special_type == LT_S1_DOOR_RED_OPEN_STAY_FAST)
+            color = game->key_colors[1];
+        else if (line.special_type == LT_DR_DOOR_YELLOW_OPEN_WAIT_CLOSE ||
+            line.special_type == LT_D1_DOOR_YELLOW_OPEN_STAY ||
+            line.special_type == LT_SR_DOOR_YELLOW_OPEN_STAY_FAST ||
+            line.special_type == LT_S1_DOOR_YELLOW_OPEN_STAY_FAST)
+            color = game->key_colors[0];
+        else if (line.special_type == LT_DR_DOOR_BLUE_OPEN_WAIT_CLOSE ||
+            line.special_type == LT_D1_DOOR_BLUE_OPEN_STAY ||
+            line.special_type == LT_SR_DOOR_BLUE_OPEN_STAY_FAST ||
+            line.special_type == LT_S1_DOOR_BLUE_OPEN_STAY_FAST)
+            color = game->key_colors[2];
+    }
+    else
+    {
+        if (line.special_type == LT_DR_DOOR_RED_OPEN_WAIT_CLOSE ||
+            line.special_type == LT_D1_DOOR_RED_OPEN_STAY ||
+            line.special_type == LT_SR_DOOR_RED_OPEN_STAY_FAST ||
+            line.special_type == LT_S1_DOOR_RED_OPEN_STAY_FAST)
+            color = game->key_colors[2];
+        else if (line.special_type == LT_DR_DOOR_YELLOW_OPEN_WAIT_CLOSE ||
+            line.special_type == LT_D1_DOOR_YELLOW_OPEN_STAY ||
+            line.special_type == LT_SR_DOOR_YELLOW_OPEN_STAY_FAST ||
+            line.special_type == LT_S1_DOOR_YELLOW_OPEN_STAY_FAST)
+            color = game->key_colors[1];
+        else if (line.special_type == LT_DR_DOOR_BLUE_OPEN_WAIT_CLOSE ||
+            line.special_type == LT_D1_DOOR_BLUE_OPEN_STAY ||
+            line.special_type == LT_SR_DOOR_BLUE_OPEN_STAY_FAST ||
+            line.special_type == LT_S1_DOOR_BLUE_OPEN_STAY_FAST)
+            color = game->key_colors[0];
+    }
+
+    if (line.special_type == LT_DR_DOOR_OPEN_WAIT_CLOSE_ALSO_MONSTERS ||
+        line.special_type == LT_DR_DOOR_OPEN_WAIT_CLOSE_FAST ||
+        line.special_type == LT_SR_DOOR_OPEN_WAIT_CLOSE ||
+        line.special_type == LT_SR_DOOR_OPEN_WAIT_CLOSE_FAST ||
+        line.special_type == LT_S1_DOOR_OPEN_WAIT_CLOSE ||
+        line.special_type == LT_S1_DOOR_OPEN_WAIT_CLOSE_FAST ||
+        line.special_type == LT_WR_DOOR_OPEN_WAIT_CLOSE ||
+        line.special_type == LT_WR_DOOR_OPEN_WAIT_CLOSE_FAST ||
+        line.special_type == LT_W1_DOOR_OPEN_WAIT_CLOSE_ALSO_MONSTERS ||
+        line.special_type == LT_W1_DOOR_OPEN_WAIT_CLOSE_FAST ||
+        line.special_type == LT_D1_DOOR_OPEN_STAY ||
+        line.special_type == LT_D1_DOOR_OPEN_STAY_FAST ||
+        line.special_type == LT_SR_DOOR_OPEN_STAY ||
+        line.special_type == LT_SR_DOOR_OPEN_STAY_FAST ||
+        line.special_type == LT_S1_DOOR_OPEN_STAY ||
+        line.special_type == LT_S1_DOOR_OPEN_STAY_FAST ||
+        line.special_type == LT_GR_DOOR_OPEN_STAY ||
+        line.special_type == LT_SR_DOOR_CLOSE_STAY ||
+        line.special_type == LT_SR_DOOR_CLOSE_STAY_FAST ||
+        line.special_type == LT_S1_DOOR_CLOSE_STAY ||
+        line.special_type == LT_S1_DOOR_CLOSE_STAY_FAST)
+        color = Color(0, 1, 1);
+    else if (line.special_type == LT_S1_EXIT_LEVEL ||
+        line.special_type == LT_W1_EXIT_LEVEL ||
+        line.special_type == LT_S1_EXIT_LEVEL_GOES_TO_SECRET_LEVEL ||
+        line.special_type == LT_W1_EXIT_LEVEL_GOES_TO_SECRET_LEVEL)
+        color = Color(0, 0.5f, 1);
+
+    return color;
+}
+
+
+static OVertexBufferRef create_line_buffer(const game_t* game, const map_t* map, bool draw_tools)
+{
+    std::vector<level_vertex_t> vertices;
+    vertices.reserve(map->linedefs.size() * 2 + map->arrows.size() * 6);
+
+    // Geometry
+    for (const auto& line : map->linedefs)
+    {
+        Color color = get_line_color(game, line, draw_tools);
+        vertices.push_back({Vector2(map->vertexes[line.start_vertex].x, -map->vertexes[line.start_vertex].y), Vector2::Zero, color});
+        vertices.push_back({Vector2(map->vertexes[line.end_vertex].x, -map->vertexes[line.end_vertex].y), Vector2::Zero, color});
+    }
+
+    // Arrows
+    for (const auto& arrow : map->arrows)
+    {
+        Vector2 dir = arrow.to - arrow.from;
+        dir.Normalize();
+        Vector2 right(-dir.y, dir.x);
+
+#define ARROW_HEAD_SIZE 8.0f
+        vertices.push_back({arrow.from, Vector2::Zero, arrow.color}); vertices.push_back({arrow.to, Vector2::Zero, arrow.color});
+        vertices.push_back({arrow.to, Vector2::Zero, arrow.color}); vertices.push_back({arrow.to - dir * ARROW_HEAD_SIZE - right * ARROW_HEAD_SIZE, Vector2::Zero, arrow.color});
+        vertices.push_back({arrow.to, Vector2::Zero, arrow.color}); vertices.push_back({arrow.to - dir * ARROW_HEAD_SIZE + right * ARROW_HEAD_SIZE, Vector2::Zero, arrow.color});
+    }
+
+    if (vertices.empty()) return nullptr;
+    return OVertexBuffer::createStatic(vertices.data(), (uint32_t)(vertices.size() * sizeof(level_vertex_t)));
+}
+
+
+static level_render_cache_t& get_level_render_cache(const game_t* game, const map_t* map)
+{
+    auto it = level_render_caches.find(map);
+    if (it != level_render_caches.end()) return it->second;
+
+    auto& cache = level_render_caches[map];
+    cache.tool_lines = create_line_buffer(game, map, true);
+    cache.plain_lines = create_line_buffer(game, map, false);
+    cache.line_vertex_count = (uint32_t)(map->linedefs.size() * 2 + map->arrows.size() * 6);
+    return cache;
+}
+
+
+static void update_sectors_buffer(level_render_cache_t& cache, const map_t* map, map_state_t* map_state)
+{
+    if (cache.sectors_state == map_state && cache.sectors_revision == edit_revision) return;
+    cache.sectors_state = map_state;
+    cache.sectors_revision = edit_revision;
+
+    std::vector<level_vertex_t> vertices;
+    int i = 0;
+    for (const auto& sector : map->sectors)
+    {
+        region_t* region = get_region_for_sector(map_state, i);
+        if (region)
+        {
+            Color color = region->tint * 0.5f;
+            for (auto v : sector.vertices)
+                vertices.push_back({Vector2(map->vertexes[v].x, -map->vertexes[v].y), Vector2::Zero, color});
+        }
+        ++i;
+    }
+
+    cache.sector_vertex_count = (uint32_t)vertices.size();
+    cache.sectors = vertices.empty() ? nullptr :
+        OVertexBuffer::createStatic(vertices.data(), (uint32_t)(vertices.size() * sizeof(level_vertex_t)));
+}
+
+
+static void draw_level_buffer(const OVertexBufferRef& vertex_buffer, uint32_t vertex_count, decltype(OPrimitiveLineList) primitive_mode, const Matrix& transform)
+{
+    if (!vertex_buffer || !vertex_count) return;
+    oRenderer->setupFor2D(transform);
+    oRenderer->renderStates.primitiveMode = primitive_mode;
+    oRenderer->renderStates.textures[0] = white_texture;
+    oRenderer->renderStates.vertexBuffer = vertex_buffer;
+    oRenderer->draw(vertex_count);
+}
+
+
+void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool draw_tools)
+{
     Color bb_color(0.5f);
 
     auto pb = oPrimitiveBatch.get();
@@ -1549,6 +1736,7 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
     auto game = get_game(idx);
     auto map = get_map(idx);
     auto map_state = get_state(idx, active_source);
+    auto& cache = get_level_render_cache(game, map);
     oRenderer->renderStates.backFaceCull = false;
 
     auto transform = 
@@ -1559,146 +1747,29 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
     // Sectors
     if (draw_tools)
     {
-        pb->begin(OPrimitiveTriangleList, nullptr, transform);
-        int i = 0;
-        for (const auto& sector : map->sectors)
-        {
-            region_t* region = get_region_for_sector(map_state, i);
-            if (region)
-            {
-                Color color = region->tint * 0.5f;
-                for (int i = 0, len = (int)sector.vertices.size(); i < len; i += 3)
-                {
-                    const auto& v1 = map->vertexes[sector.vertices[i + 0]];
-                    const auto& v2 = map->vertexes[sector.vertices[i + 1]];
-                    const auto& v3 = map->vertexes[sector.vertices[i + 2]];
-
-                    pb->draw(Vector2(v1.x, -v1.y), color);
-                    pb->draw(Vector2(v2.x, -v2.y), color);
-                    pb->draw(Vector2(v3.x, -v3.y), color);
-                }
-            }
-            ++i;
-        }
-        pb->end();
+        update_sectors_buffer(cache, map, map_state);
+        draw_level_buffer(cache.sectors, cache.sector_vertex_count, OPrimitiveTriangleList, transform);
     }
 
-    // Geometry
-    pb->begin(OPrimitiveLineList, nullptr, transform);
+    // Geometry and arrows
+    draw_level_buffer(draw_tools ? cache.tool_lines : cache.plain_lines, cache.line_vertex_count, OPrimitiveLineList, transform);
 
-    // Bounding box
-    //pb->draw(Vector2(map->bb[0], -map->bb[1]), bb_color); pb->draw(Vector2(map->bb[0], -map->bb[3]), bb_color);
-    //pb->draw(Vector2(map->bb[0], -map->bb[3]), bb_color); pb->draw(Vector2(map->bb[2], -map->bb[3]), bb_color);
-    //pb->draw(Vector2(map->bb[2], -map->bb[3]), bb_color); pb->draw(Vector2(map->bb[2], -map->bb[1]), bb_color);
-    //pb->draw(Vector2(map->bb[2], -map->bb[1]), bb_color); pb->draw(Vector2(map->bb[0], -map->bb[1]), bb_color);
+    // Overlays
+    pb->begin(OPrimitiveLineList, nullptr, transform);
 
-    // Geometry
-    int i = 0;
-    bool is_heretic = game->codename == "heretic";
-    for (const auto& line : map->linedefs)
+    // Hovered sector
+    if (draw_tools && tool == tool_t::region && mouse_hover_sector != -1)
     {
-        Color color = bound_color;
-        if (line.back_sidedef != -1) color = step_color;
-
-        if (draw_tools)
+        Color color(0, 1, 1);
+        for (const auto& line : map->linedefs)
         {
-            if (is_heretic)
+            if ((line.back_sidedef != -1 && map->sidedefs[line.back_sidedef].sector == mouse_hover_sector) ||
+                (line.front_sidedef != -1 && map->sidedefs[line.front_sidedef].sector == mouse_hover_sector))
             {
-                if (line.special_type == LT_DR_DOOR_RED_OPEN_WAIT_CLOSE ||
-                    line.special_type == LT_D1_DOOR_RED_OPEN_STAY ||
-                    line.special_type == LT_SR_DOOR_RED_OPEN_STAY_FAST ||
-                    line.special_type == LT_S1_DOOR_RED_OPEN_STAY_FAST)
-                    color = game->key_colors[1];
-                else if (line.special_type == LT_DR_DOOR_YELLOW_OPEN_WAIT_CLOSE ||
-                    line.special_type == LT_D1_DOOR_YELLOW_OPEN_STAY ||
-                    line.special_type == LT_SR_DOOR_YELLOW_OPEN_STAY_FAST ||
-                    line.special_type == LT_S1_DOOR_YELLOW_OPEN_STAY_FAST)
-                    color = game->key_colors[0];
-                else if (line.special_type == LT_DR_DOOR_BLUE_OPEN_WAIT_CLOSE ||
-                    line.special_type == LT_D1_DOOR_BLUE_OPEN_STAY ||
-                    line.special_type == LT_SR_DOOR_BLUE_OPEN_STAY_FAST ||
-                    line.special_type == LT_S1_DOOR_BLUE_OPEN_STAY_FAST)
-                    color = game->key_colors[2];
+                pb->draw(Vector2(map->vertexes[line.start_vertex].x, -map->vertexes[line.start_vertex].y), color);
+                pb->draw(Vector2(map->vertexes[line.end_vertex].x, -map->vertexes[line.end_vertex].y), color);
             }
-            else
-            {
-                if (line.special_type == LT_DR_DOOR_RED_OPEN_WAIT_CLOSE ||
-                    line.special_type == LT_D1_DOOR_RED_OPEN_STAY ||
-                    line.special_type == LT_SR_DOOR_RED_OPEN_STAY_FAST ||
-                    line.special_type == LT_S1_DOOR_RED_OPEN_STAY_FAST)
-                    color = game->key_colors[2];
-                else if (line.special_type == LT_DR_DOOR_YELLOW_OPEN_WAIT_CLOSE ||
-                    line.special_type == LT_D1_DOOR_YELLOW_OPEN_STAY ||
-                    line.special_type == LT_SR_DOOR_YELLOW_OPEN_STAY_FAST ||
-                    line.special_type == LT_S1_DOOR_YELLOW_OPEN_STAY_FAST)
-                    color = game->key_colors[1];
-                else if (line.special_type == LT_DR_DOOR_BLUE_OPEN_WAIT_CLOSE ||
-                    line.special_type == LT_D1_DOOR_BLUE_OPEN_STAY ||
-                    line.special_type == LT_SR_DOOR_BLUE_OPEN_STAY_FAST ||
-                    line.special_type == LT_S1_DOOR_BLUE_OPEN_STAY_FAST)
-                    color = game->key_colors[0];
-            }
-
-            if (line.special_type == LT_DR_DOOR_OPEN_WAIT_CLOSE_ALSO_MONSTERS ||
-                line.special_type == LT_DR_DOOR_OPEN_WAIT_CLOSE_FAST ||
-                line.special_type == LT_SR_DOOR_OPEN_WAIT_CLOSE ||
-                line.special_type == LT_SR_DOOR_OPEN_WAIT_CLOSE_FAST ||
-                line.special_type == LT_S1_DOOR_OPEN_WAIT_CLOSE ||
-                line.special_type == LT_S1_DOOR_OPEN_WAIT_CLOSE_FAST ||
-                line.special_type == LT_WR_DOOR_OPEN_WAIT_CLOSE ||
-                line.special_type == LT_WR_DOOR_OPEN_WAIT_CLOSE_FAST ||
-                line.special_type == LT_W1_DOOR_OPEN_WAIT_CLOSE_ALSO_MONSTERS ||
-                line.special_type == LT_W1_DOOR_OPEN_WAIT_CLOSE_FAST ||
-                line.special_type == LT_D1_DOOR_OPEN_STAY ||
-                line.special_type == LT_D1_DOOR_OPEN_STAY_FAST ||
-                line.special_type == LT_SR_DOOR_OPEN_STAY ||
-                line.special_type == LT_SR_DOOR_OPEN_STAY_FAST ||
-                line.special_type == LT_S1_DOOR_OPEN_STAY ||
-                line.special_type == LT_S1_DOOR_OPEN_STAY_FAST ||
-                line.special_type == LT_GR_DOOR_OPEN_STAY ||
-                line.special_type == LT_SR_DOOR_CLOSE_STAY ||
-                line.special_type == LT_SR_DOOR_CLOSE_STAY_FAST ||
-                line.special_type == LT_S1_DOOR_CLOSE_STAY ||
-                line.special_type == LT_S1_DOOR_CLOSE_STAY_FAST)
-                color = Color(0, 1, 1);
-            else if (line.special_type == LT_S1_EXIT_LEVEL ||
-                line.special_type == LT_W1_EXIT_LEVEL ||
-                line.special_type == LT_S1_EXIT_LEVEL_GOES_TO_SECRET_LEVEL ||
-                line.special_type == LT_W1_EXIT_LEVEL_GOES_TO_SECRET_LEVEL)
-                color = Color(0, 0.5f, 1);
         }
-
-        if (draw_tools && tool == tool_t::region)
-        {
-            if (mouse_hover_sector != -1)
-            {
-                if ((line.back_sidedef != -1 && map->sidedefs[line.back_sidedef].sector == mouse_hover_sector) ||
-                    (line.front_sidedef != -1 && map->sidedefs[line.front_sidedef].sector == mouse_hover_sector))
-                {
-                    color = Color(0, 1, 1);
-                }
-            }
-        }
-        
-        pb->draw(Vector2(map->vertexes[line.start_vertex].x, -map->vertexes[line.start_vertex].y), color);
-        pb->draw(Vector2(map->vertexes[line.end_vertex].x, -map->vertexes[line.end_vertex].y), color);
-
-        ++i;
-    }
-
-    // Arrows
-    for (const auto& arrow : map->arrows)
-    {
-        pb->draw(arrow.from, arrow.color);
-        pb->draw(arrow.to, arrow.color);
-
-        Vector2 dir = arrow.to - arrow.from;
-        dir.Normalize();
-        Vector2 right(-dir.y, dir.x);
-
-#define ARROW_HEAD_SIZE 8.0f
-        pb->draw(arrow.to, arrow.color); pb->draw(arrow.to - dir * ARROW_HEAD_SIZE - right * ARROW_HEAD_SIZE, arrow.color);
-        pb->draw(arrow.to, arrow.color); pb->draw(arrow.to - dir * ARROW_HEAD_SIZE + right * ARROW_HEAD_SIZE, arrow.color);
     }
 
     // Bounding boxes
@@ -1762,7 +1833,7 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
     // Items
     sb->begin(transform);
     oRenderer->renderStates.sampleFiltering = OFilterNearest;
-    i = -1;
+    int i = -1;
     for (const auto& thing : map->things)
     {
         ++i;
@@ -1874,7 +1945,9 @@ void renderUI()
             if (ImGui::MenuItem(("Generate " + game->name).c_str()))
             {
                 save(game);
-                generate(game);
+                gen_output_dirs_t dirs;
+                if (get_output_dirs(OArguments, dirs))
+                    generate(game, dirs);
             }
         }
         ImGui::Separator();
@@ -2076,7 +2149,7 @@ void renderUI()
                     push_undo();
                 }
 
-                ImGui::ColorEdit4("Tint", &region.tint.r, ImGuiColorEditFlags_NoInputs);
+                if (ImGui::ColorEdit4("Tint", &region.tint.r, ImGuiColorEditFlags_NoInputs)) edit_revision++;
                 if (ImGui::IsItemDeactivatedAfterEdit()) push_undo();
             }
         }
@@ -2109,8 +2182,10 @@ void renderUI()
 
                         for (const auto& requirement : game->item_requirements)
                         {
-                            float biggest = requirement.icon->getSizef().x;
-                            ImVec2 img_scale(requirement.icon->getSizef().x / biggest * 64.0f, requirement.icon->getSizef().y / biggest * 64.0f);
+                            auto& icon = get_item_icon(*game, requirement);
+                            if (!icon) continue;
+                            float biggest = icon->getSizef().x;
+                            ImVec2 img_scale(icon->getSizef().x / biggest * 64.0f, icon->getSizef().y / biggest * 64.0f);
 
                             {
                                 ImVec4 tint(0.25f, 0.25f, 0.25f, 1);
@@ -2124,7 +2199,7 @@ void renderUI()
 
                                 if (ImGui::ImageButton(
                                     ("or_btn_" + std::to_string(requirement.doom_type)).c_str(), // str_id
-                                    (ImTextureID)&requirement.icon, // user_texture_id
+                                    (ImTextureID)&icon, // user_texture_id
                                     img_scale, // size
                                     ImVec2(0, 0), // uv0
                                     ImVec2(1, 1), // uv1
@@ -2155,7 +2230,7 @@ void renderUI()
                                 }
                                 if (ImGui::ImageButton(
                                     ("and_btn_" + std::to_string(requirement.doom_type)).c_str(), // str_id
-                                    (ImTextureID)&requirement.icon, // user_texture_id
+                                    (ImTextureID)&icon, // user_texture_id
                                     img_scale, // size
                                     ImVec2(0, 0), // uv0
                                     ImVec2(1, 1), // uv1
@@ -2239,6 +2314,31 @@ void renderUI()
         }
         ImGui::End();
 
+        if (ImGui::Begin("Logic"))
+        {
+            auto game = get_game(active_level);
+            auto it = logic_reports.find(game->name);
+            if (it == logic_reports.end())
+            {
+                ImGui::Text("Save to validate");
+            }
+            else
+            {
+                const auto& report = it->second;
+                ImGui::Text("Locations: %i", report.location_count);
+                ImGui::Text("Spheres: %i", report.sphere_count);
+                ImGui::Text("Only out of vanilla order: %i", report.vanilla_stuck_count);
+                ImGui::Text("Solved in %.2f ms", report.ms);
+                ImGui::Separator();
+                for (const auto& error : report.errors)
+                    ImGui::TextColored(ImVec4(1, 0.5f, 0, 1), "%s", error.c_str());
+                ImGui::Text("Unreachable: %i", (int)report.unreachable.size());
+                for (const auto& location : report.unreachable)
+                    ImGui::TextColored(ImVec4(1, 0, 0, 1), "%s", location.c_str());
+            }
+        }
+        ImGui::End();
+
         if (ImGui::Begin("Location"))
         {
             if (map_state->selected_location != -1)
@@ -0,0 +1,307 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+//
+// *Reachability of every location, from the rules drawn in the editor*
+//
+// Requirements are bits (One per game->item_requirements), so a connection
+// is a couple of masks and a level's reachable regions is a worklist over
+// them. Keys and unique progressions are per level, they have their own
+// bits in each level. Weapons and such are shared by every level.
+//
+
+#include "validate.h"
+#include "data.h"
+#include "maps.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <cinttypes>
+#include <map>
+
+
+struct logic_connection_t
+{
+    int target_region = -1;
+    uint64_t ands = 0;
+    uint64_t ors = 0;
+};
+
+
+struct logic_level_t
+{
+    meta_t* meta = nullptr;
+    std::vector<logic_connection_t> hub; // From world_rules
+    std::vector<std::vector<logic_connection_t>> regions;
+    uint64_t owned = 0; // Level's own bits, global ones are kept apart
+    std::vector<bool> reached;
+    std::vector<int> worklist;
+};
+
+
+struct logic_location_t
+{
+    int level = -1;
+    int region = -1; // -1 when the sector isn't in any region
+    std::string name;
+    uint64_t gives = 0; // What's there in vanilla
+    bool gives_global = false;
+    int sphere = -1;
+};
+
+
+static bool can_pass(const logic_connection_t& connection, uint64_t owned)
+{
+    if ((connection.ands & owned) != connection.ands) return false;
+    return !connection.ors || (connection.ors & owned);
+}
+
+
+// Same filtering as Rules.py: deathlogic is ignored, pro connections only
+// exist with the pro option which we don't validate.
+static bool compile_connection(const rule_connection_t& connection, const std::map<int, int>& bits, logic_connection_t& out, std::string& error)
+{
+    out.target_region = connection.target_region;
+    for (auto doom_type : connection.requirements_and)
+    {
+        if (doom_type == -2) return false;
+        if (doom_type < 0) continue;
+        auto it = bits.find(doom_type);
+        if (it == bits.end())
+        {
+            error = "Unknown requirement " + std::to_string(doom_type);
+            continue;
+        }
+        out.ands |= 1ull << it->second;
+    }
+    for (auto doom_type : connection.requirements_or)
+    {
+        if (doom_type < 0) continue;
+        auto it = bits.find(doom_type);
+        if (it == bits.end())
+        {
+            error = "Unknown requirement " + std::to_string(doom_type);
+            continue;
+        }
+        out.ors |= 1ull << it->second;
+    }
+    return true;
+}
+
+
+static void solve_level(logic_level_t& level, uint64_t global_owned)
+{
+    uint64_t owned = level.owned | global_owned;
+    auto& reached = level.reached;
+    auto& worklist = level.worklist;
+    reached.assign(level.regions.size(), false);
+    worklist.clear();
+
+    auto visit = [&](const logic_connection_t& connection)
+    {
+        int target = connection.target_region;
+        if (target < 0 || target >= (int)reached.size()) return; // Hub or exit
+        if (reached[target] || !can_pass(connection, owned)) return;
+        reached[target] = true;
+        worklist.push_back(target);
+    };
+
+    for (const auto& connection : level.hub)
+        visit(connection);
+    while (!worklist.empty())
+    {
+        int region = worklist.back();
+        worklist.pop_back();
+        for (const auto& connection : level.regions[region])
+            visit(connection);
+    }
+}
+
+
+logic_report_t validate_logic(game_t* game)
+{
+    auto start_time = std::chrono::steady_clock::now();
+    logic_report_t report;
+
+    std::map<int, int> bits;
+    uint64_t level_bits = 0;
+    for (const auto& requirement : game->item_requirements)
+    {
+        if (requirement.doom_type < 0 || bits.count(requirement.doom_type)) continue;
+        int bit = (int)bits.size();
+        if (bit >= 64)
+        {
+            report.errors.push_back("More than 64 requirements, can't validate");
+            return report;
+        }
+        bits[requirement.doom_type] = bit;
+    }
+    for (const auto& key : game->keys)
+        level_bits |= 1ull << bits[key.item.doom_type];
+    for (const auto& item : game->unique_progressions)
+        level_bits |= 1ull << bits[item.doom_type];
+    uint64_t all_bits = 0;
+    for (const auto& kv : bits)
+        all_bits |= 1ull << kv.second;
+
+    std::vector<logic_level_t> levels;
+    std::vector<logic_location_t> locations;
+    for (auto& episode : game->episodes)
+    {
+        for (auto& meta : episode)
+        {
+            int level_i = (int)levels.size();
+            levels.emplace_back();
+            auto& level = levels.back();
+            level.meta = &meta;
+            auto state = &meta.state;
+            auto map = &meta.map;
+
+            std::string error;
+            for (const auto& connection : state->world_rules.connections)
+            {
+                logic_connection_t compiled;
+                if (compile_connection(connection, bits, compiled, error))
+                    level.hub.push_back(compiled);
+            }
+
+            std::vector<int> sector_regions(map->sectors.size(), -1);
+            int exit_region = -1;
+            level.regions.resize(state->regions.size());
+            for (int i = 0, len = (int)state->regions.size(); i < len; ++i)
+            {
+                const auto& region = state->regions[i];
+                for (auto sectori : region.sectors)
+                    if (sectori >= 0 && sectori < (int)sector_regions.size())
+                        sector_regions[sectori] = i;
+                for (const auto& connection : region.rules.connections)
+                {
+                    if (connection.target_region == -2 && exit_region == -1)
+                        exit_region = i;
+                    logic_connection_t compiled;
+                    if (compile_connection(connection, bits, compiled, error))
+                        level.regions[i].push_back(compiled);
+                }
+            }
+            if (!error.empty())
+                report.errors.push_back(meta.name + ": " + error);
+
+            // Same locations as generate() puts in the world
+            for (int i = 0, len = (int)map->things.size(); i < len; ++i)
+            {
+                const auto& thing = map->things[i];
+                if (thing.flags & 0x0010) continue; // Thing is not in single player
+                auto loc_it = game->location_doom_types.find(thing.type);
+                if (loc_it == game->location_doom_types.end()) continue;
+                auto state_it = state->locations.find(i);
+                if (state_it != state->locations.end() && state_it->second.unreachable) continue;
+
+                logic_location_t location;
+                location.level = level_i;
+                location.name = meta.name + " - " + loc_it->second + " (Thing " + std::to_string(i) + ")";
+                if (!map->subsectors.empty())
+                {
+                    int sector = sector_at(thing.x, thing.y, map);
+                    if (sector >= 0 && sector < (int)sector_regions.size())
+                        location.region = sector_regions[sector];
+                }
+                auto bit_it = bits.find(thing.type);
+                if (bit_it != bits.end())
+                {
+                    location.gives = 1ull << bit_it->second;
+                    location.gives_global = !(location.gives & level_bits);
+                }
+                locations.push_back(location);
+            }
+
+            if (exit_region != -1)
+            {
+                logic_location_t location;
+                location.level = level_i;
+                location.region = exit_region;
+                location.name = meta.name + " - Exit";
+                locations.push_back(location);
+            }
+            else
+            {
+                report.errors.push_back(meta.name + ": No region connects to the exit");
+            }
+        }
+    }
+    report.location_count = (int)locations.size();
+
+    // Spheres, with every level unlocked and items where they are in the
+    // original game. Each sphere is what the previous ones give access to.
+    uint64_t global_owned = 0;
+    std::vector<int> sphere_locations;
+    while (true)
+    {
+        for (auto& level : levels)
+            solve_level(level, global_owned);
+
+        sphere_locations.clear();
+        for (int i = 0, len = (int)locations.size(); i < len; ++i)
+        {
+            auto& location = locations[i];
+            if (location.sphere != -1 || location.region == -1) continue;
+            if (levels[location.level].reached[location.region])
+                sphere_locations.push_back(i);
+        }
+        if (sphere_locations.empty()) break;
+
+        for (auto i : sphere_locations)
+        {
+            auto& location = locations[i];
+            location.sphere = report.sphere_count;
+            if (location.gives_global)
+                global_owned |= location.gives;
+            else
+                levels[location.level].owned |= location.gives;
+        }
+        report.sphere_count++;
+    }
+
+    // Then with everything. Whatever is left can never be reached.
+    for (auto& level : levels)
+    {
+        level.owned = all_bits;
+        solve_level(level, all_bits);
+    }
+    for (const auto& location : locations)
+    {
+        if (location.sphere != -1) continue;
+        if (location.region == -1)
+            report.unreachable.push_back(location.name + ", not in a region");
+        else if (!levels[location.level].reached[location.region])
+            report.unreachable.push_back(location.name);
+        else
+            report.vanilla_stuck_count++;
+    }
+
+    report.ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    return report;
+}
+
+
+std::string logic_report_summary(const game_t* game, const logic_report_t& report)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s: %i locations, %i spheres, %i unreachable, %i only out of vanilla order (%.2f ms)",
+        game->name.c_str(),
+        report.location_count,
+        report.sphere_count,
+        (int)report.unreachable.size(),
+        report.vanilla_stuck_count,
+        report.ms);
+    return buf;
+}
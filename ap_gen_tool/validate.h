@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+struct game_t;
+
+
+struct logic_report_t
+{
+    int location_count = 0; // Including exits
+    int sphere_count = 0; // Vanilla placement, see validate_logic()
+    int vanilla_stuck_count = 0; // Reachable with every item, but not from vanilla placement
+    std::vector<std::string> unreachable; // Even with every item
+    std::vector<std::string> errors; // Rules that can't be generated properly
+    float ms = 0.0f;
+};
+
+
+// Solves the region graphs the same way Archipelago will read Regions.py and
+// Rules.py (Without the pro option), no python round trip.
+logic_report_t validate_logic(game_t* game);
+std::string logic_report_summary(const game_t* game, const logic_report_t& report);
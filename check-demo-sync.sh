@@ -0,0 +1,44 @@
+#!/bin/sh
+# Plays demos with the reference and the optimized options, and checks
+# that every game tic and every frame comes out the same.
+#
+#   check-demo-sync.sh <doom binary> <iwad> [demo ...]
+#
+# The demos are IWAD lumps or .lmp files, demo1 to demo3 by default.
+# REFERENCE_ARGS and OPTIMIZED_ARGS override the options compared.
+if [ $# -lt 2 ] ; then
+	echo "usage: $0 <doom binary> <iwad> [demo ...]"
+	exit 1
+fi
+DOOM=$1
+IWAD=$2
+shift 2
+if [ $# -eq 0 ] ; then
+	set -- demo1 demo2 demo3
+fi
+REFERENCE_ARGS=${REFERENCE_ARGS-"-nosimd -nommap -noprefetch"}
+OPTIMIZED_ARGS=${OPTIMIZED_ARGS-"-rthreads 4 -aithreads 4 -textureatlas"}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+FAILED=0
+for DEMO in "$@" ; do
+	for MODE in -simbench -benchmark ; do
+		REF="$TMP/$(basename "$DEMO")$MODE.txt"
+		if ! "$DOOM" -iwad "$IWAD" -nogui $MODE "$DEMO" $REFERENCE_ARGS \
+			-bench-sync "$REF" > "$TMP/log.txt" 2>&1 ; then
+			echo "$DEMO $MODE: reference run failed"
+			cat "$TMP/log.txt"
+			FAILED=1
+			continue
+		fi
+		if "$DOOM" -iwad "$IWAD" -nogui $MODE "$DEMO" $OPTIMIZED_ARGS \
+			-bench-syncref "$REF" > "$TMP/log.txt" 2>&1 ; then
+			echo "$DEMO $MODE: in sync"
+		else
+			echo "$DEMO $MODE: out of sync"
+			grep -e '^Sync:' -e 'D_Benchmark' "$TMP/log.txt"
+			FAILED=1
+		fi
+	done
+done
+exit $FAILED
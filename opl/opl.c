@@ -50,6 +50,7 @@ static opl_driver_t *driver = NULL;
 static int init_stage_reg_writes = 1;
 
 unsigned int opl_sample_rate = 22050;
+opl_mix_stats_t opl_mix_stats = NULL;
 
 //
 // Init/shutdown code.
@@ -177,6 +178,11 @@ void OPL_SetSampleRate(unsigned int rate)
     opl_sample_rate = rate;
 }
 
+void OPL_SetMixStats(opl_mix_stats_t stats)
+{
+    opl_mix_stats = stats;
+}
+
 void OPL_WritePort(opl_port_t port, unsigned int value)
 {
     if (driver != NULL)
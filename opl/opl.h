@@ -149,5 +149,12 @@ void OPL_Delay(uint64_t us);
 
 void OPL_SetPaused(int paused);
 
+// Set a function to be told how long the software emulator took to
+// generate each buffer of samples, in microseconds. NULL for none.
+
+typedef void (*opl_mix_stats_t)(unsigned int samples, unsigned int us);
+
+void OPL_SetMixStats(opl_mix_stats_t stats);
+
 #endif
 
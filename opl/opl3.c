@@ -372,6 +372,14 @@ static void OPL3_EnvelopeCalc(opl3_slot *slot)
     Bit8u reset = 0;
     slot->eg_out = slot->eg_rout + (slot->reg_tl << 2)
                  + (slot->eg_ksl >> kslshift[slot->reg_ksl]) + *slot->trem;
+    // [AP] Keyed off and fully decayed: whatever the rates, the state
+    // below ends up unchanged
+    if (!slot->key && slot->eg_rout == 0x1ff)
+    {
+        slot->pg_reset = 0;
+        slot->eg_gen = envelope_gen_num_release;
+        return;
+    }
     if (slot->key && slot->eg_gen == envelope_gen_num_release)
     {
         reset = 1;
@@ -608,6 +616,55 @@ static void OPL3_PhaseGenerate(opl3_slot *slot)
     chip->noise = (noise >> 1) | (n_bit << 22);
 }
 
+// [AP] Same as OPL3_PhaseGenerate, for the slots rhythm mode doesn't
+// touch.
+
+static void OPL3_PhaseGenerateMelodic(opl3_slot *slot)
+{
+    opl3_chip *chip;
+    Bit16u f_num;
+    Bit32u basefreq;
+    Bit8u n_bit;
+    Bit32u noise;
+
+    chip = slot->chip;
+    f_num = slot->channel->f_num;
+    if (slot->reg_vib)
+    {
+        Bit8s range;
+        Bit8u vibpos;
+
+        range = (f_num >> 7) & 7;
+        vibpos = chip->vibpos;
+
+        if (!(vibpos & 3))
+        {
+            range = 0;
+        }
+        else if (vibpos & 1)
+        {
+            range >>= 1;
+        }
+        range >>= chip->vibshift;
+
+        if (vibpos & 4)
+        {
+            range = -range;
+        }
+        f_num += range;
+    }
+    basefreq = (f_num << slot->channel->block) >> 1;
+    slot->pg_phase_out = (Bit16u)(slot->pg_phase >> 9);
+    if (slot->pg_reset)
+    {
+        slot->pg_phase = 0;
+    }
+    slot->pg_phase += (basefreq * mt[slot->reg_mult]) >> 1;
+    noise = chip->noise;
+    n_bit = ((noise >> 14) ^ noise) & 0x01;
+    chip->noise = (noise >> 1) | (n_bit << 22);
+}
+
 //
 // Slot
 //
@@ -662,6 +719,29 @@ static void OPL3_SlotWriteE0(opl3_slot *slot, Bit8u data)
 
 static void OPL3_SlotGenerate(opl3_slot *slot)
 {
+    Bit16u phase;
+
+    // [AP] Attenuated this much, OPL3_EnvelopeCalcExp always gives 0, so
+    // only the sign of the waveform is left
+    if (slot->eg_out >= 0x180)
+    {
+        phase = (slot->pg_phase_out + *slot->mod) & 0x3ff;
+        switch (slot->reg_wf)
+        {
+        case 0:
+        case 6:
+        case 7:
+            slot->out = (phase & 0x200) ? -1 : 0;
+            break;
+        case 4:
+            slot->out = ((phase & 0x300) == 0x100) ? -1 : 0;
+            break;
+        default:
+            slot->out = 0;
+            break;
+        }
+        return;
+    }
     slot->out = envelope_sin[slot->reg_wf](slot->pg_phase_out + *slot->mod, slot->eg_out);
 }
 
@@ -678,6 +758,23 @@ static void OPL3_SlotCalcFB(opl3_slot *slot)
     slot->prout = slot->out;
 }
 
+// [AP] One sample of a slot
+
+static void OPL3_SlotProcess(opl3_slot *slot)
+{
+    OPL3_SlotCalcFB(slot);
+    OPL3_EnvelopeCalc(slot);
+    if (slot->slot_num == 13 || slot->slot_num == 16 || slot->slot_num == 17)
+    {
+        OPL3_PhaseGenerate(slot);
+    }
+    else
+    {
+        OPL3_PhaseGenerateMelodic(slot);
+    }
+    OPL3_SlotGenerate(slot);
+}
+
 //
 // Channel
 //
@@ -1054,10 +1151,7 @@ void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 
     for (ii = 0; ii < 15; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_SlotGenerate(&chip->slot[ii]);
+        OPL3_SlotProcess(&chip->slot[ii]);
     }
 
     chip->mixbuff[0] = 0;
@@ -1073,20 +1167,14 @@ void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 
     for (ii = 15; ii < 18; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_SlotGenerate(&chip->slot[ii]);
+        OPL3_SlotProcess(&chip->slot[ii]);
     }
 
     buf[0] = OPL3_ClipSample(chip->mixbuff[0]);
 
     for (ii = 18; ii < 33; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_SlotGenerate(&chip->slot[ii]);
+        OPL3_SlotProcess(&chip->slot[ii]);
     }
 
     chip->mixbuff[1] = 0;
@@ -1102,10 +1190,7 @@ void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 
     for (ii = 33; ii < 36; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_SlotGenerate(&chip->slot[ii]);
+        OPL3_SlotProcess(&chip->slot[ii]);
     }
 
     if ((chip->timer & 0x3f) == 0x3f)
@@ -54,6 +54,10 @@ typedef struct
 
 extern unsigned int opl_sample_rate;
 
+// Called after each buffer of emulated output, if set.
+
+extern opl_mix_stats_t opl_mix_stats;
+
 
 #if (defined(__i386__) || defined(__x86_64__)) && defined(HAVE_IOPERM)
 extern opl_driver_t opl_linux_driver;
@@ -39,6 +39,11 @@
 
 #define MAX_SOUND_SLICE_TIME 100 /* ms */
 
+// [AP] Commands queued for the audio thread; enough for a full
+// register initialization.
+
+#define MAX_COMMANDS 4096
+
 typedef struct
 {
     unsigned int rate;        // Number of times the timer is advanced per sec.
@@ -48,17 +53,46 @@ typedef struct
 } opl_timer_t;
 
 // When the callback mutex is locked using OPL_Lock, callback functions
-// are not invoked.
+// are not invoked. The audio thread only tries to take it, and leaves
+// the callbacks for its next pass if it can't.
 
 static SDL_mutex *callback_mutex = NULL;
 
-// Queue of callbacks waiting to be invoked.
+// Queue of callbacks waiting to be invoked. Only touched by the audio
+// thread.
 
 static opl_callback_queue_t *callback_queue;
 
-// Mutex used to control access to the callback queue.
+// [AP] The chip, the timers and the callback queue belong to the audio
+// thread. Other threads send it commands through a single-producer,
+// single-consumer ring, which it runs before each stretch of output.
 
-static SDL_mutex *callback_queue_mutex = NULL;
+typedef enum
+{
+    OPL_COMMAND_WRITE,
+    OPL_COMMAND_SET_CALLBACK,
+    OPL_COMMAND_CLEAR_CALLBACKS,
+    OPL_COMMAND_ADJUST_CALLBACKS,
+    OPL_COMMAND_SET_PAUSED
+} opl_command_type_t;
+
+typedef struct
+{
+    opl_command_type_t type;
+    unsigned int reg_num, value;
+    uint64_t us;
+    opl_callback_t callback;
+    void *data;
+    float factor;
+} opl_command_t;
+
+static opl_command_t commands[MAX_COMMANDS];
+static SDL_atomic_t command_head, command_tail;
+
+// Set by the audio thread on its first pass.
+
+static SDL_threadID audio_thread;
+static SDL_atomic_t audio_thread_known;
 
 // Current time, in us since startup:
 
@@ -82,9 +116,11 @@ static int opl_opl3mode;
 
 static uint8_t *mix_buffer = NULL;
 
-// Register number that was written.
+// Register number that was written, by the audio thread and by the
+// others.
 
 static int register_num = 0;
+static int queued_register_num = 0;
 
 // Timers; DBOPL does not do timer stuff itself.
 
@@ -105,6 +141,110 @@ static int SDLIsInitialized(void)
     return Mix_QuerySpec(&freq, &format, &channels);
 }
 
+static void WriteRegister(unsigned int reg_num, unsigned int value);
+
+static int OnAudioThread(void)
+{
+    return SDL_AtomicGet(&audio_thread_known)
+        && SDL_ThreadID() == audio_thread;
+}
+
+static void RunCommand(const opl_command_t *command)
+{
+    switch (command->type)
+    {
+        case OPL_COMMAND_WRITE:
+            WriteRegister(command->reg_num, command->value);
+            break;
+
+        case OPL_COMMAND_SET_CALLBACK:
+            OPL_Queue_Push(callback_queue, command->callback, command->data,
+                           current_time - pause_offset + command->us);
+            break;
+
+        case OPL_COMMAND_CLEAR_CALLBACKS:
+            OPL_Queue_Clear(callback_queue);
+            break;
+
+        case OPL_COMMAND_ADJUST_CALLBACKS:
+            OPL_Queue_AdjustCallbacks(callback_queue, current_time,
+                                      command->factor);
+            break;
+
+        case OPL_COMMAND_SET_PAUSED:
+            opl_sdl_paused = command->value;
+            break;
+    }
+}
+
+// Run the commands sent since last time. Audio thread only.
+
+static void RunCommands(void)
+{
+    int head = SDL_AtomicGet(&command_head);
+    int tail = SDL_AtomicGet(&command_tail);
+
+    while (head != tail)
+    {
+        RunCommand(&commands[head]);
+        head = (head + 1) % MAX_COMMANDS;
+    }
+
+    SDL_AtomicSet(&command_head, head);
+}
+
+// Run a command now on the audio thread, or send it there. The sender
+// only waits if the ring is full.
+
+static void SendCommand(const opl_command_t *command)
+{
+    int tail, next;
+
+    if (OnAudioThread())
+    {
+        RunCommand(command);
+        return;
+    }
+
+    tail = SDL_AtomicGet(&command_tail);
+    next = (tail + 1) % MAX_COMMANDS;
+
+    while (next == SDL_AtomicGet(&command_head))
+    {
+        SDL_Delay(1);
+    }
+
+    commands[tail] = *command;
+    SDL_AtomicSet(&command_tail, next);
+}
+
+// Wait until the audio thread has run every command sent so far, so a
+// status read sees the timers they set. Like OPL_Delay, this needs the
+// audio thread to be running.
+
+static void WaitForCommands(void)
+{
+    int tail;
+
+    if (OnAudioThread())
+    {
+        return;
+    }
+
+    tail = SDL_AtomicGet(&command_tail);
+
+    while (SDL_AtomicGet(&command_head) != tail)
+    {
+        SDL_Delay(1);
+    }
+}
+
+static int CallbackDue(void)
+{
+    return !OPL_Queue_IsEmpty(callback_queue)
+        && current_time >= OPL_Queue_Peek(callback_queue) + pause_offset;
+}
+
 // Advance time by the specified number of samples, invoking any
 // callback functions as appropriate.
 
@@ -114,8 +254,6 @@ static void AdvanceTime(unsigned int nsamples)
     void *callback_data;
     uint64_t us;
 
-    SDL_LockMutex(callback_queue_mutex);
-
     // Advance time.
 
     us = ((uint64_t) nsamples * OPL_SECOND) / mixing_freq;
@@ -127,10 +265,21 @@ static void AdvanceTime(unsigned int nsamples)
     }
 
     // Are there callbacks to invoke now?  Keep invoking them
-    // until there are no more left.
+    // until there are no more left.  We must hold callback_mutex
+    // when we invoke them, so that the control thread can use
+    // OPL_Lock() to prevent callbacks from being invoked.  If it
+    // has it, they're left for the next pass rather than waiting.
 
-    while (!OPL_Queue_IsEmpty(callback_queue)
-        && current_time >= OPL_Queue_Peek(callback_queue) + pause_offset)
+    if (!CallbackDue() || SDL_TryLockMutex(callback_mutex) != 0)
+    {
+        return;
+    }
+
+    // The control thread may have cleared the queue before unlocking.
+
+    RunCommands();
+
+    while (CallbackDue())
     {
         // Pop the callback from the queue to invoke it.
 
@@ -139,23 +288,10 @@ static void AdvanceTime(unsigned int nsamples)
             break;
         }
 
-        // The mutex stuff here is a bit complicated.  We must
-        // hold callback_mutex when we invoke the callback (so that
-        // the control thread can use OPL_Lock() to prevent callbacks
-        // from being invoked), but we must not be holding
-        // callback_queue_mutex, as the callback must be able to
-        // call OPL_SetCallback to schedule new callbacks.
-
-        SDL_UnlockMutex(callback_queue_mutex);
-
-        SDL_LockMutex(callback_mutex);
         callback(callback_data);
-        SDL_UnlockMutex(callback_mutex);
-
-        SDL_LockMutex(callback_queue_mutex);
     }
 
-    SDL_UnlockMutex(callback_queue_mutex);
+    SDL_UnlockMutex(callback_mutex);
 }
 
 // Call the OPL emulator code to fill the specified buffer.
@@ -180,24 +316,33 @@ static void OPL_Mix_Callback(int chan, void *stream, int len, void *udata)
 {
     unsigned int filled, buffer_samples;
     Uint8 *buffer = (Uint8*)stream;
+    Uint64 start = opl_mix_stats ? SDL_GetPerformanceCounter() : 0;
 
     // Repeatedly call the OPL emulator update function until the buffer is
     // full.
     filled = 0;
     buffer_samples = len / 4;
 
+    if (!SDL_AtomicGet(&audio_thread_known))
+    {
+        audio_thread = SDL_ThreadID();
+        SDL_AtomicSet(&audio_thread_known, 1);
+    }
+
     while (filled < buffer_samples)
     {
         uint64_t next_callback_time;
         uint64_t nsamples;
 
-        SDL_LockMutex(callback_queue_mutex);
+        RunCommands();
 
         // Work out the time until the next callback waiting in
         // the callback queue must be invoked.  We can then fill the
-        // buffer with this many samples.
+        // buffer with this many samples.  Callbacks already due are
+        // waiting for OPL_Unlock().
 
-        if (opl_sdl_paused || OPL_Queue_IsEmpty(callback_queue))
+        if (opl_sdl_paused || OPL_Queue_IsEmpty(callback_queue)
+         || CallbackDue())
         {
             nsamples = buffer_samples - filled;
         }
@@ -214,8 +359,6 @@ static void OPL_Mix_Callback(int chan, void *stream, int len, void *udata)
             }
         }
 
-        SDL_UnlockMutex(callback_queue_mutex);
-
         // Add emulator output to buffer.
 
         FillBuffer(buffer + filled * 4, nsamples);
@@ -225,6 +368,13 @@ static void OPL_Mix_Callback(int chan, void *stream, int len, void *udata)
 
         AdvanceTime(nsamples);
     }
+
+    if (opl_mix_stats != NULL)
+    {
+        opl_mix_stats(buffer_samples,
+                      (SDL_GetPerformanceCounter() - start) * 1000000
+                        / SDL_GetPerformanceFrequency());
+    }
 }
 
 static void OPL_SDL_Shutdown(void)
@@ -254,11 +404,9 @@ static void OPL_SDL_Shutdown(void)
         callback_mutex = NULL;
     }
 
-    if (callback_queue_mutex != NULL)
-    {
-        SDL_DestroyMutex(callback_queue_mutex);
-        callback_queue_mutex = NULL;
-    }
+    SDL_AtomicSet(&command_head, 0);
+    SDL_AtomicSet(&command_tail, 0);
+    SDL_AtomicSet(&audio_thread_known, 0);
 }
 
 static unsigned int GetSliceSize(void)
@@ -351,7 +499,6 @@ static int OPL_SDL_Init(unsigned int port_base)
     opl_opl3mode = 0;
 
     callback_mutex = SDL_CreateMutex();
-    callback_queue_mutex = SDL_CreateMutex();
 
     // Set postmix that adds the OPL music. This is deliberately done
     // as a postmix and not using Mix_HookMusic() as the latter disables
@@ -370,6 +517,11 @@ static unsigned int OPL_SDL_PortRead(opl_port_t port)
         return 0xff;
     }
 
+    // [AP] Writes still in the ring would otherwise be missed here, such
+    // as the timer reset that ends OPL_Detect before it runs again.
+
+    WaitForCommands();
+
     if (timer1.enabled && current_time > timer1.expire_time)
     {
         result |= 0x80;   // Either have expired
@@ -448,6 +600,31 @@ static void WriteRegister(unsigned int reg_num, unsigned int value)
 
 static void OPL_SDL_PortWrite(opl_port_t port, unsigned int value)
 {
+    opl_command_t command;
+
+    // [AP] Other threads' writes go through the ring.
+
+    if (!OnAudioThread())
+    {
+        if (port == OPL_REGISTER_PORT)
+        {
+            queued_register_num = value;
+        }
+        else if (port == OPL_REGISTER_PORT_OPL3)
+        {
+            queued_register_num = value | 0x100;
+        }
+        else if (port == OPL_DATA_PORT)
+        {
+            command.type = OPL_COMMAND_WRITE;
+            command.reg_num = queued_register_num;
+            command.value = value;
+            SendCommand(&command);
+        }
+
+        return;
+    }
+
     if (port == OPL_REGISTER_PORT)
     {
         register_num = value;
@@ -462,20 +639,27 @@ static void OPL_SDL_PortWrite(opl_port_t port, unsigned int value)
     }
 }
 
+// [AP] Callbacks scheduled from other threads count from when the audio
+// thread gets the command, at the start of its next stretch of output.
+
 static void OPL_SDL_SetCallback(uint64_t us, opl_callback_t callback,
                                 void *data)
 {
-    SDL_LockMutex(callback_queue_mutex);
-    OPL_Queue_Push(callback_queue, callback, data,
-                   current_time - pause_offset + us);
-    SDL_UnlockMutex(callback_queue_mutex);
+    opl_command_t command;
+
+    command.type = OPL_COMMAND_SET_CALLBACK;
+    command.us = us;
+    command.callback = callback;
+    command.data = data;
+    SendCommand(&command);
 }
 
 static void OPL_SDL_ClearCallbacks(void)
 {
-    SDL_LockMutex(callback_queue_mutex);
-    OPL_Queue_Clear(callback_queue);
-    SDL_UnlockMutex(callback_queue_mutex);
+    opl_command_t command;
+
+    command.type = OPL_COMMAND_CLEAR_CALLBACKS;
+    SendCommand(&command);
 }
 
 static void OPL_SDL_Lock(void)
@@ -490,14 +674,20 @@ static void OPL_SDL_Unlock(void)
 
 static void OPL_SDL_SetPaused(int paused)
 {
-    opl_sdl_paused = paused;
+    opl_command_t command;
+
+    command.type = OPL_COMMAND_SET_PAUSED;
+    command.value = paused;
+    SendCommand(&command);
 }
 
 static void OPL_SDL_AdjustCallbacks(float factor)
 {
-    SDL_LockMutex(callback_queue_mutex);
-    OPL_Queue_AdjustCallbacks(callback_queue, current_time, factor);
-    SDL_UnlockMutex(callback_queue_mutex);
+    opl_command_t command;
+
+    command.type = OPL_COMMAND_ADJUST_CALLBACKS;
+    command.factor = factor;
+    SendCommand(&command);
 }
 
 opl_driver_t opl_sdl_driver =
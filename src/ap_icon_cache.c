@@ -0,0 +1,214 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Downscaled AP notification icons, shared by Doom and Heretic.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ap_icon_cache.h"
+#include "i_swap.h"
+#include "m_fixed.h"
+#include "v_patch.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+#define ICON_CACHE_SIZE 512 // Power of two, well above the number of item sprites
+
+typedef struct
+{
+    int lumpnum;
+    pixel_t *pixels; // NULL if the slot is empty
+} icon_cache_entry_t;
+
+static icon_cache_entry_t icon_cache[ICON_CACHE_SIZE];
+
+
+// Open addressing with linear probing. Returns the entry for lumpnum, or
+// the empty slot where it should go. NULL when full.
+static icon_cache_entry_t *FindSlot(int lumpnum)
+{
+    unsigned int i = ((unsigned int)lumpnum * 2654435761u) & (ICON_CACHE_SIZE - 1);
+    int probes;
+
+    for (probes = 0; probes < ICON_CACHE_SIZE; ++probes)
+    {
+        icon_cache_entry_t *entry = &icon_cache[i];
+        if (entry->pixels == NULL || entry->lumpnum == lumpnum)
+            return entry;
+        i = (i + 1) & (ICON_CACHE_SIZE - 1);
+    }
+
+    return NULL;
+}
+
+
+static int NearestPaletteIndex(const byte *playpal, int r, int g, int b)
+{
+    int best = 1, best_diff = INT_MAX;
+    int i;
+
+    // Index 0 is transparent in icons, don't pick it
+    for (i = 1; i < 256; ++i)
+    {
+        int dr = r - playpal[i * 3 + 0];
+        int dg = g - playpal[i * 3 + 1];
+        int db = b - playpal[i * 3 + 2];
+        int diff = dr * dr + dg * dg + db * db;
+
+        if (diff < best_diff)
+        {
+            best = i;
+            best_diff = diff;
+            if (diff == 0) break;
+        }
+    }
+
+    return best;
+}
+
+
+// Decodes the patch posts into a width * height image, 0 where transparent
+static byte *DecodePatch(const patch_t *patch, int width, int height)
+{
+    byte *raw = calloc(width * height, 1);
+    int x;
+
+    for (x = 0; x < width; ++x)
+    {
+        const column_t *column = (const column_t *)((const byte *)patch + LONG(patch->columnofs[x]));
+
+        // step through the posts in a column
+        while (column->topdelta != 0xff)
+        {
+            const byte *source = (const byte *)column + 3;
+            int y;
+
+            for (y = 0; y < column->length; ++y)
+            {
+                int py = y + column->topdelta;
+                if (py < height)
+                    raw[py * width + x] = source[y];
+            }
+
+            column = (const column_t *)((const byte *)column + column->length + 4);
+        }
+    }
+
+    return raw;
+}
+
+
+// Box filters the patch down to fit block_size, centered. A block pixel is
+// opaque if at least half of the source pixels it covers are, and takes the
+// palette color closest to their average.
+static pixel_t *BuildIcon(int lumpnum, int block_size)
+{
+    const patch_t *patch = W_CacheLumpNum(lumpnum, PU_CACHE);
+    const byte *playpal = W_CacheLumpName("PLAYPAL", PU_CACHE);
+    int width = SHORT(patch->width);
+    int height = SHORT(patch->height);
+    int max_size = width > height ? width : height;
+    fixed_t step, offsetx, offsety;
+    pixel_t *pixels;
+    byte *raw;
+    int bx, by;
+
+    if (width <= 0 || height <= 0)
+        return NULL;
+
+    raw = DecodePatch(patch, width, height);
+    pixels = malloc(block_size * block_size * sizeof(pixel_t));
+
+    step = FRACUNIT;
+    if (max_size > block_size)
+        step = (max_size << FRACBITS) / block_size;
+    offsetx = ((width << FRACBITS) - block_size * step) / 2;
+    offsety = ((height << FRACBITS) - block_size * step) / 2;
+
+    for (by = 0; by < block_size; ++by)
+    {
+        int y0 = (offsety + by * step) >> FRACBITS;
+        int y1 = (offsety + (by + 1) * step) >> FRACBITS;
+        if (y1 <= y0) y1 = y0 + 1;
+
+        for (bx = 0; bx < block_size; ++bx)
+        {
+            int x0 = (offsetx + bx * step) >> FRACBITS;
+            int x1 = (offsetx + (bx + 1) * step) >> FRACBITS;
+            int total, opaque = 0, first = 0, uniform = 1;
+            int r = 0, g = 0, b = 0;
+            int x, y;
+            if (x1 <= x0) x1 = x0 + 1;
+
+            // Outside the patch counts as transparent coverage
+            total = (x1 - x0) * (y1 - y0);
+
+            for (y = y0 < 0 ? 0 : y0; y < y1 && y < height; ++y)
+            {
+                for (x = x0 < 0 ? 0 : x0; x < x1 && x < width; ++x)
+                {
+                    int index = raw[y * width + x];
+                    if (!index) continue;
+
+                    if (!opaque) first = index;
+                    else if (index != first) uniform = 0;
+                    ++opaque;
+                    r += playpal[index * 3 + 0];
+                    g += playpal[index * 3 + 1];
+                    b += playpal[index * 3 + 2];
+                }
+            }
+
+            if (opaque * 2 < total)
+                pixels[by * block_size + bx] = 0;
+            else if (uniform)
+                pixels[by * block_size + bx] = first;
+            else
+                pixels[by * block_size + bx] = NearestPaletteIndex(playpal, r / opaque, g / opaque, b / opaque);
+        }
+    }
+
+    free(raw);
+    return pixels;
+}
+
+
+const pixel_t *ap_icon_cache_get(int lumpnum, int block_size)
+{
+    icon_cache_entry_t *entry;
+
+    if (lumpnum < 0)
+        return NULL;
+
+    entry = FindSlot(lumpnum);
+    if (!entry)
+        return NULL;
+
+    if (!entry->pixels)
+    {
+        entry->pixels = BuildIcon(lumpnum, block_size);
+        if (entry->pixels)
+            entry->lumpnum = lumpnum;
+    }
+
+    return entry->pixels;
+}
+
+
+void ap_icon_cache_precache(const char *lumpname, int block_size)
+{
+    ap_icon_cache_get(W_CheckNumForName(lumpname), block_size);
+}
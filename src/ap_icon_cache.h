@@ -0,0 +1,32 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Downscaled AP notification icons, shared by Doom and Heretic.
+//
+
+#ifndef __AP_ICON_CACHE__
+#define __AP_ICON_CACHE__
+
+#include "doomtype.h"
+
+// Returns block_size * block_size palette indices, 0 is transparent.
+// Icons are built once per lump and kept for the whole session, callers
+// must always pass the same block_size. NULL if the lump is not a patch
+// or the cache is full.
+const pixel_t *ap_icon_cache_get(int lumpnum, int block_size);
+
+// Builds the icon ahead of time so the first notification doesn't hitch.
+void ap_icon_cache_precache(const char *lumpname, int block_size);
+
+#endif
@@ -0,0 +1,203 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Bounded log of AP chat lines waiting to be shown.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ap_msg_log.h"
+#include "m_misc.h"
+
+
+static char lines[AP_MSG_LOG_CAPACITY][AP_MSG_LOG_LINE_LENGTH + 1];
+static unsigned int head = 0; // Oldest line
+static unsigned int count = 0;
+
+static FILE *log_file = NULL;
+static char *log_path = NULL;
+
+
+static void RotateLogFile(void)
+{
+    char *old_path;
+
+    fclose(log_file);
+    old_path = M_StringJoin(log_path, ".1", NULL);
+    M_remove(old_path);
+    M_rename(log_path, old_path);
+    free(old_path);
+    log_file = M_fopen(log_path, "a");
+}
+
+
+// Color codes are only meaningful on screen, leave them out of the file
+static void WriteLogLine(const char *line, int len)
+{
+    int i;
+
+    for (i = 0; i < len; ++i)
+    {
+        if (line[i] == '~' && i + 1 < len && line[i + 1] >= '0' && line[i + 1] <= '9')
+        {
+            ++i;
+            continue;
+        }
+        fputc(line[i], log_file);
+    }
+    fputc('\n', log_file);
+    fflush(log_file);
+
+    if (ftell(log_file) >= AP_MSG_LOG_ROTATE_SIZE)
+        RotateLogFile();
+}
+
+
+void ap_msg_log_open(const char *path)
+{
+    ap_msg_log_close();
+
+    log_file = M_fopen(path, "a");
+    if (!log_file)
+    {
+        printf("APDOOM: Can't open message log %s\n", path);
+        return;
+    }
+    log_path = M_StringDuplicate(path);
+}
+
+
+void ap_msg_log_close(void)
+{
+    if (log_file)
+        fclose(log_file);
+    log_file = NULL;
+    free(log_path);
+    log_path = NULL;
+}
+
+
+void ap_msg_log_push(const char *line, int len)
+{
+    char *slot;
+
+    if (len > AP_MSG_LOG_LINE_LENGTH)
+        len = AP_MSG_LOG_LINE_LENGTH;
+
+    if (log_file)
+        WriteLogLine(line, len);
+
+    if (count == AP_MSG_LOG_CAPACITY)
+    {
+        head = (head + 1) & (AP_MSG_LOG_CAPACITY - 1);
+        count--;
+    }
+
+    slot = lines[(head + count) & (AP_MSG_LOG_CAPACITY - 1)];
+    memcpy(slot, line, len);
+    slot[len] = '\0';
+    count++;
+}
+
+
+// One pass, the width of the line so far is kept as it grows. Going back
+// to the last space only rescans the word that didn't fit.
+void ap_msg_log_push_wrapped(const char *message, const int *widths, int max_width)
+{
+    char line[AP_MSG_LOG_LINE_LENGTH + 1];
+    int len = strlen(message);
+    int i = 0; // Line start
+    int j = 0; // Line end
+    int word_start = 0;
+    int w = 0; // Width of message[i..j)
+    int escape = 0; // message[j - 1] starts a color code
+
+    line[0] = '~';
+    line[1] = '2';
+    while (i < len)
+    {
+        if (message[j] == ' ')
+        {
+            word_start = j;
+        }
+        if (message[j] != '\n')
+        {
+            if (w >= max_width && word_start == i)
+            {
+                if (j > i) --j;
+            }
+            else
+            {
+                if (w < max_width && (j - i) + 2 < AP_MSG_LOG_LINE_LENGTH && j < len)
+                {
+                    if (escape)
+                        escape = 0;
+                    else if (message[j] == '~' && message[j + 1] >= '0' && message[j + 1] <= '9')
+                        escape = 1;
+                    else
+                        w += widths[(unsigned char)message[j]];
+                    j++;
+                    continue;
+                }
+                if (j < len) j = word_start;
+            }
+        }
+        else
+        {
+            j++;
+            word_start = j;
+        }
+        memcpy(line + 2, message + i, j - i);
+        ap_msg_log_push(line, (j - i) + 2);
+        i = j;
+        while (message[i] == ' ')
+        {
+            i++;
+        }
+        j = i;
+        word_start = i;
+        w = 0;
+        escape = 0;
+    }
+}
+
+
+const char *ap_msg_log_front(void)
+{
+    return count ? lines[head] : NULL;
+}
+
+
+void ap_msg_log_pop(void)
+{
+    if (!count)
+        return;
+    head = (head + 1) & (AP_MSG_LOG_CAPACITY - 1);
+    count--;
+}
+
+
+int ap_msg_log_count(void)
+{
+    return count;
+}
+
+
+void ap_msg_log_clear(void)
+{
+    head = 0;
+    count = 0;
+}
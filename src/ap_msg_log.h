@@ -0,0 +1,46 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Bounded log of AP chat lines waiting to be shown. Optionally every
+//	line is also appended to a rotating file on disk, so nothing is lost
+//	when the queue overflows.
+//
+
+#ifndef __AP_MSG_LOG__
+#define __AP_MSG_LOG__
+
+#define AP_MSG_LOG_CAPACITY 512 // Power of two
+#define AP_MSG_LOG_LINE_LENGTH 80
+
+// Also write lines to path. It is moved to path.1 once it grows past
+// AP_MSG_LOG_ROTATE_SIZE bytes.
+#define AP_MSG_LOG_ROTATE_SIZE (1024 * 1024)
+void ap_msg_log_open(const char *path);
+void ap_msg_log_close(void);
+
+// When full, the oldest pending line is dropped to make room
+void ap_msg_log_push(const char *line, int len);
+
+// Pushes message cut into lines narrower than max_width. widths is the
+// width of each glyph, by unsigned char. "~N" color codes take no room.
+// Lines break after spaces when they can, and all start white (~2).
+void ap_msg_log_push_wrapped(const char *message, const int *widths, int max_width);
+
+// Oldest pending line, NULL if empty
+const char *ap_msg_log_front(void);
+void ap_msg_log_pop(void);
+int ap_msg_log_count(void);
+void ap_msg_log_clear(void);
+
+#endif
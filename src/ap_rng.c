@@ -0,0 +1,49 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Seedable PRNG (PCG32) for AP level randomization. Gives the same
+//	sequence on every platform, unlike rand().
+//
+
+#include "ap_rng.h"
+
+
+void ap_rng_seed(ap_rng_t *rng, uint64_t seed)
+{
+    rng->state = 0;
+    rng->inc = (seed << 1) | 1;
+    ap_rng_next(rng);
+    rng->state += seed;
+    ap_rng_next(rng);
+}
+
+
+uint32_t ap_rng_next(ap_rng_t *rng)
+{
+    uint64_t oldstate = rng->state;
+    uint32_t xorshifted, rot;
+
+    rng->state = oldstate * 6364136223846793005ULL + rng->inc;
+    xorshifted = (uint32_t)(((oldstate >> 18) ^ oldstate) >> 27);
+    rot = (uint32_t)(oldstate >> 59);
+
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+
+int ap_rng_range(ap_rng_t *rng, int n)
+{
+    // Multiply-shift instead of modulo, no division and no modulo bias to speak of
+    return (int)(((uint64_t)ap_rng_next(rng) * (uint32_t)n) >> 32);
+}
@@ -0,0 +1,36 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Seedable PRNG (PCG32) for AP level randomization. Gives the same
+//	sequence on every platform, unlike rand().
+//
+
+#ifndef __AP_RNG__
+#define __AP_RNG__
+
+#include "doomtype.h"
+
+typedef struct
+{
+    uint64_t state;
+    uint64_t inc;
+} ap_rng_t;
+
+void ap_rng_seed(ap_rng_t *rng, uint64_t seed);
+uint32_t ap_rng_next(ap_rng_t *rng);
+
+// Uniform in [0, n), n > 0
+int ap_rng_range(ap_rng_t *rng, int n);
+
+#endif
@@ -30,15 +30,26 @@
 #include "apdoom_def.h"
 #include "apdoom2_def.h"
 #include "apheretic_def.h"
+#include "apdoom_c_def.h"
+#include "apdoom2_c_def.h"
+#include "apheretic_c_def.h"
 #include "Archipelago.h"
+#include "aptracker.h"
 #include <json/json.h>
 #include <memory.h>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <vector>
+#include <deque>
+#include <map>
+#include <string>
 #include <fstream>
 #include <sstream>
 #include <set>
+#include <algorithm>
 
 
 #if defined(_WIN32)
@@ -142,6 +153,44 @@ static FILE *AP_fopen(const char *filename, const char *mode)
 }
 
 
+//
+// Replace a file, atomically where the platform allows it
+//
+
+static int AP_RenameFile(const char *from, const char *to)
+{
+#ifdef _WIN32
+    wchar_t *wfrom;
+    wchar_t *wto;
+    BOOL result;
+
+    wfrom = AP_ConvertUtf8ToWide(from);
+
+    if (!wfrom)
+    {
+        return false;
+    }
+
+    wto = AP_ConvertUtf8ToWide(to);
+
+    if (!wto)
+    {
+        free(wfrom);
+        return false;
+    }
+
+    result = MoveFileExW(wfrom, wto, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+
+    free(wfrom);
+    free(wto);
+
+    return result ? true : false;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+
 static int AP_FileExists(const char *filename)
 {
     FILE *fstream;
@@ -163,6 +212,38 @@ static int AP_FileExists(const char *filename)
 }
 
 
+// Lock-free ring buffer for exactly one producer thread and one consumer
+// thread. CAPACITY must be a power of two.
+template <typename T, size_t CAPACITY>
+struct ap_spsc_queue_t
+{
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+	T slots[CAPACITY];
+	alignas(64) std::atomic<size_t> head{0}; // Written by the producer
+	alignas(64) std::atomic<size_t> tail{0}; // Written by the consumer
+
+	// Returns false when full, value is left untouched
+	bool push(T& value)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == CAPACITY) return false;
+		slots[h & (CAPACITY - 1)] = std::move(value);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& out)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) return false;
+		out = std::move(slots[t & (CAPACITY - 1)]);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+
 enum class ap_game_t
 {
 	doom,
@@ -171,11 +252,71 @@ enum class ap_game_t
 };
 
 
+// Doom type to key or weapon slot
+struct ap_game_type_slot_t
+{
+	int doom_type;
+	int slot;
+};
+
+
+static const int doom_max_ammos[] = {200, 50, 300, 50};
+static const int doom2_max_ammos[] = {200, 50, 300, 50};
+static const int heretic_max_ammos[] = {100, 50, 200, 200, 20, 150};
+
+static const ap_game_type_slot_t doom_keys[] = {{5, 0}, {40, 0}, {6, 1}, {39, 1}, {13, 2}, {38, 2}};
+static const ap_game_type_slot_t doom2_keys[] = {{5, 0}, {40, 0}, {6, 1}, {39, 1}, {13, 2}, {38, 2}};
+static const ap_game_type_slot_t heretic_keys[] = {{80, 0}, {73, 1}, {79, 2}};
+
+static const ap_game_type_slot_t doom_weapons[] = {{2001, 2}, {2002, 3}, {2003, 4}, {2004, 5}, {2006, 6}, {2005, 7}};
+static const ap_game_type_slot_t doom2_weapons[] = {{2001, 2}, {2002, 3}, {2003, 4}, {2004, 5}, {2006, 6}, {2005, 7}, {82, 8}};
+static const ap_game_type_slot_t heretic_weapons[] = {{2005, 7}, {2001, 2}, {53, 3}, {2003, 5}, {2002, 6}, {2004, 4}};
+
+
+#define AP_ARRAY_AND_COUNT(a) a, (int)(sizeof(a) / sizeof(a[0]))
+
+
+// Everything that differs between games. Adding a world is adding an entry here.
+struct ap_game_desc_t
+{
+	const char* name; // As passed in ap_settings_t::game
+	ap_game_t game;
+	int weapon_count;
+	int ammo_count;
+	int powerup_count;
+	int inventory_count;
+	int map_doom_type; // Computer area map, map scroll
+	bool flat_maps; // Maps are numbered MAP## across all episodes
+	int boss_map; // 0-based map that ends an episode for goal 1, -1 if none
+	const ap_def_tables_t* tables;
+	std::vector<std::vector<ap_level_info_t>>* level_infos;
+	const int* max_ammos;
+	const ap_game_type_slot_t* keys;
+	int key_count;
+	const ap_game_type_slot_t* weapons;
+	int weapon_def_count;
+	int (*is_type_ap_location)(int doom_type);
+};
+
+
+static const ap_game_desc_t ap_game_descs[] = {
+	{"DOOM 1993", ap_game_t::doom, 9, 4, 6, 0, 2026, false, 7,
+		&ap_doom_tables, &ap_doom_level_infos, doom_max_ammos,
+		AP_ARRAY_AND_COUNT(doom_keys), AP_ARRAY_AND_COUNT(doom_weapons), is_doom_type_ap_location},
+	{"DOOM II", ap_game_t::doom2, 9, 4, 6, 0, 2026, true, -1,
+		&ap_doom2_tables, &ap_doom2_level_infos, doom2_max_ammos,
+		AP_ARRAY_AND_COUNT(doom2_keys), AP_ARRAY_AND_COUNT(doom2_weapons), is_doom2_type_ap_location},
+	{"Heretic", ap_game_t::heretic, 9, 6, 9, 14, 35, false, 7,
+		&ap_heretic_tables, &ap_heretic_level_infos, heretic_max_ammos,
+		AP_ARRAY_AND_COUNT(heretic_keys), AP_ARRAY_AND_COUNT(heretic_weapons), is_heretic_type_ap_location},
+};
+
+
 ap_state_t ap_state;
 int ap_is_in_game = 0;
 int ap_episode_count = -1;
 
-static ap_game_t ap_game;
+static const ap_game_desc_t* ap_game_desc; // Selected once in apdoom_init
 static int ap_weapon_count = -1;
 static int ap_ammo_count = -1;
 static int ap_powerup_count = -1;
@@ -183,15 +324,158 @@ static int ap_inventory_count = -1;
 static int max_map_count = -1;
 static ap_settings_t ap_settings;
 static AP_RoomInfo ap_room_info;
-static std::vector<int64_t> ap_item_queue; // We queue when we're in the menu.
+static std::deque<int64_t> ap_item_queue; // We queue when we're in the menu.
 static bool ap_was_connected = false; // Got connected at least once. That means the state is valid
-static std::set<int64_t> ap_progressive_locations;
+// Progression status of every location, indexed by location ordinal (Its
+// position in ap_def_tables_t::locations). Persisted so reconnecting only
+// scouts what is still unknown.
+static std::vector<unsigned char> ap_progression_known;
+static std::vector<unsigned char> ap_progression_bits;
+// Checks are recorded locally as soon as they're made. Until the server
+// echoes them back they stay in this journal, which is saved with the state
+// and sent again on every (re)connect. Outgoing ones are coalesced into one
+// LocationChecks per tic.
+static std::set<int64_t> ap_unconfirmed_checks;
+static std::set<int64_t> ap_outgoing_checks;
+// How many items of the server's list the state has, and an FNV-1a hash of
+// their ids. Saved with the state. When the server sends its whole list
+// again (After a clear, on every connect) the items the state already has
+// are skipped, unless the list turns out different.
+#define AP_RECEIVED_HASH_INIT 0xcbf29ce484222325ull
+static uint64_t ap_received_count = 0;
+static uint64_t ap_received_hash = AP_RECEIVED_HASH_INIT;
+struct ap_resync_t
+{
+	bool active = false;
+	uint64_t count = 0; // What the state had before the clear
+	uint64_t hash = 0;
+	std::vector<std::pair<int64_t, bool>> skipped; // Applied after all if the lists differ
+	int idle_tics = 0; // Since the last item. The list was shorter if it stops before count
+};
+static ap_resync_t ap_resync;
+static bool ap_checks_online = false; // Authenticated when the checks were last flushed
 static bool ap_initialized = false;
-static std::vector<std::string> ap_cached_messages;
+#define AP_MAX_CACHED_MESSAGES 256
+static std::deque<std::string> ap_cached_messages; // Oldest are dropped past AP_MAX_CACHED_MESSAGES
+
+// Network side. The pump thread drains and formats AP messages and raises
+// DeathLinks, APCpp's own socket thread runs the item and location callbacks.
+// Both only hand work to the game thread through these queues.
+enum class ap_event_type_t
+{
+	item_clear, // The server's item list is sent again from the start
+	item,
+	item_silent, // Not notified to the player
+	location,
+	location_info_progression, // Scout result
+	location_info_filler
+};
+struct ap_event_t
+{
+	ap_event_type_t type;
+	int64_t id;
+};
+static ap_spsc_queue_t<std::string, 256> ap_message_queue; // Producer: pump thread
+static ap_spsc_queue_t<ap_event_t, 4096> ap_event_queue; // Producer: APCpp callbacks
+static std::atomic<bool> ap_pump_quit(false);
+static std::atomic<bool> ap_pump_running(false);
+
+// DeathLink, raised by the pump thread as soon as APCpp has one so the next
+// tic picks it up. Only the pump moves idle -> pending, with a compare and
+// swap, so a clear from the game can't be undone by a stale read of APCpp's flag.
+enum ap_deathlink_state_t : int
+{
+	AP_DEATHLINK_IDLE,
+	AP_DEATHLINK_PENDING,
+	AP_DEATHLINK_CLEARING // Game is done with it, the pump clears APCpp's flag
+};
+static std::atomic<int> ap_deathlink_state(AP_DEATHLINK_IDLE);
+static std::atomic<int64_t> ap_deathlink_arrival_us(0); // steady_clock, set before pending
+static bool ap_deathlink_logged = false; // Game thread
+
+static int64_t steady_now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Spawn plans handed to P_LoadThings, by level. Anything that changes what a
+// level spawns bumps the version, the actions are redone on next load. Which
+// things are valid locations only changes with the things or with
+// check_sanity, so the validation pass is kept until then.
+struct ap_spawn_plan_cache_t
+{
+	unsigned version;
+	unsigned validation_version;
+	std::vector<int> doom_types;
+	std::vector<int> locations; // Things that are valid AP locations
+	std::vector<unsigned char> actions;
+	bool valid = false;
+};
+static std::vector<ap_spawn_plan_cache_t> ap_spawn_plans; // By level, ep * max_map_count + map
+
+struct ap_type_remap_cache_t
+{
+	int key = -1;
+	std::vector<int> doom_types;
+};
+static std::vector<ap_type_remap_cache_t> ap_type_remaps; // By level, ep * max_map_count + map
+static std::atomic<unsigned> ap_spawn_plan_version(0);
+static std::atomic<unsigned> ap_spawn_validation_version(0);
 static std::string ap_save_dir_name;
-static std::vector<ap_notification_icon_t> ap_notification_icons;
+
+// Notification icons. Only a handful fit on screen, the rest wait in a
+// bounded backlog until the last active icon has dropped far enough.
+#define AP_NOTIF_MAX_ACTIVE 8
+#define AP_NOTIF_MAX_BACKLOG 256
+struct ap_pending_notification_t
+{
+	char sprite[9];
+	const char* text;
+};
+static ap_notification_icon_t ap_notification_icons[AP_NOTIF_MAX_ACTIVE];
+static int ap_notification_icon_count = 0;
+static ap_pending_notification_t ap_notification_backlog[AP_NOTIF_MAX_BACKLOG]; // Ring
+static int ap_notification_backlog_start = 0;
+static int ap_notification_backlog_count = 0;
+static std::vector<std::string> ap_level_short_names; // "(E1M1)", by ep * max_map_count + map. Notifications point in there
 static bool ap_check_sanity = false;
 
+// apstate.json persistence. Changes mark the state dirty, apdoom_update
+// coalesces them into one write every AP_SAVE_INTERVAL. The json is built on
+// the game thread and handed to a writer thread for formatting and disk IO.
+static const auto AP_SAVE_INTERVAL = std::chrono::seconds(10);
+static bool ap_state_dirty = false;
+static unsigned ap_state_version = 0; // Never reset, unlike ap_state_dirty
+static std::chrono::steady_clock::time_point ap_last_save_time;
+static bool ap_save_thread_running = false;
+static bool ap_save_quit = false;
+static std::mutex ap_save_mutex;
+static std::condition_variable ap_save_cv;
+struct ap_save_snapshot_t
+{
+	std::string data; // apstate.dat contents
+	Json::Value json; // Only with -apstate-export-json
+	bool has_json = false;
+};
+static ap_save_snapshot_t ap_save_pending; // Latest snapshot not yet written
+static bool ap_save_has_pending = false;
+static bool ap_save_busy = false;
+
+
+static void mark_state_dirty()
+{
+	ap_state_dirty = true;
+	ap_state_version++;
+}
+
+
+unsigned ap_get_state_version()
+{
+	return ap_state_version;
+}
+
 
 void f_itemclr();
 void f_itemrecv(int64_t item_id, int player_id, bool notify_player);
@@ -213,12 +497,36 @@ void f_episode5(int);
 void f_two_ways_keydoors(int);
 void load_state();
 void save_state();
+static void queue_save_state();
+static void flush_save_state();
 void APSend(std::string msg);
+static void start_pump_thread();
+static void process_ap_events();
+static void flush_outgoing_checks();
+static void build_type_descs();
+static void build_hint_items();
+static void build_level_names();
+static void free_ap_state();
+
+
+// Brackets a scope for -trace. The callback is optional
+struct ap_trace_scope_t
+{
+	const char* name;
+	ap_trace_scope_t(const char* name) : name(name)
+	{
+		if (ap_settings.trace_callback) ap_settings.trace_callback(name, 1);
+	}
+	~ap_trace_scope_t()
+	{
+		if (ap_settings.trace_callback) ap_settings.trace_callback(name, 0);
+	}
+};
 
 
 static int get_original_music_for_level(int ep, int map)
 {
-	switch (ap_game)
+	switch (ap_game_desc->game)
 	{
 		case ap_game_t::doom:
 		{
@@ -256,12 +564,7 @@ static int get_original_music_for_level(int ep, int map)
 
 static std::vector<std::vector<ap_level_info_t>>& get_level_info_table()
 {
-	switch (ap_game)
-	{
-		case ap_game_t::doom: return ap_doom_level_infos;
-		case ap_game_t::doom2: return ap_doom2_level_infos;
-		case ap_game_t::heretic: return ap_heretic_level_infos;
-	}
+	return *ap_game_desc->level_infos;
 }
 
 
@@ -289,25 +592,109 @@ ap_level_state_t* ap_get_level_state(ap_level_index_t idx)
 }
 
 
-static const std::map<int64_t, ap_item_t>& get_item_type_table()
+int ap_get_level_check_total(ap_level_index_t idx)
 {
-	switch (ap_game)
-	{
-		case ap_game_t::doom: return ap_doom_item_table;
-		case ap_game_t::doom2: return ap_doom2_item_table;
-		case ap_game_t::heretic: return ap_heretic_item_table;
-	}
+	const ap_level_info_t* level_info = ap_get_level_info(idx);
+	if (!level_info) return 0;
+	return level_info->check_count - level_info->sanity_check_count;
 }
 
 
-static const std::map<int /* ep */, std::map<int /* map */, std::map<int /* index */, int64_t /* loc id */>>>& get_location_table()
+int ap_get_level_remaining_checks(ap_level_index_t idx)
 {
-	switch (ap_game)
-	{
-		case ap_game_t::doom: return ap_doom_location_table;
-		case ap_game_t::doom2: return ap_doom2_location_table;
-		case ap_game_t::heretic: return ap_heretic_location_table;
-	}
+	int remaining = ap_get_level_check_total(idx) - ap_get_level_state(idx)->check_count;
+	return remaining > 0 ? remaining : 0;
+}
+
+
+static const ap_def_tables_t& get_def_tables()
+{
+	return *ap_game_desc->tables;
+}
+
+
+// Dense index into ap_def_tables_t::locations. Returns -1 if there is no location at this thing index
+static int get_location_ordinal(ap_level_index_t idx, int index)
+{
+	const auto& tables = get_def_tables();
+	if (idx.ep < 0 || idx.ep >= tables.episode_count) return -1;
+	int level = tables.episode_offsets[idx.ep] + idx.map;
+	if (idx.map < 0 || level >= tables.episode_offsets[idx.ep + 1]) return -1;
+
+	auto begin = tables.locations + tables.level_location_offsets[level];
+	auto end = tables.locations + tables.level_location_offsets[level + 1];
+	auto it = std::lower_bound(begin, end, index, [](const ap_location_def_t& loc, int i) { return loc.index < i; });
+	if (it == end || it->index != index) return -1;
+	return (int)(it - tables.locations);
+}
+
+
+// Returns -1 if loc_id isn't one of ours
+static int get_location_ordinal(int64_t loc_id)
+{
+	const auto& tables = get_def_tables();
+	auto begin = tables.location_id_order;
+	auto end = begin + tables.location_count;
+	auto it = std::lower_bound(begin, end, loc_id, [&tables](int i, int64_t id) { return tables.locations[i].loc_id < id; });
+	if (it == end || tables.locations[*it].loc_id != loc_id) return -1;
+	return *it;
+}
+
+
+// Returns -1 if there is no location at this thing index
+static int64_t get_location_id(ap_level_index_t idx, int index)
+{
+	int ordinal = get_location_ordinal(idx, index);
+	if (ordinal == -1) return -1;
+	return get_def_tables().locations[ordinal].loc_id;
+}
+
+
+static const ap_location_def_t* get_location_def(int64_t loc_id)
+{
+	int ordinal = get_location_ordinal(loc_id);
+	if (ordinal == -1) return nullptr;
+	return &get_def_tables().locations[ordinal];
+}
+
+
+static bool test_bit(const std::vector<unsigned char>& bits, int i)
+{
+	return (bits[i >> 3] & (1 << (i & 7))) != 0;
+}
+
+
+static void set_bit(std::vector<unsigned char>& bits, int i)
+{
+	bits[i >> 3] |= (1 << (i & 7));
+}
+
+
+static void set_location_progression(int ordinal, bool progression)
+{
+	set_bit(ap_progression_known, ordinal);
+	if (progression)
+		set_bit(ap_progression_bits, ordinal);
+}
+
+
+// Older saves only kept the progressive ids, and only once everything was scouted
+static void load_legacy_progressive_location(int64_t loc_id)
+{
+	std::fill(ap_progression_known.begin(), ap_progression_known.end(), 0xFF);
+	int ordinal = get_location_ordinal(loc_id);
+	if (ordinal != -1)
+		set_bit(ap_progression_bits, ordinal);
+}
+
+
+static const ap_item_t* get_item(int64_t item_id)
+{
+	const auto& tables = get_def_tables();
+	auto end = tables.items + tables.item_count;
+	auto it = std::lower_bound(tables.items, end, item_id, [](const ap_item_def_t& def, int64_t id) { return def.item_id < id; });
+	if (it == end || it->item_id != item_id) return nullptr;
+	return &it->item;
 }
 
 
@@ -329,11 +716,6 @@ std::string string_to_hex(const char* str)
 }
 
 
-static const int doom_max_ammos[] = {200, 50, 300, 50};
-static const int doom2_max_ammos[] = {200, 50, 300, 50};
-static const int heretic_max_ammos[] = {100, 50, 200, 200, 20, 150};
-
-
 static unsigned long long hash_seed(const char *str)
 {
     unsigned long long hash = 5381;
@@ -348,12 +730,7 @@ static unsigned long long hash_seed(const char *str)
 
 const int* get_max_ammos()
 {
-	switch (ap_game)
-	{
-		case ap_game_t::doom: return doom_max_ammos;
-		case ap_game_t::doom2: return doom2_max_ammos;
-		case ap_game_t::heretic: return heretic_max_ammos;
-	}
+	return ap_game_desc->max_ammos;
 }
 
 
@@ -365,112 +742,40 @@ int validate_doom_location(ap_level_index_t idx, int index)
 }
 
 
-int apdoom_init(ap_settings_t* settings)
-{
-	printf("%s\n", APDOOM_VERSION_FULL_TEXT);
-
-	ap_notification_icons.reserve(4096); // 1MB. A bit exessive, but I got a crash with invalid strings and I cannot figure out why. Let's not take any chances...
-	memset(&ap_state, 0, sizeof(ap_state));
-
-	if (strcmp(settings->game, "DOOM 1993") == 0)
-	{
-		ap_game = ap_game_t::doom;
-		ap_weapon_count = 9;
-		ap_ammo_count = 4;
-		ap_powerup_count = 6;
-		ap_inventory_count = 0;
-	}
-	else if (strcmp(settings->game, "DOOM II") == 0)
-	{
-		ap_game = ap_game_t::doom2;
-		ap_weapon_count = 9;
-		ap_ammo_count = 4;
-		ap_powerup_count = 6;
-		ap_inventory_count = 0;
-	}
-	else if (strcmp(settings->game, "Heretic") == 0)
-	{
-		ap_game = ap_game_t::heretic;
-		ap_weapon_count = 9;
-		ap_ammo_count = 6;
-		ap_powerup_count = 9;
-		ap_inventory_count = 14;
-	}
-	else
-	{
-		printf("APDOOM: Invalid game: %s\n", settings->game);
-		return 0;
-	}
-
-	const auto& level_info_table = get_level_info_table();
-	ap_episode_count = (int)level_info_table.size();
-	max_map_count = 0; // That's really the map count
-	for (const auto& episode_level_info : level_info_table)
-	{
-		max_map_count = max(max_map_count, (int)episode_level_info.size());
-	}
-
-	printf("APDOOM: Initializing Game: \"%s\", Server: %s, Slot: %s\n", settings->game, settings->ip, settings->player_name);
-
-	ap_state.level_states = new ap_level_state_t[ap_episode_count * max_map_count];
-	ap_state.episodes = new int[ap_episode_count];
-	ap_state.player_state.powers = new int[ap_powerup_count];
-	ap_state.player_state.weapon_owned = new int[ap_weapon_count];
-	ap_state.player_state.ammo = new int[ap_ammo_count];
-	ap_state.player_state.max_ammo = new int[ap_ammo_count];
-	ap_state.player_state.inventory = ap_inventory_count ? new ap_inventory_slot_t[ap_inventory_count] : nullptr;
+// MAP## to level index for flat maps, rebuilt when the game is selected
+static std::vector<ap_level_index_t> ap_flat_map_indices;
+static ap_current_level_t ap_current_level = {-1, -1};
 
-	memset(ap_state.level_states, 0, sizeof(ap_level_state_t) * ap_episode_count * max_map_count);
-	memset(ap_state.episodes, 0, sizeof(int) * ap_episode_count);
-	memset(ap_state.player_state.powers, 0, sizeof(int) * ap_powerup_count);
-	memset(ap_state.player_state.weapon_owned, 0, sizeof(int) * ap_weapon_count);
-	memset(ap_state.player_state.ammo, 0, sizeof(int) * ap_ammo_count);
-	memset(ap_state.player_state.max_ammo, 0, sizeof(int) * ap_ammo_count);
-	if (ap_inventory_count)
-		memset(ap_state.player_state.inventory, 0, sizeof(ap_inventory_slot_t) * ap_inventory_count);
 
-	ap_state.player_state.health = 100;
-	ap_state.player_state.ready_weapon = 1;
-	ap_state.player_state.weapon_owned[0] = 1; // Fist
-	ap_state.player_state.weapon_owned[1] = 1; // Pistol
-	ap_state.player_state.ammo[0] = 50; // Clip
-	auto max_ammos = get_max_ammos();
-	for (int i = 0; i < ap_ammo_count; ++i)
-		ap_state.player_state.max_ammo[i] = max_ammos[i];
-	for (int ep = 0; ep < ap_episode_count; ++ep)
+int apdoom_select_game(const char* game)
+{
+	ap_game_desc = nullptr;
+	for (const auto& game_desc : ap_game_descs)
 	{
-		int map_count = ap_get_map_count(ep + 1);
-		for (int map = 0; map < map_count; ++map)
+		if (strcmp(game, game_desc.name) == 0)
 		{
-			for (int k = 0; k < AP_CHECK_MAX; ++k)
-			{
-				ap_state.level_states[ep * max_map_count + map].checks[k] = -1;
-			}
-			auto level_info = ap_get_level_info(ap_level_index_t{ep, map});
-			level_info->sanity_check_count = 0;
-			for (int k = 0; k < level_info->thing_count; ++k)
-			{
-				if (level_info->thing_infos[k].check_sanity)
-					level_info->sanity_check_count++;
-			}
+			ap_game_desc = &game_desc;
+			break;
 		}
 	}
+	if (!ap_game_desc) return 0;
 
-	ap_settings = *settings;
+	ap_flat_map_indices.clear();
+	if (ap_game_desc->flat_maps)
+	{
+		const auto& table = get_level_info_table();
+		for (int ep = 0; ep < (int)table.size(); ++ep)
+			for (int map = 0; map < (int)table[ep].size(); ++map)
+				ap_flat_map_indices.push_back({ep, map});
+	}
+	ap_current_level.ep = -1;
+	return 1;
+}
 
-	if (ap_settings.override_skill)
-		ap_state.difficulty = ap_settings.skill;
-	if (ap_settings.override_monster_rando)
-		ap_state.random_monsters = ap_settings.monster_rando;
-	if (ap_settings.override_item_rando)
-		ap_state.random_items = ap_settings.item_rando;
-	if (ap_settings.override_music_rando)
-		ap_state.random_music = ap_settings.music_rando;
-	if (ap_settings.override_flip_levels)
-		ap_state.flip_levels = ap_settings.flip_levels;
-	if (ap_settings.override_reset_level_on_death)
-		ap_state.reset_level_on_death = ap_settings.reset_level_on_death;
 
+// Blocks until the server accepted us, or failed to. The state is loaded on success.
+static bool connect_to_server()
+{
 	AP_NetworkVersion version = {0, 4, 1};
 	AP_SetClientVersion(&version);
     AP_Init(ap_settings.ip, ap_settings.game, ap_settings.player_name, ap_settings.passwd);
@@ -494,6 +799,7 @@ int apdoom_init(ap_settings_t* settings)
 	AP_RegisterSlotDataIntCallback("episode5", f_episode5);
 	AP_RegisterSlotDataIntCallback("two_ways_keydoors", f_two_ways_keydoors);
     AP_Start();
+	start_pump_thread();
 
 	// Block DOOM until connection succeeded or failed
 	auto start_time = std::chrono::steady_clock::now();
@@ -541,45 +847,149 @@ int apdoom_init(ap_settings_t* settings)
 			}
 			case AP_ConnectionStatus::ConnectionRefused:
 				printf("APDOOM: Failed to connect, connection refused\n");
-				return 0;
+				return false;
 		}
 		if (should_break) break;
 		std::this_thread::sleep_for(std::chrono::milliseconds(100));
 		if (std::chrono::steady_clock::now() - start_time > std::chrono::seconds(10))
 		{
 			printf("APDOOM: Failed to connect, timeout 10s\n");
-			return 0;
+			return false;
 		}
 	}
 
-	// If none episode is selected, select the first one.
-	int ep_count = 0;
-	for (int i = 0; i < ap_episode_count; ++i)
-		if (ap_state.episodes[i])
-			ep_count++;
-	if (!ep_count)
-	{
-		printf("APDOOM: No episode selected, selecting episode 1\n");
-		ap_state.episodes[0] = 1;
-	}
+	return true;
+}
 
-	// Seed for random features
-	auto ap_seed = apdoom_get_seed();
-	unsigned long long seed = hash_seed(ap_seed);
-	srand(seed);
 
-	// Randomly flip levels based on the seed
-	if (ap_state.flip_levels == 1)
+int apdoom_init(ap_settings_t* settings)
+{
+	printf("%s\n", APDOOM_VERSION_FULL_TEXT);
+
+	memset(&ap_state, 0, sizeof(ap_state));
+
+	if (!apdoom_select_game(settings->game))
 	{
-		printf("APDOOM: All levels flipped\n");
-		for (int ep = 0; ep < ap_episode_count; ++ep)
-		{
-			int map_count = ap_get_map_count(ep + 1);
-			for (int map = 0; map < map_count; ++map)
-				ap_state.level_states[ep * max_map_count + map].flipped = 1;
-		}
+		printf("APDOOM: Invalid game: %s\n", settings->game);
+		return 0;
 	}
-	else if (ap_state.flip_levels == 2)
+	ap_weapon_count = ap_game_desc->weapon_count;
+	ap_ammo_count = ap_game_desc->ammo_count;
+	ap_powerup_count = ap_game_desc->powerup_count;
+	ap_inventory_count = ap_game_desc->inventory_count;
+
+	const auto& level_info_table = get_level_info_table();
+	ap_episode_count = (int)level_info_table.size();
+	max_map_count = 0; // That's really the map count
+	for (const auto& episode_level_info : level_info_table)
+	{
+		max_map_count = max(max_map_count, (int)episode_level_info.size());
+	}
+
+	printf("APDOOM: Initializing Game: \"%s\", Server: %s, Slot: %s\n", settings->game, settings->ip, settings->player_name);
+
+	ap_state.level_states = new ap_level_state_t[ap_episode_count * max_map_count];
+	ap_progression_known.assign((get_def_tables().location_count + 7) / 8, 0);
+	ap_progression_bits.assign(ap_progression_known.size(), 0);
+	ap_state.episodes = new int[ap_episode_count];
+	ap_state.player_state.powers = new int[ap_powerup_count];
+	ap_state.player_state.weapon_owned = new int[ap_weapon_count];
+	ap_state.player_state.ammo = new int[ap_ammo_count];
+	ap_state.player_state.max_ammo = new int[ap_ammo_count];
+	ap_state.player_state.inventory = ap_inventory_count ? new ap_inventory_slot_t[ap_inventory_count] : nullptr;
+
+	memset(ap_state.level_states, 0, sizeof(ap_level_state_t) * ap_episode_count * max_map_count);
+	memset(ap_state.episodes, 0, sizeof(int) * ap_episode_count);
+	memset(ap_state.player_state.powers, 0, sizeof(int) * ap_powerup_count);
+	memset(ap_state.player_state.weapon_owned, 0, sizeof(int) * ap_weapon_count);
+	memset(ap_state.player_state.ammo, 0, sizeof(int) * ap_ammo_count);
+	memset(ap_state.player_state.max_ammo, 0, sizeof(int) * ap_ammo_count);
+	if (ap_inventory_count)
+		memset(ap_state.player_state.inventory, 0, sizeof(ap_inventory_slot_t) * ap_inventory_count);
+
+	ap_state.player_state.health = 100;
+	ap_state.player_state.ready_weapon = 1;
+	ap_state.player_state.weapon_owned[0] = 1; // Fist
+	ap_state.player_state.weapon_owned[1] = 1; // Pistol
+	ap_state.player_state.ammo[0] = 50; // Clip
+	auto max_ammos = get_max_ammos();
+	for (int i = 0; i < ap_ammo_count; ++i)
+		ap_state.player_state.max_ammo[i] = max_ammos[i];
+	for (int ep = 0; ep < ap_episode_count; ++ep)
+	{
+		int map_count = ap_get_map_count(ep + 1);
+		for (int map = 0; map < map_count; ++map)
+		{
+			auto level_info = ap_get_level_info(ap_level_index_t{ep, map});
+			auto level_state = &ap_state.level_states[ep * max_map_count + map];
+			level_state->checked_capacity = (level_info->thing_count + 7) & ~7;
+			if (level_state->checked_capacity)
+				level_state->checked_bits = new unsigned char[level_state->checked_capacity / 8]();
+			level_info->sanity_check_count = 0;
+			for (int k = 0; k < level_info->thing_count; ++k)
+			{
+				if (level_info->thing_infos[k].check_sanity)
+					level_info->sanity_check_count++;
+			}
+		}
+	}
+
+	build_type_descs();
+	build_hint_items();
+	build_level_names();
+
+	ap_settings = *settings;
+
+	if (ap_settings.override_skill)
+		ap_state.difficulty = ap_settings.skill;
+	if (ap_settings.override_monster_rando)
+		ap_state.random_monsters = ap_settings.monster_rando;
+	if (ap_settings.override_item_rando)
+		ap_state.random_items = ap_settings.item_rando;
+	if (ap_settings.override_music_rando)
+		ap_state.random_music = ap_settings.music_rando;
+	if (ap_settings.override_flip_levels)
+		ap_state.flip_levels = ap_settings.flip_levels;
+	if (ap_settings.override_reset_level_on_death)
+		ap_state.reset_level_on_death = ap_settings.reset_level_on_death;
+
+	if (ap_settings.offline)
+	{
+		printf("APDOOM: Offline, starting state and nothing sent\n");
+	}
+	else if (!connect_to_server())
+	{
+		return 0;
+	}
+
+	// If none episode is selected, select the first one.
+	int ep_count = 0;
+	for (int i = 0; i < ap_episode_count; ++i)
+		if (ap_state.episodes[i])
+			ep_count++;
+	if (!ep_count)
+	{
+		printf("APDOOM: No episode selected, selecting episode 1\n");
+		ap_state.episodes[0] = 1;
+	}
+
+	// Seed for random features
+	auto ap_seed = apdoom_get_seed();
+	unsigned long long seed = hash_seed(ap_seed);
+	srand(seed);
+
+	// Randomly flip levels based on the seed
+	if (ap_state.flip_levels == 1)
+	{
+		printf("APDOOM: All levels flipped\n");
+		for (int ep = 0; ep < ap_episode_count; ++ep)
+		{
+			int map_count = ap_get_map_count(ep + 1);
+			for (int map = 0; map < map_count; ++map)
+				ap_state.level_states[ep * max_map_count + map].flipped = 1;
+		}
+	}
+	else if (ap_state.flip_levels == 2)
 	{
 		printf("APDOOM: Levels randomly flipped\n");
 		for (int ep = 0; ep < ap_episode_count; ++ep)
@@ -627,7 +1037,7 @@ int apdoom_init(ap_settings_t* settings)
 					music_pool.erase(music_pool.begin() + rnd);
 					ap_state.level_states[ep * max_map_count + map].music = mus;
 
-					switch (ap_game)
+					switch (ap_game_desc->game)
 					{
 						case ap_game_t::doom:
 							printf("  E%iM%i = E%iM%i\n", ep + 1, map + 1, ((mus - 1) / max_map_count) + 1, ((mus - 1) % max_map_count) + 1);
@@ -644,40 +1054,42 @@ int apdoom_init(ap_settings_t* settings)
 		}
 	}
 
-	// Scout locations to see which are progressive
-	if (ap_progressive_locations.empty())
+	// Scout locations we don't know yet to see which are progressive
+	std::vector<int> scouted_ordinals;
+	const auto& tables = get_def_tables();
+	for (int i = 0; i < tables.location_count; ++i)
 	{
-		std::vector<int64_t> location_scouts;
+		const auto& loc = tables.locations[i];
+		if (loc.index == -1) continue;
+		if (!ap_state.episodes[loc.ep - 1]) continue;
+		if (test_bit(ap_progression_known, i)) continue;
+		if (validate_doom_location({loc.ep - 1, loc.map - 1}, loc.index))
+			scouted_ordinals.push_back(i);
+	}
 
-		const auto& loc_table = get_location_table();
-		for (const auto& kv1 : loc_table)
-		{
-			if (!ap_state.episodes[kv1.first - 1])
-				continue;
-			for (const auto& kv2 : kv1.second)
-			{
-				for (const auto& kv3 : kv2.second)
-				{
-					if (kv3.first == -1) continue;
-					if (kv3.second == 371349)
-					{
-						int tmp;
-						tmp = 5;
-					}
-					if (validate_doom_location({kv1.first - 1, kv2.first - 1}, kv3.first))
-					{
-						location_scouts.push_back(kv3.second);
-					}
-				}
-			}
-		}
+	if (ap_settings.offline)
+	{
+		// Nobody to ask, all checks look non-progression
+	}
+	else if (!scouted_ordinals.empty())
+	{
+		std::vector<int64_t> location_scouts;
+		for (int ordinal : scouted_ordinals)
+			location_scouts.push_back(tables.locations[ordinal].loc_id);
 		
 		printf("APDOOM: Scouting for %i locations...\n", (int)location_scouts.size());
 		AP_SendLocationScouts(location_scouts, 0);
 
 		// Wait for location infos
-		start_time = std::chrono::steady_clock::now();
-		while (ap_progressive_locations.empty())
+		auto is_scouting = [&scouted_ordinals]()
+		{
+			for (int ordinal : scouted_ordinals)
+				if (!test_bit(ap_progression_known, ordinal))
+					return true;
+			return false;
+		};
+		auto start_time = std::chrono::steady_clock::now();
+		while (is_scouting())
 		{
 			apdoom_update();
 		
@@ -693,35 +1105,115 @@ int apdoom_init(ap_settings_t* settings)
 	{
 		printf("APDOOM: Scout locations cached loaded\n");
 	}
+
+	// Apply whatever the server sent while we were connecting
+	process_ap_events();
 	
+	if (ap_settings.tracker_port && !ap_tracker_start(ap_settings.tracker_port))
+		printf("APDOOM: Failed to open the tracker feed on port %i\n", ap_settings.tracker_port);
+
 	printf("APDOOM: Initialized\n");
 	ap_initialized = true;
 	return 1;
 }
 
 
+static bool is_loc_checked_in(const ap_level_state_t* level_state, int index)
+{
+	if (index < 0 || index >= level_state->checked_capacity) return false;
+	return (level_state->checked_bits[index >> 3] & (1 << (index & 7))) != 0;
+}
+
+
 static bool is_loc_checked(ap_level_index_t idx, int index)
 {
-	auto level_state = ap_get_level_state(idx);
-	for (int i = 0; i < level_state->check_count; ++i)
+	return is_loc_checked_in(ap_get_level_state(idx), index);
+}
+
+
+static void grow_checked_bits(ap_level_state_t* level_state, int capacity)
+{
+	if (capacity <= level_state->checked_capacity) return;
+
+	int new_capacity = (capacity + 7) & ~7;
+	auto new_bits = new unsigned char[new_capacity / 8]();
+	if (level_state->checked_bits)
 	{
-		if (level_state->checks[i] == index) return true;
+		memcpy(new_bits, level_state->checked_bits, level_state->checked_capacity / 8);
+		delete[] level_state->checked_bits;
 	}
-	return false;
+	level_state->checked_bits = new_bits;
+	level_state->checked_capacity = new_capacity;
+}
+
+
+// Records a check, growing the bitset if needed. Returns false if it was already there.
+static bool set_loc_checked(ap_level_state_t* level_state, int index)
+{
+	if (index < 0) return false;
+	if (is_loc_checked_in(level_state, index)) return false;
+
+	// Shouldn't need to grow with matching data, but don't lose the check
+	grow_checked_bits(level_state, index + 1);
+
+	level_state->checked_bits[index >> 3] |= (1 << (index & 7));
+	level_state->check_count++;
+	mark_state_dirty();
+	ap_spawn_plan_version++;
+	return true;
+}
+
+
+int ap_is_location_checked(ap_level_index_t idx, int index)
+{
+	return is_loc_checked(idx, index) ? 1 : 0;
 }
 
 
 void apdoom_shutdown()
 {
+	// Last tic's checks, whatever isn't sent is still in the journal
+	if (ap_initialized)
+		flush_outgoing_checks();
+
+	ap_tracker_stop();
+
+	// Stop the pump before the process tears down, it's detached
+	ap_pump_quit = true;
+	while (ap_pump_running)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
 	if (ap_was_connected)
 		save_state();
+
+	// Nothing left for the writer. Don't leave it waiting on the condition
+	// variable while statics are destroyed, that blocks exit.
+	{
+		std::unique_lock<std::mutex> lock(ap_save_mutex);
+		ap_save_quit = true;
+		ap_save_cv.notify_all();
+		ap_save_cv.wait(lock, [] { return !ap_save_thread_running; });
+	}
+
+	// Nothing runs anymore, apdoom_init can start over with another slot
+	free_ap_state();
 }
 
 
+// Called on level exit, always writes regardless of the interval
 void apdoom_save_state()
 {
 	if (ap_was_connected)
-		save_state();
+		queue_save_state();
+}
+
+
+static int hex_to_nibble(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return 0;
 }
 
 
@@ -785,17 +1277,311 @@ const char* get_ammo_name(int weapon)
 }
 
 
-void load_state()
+//
+// Binary apstate.dat, in native endianness since we only read back our own saves:
+//   ap_state_header_t, ap_state_player_t
+//   powers, weapon_owned and ammo as int32 arrays
+//   varint inventory slot count, ap_inventory_slot_t array
+//   per level: ap_state_level_t followed by checked_size bytes of bitset
+//   one byte per enabled episode
+//   varint item queue count, varint item ids
+//   progression known and progression bitmaps, each a varint byte count and
+//   the bytes, one bit per location ordinal
+//   varint unconfirmed check count, varint location ids
+//
+
+static const uint32_t AP_STATE_MAGIC = 0x54535041; // "APST"
+static const uint32_t AP_STATE_VERSION = 4; // 2: Progression bitmaps instead of the progressive id list, 3: Unconfirmed checks, 4: Received item count
+
+#define AP_LEVEL_FLAG_COMPLETED 0x01
+#define AP_LEVEL_FLAG_KEY0 0x02
+#define AP_LEVEL_FLAG_KEY1 0x04
+#define AP_LEVEL_FLAG_KEY2 0x08
+#define AP_LEVEL_FLAG_HAS_MAP 0x10
+#define AP_LEVEL_FLAG_UNLOCKED 0x20
+#define AP_LEVEL_FLAG_SPECIAL 0x40
+
+static_assert(sizeof(int) == 4, "apstate.dat stores int arrays as int32");
+
+struct ap_state_header_t
+{
+	uint32_t magic;
+	uint32_t version;
+	int32_t episode_count;
+	int32_t level_count;
+	int32_t weapon_count;
+	int32_t ammo_count;
+	int32_t powerup_count;
+	int32_t inventory_count;
+	int32_t ep;
+	int32_t map;
+	int32_t victory;
+};
+
+struct ap_state_player_t
 {
-	printf("APDOOM: Load sate\n");
+	int32_t health;
+	int32_t armor_points;
+	int32_t armor_type;
+	int32_t backpack;
+	int32_t ready_weapon;
+	int32_t kill_count;
+	int32_t item_count;
+	int32_t secret_count;
+};
+
+struct ap_state_level_t
+{
+	uint8_t flags;
+	uint8_t unused;
+	uint16_t checked_size; // Bitset bytes that follow, trailing zeroes trimmed
+};
+
+
+template <typename T>
+static void bin_put(std::string& out, const T& value)
+{
+	out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+
+static void bin_put_varint(std::string& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((char)((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+
+struct ap_bin_reader_t
+{
+	const char* p;
+	const char* end;
+
+	const char* skip(size_t size)
+	{
+		if ((size_t)(end - p) < size) return nullptr;
+		const char* ret = p;
+		p += size;
+		return ret;
+	}
+
+	bool read(void* dst, size_t size)
+	{
+		const char* src = skip(size);
+		if (!src) return false;
+		memcpy(dst, src, size);
+		return true;
+	}
+
+	template <typename T>
+	bool read(T& value)
+	{
+		return read(&value, sizeof(T));
+	}
+
+	bool read_varint(uint64_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64 && p != end; shift += 7)
+		{
+			uint8_t b = (uint8_t)*p++;
+			value |= (uint64_t)(b & 0x7F) << shift;
+			if (!(b & 0x80)) return true;
+		}
+		return false;
+	}
+};
+
+
+static int get_total_level_count()
+{
+	int level_count = 0;
+	for (int i = 0; i < ap_episode_count; ++i)
+		level_count += ap_get_map_count(i + 1);
+	return level_count;
+}
+
+
+static int count_checked_bits(const ap_level_state_t* level_state)
+{
+	int count = 0;
+	for (int i = 0; i < level_state->checked_capacity / 8; ++i)
+	{
+		unsigned char b = level_state->checked_bits[i];
+		for (; b; b &= b - 1)
+			++count;
+	}
+	return count;
+}
+
+
+// Returns false if there is no usable binary state, in which case the caller
+// falls back to apstate.json.
+static bool load_state_binary(const std::string& data)
+{
+	ap_bin_reader_t reader = {data.data(), data.data() + data.size()};
+
+	ap_state_header_t header;
+	if (!reader.read(header) || header.magic != AP_STATE_MAGIC)
+	{
+		printf("  apstate.dat is invalid.\n");
+		return false;
+	}
+	if (header.version < 1 || header.version > AP_STATE_VERSION)
+	{
+		printf("  apstate.dat version %u not supported.\n", header.version);
+		return false;
+	}
+	if (header.episode_count != ap_episode_count ||
+		header.level_count != get_total_level_count() ||
+		header.weapon_count != ap_weapon_count ||
+		header.ammo_count != ap_ammo_count ||
+		header.powerup_count != ap_powerup_count ||
+		header.inventory_count != ap_inventory_count)
+	{
+		printf("  apstate.dat doesn't match this game.\n");
+		return false;
+	}
+
+	// Past the header we keep whatever was read, the server resends items and checks anyway
+	bool ok = true;
+
+	ap_state_player_t player;
+	ok = ok && reader.read(player);
+	if (ok)
+	{
+		ap_state.player_state.health = player.health;
+		ap_state.player_state.armor_points = player.armor_points;
+		ap_state.player_state.armor_type = player.armor_type;
+		ap_state.player_state.backpack = player.backpack;
+		ap_state.player_state.ready_weapon = player.ready_weapon;
+		ap_state.player_state.kill_count = player.kill_count;
+		ap_state.player_state.item_count = player.item_count;
+		ap_state.player_state.secret_count = player.secret_count;
+	}
+	ok = ok && reader.read(ap_state.player_state.powers, sizeof(int) * ap_powerup_count);
+	ok = ok && reader.read(ap_state.player_state.weapon_owned, sizeof(int) * ap_weapon_count);
+	ok = ok && reader.read(ap_state.player_state.ammo, sizeof(int) * ap_ammo_count);
+
+	uint64_t inventory_size = 0;
+	ok = ok && reader.read_varint(inventory_size) && inventory_size <= (uint64_t)ap_inventory_count;
+	ok = ok && reader.read(ap_state.player_state.inventory, sizeof(ap_inventory_slot_t) * (size_t)inventory_size);
+
+	// Level states
+	for (int i = 0; ok && i < ap_episode_count; ++i)
+	{
+		int map_count = ap_get_map_count(i + 1);
+		for (int j = 0; ok && j < map_count; ++j)
+		{
+			auto level_state = ap_get_level_state(ap_level_index_t{i, j});
+
+			ap_state_level_t level;
+			const char* bits = nullptr;
+			ok = reader.read(level) && (bits = reader.skip(level.checked_size)) != nullptr;
+			if (!ok) break;
+
+			if (level.flags & AP_LEVEL_FLAG_COMPLETED) level_state->completed = 1;
+			if (level.flags & AP_LEVEL_FLAG_KEY0) level_state->keys[0] = 1;
+			if (level.flags & AP_LEVEL_FLAG_KEY1) level_state->keys[1] = 1;
+			if (level.flags & AP_LEVEL_FLAG_KEY2) level_state->keys[2] = 1;
+			if (level.flags & AP_LEVEL_FLAG_HAS_MAP) level_state->has_map = 1;
+			if (level.flags & AP_LEVEL_FLAG_UNLOCKED) level_state->unlocked = 1;
+			if (level.flags & AP_LEVEL_FLAG_SPECIAL) level_state->special = 1;
+
+			grow_checked_bits(level_state, level.checked_size * 8);
+			for (int k = 0; k < level.checked_size; ++k)
+				level_state->checked_bits[k] |= (unsigned char)bits[k];
+			level_state->check_count = count_checked_bits(level_state);
+		}
+	}
 
+	// Enabled episodes, slot data may already have set some
+	const char* episodes = ok ? reader.skip(ap_episode_count) : nullptr;
+	ok = episodes != nullptr;
+	for (int i = 0; ok && i < ap_episode_count; ++i)
+		if (episodes[i])
+			ap_state.episodes[i] = 1;
+
+	// Item queue
+	uint64_t count = 0;
+	ok = ok && reader.read_varint(count);
+	for (uint64_t i = 0; ok && i < count; ++i)
+	{
+		uint64_t item_id;
+		ok = reader.read_varint(item_id);
+		if (ok) ap_item_queue.push_back((int64_t)item_id);
+	}
+
+	// Progression locations
+	if (header.version == 1)
+	{
+		// Varint deltas between sorted progressive ids
+		int64_t loc_id = 0;
+		ok = ok && reader.read_varint(count);
+		for (uint64_t i = 0; ok && i < count; ++i)
+		{
+			uint64_t delta;
+			ok = reader.read_varint(delta);
+			loc_id += (int64_t)delta;
+			if (ok) load_legacy_progressive_location(loc_id);
+		}
+	}
+	else
+	{
+		for (auto bits : {&ap_progression_known, &ap_progression_bits})
+		{
+			const char* src = nullptr;
+			ok = ok && reader.read_varint(count) && (src = reader.skip((size_t)count)) != nullptr;
+			if (ok && count == bits->size()) // Stays unknown if the location count changed, we scout again
+				memcpy(bits->data(), src, bits->size());
+		}
+	}
+
+	// Checks the server hadn't confirmed yet
+	if (header.version >= 3)
+	{
+		ok = ok && reader.read_varint(count);
+		for (uint64_t i = 0; ok && i < count; ++i)
+		{
+			uint64_t loc_id;
+			ok = reader.read_varint(loc_id);
+			if (ok) ap_unconfirmed_checks.insert((int64_t)loc_id);
+		}
+	}
+
+	// Received items. Older saves have none, the whole list is applied again.
+	if (header.version >= 4)
+	{
+		uint64_t received_count = 0;
+		uint64_t received_hash = 0;
+		ok = ok && reader.read_varint(received_count) && reader.read(received_hash);
+		if (ok)
+		{
+			ap_received_count = received_count;
+			ap_received_hash = received_hash;
+		}
+	}
+
+	ap_state.ep = header.ep;
+	ap_state.map = header.map;
+	if (header.victory) ap_state.victory = 1;
+
+	if (!ok)
+		printf("  apstate.dat is truncated, kept what could be read.\n");
+	return true;
+}
+
+
+static bool load_state_json()
+{
 	std::string filename = ap_save_dir_name + "/apstate.json";
 	std::ifstream f(filename);
 	if (!f.is_open())
-	{
-		printf("  None found.\n");
-		return; // Could be no state yet, that's fine
-	}
+		return false;
 	Json::Value json;
 	f >> json;
 	f.close();
@@ -821,7 +1607,105 @@ void load_state()
 		json_get_int(inventory_slot["type"], ap_state.player_state.inventory[i].type);
 		json_get_int(inventory_slot["count"], ap_state.player_state.inventory[i].count);
 	}
-	
+
+	// Level states
+	for (int i = 0; i < ap_episode_count; ++i)
+	{
+		int map_count = ap_get_map_count(i + 1);
+		for (int j = 0; j < map_count; ++j)
+		{
+			auto level_state = ap_get_level_state(ap_level_index_t{i, j});
+			json_get_bool_or(json["episodes"][i][j]["completed"], level_state->completed);
+			json_get_bool_or(json["episodes"][i][j]["keys0"], level_state->keys[0]);
+			json_get_bool_or(json["episodes"][i][j]["keys1"], level_state->keys[1]);
+			json_get_bool_or(json["episodes"][i][j]["keys2"], level_state->keys[2]);
+			//json_get_bool_or(json["episodes"][i][j]["check_count"], level_state->check_count);
+			json_get_bool_or(json["episodes"][i][j]["has_map"], level_state->has_map);
+			json_get_bool_or(json["episodes"][i][j]["unlocked"], level_state->unlocked);
+			json_get_bool_or(json["episodes"][i][j]["special"], level_state->special);
+
+			// The server sends them back on connect as well, set_loc_checked ignores duplicates
+			const auto& json_checks = json["episodes"][i][j]["checks"];
+			if (json_checks.isString())
+			{
+				// Hex encoded bitset, 4 thing indices per character
+				std::string hex = json_checks.asString();
+				for (int c = 0; c < (int)hex.size(); ++c)
+				{
+					int nibble = hex_to_nibble(hex[c]);
+					for (int b = 0; b < 4; ++b)
+						if (nibble & (1 << b))
+							set_loc_checked(level_state, c * 4 + b);
+				}
+			}
+			else
+			{
+				// Older saves stored a list of indices
+				for (const auto& json_check : json_checks)
+				{
+					if (json_check.isInt())
+						set_loc_checked(level_state, json_check.asInt());
+				}
+			}
+		}
+	}
+
+	// Item queue
+	for (const auto& item_id_json : json["item_queue"])
+	{
+		ap_item_queue.push_back(item_id_json.asInt64());
+	}
+
+	json_get_int(json["ep"], ap_state.ep);
+	for (int i = 0; i < ap_episode_count; ++i)
+		json_get_int(json["enabled_episodes"][i++], ap_state.episodes[i]);
+	json_get_int(json["map"], ap_state.map);
+
+	for (const auto& prog_json : json["progressive_locations"])
+	{
+		load_legacy_progressive_location(prog_json.asInt64());
+	}
+
+	json_get_bool_or(json["victory"], ap_state.victory);
+
+	for (const auto& loc_id_json : json["unconfirmed_checks"])
+	{
+		ap_unconfirmed_checks.insert(loc_id_json.asInt64());
+	}
+
+	return true;
+}
+
+
+static bool read_file(const std::string& filename, std::string& out)
+{
+	std::ifstream f(filename, std::ios::binary);
+	if (!f.is_open())
+		return false;
+	std::ostringstream ss;
+	ss << f.rdbuf();
+	out = ss.str();
+	return true;
+}
+
+
+void load_state()
+{
+	printf("APDOOM: Load sate\n");
+
+	std::string data;
+	if (!read_file(ap_save_dir_name + "/apstate.dat", data) || !load_state_binary(data))
+	{
+		// Older saves only had apstate.json, the next save writes apstate.dat
+		if (!load_state_json())
+		{
+			printf("  None found.\n");
+			return; // Could be no state yet, that's fine
+		}
+		printf("  Migrating apstate.json\n");
+		mark_state_dirty();
+	}
+
 	if (ap_state.player_state.backpack)
 	{
 		auto max_ammos = get_max_ammos();
@@ -850,42 +1734,10 @@ void load_state()
 	for (int i = 0; i < ap_ammo_count; ++i)
 		printf("      %s = %i\n", get_ammo_name(i), ap_state.player_state.ammo[i]);
 
-	// Level states
-	for (int i = 0; i < ap_episode_count; ++i)
-	{
-		int map_count = ap_get_map_count(i + 1);
-		for (int j = 0; j < map_count; ++j)
-		{
-			auto level_state = ap_get_level_state(ap_level_index_t{i, j});
-			json_get_bool_or(json["episodes"][i][j]["completed"], level_state->completed);
-			json_get_bool_or(json["episodes"][i][j]["keys0"], level_state->keys[0]);
-			json_get_bool_or(json["episodes"][i][j]["keys1"], level_state->keys[1]);
-			json_get_bool_or(json["episodes"][i][j]["keys2"], level_state->keys[2]);
-			//json_get_bool_or(json["episodes"][i][j]["check_count"], level_state->check_count);
-			json_get_bool_or(json["episodes"][i][j]["has_map"], level_state->has_map);
-			json_get_bool_or(json["episodes"][i][j]["unlocked"], level_state->unlocked);
-			json_get_bool_or(json["episodes"][i][j]["special"], level_state->special);
-
-			//int k = 0;
-			//for (const auto& json_check : json["episodes"][i][j]["checks"])
-			//{
-			//	json_get_bool_or(json_check, level_state->checks[k++]);
-			//}
-		}
-	}
-
-	// Item queue
-	for (const auto& item_id_json : json["item_queue"])
-	{
-		ap_item_queue.push_back(item_id_json.asInt64());
-	}
-
-	json_get_int(json["ep"], ap_state.ep);
 	printf("  Enabled episodes: ");
 	int first = 1;
 	for (int i = 0; i < ap_episode_count; ++i)
 	{
-		json_get_int(json["enabled_episodes"][i++], ap_state.episodes[i]);
 		if (ap_state.episodes[i])
 		{
 			if (!first) printf(", ");
@@ -894,16 +1746,8 @@ void load_state()
 		}
 	}
 	printf("\n");
-	json_get_int(json["map"], ap_state.map);
 	printf("  Episode: %i\n", ap_state.ep);
 	printf("  Map: %i\n", ap_state.map);
-
-	for (const auto& prog_json : json["progressive_locations"])
-	{
-		ap_progressive_locations.insert(prog_json.asInt64());
-	}
-	
-	json_get_bool_or(json["victory"], ap_state.victory);
 	printf("  Victory state: %s\n", ap_state.victory ? "true" : "false");
 }
 
@@ -923,13 +1767,17 @@ static Json::Value serialize_level(int ep, int map)
 	json_level["unlocked"] = level_state->unlocked;
 	json_level["special"] = level_state->special;
 
-	Json::Value json_checks(Json::arrayValue);
-	for (int k = 0; k < AP_CHECK_MAX; ++k)
+	// Hex encoded bitset, low bit of each character is the lowest thing index.
+	// Trailing zeroes are trimmed.
+	static const char hex_digits[] = "0123456789ABCDEF";
+	std::string json_checks;
+	for (int k = 0; k < level_state->checked_capacity; k += 4)
 	{
-		if (level_state->checks[k] == -1)
-			continue;
-		json_checks.append(level_state->checks[k]);
+		int nibble = (level_state->checked_bits[k >> 3] >> (k & 7)) & 15;
+		json_checks.push_back(hex_digits[nibble]);
 	}
+	while (!json_checks.empty() && json_checks.back() == '0')
+		json_checks.pop_back();
 	json_level["checks"] = json_checks;
 
 	return json_level;
@@ -953,19 +1801,8 @@ std::vector<ap_level_index_t> get_level_indices()
 }
 
 
-void save_state()
+static Json::Value serialize_state_json()
 {
-	std::string filename = ap_save_dir_name + "/apstate.json";
-	std::ofstream f(filename);
-	if (!f.is_open())
-	{
-		printf("Failed to save AP state.\n");
-#if WIN32
-		MessageBoxA(nullptr, "Failed to save player state. That's bad.", "Error", MB_OK);
-#endif
-		return; // Ok that's bad. we won't save player state
-	}
-
 	// Player state
 	Json::Value json;
 	Json::Value json_player;
@@ -1035,76 +1872,240 @@ void save_state()
 	json["map"] = ap_state.map;
 
 	// Progression items (So we don't scout everytime we connect)
-	for (auto loc_id : ap_progressive_locations)
+	const auto& tables = get_def_tables();
+	for (int i = 0; i < tables.location_count; ++i)
 	{
-		json["progressive_locations"].append(loc_id);
+		if (test_bit(ap_progression_bits, i))
+			json["progressive_locations"].append(tables.locations[i].loc_id);
 	}
 
 	json["victory"] = ap_state.victory;
 
+	json["unconfirmed_checks"] = Json::Value(Json::arrayValue);
+	for (auto loc_id : ap_unconfirmed_checks)
+		json["unconfirmed_checks"].append(loc_id);
+
 	json["version"] = APDOOM_VERSION_FULL_TEXT;
 
-	f << json;
+	return json;
 }
 
 
-void f_itemclr()
+static std::string serialize_state_binary()
 {
-	// Not sure what use this would have here.
-}
+	std::string out;
+
+	ap_state_header_t header;
+	header.magic = AP_STATE_MAGIC;
+	header.version = AP_STATE_VERSION;
+	header.episode_count = ap_episode_count;
+	header.level_count = get_total_level_count();
+	header.weapon_count = ap_weapon_count;
+	header.ammo_count = ap_ammo_count;
+	header.powerup_count = ap_powerup_count;
+	header.inventory_count = ap_inventory_count;
+	header.ep = ap_state.ep;
+	header.map = ap_state.map;
+	header.victory = ap_state.victory;
+	bin_put(out, header);
+
+	// Player state
+	ap_state_player_t player;
+	player.health = ap_state.player_state.health;
+	player.armor_points = ap_state.player_state.armor_points;
+	player.armor_type = ap_state.player_state.armor_type;
+	player.backpack = ap_state.player_state.backpack;
+	player.ready_weapon = ap_state.player_state.ready_weapon;
+	player.kill_count = ap_state.player_state.kill_count;
+	player.item_count = ap_state.player_state.item_count;
+	player.secret_count = ap_state.player_state.secret_count;
+	bin_put(out, player);
+
+	out.append((const char*)ap_state.player_state.powers, sizeof(int) * ap_powerup_count);
+	out.append((const char*)ap_state.player_state.weapon_owned, sizeof(int) * ap_weapon_count);
+	out.append((const char*)ap_state.player_state.ammo, sizeof(int) * ap_ammo_count);
+
+	std::vector<ap_inventory_slot_t> inventory;
+	for (int i = 0; i < ap_inventory_count; ++i)
+	{
+		if (ap_state.player_state.inventory[i].type == 9) // Don't include wings to player inventory, they are per level
+			continue;
+		inventory.push_back(ap_state.player_state.inventory[i]);
+	}
+	bin_put_varint(out, inventory.size());
+	out.append((const char*)inventory.data(), sizeof(ap_inventory_slot_t) * inventory.size());
+
+	// Level states
+	for (int i = 0; i < ap_episode_count; ++i)
+	{
+		int map_count = ap_get_map_count(i + 1);
+		for (int j = 0; j < map_count; ++j)
+		{
+			auto level_state = ap_get_level_state(ap_level_index_t{i, j});
+
+			int checked_size = std::min(level_state->checked_capacity / 8, 0xFFFF);
+			while (checked_size > 0 && !level_state->checked_bits[checked_size - 1])
+				--checked_size;
+
+			ap_state_level_t level;
+			level.flags = 0;
+			if (level_state->completed) level.flags |= AP_LEVEL_FLAG_COMPLETED;
+			if (level_state->keys[0]) level.flags |= AP_LEVEL_FLAG_KEY0;
+			if (level_state->keys[1]) level.flags |= AP_LEVEL_FLAG_KEY1;
+			if (level_state->keys[2]) level.flags |= AP_LEVEL_FLAG_KEY2;
+			if (level_state->has_map) level.flags |= AP_LEVEL_FLAG_HAS_MAP;
+			if (level_state->unlocked) level.flags |= AP_LEVEL_FLAG_UNLOCKED;
+			if (level_state->special) level.flags |= AP_LEVEL_FLAG_SPECIAL;
+			level.unused = 0;
+			level.checked_size = (uint16_t)checked_size;
+			bin_put(out, level);
+			out.append((const char*)level_state->checked_bits, checked_size);
+		}
+	}
+
+	for (int i = 0; i < ap_episode_count; ++i)
+		out.push_back(ap_state.episodes[i] ? 1 : 0);
+
+	// Item queue
+	bin_put_varint(out, ap_item_queue.size());
+	for (auto item_id : ap_item_queue)
+		bin_put_varint(out, (uint64_t)item_id);
+
+	// Progression items (So we don't scout everytime we connect)
+	for (auto bits : {&ap_progression_known, &ap_progression_bits})
+	{
+		bin_put_varint(out, bits->size());
+		out.append((const char*)bits->data(), bits->size());
+	}
 
+	// Checks the server hasn't confirmed yet
+	bin_put_varint(out, ap_unconfirmed_checks.size());
+	for (auto loc_id : ap_unconfirmed_checks)
+		bin_put_varint(out, (uint64_t)loc_id);
 
-static const std::map<int, int> doom_keys_map = {{5, 0}, {40, 0}, {6, 1}, {39, 1}, {13, 2}, {38, 2}};
-static const std::map<int, int> doom2_keys_map = {{5, 0}, {40, 0}, {6, 1}, {39, 1}, {13, 2}, {38, 2}};
-static const std::map<int, int> heretic_keys_map = {{80, 0}, {73, 1}, {79, 2}};
+	bin_put_varint(out, ap_received_count);
+	bin_put(out, ap_received_hash);
+
+	return out;
+}
 
 
-const std::map<int, int>& get_keys_map()
+static ap_save_snapshot_t make_save_snapshot()
 {
-	switch (ap_game)
+	ap_save_snapshot_t snapshot;
+	snapshot.data = serialize_state_binary();
+	if (ap_settings.export_state_json)
 	{
-		case ap_game_t::doom: return doom_keys_map;
-		case ap_game_t::doom2: return doom2_keys_map;
-		case ap_game_t::heretic: return heretic_keys_map;
+		snapshot.json = serialize_state_json();
+		snapshot.has_json = true;
 	}
+	return snapshot;
 }
 
 
-int get_map_doom_type()
+// Writes to a temporary file first then renames it over the destination, so a
+// crash mid-write leaves the previous state intact.
+static bool write_file_atomic(const std::string& filename, const std::string& contents)
 {
-	switch (ap_game)
+	std::string tmp_filename = filename + ".tmp";
 	{
-		case ap_game_t::doom: return 2026;
-		case ap_game_t::doom2: return 2026;
-		case ap_game_t::heretic: return 35;
+		std::ofstream f(tmp_filename, std::ios::binary);
+		if (!f.is_open())
+			return false;
+		f.write(contents.data(), contents.size());
+		f.close();
+		if (f.fail())
+			return false;
 	}
+	return AP_RenameFile(tmp_filename.c_str(), filename.c_str()) ? true : false;
 }
 
 
-static const std::map<int, int> doom_weapons_map = {{2001, 2}, {2002, 3}, {2003, 4}, {2004, 5}, {2006, 6}, {2005, 7}};
-static const std::map<int, int> doom2_weapons_map = {{2001, 2}, {2002, 3}, {2003, 4}, {2004, 5}, {2006, 6}, {2005, 7}, {82, 8}};
-static const std::map<int, int> heretic_weapons_map = {{2005, 7}, {2001, 2}, {53, 3}, {2003, 5}, {2002, 6}, {2004, 4}};
+static void write_state_files(const ap_save_snapshot_t& snapshot)
+{
+	ap_trace_scope_t trace("write_state_files");
+
+	if (!write_file_atomic(ap_save_dir_name + "/apstate.dat", snapshot.data))
+	{
+		printf("Failed to save AP state.\n");
+#if WIN32
+		MessageBoxA(nullptr, "Failed to save player state. That's bad.", "Error", MB_OK);
+#endif
+		return; // Ok that's bad. we won't save player state
+	}
+
+	// Debugging copy, never read back once apstate.dat exists
+	if (snapshot.has_json)
+	{
+		std::ostringstream ss;
+		ss << snapshot.json;
+		if (!write_file_atomic(ap_save_dir_name + "/apstate.json", ss.str()))
+			printf("APDOOM: Failed to export apstate.json\n");
+	}
+}
 
 
-const std::map<int, int>& get_weapons_map()
+static void save_thread_main()
 {
-	switch (ap_game)
+	std::unique_lock<std::mutex> lock(ap_save_mutex);
+	while (true)
 	{
-		case ap_game_t::doom: return doom_weapons_map;
-		case ap_game_t::doom2: return doom2_weapons_map;
-		case ap_game_t::heretic: return heretic_weapons_map;
+		ap_save_cv.wait(lock, [] { return ap_save_has_pending || ap_save_quit; });
+		if (!ap_save_has_pending) break;
+
+		ap_save_snapshot_t snapshot;
+		std::swap(snapshot, ap_save_pending);
+		ap_save_has_pending = false;
+		ap_save_busy = true;
+
+		lock.unlock();
+		write_state_files(snapshot);
+		lock.lock();
+
+		ap_save_busy = false;
+		ap_save_cv.notify_all();
 	}
+	ap_save_thread_running = false;
+	ap_save_cv.notify_all();
 }
 
 
-const std::map<int, std::string>& get_sprites()
+static void queue_save_state()
 {
-	switch (ap_game)
+	ap_trace_scope_t trace("queue_save_state");
+	ap_save_snapshot_t snapshot = make_save_snapshot();
+	ap_state_dirty = false;
+	ap_last_save_time = std::chrono::steady_clock::now();
+
+	std::unique_lock<std::mutex> lock(ap_save_mutex);
+	if (!ap_save_thread_running)
 	{
-		case ap_game_t::doom: return ap_doom_type_sprites;
-		case ap_game_t::doom2: return ap_doom2_type_sprites;
-		case ap_game_t::heretic: return ap_heretic_type_sprites;
+		// Detached, the temp file rename keeps us safe if the process exits mid-write
+		ap_save_thread_running = true;
+		ap_save_quit = false;
+		std::thread(save_thread_main).detach();
 	}
+	std::swap(ap_save_pending, snapshot); // Replaces an older snapshot not yet written
+	ap_save_has_pending = true;
+	ap_save_cv.notify_all();
+}
+
+
+// Wait for the writer thread to finish what it has
+static void flush_save_state()
+{
+	std::unique_lock<std::mutex> lock(ap_save_mutex);
+	ap_save_cv.wait(lock, [] { return !ap_save_has_pending && !ap_save_busy; });
+}
+
+
+void save_state()
+{
+	ap_trace_scope_t trace("save_state");
+	flush_save_state();
+	write_state_files(make_save_snapshot());
+	ap_state_dirty = false;
+	ap_last_save_time = std::chrono::steady_clock::now();
 }
 
 
@@ -1116,177 +2117,514 @@ std::string get_exmx_name(const std::string& name)
 }
 
 
-void f_itemrecv(int64_t item_id, int player_id, bool notify_player)
+// Everything receiving an item of a given doom type does, resolved once at init
+struct ap_type_desc_t
 {
-	const auto& item_type_table = get_item_type_table();
-	auto it = item_type_table.find(item_id);
-	if (it == item_type_table.end())
-		return; // Skip
-	ap_item_t item = it->second;
-	ap_level_index_t idx = {item.ep - 1, item.map - 1};
-	ap_level_info_t* level_info = ap_get_level_info(idx);
+	int key; // -1 if not a key
+	int weapon; // -1 if not a weapon
+	bool is_map;
+	bool is_backpack;
+	const char* sprite; // Notification icon, nullptr if none
+};
 
-	std::string notif_text;
 
-	auto level_state = ap_get_level_state(idx);
+static std::vector<ap_type_desc_t> ap_type_descs; // Indexed by doom_type
 
-	// Key?
-	const auto& keys_map = get_keys_map();
-	auto key_it = keys_map.find(item.doom_type);
-	if (key_it != keys_map.end())
-	{
-		level_state->keys[key_it->second] = 1;
-		notif_text = get_exmx_name(level_info->name);
-	}
 
-	// Map?
-	if (item.doom_type == get_map_doom_type())
-	{
-		level_state->has_map = 1;
-		notif_text = get_exmx_name(level_info->name);
-	}
+static void build_type_descs()
+{
+	const auto& tables = get_def_tables();
 
-	// Backpack?
-	if (item.doom_type == 8)
-	{
-		ap_state.player_state.backpack = 1;
-		auto max_ammos = get_max_ammos();
-		for (int i = 0; i < ap_ammo_count; ++i)
-			ap_state.player_state.max_ammo[i] = max_ammos[i] * 2;
-	}
+	int max_type = ap_game_desc->map_doom_type;
+	for (int i = 0; i < tables.item_count; ++i)
+		max_type = max(max_type, tables.items[i].item.doom_type);
+	for (int i = 0; i < tables.type_sprite_count; ++i)
+		max_type = max(max_type, tables.type_sprites[i].doom_type);
+	for (int i = 0; i < ap_game_desc->key_count; ++i)
+		max_type = max(max_type, ap_game_desc->keys[i].doom_type);
+	for (int i = 0; i < ap_game_desc->weapon_def_count; ++i)
+		max_type = max(max_type, ap_game_desc->weapons[i].doom_type);
 
-	// Weapon?
-	const auto& weapons_map = get_weapons_map();
-	auto weapon_it = weapons_map.find(item.doom_type);
-	if (weapon_it != weapons_map.end())
-		ap_state.player_state.weapon_owned[weapon_it->second] = 1;
+	ap_type_descs.assign(max_type + 1, {-1, -1, false, false, nullptr});
+	for (int i = 0; i < ap_game_desc->key_count; ++i)
+		ap_type_descs[ap_game_desc->keys[i].doom_type].key = ap_game_desc->keys[i].slot;
+	for (int i = 0; i < ap_game_desc->weapon_def_count; ++i)
+		ap_type_descs[ap_game_desc->weapons[i].doom_type].weapon = ap_game_desc->weapons[i].slot;
+	for (int i = 0; i < tables.type_sprite_count; ++i)
+		ap_type_descs[tables.type_sprites[i].doom_type].sprite = tables.type_sprites[i].sprite;
+	ap_type_descs[ap_game_desc->map_doom_type].is_map = true;
+	if (8 <= max_type)
+		ap_type_descs[8].is_backpack = true;
+}
 
-	// Ignore inventory items, the game will add them up
 
-	// Is it a level?
-	if (item.doom_type == -1)
-	{
-		level_state->unlocked = 1;
-		notif_text = get_exmx_name(level_info->name);
-	}
+static const ap_type_desc_t* get_type_desc(int doom_type)
+{
+	if (doom_type < 0 || doom_type >= (int)ap_type_descs.size()) return nullptr;
+	return &ap_type_descs[doom_type];
+}
 
-	// Level complete?
-	if (item.doom_type == -2)
-		level_state->completed = 1;
 
+// Level specific items, what "!hint E1M1 blue" can resolve to
+struct ap_hint_item_t
+{
+	std::string command; // "!hint " and the full item name, sent as is
+	std::vector<std::string> words; // Lowercase words after the level name
+};
 
-	if (!notify_player) return;
 
-	if (!ap_is_in_game)
-	{
-		ap_item_queue.push_back(item_id);
-		return;
-	}
+static std::vector<std::vector<ap_hint_item_t>> ap_hint_items; // By level, ep * max_map_count + map
 
-	// Give item to player
-	ap_settings.give_item_callback(item.doom_type, item.ep, item.map);
 
-	// Add notification icon
-	const auto& sprite_map = get_sprites();
-	auto sprite_it = sprite_map.find(item.doom_type);
-	if (sprite_it != sprite_map.end())
+static void build_hint_items()
+{
+	const auto& tables = get_def_tables();
+
+	ap_hint_items.assign(ap_episode_count * max_map_count, {});
+	for (int i = 0; i < tables.item_count; ++i)
 	{
-		ap_notification_icon_t notif;
-		snprintf(notif.sprite, 9, "%s", sprite_it->second.c_str());
-		notif.t = 0;
-		notif.text[0] = '\0'; // For now
-		if (notif_text != "")
+		const auto& def = tables.items[i];
+		if (def.item.doom_type < 0) continue; // Level access and completion
+		auto level_info = ap_get_level_info(ap_level_index_t{def.item.ep - 1, def.item.map - 1});
+		if (!level_info) continue;
+
+		ap_hint_item_t hint_item;
+		hint_item.command = std::string("!hint ") + def.name;
+		const char* suffix = strstr(def.name, " - ");
+		suffix = suffix ? suffix + 3 : def.name;
+		std::string word;
+		for (const char* c = suffix; ; ++c)
 		{
-			snprintf(notif.text, 260, "%s", notif_text.c_str());
+			if (isalnum((unsigned char)*c))
+			{
+				word += (char)tolower((unsigned char)*c);
+				continue;
+			}
+			if (!word.empty()) hint_item.words.push_back(word);
+			word.clear();
+			if (!*c) break;
 		}
-		notif.xf = AP_NOTIF_SIZE / 2 + AP_NOTIF_PADDING;
-		notif.yf = -200.0f + AP_NOTIF_SIZE / 2;
-		notif.state = AP_NOTIF_STATE_PENDING;
-		notif.velx = 0.0f;
-		notif.vely = 0.0f;
-		notif.x = (int)notif.xf;
-		notif.y = (int)notif.yf;
-		ap_notification_icons.push_back(notif);
+		ap_hint_items[(def.item.ep - 1) * max_map_count + (def.item.map - 1)].push_back(hint_item);
 	}
 }
 
 
-bool find_location(int64_t loc_id, int &ep, int &map, int &index)
+// What notifications show for keys and maps. Never changes after init,
+// so no string is built when an item comes in.
+static void build_level_names()
 {
-	ep = -1;
-	map = -1;
-	index = -1;
+	ap_level_short_names.assign(ap_episode_count * max_map_count, "");
+	for (int ep = 0; ep < ap_episode_count; ++ep)
+	{
+		int map_count = ap_get_map_count(ep + 1);
+		for (int map = 0; map < map_count; ++map)
+			ap_level_short_names[ep * max_map_count + map] = get_exmx_name(ap_get_level_info(ap_level_index_t{ep, map})->name);
+	}
+}
+
 
-	const auto& loc_table = get_location_table();
-	for (const auto& loc_map_table : loc_table)
+// Finds the item of that level the most hint words point to. A word matches
+// an item word it is a prefix of, so "yel" or "comp" are enough.
+static const ap_hint_item_t* find_hint_item(ap_level_index_t idx, const char (*words)[16], int word_count)
+{
+	const ap_hint_item_t* best = nullptr;
+	int best_score = 0;
+	for (const auto& hint_item : ap_hint_items[idx.ep * max_map_count + idx.map])
 	{
-		for (const auto& loc_index_table : loc_map_table.second)
+		int score = 0;
+		for (int i = 0; i < word_count; ++i)
 		{
-			for (const auto& loc_index : loc_index_table.second)
+			size_t len = strlen(words[i]);
+			for (const auto& item_word : hint_item.words)
 			{
-				if (loc_index.second == loc_id)
+				if (item_word.compare(0, len, words[i]) == 0)
 				{
-					ep = loc_map_table.first;
-					map = loc_index_table.first;
-					index = loc_index.first;
+					score++;
 					break;
 				}
 			}
-			if (ep != -1) break;
 		}
-		if (ep != -1) break;
+		if (score > best_score)
+		{
+			best_score = score;
+			best = &hint_item;
+		}
 	}
-	return (ep > 0);
+	return best;
 }
 
 
-void f_locrecv(int64_t loc_id)
+static void queue_notification(const char* sprite, const char* text)
 {
-	// Find where this location is
-	int ep = -1;
-	int map = -1;
-	int index = -1;
-	if (!find_location(loc_id, ep, map, index))
+	if (ap_notification_backlog_count == AP_NOTIF_MAX_BACKLOG)
 	{
-		printf("APDOOM: In f_locrecv, loc id not found: %i\n", (int)loc_id);
-		return; // Loc not found
+		printf("APDOOM: Too many notifications queued, dropping %s\n", sprite);
+		return;
 	}
 
-	ap_level_index_t idx = {ep - 1, map - 1};
+	int slot = (ap_notification_backlog_start + ap_notification_backlog_count) % AP_NOTIF_MAX_BACKLOG;
+	auto& pending = ap_notification_backlog[slot];
+	snprintf(pending.sprite, 9, "%s", sprite);
+	pending.text = text;
+	ap_notification_backlog_count++;
+}
 
-	// Make sure we didn't already check it
-	if (is_loc_checked(idx, index)) return;
-	if (index < 0) return;
 
-	auto level_state = ap_get_level_state(idx);
-	level_state->checks[level_state->check_count] = index;
-	level_state->check_count++;
+// Moves the oldest backlog entry into an active slot, dropping from the top
+static void activate_notification()
+{
+	const auto& pending = ap_notification_backlog[ap_notification_backlog_start];
+	ap_notification_backlog_start = (ap_notification_backlog_start + 1) % AP_NOTIF_MAX_BACKLOG;
+	ap_notification_backlog_count--;
+
+	auto& notif = ap_notification_icons[ap_notification_icon_count++];
+	memcpy(notif.sprite, pending.sprite, sizeof(notif.sprite));
+	notif.text = pending.text;
+	notif.t = 0;
+	notif.xf = AP_NOTIF_SIZE / 2 + AP_NOTIF_PADDING;
+	notif.yf = -200.0f + AP_NOTIF_SIZE / 2;
+	notif.state = AP_NOTIF_STATE_DROPPING;
+	notif.velx = 0.0f;
+	notif.vely = 0.0f;
+	notif.x = (int)notif.xf;
+	notif.y = (int)notif.yf;
 }
 
 
-void f_locinfo(std::vector<AP_NetworkItem> loc_infos)
+// Adds the item's notification icon
+static void notify_item(const ap_item_t& item)
 {
-	for (const auto& loc_info : loc_infos)
+	auto desc = get_type_desc(item.doom_type);
+	if (desc && desc->sprite)
 	{
-		if (loc_info.flags & 1)
-			ap_progressive_locations.insert(loc_info.location);
+		const char* text = "";
+		if (desc->key != -1 || desc->is_map)
+		{
+			if (ap_get_level_info({item.ep - 1, item.map - 1}))
+				text = ap_level_short_names[(item.ep - 1) * max_map_count + (item.map - 1)].c_str();
+		}
+		queue_notification(desc->sprite, text);
 	}
 }
 
 
-void f_goal(int goal)
+// Gives the item to the player and pops its notification icon. State was already applied in f_itemrecv.
+static void deliver_item(const ap_item_t& item)
 {
-	ap_state.goal = goal;
+	ap_settings.give_item_callback(item.doom_type, item.ep, item.map);
+	notify_item(item);
 }
 
 
-void f_difficulty(int difficulty)
+// Delivers everything that was queued while in the menu, in one go. With
+// give_items_callback the game gets them in a single call, so it can show
+// one message and play one sound instead of one per item.
+static void deliver_queued_items()
 {
-	if (ap_settings.override_skill)
+	if (ap_item_queue.empty()) return;
+	ap_trace_scope_t trace("deliver_queued_items");
+	mark_state_dirty();
+
+	if (!ap_settings.give_items_callback)
+	{
+		while (!ap_item_queue.empty())
+		{
+			auto item = get_item(ap_item_queue.front());
+			ap_item_queue.pop_front();
+			if (item)
+				deliver_item(*item);
+		}
 		return;
+	}
 
-	ap_state.difficulty = difficulty;
-}
+	static std::vector<ap_given_item_t> given;
+	given.clear();
+	for (auto item_id : ap_item_queue)
+	{
+		auto item = get_item(item_id);
+		if (!item) continue;
+		given.push_back({item->doom_type, item->ep, item->map});
+		notify_item(*item);
+	}
+	ap_item_queue.clear();
+	if (!given.empty())
+		ap_settings.give_items_callback(given.data(), (int)given.size());
+}
+
+
+// Called from APCpp's socket thread. Blocks that thread, never the game, if the game falls behind.
+static void push_ap_event(ap_event_type_t type, int64_t id)
+{
+	ap_event_t event = {type, id};
+	while (!ap_event_queue.push(event))
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+
+void f_itemrecv(int64_t item_id, int player_id, bool notify_player)
+{
+	ap_trace_scope_t trace("f_itemrecv");
+	push_ap_event(notify_player ? ap_event_type_t::item : ap_event_type_t::item_silent, item_id);
+}
+
+
+void f_itemclr()
+{
+	push_ap_event(ap_event_type_t::item_clear, 0);
+}
+
+
+static void apply_item(int64_t item_id, bool notify_player);
+
+
+static void begin_item_resync()
+{
+	ap_resync.active = ap_received_count > 0;
+	ap_resync.count = ap_received_count;
+	ap_resync.hash = ap_received_hash;
+	ap_resync.skipped.clear();
+	ap_resync.idle_tics = 0;
+	ap_received_count = 0;
+	ap_received_hash = AP_RECEIVED_HASH_INIT;
+}
+
+
+// The server's list isn't what the state was built from, give everything
+static void end_item_resync(bool diverged)
+{
+	if (diverged)
+	{
+		printf("APDOOM: Received items differ from the saved state, applying all %i\n", (int)ap_resync.skipped.size());
+		for (const auto& skipped : ap_resync.skipped)
+			apply_item(skipped.first, skipped.second);
+	}
+	ap_resync.active = false;
+	ap_resync.skipped.clear();
+	ap_resync.skipped.shrink_to_fit();
+	mark_state_dirty();
+}
+
+
+static void receive_item(int64_t item_id, bool notify_player)
+{
+	ap_received_count++;
+	for (int i = 0; i < 8; ++i)
+		ap_received_hash = (ap_received_hash ^ ((uint64_t)item_id >> (i * 8) & 0xFF)) * 0x100000001b3ull;
+
+	if (ap_resync.active)
+	{
+		ap_resync.skipped.push_back({item_id, notify_player});
+		ap_resync.idle_tics = 0;
+		if (ap_received_count == ap_resync.count)
+			end_item_resync(ap_received_hash != ap_resync.hash);
+		return;
+	}
+
+	apply_item(item_id, notify_player);
+}
+
+
+static void apply_item(int64_t item_id, bool notify_player)
+{
+	auto item_def = get_item(item_id);
+	if (!item_def)
+		return; // Skip
+	const ap_item_t& item = *item_def;
+	ap_level_index_t idx = {item.ep - 1, item.map - 1};
+	auto desc = get_type_desc(item.doom_type);
+
+	if (desc)
+	{
+		// Key?
+		if (desc->key != -1)
+			ap_get_level_state(idx)->keys[desc->key] = 1;
+
+		// Map?
+		if (desc->is_map)
+			ap_get_level_state(idx)->has_map = 1;
+
+		// Backpack?
+		if (desc->is_backpack)
+		{
+			ap_state.player_state.backpack = 1;
+			auto max_ammos = get_max_ammos();
+			for (int i = 0; i < ap_ammo_count; ++i)
+				ap_state.player_state.max_ammo[i] = max_ammos[i] * 2;
+		}
+
+		// Weapon?
+		if (desc->weapon != -1)
+			ap_state.player_state.weapon_owned[desc->weapon] = 1;
+
+		// Ignore inventory items, the game will add them up
+	}
+
+	// Is it a level?
+	if (item.doom_type == -1)
+		ap_get_level_state(idx)->unlocked = 1;
+
+	// Level complete?
+	if (item.doom_type == -2)
+		ap_get_level_state(idx)->completed = 1;
+
+	mark_state_dirty();
+
+	if (!notify_player) return;
+
+	if (!ap_is_in_game)
+	{
+		ap_item_queue.push_back(item_id);
+		return;
+	}
+
+	// Give item to player
+	deliver_item(item);
+}
+
+
+bool find_location(int64_t loc_id, int &ep, int &map, int &index)
+{
+	auto loc = get_location_def(loc_id);
+	if (!loc)
+	{
+		ep = -1;
+		map = -1;
+		index = -1;
+		return false;
+	}
+
+	ep = loc->ep;
+	map = loc->map;
+	index = loc->index;
+	return (ep > 0);
+}
+
+
+// Steps through the table by a prime, so that ids that sort together
+// aren't looked up one after the other
+static int bench_table_index(int i, int count)
+{
+	return (int)(((long long)i * 7919) % count);
+}
+
+
+int apdoom_bench_find_locations(int count)
+{
+	const auto& tables = get_def_tables();
+	int found = 0;
+	if (tables.location_count == 0) return 0;
+	for (int i = 0; i < count; ++i)
+	{
+		int ep, map, index;
+		if (find_location(tables.locations[bench_table_index(i, tables.location_count)].loc_id, ep, map, index))
+			++found;
+	}
+	return found;
+}
+
+
+int apdoom_bench_find_items(int count)
+{
+	const auto& tables = get_def_tables();
+	int found = 0;
+	if (tables.item_count == 0) return 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (get_item(tables.items[bench_table_index(i, tables.item_count)].item_id))
+			++found;
+	}
+	return found;
+}
+
+
+int apdoom_bench_get_locations(long long* ids, ap_level_index_t* idxs, int* indices, int max_count)
+{
+	const auto& tables = get_def_tables();
+	int count = std::min(max_count, tables.location_count);
+	for (int i = 0; i < count; ++i)
+	{
+		const auto& loc = tables.locations[i];
+		ids[i] = loc.loc_id;
+		if (idxs) idxs[i] = {loc.ep - 1, loc.map - 1};
+		if (indices) indices[i] = loc.index;
+	}
+	return count;
+}
+
+
+int apdoom_bench_get_item_ids(long long* ids, int max_count)
+{
+	const auto& tables = get_def_tables();
+	int count = std::min(max_count, tables.item_count);
+	for (int i = 0; i < count; ++i)
+		ids[i] = tables.items[i].item_id;
+	return count;
+}
+
+
+void f_locrecv(int64_t loc_id)
+{
+	ap_trace_scope_t trace("f_locrecv");
+	push_ap_event(ap_event_type_t::location, loc_id);
+}
+
+
+static void apply_location(int64_t loc_id)
+{
+	// The server has it, no need to send it again
+	if (ap_unconfirmed_checks.erase(loc_id))
+		mark_state_dirty();
+
+	// Find where this location is
+	int ep = -1;
+	int map = -1;
+	int index = -1;
+	if (!find_location(loc_id, ep, map, index))
+	{
+		printf("APDOOM: In apply_location, loc id not found: %i\n", (int)loc_id);
+		return; // Loc not found
+	}
+
+	ap_level_index_t idx = {ep - 1, map - 1};
+
+	// Make sure we didn't already check it
+	set_loc_checked(ap_get_level_state(idx), index);
+}
+
+
+void f_locinfo(std::vector<AP_NetworkItem> loc_infos)
+{
+	for (const auto& loc_info : loc_infos)
+	{
+		push_ap_event((loc_info.flags & 1) ? ap_event_type_t::location_info_progression : ap_event_type_t::location_info_filler, loc_info.location);
+	}
+}
+
+
+static void apply_location_info(int64_t loc_id, bool progression)
+{
+	int ordinal = get_location_ordinal(loc_id);
+	if (ordinal == -1)
+		return; // Not one of ours
+	set_location_progression(ordinal, progression);
+	mark_state_dirty();
+	ap_spawn_plan_version++;
+}
+
+
+void f_goal(int goal)
+{
+	ap_state.goal = goal;
+}
+
+
+void f_difficulty(int difficulty)
+{
+	if (ap_settings.override_skill)
+		return;
+
+	ap_state.difficulty = difficulty;
+}
 
 
 void f_random_monsters(int random_monsters)
@@ -1327,6 +2665,8 @@ void f_flip_levels(int flip_levels)
 
 void f_check_sanity(int check_sanity)
 {
+	ap_spawn_plan_version++;
+	ap_spawn_validation_version++;
 	ap_state.check_sanity = check_sanity;
 }
 
@@ -1340,33 +2680,40 @@ void f_reset_level_on_death(int reset_level_on_death)
 }
 
 
+// Slot data can name more episodes than the game has
+static void set_episode(int i, int ep)
+{
+	if (i < ap_episode_count) ap_state.episodes[i] = ep;
+}
+
+
 void f_episode1(int ep)
 {
-	ap_state.episodes[0] = ep;
+	set_episode(0, ep);
 }
 
 
 void f_episode2(int ep)
 {
-	ap_state.episodes[1] = ep;
+	set_episode(1, ep);
 }
 
 
 void f_episode3(int ep)
 {
-	ap_state.episodes[2] = ep;
+	set_episode(2, ep);
 }
 
 
 void f_episode4(int ep)
 {
-	ap_state.episodes[3] = ep;
+	set_episode(3, ep);
 }
 
 
 void f_episode5(int ep)
 {
-	ap_state.episodes[4] = ep;
+	set_episode(4, ep);
 }
 
 
@@ -1384,19 +2731,8 @@ const char* apdoom_get_seed()
 
 void apdoom_check_location(ap_level_index_t idx, int index)
 {
-	int64_t id = 0;
-	const auto& loc_table = get_location_table();
-
-	auto it1 = loc_table.find(idx.ep + 1);
-	if (it1 == loc_table.end()) return;
-
-	auto it2 = it1->second.find(idx.map + 1);
-	if (it2 == it1->second.end()) return;
-
-	auto it3 = it2->second.find(index);
-	if (it3 == it2->second.end()) return;
-
-	id = it3->second;
+	int64_t id = get_location_id(idx, index);
+	if (id == -1) return;
 
 	if (index >= 0)
 	{
@@ -1405,50 +2741,71 @@ void apdoom_check_location(ap_level_index_t idx, int index)
 			printf("APDOOM: Location already checked\n");
 		}
 		else
-		{ // We get back from AP
-			//auto level_state = ap_get_level_state(ep, map);
-			//level_state->checks[level_state->check_count] = index;
-			//level_state->check_count++;
+		{
+			// Record it now, so the thing stays gone if the level reloads
+			// before the server echoes it back
+			set_loc_checked(ap_get_level_state(idx), index);
 		}
 	}
-	AP_SendItem(id);
+
+	// Journaled until the server confirms it, sent with the tic's batch
+	if (ap_unconfirmed_checks.insert(id).second)
+		mark_state_dirty();
+	ap_outgoing_checks.insert(id);
 }
 
 
-int apdoom_is_location_progression(ap_level_index_t idx, int index)
+// Sends this tic's checks as one LocationChecks. After a (re)connect,
+// everything unconfirmed is sent again, the server ignores duplicates.
+static void flush_outgoing_checks()
 {
-	const auto& loc_table = get_location_table();
+	if (ap_settings.offline)
+	{
+		ap_outgoing_checks.clear(); // Still journaled for a later online session
+		return;
+	}
 
-	auto it1 = loc_table.find(idx.ep + 1);
-	if (it1 == loc_table.end()) return 0;
+	bool online = AP_GetConnectionStatus() == AP_ConnectionStatus::Authenticated;
+	if (online && !ap_checks_online)
+		ap_outgoing_checks.insert(ap_unconfirmed_checks.begin(), ap_unconfirmed_checks.end());
+	ap_checks_online = online;
 
-	auto it2 = it1->second.find(idx.map + 1);
-	if (it2 == it1->second.end()) return 0;
+	if (!online || ap_outgoing_checks.empty()) return;
+
+	AP_SendItems(ap_outgoing_checks);
+	ap_outgoing_checks.clear();
+}
 
-	auto it3 = it2->second.find(index);
-	if (it3 == it2->second.end()) return 0;
 
-	int64_t id = it3->second;
+int apdoom_is_location_progression(ap_level_index_t idx, int index)
+{
+	int ordinal = get_location_ordinal(idx, index);
+	if (ordinal == -1) return 0;
 
-	return (ap_progressive_locations.find(id) != ap_progressive_locations.end()) ? 1 : 0;
+	return test_bit(ap_progression_bits, ordinal) ? 1 : 0;
 }
 
 void apdoom_complete_level(ap_level_index_t idx)
 {
 	//if (ap_state.level_states[ep - 1][map - 1].completed) return; // Already completed
     ap_get_level_state(idx)->completed = 1;
+	mark_state_dirty();
 	apdoom_check_location(idx, -1); // -1 is complete location
 }
 
 
 ap_level_index_t ap_make_level_index(int ep /* 1-based */, int map /* 1-based */)
 {
-	if (ap_game != ap_game_t::doom2) return { ep - 1, map - 1 };
+	if (!ap_game_desc->flat_maps) return { ep - 1, map - 1 };
 
 	// In Doom2, every map is ep = 1
+	if (map >= 1 && map <= (int)ap_flat_map_indices.size())
+		return ap_flat_map_indices[map - 1];
+
+	// Past the last map, same as walking the table
 	ap_level_index_t ret = { 0, map - 1 };
 	const auto& table = get_level_info_table();
-	while (ret.map >= (int)table[ret.ep].size())
+	while (ret.ep < (int)table.size() && ret.map >= (int)table[ret.ep].size())
 	{
 		ret.map -= (int)table[ret.ep].size();
 		ret.ep++;
@@ -1458,16 +2815,32 @@ ap_level_index_t ap_make_level_index(int ep /* 1-based */, int map /* 1-based */
 }
 
 
+const ap_current_level_t* ap_get_current_level(int ep, int map)
+{
+	if (ep != ap_current_level.ep || map != ap_current_level.map ||
+		ap_current_level.level_states != ap_state.level_states)
+	{
+		ap_current_level.ep = ep;
+		ap_current_level.map = map;
+		ap_current_level.idx = ap_make_level_index(ep, map);
+		ap_current_level.state = ap_get_level_state(ap_current_level.idx);
+		ap_current_level.info = ap_get_level_info(ap_current_level.idx);
+		ap_current_level.level_states = ap_state.level_states;
+	}
+	return &ap_current_level;
+}
+
+
 int ap_index_to_ep(ap_level_index_t idx)
 {
-	if (ap_game != ap_game_t::doom2) return idx.ep + 1;
+	if (!ap_game_desc->flat_maps) return idx.ep + 1;
 	return 1;
 }
 
 
 int ap_index_to_map(ap_level_index_t idx)
 {
-	if (ap_game != ap_game_t::doom2) return idx.map + 1;
+	if (!ap_game_desc->flat_maps) return idx.map + 1;
 
 	const auto& table = get_level_info_table();
 	for (int ep = 0; ep < idx.ep; ++ep)
@@ -1482,12 +2855,12 @@ void apdoom_check_victory()
 {
 	if (ap_state.victory) return;
 
-	if (ap_state.goal == 1 && (ap_game == ap_game_t::doom || ap_game == ap_game_t::heretic))
+	if (ap_state.goal == 1 && ap_game_desc->boss_map >= 0)
 	{
 		for (int ep = 0; ep < ap_episode_count; ++ep)
 		{
 			if (!ap_state.episodes[ep]) continue;
-			if (!ap_get_level_state(ap_level_index_t{ep, 7})->completed) return;
+			if (!ap_get_level_state(ap_level_index_t{ep, ap_game_desc->boss_map})->completed) return;
 		}
 	}
 	else
@@ -1506,150 +2879,126 @@ void apdoom_check_victory()
 	}
 
 	ap_state.victory = 1;
+	mark_state_dirty();
 
-	AP_StoryComplete();
+	if (!ap_settings.offline)
+		AP_StoryComplete();
 	ap_settings.victory_callback();
 }
 
 
 void apdoom_send_message(const char* msg)
 {
-	std::string smsg = msg;
+	std::string text = msg;
 	if (strnicmp(msg, "!hint ", 6) == 0)
 	{
-		// Make the hint easier.
-		// Find an E#M# in the text
-		for (size_t i = 6; i < smsg.size() - 4; ++i)
+		// Make the hint easier. Split the rest in lowercase words, one of
+		// them being an E#M# or MAP## and the others describing the item.
+		char words[8][16];
+		int word_count = 0;
+		ap_level_index_t idx = {-1, -1};
+		const char* c = msg + 6;
+		while (*c)
 		{
-			ap_level_info_t* level_info = nullptr;
-
-			if (toupper(smsg[i]) == 'E' &&
-				toupper(smsg[i + 2]) == 'M' &&
-				(smsg[i + 1] - '0') >= 1 && (smsg[i + 1] - '0') <= 9 &&
-				(smsg[i + 3] - '0') >= 1 && (smsg[i + 3] - '0') <= 9)
+			if (!isalnum((unsigned char)*c))
 			{
-				// Find the level name
-				int ep = smsg[i + 1] - '1';
-				int map = smsg[i + 3] - '1';
-				level_info = ap_get_level_info(ap_level_index_t{ep, map});
+				++c;
+				continue;
 			}
 
-			if (toupper(smsg[i]) == 'M' &&
-				toupper(smsg[i + 1]) == 'A' &&
-				toupper(smsg[i + 2]) == 'P' &&
-				(smsg[i + 3] - '0') >= 0 && (smsg[i + 3] - '0') <= 3 &&
-				(smsg[i + 4] - '0') >= 0 && (smsg[i + 4] - '0') <= 9)
+			char word[16];
+			int len = 0;
+			for (; isalnum((unsigned char)*c); ++c)
+				if (len < (int)sizeof(word) - 1)
+					word[len++] = (char)tolower((unsigned char)*c);
+			word[len] = '\0';
+
+			if (len == 4 && word[0] == 'e' && word[2] == 'm' &&
+				word[1] >= '1' && word[1] <= '9' && word[3] >= '1' && word[3] <= '9')
 			{
-				// Find the level name
-				int ep = 1;
-				int map = smsg[i + 4] + (smsg[i + 3] - '0') * 10;
-				level_info = ap_get_level_info(ap_make_level_index(ep, map));
+				if (!ap_game_desc->flat_maps)
+					idx = ap_make_level_index(word[1] - '0', word[3] - '0');
 			}
-
-			if (level_info)
+			else if (len == 5 && strncmp(word, "map", 3) == 0 &&
+					 isdigit((unsigned char)word[3]) && isdigit((unsigned char)word[4]))
 			{
-				std::string level_name = level_info->name;
-
-				// Check what it's looking for. Computer area map? map scroll?
-				if (smsg.find("map") != std::string::npos || smsg.find("MAP") != std::string::npos)
-				{
-					switch (ap_game)
-					{
-						case ap_game_t::doom:
-						case ap_game_t::doom2:
-							smsg = "!hint " + level_name + " - Computer area map";
-							break;
-						case ap_game_t::heretic:
-							smsg = "!hint " + level_name + " - Map scroll";
-							break;
-					}
-				}
-				else if (smsg.find("blue") != std::string::npos || smsg.find("BLUE") != std::string::npos)
-				{
-					switch (ap_game)
-					{
-						case ap_game_t::doom:
-						case ap_game_t::doom2:
-							smsg = "!hint " + level_name + " - Blue " + (level_info->use_skull[0] ? "skull key" : "keycard");
-							break;
-						case ap_game_t::heretic:
-							smsg = "!hint " + level_name + " - Blue key";
-							break;
-					}
-				}
-				else if (smsg.find("yellow") != std::string::npos || smsg.find("YELLOW") != std::string::npos)
-				{
-					switch (ap_game)
-					{
-						case ap_game_t::doom:
-						case ap_game_t::doom2:
-							smsg = "!hint " + level_name + " - Yellow " + (level_info->use_skull[1] ? "skull key" : "keycard");
-							break;
-						case ap_game_t::heretic:
-							smsg = "!hint " + level_name + " - Yellow key";
-							break;
-					}
-				}
-				else if (smsg.find("red") != std::string::npos || smsg.find("RED") != std::string::npos)
-				{
-					switch (ap_game)
-					{
-						case ap_game_t::doom:
-						case ap_game_t::doom2:
-							smsg = "!hint " + level_name + " - Red " + (level_info->use_skull[0] ? "skull key" : "keycard");
-							break;
-						case ap_game_t::heretic:
-							break;
-					}
-				}
-				else if (smsg.find("green") != std::string::npos || smsg.find("GREEN") != std::string::npos)
-				{
-					switch (ap_game)
-					{
-						case ap_game_t::doom:
-						case ap_game_t::doom2:
-							break;
-						case ap_game_t::heretic:
-							smsg = "!hint " + level_name + " - Green key";
-							break;
-					}
-				}
-
-				break;
+				if (ap_game_desc->flat_maps)
+					idx = ap_make_level_index(1, (word[3] - '0') * 10 + (word[4] - '0'));
+			}
+			else if (word_count < 8)
+			{
+				memcpy(words[word_count++], word, len + 1);
 			}
 		}
+
+		if (ap_get_level_info(idx))
+		{
+			auto hint_item = find_hint_item(idx, words, word_count);
+			if (hint_item)
+				text = hint_item->command;
+		}
 	}
 
 	Json::Value say_packet;
 	say_packet[0]["cmd"] = "Say";
-	say_packet[0]["text"] = smsg;
+	say_packet[0]["text"] = text;
 	Json::FastWriter writer;
-	APSend(writer.write(say_packet));
+	if (!ap_settings.offline)
+		APSend(writer.write(say_packet));
 }
 
 
 void apdoom_on_death()
 {
-	AP_DeathLinkSend();
+	if (!ap_settings.offline)
+		AP_DeathLinkSend();
 }
 
 
 void apdoom_clear_death()
 {
-	AP_DeathLinkClear();
+	if (ap_settings.offline)
+		return;
+
+	// Stops apdoom_should_die right away, the pump clears APCpp's side
+	ap_deathlink_state = AP_DEATHLINK_CLEARING;
+	ap_deathlink_logged = false;
 }
 
 
 int apdoom_should_die()
 {
-	return AP_DeathLinkPending() ? 1 : 0;
+	if (ap_settings.offline)
+		return 0;
+	if (ap_deathlink_state.load() != AP_DEATHLINK_PENDING)
+		return 0;
+
+	if (!ap_deathlink_logged)
+	{
+		printf("APDOOM: DeathLink applied %.1f ms after it arrived\n",
+			(double)(steady_now_us() - ap_deathlink_arrival_us.load()) / 1000.0);
+		ap_deathlink_logged = true;
+	}
+	return 1;
 }
 
 
 const ap_notification_icon_t* ap_get_notification_icons(int* count)
 {
-	*count = (int)ap_notification_icons.size();
-	return ap_notification_icons.data();
+	*count = ap_notification_icon_count;
+	return ap_notification_icons;
+}
+
+
+int ap_get_notification_sprite_count()
+{
+	return get_def_tables().type_sprite_count;
+}
+
+
+const char* ap_get_notification_sprite(int i)
+{
+	return get_def_tables().type_sprites[i].sprite;
 }
 
 
@@ -1663,6 +3012,20 @@ int ap_get_highest_episode()
 }
 
 
+int ap_validate_level_things(ap_level_index_t idx, const int* doom_types, int count)
+{
+	const ap_level_info_t* level_info = ap_get_level_info(idx);
+	if (!level_info) return 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (!ap_game_desc->is_type_ap_location(doom_types[i])) continue;
+		if (i >= level_info->thing_count) return 0;
+		if (level_info->thing_infos[i].doom_type != doom_types[i]) return 0;
+	}
+	return 1;
+}
+
+
 int ap_validate_doom_location(ap_level_index_t idx, int doom_type, int index)
 {
 	ap_level_info_t* level_info = ap_get_level_info(idx);
@@ -1672,6 +3035,200 @@ int ap_validate_doom_location(ap_level_index_t idx, int doom_type, int index)
 }
 
 
+static ap_type_remap_cache_t* get_type_remap_cache(ap_level_index_t idx)
+{
+	if (ap_get_level_info(idx) == nullptr) return nullptr;
+	if (ap_type_remaps.empty())
+		ap_type_remaps.resize(ap_episode_count * max_map_count);
+	return &ap_type_remaps[idx.ep * max_map_count + idx.map];
+}
+
+
+const int* ap_get_cached_type_remap(ap_level_index_t idx, int key, int count)
+{
+	auto cache = get_type_remap_cache(idx);
+	if (!cache || cache->key != key || cache->doom_types.size() != (size_t)count)
+		return nullptr;
+	return cache->doom_types.data();
+}
+
+
+void ap_set_cached_type_remap(ap_level_index_t idx, int key, const int* doom_types, int count)
+{
+	auto cache = get_type_remap_cache(idx);
+	if (!cache) return;
+	cache->key = key;
+	cache->doom_types.assign(doom_types, doom_types + count);
+}
+
+
+static ap_spawn_plan_cache_t* get_spawn_plan_cache(ap_level_index_t idx)
+{
+	if (ap_get_level_info(idx) == nullptr) return nullptr;
+	if (ap_spawn_plans.empty())
+		ap_spawn_plans.resize(ap_episode_count * max_map_count);
+	return &ap_spawn_plans[idx.ep * max_map_count + idx.map];
+}
+
+
+const unsigned char* ap_build_spawn_plan(ap_level_index_t idx, const int* doom_types, int count)
+{
+	// A level outside our data gets a plan that isn't kept
+	static ap_spawn_plan_cache_t uncached;
+	auto plan = get_spawn_plan_cache(idx);
+	if (!plan)
+	{
+		plan = &uncached;
+		plan->valid = false;
+	}
+
+	unsigned version = ap_spawn_plan_version;
+	unsigned validation_version = ap_spawn_validation_version;
+	bool same_things = plan->valid &&
+		plan->doom_types.size() == (size_t)count &&
+		std::equal(doom_types, doom_types + count, plan->doom_types.begin());
+
+	if (same_things && plan->version == version)
+		return plan->actions.data();
+
+	if (!same_things || plan->validation_version != validation_version)
+	{
+		plan->valid = false;
+		plan->validation_version = validation_version;
+		plan->doom_types.assign(doom_types, doom_types + count);
+		plan->locations.clear();
+		plan->actions.assign(count, AP_SPAWN_KEEP);
+
+		for (int i = 0; i < count; ++i)
+		{
+			int doom_type = doom_types[i];
+			if (!ap_game_desc->is_type_ap_location(doom_type)) continue;
+
+			// Validate that the location index matches what we have in our data
+			int ret = ap_validate_doom_location(idx, doom_type, i);
+			if (ret == -1)
+				return nullptr;
+
+			if (ret == 0)
+				plan->actions[i] = AP_SPAWN_SKIP;
+			else
+				plan->locations.push_back(i);
+		}
+
+		plan->valid = true;
+	}
+
+	// Only checks and progression are left to redo
+	plan->version = version;
+	auto level_state = ap_get_level_state(idx);
+	for (int i : plan->locations)
+	{
+		if (is_loc_checked_in(level_state, i))
+			plan->actions[i] = AP_SPAWN_SKIP;
+		else if (apdoom_is_location_progression(idx, i))
+			plan->actions[i] = AP_SPAWN_AP_PROGRESSION;
+		else
+			plan->actions[i] = AP_SPAWN_AP_ITEM;
+	}
+
+	return plan->actions.data();
+}
+
+
+static std::string format_ap_message(const AP_Message* msg)
+{
+	switch (msg->type)
+	{
+		case AP_MessageType::ItemSend:
+		{
+			auto o_msg = static_cast<const AP_ItemSendMessage*>(msg);
+			return "~9" + o_msg->item + "~2 was sent to ~4" + o_msg->recvPlayer;
+		}
+		case AP_MessageType::ItemRecv:
+		{
+			auto o_msg = static_cast<const AP_ItemRecvMessage*>(msg);
+			return "~2Received ~9" + o_msg->item + "~2 from ~4" + o_msg->sendPlayer;
+		}
+		case AP_MessageType::Hint:
+		{
+			auto o_msg = static_cast<const AP_HintMessage*>(msg);
+			return "~9" + o_msg->item + "~2 from ~4" + o_msg->sendPlayer + "~2 to ~4" + o_msg->recvPlayer + "~2 at ~3" + o_msg->location + (o_msg->checked ? " (Checked)" : " (Unchecked)");
+		}
+		default:
+			return "~2" + msg->text;
+	}
+}
+
+
+static void pump_deathlink()
+{
+	int state = ap_deathlink_state.load();
+	if (state == AP_DEATHLINK_CLEARING)
+	{
+		AP_DeathLinkClear();
+		ap_deathlink_state.compare_exchange_strong(state, AP_DEATHLINK_IDLE);
+	}
+	else if (state == AP_DEATHLINK_IDLE && AP_DeathLinkPending())
+	{
+		ap_deathlink_arrival_us = steady_now_us();
+		ap_deathlink_state.compare_exchange_strong(state, AP_DEATHLINK_PENDING);
+	}
+}
+
+
+static void pump_thread_main()
+{
+	while (!ap_pump_quit)
+	{
+		pump_deathlink();
+		while (!ap_pump_quit && AP_IsMessagePending())
+		{
+			AP_Message* msg = AP_GetLatestMessage();
+			std::string colored_msg = format_ap_message(msg);
+			printf("APDOOM: %s\n", msg->text.c_str());
+			AP_ClearLatestMessage();
+
+			// Game is behind, wait for it rather than dropping messages
+			while (!ap_pump_quit && !ap_message_queue.push(colored_msg))
+			{
+				pump_deathlink();
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	ap_pump_running = false;
+}
+
+
+static void start_pump_thread()
+{
+	ap_pump_quit = false; // Set by the last apdoom_shutdown
+	ap_pump_running = true;
+	std::thread(pump_thread_main).detach();
+}
+
+
+// Applies item and location deltas queued by the APCpp callbacks
+static void process_ap_events()
+{
+	ap_trace_scope_t trace("process_ap_events");
+	ap_event_t event;
+	while (ap_event_queue.pop(event))
+	{
+		switch (event.type)
+		{
+			case ap_event_type_t::item_clear: begin_item_resync(); break;
+			case ap_event_type_t::item: receive_item(event.id, true); break;
+			case ap_event_type_t::item_silent: receive_item(event.id, false); break;
+			case ap_event_type_t::location: apply_location(event.id); break;
+			case ap_event_type_t::location_info_progression: apply_location_info(event.id, true); break;
+			case ap_event_type_t::location_info_filler: apply_location_info(event.id, false); break;
+		}
+	}
+}
+
+
 /*
     black: "000000"
     red: "EE0000"
@@ -1695,8 +3252,174 @@ int ap_validate_doom_location(ap_level_index_t idx, int doom_type, int index)
     (byte *) &cr_red2blue, // 7 (BLUE) items
     (byte *) &cr_red2green // 8 (DARK EDGE GREEN)
 */
+// What the tracker clients last got, to send them only what changed
+struct ap_tracker_level_t
+{
+	int flags = 0;
+	std::vector<unsigned char> checked_bits;
+};
+static std::vector<ap_tracker_level_t> ap_tracker_levels;
+static unsigned ap_tracker_version = 0;
+static int ap_tracker_ep = 0, ap_tracker_map = 0;
+static int ap_player_x = 0, ap_player_y = 0, ap_player_angle = 0;
+static bool ap_player_moved = false;
+
+
+void ap_report_player_position(int x, int y, int angle)
+{
+	if (x == ap_player_x && y == ap_player_y && angle == ap_player_angle) return;
+	ap_player_x = x;
+	ap_player_y = y;
+	ap_player_angle = angle;
+	ap_player_moved = true;
+}
+
+
+static int get_level_flags(const ap_level_state_t* level_state)
+{
+	int flags = 0;
+	if (level_state->completed) flags |= AP_LEVEL_FLAG_COMPLETED;
+	if (level_state->keys[0]) flags |= AP_LEVEL_FLAG_KEY0;
+	if (level_state->keys[1]) flags |= AP_LEVEL_FLAG_KEY1;
+	if (level_state->keys[2]) flags |= AP_LEVEL_FLAG_KEY2;
+	if (level_state->has_map) flags |= AP_LEVEL_FLAG_HAS_MAP;
+	if (level_state->unlocked) flags |= AP_LEVEL_FLAG_UNLOCKED;
+	return flags;
+}
+
+
+static Json::Value make_tracker_event(const char* type, ap_level_index_t idx)
+{
+	Json::Value event;
+	event["type"] = type;
+	event["ep"] = ap_index_to_ep(idx);
+	event["map"] = ap_index_to_map(idx);
+	return event;
+}
+
+
+static void fill_tracker_level(Json::Value& event, int flags)
+{
+	event["completed"] = (flags & AP_LEVEL_FLAG_COMPLETED) != 0;
+	event["unlocked"] = (flags & AP_LEVEL_FLAG_UNLOCKED) != 0;
+	event["has_map"] = (flags & AP_LEVEL_FLAG_HAS_MAP) != 0;
+	event["keys"][0] = (flags & AP_LEVEL_FLAG_KEY0) != 0;
+	event["keys"][1] = (flags & AP_LEVEL_FLAG_KEY1) != 0;
+	event["keys"][2] = (flags & AP_LEVEL_FLAG_KEY2) != 0;
+}
+
+
+// One message per tic at most. A sync holds every level, after that only
+// what changed since the state version we last looked at.
+static void update_tracker()
+{
+	if (!ap_tracker_has_clients()) return;
+
+	bool sync = ap_tracker_take_sync_request();
+	Json::Value events(Json::arrayValue);
+
+	if (sync)
+	{
+		Json::Value event;
+		event["type"] = "sync";
+		event["game"] = ap_settings.game;
+		event["slot"] = ap_settings.player_name;
+		event["levels"] = Json::Value(Json::arrayValue);
+		events.append(event);
+		ap_tracker_levels.assign(ap_episode_count * max_map_count, ap_tracker_level_t());
+		ap_tracker_version = ap_get_state_version() - 1;
+		ap_tracker_ep = 0;
+		ap_tracker_map = 0;
+		ap_player_moved = true;
+	}
+
+	if (ap_tracker_version != ap_get_state_version())
+	{
+		ap_tracker_version = ap_get_state_version();
+		for (int ep = 0; ep < ap_episode_count; ++ep)
+		{
+			int map_count = ap_get_map_count(ep + 1);
+			for (int map = 0; map < map_count; ++map)
+			{
+				ap_level_index_t idx = {ep, map};
+				const ap_level_state_t* level_state = ap_get_level_state(idx);
+				auto& shadow = ap_tracker_levels[ep * max_map_count + map];
+				int flags = get_level_flags(level_state);
+
+				if (sync)
+				{
+					Json::Value level = make_tracker_event("level", idx);
+					level.removeMember("type");
+					level["name"] = ap_get_level_info(idx)->name;
+					fill_tracker_level(level, flags);
+					level["checks"] = Json::Value(Json::arrayValue);
+					for (int i = 0; i < level_state->checked_capacity; ++i)
+						if (is_loc_checked_in(level_state, i))
+							level["checks"].append((Json::Int64)get_location_id(idx, i));
+					events[0]["levels"].append(level);
+				}
+				else
+				{
+					if (flags != shadow.flags)
+					{
+						Json::Value event = make_tracker_event("level", idx);
+						fill_tracker_level(event, flags);
+						events.append(event);
+					}
+					for (int i = 0; i < level_state->checked_capacity; i += 8)
+					{
+						unsigned char old_byte = (i >> 3) < (int)shadow.checked_bits.size() ? shadow.checked_bits[i >> 3] : 0;
+						unsigned char new_bits = level_state->checked_bits[i >> 3] & ~old_byte;
+						for (int b = 0; new_bits; ++b, new_bits >>= 1)
+						{
+							if (!(new_bits & 1)) continue;
+							Json::Value event = make_tracker_event("check", idx);
+							event["index"] = i + b;
+							event["location"] = (Json::Int64)get_location_id(idx, i + b);
+							events.append(event);
+						}
+					}
+				}
+
+				shadow.flags = flags;
+				shadow.checked_bits.assign(level_state->checked_bits, level_state->checked_bits + (level_state->checked_capacity + 7) / 8);
+			}
+		}
+	}
+
+	if (ap_state.ep != ap_tracker_ep || ap_state.map != ap_tracker_map)
+	{
+		ap_tracker_ep = ap_state.ep;
+		ap_tracker_map = ap_state.map;
+		Json::Value event;
+		event["type"] = "map";
+		event["ep"] = ap_state.ep;
+		event["map"] = ap_state.map;
+		events.append(event);
+	}
+
+	if (ap_player_moved && ap_is_in_game)
+	{
+		ap_player_moved = false;
+		Json::Value event;
+		event["type"] = "position";
+		event["x"] = ap_player_x;
+		event["y"] = ap_player_y;
+		event["angle"] = ap_player_angle;
+		events.append(event);
+	}
+
+	if (events.empty()) return;
+
+	Json::FastWriter writer;
+	ap_tracker_send(writer.write(events), sync);
+}
+
+
 void apdoom_update()
 {
+	ap_trace_scope_t trace("apdoom_update");
+
 	if (ap_initialized)
 	{
 		if (!ap_cached_messages.empty())
@@ -1707,87 +3430,63 @@ void apdoom_update()
 		}
 	}
 
-	while (AP_IsMessagePending())
+	std::string colored_msg;
+	while (ap_message_queue.pop(colored_msg))
 	{
-		AP_Message* msg = AP_GetLatestMessage();
-
-		std::string colored_msg;
-
-		switch (msg->type)
-		{
-			case AP_MessageType::ItemSend:
-			{
-				AP_ItemSendMessage* o_msg = static_cast<AP_ItemSendMessage*>(msg);
-				colored_msg = "~9" + o_msg->item + "~2 was sent to ~4" + o_msg->recvPlayer;
-				break;
-			}
-			case AP_MessageType::ItemRecv:
-			{
-				AP_ItemRecvMessage* o_msg = static_cast<AP_ItemRecvMessage*>(msg);
-				colored_msg = "~2Received ~9" + o_msg->item + "~2 from ~4" + o_msg->sendPlayer;
-				break;
-			}
-			case AP_MessageType::Hint:
-			{
-				AP_HintMessage* o_msg = static_cast<AP_HintMessage*>(msg);
-				colored_msg = "~9" + o_msg->item + "~2 from ~4" + o_msg->sendPlayer + "~2 to ~4" + o_msg->recvPlayer + "~2 at ~3" + o_msg->location + (o_msg->checked ? " (Checked)" : " (Unchecked)");
-				break;
-			}
-			default:
-			{
-				colored_msg = "~2" + msg->text;
-				break;
-			}
-		}
-
-		printf("APDOOM: %s\n", msg->text.c_str());
-
 		if (ap_initialized)
 			ap_settings.message_callback(colored_msg.c_str());
 		else
+		{
+			if (ap_cached_messages.size() == AP_MAX_CACHED_MESSAGES)
+				ap_cached_messages.pop_front();
 			ap_cached_messages.push_back(colored_msg);
+		}
+	}
+
+	process_ap_events();
+
+	// About a second without the rest of the list, the server has fewer items than we saved
+	if (ap_resync.active && ++ap_resync.idle_tics > 35)
+		end_item_resync(true);
 
-		AP_ClearLatestMessage();
+	if (ap_initialized)
+	{
+		flush_outgoing_checks();
+		update_tracker();
 	}
 
 	// Check if we're in game, then dequeue the items
 	if (ap_is_in_game)
 	{
-		while (!ap_item_queue.empty())
-		{
-			auto item_id = ap_item_queue.front();
-			ap_item_queue.erase(ap_item_queue.begin());
-			f_itemrecv(item_id, 0, true);
-		}
+		deliver_queued_items();
+	}
+
+	// Coalesce state changes into periodic saves
+	if (ap_was_connected && ap_state_dirty &&
+		std::chrono::steady_clock::now() - ap_last_save_time >= AP_SAVE_INTERVAL)
+	{
+		queue_save_state();
 	}
 
 	// Update notification icons
+	int queued_count = ap_notification_icon_count + ap_notification_backlog_count;
 	float previous_y = 2.0f;
-	for (auto it = ap_notification_icons.begin(); it != ap_notification_icons.end();)
+	int kept = 0;
+	for (int i = 0; i < ap_notification_icon_count; ++i)
 	{
-		auto& notification_icon = *it;
-
-		if (notification_icon.state == AP_NOTIF_STATE_PENDING && previous_y > -100.0f)
-		{
-			notification_icon.state = AP_NOTIF_STATE_DROPPING;
-		}
-		if (notification_icon.state == AP_NOTIF_STATE_PENDING)
-		{
-			++it;
-			continue;
-		}
+		auto& notification_icon = ap_notification_icons[i];
 
 		if (notification_icon.state == AP_NOTIF_STATE_DROPPING)
 		{
-			notification_icon.vely += 0.15f + (float)(ap_notification_icons.size() / 4) * 0.25f;
+			notification_icon.vely += 0.15f + (float)(queued_count / 4) * 0.25f;
 			if (notification_icon.vely > 8.0f) notification_icon.vely = 8.0f;
 			notification_icon.yf += notification_icon.vely;
 			if (notification_icon.yf >= previous_y - AP_NOTIF_SIZE - AP_NOTIF_PADDING)
 			{
 				notification_icon.yf = previous_y - AP_NOTIF_SIZE - AP_NOTIF_PADDING;
-				notification_icon.vely *= -0.3f / ((float)(ap_notification_icons.size() / 4) * 0.05f + 1.0f);
+				notification_icon.vely *= -0.3f / ((float)(queued_count / 4) * 0.05f + 1.0f);
 
-				notification_icon.t += ap_notification_icons.size() / 4 + 1; // Faster the more we have queued (4 can display on screen)
+				notification_icon.t += queued_count / 4 + 1; // Faster the more we have queued (4 can display on screen)
 				if (notification_icon.t > 350 * 3 / 4) // ~7.5sec
 				{
 					notification_icon.state = AP_NOTIF_STATE_HIDING;
@@ -1797,19 +3496,87 @@ void apdoom_update()
 
 		if (notification_icon.state == AP_NOTIF_STATE_HIDING)
 		{
-			notification_icon.velx -= 0.14f + (float)(ap_notification_icons.size() / 4) * 0.1f;
+			notification_icon.velx -= 0.14f + (float)(queued_count / 4) * 0.1f;
 			notification_icon.xf += notification_icon.velx;
 			if (notification_icon.xf < -AP_NOTIF_SIZE / 2)
-			{
-				it = ap_notification_icons.erase(it);
-				continue;
-			}
+				continue; // Gone, don't keep it
 		}
 
 		notification_icon.x = (int)notification_icon.xf;
 		notification_icon.y = (int)notification_icon.yf;
 		previous_y = notification_icon.yf;
 
-		++it;
+		if (kept != i)
+			ap_notification_icons[kept] = notification_icon;
+		++kept;
+	}
+	ap_notification_icon_count = kept;
+
+	// Next one starts dropping once the last one is low enough
+	if (ap_notification_backlog_count > 0 &&
+		ap_notification_icon_count < AP_NOTIF_MAX_ACTIVE &&
+		previous_y > -100.0f)
+	{
+		activate_notification();
+	}
+}
+
+
+// Everything apdoom_init sets up, back to how it was before. The pump, the
+// save writer and the tracker are stopped by then. APCpp's callbacks still
+// point at us, whatever they queue before the next apdoom_init is dropped.
+static void free_ap_state()
+{
+	if (ap_state.level_states)
+	{
+		for (int i = 0, len = ap_episode_count * max_map_count; i < len; ++i)
+			delete[] ap_state.level_states[i].checked_bits;
+		delete[] ap_state.level_states;
 	}
+	delete[] ap_state.episodes;
+	delete[] ap_state.player_state.powers;
+	delete[] ap_state.player_state.weapon_owned;
+	delete[] ap_state.player_state.ammo;
+	delete[] ap_state.player_state.max_ammo;
+	delete[] ap_state.player_state.inventory;
+	memset(&ap_state, 0, sizeof(ap_state));
+
+	ap_settings = ap_settings_t();
+	ap_room_info = AP_RoomInfo();
+	ap_save_dir_name.clear();
+	ap_initialized = false;
+	ap_was_connected = false;
+	ap_checks_online = false;
+	ap_is_in_game = 0;
+	ap_check_sanity = false;
+	ap_state_dirty = false;
+
+	ap_item_queue.clear();
+	ap_progression_known.clear();
+	ap_progression_bits.clear();
+	ap_unconfirmed_checks.clear();
+	ap_outgoing_checks.clear();
+	ap_received_count = 0;
+	ap_received_hash = AP_RECEIVED_HASH_INIT;
+	ap_resync = ap_resync_t();
+	ap_cached_messages.clear();
+
+	std::string message;
+	while (ap_message_queue.pop(message)) {}
+	ap_event_t event;
+	while (ap_event_queue.pop(event)) {}
+	ap_deathlink_state = AP_DEATHLINK_IDLE;
+	ap_deathlink_logged = false;
+
+	// Sized for the game, lazily
+	ap_spawn_plans.clear();
+	ap_type_remaps.clear();
+	ap_spawn_plan_version++;
+	ap_spawn_validation_version++;
+	ap_tracker_levels.clear();
+	ap_current_level.ep = -1;
+
+	ap_notification_icon_count = 0;
+	ap_notification_backlog_start = 0;
+	ap_notification_backlog_count = 0;
 }
@@ -36,10 +36,6 @@ extern "C"
 #define APDOOM_VERSION_FULL_TEXT "APDOOM " APDOOM_VERSION_TEXT
 
 
-#define AP_CHECK_MAX 64 // Arbitrary number
-#define AP_MAX_THING 1024 // Twice more than current max for every level
-
-
 typedef struct
 {
     int doom_type;
@@ -55,7 +51,7 @@ typedef struct
     int use_skull[3];
     int check_count;
     int thing_count;
-    ap_thing_info_t thing_infos[AP_MAX_THING];
+    const ap_thing_info_t* thing_infos; // thing_count entries, NULL if empty
     int sanity_check_count;
 
 } ap_level_info_t;
@@ -68,7 +64,8 @@ typedef struct
     int check_count;
     int has_map;
     int unlocked;
-    int checks[AP_CHECK_MAX];
+    unsigned char* checked_bits; // One bit per thing index
+    int checked_capacity; // In things, starts at ap_level_info_t::thing_count
     int special; // Berzerk or Wings
     int flipped;
     int music;
@@ -123,6 +120,14 @@ typedef struct
 } ap_state_t;
 
 
+typedef struct
+{
+    int doom_type;
+    int ep;
+    int map;
+} ap_given_item_t;
+
+
 typedef struct
 {
     const char* ip;
@@ -131,7 +136,9 @@ typedef struct
     const char* passwd;
     void (*message_callback)(const char*);
     void (*give_item_callback)(int doom_type, int ep, int map);
+    void (*give_items_callback)(const ap_given_item_t* items, int count); // Optional. Items queued in the menu, all at once
     void (*victory_callback)();
+    void (*trace_callback)(const char* name, int begin); // Optional. Brackets AP work for -trace, from any thread
 
     int override_skill; int skill;
     int override_monster_rando; int monster_rando;
@@ -140,6 +147,9 @@ typedef struct
     int override_flip_levels; int flip_levels;
     int force_deathlink_off;
     int override_reset_level_on_death; int reset_level_on_death;
+    int export_state_json; // Also write apstate.json next to apstate.dat, for debugging
+    int offline; // Don't connect: the starting state, and nothing is ever sent. For benchmarks
+    int tracker_port; // Local WebSocket feed of the state for trackers, 0 for none
 } ap_settings_t;
 
 
@@ -156,12 +166,22 @@ typedef struct
     int x, y;
     float xf, yf;
     float velx, vely;
-    char text[260];
+    const char* text; // Interned, never NULL
     int t;
     int state;
 } ap_notification_icon_t;
 
 
+// What P_LoadThings does with each map thing
+typedef enum
+{
+    AP_SPAWN_KEEP,
+    AP_SPAWN_AP_ITEM, // Replace with 20000
+    AP_SPAWN_AP_PROGRESSION, // Replace with 20001
+    AP_SPAWN_SKIP
+} ap_spawn_action_t;
+
+
 // Don't construct that manually, use ap_make_level_index()
 typedef struct
 {
@@ -175,7 +195,14 @@ extern int ap_is_in_game; // Don't give items when in menu (Or when dead on the
 extern int ap_episode_count;
 
 
+// Picks the game's generated data without connecting, so the level
+// functions below work before apdoom_init (Which picks it again). 0 if
+// the game is unknown.
+int apdoom_select_game(const char* game);
 int apdoom_init(ap_settings_t* settings);
+// Sends and saves what's left, then frees the state. apdoom_init can be
+// called again after, with another slot or game. The WADs the game loaded
+// are its own business.
 void apdoom_shutdown();
 void apdoom_save_state();
 void apdoom_check_location(ap_level_index_t idx, int index);
@@ -187,17 +214,66 @@ void apdoom_send_message(const char* msg);
 void apdoom_complete_level(ap_level_index_t idx);
 ap_level_state_t* ap_get_level_state(ap_level_index_t idx); // 1-based
 ap_level_info_t* ap_get_level_info(ap_level_index_t idx); // 1-based
+// Checks that count towards a level's progress, and how many of them are left.
+// Both read the counts kept up to date by the check handlers, so they are cheap.
+int ap_get_level_check_total(ap_level_index_t idx);
+int ap_get_level_remaining_checks(ap_level_index_t idx);
+// Bumped whenever something saved in ap_state changes (checks, keys, unlocks...),
+// so screens can cache what they show from it.
+unsigned ap_get_state_version();
 const ap_notification_icon_t* ap_get_notification_icons(int* count);
+int ap_get_notification_sprite_count();
+const char* ap_get_notification_sprite(int i); // Every sprite an item notification can show
 int ap_get_highest_episode();
 int ap_validate_doom_location(ap_level_index_t idx, int doom_type, int index);
+// 1 if every AP location among a level's things (Types in THINGS order, before randomization) is where our data has it.
+int ap_validate_level_things(ap_level_index_t idx, const int* doom_types, int count);
+int ap_is_location_checked(ap_level_index_t idx, int index);
+// One ap_spawn_action_t per thing, doom_types are the types about to spawn (After random items).
+// Kept per level; checks and progression changes only redo the actions, not the validation.
+// NULL if they don't match our data (Wrong WAD).
+const unsigned char* ap_build_spawn_plan(ap_level_index_t idx, const int* doom_types, int count);
+// Thing types of a level after monster/item randomization, so reloading it doesn't shuffle again.
+// key identifies the settings they were randomized with. NULL if not cached.
+const int* ap_get_cached_type_remap(ap_level_index_t idx, int key, int count);
+void ap_set_cached_type_remap(ap_level_index_t idx, int key, const int* doom_types, int count);
 int ap_get_map_count(int ep);
 
+// For crispy-bench: count lookups of the location and item ids that the
+// server sends, spread over the tables. Returns how many were found.
+int apdoom_bench_find_locations(int count);
+int apdoom_bench_find_items(int count);
+
+// For apdoom-loadbench: the game's locations and item ids, in table
+// order, so the synthetic traffic is ids we really handle. Work after
+// apdoom_select_game. Return how many were written, up to max_count.
+// idxs and indices can be NULL, index is -1 for level completion.
+int apdoom_bench_get_locations(long long* ids, ap_level_index_t* idxs, int* indices, int max_count);
+int apdoom_bench_get_item_ids(long long* ids, int max_count);
+
 // Deathlink stuff
 void apdoom_on_death();
 void apdoom_clear_death();
 int apdoom_should_die();
 
+// For the tracker feed, map units and degrees. Sent at most once a tic, only when it changed.
+void ap_report_player_position(int x, int y, int angle);
+
 ap_level_index_t ap_make_level_index(int ep /* 1-based */, int map /* 1-based */);
+
+// The level being played, for code that runs every tic or every frame.
+// Only looked up again when ep or map change.
+typedef struct
+{
+    int ep; // 1-based, as passed
+    int map;
+    ap_level_index_t idx;
+    ap_level_state_t* state;
+    ap_level_info_t* info;
+    const ap_level_state_t* level_states; // What state points into
+} ap_current_level_t;
+
+const ap_current_level_t* ap_get_current_level(int ep /* 1-based */, int map /* 1-based */);
 int ap_index_to_ep(ap_level_index_t idx);
 int ap_index_to_map(ap_level_index_t idx);
 
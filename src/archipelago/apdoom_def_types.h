@@ -1,6 +1,9 @@
 #pragma once
 
 
+#include <cinttypes>
+
+
 // Map item id
 struct ap_item_t
 {
@@ -8,3 +11,45 @@ struct ap_item_t
     int ep; // If doom_type is a keycard
     int map; // If doom_type is a keycard
 };
+
+
+struct ap_item_def_t
+{
+    int64_t item_id;
+    ap_item_t item;
+    const char* name; // Archipelago item name
+};
+
+
+struct ap_location_def_t
+{
+    int ep; // 1-based
+    int map; // 1-based
+    int index; // Thing index in the map, -1 is level complete
+    int64_t loc_id;
+};
+
+
+struct ap_type_sprite_t
+{
+    int doom_type;
+    const char* sprite;
+};
+
+
+// Everything the generator outputs for a game, as flat sorted arrays.
+// Level ordinal for an episode/map pair is episode_offsets[ep] + map,
+// both 0-based. level_location_offsets has one extra entry at the end.
+struct ap_def_tables_t
+{
+    const ap_location_def_t* locations; // Sorted by ep, map, index
+    int location_count;
+    const int* episode_offsets; // episode_count + 1 entries
+    int episode_count;
+    const int* level_location_offsets;
+    const int* location_id_order; // Indices into locations, sorted by loc_id
+    const ap_item_def_t* items; // Sorted by item_id
+    int item_count;
+    const ap_type_sprite_t* type_sprites; // Sorted by doom_type
+    int type_sprite_count;
+};
@@ -0,0 +1,457 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+//
+// *apdoom-loadbench*
+//
+// apdoom.cpp against the APCpp mock, with no game around it. Connects,
+// takes a catch-up storm of items and locations, then runs tics with
+// traffic at the given rates (Or replayed from a file), calling
+// apdoom_update once per tic like the game does. The cost of every scope
+// apdoom.cpp reports through trace_callback is collected and printed at
+// the end: apdoom_update per tic, the APCpp callbacks, the saves.
+//
+// Replay files have one event per line, sorted by tic:
+//   <tic> item <item id> [silent]
+//   <tic> location <location id>
+//   <tic> message <text>
+//   <tic> deathlink
+// Lines starting with # are skipped.
+//
+
+#include "apdoom.h"
+#include "apmock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+void save_state(); // Not in apdoom.h, the game only saves through apdoom_save_state
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+struct bench_options_t
+{
+	const char* game = "DOOM 1993";
+	int tics = 35 * 60;
+	int connect_items = 2000;
+	int connect_locations = 200;
+	double item_rate = 1.0; // Per second, after connecting
+	double location_rate = 1.0;
+	double check_rate = 0.5; // The player's own checks
+	double message_rate = 2.0;
+	int deathlink_every = 0; // In tics, 0 for never
+	int save_every = 35 * 10;
+	const char* replay = nullptr;
+	bool realtime = false; // 35 Hz, instead of as fast as possible
+	bool keep = false; // Keep the state from a previous run
+	int reinits = 0; // apdoom_shutdown then apdoom_init again, that many times
+};
+
+
+struct replay_event_t
+{
+	int tic;
+	std::string type;
+	int64_t id;
+	bool silent;
+	std::string text;
+};
+
+
+struct pending_scope_t
+{
+	const char* name;
+	bench_clock::time_point start;
+};
+
+
+static std::mutex bench_scope_mutex;
+static std::map<std::string, std::vector<double>> bench_scopes; // Name, durations in us
+static thread_local std::vector<pending_scope_t> bench_scope_stack;
+
+static int bench_items_given = 0;
+static int bench_messages_shown = 0;
+
+
+static void on_trace(const char* name, int begin)
+{
+	if (begin)
+	{
+		bench_scope_stack.push_back({name, bench_clock::now()});
+		return;
+	}
+	if (bench_scope_stack.empty()) return;
+
+	auto scope = bench_scope_stack.back();
+	bench_scope_stack.pop_back();
+	double us = std::chrono::duration<double, std::micro>(bench_clock::now() - scope.start).count();
+
+	std::lock_guard<std::mutex> lock(bench_scope_mutex);
+	bench_scopes[scope.name].push_back(us);
+}
+
+
+static void on_message(const char*)
+{
+	bench_messages_shown++;
+}
+
+
+static void on_give_item(int, int, int)
+{
+	bench_items_given++;
+}
+
+
+static void on_give_items(const ap_given_item_t*, int count)
+{
+	bench_items_given += count;
+}
+
+
+static void on_victory()
+{
+}
+
+
+static void print_usage()
+{
+	printf("Usage: apdoom-loadbench [options]\n"
+	       "  -game <name>             \"DOOM 1993\", \"DOOM II\" or \"Heretic\"\n"
+	       "  -tics <count>            Tics to run after connecting (%i)\n"
+	       "  -connectitems <count>    Items sent at connect (%i)\n"
+	       "  -connectlocations <count> Locations already checked at connect (%i)\n"
+	       "  -itemrate <per second>   Items after that\n"
+	       "  -locrate <per second>    Locations checked by others after that\n"
+	       "  -checkrate <per second>  Locations checked by the player\n"
+	       "  -msgrate <per second>    Chat messages\n"
+	       "  -deathlinkevery <tics>   Incoming DeathLinks, 0 for none\n"
+	       "  -saveevery <tics>        Blocking save_state, 0 for none\n"
+	       "  -replay <file>           Server traffic from a file instead of the rates\n"
+	       "  -realtime                Pace tics at 35 Hz\n"
+	       "  -keep                    Start from the previous run's state\n"
+	       "  -reinit <count>          Shut down and connect again, running the tics each time\n",
+	       bench_options_t().tics, bench_options_t().connect_items, bench_options_t().connect_locations);
+}
+
+
+static bool parse_options(int argc, char** argv, bench_options_t& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "-realtime") options.realtime = true;
+		else if (arg == "-keep") options.keep = true;
+		else if (!has_value) return false;
+		else if (arg == "-game") options.game = argv[++i];
+		else if (arg == "-tics") options.tics = atoi(argv[++i]);
+		else if (arg == "-connectitems") options.connect_items = atoi(argv[++i]);
+		else if (arg == "-connectlocations") options.connect_locations = atoi(argv[++i]);
+		else if (arg == "-itemrate") options.item_rate = atof(argv[++i]);
+		else if (arg == "-locrate") options.location_rate = atof(argv[++i]);
+		else if (arg == "-checkrate") options.check_rate = atof(argv[++i]);
+		else if (arg == "-msgrate") options.message_rate = atof(argv[++i]);
+		else if (arg == "-deathlinkevery") options.deathlink_every = atoi(argv[++i]);
+		else if (arg == "-saveevery") options.save_every = atoi(argv[++i]);
+		else if (arg == "-replay") options.replay = argv[++i];
+		else if (arg == "-reinit") options.reinits = atoi(argv[++i]);
+		else return false;
+	}
+	return true;
+}
+
+
+static bool load_replay(const char* filename, std::vector<replay_event_t>& events)
+{
+	std::ifstream file(filename);
+	if (!file.is_open()) return false;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#') continue;
+
+		std::istringstream ss(line);
+		replay_event_t event = {0, "", 0, false, ""};
+		ss >> event.tic >> event.type;
+		if (event.type == "item" || event.type == "location")
+		{
+			std::string flag;
+			ss >> event.id >> flag;
+			event.silent = flag == "silent";
+		}
+		else if (event.type == "message")
+		{
+			std::getline(ss >> std::ws, event.text);
+		}
+		else if (event.type != "deathlink")
+		{
+			printf("Unknown replay event: %s\n", line.c_str());
+			return false;
+		}
+		events.push_back(event);
+	}
+
+	std::stable_sort(events.begin(), events.end(), [](const replay_event_t& a, const replay_event_t& b) { return a.tic < b.tic; });
+	return true;
+}
+
+
+// Carries the fraction over, so low rates still happen
+static int take_rate(double rate, double& accumulator)
+{
+	accumulator += rate / 35.0;
+	int count = (int)accumulator;
+	accumulator -= count;
+	return count;
+}
+
+
+static void post_items(const std::vector<int64_t>& ids, bool notify)
+{
+	if (ids.empty()) return;
+	apmock_post([ids, notify]
+	{
+		for (auto id : ids)
+			apmock_get_callbacks().item_recv(id, 1, notify);
+	});
+}
+
+
+static void post_locations(const std::vector<int64_t>& ids)
+{
+	if (ids.empty()) return;
+	apmock_post([ids]
+	{
+		for (auto id : ids)
+			apmock_get_callbacks().location_checked(id);
+	});
+}
+
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty()) return 0.0;
+	size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[i];
+}
+
+
+static void print_report(int tics, double seconds)
+{
+	printf("\n%i tics in %.2f s\n", tics, seconds);
+	printf("Items given: %i, messages shown: %i\n", bench_items_given, bench_messages_shown);
+	auto stats = apmock_get_stats();
+	printf("Checks sent: %i in %i LocationChecks, scouted: %i, messages left: %i\n\n",
+		   stats.checks_sent, stats.send_calls, stats.scouted, stats.messages_left);
+
+	printf("%-24s %8s %11s %10s %10s %10s %10s\n", "scope", "count", "total ms", "mean us", "p50 us", "p99 us", "max us");
+	std::lock_guard<std::mutex> lock(bench_scope_mutex);
+	for (auto& kv : bench_scopes)
+	{
+		auto& us = kv.second;
+		std::sort(us.begin(), us.end());
+		double total = 0.0;
+		for (double d : us) total += d;
+		printf("%-24s %8i %11.3f %10.2f %10.2f %10.2f %10.2f\n", kv.first.c_str(), (int)us.size(), total / 1000.0,
+			   total / us.size(), percentile(us, 0.5), percentile(us, 0.99), us.back());
+	}
+
+	auto it = bench_scopes.find("apdoom_update");
+	if (it != bench_scopes.end())
+	{
+		int over = 0;
+		for (double d : it->second)
+			if (d > 1000.0) over++;
+		printf("\napdoom_update over 1 ms: %i tics\n", over);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	bench_options_t options;
+	if (!parse_options(argc, argv, options))
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::vector<replay_event_t> replay;
+	if (options.replay && !load_replay(options.replay, replay))
+	{
+		printf("Failed to load replay: %s\n", options.replay);
+		return 1;
+	}
+
+	if (!apdoom_select_game(options.game))
+	{
+		printf("Unknown game: %s\n", options.game);
+		return 1;
+	}
+	const int max_ids = 100000;
+	std::vector<long long> raw_ids(max_ids);
+	std::vector<int64_t> item_ids(raw_ids.begin(), raw_ids.begin() + apdoom_bench_get_item_ids(raw_ids.data(), max_ids));
+
+	// The player's checks, from the last level back, so they don't run into
+	// the ones the server sends, which start from the first
+	std::vector<ap_level_index_t> location_idxs(max_ids);
+	std::vector<int> location_indices(max_ids);
+	int location_count = apdoom_bench_get_locations(raw_ids.data(), location_idxs.data(), location_indices.data(), max_ids);
+	std::vector<int64_t> location_ids(raw_ids.begin(), raw_ids.begin() + location_count);
+	std::vector<std::pair<ap_level_index_t, int>> local_checks;
+	for (int i = location_count - 1; i >= 0; --i)
+		if (location_indices[i] >= 0)
+			local_checks.push_back({location_idxs[i], location_indices[i]});
+
+	if (item_ids.empty() || location_ids.empty())
+	{
+		printf("No ids for %s\n", options.game);
+		return 1;
+	}
+
+	// Saves go in cwd, keep them out of the way
+	std::error_code ec;
+	auto work_dir = std::filesystem::temp_directory_path(ec) / "apdoom-loadbench";
+	if (!options.keep) std::filesystem::remove_all(work_dir, ec);
+	std::filesystem::create_directories(work_dir, ec);
+	std::filesystem::current_path(work_dir, ec);
+	if (ec)
+	{
+		printf("Can't use %s\n", work_dir.string().c_str());
+		return 1;
+	}
+	printf("Working in %s\n", work_dir.string().c_str());
+
+	for (int ep = 1; ep <= 5; ++ep)
+		apmock_set_slot_data("episode" + std::to_string(ep), 1);
+	apmock_set_slot_data("difficulty", 2);
+
+	ap_settings_t settings;
+	memset(&settings, 0, sizeof(settings));
+	settings.ip = "127.0.0.1:38281";
+	settings.game = options.game;
+	settings.player_name = "LoadBench";
+	settings.passwd = "";
+	settings.message_callback = on_message;
+	settings.give_item_callback = on_give_item;
+	settings.give_items_callback = on_give_items;
+	settings.victory_callback = on_victory;
+	settings.trace_callback = on_trace;
+
+	// The catch-up storm, it lands while apdoom_init waits for the scouts
+	apmock_set_connect_task([&options, &item_ids, &location_ids]
+	{
+		const auto& callbacks = apmock_get_callbacks();
+		for (int i = 0; i < options.connect_locations; ++i)
+			callbacks.location_checked(location_ids[i % location_ids.size()]);
+		for (int i = 0; i < options.connect_items; ++i)
+			callbacks.item_recv(item_ids[i % item_ids.size()], 1, false);
+	});
+
+	// Each run starts over like switching slots would, same WADs, new state.
+	// The mock sends the catch-up storm again on every connect.
+	double seconds = 0.0;
+	for (int run = 0; run <= options.reinits; ++run)
+	{
+		if (!apdoom_init(&settings))
+		{
+			printf("apdoom_init failed\n");
+			apmock_shutdown();
+			return 1;
+		}
+		ap_is_in_game = 1;
+
+		double item_acc = 0.0, location_acc = 0.0, check_acc = 0.0, message_acc = 0.0;
+		size_t next_item = options.connect_items, next_location = options.connect_locations;
+		size_t next_check = 0, next_replay = 0;
+
+		auto start = bench_clock::now();
+		auto next_tic = start;
+		for (int tic = 0; tic < options.tics; ++tic)
+		{
+			if (options.replay)
+			{
+				std::vector<int64_t> items, silent_items, locations;
+				for (; next_replay < replay.size() && replay[next_replay].tic <= tic; ++next_replay)
+				{
+					const auto& event = replay[next_replay];
+					if (event.type == "item") (event.silent ? silent_items : items).push_back(event.id);
+					else if (event.type == "location") locations.push_back(event.id);
+					else if (event.type == "message") apmock_push_message(event.text, "Replay");
+					else if (event.type == "deathlink") apmock_push_deathlink();
+				}
+				post_items(items, true);
+				post_items(silent_items, false);
+				post_locations(locations);
+			}
+			else
+			{
+				std::vector<int64_t> items, locations;
+				for (int n = take_rate(options.item_rate, item_acc); n > 0; --n)
+					items.push_back(item_ids[next_item++ % item_ids.size()]);
+				for (int n = take_rate(options.location_rate, location_acc); n > 0; --n)
+					locations.push_back(location_ids[next_location++ % location_ids.size()]);
+				post_items(items, true);
+				post_locations(locations);
+
+				for (int n = take_rate(options.message_rate, message_acc); n > 0; --n)
+					apmock_push_message("Item " + std::to_string(tic), "Player" + std::to_string(tic % 8 + 1));
+				if (options.deathlink_every > 0 && tic % options.deathlink_every == options.deathlink_every - 1)
+					apmock_push_deathlink();
+			}
+
+			for (int n = take_rate(options.check_rate, check_acc); n > 0 && next_check < local_checks.size(); --n, ++next_check)
+				apdoom_check_location(local_checks[next_check].first, local_checks[next_check].second);
+
+			apdoom_update();
+
+			if (apdoom_should_die())
+				apdoom_clear_death();
+
+			if (options.save_every > 0 && tic % options.save_every == options.save_every - 1)
+				save_state();
+
+			if (options.realtime)
+			{
+				next_tic += std::chrono::microseconds(1000000 / 35);
+				std::this_thread::sleep_until(next_tic);
+			}
+		}
+		seconds += std::chrono::duration<double>(bench_clock::now() - start).count();
+
+		// Whatever is still in flight, then the shutdown save
+		apmock_drain();
+		apdoom_update();
+		apdoom_shutdown();
+	}
+	apmock_shutdown();
+
+	print_report(options.tics * (options.reinits + 1), seconds);
+	return 0;
+}
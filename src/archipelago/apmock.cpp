@@ -0,0 +1,316 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+//
+// *Mock of the APCpp interface, for apdoom-loadbench*
+//
+
+#include "apmock.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+static apmock_callbacks_t apmock_callbacks;
+static std::map<std::string, int> apmock_slot_values;
+static std::string apmock_seed_name = "loadbench";
+static std::function<void()> apmock_connect_task;
+static std::atomic<AP_ConnectionStatus> apmock_status(AP_ConnectionStatus::Disconnected);
+
+static std::thread apmock_server;
+static std::mutex apmock_task_mutex;
+static std::condition_variable apmock_task_cv;
+static std::deque<std::function<void()>> apmock_tasks;
+static bool apmock_quit = false;
+
+static std::mutex apmock_message_mutex;
+static std::deque<std::unique_ptr<AP_Message>> apmock_messages;
+static std::atomic<bool> apmock_deathlink(false);
+
+static std::mutex apmock_stats_mutex;
+static apmock_stats_t apmock_stats = {};
+
+
+static void server_thread_main()
+{
+	std::unique_lock<std::mutex> lock(apmock_task_mutex);
+	while (true)
+	{
+		apmock_task_cv.wait(lock, [] { return apmock_quit || !apmock_tasks.empty(); });
+		if (apmock_tasks.empty()) break; // Quit, once everything ran
+
+		auto task = std::move(apmock_tasks.front());
+		apmock_tasks.pop_front();
+		lock.unlock();
+		task();
+		lock.lock();
+	}
+}
+
+
+void apmock_post(std::function<void()> task)
+{
+	std::lock_guard<std::mutex> lock(apmock_task_mutex);
+	if (!apmock_server.joinable())
+	{
+		apmock_quit = false;
+		apmock_server = std::thread(server_thread_main);
+	}
+	apmock_tasks.push_back(std::move(task));
+	apmock_task_cv.notify_one();
+}
+
+
+void apmock_drain()
+{
+	std::mutex done_mutex;
+	std::condition_variable done_cv;
+	bool done = false;
+	apmock_post([&]
+	{
+		std::lock_guard<std::mutex> lock(done_mutex);
+		done = true;
+		done_cv.notify_one();
+	});
+	std::unique_lock<std::mutex> lock(done_mutex);
+	done_cv.wait(lock, [&] { return done; });
+}
+
+
+void apmock_shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(apmock_task_mutex);
+		apmock_quit = true;
+		apmock_task_cv.notify_one();
+	}
+	if (apmock_server.joinable())
+		apmock_server.join();
+}
+
+
+const apmock_callbacks_t& apmock_get_callbacks()
+{
+	return apmock_callbacks;
+}
+
+
+void apmock_set_slot_data(const std::string& name, int value)
+{
+	apmock_slot_values[name] = value;
+}
+
+
+void apmock_set_seed_name(const std::string& seed_name)
+{
+	apmock_seed_name = seed_name;
+}
+
+
+void apmock_set_connect_task(std::function<void()> task)
+{
+	apmock_connect_task = std::move(task);
+}
+
+
+void apmock_push_message(const std::string& item, const std::string& player)
+{
+	auto msg = std::make_unique<AP_ItemRecvMessage>();
+	msg->type = AP_MessageType::ItemRecv;
+	msg->text = "Received " + item + " from " + player;
+	msg->item = item;
+	msg->sendPlayer = player;
+
+	std::lock_guard<std::mutex> lock(apmock_message_mutex);
+	apmock_messages.push_back(std::move(msg));
+}
+
+
+void apmock_push_deathlink()
+{
+	apmock_deathlink = true;
+}
+
+
+apmock_stats_t apmock_get_stats()
+{
+	apmock_stats_t stats;
+	{
+		std::lock_guard<std::mutex> lock(apmock_stats_mutex);
+		stats = apmock_stats;
+	}
+	std::lock_guard<std::mutex> lock(apmock_message_mutex);
+	stats.messages_left = (int)apmock_messages.size();
+	return stats;
+}
+
+
+//
+// Archipelago.h
+//
+
+void AP_Init(const char*, const char*, const char*, const char*)
+{
+	apmock_status = AP_ConnectionStatus::Disconnected;
+}
+
+
+void AP_SetClientVersion(AP_NetworkVersion*) {}
+void AP_SetDeathLinkSupported(bool) {}
+void AP_StoryComplete() {}
+void AP_SetItemClearCallback(void (*f)()) { apmock_callbacks.item_clear = f; }
+void AP_SetItemRecvCallback(void (*f)(int64_t, int, bool)) { apmock_callbacks.item_recv = f; }
+void AP_SetLocationCheckedCallback(void (*f)(int64_t)) { apmock_callbacks.location_checked = f; }
+void AP_SetLocationInfoCallback(void (*f)(std::vector<AP_NetworkItem>)) { apmock_callbacks.location_info = f; }
+
+
+void AP_RegisterSlotDataIntCallback(std::string name, void (*f)(int))
+{
+	apmock_callbacks.slot_data[name] = f;
+}
+
+
+// Same order as APCpp: slot data with Connected, then we're authenticated
+// and the items come
+void AP_Start()
+{
+	apmock_post([]
+	{
+		apmock_status = AP_ConnectionStatus::Connected;
+		if (apmock_callbacks.item_clear) apmock_callbacks.item_clear();
+		for (const auto& kv : apmock_slot_values)
+		{
+			auto it = apmock_callbacks.slot_data.find(kv.first);
+			if (it != apmock_callbacks.slot_data.end())
+				it->second(kv.second);
+		}
+		apmock_status = AP_ConnectionStatus::Authenticated;
+		if (apmock_connect_task) apmock_connect_task();
+	});
+}
+
+
+AP_ConnectionStatus AP_GetConnectionStatus()
+{
+	return apmock_status;
+}
+
+
+int AP_GetRoomInfo(AP_RoomInfo* room_info)
+{
+	room_info->version = {0, 4, 1};
+	room_info->tags.clear();
+	room_info->password_required = false;
+	room_info->permissions.clear();
+	room_info->hint_cost = 10;
+	room_info->location_check_points = 1;
+	room_info->datapackage_checksums.clear();
+	room_info->seed_name = apmock_seed_name;
+	room_info->time = 0.0;
+	return 0;
+}
+
+
+// About a third of the items are progression, always the same ones
+void AP_SendLocationScouts(std::vector<int64_t> const& locations, int)
+{
+	{
+		std::lock_guard<std::mutex> lock(apmock_stats_mutex);
+		apmock_stats.scouted += (int)locations.size();
+	}
+	apmock_post([locations]
+	{
+		std::vector<AP_NetworkItem> infos;
+		infos.reserve(locations.size());
+		for (auto location : locations)
+		{
+			AP_NetworkItem info;
+			info.item = location;
+			info.location = location;
+			info.player = 1;
+			info.flags = (location % 3 == 0) ? 1 : 0;
+			infos.push_back(info);
+		}
+		if (apmock_callbacks.location_info) apmock_callbacks.location_info(infos);
+	});
+}
+
+
+// The server echoes accepted checks back in a RoomUpdate
+void AP_SendItems(std::set<int64_t> const& locations)
+{
+	{
+		std::lock_guard<std::mutex> lock(apmock_stats_mutex);
+		apmock_stats.checks_sent += (int)locations.size();
+		apmock_stats.send_calls++;
+	}
+	apmock_post([locations]
+	{
+		if (!apmock_callbacks.location_checked) return;
+		for (auto location : locations)
+			apmock_callbacks.location_checked(location);
+	});
+}
+
+
+// Not in Archipelago.h, apdoom.cpp declares it itself
+void APSend(std::string)
+{
+	std::lock_guard<std::mutex> lock(apmock_stats_mutex);
+	apmock_stats.packets_sent++;
+}
+
+
+void AP_DeathLinkSend()
+{
+	std::lock_guard<std::mutex> lock(apmock_stats_mutex);
+	apmock_stats.deathlinks_sent++;
+}
+
+
+bool AP_DeathLinkPending()
+{
+	return apmock_deathlink;
+}
+
+
+void AP_DeathLinkClear()
+{
+	apmock_deathlink = false;
+}
+
+
+bool AP_IsMessagePending()
+{
+	std::lock_guard<std::mutex> lock(apmock_message_mutex);
+	return !apmock_messages.empty();
+}
+
+
+AP_Message* AP_GetLatestMessage()
+{
+	std::lock_guard<std::mutex> lock(apmock_message_mutex);
+	return apmock_messages.empty() ? nullptr : apmock_messages.front().get();
+}
+
+
+void AP_ClearLatestMessage()
+{
+	std::lock_guard<std::mutex> lock(apmock_message_mutex);
+	if (!apmock_messages.empty())
+		apmock_messages.pop_front();
+}
@@ -0,0 +1,78 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+//
+// *Mock of the APCpp interface, for apdoom-loadbench*
+//
+// Implements what apdoom.cpp uses from Archipelago.h without a server.
+// Like APCpp, the callbacks run on a thread of their own (The "server"),
+// one at a time, so apdoom.cpp's single producer queues hold. The harness
+// feeds that thread with apmock_post.
+//
+
+#ifndef _APMOCK_
+#define _APMOCK_
+
+#include "Archipelago.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <map>
+
+
+struct apmock_callbacks_t
+{
+	void (*item_clear)() = nullptr;
+	void (*item_recv)(int64_t, int, bool) = nullptr;
+	void (*location_checked)(int64_t) = nullptr;
+	void (*location_info)(std::vector<AP_NetworkItem>) = nullptr;
+	std::map<std::string, void (*)(int)> slot_data;
+};
+
+
+struct apmock_stats_t
+{
+	int checks_sent; // Locations in AP_SendItems
+	int send_calls;
+	int scouted; // Locations in AP_SendLocationScouts
+	int deathlinks_sent;
+	int packets_sent; // APSend, chat
+	int messages_left; // Not taken by the pump yet
+};
+
+
+// What AP_Start answers with. Set before apdoom_init.
+void apmock_set_slot_data(const std::string& name, int value);
+void apmock_set_seed_name(const std::string& seed_name);
+// Runs on the server thread right after authenticating, where the server
+// sends everything received so far
+void apmock_set_connect_task(std::function<void()> task);
+
+// Runs task on the server thread, after everything posted before it
+void apmock_post(std::function<void()> task);
+// Waits until the server thread ran everything posted so far
+void apmock_drain();
+
+// Only from posted tasks
+const apmock_callbacks_t& apmock_get_callbacks();
+
+// Queued for the pump, like a PrintJSON from the server
+void apmock_push_message(const std::string& item, const std::string& player);
+void apmock_push_deathlink();
+
+apmock_stats_t apmock_get_stats();
+void apmock_shutdown();
+
+
+#endif
@@ -0,0 +1,503 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+//
+// *Local tracker feed, the WebSocket side*
+//
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET ap_socket_t;
+#define AP_INVALID_SOCKET INVALID_SOCKET
+#define ap_closesocket closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+typedef int ap_socket_t;
+#define AP_INVALID_SOCKET (-1)
+#define ap_closesocket close
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SO_NOSIGPIPE is set instead where there is one
+#endif
+
+#include "aptracker.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <string>
+#include <utility>
+
+
+#define AP_TRACKER_MAX_REQUEST 8192 // Handshake, then any one client frame
+#define AP_TRACKER_MAX_BACKLOG (4 * 1024 * 1024) // Clients that fall this far behind are dropped
+
+
+struct ap_tracker_client_t
+{
+	ap_socket_t socket;
+	std::string in;
+	std::string out;
+	bool handshaken = false;
+	bool synced = false;
+	bool closing = false; // Close once out is flushed
+	bool dead = false;
+};
+
+
+static ap_socket_t ap_tracker_listener = AP_INVALID_SOCKET;
+static std::thread ap_tracker_thread;
+static std::atomic<bool> ap_tracker_quit(false);
+static std::atomic<int> ap_tracker_client_count(0); // Handshaken ones
+static std::atomic<bool> ap_tracker_sync_requested(false);
+static std::mutex ap_tracker_mutex;
+static std::deque<std::pair<std::string, bool>> ap_tracker_queue; // Message, sync
+
+
+static uint32_t rol32(uint32_t x, int n)
+{
+	return (x << n) | (x >> (32 - n));
+}
+
+
+static std::string sha1(const std::string& data)
+{
+	uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+	std::string msg = data;
+	msg.push_back((char)0x80);
+	while (msg.size() % 64 != 56)
+		msg.push_back(0);
+	uint64_t bits = (uint64_t)data.size() * 8;
+	for (int i = 7; i >= 0; --i)
+		msg.push_back((char)(bits >> (i * 8)));
+
+	for (size_t chunk = 0; chunk < msg.size(); chunk += 64)
+	{
+		uint32_t w[80];
+		for (int i = 0; i < 16; ++i)
+		{
+			const unsigned char* p = (const unsigned char*)msg.data() + chunk + i * 4;
+			w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+		}
+		for (int i = 16; i < 80; ++i)
+			w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for (int i = 0; i < 80; ++i)
+		{
+			uint32_t f, k;
+			if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+			else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+			else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+			else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+
+			uint32_t temp = rol32(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rol32(b, 30);
+			b = a;
+			a = temp;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+	}
+
+	std::string digest;
+	for (int i = 0; i < 5; ++i)
+		for (int j = 3; j >= 0; --j)
+			digest.push_back((char)(h[i] >> (j * 8)));
+	return digest;
+}
+
+
+static std::string base64(const std::string& data)
+{
+	static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string ret;
+	for (size_t i = 0; i < data.size(); i += 3)
+	{
+		uint32_t n = (uint32_t)(unsigned char)data[i] << 16;
+		if (i + 1 < data.size()) n |= (uint32_t)(unsigned char)data[i + 1] << 8;
+		if (i + 2 < data.size()) n |= (unsigned char)data[i + 2];
+		ret.push_back(digits[(n >> 18) & 63]);
+		ret.push_back(digits[(n >> 12) & 63]);
+		ret.push_back(i + 1 < data.size() ? digits[(n >> 6) & 63] : '=');
+		ret.push_back(i + 2 < data.size() ? digits[n & 63] : '=');
+	}
+	return ret;
+}
+
+
+static std::string make_frame(int opcode, const std::string& payload)
+{
+	std::string frame;
+	frame.push_back((char)(0x80 | opcode)); // FIN, never fragmented
+	if (payload.size() < 126)
+	{
+		frame.push_back((char)payload.size());
+	}
+	else if (payload.size() < 65536)
+	{
+		frame.push_back((char)126);
+		frame.push_back((char)(payload.size() >> 8));
+		frame.push_back((char)payload.size());
+	}
+	else
+	{
+		frame.push_back((char)127);
+		for (int i = 7; i >= 0; --i)
+			frame.push_back((char)((uint64_t)payload.size() >> (i * 8)));
+	}
+	frame += payload;
+	return frame;
+}
+
+
+static bool set_nonblocking(ap_socket_t s)
+{
+#ifdef _WIN32
+	u_long mode = 1;
+	return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+#ifdef SO_NOSIGPIPE
+	int one = 1;
+	setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+	int flags = fcntl(s, F_GETFL, 0);
+	return flags != -1 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+
+static bool would_block()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+
+// Returns false if the request isn't a WebSocket upgrade
+static bool handshake(ap_tracker_client_t& client, size_t header_end)
+{
+	std::string header = client.in.substr(0, header_end);
+	client.in.erase(0, header_end + 4);
+
+	std::string lower = header;
+	for (auto& c : lower)
+		c = (char)tolower((unsigned char)c);
+
+	static const char key_field[] = "\r\nsec-websocket-key:";
+	size_t key_pos = lower.find(key_field);
+	if (lower.compare(0, 4, "get ") != 0 || key_pos == std::string::npos)
+	{
+		client.out += "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+		client.closing = true;
+		return false;
+	}
+
+	key_pos += sizeof(key_field) - 1;
+	size_t key_end = header.find("\r\n", key_pos);
+	std::string key = header.substr(key_pos, key_end == std::string::npos ? std::string::npos : key_end - key_pos);
+	while (!key.empty() && isspace((unsigned char)key.front())) key.erase(0, 1);
+	while (!key.empty() && isspace((unsigned char)key.back())) key.pop_back();
+
+	client.out += "HTTP/1.1 101 Switching Protocols\r\n"
+	              "Upgrade: websocket\r\n"
+	              "Connection: Upgrade\r\n"
+	              "Sec-WebSocket-Accept: " + base64(sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11")) + "\r\n\r\n";
+	client.handshaken = true;
+	ap_tracker_sync_requested = true;
+	return true;
+}
+
+
+// Handles what the client sent. Text is only looked at for a sync request.
+static void process_input(ap_tracker_client_t& client)
+{
+	if (!client.handshaken)
+	{
+		size_t header_end = client.in.find("\r\n\r\n");
+		if (header_end == std::string::npos)
+		{
+			if (client.in.size() > AP_TRACKER_MAX_REQUEST) client.dead = true;
+			return;
+		}
+		if (!handshake(client, header_end)) return;
+	}
+
+	while (!client.closing && client.in.size() >= 2)
+	{
+		const unsigned char* p = (const unsigned char*)client.in.data();
+		int opcode = p[0] & 0x0F;
+		bool masked = (p[1] & 0x80) != 0;
+		uint64_t len = p[1] & 0x7F;
+		size_t pos = 2;
+
+		if (len == 126)
+		{
+			if (client.in.size() < 4) return;
+			len = ((uint64_t)p[2] << 8) | p[3];
+			pos = 4;
+		}
+		else if (len == 127)
+		{
+			if (client.in.size() < 10) return;
+			len = 0;
+			for (int i = 0; i < 8; ++i)
+				len = (len << 8) | p[2 + i];
+			pos = 10;
+		}
+		if (len > AP_TRACKER_MAX_REQUEST)
+		{
+			client.dead = true;
+			return;
+		}
+
+		size_t mask_pos = pos;
+		if (masked) pos += 4;
+		if (client.in.size() < pos + len) return;
+
+		std::string payload = client.in.substr(pos, (size_t)len);
+		if (masked)
+			for (size_t i = 0; i < payload.size(); ++i)
+				payload[i] ^= p[mask_pos + (i & 3)];
+		client.in.erase(0, pos + (size_t)len);
+
+		switch (opcode)
+		{
+			case 0x1: // Text
+				if (payload.find("\"sync\"") != std::string::npos)
+				{
+					client.synced = false;
+					ap_tracker_sync_requested = true;
+				}
+				break;
+			case 0x8: // Close
+				client.out += make_frame(0x8, payload.substr(0, 2));
+				client.closing = true;
+				break;
+			case 0x9: // Ping
+				client.out += make_frame(0xA, payload);
+				break;
+		}
+	}
+}
+
+
+static void tracker_thread_main()
+{
+	std::vector<ap_tracker_client_t> clients;
+	std::deque<std::pair<std::string, bool>> messages;
+
+	while (!ap_tracker_quit)
+	{
+		fd_set readfds, writefds;
+		FD_ZERO(&readfds);
+		FD_ZERO(&writefds);
+		FD_SET(ap_tracker_listener, &readfds);
+		ap_socket_t maxfd = ap_tracker_listener;
+		for (const auto& client : clients)
+		{
+			FD_SET(client.socket, &readfds);
+			if (!client.out.empty())
+				FD_SET(client.socket, &writefds);
+			if (client.socket > maxfd) maxfd = client.socket;
+		}
+
+		// Short, so queued messages go out well within a tic
+		timeval timeout = {0, 10000};
+		if (select((int)maxfd + 1, &readfds, &writefds, nullptr, &timeout) < 0)
+		{
+			if (!would_block())
+			{
+				printf("APDOOM: Tracker feed stopped, select failed\n");
+				break;
+			}
+			continue;
+		}
+
+		if (FD_ISSET(ap_tracker_listener, &readfds) && clients.size() < FD_SETSIZE - 1)
+		{
+			ap_socket_t s = accept(ap_tracker_listener, nullptr, nullptr);
+			if (s != AP_INVALID_SOCKET)
+			{
+				if (set_nonblocking(s))
+				{
+					ap_tracker_client_t client;
+					client.socket = s;
+					clients.push_back(client);
+				}
+				else
+				{
+					ap_closesocket(s);
+				}
+			}
+		}
+
+		for (auto& client : clients)
+		{
+			if (!FD_ISSET(client.socket, &readfds)) continue;
+
+			char buf[4096];
+			int received = (int)recv(client.socket, buf, sizeof(buf), 0);
+			if (received > 0)
+			{
+				client.in.append(buf, received);
+				process_input(client);
+			}
+			else if (received == 0 || !would_block())
+			{
+				client.dead = true;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(ap_tracker_mutex);
+			messages.swap(ap_tracker_queue);
+		}
+		for (const auto& message : messages)
+		{
+			std::string frame = make_frame(0x1, message.first);
+			for (auto& client : clients)
+			{
+				if (!client.handshaken || client.closing || client.synced != !message.second) continue;
+				client.out += frame;
+				client.synced = true;
+			}
+		}
+		messages.clear();
+
+		for (auto& client : clients)
+		{
+			while (!client.dead && !client.out.empty())
+			{
+				int sent = (int)send(client.socket, client.out.data(), (int)client.out.size(), MSG_NOSIGNAL);
+				if (sent > 0)
+				{
+					client.out.erase(0, sent);
+					continue;
+				}
+				if (!would_block()) client.dead = true;
+				break;
+			}
+			if (client.out.size() > AP_TRACKER_MAX_BACKLOG) client.dead = true;
+			if (client.closing && client.out.empty()) client.dead = true;
+		}
+
+		int count = 0;
+		for (size_t i = 0; i < clients.size(); )
+		{
+			if (clients[i].dead)
+			{
+				ap_closesocket(clients[i].socket);
+				clients.erase(clients.begin() + i);
+				continue;
+			}
+			if (clients[i].handshaken) ++count;
+			++i;
+		}
+		ap_tracker_client_count = count;
+	}
+
+	for (auto& client : clients)
+		ap_closesocket(client.socket);
+	ap_tracker_client_count = 0;
+}
+
+
+bool ap_tracker_start(int port)
+{
+#ifdef _WIN32
+	WSADATA wsa_data;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+		return false;
+#endif
+
+	ap_tracker_listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (ap_tracker_listener == AP_INVALID_SOCKET)
+		return false;
+
+	int one = 1;
+	setsockopt(ap_tracker_listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+
+	// Local only, nothing here is meant for the network
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons((unsigned short)port);
+
+	if (bind(ap_tracker_listener, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+		listen(ap_tracker_listener, 4) != 0 ||
+		!set_nonblocking(ap_tracker_listener))
+	{
+		ap_closesocket(ap_tracker_listener);
+		ap_tracker_listener = AP_INVALID_SOCKET;
+		return false;
+	}
+
+	ap_tracker_quit = false;
+	ap_tracker_thread = std::thread(tracker_thread_main);
+	printf("APDOOM: Tracker feed on ws://127.0.0.1:%i\n", port);
+	return true;
+}
+
+
+void ap_tracker_stop()
+{
+	if (ap_tracker_listener == AP_INVALID_SOCKET) return;
+
+	ap_tracker_quit = true;
+	if (ap_tracker_thread.joinable())
+		ap_tracker_thread.join();
+	ap_closesocket(ap_tracker_listener);
+	ap_tracker_listener = AP_INVALID_SOCKET;
+}
+
+
+bool ap_tracker_has_clients()
+{
+	return ap_tracker_client_count > 0;
+}
+
+
+bool ap_tracker_take_sync_request()
+{
+	return ap_tracker_sync_requested.exchange(false);
+}
+
+
+void ap_tracker_send(const std::string& message, bool sync)
+{
+	std::lock_guard<std::mutex> lock(ap_tracker_mutex);
+	ap_tracker_queue.emplace_back(message, sync);
+}
@@ -0,0 +1,45 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+//
+// *Local tracker feed*
+//
+// A WebSocket server on 127.0.0.1 for trackers and stream overlays. It
+// runs on its own thread and only moves text; apdoom.cpp decides what is
+// sent. Every message is a JSON array of events. A client first gets a
+// "sync" message holding the whole state, then the deltas that follow it.
+//
+
+#ifndef _APTRACKER_
+#define _APTRACKER_
+
+#include <string>
+
+
+// Starts listening on port. False if the socket couldn't be set up.
+bool ap_tracker_start(int port);
+void ap_tracker_stop();
+
+// True while at least one client is connected.
+bool ap_tracker_has_clients();
+
+// True once after a client connects or asks for it, the game thread then
+// sends a sync message.
+bool ap_tracker_take_sync_request();
+
+// Queues message for the clients. Sync messages only go to clients that
+// haven't had one yet, the others only to clients that have.
+void ap_tracker_send(const std::string& message, bool sync);
+
+
+#endif
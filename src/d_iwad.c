@@ -78,6 +78,18 @@ static boolean iwad_dirs_built = false;
 static const char *iwad_dirs[MAX_IWAD_DIRS];
 static int num_iwad_dirs = 0;
 
+// [AP] Whether each IWAD dir is there, found out the first time we look
+// in it. Most of the install locations we know of aren't on any given
+// machine, and each lookup would probe them for the name in five cases.
+typedef enum
+{
+    IWAD_DIR_UNKNOWN,
+    IWAD_DIR_PRESENT,
+    IWAD_DIR_MISSING
+} iwad_dir_state_t;
+
+static iwad_dir_state_t iwad_dir_states[MAX_IWAD_DIRS];
+
 static void AddIWADDir(const char *dir)
 {
     if (num_iwad_dirs < MAX_IWAD_DIRS)
@@ -494,24 +506,46 @@ static boolean DirIsFile(const char *path, const char *filename)
         && !strcasecmp(M_BaseName(path), filename);
 }
 
+// [AP] False when IWAD dir number dir isn't a directory that's there
+static boolean IWADDirExists(int dir)
+{
+    struct stat st;
+
+    if (iwad_dir_states[dir] == IWAD_DIR_UNKNOWN)
+    {
+        iwad_dir_states[dir] =
+            M_stat(iwad_dirs[dir], &st) == 0
+         && (st.st_mode & S_IFMT) == S_IFDIR ? IWAD_DIR_PRESENT
+                                             : IWAD_DIR_MISSING;
+    }
+
+    return iwad_dir_states[dir] == IWAD_DIR_PRESENT;
+}
+
 // Check if the specified directory contains the specified IWAD
 // file, returning the full path to the IWAD if found, or NULL
 // if not found.
 
-static char *CheckDirectoryHasIWAD(const char *dir, const char *iwadname)
+static char *CheckDirectoryHasIWAD(int dir_index, const char *iwadname)
 {
+    const char *dir = iwad_dirs[dir_index];
     char *filename; 
     char *probe;
 
     // As a special case, the "directory" may refer directly to an
     // IWAD file if the path comes from DOOMWADDIR or DOOMWADPATH.
+    // [AP] Only probed when the name matches
 
-    probe = M_FileCaseExists(dir);
-    if (DirIsFile(dir, iwadname) && probe != NULL)
+    if (DirIsFile(dir, iwadname) && (probe = M_FileCaseExists(dir)) != NULL)
     {
         return probe;
     }
 
+    if (!IWADDirExists(dir_index))
+    {
+        return NULL;
+    }
+
     // Construct the full path to the IWAD if it is located in
     // this directory, and check if it exists.
 
@@ -524,7 +558,6 @@ static char *CheckDirectoryHasIWAD(const char *dir, const char *iwadname)
         filename = M_StringJoin(dir, DIR_SEPARATOR_S, iwadname, NULL);
     }
 
-    free(probe);
     probe = M_FileCaseExists(filename);
     free(filename);
     if (probe != NULL)
@@ -538,7 +571,7 @@ static char *CheckDirectoryHasIWAD(const char *dir, const char *iwadname)
 // Search a directory to try to find an IWAD
 // Returns the location of the IWAD if found, otherwise NULL.
 
-static char *SearchDirectoryForIWAD(const char *dir, int mask, GameMission_t *mission)
+static char *SearchDirectoryForIWAD(int dir, int mask, GameMission_t *mission)
 {
     char *filename;
     size_t i;
@@ -814,12 +847,17 @@ char *D_FindWADByName(const char *name)
         // the "directory" may actually refer directly to an IWAD
         // file.
 
-        probe = M_FileCaseExists(iwad_dirs[i]);
-        if (DirIsFile(iwad_dirs[i], name) && probe != NULL)
+        // [AP] Only probed when the name matches
+        if (DirIsFile(iwad_dirs[i], name)
+         && (probe = M_FileCaseExists(iwad_dirs[i])) != NULL)
         {
             return probe;
         }
-        free(probe);
+
+        if (!IWADDirExists(i))
+        {
+            continue;
+        }
 
         // Construct a string for the full path
 
@@ -911,7 +949,7 @@ char *D_FindIWAD(int mask, GameMission_t *mission)
     
         for (i=0; result == NULL && i<num_iwad_dirs; ++i)
         {
-            result = SearchDirectoryForIWAD(iwad_dirs[i], mask, mission);
+            result = SearchDirectoryForIWAD(i, mask, mission);
         }
     }
 
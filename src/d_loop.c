@@ -23,19 +23,23 @@
 #include "d_loop.h"
 #include "d_ticcmd.h"
 
+#include "i_profile.h"
+#include "i_trace.h"
 #include "i_system.h"
 #include "i_timer.h"
 #include "i_video.h"
 
 #include "m_argv.h"
 #include "m_fixed.h"
+#include "m_misc.h"
 
 #include "net_client.h"
 #include "net_gui.h"
 #include "net_io.h"
 #include "net_query.h"
 #include "net_server.h"
-#include "net_sdl.h"
+#include "net_thread.h"
+#include "net_udp.h"
 #include "net_loop.h"
 
 #include "crispy.h"
@@ -106,6 +110,16 @@ fixed_t         offsetms;
 
 static boolean  new_sync = true;
 
+// Network module whose socket TryRunTics waits on for new tics, or NULL
+// in single player.
+
+static net_module_t *wait_module = NULL;
+
+// [AP] If true, the local player is shown moved ahead by the ticcmds
+// it has sent but not had back from the server yet.
+
+static boolean predict_local = false;
+
 // Callback functions for loop code.
 
 static loop_interface_t *loop_interface = NULL;
@@ -186,7 +200,11 @@ static boolean BuildNewTic(void)
     memset(&cmd, 0, sizeof(ticcmd_t));
     loop_interface->BuildTiccmd(&cmd, maketic);
 
-    if (net_client_connected)
+    if (NET_ThreadRunning())
+    {
+        NET_ThreadSendTiccmd(&cmd, maketic);
+    }
+    else if (net_client_connected)
     {
         NET_CL_SendTiccmd(&cmd, maketic);
     }
@@ -206,7 +224,7 @@ static boolean BuildNewTic(void)
 //
 int      lasttime;
 
-void NetUpdate (void)
+static void RunNetUpdate(void)
 {
     int nowtime;
     int newtics;
@@ -218,10 +236,17 @@ void NetUpdate (void)
     if (singletics)
         return;
 
-    // Run network subsystems
+    // Run network subsystems, or collect what their thread received
 
-    NET_CL_Run();
-    NET_SV_Run();
+    if (NET_ThreadRunning())
+    {
+        NET_ThreadReceiveTics();
+    }
+    else
+    {
+        NET_CL_Run();
+        NET_SV_Run();
+    }
 
     // check time
     nowtime = GetAdjustedTime() / ticdup;
@@ -251,6 +276,13 @@ void NetUpdate (void)
     }
 }
 
+void NetUpdate (void)
+{
+    I_ProfileBegin(PROFILE_NETUPDATE);
+    RunNetUpdate();
+    I_ProfileEnd(PROFILE_NETUPDATE);
+}
+
 static void D_Disconnected(void)
 {
     // In drone mode, the game cannot continue once disconnected.
@@ -418,11 +450,31 @@ void D_StartNetGame(net_gamesettings_t *settings,
     ticdup = settings->ticdup;
     new_sync = settings->new_sync;
 
+    //!
+    // @category net
+    //
+    // Move the local player ahead of the server in netgames, by running
+    // its own unacknowledged ticcmds for display. Hides latency when
+    // moving, at the cost of a correction now and then.
+    //
+
+    predict_local = net_client_connected && !drone
+                 && loop_interface != NULL
+                 && loop_interface->PredictTics != NULL
+                 && M_CheckParm("-predict") > 0;
+
     if (ticdup < 1)
     {
         I_Error("D_StartNetGame: invalid ticdup value (%d)", ticdup);
     }
 
+    // [AP] From here on, network I/O doesn't wait for our frames
+
+    if (net_client_connected)
+    {
+        NET_StartThread();
+    }
+
     // TODO: Message disabled until we fix new_sync.
     //if (!new_sync)
     //{
@@ -453,7 +505,7 @@ boolean D_InitNetGame(net_connect_data_t *connect_data)
     {
         NET_SV_Init();
         NET_SV_AddModule(&net_loop_server_module);
-        NET_SV_AddModule(&net_sdl_module);
+        NET_SV_AddModule(NET_UDP_DefaultModule());
         NET_SV_RegisterWithMaster();
 
         net_loop_client_module.InitClient();
@@ -493,8 +545,8 @@ boolean D_InitNetGame(net_connect_data_t *connect_data)
 
         if (i > 0)
         {
-            net_sdl_module.InitClient();
-            addr = net_sdl_module.ResolveAddress(myargv[i+1]);
+            NET_UDP_DefaultModule()->InitClient();
+            addr = NET_UDP_DefaultModule()->ResolveAddress(myargv[i+1]);
             NET_ReferenceAddress(addr);
 
             if (addr == NULL)
@@ -520,6 +572,9 @@ boolean D_InitNetGame(net_connect_data_t *connect_data)
         printf("D_InitNetGame: Connected to %s\n", NET_AddrToString(addr));
         NET_ReleaseAddress(addr);
 
+        // As the server, or connected to one, it is initialized by now
+        wait_module = NET_UDP_DefaultModule();
+
         // Wait for launch message received from server.
 
         NET_WaitForLaunch();
@@ -538,6 +593,7 @@ boolean D_InitNetGame(net_connect_data_t *connect_data)
 //
 void D_QuitNetGame (void)
 {
+    NET_StopThread();
     NET_SV_Shutdown();
     NET_CL_Disconnect();
 }
@@ -677,11 +733,32 @@ static void SinglePlayerClear(ticcmd_set_t *set)
 void tick_sticky_msgs();
 
 
+//
+// [AP] Predict the local player over the tics built but not run yet.
+//
+
+static void PredictLocalTics(void)
+{
+    static ticcmd_t cmds[BACKUPTICS];
+    int numcmds = 0;
+    int t, i;
+
+    for (t = gametic / ticdup; t < maketic; ++t)
+    {
+        for (i = 0; i < ticdup && numcmds < BACKUPTICS; ++i)
+        {
+            cmds[numcmds++] = ticdata[t % BACKUPTICS].cmds[localplayer];
+        }
+    }
+
+    loop_interface->PredictTics(cmds, numcmds);
+}
+
 //
 // TryRunTics
 //
 
-void TryRunTics (void)
+static void RunTics (void)
 {
     int	i;
     int	lowtic;
@@ -789,14 +866,24 @@ void TryRunTics (void)
                 return;
             }
 
-            I_Sleep(1);
+            if (NET_ThreadRunning())
+            {
+                I_WaitForTic(NET_ThreadWaitTic);
+            }
+            else
+            {
+                I_WaitForTic(wait_module != NULL ? wait_module->WaitPacket
+                                                 : NULL);
+            }
         }
     }
 
     // run the count * ticdup dics
     while (counts--)
     {
+        I_ProfileBegin(PROFILE_APUPDATE);
         apdoom_update();
+        I_ProfileEnd(PROFILE_APUPDATE);
 
         ticcmd_set_t *set;
 
@@ -819,7 +906,16 @@ void TryRunTics (void)
 
             memcpy(local_playeringame, set->ingame, sizeof(local_playeringame));
 
+            if (tracing)
+            {
+                char detail[16];
+
+                M_snprintf(detail, sizeof(detail), "%d", gametic);
+                I_TraceBegin("tic", detail);
+            }
+
             loop_interface->RunTic(set->cmds, set->ingame);
+            I_TraceEnd("tic");
 	    gametic++;
 
 	    // modify command for duplicated tics
@@ -833,13 +929,29 @@ void TryRunTics (void)
     }
 }
 
+void TryRunTics (void)
+{
+    // The game only ever sees the real state of the player
+
+    if (predict_local)
+    {
+        loop_interface->PredictTics(NULL, 0);
+    }
+
+    RunTics();
+
+    if (predict_local)
+    {
+        PredictLocalTics();
+    }
+}
+
 void D_RegisterLoopCallbacks(loop_interface_t *i)
 {
     loop_interface = i;
 }
 
 // TODO: Move nonvanilla demo functions into a dedicated file.
-#include "m_misc.h"
 #include "w_wad.h"
 
 static boolean StrictDemos(void)
@@ -48,6 +48,12 @@ typedef struct
     // Run the menu (runs independently of the game).
 
     void (*RunMenu)();
+
+    // [AP] Undo the last prediction, then show the local player moved
+    // ahead by the given ticcmds of its own that haven't been run yet.
+    // Called with numcmds == 0 before real tics run. May be NULL.
+
+    void (*PredictTics)(ticcmd_t *cmds, int numcmds);
 } loop_interface_t;
 
 // Register callback functions for the main loop code to use.
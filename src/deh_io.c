@@ -39,17 +39,13 @@ struct deh_context_s
     deh_input_type_t type;
     char *filename;
 
-    // If the input comes from a memory buffer, pointer to the memory
-    // buffer.
+    // The whole input, read into memory: the lump, or the contents of
+    // the file, which are freed on close.
     unsigned char *input_buffer;
     size_t input_buffer_len;
     unsigned int input_buffer_pos;
     int lumpnum;
 
-    // If the input comes from a file, the file stream for reading
-    // data.
-    FILE *stream;
-
     // Current line number that we have reached:
     int linenum;
 
@@ -91,16 +87,35 @@ deh_context_t *DEH_OpenFile(const char *filename)
 {
     FILE *fstream;
     deh_context_t *context;
+    unsigned char *buffer;
+    long length;
 
-    fstream = M_fopen(filename, "r");
+    fstream = M_fopen(filename, "rb");
 
     if (fstream == NULL)
         return NULL;
 
+    // Read it all in one go; DEH_GetChar and DEH_ReadLine then work on
+    // the buffer the same way they do for a lump.
+
+    length = M_FileLength(fstream);
+    buffer = malloc(length > 0 ? length : 1);
+
+    if (buffer == NULL || fread(buffer, 1, length, fstream) != (size_t) length)
+    {
+        free(buffer);
+        fclose(fstream);
+        return NULL;
+    }
+
+    fclose(fstream);
+
     context = DEH_NewContext();
 
     context->type = DEH_INPUT_FILE;
-    context->stream = fstream;
+    context->input_buffer = buffer;
+    context->input_buffer_len = length;
+    context->input_buffer_pos = 0;
     context->filename = M_StringDuplicate(filename);
 
     return context;
@@ -135,7 +150,7 @@ void DEH_CloseFile(deh_context_t *context)
 {
     if (context->type == DEH_INPUT_FILE)
     {
-        fclose(context->stream);
+        free(context->input_buffer);
     }
     else if (context->type == DEH_INPUT_LUMP)
     {
@@ -147,33 +162,6 @@ void DEH_CloseFile(deh_context_t *context)
     Z_Free(context);
 }
 
-int DEH_GetCharFile(deh_context_t *context)
-{
-    if (feof(context->stream))
-    {
-        // end of file
-
-        return -1;
-    }
-
-    return fgetc(context->stream);
-}
-
-int DEH_GetCharLump(deh_context_t *context)
-{
-    int result;
-
-    if (context->input_buffer_pos >= context->input_buffer_len)
-    {
-        return -1;
-    }
-
-    result = context->input_buffer[context->input_buffer_pos];
-    ++context->input_buffer_pos;
-
-    return result;
-}
-
 // Reads a single character from a dehacked file
 
 int DEH_GetChar(deh_context_t *context)
@@ -192,31 +180,28 @@ int DEH_GetChar(deh_context_t *context)
 
     do
     {
-        switch (context->type)
+        if (context->input_buffer_pos >= context->input_buffer_len)
         {
-            case DEH_INPUT_FILE:
-                result = DEH_GetCharFile(context);
-                break;
+            // end of input; a \r just before it is returned as it is
 
-            case DEH_INPUT_LUMP:
-                result = DEH_GetCharLump(context);
-                break;
+            result = -1;
+        }
+        else
+        {
+            result = context->input_buffer[context->input_buffer_pos];
+            ++context->input_buffer_pos;
         }
 
         // Handle \r characters not paired with \n
         if (last_was_cr && result != '\n')
         {
-            switch (context->type)
+            if (result >= 0)
             {
-                case DEH_INPUT_FILE:
-                    ungetc(result, context->stream);
-                    break;
-
-                case DEH_INPUT_LUMP:
-                    --context->input_buffer_pos;
-                    break;
+                --context->input_buffer_pos;
             }
 
+            context->last_was_newline = false;
+
             return '\r';
         }
 
@@ -250,15 +235,7 @@ static void IncreaseReadBuffer(deh_context_t *context)
 // [crispy] Save pointer to start of current line ...
 void DEH_SaveLineStart (deh_context_t *context)
 {
-    if (context->type == DEH_INPUT_FILE)
-    {
-	context->linestart = ftell(context->stream);
-    }
-    else
-    if (context->type == DEH_INPUT_LUMP)
-    {
-	context->linestart = context->input_buffer_pos;
-    }
+    context->linestart = context->input_buffer_pos;
 }
 
 // [crispy] ... and reset context to start of current line
@@ -269,18 +246,64 @@ void DEH_RestoreLineStart (deh_context_t *context)
     if (context->linestart < 0)
 	return;
 
-    if (context->type == DEH_INPUT_FILE)
+    context->input_buffer_pos = context->linestart;
+
+    // [crispy] don't count this line twice
+    --context->linenum;
+}
+
+// Read a plain line straight out of the buffer: find the end with
+// memchr and copy it over in one pass, dropping NULs and the \r of a
+// CRLF. Gives the same result as reading it through DEH_GetChar.
+
+static char *ReadPlainLine(deh_context_t *context)
+{
+    const unsigned char *start, *end, *p;
+    size_t remaining, length;
+    int pos;
+
+    if (context->last_was_newline)
     {
-	fseek(context->stream, context->linestart, SEEK_SET);
+        ++context->linenum;
     }
-    else
-    if (context->type == DEH_INPUT_LUMP)
+
+    if (context->input_buffer_pos >= context->input_buffer_len)
     {
-	context->input_buffer_pos = context->linestart;
+        // end of file
+
+        context->last_was_newline = false;
+        return NULL;
     }
 
-    // [crispy] don't count this line twice
-    --context->linenum;
+    start = context->input_buffer + context->input_buffer_pos;
+    remaining = context->input_buffer_len - context->input_buffer_pos;
+    end = memchr(start, '\n', remaining);
+    length = end != NULL ? (size_t) (end - start) : remaining;
+
+    while ((size_t) context->readbuffer_size <= length)
+    {
+        IncreaseReadBuffer(context);
+    }
+
+    pos = 0;
+
+    for (p = start; p < start + length; ++p)
+    {
+        if (*p == '\0' || (*p == '\r' && end != NULL && p + 1 == end))
+        {
+            continue;
+        }
+
+        context->readbuffer[pos] = (char) *p;
+        ++pos;
+    }
+
+    context->readbuffer[pos] = '\0';
+
+    context->input_buffer_pos += length + (end != NULL);
+    context->last_was_newline = end != NULL;
+
+    return context->readbuffer;
 }
 
 // Read a whole line
@@ -291,6 +314,11 @@ char *DEH_ReadLine(deh_context_t *context, boolean extended)
     int pos;
     boolean escaped = false;
 
+    if (!extended)
+    {
+        return ReadPlainLine(context);
+    }
+
     for (pos = 0;;)
     {
         c = DEH_GetChar(context);
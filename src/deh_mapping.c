@@ -17,6 +17,7 @@
 // name
 //
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,15 +28,57 @@
 
 #include "deh_mapping.h"
 
+static unsigned int MappingHash(const char *name)
+{
+    unsigned int result = 5381;
+
+    while (*name != '\0')
+    {
+        result = result * 33 + toupper((unsigned char) *name);
+        ++name;
+    }
+
+    return result % MAPPING_HASHSIZE;
+}
+
+// Entries go in from the end so that each chain keeps table order and
+// the first of two entries with the same name still wins.
+
+static void HashMapping(deh_mapping_t *mapping)
+{
+    int i, numentries;
+
+    for (numentries = 0; mapping->entries[numentries].name != NULL;
+         ++numentries);
+
+    memset(mapping->hash, 0, sizeof(mapping->hash));
+
+    for (i = numentries - 1; i >= 0; --i)
+    {
+        unsigned int h = MappingHash(mapping->entries[i].name);
+
+        mapping->hashnext[i] = mapping->hash[h];
+        mapping->hash[h] = i + 1;
+    }
+
+    mapping->hashed = true;
+}
+
 static deh_mapping_entry_t *GetMappingEntryByName(deh_context_t *context,
                                                   deh_mapping_t *mapping,
                                                   char *name)
 {
     int i;
 
-    for (i=0; mapping->entries[i].name != NULL; ++i)
+    if (!mapping->hashed)
     {
-        deh_mapping_entry_t *entry = &mapping->entries[i];
+        HashMapping(mapping);
+    }
+
+    for (i = mapping->hash[MappingHash(name)]; i != 0;
+         i = mapping->hashnext[i - 1])
+    {
+        deh_mapping_entry_t *entry = &mapping->entries[i - 1];
 
         if (!strcasecmp(entry->name, name))
         {
@@ -52,6 +52,7 @@
 
 
 #define MAX_MAPPING_ENTRIES 32
+#define MAPPING_HASHSIZE 64
 
 typedef struct deh_mapping_s deh_mapping_t;
 typedef struct deh_mapping_entry_s deh_mapping_entry_t;
@@ -80,6 +81,13 @@ struct deh_mapping_s
 {
     void *base;
     deh_mapping_entry_t entries[MAX_MAPPING_ENTRIES];
+
+    // Field names hashed case-insensitively, built on the first lookup.
+    // Both hold an entry index plus one, so that zero ends a chain.
+
+    boolean hashed;
+    byte hash[MAPPING_HASHSIZE];
+    byte hashnext[MAX_MAPPING_ENTRIES];
 };
 
 boolean DEH_SetMapping(deh_context_t *context, deh_mapping_t *mapping,
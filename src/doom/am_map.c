@@ -18,6 +18,7 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "deh_main.h"
 
@@ -1615,17 +1616,198 @@ static keycolor_t AM_DoorColor(int type)
   return no_key;
 }
 
+// [AP] Per-level linedef cache for AM_drawWalls: every linedef in map
+// coordinates, bucketed into AMCELLSIZE squares, so each frame only the
+// lines near the window are classified and clipped. Colors still come
+// from live state (doors move, lines get mapped), so those aren't cached.
+#define AMCELLSHIFT (10 + MAPBITS) // 1024 map units
+static boolean	amlinecache_valid;
+static mline_t*	amlines;
+static int*	amcellstart;
+static int*	amcelllist;
+static int	amcellsx, amcellsy;
+static int64_t	amcellx0, amcelly0;
+static int*	amlinestamp;
+static int	amstamp;
+static int*	amvisible;
+
+void AM_InvalidateLineCache (void)
+{
+    amlinecache_valid = false;
+}
+
+static void AM_lineCells (const mline_t *ml, int *cx1, int *cy1, int *cx2, int *cy2)
+{
+    *cx1 = (int) ((MIN(ml->a.x, ml->b.x) - amcellx0) >> AMCELLSHIFT);
+    *cx2 = (int) ((MAX(ml->a.x, ml->b.x) - amcellx0) >> AMCELLSHIFT);
+    *cy1 = (int) ((MIN(ml->a.y, ml->b.y) - amcelly0) >> AMCELLSHIFT);
+    *cy2 = (int) ((MAX(ml->a.y, ml->b.y) - amcelly0) >> AMCELLSHIFT);
+}
+
+static void AM_buildLineCache (void)
+{
+    int64_t x1 = INT64_MAX, y1 = INT64_MAX, x2 = INT64_MIN, y2 = INT64_MIN;
+    int *fill;
+    int i, pass;
+
+    amlines = I_Realloc(amlines, (numlines + 1) * sizeof(*amlines));
+    amlinestamp = I_Realloc(amlinestamp, (numlines + 1) * sizeof(*amlinestamp));
+    amvisible = I_Realloc(amvisible, (numlines + 1) * sizeof(*amvisible));
+    memset(amlinestamp, 0, (numlines + 1) * sizeof(*amlinestamp));
+    amstamp = 0;
+
+    for (i = 0; i < numlines; i++)
+    {
+	mline_t *ml = &amlines[i];
+
+	ml->a.x = lines[i].v1->x >> FRACTOMAPBITS;
+	ml->a.y = lines[i].v1->y >> FRACTOMAPBITS;
+	ml->b.x = lines[i].v2->x >> FRACTOMAPBITS;
+	ml->b.y = lines[i].v2->y >> FRACTOMAPBITS;
+
+	x1 = MIN(x1, MIN(ml->a.x, ml->b.x));
+	y1 = MIN(y1, MIN(ml->a.y, ml->b.y));
+	x2 = MAX(x2, MAX(ml->a.x, ml->b.x));
+	y2 = MAX(y2, MAX(ml->a.y, ml->b.y));
+    }
+
+    if (!numlines)
+	x1 = y1 = x2 = y2 = 0;
+
+    amcellx0 = x1;
+    amcelly0 = y1;
+    amcellsx = (int) ((x2 - x1) >> AMCELLSHIFT) + 1;
+    amcellsy = (int) ((y2 - y1) >> AMCELLSHIFT) + 1;
+
+    amcellstart = I_Realloc(amcellstart, (amcellsx * amcellsy + 1) * sizeof(*amcellstart));
+    fill = calloc(amcellsx * amcellsy, sizeof(*fill));
+
+    // count, then fill, keeping each cell in linedef order
+    for (pass = 0; pass < 2; pass++)
+    {
+	for (i = 0; i < numlines; i++)
+	{
+	    int cx, cy, cx1, cy1, cx2, cy2;
+
+	    AM_lineCells(&amlines[i], &cx1, &cy1, &cx2, &cy2);
+	    for (cy = cy1; cy <= cy2; cy++)
+		for (cx = cx1; cx <= cx2; cx++)
+		{
+		    if (pass)
+			amcelllist[fill[cy * amcellsx + cx]++] = i;
+		    else
+			fill[cy * amcellsx + cx]++;
+		}
+	}
+
+	if (!pass)
+	{
+	    int total = 0;
+
+	    for (i = 0; i < amcellsx * amcellsy; i++)
+	    {
+		amcellstart[i] = total;
+		total += fill[i];
+		fill[i] = amcellstart[i];
+	    }
+	    amcellstart[i] = total;
+	    amcelllist = I_Realloc(amcelllist, (total + 1) * sizeof(*amcelllist));
+	}
+    }
+
+    free(fill);
+    amlinecache_valid = true;
+}
+
+static int AM_cmpLines (const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+// Fills amvisible with the linedefs that may cross the window, in
+// linedef order like the full walk, and returns how many there are.
+static int AM_cullLines (void)
+{
+    int64_t x1, y1, x2, y2;
+    int cx1, cy1, cx2, cy2, cx, cy;
+    int count = 0;
+
+    if (!amlinecache_valid)
+	AM_buildLineCache();
+
+    if (crispy->automaprotate)
+    {
+	// anything that rotates into the window is within this
+	// distance of the center it rotates around
+	const int64_t r = m_w / 2 + m_h / 2 + 1;
+
+	x1 = mapcenter.x - r;
+	x2 = mapcenter.x + r;
+	y1 = mapcenter.y - r;
+	y2 = mapcenter.y + r;
+    }
+    else
+    {
+	x1 = m_x;
+	x2 = m_x2;
+	y1 = m_y;
+	y2 = m_y2;
+    }
+
+    cx1 = (int) MAX(0, (x1 - amcellx0) >> AMCELLSHIFT);
+    cy1 = (int) MAX(0, (y1 - amcelly0) >> AMCELLSHIFT);
+    cx2 = (int) MIN(amcellsx - 1, (x2 - amcellx0) >> AMCELLSHIFT);
+    cy2 = (int) MIN(amcellsy - 1, (y2 - amcelly0) >> AMCELLSHIFT);
+
+    amstamp++;
+
+    for (cy = cy1; cy <= cy2; cy++)
+	for (cx = cx1; cx <= cx2; cx++)
+	{
+	    const int cell = cy * amcellsx + cx;
+	    int j;
+
+	    for (j = amcellstart[cell]; j < amcellstart[cell + 1]; j++)
+	    {
+		const int i = amcelllist[j];
+
+		if (amlinestamp[i] != amstamp)
+		{
+		    amlinestamp[i] = amstamp;
+		    amvisible[count++] = i;
+		}
+	    }
+	}
+
+    // put them back in linedef order, so overlapping lines draw the same
+    if (count * 8 > numlines)
+    {
+	int i;
+
+	count = 0;
+	for (i = 0; i < numlines; i++)
+	    if (amlinestamp[i] == amstamp)
+		amvisible[count++] = i;
+    }
+    else
+    {
+	qsort(amvisible, count, sizeof(*amvisible), AM_cmpLines);
+    }
+
+    return count;
+}
+
 void AM_drawWalls(void)
 {
-    int i;
+    int i, j, count;
     static mline_t l;
 
-    for (i=0;i<numlines;i++)
+    count = AM_cullLines();
+
+    for (j=0;j<count;j++)
     {
-	l.a.x = lines[i].v1->x >> FRACTOMAPBITS;
-	l.a.y = lines[i].v1->y >> FRACTOMAPBITS;
-	l.b.x = lines[i].v2->x >> FRACTOMAPBITS;
-	l.b.y = lines[i].v2->y >> FRACTOMAPBITS;
+	i = amvisible[j];
+	l = amlines[i];
 	if (crispy->automaprotate)
 	{
 	    AM_rotatePoint(&l.a);
@@ -2072,44 +2254,84 @@ void AM_drawMarks(void)
 }
 
 
+// [AP] Remaining AP items of the current level, in spawn order. Built once
+// the level's things are spawned and shrunk as they get picked up, so
+// drawing doesn't walk every sector's things each frame.
+typedef struct
+{
+    int64_t x, y; // Map coordinates
+    int index; // Thing index, as passed to apdoom_check_location
+} amlocation_t;
+
+static amlocation_t*	amlocations;
+static int	numamlocations;
+static int	maxamlocations;
+
+void AM_BuildLocations (void)
+{
+    mobj_t*	t;
+    int		i;
+
+    numamlocations = 0;
+
+    for (i = 0; i < numsectors; i++)
+    {
+        for (t = sectors[i].thinglist; t; t = t->snext)
+        {
+            if (t->info->doomednum != 20000 && t->info->doomednum != 20001)
+                continue;
+
+            if (numamlocations == maxamlocations)
+            {
+                maxamlocations = maxamlocations ? maxamlocations * 2 : 64;
+                amlocations = I_Realloc(amlocations, maxamlocations * sizeof(*amlocations));
+            }
+
+            amlocations[numamlocations].x = t->x >> FRACTOMAPBITS;
+            amlocations[numamlocations].y = t->y >> FRACTOMAPBITS;
+            amlocations[numamlocations].index = t->index;
+            numamlocations++;
+        }
+    }
+}
+
+void AM_RemoveLocation (int index)
+{
+    int i;
+
+    for (i = 0; i < numamlocations; i++)
+    {
+        if (amlocations[i].index == index)
+        {
+            numamlocations--;
+            memmove(&amlocations[i], &amlocations[i + 1],
+                    (numamlocations - i) * sizeof(*amlocations));
+            return;
+        }
+    }
+}
+
 void AM_drawLocations(void)
 {
     int		i, fx, fy;
     int w = 6;
     int h = 6;
-    mobj_t*	t;
     mpoint_t	pt;
 
-    for (i=0;i<numsectors;i++)
+    for (i = 0; i < numamlocations; i++)
     {
-	    t = sectors[i].thinglist;
-        while (t)
-	    {
+        pt.x = amlocations[i].x;
+        pt.y = amlocations[i].y;
 
-            // [crispy] skull keys and key cards
-            switch (t->info->doomednum)
-            {
-                case 20000:
-                case 20001:
-                {
-	                pt.x = t->x >> FRACTOMAPBITS;
-	                pt.y = t->y >> FRACTOMAPBITS;
-
-	                if (crispy->automaprotate)
-	                {
-		                AM_rotatePoint(&pt);
-	                }
-
-	                fx = (flipscreenwidth[CXMTOF(pt.x)] >> crispy->hires) - 1 - WIDESCREENDELTA;
-	                fy = (CYMTOF(pt.y) >> crispy->hires) - 2;
-	                if (fx >= f_x && fx <= (f_w >> crispy->hires) - w && fy >= f_y && fy <= (f_h >> crispy->hires) - h)
-                        V_DrawPatch(fx, fy, amap);
-
-	                break;
-                }
-            }
-	        t = t->snext;
+        if (crispy->automaprotate)
+        {
+            AM_rotatePoint(&pt);
         }
+
+        fx = (flipscreenwidth[CXMTOF(pt.x)] >> crispy->hires) - 1 - WIDESCREENDELTA;
+        fy = (CYMTOF(pt.y) >> crispy->hires) - 2;
+        if (fx >= f_x && fx <= (f_w >> crispy->hires) - w && fy >= f_y && fy <= (f_h >> crispy->hires) - h)
+            V_DrawPatch(fx, fy, amap);
     }
 }
 
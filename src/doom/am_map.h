@@ -45,6 +45,16 @@ void AM_Stop (void);
 // [crispy] re-init in G_Responder on toggling spy mode (F12)
 void AM_initVariables (void);
 
+// [AP] Called when a level is loaded, the linedef cache is rebuilt on the
+// next draw
+void AM_InvalidateLineCache (void);
+
+// [AP] Collects the level's AP item markers, once its things are spawned
+void AM_BuildLocations (void);
+
+// [AP] Drops the marker of a picked up AP item
+void AM_RemoveLocation (int index);
+
 extern cheatseq_t cheat_amap;
 
 
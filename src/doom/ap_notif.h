@@ -1,6 +1,7 @@
 #ifndef __APNOTIF_H__
 #define __APNOTIF_H__
 
+void ap_notif_precache(void);
 void ap_notif_draw(void);
 
 #endif
@@ -0,0 +1,1175 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Demo benchmark.
+//
+//	The demo is played as with -timedemo, with SDL's dummy video and
+//	audio drivers so that no window or sound device is needed, and
+//	without Archipelago. The frame profiler does the timing; every
+//	frame's numbers are kept, so the percentiles are over the whole
+//	run rather than the profiler's last 256 frames.
+//
+//	-simbench runs only the game tics, back to back, with no frames in
+//	between. Each run ends with a checksum of the game state, which
+//	should be the same every time, and in every build that keeps demo
+//	sync.
+//
+//	-renderbench renders the views that -recordviews wrote down, one
+//	after the other, without running the game at all. Along with the
+//	usual summary it lists the most expensive views, and a heatmap of
+//	the average cost over a grid laid on each map.
+//
+//	-microbench, which is what crispy-bench runs, times single engine
+//	functions instead; see d_microbench.c.
+//
+//	-bench-sync writes a checksum after every game tic, and a hash of
+//	every frame, so that -bench-syncref can tell in which tic or frame
+//	another build or configuration first differs. check-demo-sync.sh
+//	runs a set of demos that way.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crispy.h"
+#include "doomstat.h"
+#include "d_bench.h"
+#include "d_microbench.h"
+#include "g_game.h"
+#include "p_local.h"
+#include "i_profile.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "i_video.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "m_random.h"
+#include "r_main.h"
+#include "r_views.h"
+#include "sha1.h"
+#include "z_zone.h"
+
+// Per frame: each phase, then the whole frame
+#define FRAMESIZE (NUMPROFILEPHASES + 1)
+
+typedef struct
+{
+    unsigned int *frames;
+    int numframes;
+    int maxframes;
+    boolean started;
+    int starttic;
+    int tics;
+    int starttime_ms;
+    int time_ms;
+    char checksum[sizeof(sha1_digest_t) * 2 + 1];
+} iteration_t;
+
+typedef struct
+{
+    double min, avg, p50, p90, p99, max;
+} timesummary_t;
+
+typedef char synchash_t[sizeof(sha1_digest_t) * 2 + 1];
+
+// The reference's checksums, in order, and how many of ours differ
+typedef struct
+{
+    const char *name;
+    synchash_t *hashes;
+    int num;
+    int max;
+    int next;               // This iteration
+    int checked;
+    int differ;
+    int first;
+} syncstream_t;
+
+// -renderbench heatmap grid: 256 map units
+#define HEATCELLSHIFT 8
+#define HEATCELLSIZE (1 << HEATCELLSHIFT)
+#define TOPVIEWS 10
+
+typedef struct
+{
+    int episode, map;
+    int x, y;
+    int views;
+    double avg_us;
+    unsigned int max_us;
+} heatcell_t;
+
+boolean benchmark = false;
+boolean simbench = false;
+boolean renderbench = false;
+boolean microbench = false;
+
+static const char *bench_demo;
+static const char *bench_out;
+static int bench_hires = -1;
+static boolean bench_window;
+
+static iteration_t *iterations;
+static int numiterations = 1;
+static int current;
+
+static FILE *sync_out;
+static const char *sync_ref;
+static syncstream_t sync_tics = {"tic"};
+static syncstream_t sync_frames = {"frame"};
+static int sync_lastframetic = -1;
+
+static rview_t *views;
+static int numviews;
+static unsigned int *view_us;   // Averaged over the iterations
+static heatcell_t *cells;
+static int numcells;
+
+static void AddSyncHash(syncstream_t *s, const char *hash)
+{
+    if (s->num == s->max)
+    {
+        s->max = s->max ? s->max * 2 : 4096;
+        s->hashes = I_Realloc(s->hashes, s->max * sizeof(*s->hashes));
+    }
+
+    M_StringCopy(s->hashes[s->num++], hash, sizeof(synchash_t));
+}
+
+static void LoadSyncReference(const char *filename)
+{
+    char line[128];
+    char kind[16];
+    synchash_t hash;
+    int n;
+    FILE *f;
+
+    f = M_fopen(filename, "r");
+
+    if (f == NULL)
+    {
+        I_Error("D_BenchmarkInit: Unable to read %s", filename);
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "%15s %d %40s", kind, &n, hash) != 3)
+        {
+            continue;
+        }
+
+        if (!strcmp(kind, sync_tics.name))
+        {
+            AddSyncHash(&sync_tics, hash);
+        }
+        else if (!strcmp(kind, sync_frames.name))
+        {
+            AddSyncHash(&sync_frames, hash);
+        }
+    }
+
+    fclose(f);
+}
+
+const char *D_BenchmarkInit(void)
+{
+    int p;
+
+    //!
+    // @arg <demo>
+    // @category demo
+    //
+    // Play back the demo named demo.lmp as fast as possible, without a
+    // window or sound device, and print how long the frames, game tics
+    // and each part of them took, along with peak memory use. Nothing
+    // is sent to Archipelago and the configuration is left alone.
+    //
+
+    p = M_CheckParmWithArgs("-benchmark", 1);
+
+    if (p == 0)
+    {
+        //!
+        // @arg <demo>
+        // @category demo
+        //
+        // As -benchmark, but run only the game tics, as fast as they
+        // go, without drawing anything or playing sound. Prints the
+        // tics per second and a checksum of the game state at the end
+        // of the demo, for checking demo sync. Takes the same -bench
+        // parameters.
+        //
+
+        p = M_CheckParmWithArgs("-simbench", 1);
+
+        if (p > 0)
+        {
+            simbench = true;
+        }
+        else
+        {
+            //!
+            // @arg <file>
+            // @category demo
+            //
+            // As -benchmark, but render the views in a -recordviews
+            // file, without running the game. Prints how long each
+            // view took, the most expensive ones, and which parts of
+            // each map cost the most to draw. Takes the same -bench
+            // parameters.
+            //
+
+            p = M_CheckParmWithArgs("-renderbench", 1);
+
+            if (p > 0)
+            {
+                renderbench = true;
+            }
+            else
+            {
+                //!
+                // @category demo
+                //
+                // Time the renderer's drawers, V_DrawPatch, fixed point
+                // math, line traces and sight checks, WAD lookups, zone
+                // allocation, savegame writing, ticcmd packing, OPL
+                // synthesis and the Archipelago lookups, one by one, on
+                // the -warp level. crispy-bench runs this. Takes
+                // -bench-out and -bench-iterations, which counts rounds
+                // and defaults to 5 here.
+                //
+
+                if (!M_ParmExists("-microbench"))
+                {
+                    return NULL;
+                }
+
+                microbench = true;
+                numiterations = 5;
+            }
+        }
+    }
+
+    bench_demo = microbench ? "microbench" : myargv[p + 1];
+
+    //!
+    // @arg <file>
+    // @category demo
+    //
+    // With -benchmark, also write the results to a JSON file.
+    //
+
+    p = M_CheckParmWithArgs("-bench-out", 1);
+
+    if (p > 0)
+    {
+        bench_out = myargv[p + 1];
+    }
+
+    //!
+    // @arg <n>
+    // @category demo
+    //
+    // With -benchmark, play the demo n times, reporting each run.
+    //
+
+    p = M_CheckParmWithArgs("-bench-iterations", 1);
+
+    if (p > 0)
+    {
+        numiterations = atoi(myargv[p + 1]);
+
+        if (numiterations < 1)
+        {
+            I_Error("D_BenchmarkInit: -bench-iterations must be at least 1");
+        }
+    }
+
+    //!
+    // @arg <0|1>
+    // @category demo
+    //
+    // With -benchmark, render at 320x200 (0) or 640x400 (1) instead of
+    // the configured resolution.
+    //
+
+    p = M_CheckParmWithArgs("-bench-hires", 1);
+
+    if (p > 0)
+    {
+        bench_hires = atoi(myargv[p + 1]) != 0;
+    }
+
+    //!
+    // @category demo
+    //
+    // With -benchmark, show the window and play the sound, so that the
+    // times include presenting frames to the real display.
+    //
+
+    bench_window = M_ParmExists("-bench-window");
+
+    //!
+    // @arg <file>
+    // @category demo
+    //
+    // With -benchmark, -simbench or -renderbench, write a checksum of
+    // the game state after every tic and a hash of every frame to the
+    // file, for -bench-syncref. Only the first run is written.
+    //
+
+    p = M_CheckParmWithArgs("-bench-sync", 1);
+
+    if (p > 0)
+    {
+        sync_out = M_fopen(myargv[p + 1], "w");
+
+        if (sync_out == NULL)
+        {
+            I_Error("D_BenchmarkInit: Unable to write %s", myargv[p + 1]);
+        }
+    }
+
+    //!
+    // @arg <file>
+    // @category demo
+    //
+    // With -benchmark, -simbench or -renderbench, compare every tic and
+    // frame with a -bench-sync file, written by a reference build or
+    // configuration. Prints the first ones that differ, and exits with
+    // an error if any do.
+    //
+
+    p = M_CheckParmWithArgs("-bench-syncref", 1);
+
+    if (p > 0)
+    {
+        sync_ref = myargv[p + 1];
+        LoadSyncReference(sync_ref);
+    }
+
+    iterations = calloc(numiterations, sizeof(*iterations));
+
+    if (iterations == NULL)
+    {
+        I_Error("D_BenchmarkInit: Out of memory");
+    }
+
+    benchmark = true;
+    profiling = true;
+
+    return bench_demo;
+}
+
+void D_BenchmarkDefaults(void)
+{
+    if (!benchmark)
+    {
+        return;
+    }
+
+    if (!bench_window)
+    {
+        video_driver = M_StringDuplicate("dummy");
+
+        if (getenv("SDL_AUDIODRIVER") == NULL)
+        {
+            putenv("SDL_AUDIODRIVER=dummy");
+        }
+    }
+
+    if (bench_hires >= 0)
+    {
+        crispy->hires = bench_hires;
+    }
+
+    fullscreen = false;
+    crispy->vsync = false;
+
+    // Interpolated frames depend on the real time
+    if (sync_out != NULL || sync_ref != NULL)
+    {
+        crispy->uncapped = false;
+    }
+}
+
+static void DigestString(sha1_digest_t digest, char *out)
+{
+    int i;
+
+    for (i = 0; i < (int) sizeof(sha1_digest_t); ++i)
+    {
+        M_snprintf(out + i * 2, 3, "%02x", digest[i]);
+    }
+}
+
+// Writes down or checks the next tic or frame of this iteration
+static void SyncHash(syncstream_t *s, const char *hash)
+{
+    int n = s->next++;
+
+    if (sync_out != NULL && current == 0)
+    {
+        fprintf(sync_out, "%s %d %s\n", s->name, n, hash);
+    }
+
+    if (sync_ref == NULL)
+    {
+        return;
+    }
+
+    s->checked++;
+
+    if (n >= s->num || strcmp(s->hashes[n], hash))
+    {
+        if (s->differ == 0)
+        {
+            s->first = n;
+        }
+
+        s->differ++;
+    }
+}
+
+static void HashFrame(void)
+{
+    sha1_context_t sha1;
+    sha1_digest_t digest;
+    synchash_t hash;
+
+    SHA1_Init(&sha1);
+    SHA1_Update(&sha1, (byte *) I_VideoBuffer,
+                SCREENWIDTH * SCREENHEIGHT * sizeof(*I_VideoBuffer));
+    SHA1_Final(digest, &sha1);
+    DigestString(digest, hash);
+    SyncHash(&sync_frames, hash);
+}
+
+// Keeps the profiler's last frame. Returns it, to be overridden.
+static unsigned int *AddFrame(iteration_t *it)
+{
+    unsigned int *frame;
+
+    if (it->numframes == it->maxframes)
+    {
+        it->maxframes = it->maxframes ? it->maxframes * 2 : 4096;
+        it->frames = I_Realloc(it->frames,
+                               it->maxframes * FRAMESIZE * sizeof(*it->frames));
+    }
+
+    frame = it->frames + it->numframes * FRAMESIZE;
+    frame[NUMPROFILEPHASES] = I_ProfileLastFrame(frame);
+    it->numframes++;
+
+    return frame;
+}
+
+void D_BenchmarkFrame(void)
+{
+    iteration_t *it;
+
+    if (!benchmark || !demoplayback)
+    {
+        return;
+    }
+
+    it = &iterations[current];
+
+    // Timing starts after the frame that loaded the demo's level
+    if (!it->started)
+    {
+        it->started = true;
+        it->starttic = gametic;
+        it->starttime_ms = I_GetTimeMS();
+        return;
+    }
+
+    AddFrame(it);
+
+    // Wipe frames depend on the real time, and don't run tics
+    if ((sync_out != NULL || sync_ref != NULL) && gametic != sync_lastframetic)
+    {
+        sync_lastframetic = gametic;
+        HashFrame();
+    }
+}
+
+static void ChecksumInt(sha1_context_t *sha1, int value)
+{
+    SHA1_UpdateInt32(sha1, (unsigned int) value);
+}
+
+// Everything about the level and its things that demo sync depends on
+static void Checksum(char *out)
+{
+    sha1_context_t sha1;
+    sha1_digest_t digest;
+    thinker_t *th;
+    int i, j;
+
+    SHA1_Init(&sha1);
+
+    ChecksumInt(&sha1, gameepisode);
+    ChecksumInt(&sha1, gamemap);
+    ChecksumInt(&sha1, leveltime);
+    ChecksumInt(&sha1, prndindex);
+    ChecksumInt(&sha1, rndindex);
+
+    for (i = 0; i < MAXPLAYERS; ++i)
+    {
+        player_t *player = &players[i];
+
+        if (!playeringame[i])
+        {
+            continue;
+        }
+
+        ChecksumInt(&sha1, player->playerstate);
+        ChecksumInt(&sha1, player->health);
+        ChecksumInt(&sha1, player->armorpoints);
+        ChecksumInt(&sha1, player->readyweapon);
+        ChecksumInt(&sha1, player->killcount);
+        ChecksumInt(&sha1, player->itemcount);
+        ChecksumInt(&sha1, player->secretcount);
+
+        for (j = 0; j < NUMAMMO; ++j)
+        {
+            ChecksumInt(&sha1, player->ammo[j]);
+        }
+    }
+
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj];
+         th = th->cnext)
+    {
+        mobj_t *mo = (mobj_t *) th;
+
+        if (th->function.acp1 != (actionf_p1) P_MobjThinker)
+        {
+            continue;
+        }
+
+        ChecksumInt(&sha1, mo->type);
+        ChecksumInt(&sha1, mo->x);
+        ChecksumInt(&sha1, mo->y);
+        ChecksumInt(&sha1, mo->z);
+        ChecksumInt(&sha1, mo->angle);
+        ChecksumInt(&sha1, mo->momx);
+        ChecksumInt(&sha1, mo->momy);
+        ChecksumInt(&sha1, mo->momz);
+        ChecksumInt(&sha1, mo->health);
+        ChecksumInt(&sha1, mo->flags);
+        ChecksumInt(&sha1, mo->tics);
+        ChecksumInt(&sha1, mo->state ? (int) (mo->state - states) : -1);
+    }
+
+    SHA1_Final(digest, &sha1);
+    DigestString(digest, out);
+}
+
+void D_BenchmarkTic(void)
+{
+    synchash_t hash;
+
+    if (!benchmark || !demoplayback || (sync_out == NULL && sync_ref == NULL))
+    {
+        return;
+    }
+
+    Checksum(hash);
+    SyncHash(&sync_tics, hash);
+}
+
+static int CompareTimes(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *) a;
+    unsigned int y = *(const unsigned int *) b;
+
+    return (x > y) - (x < y);
+}
+
+// Summarizes n times in microseconds, in milliseconds. Sorts times.
+static void SummarizeTimes(unsigned int *times, int n, timesummary_t *s)
+{
+    double total = 0;
+    int i;
+
+    memset(s, 0, sizeof(*s));
+
+    if (n == 0)
+    {
+        return;
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        total += times[i];
+    }
+
+    qsort(times, n, sizeof(*times), CompareTimes);
+
+    s->min = times[0] / 1000.0;
+    s->avg = total / n / 1000.0;
+    s->p50 = times[n / 2] / 1000.0;
+    s->p90 = times[(n * 90) / 100] / 1000.0;
+    s->p99 = times[(n * 99) / 100] / 1000.0;
+    s->max = times[n - 1] / 1000.0;
+}
+
+// Summarizes column column of the iteration's frames.
+static void Summarize(iteration_t *it, int column, timesummary_t *s)
+{
+    unsigned int *times;
+    int i, n = it->numframes;
+
+    memset(s, 0, sizeof(*s));
+
+    times = malloc((n ? n : 1) * sizeof(*times));
+
+    if (times == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        times[i] = it->frames[i * FRAMESIZE + column];
+    }
+
+    SummarizeTimes(times, n, s);
+    free(times);
+}
+
+static void PrintSummary(const char *name, timesummary_t *s)
+{
+    printf("  %-8s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f\n", name,
+           s->min, s->avg, s->p50, s->p90, s->p99, s->max);
+}
+
+static void WriteSummary(FILE *f, int indent, const char *name,
+                         timesummary_t *s, boolean last)
+{
+    fprintf(f, "%*s\"%s\": {\"min\": %.3f, \"avg\": %.3f, "
+               "\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+               "\"max\": %.3f}%s\n",
+            indent, "", name, s->min, s->avg, s->p50, s->p90, s->p99, s->max,
+            last ? "" : ",");
+}
+
+static void MapName(char *buf, size_t buf_len, int episode, int map)
+{
+    if (gamemode == commercial)
+    {
+        M_snprintf(buf, buf_len, "MAP%02d", map);
+    }
+    else
+    {
+        M_snprintf(buf, buf_len, "E%dM%d", episode, map);
+    }
+}
+
+static int ViewCell(fixed_t coord)
+{
+    return (coord >> FRACBITS) >> HEATCELLSHIFT;
+}
+
+static int CompareViewCells(const void *a, const void *b)
+{
+    const rview_t *x = &views[*(const int *) a];
+    const rview_t *y = &views[*(const int *) b];
+
+    if (x->episode != y->episode)
+    {
+        return x->episode - y->episode;
+    }
+    if (x->map != y->map)
+    {
+        return x->map - y->map;
+    }
+    if (ViewCell(x->x) != ViewCell(y->x))
+    {
+        return ViewCell(x->x) - ViewCell(y->x);
+    }
+
+    return ViewCell(x->y) - ViewCell(y->y);
+}
+
+// Most expensive first
+static int CompareViewCosts(const void *a, const void *b)
+{
+    unsigned int x = view_us[*(const int *) a];
+    unsigned int y = view_us[*(const int *) b];
+
+    return (x < y) - (x > y);
+}
+
+static int CompareCellCosts(const void *a, const void *b)
+{
+    double x = ((const heatcell_t *) a)->avg_us;
+    double y = ((const heatcell_t *) b)->avg_us;
+
+    return (x < y) - (x > y);
+}
+
+// Groups the views by map and grid cell, most expensive cells first.
+static void BuildHeatmap(void)
+{
+    int *order;
+    heatcell_t *cell;
+    int i;
+
+    order = malloc((numviews ? numviews : 1) * sizeof(*order));
+    cells = malloc((numviews ? numviews : 1) * sizeof(*cells));
+
+    if (order == NULL || cells == NULL)
+    {
+        I_Error("D_Benchmark: Out of memory");
+    }
+
+    for (i = 0; i < numviews; ++i)
+    {
+        order[i] = i;
+    }
+
+    qsort(order, numviews, sizeof(*order), CompareViewCells);
+
+    numcells = 0;
+
+    for (i = 0; i < numviews; ++i)
+    {
+        const rview_t *view = &views[order[i]];
+        unsigned int us = view_us[order[i]];
+
+        if (i == 0 || CompareViewCells(&order[i - 1], &order[i]) != 0)
+        {
+            cell = &cells[numcells++];
+            cell->episode = view->episode;
+            cell->map = view->map;
+            cell->x = ViewCell(view->x) * HEATCELLSIZE;
+            cell->y = ViewCell(view->y) * HEATCELLSIZE;
+            cell->views = 0;
+            cell->avg_us = 0;
+            cell->max_us = 0;
+        }
+
+        cell->views++;
+        cell->avg_us += us;
+
+        if (us > cell->max_us)
+        {
+            cell->max_us = us;
+        }
+    }
+
+    for (i = 0; i < numcells; ++i)
+    {
+        cells[i].avg_us /= cells[i].views;
+    }
+
+    qsort(cells, numcells, sizeof(*cells), CompareCellCosts);
+    free(order);
+}
+
+static void PrintRenderResults(void)
+{
+    char name[16];
+    int *order;
+    int i;
+
+    order = malloc((numviews ? numviews : 1) * sizeof(*order));
+
+    if (order == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < numviews; ++i)
+    {
+        order[i] = i;
+    }
+
+    qsort(order, numviews, sizeof(*order), CompareViewCosts);
+
+    printf("Most expensive views:\n");
+    printf("  %6s %-6s %6s %6s %5s %8s\n",
+           "view", "map", "x", "y", "angle", "ms");
+
+    for (i = 0; i < numviews && i < TOPVIEWS; ++i)
+    {
+        const rview_t *view = &views[order[i]];
+
+        MapName(name, sizeof(name), view->episode, view->map);
+        printf("  %6d %-6s %6d %6d %5d %8.3f\n", order[i], name,
+               view->x >> FRACBITS, view->y >> FRACBITS,
+               (int) (((unsigned long long) view->angle * 360) >> 32),
+               view_us[order[i]] / 1000.0);
+    }
+
+    printf("Most expensive %dx%d areas:\n", HEATCELLSIZE, HEATCELLSIZE);
+    printf("  %-6s %6s %6s %6s %8s %8s\n",
+           "map", "x", "y", "views", "avg", "max");
+
+    for (i = 0; i < numcells && i < TOPVIEWS; ++i)
+    {
+        const heatcell_t *cell = &cells[i];
+
+        MapName(name, sizeof(name), cell->episode, cell->map);
+        printf("  %-6s %6d %6d %6d %8.3f %8.3f\n", name, cell->x, cell->y,
+               cell->views, cell->avg_us / 1000.0, cell->max_us / 1000.0);
+    }
+
+    free(order);
+}
+
+static void WriteRenderResults(FILE *f)
+{
+    char name[16];
+    int i;
+
+    fprintf(f, "  \"views_ms\": [");
+
+    for (i = 0; i < numviews; ++i)
+    {
+        fprintf(f, "%s%.3f", i == 0 ? "" : ", ", view_us[i] / 1000.0);
+    }
+
+    fprintf(f, "],\n  \"heatmap\": {\n    \"cell_size\": %d,\n"
+               "    \"cells\": [\n", HEATCELLSIZE);
+
+    for (i = 0; i < numcells; ++i)
+    {
+        const heatcell_t *cell = &cells[i];
+
+        MapName(name, sizeof(name), cell->episode, cell->map);
+        fprintf(f, "      {\"map\": \"%s\", \"x\": %d, \"y\": %d, "
+                   "\"views\": %d, \"avg_ms\": %.3f, \"max_ms\": %.3f}%s\n",
+                name, cell->x, cell->y, cell->views, cell->avg_us / 1000.0,
+                cell->max_us / 1000.0, i == numcells - 1 ? "" : ",");
+    }
+
+    fprintf(f, "    ]\n  }\n");
+}
+
+static double IterationFPS(iteration_t *it)
+{
+    return it->time_ms > 0 ? it->numframes * 1000.0 / it->time_ms : 0.0;
+}
+
+static double IterationTicsPerSecond(iteration_t *it)
+{
+    return it->time_ms > 0 ? it->tics * 1000.0 / it->time_ms : 0.0;
+}
+
+static void PrintResults(void)
+{
+    timesummary_t s;
+    int i, j;
+
+    for (i = 0; i < numiterations; ++i)
+    {
+        iteration_t *it = &iterations[i];
+
+        if (simbench)
+        {
+            printf("Benchmark %d/%d: %d tics in %.3f s, %.1f tics/s\n",
+                   i + 1, numiterations, it->tics, it->time_ms / 1000.0,
+                   IterationTicsPerSecond(it));
+        }
+        else if (renderbench)
+        {
+            printf("Benchmark %d/%d: %d views in %.3f s, %.1f views/s\n",
+                   i + 1, numiterations, it->numframes, it->time_ms / 1000.0,
+                   IterationFPS(it));
+        }
+        else
+        {
+            printf("Benchmark %d/%d: %d frames, %d tics in %.3f s, "
+                   "%.1f fps\n", i + 1, numiterations, it->numframes,
+                   it->tics, it->time_ms / 1000.0, IterationFPS(it));
+        }
+
+        if (!renderbench)
+        {
+            printf("  Checksum %s\n", it->checksum);
+        }
+
+        printf("  %-8s %8s %8s %8s %8s %8s %8s\n", "ms",
+               "min", "avg", "p50", "p90", "p99", "max");
+
+        Summarize(it, NUMPROFILEPHASES, &s);
+        PrintSummary(simbench ? "TIC" : renderbench ? "VIEW" : "FRAME", &s);
+
+        // -simbench has nothing for most of them
+        for (j = 0; j < NUMPROFILEPHASES; ++j)
+        {
+            Summarize(it, j, &s);
+
+            if (s.max > 0)
+            {
+                PrintSummary(I_ProfilePhaseName(j), &s);
+            }
+        }
+    }
+
+    if (renderbench)
+    {
+        PrintRenderResults();
+    }
+
+    printf("Peak memory: zone %lu KiB, process %lu KiB\n",
+           (unsigned long) (Z_PeakUsage() / 1024),
+           (unsigned long) (I_PeakMemoryUsage() / 1024));
+}
+
+static void WriteResults(const char *filename)
+{
+    timesummary_t s;
+    FILE *f;
+    int i, j;
+
+    f = M_fopen(filename, "w");
+
+    if (f == NULL)
+    {
+        fprintf(stderr, "D_Benchmark: Unable to write %s\n", filename);
+        return;
+    }
+
+    fprintf(f, "{\n  \"mode\": \"%s\",\n  \"demo\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n"
+               "  \"zone_peak_bytes\": %lu,\n  \"process_peak_bytes\": %lu,\n"
+               "  \"iterations\": [\n",
+            simbench ? "simbench" : renderbench ? "renderbench" : "benchmark",
+            M_BaseName(bench_demo), SCREENWIDTH, SCREENHEIGHT,
+            (unsigned long) Z_PeakUsage(),
+            (unsigned long) I_PeakMemoryUsage());
+
+    for (i = 0; i < numiterations; ++i)
+    {
+        iteration_t *it = &iterations[i];
+
+        fprintf(f, "    {\n      \"frames\": %d,\n      \"tics\": %d,\n"
+                   "      \"seconds\": %.3f,\n      \"fps\": %.2f,\n"
+                   "      \"tics_per_second\": %.2f,\n"
+                   "      \"checksum\": \"%s\",\n",
+                it->numframes, it->tics, it->time_ms / 1000.0,
+                IterationFPS(it), IterationTicsPerSecond(it), it->checksum);
+
+        // Game tics are the TICKER phase; -timedemo runs one a frame
+        Summarize(it, NUMPROFILEPHASES, &s);
+        WriteSummary(f, 6, "frame_ms", &s, false);
+        Summarize(it, PROFILE_TICKER, &s);
+        WriteSummary(f, 6, "tic_ms", &s, false);
+
+        fprintf(f, "      \"phases_ms\": {\n");
+
+        for (j = 0; j < NUMPROFILEPHASES; ++j)
+        {
+            Summarize(it, j, &s);
+            WriteSummary(f, 8, I_ProfilePhaseName(j), &s,
+                         j == NUMPROFILEPHASES - 1);
+        }
+
+        fprintf(f, "      }\n    }%s\n", i == numiterations - 1 ? "" : ",");
+    }
+
+    fprintf(f, "  ]%s\n", renderbench ? "," : "");
+
+    if (renderbench)
+    {
+        WriteRenderResults(f);
+    }
+
+    fprintf(f, "}\n");
+    fclose(f);
+
+    printf("Benchmark results written to %s\n", filename);
+}
+
+static void PrintSync(syncstream_t *s)
+{
+    if (s->checked == 0)
+    {
+        return;
+    }
+
+    if (s->differ == 0)
+    {
+        printf("Sync: all %d %ss match %s\n", s->checked, s->name, sync_ref);
+    }
+    else
+    {
+        printf("Sync: %d of %d %ss differ from %s, first %s %d\n",
+               s->differ, s->checked, s->name, sync_ref, s->name, s->first);
+    }
+}
+
+static void FinishBenchmark(void) NORETURN;
+
+static void FinishBenchmark(void)
+{
+    PrintResults();
+
+    if (bench_out != NULL)
+    {
+        WriteResults(bench_out);
+    }
+
+    if (sync_out != NULL)
+    {
+        fclose(sync_out);
+        sync_out = NULL;
+    }
+
+    if (sync_ref != NULL)
+    {
+        PrintSync(&sync_tics);
+        PrintSync(&sync_frames);
+
+        if (sync_tics.differ || sync_frames.differ)
+        {
+            I_Error("D_Benchmark: Out of sync with %s", sync_ref);
+        }
+    }
+
+    I_Quit();
+}
+
+boolean D_BenchmarkNextIteration(void)
+{
+    iteration_t *it = &iterations[current];
+
+    it->tics = gametic - it->starttic;
+    it->time_ms = I_GetTimeMS() - it->starttime_ms;
+    Checksum(it->checksum);
+
+    // Each run is checked from the start of the reference again
+    sync_tics.next = 0;
+    sync_frames.next = 0;
+
+    if (++current < numiterations)
+    {
+        return true;
+    }
+
+    FinishBenchmark();
+}
+
+void D_SimBenchmarkLoop(const char *demo)
+{
+    static ticcmd_t cmds[MAXPLAYERS];
+
+    // G_Ticker copies from here before reading the demo over it
+    netcmds = cmds;
+
+    G_TimeDemo((char *) demo);
+
+    while (1)
+    {
+        G_Ticker();
+        gametic++;
+
+        // One profiler frame per tic
+        I_ProfileFrame();
+        D_BenchmarkFrame();
+    }
+}
+
+void D_RenderBenchmarkLoop(void)
+{
+    player_t *player = &players[consoleplayer];
+    uint64_t *totals;
+    int episode = -1, map = -1;
+    int i;
+
+    numviews = R_LoadViews(bench_demo, &views);
+
+    if (numviews == 0)
+    {
+        I_Error("D_RenderBenchmarkLoop: %s has no views", bench_demo);
+    }
+
+    totals = calloc(numviews, sizeof(*totals));
+    view_us = calloc(numviews, sizeof(*view_us));
+
+    if (totals == NULL || view_us == NULL)
+    {
+        I_Error("D_RenderBenchmarkLoop: Out of memory");
+    }
+
+    for (current = 0; current < numiterations; ++current)
+    {
+        iteration_t *it = &iterations[current];
+        int loading_ms = 0;
+
+        it->starttime_ms = I_GetTimeMS();
+
+        for (i = 0; i < numviews; ++i)
+        {
+            uint64_t start;
+            unsigned int *frame;
+
+            if (views[i].episode != episode || views[i].map != map)
+            {
+                int load_start = I_GetTimeMS();
+
+                episode = views[i].episode;
+                map = views[i].map;
+                G_InitNew(startskill, episode, map);
+
+                // Leave the level loading out of the next view
+                I_ProfileFrame();
+                loading_ms += I_GetTimeMS() - load_start;
+            }
+
+            R_SetViewOverride(&views[i]);
+
+            start = I_GetTimeUS();
+            R_RenderPlayerView(player);
+            I_ProfileFrame();
+
+            // Without the time between views
+            frame = AddFrame(it);
+            frame[NUMPROFILEPHASES] = I_GetTimeUS() - start;
+            totals[i] += frame[NUMPROFILEPHASES];
+
+            if (sync_out != NULL || sync_ref != NULL)
+            {
+                HashFrame();
+            }
+        }
+
+        sync_frames.next = 0;
+
+        it->time_ms = I_GetTimeMS() - it->starttime_ms - loading_ms;
+    }
+
+    R_SetViewOverride(NULL);
+
+    for (i = 0; i < numviews; ++i)
+    {
+        view_us[i] = totals[i] / numiterations;
+    }
+
+    free(totals);
+
+    BuildHeatmap();
+    FinishBenchmark();
+}
+
+void D_MicroBenchmarkLoop(void)
+{
+    G_InitNew(startskill, startepisode, startmap);
+    D_MicroBenchmarks(numiterations, bench_out);
+    I_Quit();
+}
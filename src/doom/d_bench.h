@@ -0,0 +1,59 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	-benchmark, -simbench, -renderbench and -microbench: time a demo,
+//	recorded views or engine functions without a window, for comparing
+//	builds and machines.
+//
+
+#ifndef __D_BENCH__
+#define __D_BENCH__
+
+#include "doomtype.h"
+
+// Set for the other modes as well.
+extern boolean benchmark;
+extern boolean simbench;
+extern boolean renderbench;
+extern boolean microbench;
+
+// Reads the benchmark parameters. Returns the demo or views file, or
+// NULL if there is no benchmark to run.
+const char *D_BenchmarkInit(void);
+
+// Overrides the loaded configuration for an unattended run.
+void D_BenchmarkDefaults(void);
+
+// Call after I_ProfileFrame.
+void D_BenchmarkFrame(void);
+
+// Call after each P_Ticker, for -bench-sync.
+void D_BenchmarkTic(void);
+
+// Plays the -simbench demo. Never returns.
+void D_SimBenchmarkLoop(const char *demo) NORETURN;
+
+// Renders the -renderbench views. Call once the renderer is set up.
+// Never returns.
+void D_RenderBenchmarkLoop(void) NORETURN;
+
+// Loads the -warp level and runs the microbenchmarks. Call once the
+// renderer is set up. Never returns.
+void D_MicroBenchmarkLoop(void) NORETURN;
+
+// Call at the end of the demo. Returns true if it should be played
+// again; otherwise writes the results and quits.
+boolean D_BenchmarkNextIteration(void);
+
+#endif
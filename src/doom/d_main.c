@@ -34,6 +34,7 @@
 #include "dstrings.h"
 #include "sounds.h"
 
+#include "d_bench.h" // [AP]
 #include "d_iwad.h"
 #include "d_pwad.h" // [crispy] D_Load{Sigil,Nerve,Masterlevels}Wad()
 
@@ -50,13 +51,18 @@
 #include "m_argv.h"
 #include "m_config.h"
 #include "m_controls.h"
+#include "m_savethread.h"
 #include "m_misc.h"
 #include "m_menu.h"
 #include "p_saveg.h"
 
 #include "i_endoom.h"
 #include "i_input.h"
+#include "i_jobs.h" // [AP]
 #include "i_joystick.h"
+#include "i_profile.h" // [AP]
+#include "i_startup.h" // [AP]
+#include "i_trace.h" // [AP]
 #include "i_system.h"
 #include "i_timer.h"
 #include "i_video.h"
@@ -73,6 +79,7 @@
 #include "net_dedicated.h"
 #include "net_query.h"
 
+#include "p_local.h" // [AP] P_GetNumForMap()
 #include "p_setup.h"
 #include "r_local.h"
 #include "statdump.h"
@@ -84,7 +91,10 @@
 #include "level_select.h" // [ap]
 #include "apdoom.h"
 #include "deh_misc.h"
+#include "ap_msg_log.h"
 #include "ap_notif.h"
+#include "i_swap.h" // [AP] SHORT()
+#include "sha1.h" // [AP] D_VerifyAPWad()
 
 //
 // D-DoomLoop()
@@ -178,6 +188,22 @@ void on_ap_victory()
 }
 
 
+// [AP] apdoom_init as a startup stage
+static int D_StartAP(void *settings)
+{
+    return apdoom_init(settings);
+}
+
+
+void on_ap_trace(const char* name, int begin)
+{
+    if (begin)
+        I_TraceBegin(name, NULL);
+    else
+        I_TraceEnd(name);
+}
+
+
 boolean P_GiveArmor(player_t* player, int armortype);
 boolean P_GiveWeapon(player_t* player, weapontype_t weapon, boolean dropped);
 
@@ -191,12 +217,11 @@ boolean is_in_level(int ep, int map)
 }
 
 
-// Kind of a copy of P_TouchSpecialThing
-void on_ap_give_item(int doom_type, int ep, int map)
+// Kind of a copy of P_TouchSpecialThing. Returns the pickup sound, -1 when
+// the item changed nothing.
+static int give_ap_item(player_t* player, ap_level_info_t* level_info, int doom_type, int ep, int map)
 {
-    player_t* player = &players[consoleplayer];
     int sound = sfx_itemup;
-    ap_level_info_t* level_info = ap_get_level_info(ap_make_level_index(gameepisode, gamemap));
 
     switch (doom_type)
     {
@@ -309,7 +334,7 @@ void on_ap_give_item(int doom_type, int ep, int map)
             break;
         case 2023: // Berserk
             if (!P_GivePower(player, pw_strength))
-                return;
+                return -1;
             player->message = DEH_String(GOTBERSERK);
             if (player->readyweapon != wp_fist)
                 player->pendingweapon = wp_fist;
@@ -327,21 +352,21 @@ void on_ap_give_item(int doom_type, int ep, int map)
             break;
         case 2022: // Invulnerability
             if (!P_GivePower (player, pw_invulnerability))
-                return;
+                return -1;
             player->message = DEH_String(GOTINVUL);
             if (gameversion > exe_doom_1_2)
                 sound = sfx_getpow;
             break;
         case 2024: // Partial invisibility
             if (!P_GivePower (player, pw_invisibility))
-                return;
+                return -1;
             player->message = DEH_String(GOTINVIS);
             if (gameversion > exe_doom_1_2)
                 sound = sfx_getpow;
             break;
         case 83: // Megasphere
 	        if (gamemode != commercial)
-	            return;
+	            return -1;
 	        player->health = deh_megasphere_health;
 	        player->mo->health = player->health;
                 // We always give armor type 2 for the megasphere; dehacked only 
@@ -355,31 +380,99 @@ void on_ap_give_item(int doom_type, int ep, int map)
         // Junk
         case 2012: // Medikit
 	        if (!P_GiveBody(player, 25))
-	            return;
+	            return -1;
             break;
         case 2048: // Box of bullets
             if (!P_GiveAmmo(player, am_clip, 5, false))
-                return;
+                return -1;
             player->message = DEH_String(GOTCLIPBOX);
             break;
         case 2046: // Box of rockets
             if (!P_GiveAmmo(player, am_misl, 5, false))
-                return;
+                return -1;
             player->message = DEH_String(GOTROCKBOX);
             break;
         case 2049: // Box of shotgun shells
             if (!P_GiveAmmo (player, am_shell,5,false))
-                return;
+                return -1;
             player->message = DEH_String(GOTSHELLBOX);
             break;
         case 17: // Energy cell pack
             if (!P_GiveAmmo (player, am_cell,5,false))
-                return;
+                return -1;
             player->message = DEH_String(GOTCELLBOX);
             break;
     }
 
-	S_StartSoundOptional (NULL, sound, sfx_itemup); // [NS] Fallback to itemup.
+    return sound;
+}
+
+
+// Higher is more important, when several items only get one sound
+static int ap_sound_priority(int sound)
+{
+    if (sound == sfx_keyup) return 4;
+    if (sound == sfx_getpow) return 3;
+    if (sound == sfx_wpnup) return 2;
+    if (sound == sfx_itemup) return 1;
+    return 0;
+}
+
+
+void on_ap_give_item(int doom_type, int ep, int map)
+{
+    player_t* player = &players[consoleplayer];
+    ap_level_info_t* level_info = ap_get_current_level(gameepisode, gamemap)->info;
+    int sound;
+
+    StatItemReceived(); // [AP] -runlog
+    sound = give_ap_item(player, level_info, doom_type, ep, map);
+    if (sound != -1)
+        S_StartSoundOptional (NULL, sound, sfx_itemup); // [NS] Fallback to itemup.
+}
+
+
+// [AP] Everything that was received while in the menu, at once. Still one
+// message and one sound, like picking up a single item.
+void on_ap_give_items(const ap_given_item_t* items, int count)
+{
+    static char summary[64];
+    player_t* player = &players[consoleplayer];
+    ap_level_info_t* level_info = ap_get_current_level(gameepisode, gamemap)->info;
+    const char* previous_message = player->message;
+    const char* message = NULL;
+    int message_count = 0;
+    int best_sound = -1;
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        int sound;
+
+        StatItemReceived(); // [AP] -runlog
+        player->message = NULL;
+        sound = give_ap_item(player, level_info, items[i].doom_type, items[i].ep, items[i].map);
+        if (player->message)
+        {
+            message = player->message;
+            message_count++;
+        }
+        if (ap_sound_priority(sound) > ap_sound_priority(best_sound))
+            best_sound = sound;
+    }
+
+    if (message_count > 1)
+    {
+        M_snprintf(summary, sizeof(summary), "Received %d items", count);
+        player->message = summary;
+    }
+    else
+    {
+        player->message = message ? message : previous_message;
+    }
+
+    if (best_sound != -1)
+        S_StartSoundOptional (NULL, best_sound, sfx_itemup); // [NS] Fallback to itemup.
 }
 
 
@@ -464,7 +557,9 @@ boolean D_Display (void)
 	    redrawsbar = true;
 	if (inhelpscreensstate && !inhelpscreens)
 	    redrawsbar = true;              // just put away the help screen
+	I_ProfileBegin(PROFILE_STATUSBAR); // [AP]
 	ST_Drawer (viewheight == SCREENHEIGHT, redrawsbar );
+	I_ProfileEnd(PROFILE_STATUSBAR);
 	fullscreen = viewheight == SCREENHEIGHT;
 	break;
 
@@ -495,13 +590,21 @@ boolean D_Display (void)
 
         // [crispy] Crispy HUD
         if (screenblocks >= CRISPY_HUD)
+        {
+            I_ProfileBegin(PROFILE_STATUSBAR); // [AP]
             ST_Drawer(false, true);
+            I_ProfileEnd(PROFILE_STATUSBAR);
+        }
     }
 
     // [crispy] in automap overlay mode,
     // the HUD is drawn on top of everything else
     if (gamestate == GS_LEVEL && gametic && !(automapactive && crispy->automapoverlay))
+    {
+	I_ProfileBegin(PROFILE_HUD); // [AP]
 	HU_Drawer ();
+	I_ProfileEnd(PROFILE_HUD);
+    }
     
     // clean up border stuff
     if (gamestate != oldgamestate && gamestate != GS_LEVEL)
@@ -548,7 +651,9 @@ boolean D_Display (void)
     if (automapactive && crispy->automapoverlay)
     {
 	AM_Drawer ();
+	I_ProfileBegin(PROFILE_HUD); // [AP]
 	HU_Drawer ();
+	I_ProfileEnd(PROFILE_HUD);
 
 	// [crispy] force redraw of status bar and border
 	viewactivestate = false;
@@ -587,8 +692,10 @@ boolean D_Display (void)
     M_Drawer ();          // menu is drawn even on top of everything
     if (gamestate != GS_FINALE)
     {
+        I_ProfileBegin(PROFILE_NOTIF); // [AP]
         ap_notif_draw();
-        HU_DrawAPMessages();   // ^ no, Sticky messages on top of everything :)
+        HU_DrawAPMessages();
+        I_ProfileEnd(PROFILE_NOTIF);   // ^ no, Sticky messages on top of everything :)
     }
     NetUpdate ();         // send out any new accumulation
 
@@ -672,6 +779,8 @@ void D_BindVariables(void)
     // [crispy] unconditionally disable savegame and demo limits
 //  M_BindIntVariable("vanilla_savegame_limit", &vanilla_savegame_limit);
 //  M_BindIntVariable("vanilla_demo_limit",     &vanilla_demo_limit);
+    M_BindIntVariable("compress_savegames",     &compress_savegames); // [AP]
+    M_BindIntVariable("fast_mouse",             &fast_mouse); // [AP]
     M_BindIntVariable("a11y_sector_lighting",   &a11y_sector_lighting);
     M_BindIntVariable("a11y_extra_lighting",    &a11y_extra_lighting);
     M_BindIntVariable("a11y_weapon_flash",      &a11y_weapon_flash);
@@ -790,7 +899,12 @@ void D_RunFrame()
                                , 0, 0, SCREENWIDTH, SCREENHEIGHT, tics);
         I_UpdateNoBlit ();
         M_Drawer ();                            // menu is drawn even on top of wipes
+        I_ProfileBegin(PROFILE_FINISHUPDATE); // [AP]
         I_FinishUpdate ();                      // page flip or blit buffer
+        I_ProfileEnd(PROFILE_FINISHUPDATE);
+        I_ProfileFrame();
+        D_BenchmarkFrame();
+        StatFrame(); // [AP]
         return;
     }
 
@@ -799,7 +913,17 @@ void D_RunFrame()
 
     TryRunTics (); // will run at least one tic
 
+    // [AP] Read the mouse again right before drawing, so that the view can
+    // turn with it between tics
+    if (G_FastMouse())
+    {
+        I_StartTic ();
+        D_ProcessEvents ();
+    }
+
+    I_ProfileBegin(PROFILE_SOUND); // [AP]
     S_UpdateSounds (players[displayplayer].mo);// move positional sounds
+    I_ProfileEnd(PROFILE_SOUND);
 
     // Update display, next frame, with current state if no profiling is on
     if (screenvisible && !nodrawers)
@@ -812,10 +936,16 @@ void D_RunFrame()
             wipestart = I_GetTime () - 1;
         } else {
             // normal update
+            I_ProfileBegin(PROFILE_FINISHUPDATE); // [AP]
             I_FinishUpdate ();              // page flip or blit buffer
+            I_ProfileEnd(PROFILE_FINISHUPDATE);
         }
     }
 
+    I_ProfileFrame(); // [AP]
+    D_BenchmarkFrame();
+    StatFrame();
+
 	// [crispy] post-rendering function pointer to apply config changes
 	// that affect rendering and that are better applied after the current
 	// frame has finished rendering
@@ -860,6 +990,16 @@ void D_DoomLoop (void)
     V_RestoreBuffer();
     R_ExecuteSetViewSize();
 
+    if (renderbench) // [AP]
+    {
+        D_RenderBenchmarkLoop();
+    }
+
+    if (microbench) // [AP]
+    {
+        D_MicroBenchmarkLoop();
+    }
+
     D_StartGameLoop();
 
     if (testcontrols)
@@ -1703,6 +1843,233 @@ static void G_CheckDemoStatusAtExit (void)
     G_CheckDemoStatus();
 }
 
+// [AP] IWADs already checked against the generated data, one per line:
+// SHA-1, size, mtime, game and path, separated by tabs
+#define APWADCACHE "apwads.txt"
+
+static void D_HashIWAD (char *hex)
+{
+    wad_file_t *wad = lumpinfo[0]->wad_file;
+    sha1_context_t sha1;
+    sha1_digest_t digest;
+    int i;
+
+    SHA1_Init(&sha1);
+
+    if (wad->mapped != NULL)
+    {
+        SHA1_Update(&sha1, wad->mapped, wad->length);
+    }
+    else
+    {
+        FILE *fstream = M_fopen(iwadfile, "rb");
+        byte *buf = Z_Malloc(1 << 20, PU_STATIC, NULL);
+        size_t len;
+
+        if (fstream != NULL)
+        {
+            while ((len = fread(buf, 1, 1 << 20, fstream)) > 0)
+                SHA1_Update(&sha1, buf, len);
+
+            fclose(fstream);
+        }
+
+        Z_Free(buf);
+    }
+
+    SHA1_Final(digest, &sha1);
+
+    for (i = 0; i < 20; i++)
+        M_snprintf(hex + i * 2, 3, "%02x", digest[i]);
+}
+
+// THINGS lump of an AP level, -1 if the map is missing
+static int D_APThingsLump (ap_level_index_t idx)
+{
+    int lumpnum = P_GetNumForMap(ap_index_to_ep(idx), ap_index_to_map(idx), false);
+
+    if (lumpnum < 0 || lumpnum + ML_THINGS >= numlumps)
+	return -1;
+
+    return lumpnum + ML_THINGS;
+}
+
+// True if no PWAD replaces any of the AP levels, so checking the IWAD
+// once covers them
+static boolean D_APLevelsFromIWAD (void)
+{
+    int ep, map, lumpnum;
+
+    for (ep = 1; ap_get_map_count(ep) != -1; ep++)
+    {
+	for (map = 1; map <= ap_get_map_count(ep); map++)
+	{
+	    lumpnum = D_APThingsLump(ap_make_level_index(ep, map));
+
+	    if (lumpnum < 0 || !W_IsIWADLump(lumpinfo[lumpnum]))
+		return false;
+	}
+    }
+
+    return true;
+}
+
+// Every AP location in every level has to be where the generated data
+// has it
+static boolean D_CheckAPLevels (void)
+{
+    int ep, map, i;
+
+    for (ep = 1; ap_get_map_count(ep) != -1; ep++)
+    {
+	for (map = 1; map <= ap_get_map_count(ep); map++)
+	{
+	    ap_level_index_t idx = ap_make_level_index(ep, map);
+	    int lumpnum, numthings, *types, ok;
+	    const mapthing_t *mt;
+
+	    lumpnum = D_APThingsLump(idx);
+
+	    if (lumpnum < 0)
+	    {
+		fprintf(stderr, "D_VerifyAPWad: episode %d map %d is missing\n", ep, map);
+		return false;
+	    }
+
+	    numthings = W_LumpLength(lumpnum) / sizeof(mapthing_t);
+	    mt = W_CacheLumpNum(lumpnum, PU_STATIC);
+	    types = Z_Malloc((numthings + 1) * sizeof(*types), PU_STATIC, NULL);
+
+	    for (i = 0; i < numthings; i++)
+		types[i] = SHORT(mt[i].type);
+
+	    ok = ap_validate_level_things(idx, types, numthings);
+
+	    Z_Free(types);
+	    W_ReleaseLumpNum(lumpnum);
+
+	    if (!ok)
+	    {
+		fprintf(stderr, "D_VerifyAPWad: episode %d map %d doesn't match\n", ep, map);
+		return false;
+	    }
+	}
+    }
+
+    return true;
+}
+
+static char *D_APWadCacheNext (char *line)
+{
+    line += strcspn(line, "\n");
+
+    return *line ? line + 1 : line;
+}
+
+// Field n (0 is the SHA-1) of a cache line, NULL if the line is short
+static const char *D_APWadCacheField (const char *line, int n)
+{
+    for ( ; n > 0; n--)
+    {
+	line += strcspn(line, "\t\n");
+
+	if (*line != '\t')
+	    return NULL;
+
+	line++;
+    }
+
+    return line;
+}
+
+//
+// D_VerifyAPWad
+// [AP] Fails right away if the maps aren't the ones the AP logic was
+// generated from, rather than when one of them is loaded. An IWAD that
+// passed is remembered by path, size and mtime, so later launches check
+// nothing, and by SHA-1, so a moved or copied one isn't checked again.
+// Maps from PWADs are checked every time.
+//
+static void D_VerifyAPWad (const char *game)
+{
+    struct stat st;
+    char *cachepath, *cache = NULL, *line;
+    char entry[512];
+    char hex[41];
+    boolean known = false;
+
+    if (!apdoom_select_game(game))
+	return; // apdoom_init complains
+
+    if (!D_APLevelsFromIWAD() || M_stat(iwadfile, &st) != 0)
+    {
+	if (!D_CheckAPLevels())
+	    goto mismatch;
+	return;
+    }
+
+    cachepath = M_StringJoin(configdir, APWADCACHE, NULL);
+    M_snprintf(entry, sizeof(entry), "\t%ld\t%lld\t%s\t%s\n",
+               (long) st.st_size, (long long) st.st_mtime, game, iwadfile);
+
+    if (M_FileExists(cachepath))
+    {
+	M_ReadFile(cachepath, (byte **) &cache);
+
+	for (line = cache; *line; line = D_APWadCacheNext(line))
+	{
+	    const char *rest = D_APWadCacheField(line, 1);
+
+	    if (rest && !strncmp(rest - 1, entry, strlen(entry)))
+	    {
+		Z_Free(cache);
+		free(cachepath);
+		return;
+	    }
+	}
+    }
+
+    printf("D_VerifyAPWad: Checking %s.\n", iwadfile);
+    D_HashIWAD(hex);
+
+    // Same contents as an IWAD that passed before?
+    for (line = cache; line && *line; line = D_APWadCacheNext(line))
+    {
+	const char *game_at = D_APWadCacheField(line, 3);
+
+	if (!strncmp(line, hex, 40) && game_at
+	 && !strncmp(game_at, game, strlen(game)) && game_at[strlen(game)] == '\t')
+	{
+	    known = true;
+	    break;
+	}
+    }
+
+    if (!known && !D_CheckAPLevels())
+    {
+	if (cache != NULL)
+	    Z_Free(cache);
+	free(cachepath);
+	goto mismatch;
+    }
+
+    {
+	char *contents = M_StringJoin(cache ? cache : "", hex, entry, NULL);
+
+	M_WriteFile(cachepath, contents, strlen(contents));
+	free(contents);
+    }
+
+    if (cache != NULL)
+	Z_Free(cache);
+    free(cachepath);
+    return;
+
+mismatch:
+    I_Error("WAD file doesn't match the one used to generate the logic.\n"
+            "To make sure it works as intended, get DOOM.WAD or DOOM2.WAD from the steam releases.");
+}
+
 static const char *const loadparms[] = {"-file", "-merge", NULL};
 
 //
@@ -1715,8 +2082,14 @@ void D_DoomMain (void)
     char demolumpname[9] = {0};
     int numiwadlumps;
     ap_settings_t ap_settings;
+    startuptask_t* ap_task;
+    char* player_name;
     memset(&ap_settings, 0, sizeof(ap_settings));
 
+    // [AP] A benchmark runs without a server, and so does -playdemo
+    ap_settings.offline = D_BenchmarkInit() != NULL
+                       || M_CheckParm("-playdemo") > 0;
+
     // [crispy] unconditionally initialize DEH tables
     DEH_Init();
 
@@ -1761,6 +2134,17 @@ void D_DoomMain (void)
     if (M_CheckParm("-apdeathlinkoff"))
         ap_settings.force_deathlink_off = 1;
 
+    int tracker_port_id = M_CheckParmWithArgs("-aptracker", 1);
+    if (tracker_port_id)
+        ap_settings.tracker_port = atoi(myargv[tracker_port_id + 1]);
+
+    if (M_CheckParm("-apstate-export-json"))
+        ap_settings.export_state_json = 1;
+
+    int message_log_id = M_CheckParmWithArgs("-apmessagelog", 1);
+    if (message_log_id)
+        ap_msg_log_open(myargv[message_log_id + 1]);
+
     int reset_level_on_death_id = M_CheckParmWithArgs("-apresetlevelondeath", 1);
     if (reset_level_on_death_id)
     {
@@ -1771,13 +2155,13 @@ void D_DoomMain (void)
     
     // Grab parameters for AP
     int apserver_arg_id = M_CheckParmWithArgs("-apserver", 1);
-    if (!apserver_arg_id)
+    if (!apserver_arg_id && !benchmark)
 	    I_Error("Make sure to launch the game using APDoomLauncher.exe.\nThe '-apserver' parameter requires an argument.");
-    ap_settings.ip = myargv[apserver_arg_id + 1];
+    ap_settings.ip = apserver_arg_id ? myargv[apserver_arg_id + 1] : "";
 
     int player_is_hex = 0;
     int applayer_arg_id = M_CheckParmWithArgs("-applayer", 1);
-    if (!applayer_arg_id)
+    if (!applayer_arg_id && !benchmark)
     {
         applayer_arg_id = M_CheckParmWithArgs("-applayerhex", 1);
         if (!applayer_arg_id)
@@ -1851,6 +2235,22 @@ void D_DoomMain (void)
         exit(0);
     }
 
+    //!
+    // @arg <address>
+    // @category net
+    //
+    // Print the lag statistics for each client of the server running
+    // on the given address. The server must be started with -netstats.
+    //
+
+    p = M_CheckParmWithArgs("-querystats", 1);
+
+    if (p)
+    {
+        NET_QueryStats(myargv[p+1]);
+        exit(0);
+    }
+
     //!
     // @category net
     //
@@ -1998,9 +2398,14 @@ void D_DoomMain (void)
     M_SetConfigFilenames("default.cfg", PROGRAM_PREFIX "doom.cfg");
     D_BindVariables();
     M_LoadDefaults();
+    D_BenchmarkDefaults(); // [AP]
 
     // Save configuration at exit.
-    I_AtExit(M_SaveDefaults, true); // [crispy] always save configuration at exit
+    // [AP] Unless a benchmark has overridden it
+    if (!benchmark)
+    {
+        I_AtExit(M_SaveDefaults, true); // [crispy] always save configuration at exit
+    }
 
     // Find main IWAD file and load it.
     int iwad_mask = IWAD_MASK_DOOM;
@@ -2300,6 +2705,16 @@ void D_DoomMain (void)
 
     }
 
+    if (!p)
+    {
+	p = M_CheckParmWithArgs("-benchmark", 1); // [AP]
+    }
+
+    if (!p)
+    {
+	p = M_CheckParmWithArgs("-simbench", 1); // [AP]
+    }
+
     if (p)
     {
         char *uc_filename = strdup(myargv[p + 1]);
@@ -2468,6 +2883,10 @@ void D_DoomMain (void)
     DEH_printf("I_Init: Setting up machine state.\n");
     I_CheckIsScreensaver();
     I_InitTimer();
+    I_InitJobs(); // [AP]
+    I_InitTrace(); // [AP]
+    R_InitDynamicResolution(); // [AP]
+    I_InitProfile(); // [AP]
     I_InitJoystick();
     I_InitSound(true);
     I_InitMusic();
@@ -2700,7 +3119,7 @@ void D_DoomMain (void)
     else if (mission == doom2)
         ap_settings.game = "DOOM II";
 
-    char* player_name = myargv[applayer_arg_id + 1];
+    player_name = applayer_arg_id ? myargv[applayer_arg_id + 1] : "Benchmark";
     if (player_is_hex)
     {
         int len = strlen(player_name) / 2;
@@ -2717,12 +3136,14 @@ void D_DoomMain (void)
     ap_settings.passwd = password;
     ap_settings.message_callback = on_ap_message;
     ap_settings.give_item_callback = on_ap_give_item;
+    ap_settings.give_items_callback = on_ap_give_items;
     ap_settings.victory_callback = on_ap_victory;
-    if (!apdoom_init(&ap_settings))
-    {
-	    I_Error("Failed to initialize Archipelago.");
-    }
+    ap_settings.trace_callback = on_ap_trace;
+    D_VerifyAPWad(ap_settings.game); // [AP] Before connecting
 
+    // [AP] Connecting waits on the server, so it's done while the menus
+    // and graphics load, which don't need the AP state
+    ap_task = I_StartupTask("AP connect", D_StartAP, &ap_settings);
 
     DEH_printf("M_Init: Init miscellaneous info.\n");
     M_Init ();
@@ -2730,6 +3151,11 @@ void D_DoomMain (void)
     DEH_printf("R_Init: Init DOOM refresh daemon - ");
     R_Init ();
 
+    if (!I_StartupWait(ap_task))
+    {
+	    I_Error("Failed to initialize Archipelago.");
+    }
+
     DEH_printf("\nP_Init: Init Playloop state.\n");
     P_Init ();
 
@@ -2760,6 +3186,8 @@ void D_DoomMain (void)
         DEH_printf("External statistics registered.\n");
     }
 
+    StatRunLogInit(); // [AP]
+
     //!
     // @arg <x>
     // @category demo
@@ -2785,8 +3213,18 @@ void D_DoomMain (void)
     }
     crispy->demowarp = 0; // [crispy] we don't play a demo, so don't skip maps
 	
+    if (simbench) // [AP]
+    {
+	D_SimBenchmarkLoop (demolumpname);
+    }
+
+    if (renderbench || microbench) // [AP]
+    {
+	D_DoomLoop ();  // never returns
+    }
+
     p = M_CheckParmWithArgs("-timedemo", 1);
-    if (p)
+    if (p || benchmark) // [AP]
     {
 	G_TimeDemo (demolumpname);
 	D_DoomLoop ();  // never returns
@@ -0,0 +1,924 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Microbenchmarks for the engine's hot paths, run by crispy-bench
+//	(or -microbench) once the IWAD, the renderer and a level are
+//	loaded, so that every kernel works on the data it sees in game.
+//
+//	Each kernel runs a fixed number of operations per round; the
+//	best round is the number to compare, the mean shows the noise.
+//	Inputs come from a fixed-seed generator, so every run does the
+//	same work.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apdoom.h"
+#include "deh_str.h"
+#include "doomstat.h"
+#include "d_microbench.h"
+#include "i_swap.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "i_video.h"
+#include "memio.h"
+#include "m_fixed.h"
+#include "m_misc.h"
+#include "net_packet.h"
+#include "net_structrw.h"
+#include "opl3.h"
+#include "p_local.h"
+#include "p_saveg.h"
+#include "r_bmaps.h"
+#include "r_local.h"
+#include "v_trans.h"
+#include "v_video.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+typedef struct
+{
+    const char *name;
+    int ops;                    // Per round
+    boolean (*setup)(void);     // false if it can't run here
+    void (*run)(int ops);
+    void (*shutdown)(void);
+} microbench_t;
+
+typedef struct
+{
+    double best_ns;
+    double mean_ns;
+    boolean skipped;
+} microresult_t;
+
+static unsigned int bench_seed;
+static volatile int sink;
+
+static unsigned int BenchRandom(void)
+{
+    bench_seed = bench_seed * 1664525u + 1013904223u;
+
+    return bench_seed >> 8;
+}
+
+//
+// Column and span drawers, in each detail mode
+//
+
+static byte column_source[256];
+static byte span_source[64 * 64];
+
+static boolean SetupDrawers(void)
+{
+    int i;
+
+    for (i = 0; i < arrlen(column_source); ++i)
+    {
+        column_source[i] = BenchRandom() & 0xff;
+    }
+
+    for (i = 0; i < arrlen(span_source); ++i)
+    {
+        span_source[i] = BenchRandom() & 0xff;
+    }
+
+    return true;
+}
+
+// A magnified wall column down the whole view, at x out of width
+static void SetupColumn(int x, int width)
+{
+    dc_x = x % width;
+    dc_yl = 0;
+    dc_yh = viewheight - 1;
+    dc_iscale = FRACUNIT / 2;
+    dc_texturemid = centery * dc_iscale;
+    dc_texheight = 128;
+    dc_source = column_source;
+    dc_colormap[0] = dc_colormap[1] = colormaps;
+    dc_brightmap = nobrightmap;
+    dc_translation = translationtables;
+}
+
+static void RunColumn(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupColumn(i, scaledviewwidth);
+        R_DrawColumn();
+    }
+}
+
+static void RunColumnLow(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupColumn(i, scaledviewwidth / 2);
+        R_DrawColumnLow();
+    }
+}
+
+static void RunFuzzColumn(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupColumn(i, scaledviewwidth);
+        R_DrawFuzzColumn();
+    }
+}
+
+static void RunFuzzColumnLow(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupColumn(i, scaledviewwidth / 2);
+        R_DrawFuzzColumnLow();
+    }
+}
+
+static void RunTranslatedColumn(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupColumn(i, scaledviewwidth);
+        R_DrawTranslatedColumn();
+    }
+}
+
+static void RunTranslatedColumnLow(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupColumn(i, scaledviewwidth / 2);
+        R_DrawTranslatedColumnLow();
+    }
+}
+
+static boolean SetupTLColumn(void)
+{
+#ifndef CRISPY_TRUECOLOR
+    return tranmap != NULL;
+#else
+    return true;
+#endif
+}
+
+static void RunTLColumn(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupColumn(i, scaledviewwidth);
+        R_DrawTLColumn();
+    }
+}
+
+static void RunTLColumnLow(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupColumn(i, scaledviewwidth / 2);
+        R_DrawTLColumnLow();
+    }
+}
+
+#ifdef CRISPY_TRUECOLOR
+static void RunTLAddColumn(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupColumn(i, scaledviewwidth);
+        R_DrawTLAddColumn();
+    }
+}
+
+static void RunTLAddColumnLow(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupColumn(i, scaledviewwidth / 2);
+        R_DrawTLAddColumnLow();
+    }
+}
+#endif
+
+// A floor row across the whole view, at y
+static void SetupSpan(int y, int width)
+{
+    ds_y = y % viewheight;
+    ds_x1 = 0;
+    ds_x2 = width - 1;
+    ds_xfrac = 0x123456;
+    ds_yfrac = 0x654321;
+    ds_xstep = 0x9000;
+    ds_ystep = 0x3000;
+    ds_source = span_source;
+    ds_colormap[0] = ds_colormap[1] = colormaps;
+    ds_brightmap = nobrightmap;
+}
+
+static void RunSpan(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupSpan(i, scaledviewwidth);
+        R_DrawSpan();
+    }
+}
+
+static void RunSpanLow(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupSpan(i, scaledviewwidth / 2);
+        R_DrawSpanLow();
+    }
+}
+
+static void RunSpanSolid(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupSpan(i, scaledviewwidth);
+        R_DrawSpanSolid();
+    }
+}
+
+static void RunSpanSolidLow(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        SetupSpan(i, scaledviewwidth / 2);
+        R_DrawSpanSolidLow();
+    }
+}
+
+//
+// V_DrawPatch, with the menu's title graphic
+//
+
+static patch_t *bench_patch;
+
+static boolean SetupPatch(void)
+{
+    const char *name = DEH_String("M_DOOM");
+
+    if (W_CheckNumForName(name) < 0)
+    {
+        return false;
+    }
+
+    bench_patch = W_CacheLumpName(name, PU_STATIC);
+
+    return true;
+}
+
+static void RunPatch(int ops)
+{
+    int x = (ORIGWIDTH - SHORT(bench_patch->width)) / 2;
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        V_DrawPatch(x, 2, bench_patch);
+    }
+}
+
+static void ShutdownPatch(void)
+{
+    W_ReleaseLumpName(DEH_String("M_DOOM"));
+}
+
+//
+// FixedMul and FixedDiv
+//
+
+#define NUMFIXED 1024
+
+static fixed_t fixed_a[NUMFIXED];
+static fixed_t fixed_b[NUMFIXED];
+
+static boolean SetupFixed(void)
+{
+    int i;
+
+    for (i = 0; i < NUMFIXED; ++i)
+    {
+        fixed_a[i] = (fixed_t) (BenchRandom() << 4) - (64 << FRACBITS);
+        fixed_b[i] = (fixed_t) (BenchRandom() | 1) - (128 << FRACBITS);
+    }
+
+    return true;
+}
+
+static void RunFixedMul(int ops)
+{
+    unsigned int total = 0;
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        total += (unsigned int) FixedMul(fixed_a[i & (NUMFIXED - 1)],
+                          fixed_b[(i * 7) & (NUMFIXED - 1)]);
+    }
+
+    sink = total;
+}
+
+static void RunFixedDiv(int ops)
+{
+    unsigned int total = 0;
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        total += (unsigned int) FixedDiv(fixed_a[i & (NUMFIXED - 1)],
+                          fixed_b[(i * 7) & (NUMFIXED - 1)]);
+    }
+
+    sink = total;
+}
+
+//
+// P_PathTraverse and P_CheckSight, on the loaded level
+//
+
+#define NUMTRACES 1024
+
+static fixed_t trace_points[NUMTRACES][4];
+static mobj_t **sight_mobjs;
+static int num_sight_mobjs;
+static int path_hits;
+
+// Traces of up to 1024 units in each direction, from near the level's
+// vertexes, so that they start somewhere in the level
+static boolean SetupPaths(void)
+{
+    int i;
+
+    if (numvertexes == 0)
+    {
+        return false;
+    }
+
+    for (i = 0; i < NUMTRACES; ++i)
+    {
+        const vertex_t *v = &vertexes[BenchRandom() % numvertexes];
+
+        trace_points[i][0] = v->x + (int) (BenchRandom() % 64 + 1) * FRACUNIT;
+        trace_points[i][1] = v->y + (int) (BenchRandom() % 64 + 1) * FRACUNIT;
+        trace_points[i][2] = trace_points[i][0]
+                           + ((int) (BenchRandom() % 2048) - 1024) * FRACUNIT;
+        trace_points[i][3] = trace_points[i][1]
+                           + ((int) (BenchRandom() % 2048) - 1024) * FRACUNIT;
+    }
+
+    return true;
+}
+
+static boolean PTR_BenchCount(intercept_t *in)
+{
+    ++path_hits;
+
+    return true;
+}
+
+static void RunPathTraverse(int ops)
+{
+    int i;
+
+    path_hits = 0;
+
+    for (i = 0; i < ops; ++i)
+    {
+        fixed_t *p = trace_points[i & (NUMTRACES - 1)];
+
+        P_PathTraverse(p[0], p[1], p[2], p[3], PT_ADDLINES | PT_ADDTHINGS,
+                       PTR_BenchCount);
+    }
+
+    sink = path_hits;
+}
+
+static void ShutdownSight(void)
+{
+    free(sight_mobjs);
+    sight_mobjs = NULL;
+}
+
+static boolean SetupSight(void)
+{
+    thinker_t *th;
+    int n = 0;
+
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj];
+         th = th->cnext)
+    {
+        ++n;
+    }
+
+    sight_mobjs = malloc((n ? n : 1) * sizeof(*sight_mobjs));
+
+    if (sight_mobjs == NULL)
+    {
+        return false;
+    }
+
+    num_sight_mobjs = 0;
+
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj];
+         th = th->cnext)
+    {
+        if (th->function.acp1 == (actionf_p1) P_MobjThinker)
+        {
+            sight_mobjs[num_sight_mobjs++] = (mobj_t *) th;
+        }
+    }
+
+    if (num_sight_mobjs < 2)
+    {
+        ShutdownSight();
+        return false;
+    }
+
+    return true;
+}
+
+static void RunCheckSight(int ops)
+{
+    int seen = 0;
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        mobj_t *t1 = sight_mobjs[BenchRandom() % num_sight_mobjs];
+        mobj_t *t2 = sight_mobjs[BenchRandom() % num_sight_mobjs];
+
+        // Every pair traced, rather than coming from the cache
+        P_ClearSightCache();
+        seen += P_CheckSight(t1, t2);
+    }
+
+    sink = seen;
+}
+
+//
+// W_CheckNumForName, over every lump and some misses
+//
+
+static char (*lump_names)[9];
+static int num_lump_names;
+
+static boolean SetupLumpNames(void)
+{
+    unsigned int i;
+
+    num_lump_names = numlumps + numlumps / 8 + 1;
+    lump_names = malloc(num_lump_names * sizeof(*lump_names));
+
+    if (lump_names == NULL)
+    {
+        return false;
+    }
+
+    for (i = 0; i < numlumps; ++i)
+    {
+        M_StringCopy(lump_names[i], lumpinfo[i]->name, 9);
+    }
+
+    for (; i < (unsigned int) num_lump_names; ++i)
+    {
+        M_snprintf(lump_names[i], 9, "NOLMP%03d", i % 1000);
+    }
+
+    return true;
+}
+
+static void RunCheckNumForName(int ops)
+{
+    int total = 0;
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        total += W_CheckNumForName(lump_names[BenchRandom() % num_lump_names]);
+    }
+
+    sink = total;
+}
+
+static void ShutdownLumpNames(void)
+{
+    free(lump_names);
+    lump_names = NULL;
+}
+
+//
+// Z_Malloc and Z_Free
+//
+
+#define NUMLIVEBLOCKS 256
+
+static void *live_blocks[NUMLIVEBLOCKS];
+
+static void RunZoneSmall(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        void *p = Z_Malloc(64, PU_STATIC, NULL);
+
+        Z_Free(p);
+    }
+}
+
+// Random sizes, freed in random order, with a working set of blocks
+static boolean SetupZoneMixed(void)
+{
+    int i;
+
+    for (i = 0; i < NUMLIVEBLOCKS; ++i)
+    {
+        live_blocks[i] = Z_Malloc(16 + BenchRandom() % 4096, PU_STATIC, NULL);
+    }
+
+    return true;
+}
+
+static void RunZoneMixed(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        int slot = BenchRandom() % NUMLIVEBLOCKS;
+
+        Z_Free(live_blocks[slot]);
+        live_blocks[slot] = Z_Malloc(16 + BenchRandom() % 4096, PU_STATIC,
+                                     NULL);
+    }
+}
+
+static void ShutdownZoneMixed(void)
+{
+    int i;
+
+    for (i = 0; i < NUMLIVEBLOCKS; ++i)
+    {
+        Z_Free(live_blocks[i]);
+        live_blocks[i] = NULL;
+    }
+}
+
+// What the lump cache does: owned, demoted to PU_CACHE, then dropped
+static void RunZoneCache(int ops)
+{
+    void *p;
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        Z_Malloc(256 + (i & 1023), PU_STATIC, &p);
+        Z_ChangeTag(p, PU_CACHE);
+        Z_Free(p);
+    }
+}
+
+//
+// Savegame serialization of the loaded level
+//
+
+static void RunSaveGame(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        save_stream = mem_fopen_write();
+        savegame_error = false;
+
+        P_ArchivePlayers();
+        P_ArchiveWorld();
+        P_ArchiveThinkers();
+        P_ArchiveSpecials();
+
+        sink = mem_ftell(save_stream);
+        mem_fclose(save_stream);
+        save_stream = NULL;
+    }
+}
+
+//
+// NET_WriteTiccmdDiff
+//
+
+#define NUMDIFFS 64
+
+static net_ticdiff_t tic_diffs[NUMDIFFS];
+static net_packet_t *diff_packet;
+
+static boolean SetupTiccmdDiff(void)
+{
+    ticcmd_t cmds[NUMDIFFS + 1];
+    int i;
+
+    memset(cmds, 0, sizeof(cmds));
+
+    for (i = 0; i <= NUMDIFFS; ++i)
+    {
+        cmds[i].forwardmove = (signed char) (BenchRandom() % 101) - 50;
+        cmds[i].sidemove = (BenchRandom() & 3) ? 0
+                         : (signed char) (BenchRandom() % 81) - 40;
+        cmds[i].angleturn = (short) BenchRandom();
+        cmds[i].buttons = (BenchRandom() & 7) ? 0 : BT_ATTACK;
+        cmds[i].lookdir = (BenchRandom() & 15) ? 0 : 1;
+    }
+
+    for (i = 0; i < NUMDIFFS; ++i)
+    {
+        NET_TiccmdDiff(&cmds[i], &cmds[i + 1], &tic_diffs[i]);
+    }
+
+    diff_packet = NET_NewPacket(256);
+
+    return true;
+}
+
+static void RunTiccmdDiff(int ops)
+{
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        diff_packet->len = 0;
+        NET_WriteTiccmdDiff(diff_packet, &tic_diffs[i & (NUMDIFFS - 1)],
+                            false);
+    }
+
+    sink = diff_packet->len;
+}
+
+static void ShutdownTiccmdDiff(void)
+{
+    NET_FreePacket(diff_packet);
+    diff_packet = NULL;
+}
+
+//
+// OPL3_Generate, with all nine two-operator channels playing
+//
+
+static opl3_chip bench_chip;
+
+static boolean SetupOPL(void)
+{
+    static const int op_offsets[] =
+    {
+        0x00, 0x01, 0x02, 0x08, 0x09, 0x0a, 0x10, 0x11, 0x12,
+    };
+    int ch, op;
+
+    OPL3_Reset(&bench_chip, 49716);
+    OPL3_WriteReg(&bench_chip, 0x105, 0x01);
+
+    for (ch = 0; ch < arrlen(op_offsets); ++ch)
+    {
+        for (op = 0; op < 2; ++op)
+        {
+            int reg = op_offsets[ch] + op * 3;
+
+            OPL3_WriteReg(&bench_chip, 0x20 + reg, 0x21);
+            OPL3_WriteReg(&bench_chip, 0x40 + reg, op ? 0x00 : 0x18);
+            OPL3_WriteReg(&bench_chip, 0x60 + reg, 0xf4);
+            OPL3_WriteReg(&bench_chip, 0x80 + reg, 0x46);
+        }
+
+        OPL3_WriteReg(&bench_chip, 0xc0 + ch, 0x30 | 0x0e);
+        OPL3_WriteReg(&bench_chip, 0xa0 + ch, 0x40 + ch * 0x10);
+        OPL3_WriteReg(&bench_chip, 0xb0 + ch, 0x31);
+    }
+
+    return true;
+}
+
+static void RunOPL(int ops)
+{
+    Bit16s buf[2];
+    int total = 0;
+    int i;
+
+    for (i = 0; i < ops; ++i)
+    {
+        OPL3_Generate(&bench_chip, buf);
+        total += buf[0];
+    }
+
+    sink = total;
+}
+
+//
+// The Archipelago table lookups behind every location and item message
+//
+
+static void RunFindLocation(int ops)
+{
+    sink = apdoom_bench_find_locations(ops);
+}
+
+static void RunFindItem(int ops)
+{
+    sink = apdoom_bench_find_items(ops);
+}
+
+static const microbench_t microbenches[] =
+{
+    {"R_DrawColumn",            20000,   SetupDrawers,    RunColumn,              NULL},
+    {"R_DrawColumnLow",         20000,   SetupDrawers,    RunColumnLow,           NULL},
+    {"R_DrawFuzzColumn",        20000,   SetupDrawers,    RunFuzzColumn,          NULL},
+    {"R_DrawFuzzColumnLow",     20000,   SetupDrawers,    RunFuzzColumnLow,       NULL},
+    {"R_DrawTranslatedColumn",  20000,   SetupDrawers,    RunTranslatedColumn,    NULL},
+    {"R_DrawTranslatedColumnLow", 20000, SetupDrawers,    RunTranslatedColumnLow, NULL},
+    {"R_DrawTLColumn",          20000,   SetupTLColumn,   RunTLColumn,            NULL},
+    {"R_DrawTLColumnLow",       20000,   SetupTLColumn,   RunTLColumnLow,         NULL},
+#ifdef CRISPY_TRUECOLOR
+    {"R_DrawTLAddColumn",       20000,   SetupTLColumn,   RunTLAddColumn,         NULL},
+    {"R_DrawTLAddColumnLow",    20000,   SetupTLColumn,   RunTLAddColumnLow,      NULL},
+#endif
+    {"R_DrawSpan",              20000,   SetupDrawers,    RunSpan,                NULL},
+    {"R_DrawSpanLow",           20000,   SetupDrawers,    RunSpanLow,             NULL},
+    {"R_DrawSpanSolid",         20000,   SetupDrawers,    RunSpanSolid,           NULL},
+    {"R_DrawSpanSolidLow",      20000,   SetupDrawers,    RunSpanSolidLow,        NULL},
+    {"V_DrawPatch",             2000,    SetupPatch,      RunPatch,               ShutdownPatch},
+    {"FixedMul",                10000000, SetupFixed,     RunFixedMul,            NULL},
+    {"FixedDiv",                10000000, SetupFixed,     RunFixedDiv,            NULL},
+    {"P_PathTraverse",          20000,   SetupPaths,      RunPathTraverse,        NULL},
+    {"P_CheckSight",            20000,   SetupSight,      RunCheckSight,          ShutdownSight},
+    {"W_CheckNumForName",       200000,  SetupLumpNames,  RunCheckNumForName,     ShutdownLumpNames},
+    {"Z_Malloc/Z_Free 64",      200000,  NULL,            RunZoneSmall,           NULL},
+    {"Z_Malloc/Z_Free mixed",   200000,  SetupZoneMixed,  RunZoneMixed,           ShutdownZoneMixed},
+    {"Z_Malloc/Z_ChangeTag",    200000,  NULL,            RunZoneCache,           NULL},
+    {"P_Archive*",              200,     NULL,            RunSaveGame,            NULL},
+    {"NET_WriteTiccmdDiff",     200000,  SetupTiccmdDiff, RunTiccmdDiff,          ShutdownTiccmdDiff},
+    {"OPL3_Generate",           200000,  SetupOPL,        RunOPL,                 NULL},
+    {"find_location",           200000,  NULL,            RunFindLocation,        NULL},
+    {"f_itemrecv lookup",       200000,  NULL,            RunFindItem,            NULL},
+};
+
+static void RunMicroBench(const microbench_t *bench, int rounds,
+                          microresult_t *result)
+{
+    double total = 0;
+    int i;
+
+    memset(result, 0, sizeof(*result));
+    bench_seed = 1;
+
+    if (bench->setup != NULL && !bench->setup())
+    {
+        result->skipped = true;
+        return;
+    }
+
+    // One round to warm the caches, not counted
+    bench->run(bench->ops);
+
+    for (i = 0; i < rounds; ++i)
+    {
+        uint64_t start = I_GetTimeUS();
+        double ns;
+
+        bench->run(bench->ops);
+        ns = (I_GetTimeUS() - start) * 1000.0 / bench->ops;
+        total += ns;
+
+        if (i == 0 || ns < result->best_ns)
+        {
+            result->best_ns = ns;
+        }
+    }
+
+    result->mean_ns = total / rounds;
+
+    if (bench->shutdown != NULL)
+    {
+        bench->shutdown();
+    }
+}
+
+static void WriteMicroResults(const char *filename,
+                              const microresult_t *results, int rounds)
+{
+    FILE *f;
+    int i, last = -1;
+
+    f = M_fopen(filename, "w");
+
+    if (f == NULL)
+    {
+        fprintf(stderr, "D_MicroBenchmarks: Unable to write %s\n", filename);
+        return;
+    }
+
+    for (i = 0; i < arrlen(microbenches); ++i)
+    {
+        if (!results[i].skipped)
+        {
+            last = i;
+        }
+    }
+
+    fprintf(f, "{\n  \"mode\": \"microbench\",\n  \"width\": %d,\n"
+               "  \"height\": %d,\n  \"rounds\": %d,\n  \"kernels\": [\n",
+            SCREENWIDTH, SCREENHEIGHT, rounds);
+
+    for (i = 0; i < arrlen(microbenches); ++i)
+    {
+        if (results[i].skipped)
+        {
+            continue;
+        }
+
+        fprintf(f, "    {\"name\": \"%s\", \"ops\": %d, \"best_ns\": %.2f, "
+                   "\"mean_ns\": %.2f}%s\n",
+                microbenches[i].name, microbenches[i].ops,
+                results[i].best_ns, results[i].mean_ns,
+                i == last ? "" : ",");
+    }
+
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+
+    printf("Benchmark results written to %s\n", filename);
+}
+
+void D_MicroBenchmarks(int rounds, const char *json)
+{
+    microresult_t results[arrlen(microbenches)];
+    int i;
+
+    printf("Microbenchmarks, %dx%d, best and mean of %d rounds:\n",
+           SCREENWIDTH, SCREENHEIGHT, rounds);
+    printf("  %-28s %10s %12s %12s\n", "kernel", "ops", "best ns/op",
+           "mean ns/op");
+
+    for (i = 0; i < arrlen(microbenches); ++i)
+    {
+        RunMicroBench(&microbenches[i], rounds, &results[i]);
+
+        if (results[i].skipped)
+        {
+            printf("  %-28s %10s\n", microbenches[i].name, "skipped");
+            continue;
+        }
+
+        printf("  %-28s %10d %12.2f %12.2f\n", microbenches[i].name,
+               microbenches[i].ops, results[i].best_ns, results[i].mean_ns);
+    }
+
+    if (json != NULL)
+    {
+        WriteMicroResults(json, results, rounds);
+    }
+}
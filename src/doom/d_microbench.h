@@ -0,0 +1,25 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Microbenchmarks for crispy-bench.
+//
+
+#ifndef __D_MICROBENCH__
+#define __D_MICROBENCH__
+
+// Runs every kernel rounds times and prints the results, also writing
+// them to json if it isn't NULL. Needs a level loaded.
+void D_MicroBenchmarks(int rounds, const char *json);
+
+#endif
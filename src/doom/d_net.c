@@ -27,6 +27,7 @@
 #include "i_timer.h"
 #include "i_video.h"
 #include "g_game.h"
+#include "p_local.h"
 #include "doomdef.h"
 #include "doomstat.h"
 #include "w_checksum.h"
@@ -97,7 +98,8 @@ static loop_interface_t doom_loop_interface = {
     D_ProcessEvents,
     G_BuildTiccmd,
     RunTic,
-    M_Ticker
+    M_Ticker,
+    P_PredictTics
 };
 
 
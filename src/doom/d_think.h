@@ -62,6 +62,9 @@ typedef struct thinker_s
     struct thinker_s*	prev;
     struct thinker_s*	next;
     think_t		function;
+    // [AP] Links in the thinker's class list, see thinkerclasscap
+    struct thinker_s*	cprev;
+    struct thinker_s*	cnext;
     
 } thinker_t;
 
@@ -39,28 +39,6 @@ static pixel_t*	wipe_scr_end;
 static pixel_t*	wipe_scr;
 
 
-void
-wipe_shittyColMajorXform
-( dpixel_t*	array,
-  int		width,
-  int		height )
-{
-    int		x;
-    int		y;
-    dpixel_t*	dest;
-
-    dest = (dpixel_t*) Z_Malloc(width*height*sizeof(*dest), PU_STATIC, 0);
-
-    for(y=0;y<height;y++)
-	for(x=0;x<width;x++)
-	    dest[x*height+y] = array[y*width+x];
-
-    memcpy(array, dest, width*height*sizeof(*dest));
-
-    Z_Free(dest);
-
-}
-
 int
 wipe_initColorXForm
 ( int	width,
@@ -127,7 +105,51 @@ wipe_exitColorXForm
 }
 
 
+// [AP] The melt moves vertical strips as wide as two pixels at the
+// original resolution, so the strip count and the per-tick work on y[]
+// don't grow with crispy->hires. Each frame is rebuilt from the row-major
+// start and end screens with one copy per strip and row, and a single copy
+// for runs of neighbouring strips that all show the end screen. The
+// screens and y[] are allocated once and reused for every wipe.
 static int*	y;
+static int	numstrips;
+static int*	stripx; // numstrips + 1 entries, left edge of each strip
+static int	wipe_alloc_size;
+static int	wipe_alloc_width;
+
+static void wipe_AllocScreens (int width)
+{
+    int size = SCREENWIDTH * SCREENHEIGHT;
+
+    if (size != wipe_alloc_size)
+    {
+	if (wipe_scr_start)
+	{
+	    Z_Free(wipe_scr_start);
+	    Z_Free(wipe_scr_end);
+	}
+	wipe_scr_start = Z_Malloc(size * sizeof(*wipe_scr_start), PU_STATIC, NULL);
+	wipe_scr_end = Z_Malloc(size * sizeof(*wipe_scr_end), PU_STATIC, NULL);
+	wipe_alloc_size = size;
+    }
+
+    if (width != wipe_alloc_width)
+    {
+	int i;
+
+	if (y)
+	{
+	    Z_Free(y);
+	    Z_Free(stripx);
+	}
+	numstrips = MAX(1, (width >> crispy->hires) / 2);
+	y = Z_Malloc(numstrips * sizeof(*y), PU_STATIC, NULL);
+	stripx = Z_Malloc((numstrips + 1) * sizeof(*stripx), PU_STATIC, NULL);
+	for (i = 0; i <= numstrips; i++)
+	    stripx[i] = i * width / numstrips;
+	wipe_alloc_width = width;
+    }
+}
 
 int
 wipe_initMelt
@@ -140,16 +162,10 @@ wipe_initMelt
     // copy start screen to main screen
     memcpy(wipe_scr, wipe_scr_start, width*height*sizeof(*wipe_scr));
     
-    // makes this wipe faster (in theory)
-    // to have stuff in column-major format
-    wipe_shittyColMajorXform((dpixel_t*)wipe_scr_start, width/2, height);
-    wipe_shittyColMajorXform((dpixel_t*)wipe_scr_end, width/2, height);
-    
     // setup initial column positions
     // (y<0 => not ready to scroll yet)
-    y = (int *) Z_Malloc(width*sizeof(int), PU_STATIC, 0);
     y[0] = -(M_Random()%16);
-    for (i=1;i<width;i++)
+    for (i=1;i<numstrips;i++)
     {
 	r = (M_Random()%3) - 1;
 	y[i] = y[i-1] + r;
@@ -167,19 +183,13 @@ wipe_doMelt
   int	ticks )
 {
     int		i;
-    int		j;
+    int		row;
     int		dy;
-    int		idx;
-    
-    dpixel_t*	s;
-    dpixel_t*	d;
     boolean	done = true;
 
-    width/=2;
-
     while (ticks--)
     {
-	for (i=0;i<width;i++)
+	for (i=0;i<numstrips;i++)
 	{
 	    if (y[i]<0)
 	    {
@@ -189,28 +199,40 @@ wipe_doMelt
 	    {
 		dy = (y[i] < 16) ? y[i]+1 : (8 << crispy->hires);
 		if (y[i]+dy >= height) dy = height - y[i];
-		s = &((dpixel_t *)wipe_scr_end)[i*height+y[i]];
-		d = &((dpixel_t *)wipe_scr)[y[i]*width+i];
-		idx = 0;
-		for (j=dy;j;j--)
-		{
-		    d[idx] = *(s++);
-		    idx += width;
-		}
 		y[i] += dy;
-		s = &((dpixel_t *)wipe_scr_start)[i*height];
-		d = &((dpixel_t *)wipe_scr)[y[i]*width+i];
-		idx = 0;
-		for (j=height-y[i];j;j--)
-		{
-		    d[idx] = *(s++);
-		    idx += width;
-		}
 		done = false;
 	    }
 	}
     }
 
+    // Above its y a strip shows the end screen, below it the start screen
+    // pushed down by y
+    for (row = 0; row < height; row++)
+    {
+	pixel_t *d = &wipe_scr[row * width];
+
+	for (i = 0; i < numstrips; )
+	{
+	    int x1 = stripx[i];
+
+	    if (row < y[i])
+	    {
+		while (i < numstrips && row < y[i])
+		    i++;
+		memcpy(d + x1, &wipe_scr_end[row * width + x1],
+		       (stripx[i] - x1) * sizeof(*d));
+	    }
+	    else
+	    {
+		int sy = row - MAX(y[i], 0);
+
+		memcpy(d + x1, &wipe_scr_start[sy * width + x1],
+		       (stripx[i + 1] - x1) * sizeof(*d));
+		i++;
+	    }
+	}
+    }
+
     return done;
 
 }
@@ -221,9 +243,7 @@ wipe_exitMelt
   int	height,
   int	ticks )
 {
-    Z_Free(y);
-    Z_Free(wipe_scr_start);
-    Z_Free(wipe_scr_end);
+    // The buffers are kept for the next wipe
     return 0;
 }
 
@@ -234,7 +254,7 @@ wipe_StartScreen
   int	width,
   int	height )
 {
-    wipe_scr_start = Z_Malloc(SCREENWIDTH * SCREENHEIGHT * sizeof(*wipe_scr_start), PU_STATIC, NULL);
+    wipe_AllocScreens(width);
     I_ReadScreen(wipe_scr_start);
     return 0;
 }
@@ -246,7 +266,6 @@ wipe_EndScreen
   int	width,
   int	height )
 {
-    wipe_scr_end = Z_Malloc(SCREENWIDTH * SCREENHEIGHT * sizeof(*wipe_scr_end), PU_STATIC, NULL);
     I_ReadScreen(wipe_scr_end);
     V_DrawBlock(x, y, width, height, wipe_scr_start); // restore start scr.
     return 0;
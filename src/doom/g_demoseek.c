@@ -0,0 +1,296 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Demo seeking.
+//
+//	A snapshot is what a savegame holds, written to memory with the
+//	savegame code, plus what a savegame leaves out but demo sync needs:
+//	the position in the demo and the random number indices. Snapshots
+//	are only taken in levels; an intermission is played through from
+//	the level before it. There are at most MAXSNAPSHOTS: when they run
+//	out, every other one is dropped and the interval doubles, so they
+//	stay spread over the whole of a long demo in bounded memory.
+//
+//	G_Ticker doesn't move gametic, so while seeking, demostarttic is
+//	moved instead to keep the revenant tracer fix in sync.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "am_map.h"
+#include "d_loop.h"
+#include "doomdef.h"
+#include "doomkeys.h"
+#include "doomstat.h"
+#include "g_demoseek.h"
+#include "g_game.h"
+#include "i_system.h"
+#include "i_trace.h"
+#include "m_random.h"
+#include "p_extsaveg.h"
+#include "p_saveg.h"
+#include "st_stuff.h"
+
+#define MAXSNAPSHOTS 64
+#define FIRSTINTERVAL (10 * TICRATE)
+
+typedef struct
+{
+    int tic;                    // defdemotics
+    int demo_pos;               // demo_p - demobuffer
+    int ticphase;               // gametic - demostarttic
+    int rndindex, prndindex;
+    int leveltime;
+    skill_t skill;
+    int episode, map;
+    byte *data;
+    size_t length;
+} snapshot_t;
+
+extern byte *demobuffer;
+extern byte *demo_p;
+extern int demostarttic;
+extern boolean timingdemo;
+
+static snapshot_t snapshots[MAXSNAPSHOTS];
+static int num_snapshots;
+static int interval = FIRSTINTERVAL;
+static boolean seeking;
+
+void G_DemoSeekReset(void)
+{
+    int i;
+
+    for (i = 0; i < num_snapshots; ++i)
+    {
+        free(snapshots[i].data);
+    }
+
+    num_snapshots = 0;
+    interval = FIRSTINTERVAL;
+}
+
+// Keeps every other snapshot, starting with the first.
+
+static void ThinSnapshots(void)
+{
+    int i;
+
+    for (i = 1; i < num_snapshots; i += 2)
+    {
+        free(snapshots[i].data);
+    }
+
+    for (i = 0; i * 2 < num_snapshots; ++i)
+    {
+        snapshots[i] = snapshots[i * 2];
+    }
+
+    num_snapshots = i;
+    interval *= 2;
+}
+
+void G_DemoSnapshot(void)
+{
+    snapshot_t *snap;
+    void *buf;
+    size_t length;
+
+    if (!demoplayback || timingdemo || gamestate != GS_LEVEL)
+    {
+        return;
+    }
+
+    if (num_snapshots > 0
+     && defdemotics < snapshots[num_snapshots - 1].tic + interval)
+    {
+        return;
+    }
+
+    if (num_snapshots == MAXSNAPSHOTS)
+    {
+        ThinSnapshots();
+    }
+
+    I_TraceBegin("demo snapshot", NULL);
+
+    save_stream = mem_fopen_write();
+    savegame_error = false;
+
+    P_ArchivePlayers();
+    P_ArchiveWorld();
+    P_ArchiveThinkers();
+    P_ArchiveSpecials();
+    P_WriteSaveGameEOF();
+    P_WriteExtendedSaveGameData();
+
+    mem_get_buf(save_stream, &buf, &length);
+    snap = &snapshots[num_snapshots];
+    snap->data = malloc(length);
+
+    if (snap->data != NULL && !savegame_error)
+    {
+        memcpy(snap->data, buf, length);
+        snap->length = length;
+        snap->tic = defdemotics;
+        snap->demo_pos = demo_p - demobuffer;
+        snap->ticphase = gametic - demostarttic;
+        snap->rndindex = rndindex;
+        snap->prndindex = prndindex;
+        snap->leveltime = leveltime;
+        snap->skill = gameskill;
+        snap->episode = gameepisode;
+        snap->map = gamemap;
+        ++num_snapshots;
+    }
+    else
+    {
+        free(snap->data);
+    }
+
+    mem_fclose(save_stream);
+
+    I_TraceEnd("demo snapshot");
+}
+
+// As G_DoLoadGame, from a snapshot.
+
+static void RestoreSnapshot(snapshot_t *snap)
+{
+    boolean oldprecache = precache;
+
+    save_stream = mem_fopen_read(snap->data, snap->length);
+    savegame_error = false;
+
+    precache = false;
+    G_InitNew(snap->skill, snap->episode, snap->map);
+    precache = oldprecache;
+
+    // G_InitNew starts a new game, but this is still the demo
+    demoplayback = true;
+    usergame = false;
+    leveltime = snap->leveltime;
+
+    P_UnArchivePlayers();
+    P_UnArchiveWorld();
+    P_UnArchiveThinkers();
+    P_UnArchiveSpecials();
+    P_RestoreTargets();
+    AM_BuildLocations();
+
+    if (!P_ReadSaveGameEOF())
+    {
+        I_Error("G_DemoSeek: Bad snapshot");
+    }
+
+    P_ReadExtendedSaveGameData(1);
+    mem_fclose(save_stream);
+
+    demo_p = demobuffer + snap->demo_pos;
+    defdemotics = snap->tic;
+    demostarttic = gametic - snap->ticphase;
+    rndindex = snap->rndindex;
+    prndindex = snap->prndindex;
+}
+
+void G_DemoSeek(int tic)
+{
+    snapshot_t *snap = NULL;
+    boolean oldnodrawers = nodrawers;
+    boolean oldsingletics = singletics;
+    int oldpaused = paused & 2;
+    int i;
+
+    if (!demoplayback || seeking || deftotaldemotics <= 0)
+    {
+        return;
+    }
+
+    tic = BETWEEN(0, deftotaldemotics - 1, tic);
+
+    for (i = 0; i < num_snapshots && snapshots[i].tic <= tic; ++i)
+    {
+        snap = &snapshots[i];
+    }
+
+    if (snap == NULL && tic < defdemotics)
+    {
+        return;
+    }
+
+    seeking = true;
+    I_TraceBegin("demo seek", NULL);
+
+    // Going forward, only restore if that skips tics
+
+    if (snap != NULL && (tic < defdemotics || snap->tic > defdemotics))
+    {
+        RestoreSnapshot(snap);
+    }
+
+    // Both set also mutes sounds, as for the crispy demo warp
+
+    nodrawers = true;
+    singletics = true;
+    paused &= ~2;
+
+    while (demoplayback && defdemotics < tic)
+    {
+        G_Ticker();
+        --demostarttic;
+    }
+
+    nodrawers = oldnodrawers;
+    singletics = oldsingletics;
+    paused |= oldpaused;
+
+    // No melt from where we were
+    wipegamestate = gamestate;
+
+    I_TraceEnd("demo seek");
+    seeking = false;
+}
+
+boolean G_DemoSeekResponder(event_t *ev)
+{
+    int step;
+
+    if (!demoplayback || timingdemo || ev->type != ev_keydown)
+    {
+        return false;
+    }
+
+    switch (ev->data1)
+    {
+        case KEY_LEFTARROW:
+            step = -10 * TICRATE;
+            break;
+        case KEY_RIGHTARROW:
+            step = 10 * TICRATE;
+            break;
+        case KEY_PGUP:
+            step = -60 * TICRATE;
+            break;
+        case KEY_PGDN:
+            step = 60 * TICRATE;
+            break;
+        default:
+            return false;
+    }
+
+    G_DemoSeek(defdemotics + step);
+
+    return true;
+}
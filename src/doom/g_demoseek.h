@@ -0,0 +1,38 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Demo seeking. While a demo plays, the world is snapshotted into
+//	memory every so often, so that seeking only has to restore the
+//	closest snapshot and play the tics after it without drawing.
+//
+
+#ifndef __G_DEMOSEEK__
+#define __G_DEMOSEEK__
+
+#include "d_event.h"
+
+// Frees the snapshots of the last demo. Call when a demo starts.
+void G_DemoSeekReset(void);
+
+// Called by G_Ticker before the commands of a tic are read.
+void G_DemoSnapshot(void);
+
+// Jumps to demo tic tic, as counted by defdemotics.
+void G_DemoSeek(int tic);
+
+// Seek keys during demo playback: left and right arrows for ten
+// seconds, page up and down for a minute.
+boolean G_DemoSeekResponder(event_t *ev);
+
+#endif
@@ -33,12 +33,15 @@
 #include "f_finale.h"
 #include "m_argv.h"
 #include "m_controls.h"
+#include "m_demostream.h" // [AP]
 #include "m_misc.h"
 #include "m_menu.h"
 #include "m_random.h"
+#include "m_savethread.h"
 #include "i_system.h"
 #include "i_timer.h"
 #include "i_input.h"
+#include "i_profile.h" // [AP]
 #include "i_swap.h"
 #include "i_video.h"
 
@@ -47,6 +50,7 @@
 #include "p_extsaveg.h"
 #include "p_tick.h"
 
+#include "d_bench.h" // [AP]
 #include "d_main.h"
 
 #include "wi_stuff.h"
@@ -75,6 +79,7 @@
 
 
 #include "g_game.h"
+#include "g_demoseek.h" // [AP]
 #include "v_trans.h" // [crispy] colored "always run" message
 
 #include "deh_main.h" // [crispy] for demo footer
@@ -137,6 +142,7 @@ boolean         turbodetected[MAXPLAYERS];
 int             consoleplayer;          // player taking events and displaying 
 int             displayplayer;          // view being displayed 
 int             levelstarttic;          // gametic at level start 
+static boolean  levelrestart;           // [AP] the level is loaded again because the player died
 int             totalkills, totalitems, totalsecret;    // for intermission 
 int             extrakills;             // [crispy] count spawned monsters
 int             totalleveltimes;        // [crispy] CPhipps - total time for all completed levels
@@ -811,14 +817,69 @@ void G_BuildTiccmd (ticcmd_t* cmd, int maketic)
  
 
 
+//
+// G_FastMouse
+// [AP] True while fast_mouse has the mouse read every frame.
+//
+boolean G_FastMouse (void)
+{
+    return fast_mouse && crispy->uncapped && !singletics
+        && gamestate == GS_LEVEL && !demoplayback && !menuactive && !paused;
+}
+
+//
+// G_PendingMouseView
+// [AP] The turn and lookdir change that the mouse has built up for the
+// next ticcmd, for R_SetupFrame to show before that ticcmd runs. False
+// if the view should just follow the player.
+//
+boolean G_PendingMouseView (player_t *player, angle_t *turn, int *look)
+{
+    signed short angleturn = 0;
+
+    // Low-res turning rounds the turn, so it wouldn't land where shown
+    if (!G_FastMouse() || lowres_turn
+     || player != &players[consoleplayer]
+     || player->playerstate != PST_LIVE || player->mo->reactiontime)
+    {
+        return false;
+    }
+
+    if (!(gamekeydown[key_strafe] || mousebuttons[mousebstrafe]
+       || joybuttons[joybstrafe]))
+    {
+        angleturn = -mousex*0x8;
+    }
+
+    if (crispy->fliplevels)
+    {
+        angleturn = -angleturn;
+    }
+
+    *turn = ((angle_t) angleturn) << FRACBITS;
+
+    if ((crispy->freelook && mousebuttons[mousebmouselook]) ||
+         crispy->mouselook)
+    {
+        *look = mouse_y_invert ? -mousey : mousey;
+    }
+    else
+    {
+        *look = 0;
+    }
+
+    return true;
+}
+
 //
 // G_DoLoadLevel 
 //
 void G_DoLoadLevel (void) 
 { 
     int             i; 
+    uint64_t        load_start; // [AP]
 
-    crispy->fliplevels = ap_get_level_state(ap_make_level_index(gameepisode, gamemap))->flipped ? true : false;
+    crispy->fliplevels = ap_get_current_level(gameepisode, gamemap)->state->flipped ? true : false;
     crispy->flipweapons = crispy->fliplevels;
     S_UpdateStereoSeparation();
     setsizeneeded = true;
@@ -920,7 +981,16 @@ void G_DoLoadLevel (void)
         }
     }
 
-    P_SetupLevel (gameepisode, gamemap, 0, gameskill);    
+    // [AP] -runlog; players who were dead are being reborn
+    StatLevelEnd(players[consoleplayer].playerstate == PST_REBORN
+                 ? "died" : "left");
+    load_start = I_GetTimeUS();
+
+    // [AP] Dying restarts the level from its snapshot
+    if (!levelrestart || !P_RestoreLevel (gameepisode, gamemap, gameskill))
+	P_SetupLevel (gameepisode, gamemap, 0, gameskill);
+    levelrestart = false;
+    StatLevelStart((unsigned int) (I_GetTimeUS() - load_start)); // [AP]
     displayplayer = consoleplayer;		// view the guy you are playing    
     gameaction = ga_nothing; 
     Z_CheckHeap ();
@@ -1020,6 +1090,12 @@ boolean G_Responder (event_t* ev)
         }
     }
 
+    // [AP] demo seeking
+    if (gameaction == ga_nothing && G_DemoSeekResponder(ev))
+    {
+        return true;
+    }
+
     // [crispy] demo fast-forward
     if (ev->type == ev_keydown && ev->data1 == key_demospeed && 
         (demoplayback || gamestate == GS_DEMOSCREEN))
@@ -1138,17 +1214,19 @@ boolean G_Responder (event_t* ev)
 	return false;   // always let key up events filter down 
 		 
       case ev_mouse: 
+        // [AP] Motion adds up until the next ticcmd takes it, as with
+        // fast_mouse there can be several events a tic
         SetMouseButtons(ev->data1);
 	if (mouseSensitivity)
-	mousex = ev->data2*(mouseSensitivity+5)/10; 
+	mousex += ev->data2*(mouseSensitivity+5)/10; 
 	else
 	    mousex = 0; // [crispy] disable entirely
 	if (mouseSensitivity_x2)
-	mousex2 = ev->data2*(mouseSensitivity_x2+5)/10; // [crispy] separate sensitivity for strafe
+	mousex2 += ev->data2*(mouseSensitivity_x2+5)/10; // [crispy] separate sensitivity for strafe
 	else
 	    mousex2 = 0; // [crispy] disable entirely
 	if (mouseSensitivity_y)
-	mousey = ev->data3*(mouseSensitivity_y+5)/10; // [crispy] separate sensitivity for y-axis
+	mousey += ev->data3*(mouseSensitivity_y+5)/10; // [crispy] separate sensitivity for y-axis
 	else
 	    mousey = 0; // [crispy] disable entirely
 	return true;    // eat events 
@@ -1207,7 +1285,7 @@ void set_ap_player_states()
     //p->secretcount = ap_state.player_state.secret_count;
     for (int i = 0; i < NUMPOWERS; ++i)
         p->powers[i] = ap_state.player_state.powers[i];
-    p->powers[pw_allmap] = ap_get_level_state(ap_make_level_index(gameepisode, gamemap))->has_map;
+    p->powers[pw_allmap] = ap_get_current_level(gameepisode, gamemap)->state->has_map;
     for (int i = 0; i < NUMWEAPONS; ++i)
         p->weaponowned[i] = ap_state.player_state.weapon_owned[i];
     for (int i = 0; i < NUMAMMO; ++i)
@@ -1216,8 +1294,8 @@ void set_ap_player_states()
         p->maxammo[i] = ap_state.player_state.max_ammo[i];
 
     // Cards
-    ap_level_state_t* level_state = ap_get_level_state(ap_make_level_index(gameepisode, gamemap));
-    ap_level_info_t* level_info = ap_get_level_info(ap_make_level_index(gameepisode, gamemap));
+    ap_level_state_t* level_state = ap_get_current_level(gameepisode, gamemap)->state;
+    ap_level_info_t* level_info = ap_get_current_level(gameepisode, gamemap)->info;
 
     p->cards[0] = level_state->keys[0] && !level_info->use_skull[0];
     p->cards[1] = level_state->keys[1] && !level_info->use_skull[1];
@@ -1245,6 +1323,8 @@ void G_Ticker (void)
     int		buf; 
     ticcmd_t*	cmd;
     player_t* p;
+
+    G_CheckSaveGameWritten(); // [AP]
     
     // do player reborns if needed
     for (i=0 ; i<MAXPLAYERS ; i++) 
@@ -1320,6 +1400,7 @@ void G_Ticker (void)
 	    gameaction = ga_nothing; 
 	    break; 
         case ga_levelselect:
+            StatLevelEnd("left"); // [AP]
             ShowLevelSelect();
             break;
 	  case ga_nothing: 
@@ -1334,6 +1415,8 @@ void G_Ticker (void)
     }
     else
     {     
+    G_DemoSnapshot(); // [AP] before this tic's commands are read
+
     // get commands, check consistancy,
     // and build new consistancy check
     buf = (gametic/ticdup)%BACKUPTICS; 
@@ -1464,7 +1547,10 @@ void G_Ticker (void)
     switch (gamestate) 
     { 
       case GS_LEVEL: 
+	I_ProfileBegin(PROFILE_TICKER); // [AP]
 	P_Ticker (); 
+	I_ProfileEnd(PROFILE_TICKER);
+	D_BenchmarkTic(); // [AP] -bench-sync
 	ST_Ticker (); 
 	AM_Ticker (); 
 	HU_Ticker ();
@@ -1477,6 +1563,12 @@ void G_Ticker (void)
                 HU_AddAPMessage("Death by Deathlink");
                 P_KillMobj_Real(NULL, players[consoleplayer].mo, false);
             }
+            if (players[consoleplayer].mo)
+            {
+                mobj_t *mo = players[consoleplayer].mo;
+                ap_report_player_position(mo->x >> FRACBITS, mo->y >> FRACBITS,
+                                          (int)((mo->angle >> 16) * 360 >> 16));
+            }
         }
 	break; 
 	 
@@ -1596,8 +1688,6 @@ void G_PlayerReborn (int player)
 // at the given mapthing_t spot  
 // because something is occupying it 
 //
-void P_SpawnPlayer (mapthing_t* mthing); 
- 
 boolean
 G_CheckSpot
 ( int		playernum,
@@ -1782,6 +1872,7 @@ void G_DoReborn (int playernum)
 	{
 	// reload the level from scratch
 	gameaction = ga_loadlevel;
+	levelrestart = true; // [AP]
 	G_ClearSavename();
 	}
     }
@@ -2011,7 +2102,8 @@ void G_DoCompleted (void)
 
     // [AP]
     cache_ap_player_state();
-    apdoom_complete_level(ap_make_level_index(gameepisode, gamemap));
+    apdoom_complete_level(ap_get_current_level(gameepisode, gamemap)->idx);
+    StatLevelEnd("completed");
     apdoom_save_state();
     G_DoSaveGame();
 
@@ -2372,8 +2464,10 @@ void G_DoLoadGame (void)
 	deathmatch = false;
     }
     gameaction = ga_nothing; 
+
+    G_FinishSaveGame(); // [AP] It may be the one being loaded
 	 
-    save_stream = M_fopen(savename, "rb");
+    save_stream = M_ReadSaveGame(savename);
 
     if (save_stream == NULL)
     {
@@ -2393,7 +2487,7 @@ void G_DoLoadGame (void)
             strcasecmp(savewadfilename, W_WadNameForLump(savemaplumpinfo)))
         {
             M_ForceLoadGame();
-            fclose(save_stream);
+            mem_fclose(save_stream);
             return;
         }
         else
@@ -2412,7 +2506,7 @@ void G_DoLoadGame (void)
         // [crispy] indicate game version mismatch
         extern void M_LoadGameVerMismatch ();
         M_LoadGameVerMismatch();
-        fclose(save_stream);
+        mem_fclose(save_stream);
         return;
     }
 
@@ -2432,6 +2526,7 @@ void G_DoLoadGame (void)
     P_UnArchiveThinkers (); 
     P_UnArchiveSpecials (); 
     P_RestoreTargets (); // [crispy] restore mobj->target and mobj->tracer pointers
+    AM_BuildLocations (); // [AP] the loaded things replaced the spawned ones
  
     if (!P_ReadSaveGameEOF())
 	I_Error ("Bad savegame");
@@ -2439,7 +2534,7 @@ void G_DoLoadGame (void)
     // [crispy] read more extended savegame data
     P_ReadExtendedSaveGameData(1);
 
-    fclose(save_stream);
+    mem_fclose(save_stream);
     
     if (setsizeneeded)
 	R_ExecuteSetViewSize ();
@@ -2506,8 +2601,52 @@ G_SaveGame
 
 void cache_ap_player_state(void);
 
+static char *recovery_savegame_file;
+
+// [AP] Savegames are written by a background thread; this reports how
+// the last one went once it's on disk.
+void G_CheckSaveGameWritten (void)
+{
+    switch (M_SaveThreadPoll())
+    {
+      case SAVETHREAD_DONE:
+        players[consoleplayer].message = DEH_String(GGSAVED);
+        break;
+
+      case SAVETHREAD_RECOVERED:
+        // We failed to save to the normal location, but we wrote a
+        // recovery file to the temp directory. Now we can bomb out
+        // with an error.
+        I_Error("Failed to open savegame file '%s' for writing.\n"
+                "But your game has been saved to '%s' for recovery.",
+                P_TempSaveGameFile(), recovery_savegame_file);
+        break;
+
+      case SAVETHREAD_FAILED:
+        I_Error("Failed to open either '%s' or '%s' to write savegame.",
+                P_TempSaveGameFile(), recovery_savegame_file);
+        break;
+
+      default:
+        break;
+    }
+}
+
+// [AP] Waits for the savegame being written, before it's read or
+// replaced
+void G_FinishSaveGame (void)
+{
+    M_SaveThreadWait();
+    G_CheckSaveGameWritten();
+}
+
 void G_DoSaveGame (void) 
 { 
+    void *savebuf;
+    byte *savedata;
+    size_t savelength;
+
+    G_FinishSaveGame();
     cache_ap_player_state();
 
     char filename[260];
@@ -2519,30 +2658,20 @@ void G_DoSaveGame (void)
 
     char *savegame_file;
     char *temp_savegame_file;
-    char *recovery_savegame_file;
 
-    recovery_savegame_file = NULL;
+    if (recovery_savegame_file == NULL)
+    {
+        recovery_savegame_file = M_TempFile("recovery.dsg");
+    }
+
     temp_savegame_file = P_TempSaveGameFile();
     savegame_file = filename;//P_SaveGameFile(savegameslot);
 
-    // Open the savegame file for writing.  We write to a temporary file
-    // and then rename it at the end if it was successfully written.
+    // The savegame is built in memory, then written to a temporary file
+    // and renamed at the end if it was successfully written.
     // This prevents an existing savegame from being overwritten by
     // a corrupted one, or if a savegame buffer overrun occurs.
-    save_stream = M_fopen(temp_savegame_file, "wb");
-
-    if (save_stream == NULL)
-    {
-        // Failed to save the game, so we're going to have to abort. But
-        // to be nice, save to somewhere else before we call I_Error().
-        recovery_savegame_file = M_TempFile("recovery.dsg");
-        save_stream = M_fopen(recovery_savegame_file, "wb");
-        if (save_stream == NULL)
-        {
-            I_Error("Failed to open either '%s' or '%s' to write savegame.",
-                    temp_savegame_file, recovery_savegame_file);
-        }
-    }
+    save_stream = mem_fopen_write();
 
     savegame_error = false;
 
@@ -2574,38 +2703,30 @@ void G_DoSaveGame (void)
     // Enforce the same savegame size limit as in Vanilla Doom,
     // except if the vanilla_savegame_limit setting is turned off.
 
-    if (vanilla_savegame_limit && ftell(save_stream) > SAVEGAMESIZE)
+    if (vanilla_savegame_limit && mem_ftell(save_stream) > SAVEGAMESIZE)
     {
         I_Error("Savegame buffer overrun");
     }
     */
 
-    // Finish up, close the savegame file.
-
-    fclose(save_stream);
-
-    if (recovery_savegame_file != NULL)
-    {
-        // We failed to save to the normal location, but we wrote a
-        // recovery file to the temp directory. Now we can bomb out
-        // with an error.
-        I_Error("Failed to open savegame file '%s' for writing.\n"
-                "But your game has been saved to '%s' for recovery.",
-                temp_savegame_file, recovery_savegame_file);
-    }
+    // Finish up. The writer thread takes a copy of the buffer, writes it
+    // to the temporary file and then renames that to the actual savegame
+    // file, overwriting the old savegame if there was one there. If it
+    // can't, it saves to somewhere else before G_CheckSaveGameWritten
+    // calls I_Error().
 
-    // Now rename the temporary savegame file to the actual savegame
-    // file, overwriting the old savegame if there was one there.
+    mem_get_buf(save_stream, &savebuf, &savelength);
+    savedata = malloc(savelength);
+    memcpy(savedata, savebuf, savelength);
+    mem_fclose(save_stream);
 
-    M_remove(savegame_file);
-    M_rename(temp_savegame_file, savegame_file);
+    M_SaveThreadWrite(savedata, savelength, temp_savegame_file,
+                      savegame_file, recovery_savegame_file);
 
     gameaction = ga_nothing;
     M_StringCopy(savedescription, "", sizeof(savedescription));
     M_StringCopy(savename, savegame_file, sizeof(savename));
 
-    players[consoleplayer].message = DEH_String(GGSAVED);
-
     // draw the pattern into the back screen
     R_FillBackScreen ();
 }
@@ -2885,8 +3006,108 @@ int defdemotics = 0, deftotaldemotics;
 // [crispy] moved here
 static const char *defdemoname;
 
+// [AP] -streamdemo: the demo goes out to demo_writer every DEMOBLOCKTICS
+// ticcmds, so demobuffer only holds the block being recorded.
+#define DEMOBLOCKTICS (10 * TICRATE)
+
+static demowriter_t *demo_writer;
+static int demo_block_ticcmds;
+
+// [AP] Playing a streamed demo: its blocks are decoded into demobuffer as
+// playback reaches them. Past demo_stream_end, demobuffer is filled with
+// DEMOMARKER, so a demo cut short by a crash just ends there.
+static boolean demo_streaming;
+static demoreader_t demo_reader;
+static byte *demo_stream_end;
+
+static void GrowDemoStream(size_t length)
+{
+    size_t old_length = demoend - demobuffer;
+    size_t new_length = old_length * 2;
+    byte *new_demobuffer;
+
+    while (new_length < length)
+    {
+        new_length *= 2;
+    }
+
+    new_demobuffer = Z_Malloc(new_length, PU_STATIC, NULL);
+    memcpy(new_demobuffer, demobuffer, old_length);
+    memset(new_demobuffer + old_length, DEMOMARKER, new_length - old_length);
+
+    demo_p = new_demobuffer + (demo_p - demobuffer);
+    demo_stream_end = new_demobuffer + (demo_stream_end - demobuffer);
+    Z_Free(demobuffer);
+    demobuffer = new_demobuffer;
+    demoend = demobuffer + new_length;
+}
+
+// Decodes blocks until there are count bytes at demo_p.
+
+static void ReadDemoStream(size_t count)
+{
+    size_t length;
+
+    if (!demo_streaming)
+    {
+        return;
+    }
+
+    if ((size_t) (demoend - demo_p) < count)
+    {
+        GrowDemoStream((demo_p - demobuffer) + count);
+    }
+
+    while ((size_t) (demo_stream_end - demo_p) < count
+        && (length = M_DemoReaderNextSize(&demo_reader)) > 0)
+    {
+        if ((size_t) (demoend - demo_stream_end) < length)
+        {
+            GrowDemoStream((demo_stream_end - demobuffer) + length);
+        }
+
+        if (!M_DemoReaderNext(&demo_reader, demo_stream_end))
+        {
+            fprintf(stderr, "ReadDemoStream: Damaged block in %s\n",
+                    defdemoname);
+            memset(demo_stream_end, DEMOMARKER, length);
+            demo_reader.pos = demo_reader.length;
+            break;
+        }
+
+        demo_stream_end += length;
+    }
+}
+
+// Drops the decoded demo, or with keep, hands it over to demo recording.
+
+static void StopDemoStream(boolean keep)
+{
+    if (demo_streaming && !keep)
+    {
+        Z_Free(demobuffer);
+        demobuffer = demo_p = demoend = NULL;
+    }
+
+    demo_streaming = false;
+}
+
+static void FlushDemoBlock(void)
+{
+    if (!M_DemoWriterBlock(demo_writer, demobuffer, demo_p - demobuffer,
+                           demo_block_ticcmds))
+    {
+        I_Error("Failed to record Demo %s", demoname);
+    }
+
+    demo_p = demobuffer;
+    demo_block_ticcmds = 0;
+}
+
 void G_ReadDemoTiccmd (ticcmd_t* cmd) 
 { 
+    ReadDemoStream(5); // [AP]
+
     if (*demo_p == DEMOMARKER) 
     {
 	last_cmd = cmd; // [crispy] remember last cmd to track joins
@@ -2941,7 +3162,10 @@ void G_ReadDemoTiccmd (ticcmd_t* cmd)
 
 // Increase the size of the demo buffer to allow unlimited demos
 
-static void IncreaseDemoBuffer(void)
+// [AP] The old buffer is freed only if it's ours; a demo lump being
+// continued may be mapped straight from the WAD.
+
+static void IncreaseDemoBuffer(boolean freeold)
 {
     int current_length;
     byte *new_demobuffer;
@@ -2964,7 +3188,10 @@ static void IncreaseDemoBuffer(void)
 
     // Free the old buffer and point the demo pointers at the new buffer.
 
-    Z_Free(demobuffer);
+    if (freeold)
+    {
+        Z_Free(demobuffer);
+    }
 
     demobuffer = new_demobuffer;
     demo_p = new_demop;
@@ -2978,6 +3205,12 @@ void G_WriteDemoTiccmd (ticcmd_t* cmd)
     if (gamekeydown[key_demo_quit])           // press q to end demo recording 
 	G_CheckDemoStatus (); 
 
+    // [AP] -streamdemo
+    if (demo_writer != NULL && demo_block_ticcmds >= DEMOBLOCKTICS)
+    {
+        FlushDemoBlock();
+    }
+
     demo_start = demo_p;
 
     *demo_p++ = cmd->forwardmove; 
@@ -3016,11 +3249,13 @@ void G_WriteDemoTiccmd (ticcmd_t* cmd)
             // Vanilla demo limit disabled: unlimited
             // demo lengths!
 
-            IncreaseDemoBuffer();
+            IncreaseDemoBuffer(true);
         }
     } 
 	
     G_ReadDemoTiccmd (cmd);         // make SURE it is exactly the same 
+
+    ++demo_block_ticcmds; // [AP]
 } 
  
  
@@ -3133,6 +3368,26 @@ void G_BeginRecording (void)
 	 
     for (i=0 ; i<MAXPLAYERS ; i++) 
 	*demo_p++ = playeringame[i]; 		 
+
+    //!
+    // @category demo
+    //
+    // Write the demo being recorded out every ten seconds, compressed
+    // if possible, so that a crash loses at most the last ten seconds
+    // of it. Not used when continuing a demo.
+    //
+
+    // [AP]
+    if (M_ParmExists("-streamdemo"))
+    {
+        demo_writer = M_DemoWriterOpen(demoname);
+        demo_block_ticcmds = 0;
+
+        if (demo_writer == NULL)
+        {
+            I_Error("G_BeginRecording: Unable to write %s", demoname);
+        }
+    }
 } 
  
 
@@ -3143,7 +3398,10 @@ void G_BeginRecording (void)
  
 void G_DeferedPlayDemo(const char *name)
 { 
-    return; // [AP] Don't play demo. Picking up items in the demo will break our state!
+    // [AP] Don't play demo. Picking up items in the demo will break our state!
+    // -playdemo is offline, so it has no state to break.
+    if (!singledemo)
+        return;
 
     defdemoname = name; 
     gameaction = ga_playdemo; 
@@ -3205,6 +3463,9 @@ void G_DoPlayDemo (void)
     int demoversion;
     boolean olddemo = false;
     int lumplength; // [crispy]
+    byte *lump; // [AP]
+
+    StopDemoStream(false); // [AP]
 
     // [crispy] in demo continue mode free the obsolete demo buffer
     // of size 'maxsize' previously allocated in G_RecordDemo()
@@ -3215,11 +3476,27 @@ void G_DoPlayDemo (void)
 
     lumpnum = W_GetNumForName(defdemoname);
     gameaction = ga_nothing;
-    demobuffer = W_CacheLumpNum(lumpnum, PU_STATIC);
+    lump = W_CacheLumpNum(lumpnum, PU_STATIC);
+    lumplength = W_LumpLength(lumpnum);
+    demobuffer = lump;
+
+    // [AP] A streamed demo is decoded as it plays
+    if (M_IsDemoStream(lump, lumplength))
+    {
+        M_DemoReaderInit(&demo_reader, lump, lumplength);
+        demobuffer = Z_Malloc(0x20000, PU_STATIC, NULL);
+        demoend = demobuffer + 0x20000;
+        memset(demobuffer, DEMOMARKER, demoend - demobuffer);
+        demo_p = demo_stream_end = demobuffer;
+        demo_streaming = true;
+
+        ReadDemoStream(0xd);
+        lumplength = demo_stream_end - demobuffer;
+    }
+
     demo_p = demobuffer;
 
     // [crispy] ignore empty demo lumps
-    lumplength = W_LumpLength(lumpnum);
     if (lumplength < 0xd)
     {
 	demoplayback = true;
@@ -3340,12 +3617,23 @@ void G_DoPlayDemo (void)
 
 	deftotaldemotics = defdemotics = 0;
 
-	while (*demo_ptr != DEMOMARKER && (demo_ptr - demobuffer) < lumplength)
+	// [AP] The blocks of a streamed demo say how many ticcmds they hold
+	if (demo_streaming)
+	{
+	    deftotaldemotics = M_DemoStreamTiccmds(lump, W_LumpLength(lumpnum))
+	                     / numplayersingame;
+	}
+	else
 	{
-	    demo_ptr += numplayersingame * (longtics ? 5 : 4);
-	    deftotaldemotics++;
+	    while (*demo_ptr != DEMOMARKER && (demo_ptr - demobuffer) < lumplength)
+	    {
+		demo_ptr += numplayersingame * (longtics ? 5 : 4);
+		deftotaldemotics++;
+	    }
 	}
     }
+
+    G_DemoSeekReset(); // [AP]
 } 
 
 //
@@ -3353,7 +3641,10 @@ void G_DoPlayDemo (void)
 //
 void G_TimeDemo (char* name) 
 {
-    return; // [AP] Don't play demo. Picking up items in the demo will break our state!
+    // [AP] Don't play demo. Picking up items in the demo will break our state!
+    // A benchmark is offline, so it has no state to break.
+    if (!benchmark)
+        return;
 
     //!
     // @category video
@@ -3362,7 +3653,7 @@ void G_TimeDemo (char* name)
     // Disable rendering the screen entirely.
     //
 
-    nodrawers = M_CheckParm ("-nodraw");
+    nodrawers = M_CheckParm ("-nodraw") || simbench; // [AP]
 
     timingdemo = true; 
     singletics = true; 
@@ -3434,7 +3725,7 @@ static void G_AddDemoFooter(void)
 
     while (demo_p > demoend - len)
     {
-        IncreaseDemoBuffer();
+        IncreaseDemoBuffer(true);
     }
 
     memcpy(demo_p, tmp, len);
@@ -3473,6 +3764,20 @@ boolean G_CheckDemoStatus (void)
         // Prevent recursive calls
         timingdemo = false;
         demoplayback = false;
+        StopDemoStream(false); // [AP]
+
+        // [AP] -benchmark plays the demo again, or quits with its results
+        if (benchmark)
+        {
+            W_ReleaseLumpName(defdemoname);
+
+            if (D_BenchmarkNextIteration())
+            {
+                G_TimeDemo((char *) defdemoname);
+            }
+
+            return true;
+        }
 
 	I_Error ("timed %i gametics in %i realtics (%f fps)",
                  gametic, realtics, fps);
@@ -3499,8 +3804,10 @@ boolean G_CheckDemoStatus (void)
         // continue recording once we are done with playback
         if (demorecording)
         {
+            // [AP] The old buffer is ours if the demo was a stream
             demoend = demo_p;
-            IncreaseDemoBuffer();
+            IncreaseDemoBuffer(demo_streaming);
+            StopDemoStream(true);
 
             nodrawers = false;
             singletics = false;
@@ -3520,6 +3827,8 @@ boolean G_CheckDemoStatus (void)
             return true;
         }
 
+        StopDemoStream(false); // [AP]
+
         if (singledemo) 
             I_Quit (); 
         else 
@@ -3535,7 +3844,18 @@ boolean G_CheckDemoStatus (void)
 
 	*demo_p++ = DEMOMARKER; 
 	G_AddDemoFooter();
-	success = M_WriteFile (demoname, demobuffer, demo_p - demobuffer);
+	// [AP] -streamdemo writes the last block
+	if (demo_writer != NULL)
+	{
+	    success = M_DemoWriterBlock(demo_writer, demobuffer,
+	                                demo_p - demobuffer, demo_block_ticcmds);
+	    success = M_DemoWriterClose(demo_writer) && success;
+	    demo_writer = NULL;
+	}
+	else
+	{
+	    success = M_WriteFile (demoname, demobuffer, demo_p - demobuffer);
+	}
 	msg = success ? "Demo %s recorded%c" : "Failed to record Demo %s%c";
 	Z_Free (demobuffer); 
 	demorecording = false; 
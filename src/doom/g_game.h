@@ -22,6 +22,7 @@
 
 #include "doomdef.h"
 #include "d_event.h"
+#include "d_player.h"
 #include "d_ticcmd.h"
 #include "m_fixed.h"
 
@@ -48,6 +49,8 @@ void G_DoLoadGame (void);
 
 // Called by M_Responder.
 void G_SaveGame (int slot, char* description);
+void G_CheckSaveGameWritten (void); // [AP]
+void G_FinishSaveGame (void); // [AP]
 
 // Only called by startup code.
 void G_RecordDemo (const char* name);
@@ -67,6 +70,11 @@ void G_WorldDone (void);
 
 void G_BuildTiccmd (ticcmd_t *cmd, int maketic); 
 
+// [AP] fast_mouse: the mouse is also read every frame, and the view shows
+// the turn it has built up before the ticcmd carrying it runs.
+boolean G_FastMouse (void);
+boolean G_PendingMouseView (player_t *player, angle_t *turn, int *look);
+
 void G_Ticker (void);
 boolean G_Responder (event_t*	ev);
 
@@ -17,6 +17,8 @@
 
 
 #include <ctype.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "doomdef.h"
 #include "doomkeys.h"
@@ -126,9 +128,9 @@ int HULib_measureText(const char* text, int len)
 	return x;
 }
 
-void
-HUlib_drawTextLine
-( hu_textline_t*	l,
+static void
+HUlib_drawTextLineDirect
+( const hu_textline_t*	l,
   boolean		drawcursor )
 {
 
@@ -196,6 +198,63 @@ HUlib_drawTextLine
     dp_translation = NULL;
 }
 
+// [AP] Text lines are drawn through V_DrawLayer, keyed on the text and
+// everything else that decides how it looks.
+
+typedef struct
+{
+    int		x;
+    int		y;
+    patch_t**	f;
+    int		sc;
+    boolean	drawcursor;
+    byte*	translation;
+    int		coloredtext;
+    int		widescreendelta;
+    int		len;
+    char	l[HU_MAXLINELENGTH+1];
+} textlinekey_t;
+
+typedef struct
+{
+    const hu_textline_t*	l;
+    boolean			drawcursor;
+} textlinedraw_t;
+
+static void HUlib_drawTextLineLayer(void *data)
+{
+    const textlinedraw_t *draw = data;
+
+    HUlib_drawTextLineDirect(draw->l, draw->drawcursor);
+}
+
+void
+HUlib_drawTextLine
+( hu_textline_t*	l,
+  boolean		drawcursor )
+{
+    textlinekey_t	key;
+    textlinedraw_t	draw;
+
+    memset(&key, 0, sizeof(key));
+    key.x = l->x;
+    key.y = l->y;
+    key.f = l->f;
+    key.sc = l->sc;
+    key.drawcursor = drawcursor;
+    key.translation = dp_translation;
+    key.coloredtext = crispy->coloredhud & COLOREDHUD_TEXT;
+    key.widescreendelta = WIDESCREENDELTA;
+    key.len = l->len;
+    memcpy(key.l, l->l, l->len);
+
+    draw.l = l;
+    draw.drawcursor = drawcursor;
+
+    V_DrawLayer(&key, offsetof(textlinekey_t, l) + l->len,
+		HUlib_drawTextLineLayer, &draw);
+}
+
 void HUlib_drawText(const char* text, int x, int y)
 {
     int			i;
@@ -26,6 +26,8 @@
 
 #include "deh_main.h"
 #include "i_input.h"
+#include "i_profile.h"
+#include "i_soundstats.h"
 #include "i_swap.h"
 #include "i_video.h"
 
@@ -54,6 +56,7 @@
 #include "i_swap.h"
 
 #include "apdoom.h"
+#include "ap_msg_log.h"
 
 //
 // Locally used constants, shortcuts.
@@ -101,6 +104,9 @@ static hu_textline_t	w_coordx;
 static hu_textline_t	w_coordy;
 static hu_textline_t	w_coorda;
 static hu_textline_t	w_fps;
+static hu_textline_t	w_sndstats[4]; // [AP] -audiostats, under the FPS
+static hu_textline_t	w_profile[NUMPROFILEPHASES + 2]; // [AP] -profile, under those
+static hu_textline_t	w_zonestats[PU_NUM_TAGS + 1]; // [AP] -zonestats, on the left
 boolean			chat_on;
 static hu_itext_t	w_chat;
 static boolean		always_off = false;
@@ -120,9 +126,6 @@ static hu_stext_t   w_ap_messages[4];
 static boolean      ap_message_ons[4];
 static int		ap_message_counters[4];
 
-static char ap_message_buffer[HU_MAX_LINE_BUFFER][HU_MAXLINELENGTH + 1];
-static int ap_message_buffer_count = 0;
-
 static int ap_message_anim = 0;
 
 
@@ -692,6 +695,30 @@ void HU_Start(void)
 		       hu_font,
 		       HU_FONTSTART);
 
+    for (i = 0; i < arrlen(w_sndstats); i++)
+    {
+	HUlib_initTextLine(&w_sndstats[i],
+			   HU_COORDX, HU_MSGY + (4 + i) * 8,
+			   hu_font,
+			   HU_FONTSTART);
+    }
+
+    for (i = 0; i < arrlen(w_profile); i++)
+    {
+	HUlib_initTextLine(&w_profile[i],
+			   HU_COORDX, HU_MSGY + (8 + i) * 8,
+			   hu_font,
+			   HU_FONTSTART);
+    }
+
+    for (i = 0; i < arrlen(w_zonestats); i++)
+    {
+	HUlib_initTextLine(&w_zonestats[i],
+			   HU_TITLEX, HU_MSGY + (6 + i) * 8,
+			   hu_font,
+			   HU_FONTSTART);
+    }
+
     
     switch ( logical_gamemission )
     {
@@ -840,6 +867,7 @@ static void HU_DrawCrosshair (void)
 
 void HU_Drawer(void)
 {
+    int i;
 
     if (crispy->cleanscreenshot)
     {
@@ -910,6 +938,15 @@ void HU_Drawer(void)
     if (plr->powers[pw_showfps])
     {
 	HUlib_drawTextLine(&w_fps, false);
+
+	for (i = 0; i < arrlen(w_sndstats); i++)
+	    HUlib_drawTextLine(&w_sndstats[i], false);
+
+	for (i = 0; i < arrlen(w_profile); i++)
+	    HUlib_drawTextLine(&w_profile[i], false);
+
+	for (i = 0; i < arrlen(w_zonestats); i++)
+	    HUlib_drawTextLine(&w_zonestats[i], false);
     }
 
     if (crispy->crosshair == CROSSHAIR_STATIC)
@@ -952,6 +989,12 @@ void HU_Erase(void)
     HUlib_eraseTextLine(&w_coordy);
     HUlib_eraseTextLine(&w_coorda);
     HUlib_eraseTextLine(&w_fps);
+    for (int i = 0; i < arrlen(w_sndstats); i++)
+        HUlib_eraseTextLine(&w_sndstats[i]);
+    for (int i = 0; i < arrlen(w_profile); i++)
+        HUlib_eraseTextLine(&w_profile[i]);
+    for (int i = 0; i < arrlen(w_zonestats); i++)
+        HUlib_eraseTextLine(&w_zonestats[i]);
 
 }
 
@@ -998,7 +1041,7 @@ void HU_ClearAPMessages()
 {
 #if 0
     // Keep the last 3 ones in case they are important, but remove the queue.
-    while (HU_GetActiveAPMessageCount() > 3 && ap_message_buffer_count)
+    while (HU_GetActiveAPMessageCount() > 3 && ap_msg_log_count())
     {
         // Shift currents
         for (int i = 3; i > 0; --i)
@@ -1008,21 +1051,15 @@ void HU_ClearAPMessages()
             ap_message_counters[i] = ap_message_counters[i - 1];
             ap_message_ons[i] = ap_message_ons[i - 1];
         }
-	    HUlib_addMessageToSText(&w_ap_messages[0], 0, ap_message_buffer[0]);
+	    HUlib_addMessageToSText(&w_ap_messages[0], 0, ap_msg_log_front());
 	    ap_message_ons[0] = true;
 	    ap_message_counters[0] = HU_APMSGTIMEOUT;
-
-        // Shift buffers
-        for (int i = 1; i < ap_message_buffer_count; ++i)
-        {
-            memcpy(ap_message_buffer[i - 1], ap_message_buffer[i], HU_MAXLINELENGTH + 1);
-        }
-        ap_message_buffer_count--;
+        ap_msg_log_pop();
     }
 #else // Clear everything
     for (int i = 0; i < 4; ++i)
         ap_message_ons[i] = false;
-    ap_message_buffer_count = 0;
+    ap_msg_log_clear();
 #endif
     ap_message_anim = 0;
 }
@@ -1041,66 +1078,24 @@ void HU_InitAPMessages()
 
 void HU_AddAPLine(const char* line, int len)
 {
-    char baked_line[HU_MAXLINELENGTH + 1];
-    memcpy(baked_line, line, len);
-    baked_line[len] = '\0';
-
-    // Add to buffer
-    if (ap_message_buffer_count >= HU_MAX_LINE_BUFFER)
-        return; // No more room
-    memcpy(ap_message_buffer[ap_message_buffer_count], baked_line, len + 1);
-    ap_message_buffer_count++;
+    ap_msg_log_push(line, len);
 }
 
 void HU_AddAPMessage(const char* message)
 {
-    int len = strlen(message);
-
-    int i = 0;
-    int j = 0;
-    char baked_line[HU_MAXLINELENGTH + 1];
-    baked_line[HU_MAXLINELENGTH] = '\0';
-    int word_start = 0;
-    while (i < len)
+    static int glyph_widths[256];
+    static boolean glyph_widths_set = false;
+
+    if (!glyph_widths_set)
     {
-        if (message[j] == ' ')
-        {
-            word_start = j;
-        }
-        if (message[j] != '\n')
-        {
-            int w = HULib_measureText(message + i, j - i);
-            if (w >= ORIGWIDTH + WIDESCREENDELTA - 8 && word_start == i)
-            {
-                if (j > i && word_start == i) --j;
-            }
-            else
-            {
-                if (w < ORIGWIDTH + WIDESCREENDELTA - 8 && (j - i) + 2 < HU_MAXLINELENGTH && j < len)
-                {
-                    j++;
-                    continue;
-                }
-                if (j < len) j = word_start;
-            }
-        }
-        else
-        {
-            j++;
-            word_start = j;
-        }
-        memcpy(baked_line + 2, message + i, j - i);
-        baked_line[0] = '~'; baked_line[1] = '2'; // Always make sure to use white
-        HU_AddAPLine(baked_line, (j - i) + 2);
-        i = j;
-        word_start = j;
-        while (message[i] == ' ')
+        for (int c = 0; c < 256; ++c)
         {
-            i++;
-            j++;
-            word_start++;
+            char glyph[2] = {(char)c, '\0'};
+            glyph_widths[c] = (c > ' ' && c < 127) ? HULib_measureText(glyph, 1) : 4;
         }
+        glyph_widths_set = true;
     }
+    ap_msg_log_push_wrapped(message, glyph_widths, ORIGWIDTH + WIDESCREENDELTA - 8);
 }
 
 void HU_DrawAPMessages()
@@ -1160,7 +1155,7 @@ void HU_TickAPMessages()
     test--;
 #endif
 
-    while (HU_HasAPMessageRoom() && ap_message_buffer_count && ap_message_anim == 0)
+    while (HU_HasAPMessageRoom() && ap_msg_log_count() && ap_message_anim == 0)
     {
         // Shift currents
         for (int i = 3; i > 0; --i)
@@ -1170,16 +1165,10 @@ void HU_TickAPMessages()
             ap_message_counters[i] = ap_message_counters[i - 1];
             ap_message_ons[i] = ap_message_ons[i - 1];
         }
-	    HUlib_addMessageToSText(&w_ap_messages[0], 0, ap_message_buffer[0]);
+	    HUlib_addMessageToSText(&w_ap_messages[0], 0, ap_msg_log_front());
 	    ap_message_ons[0] = true;
 	    ap_message_counters[0] = HU_APMSGTIMEOUT;
-
-        // Shift buffers
-        for (int i = 1; i < ap_message_buffer_count; ++i)
-        {
-            memcpy(ap_message_buffer[i - 1], ap_message_buffer[i], HU_MAXLINELENGTH + 1);
-        }
-        ap_message_buffer_count--;
+        ap_msg_log_pop();
     }
 
     if (ap_message_anim == 0)
@@ -1188,11 +1177,11 @@ void HU_TickAPMessages()
         {
             if (ap_message_counters[i])
             {
-                ap_message_counters[i] -= max(1, ap_message_buffer_count / 6);
+                ap_message_counters[i] -= max(1, ap_msg_log_count() / 6);
                 if (ap_message_counters[i] <= 0)
                 {
                     ap_message_counters[i] = 0;
-                    // ap_message_buffer_count
+                    // ap_msg_log_count()
                     ap_message_ons[i] = false;
                     ap_message_anim = 8;
                     break;
@@ -1207,7 +1196,7 @@ void HU_TickAPMessages()
 
     if (ap_message_anim > 0)
     {
-        ap_message_anim -= min(4, max(1, ap_message_buffer_count / 10));
+        ap_message_anim -= min(4, max(1, ap_msg_log_count() / 10));
         if (ap_message_anim < 0) ap_message_anim = 0;
     }
 }
@@ -1373,8 +1362,8 @@ void HU_Ticker(void)
 	    HUlib_addCharToTextLine(&w_kills, *(s++));
 
     // AP replaced items with AP items
-    ap_level_state_t* level_state = ap_get_level_state(ap_make_level_index(gameepisode, gamemap));
-    const ap_level_info_t* level_info = ap_get_level_info(ap_make_level_index(gameepisode, gamemap));
+    ap_level_state_t* level_state = ap_get_current_level(gameepisode, gamemap)->state;
+    const ap_level_info_t* level_info = ap_get_current_level(gameepisode, gamemap)->info;
 	crispy_statsline(str, sizeof(str), "I\t", level_state->check_count, level_info->check_count - level_info->sanity_check_count, 0);
 	HUlib_clearTextLine(&w_items);
 	s = str;
@@ -1450,6 +1439,48 @@ void HU_Ticker(void)
 	s = str;
 	while (*s)
 	    HUlib_addCharToTextLine(&w_fps, *(s++));
+
+	for (i = 0; i < arrlen(w_sndstats); i++)
+	{
+	    char sndstr[40];
+
+	    HUlib_clearTextLine(&w_sndstats[i]);
+
+	    if (!I_SoundStatsText(i, sndstr, sizeof(sndstr)))
+		continue;
+
+	    s = sndstr;
+	    while (*s)
+		HUlib_addCharToTextLine(&w_sndstats[i], *(s++));
+	}
+
+	for (i = 0; i < arrlen(w_profile); i++)
+	{
+	    char profstr[40];
+
+	    HUlib_clearTextLine(&w_profile[i]);
+
+	    if (!I_ProfileText(i, profstr, sizeof(profstr)))
+		continue;
+
+	    s = profstr;
+	    while (*s)
+		HUlib_addCharToTextLine(&w_profile[i], *(s++));
+	}
+
+	for (i = 0; i < arrlen(w_zonestats); i++)
+	{
+	    char zonestr[40];
+
+	    HUlib_clearTextLine(&w_zonestats[i]);
+
+	    if (!Z_StatsText(i, zonestr, sizeof(zonestr)))
+		continue;
+
+	    s = zonestr;
+	    while (*s)
+		HUlib_addCharToTextLine(&w_zonestats[i], *(s++));
+	}
     }
 }
 
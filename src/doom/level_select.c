@@ -30,6 +30,8 @@
 #include "m_misc.h"
 #include "hu_lib.h"
 #include "hu_stuff.h"
+#include "p_local.h"
+#include "wi_stuff.h"
 #include <math.h>
 #include "m_controls.h"
 
@@ -209,20 +211,131 @@ static const char* YELLOW_DIGIT_LUMP_NAMES[] = {
 };
 
 
+// Lumps the stats overlay draws, resolved once per cache rebuild instead of
+// looked up by name for every patch. Held PU_STATIC while cached.
+static patch_t* yellow_digit_patches[10];
+static patch_t* keybg_patch;
+static patch_t* checkmrk_patch;
+static patch_t* styslash_patch;
+static patch_t* wisplat_patch;
+static patch_t* wilock_patch;
+static patch_t* key_patches[3];
+static patch_t* key_skull_patches[3];
+
+
+#define MAX_LEVEL_SELECT_MAPS 11
+
+
+// What DrawEpisodicLevelSelectStats shows for one level. Only changes with
+// the AP state, so it's rebuilt when ap_get_state_version() moves.
+typedef struct
+{
+    int completed;
+    int unlocked;
+    int key_count;
+    patch_t* keys[3]; // key_count entries, skull or card
+    int has_key[3];
+    int check_count;
+    int check_total;
+    patch_t* img; // NULL if level_pos_t::img is
+    patch_t* urhere;
+} level_select_stats_t;
+
+static level_select_stats_t level_select_stats[MAX_LEVEL_SELECT_MAPS];
+static int level_select_stats_count;
+static int level_select_stats_ep = -1;
+static unsigned level_select_stats_version;
+
+
+static void cache_level_select_patches()
+{
+    char name[9];
+
+    for (int i = 0; i < 10; ++i)
+        yellow_digit_patches[i] = W_CacheLumpName(YELLOW_DIGIT_LUMP_NAMES[i], PU_STATIC);
+    for (int i = 0; i < 3; ++i)
+    {
+        snprintf(name, 9, "STKEYS%d", i);
+        key_patches[i] = W_CacheLumpName(name, PU_STATIC);
+        snprintf(name, 9, "STKEYS%d", i + 3);
+        key_skull_patches[i] = W_CacheLumpName(name, PU_STATIC);
+    }
+    keybg_patch = W_CacheLumpName("KEYBG", PU_STATIC);
+    checkmrk_patch = W_CacheLumpName("CHECKMRK", PU_STATIC);
+    styslash_patch = W_CacheLumpName("STYSLASH", PU_STATIC);
+    wisplat_patch = W_CacheLumpName("WISPLAT", PU_STATIC);
+    wilock_patch = W_CacheLumpName("WILOCK", PU_STATIC);
+}
+
+
+static void invalidate_level_select_stats()
+{
+    level_select_stats_ep = -1;
+}
+
+
+static const level_select_stats_t* get_level_select_stats(int* count)
+{
+    unsigned version = ap_get_state_version();
+
+    if (level_select_stats_ep != selected_ep || level_select_stats_version != version)
+    {
+        int map_count = ap_get_map_count(selected_ep + 1);
+        if (map_count > MAX_LEVEL_SELECT_MAPS) map_count = MAX_LEVEL_SELECT_MAPS;
+        if (map_count < 0) map_count = 0;
+
+        // Something else may have dropped our lumps to PU_CACHE since
+        cache_level_select_patches();
+
+        for (int i = 0; i < map_count; ++i)
+        {
+            const level_pos_t* level_pos = get_level_pos_info(selected_ep, i);
+            ap_level_index_t idx = {selected_ep, i};
+            ap_level_info_t* ap_level_info = ap_get_level_info(idx);
+            ap_level_state_t* ap_level_state = ap_get_level_state(idx);
+            level_select_stats_t* stats = &level_select_stats[i];
+
+            stats->completed = ap_level_state->completed;
+            stats->unlocked = ap_level_state->unlocked;
+            stats->key_count = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                if (!ap_level_info->keys[k])
+                    continue;
+                stats->keys[stats->key_count] = ap_level_info->use_skull[k] ? key_skull_patches[k] : key_patches[k];
+                stats->has_key[stats->key_count] = ap_level_state->keys[k];
+                stats->key_count++;
+            }
+            stats->check_count = ap_level_state->check_count;
+            stats->check_total = ap_get_level_check_total(idx);
+            stats->img = level_pos->img ? W_CacheLumpName(level_pos->img, PU_STATIC) : NULL;
+            stats->urhere = W_CacheLumpName(level_pos->urhere_lump_name, PU_STATIC);
+        }
+
+        level_select_stats_count = map_count;
+        level_select_stats_ep = selected_ep;
+        level_select_stats_version = version;
+    }
+
+    *count = level_select_stats_count;
+    return level_select_stats;
+}
+
+
 void print_right_aligned_yellow_digit(int x, int y, int digit)
 {
     x -= 4;
 
     if (!digit)
     {
-        V_DrawPatch(x, y, W_CacheLumpName(YELLOW_DIGIT_LUMP_NAMES[0], PU_CACHE));
+        V_DrawPatch(x, y, yellow_digit_patches[0]);
         return;
     }
 
     while (digit)
     {
         int i = digit % 10;
-        V_DrawPatch(x, y, W_CacheLumpName(YELLOW_DIGIT_LUMP_NAMES[i], PU_CACHE));
+        V_DrawPatch(x, y, yellow_digit_patches[i]);
         x -= 4;
         digit /= 10;
     }
@@ -264,6 +377,7 @@ void play_level(int ep, int lvl)
     lvl = ap_index_to_map(idx);
 
     // Check if level has a save file first
+    G_FinishSaveGame();
     char filename[260];
     if (gamemode != commercial)
         snprintf(filename, 260, "%s/save_E%iM%i.dsg", apdoom_get_seed(), ep, lvl);
@@ -291,6 +405,21 @@ void play_level(int ep, int lvl)
 }
 
 
+// Get the selected level's music ready, so entering it doesn't wait on
+// the disk.
+// Music and map lumps, so confirming the level doesn't wait on the disk
+static void precache_selected_level()
+{
+    ap_level_index_t idx = {selected_ep, selected_level[selected_ep]};
+
+    if (ap_get_level_state(idx)->unlocked)
+    {
+        S_PrecacheLevelMusic(ap_index_to_ep(idx), ap_index_to_map(idx));
+        P_PrefetchMap(ap_index_to_ep(idx), ap_index_to_map(idx));
+    }
+}
+
+
 void select_map_dir(int dir)
 {
     int from = selected_level[selected_ep];
@@ -368,6 +497,7 @@ void select_map_dir(int dir)
         urh_anim = 0;
         S_StartSoundOptional(NULL, sfx_mnusli, sfx_stnmov);
         selected_level[selected_ep] = best;
+        precache_selected_level();
     }
 }
 
@@ -424,6 +554,7 @@ static void level_select_prev_episode()
         restart_wi_anims();
         urh_anim = 0;
         S_StartSoundOptional(NULL, sfx_mnucls, sfx_swtchx);
+        precache_selected_level();
     }
 }
 
@@ -444,6 +575,7 @@ static void level_select_next_episode()
         restart_wi_anims();
         urh_anim = 0;
         S_StartSoundOptional(NULL, sfx_mnucls, sfx_swtchx);
+        precache_selected_level();
     }
 }
 
@@ -560,6 +692,11 @@ void ShowLevelSelect()
     
     restart_wi_anims();
     bcnt = 0;
+
+    // Lumps may have been purged while we were away
+    invalidate_level_select_stats();
+
+    precache_selected_level();
 }
 
 
@@ -595,47 +732,37 @@ void DrawEpisodicLevelSelectStats()
     const int key_h_spacing = 12;
     const int start_y_offset = 10;
 
-    int map_count = ap_get_map_count(selected_ep + 1);
+    int map_count;
+    const level_select_stats_t* all_stats = get_level_select_stats(&map_count);
     for (int i = 0; i < map_count; ++i)
     {
         const level_pos_t* level_pos = get_level_pos_info(selected_ep, i);
-        ap_level_index_t idx = {selected_ep, i};
-        ap_level_info_t* ap_level_info = ap_get_level_info(idx);
-        ap_level_state_t* ap_level_state = ap_get_level_state(idx);
+        const level_select_stats_t* stats = &all_stats[i];
 
         x = level_pos->x;
         y = level_pos->y;
 
-        int key_count = 0;
-        for (int i = 0; i < 3; ++i)
-            if (ap_level_info->keys[i])
-                key_count++;
-
-        const int key_start_offset = -key_spacing * key_count / 2;
+        const int key_start_offset = -key_spacing * stats->key_count / 2;
 
         int img_w = 0;
 
         // Level custom icon
-        if (level_pos->img)
+        if (stats->img)
         {
-            patch_t* patch = W_CacheLumpName(level_pos->img, PU_CACHE);
-            img_w = patch->width;
-            V_DrawPatch(x + level_pos->img_x_offset, y + level_pos->img_y_offset, patch);
+            img_w = stats->img->width;
+            V_DrawPatch(x + level_pos->img_x_offset, y + level_pos->img_y_offset, stats->img);
             if (img_w) img_w += level_pos->img_x_offset;
         }
         
         // Level complete splash
-        if (ap_level_state->completed)
-            V_DrawPatch(x, y, W_CacheLumpName("WISPLAT", PU_CACHE));
+        if (stats->completed)
+            V_DrawPatch(x, y, wisplat_patch);
 
         // Lock
-        if (!ap_level_state->unlocked)
-            V_DrawPatch(x, y, W_CacheLumpName("WILOCK", PU_CACHE));
+        if (!stats->unlocked)
+            V_DrawPatch(x, y, wilock_patch);
 
         // Keys
-        const char* key_lump_names[] = {"STKEYS0", "STKEYS1", "STKEYS2"};
-        const char* key_skull_lump_names[] = {"STKEYS3", "STKEYS4", "STKEYS5"};
-
         int key_x = 0;
         int key_y = 0;
 
@@ -643,46 +770,34 @@ void DrawEpisodicLevelSelectStats()
         {
             key_x = x + img_w + 3 + level_pos->h_key_x_offset;
             key_y = y - 3 + level_pos->h_key_y_offset;
-            for (int k = 0; k < 3; ++k)
+            for (int k = 0; k < stats->key_count; ++k)
             {
-                if (ap_level_info->keys[k])
-                {
-                    const char* key_lump_name = key_lump_names[k];
-                    if (ap_level_info->use_skull[k])
-                        key_lump_name = key_skull_lump_names[k];
-                    V_DrawPatch(key_x, key_y, W_CacheLumpName("KEYBG", PU_CACHE));
-                    if (ap_level_state->keys[k])
-                        V_DrawPatch(key_x + 2, key_y + 1, W_CacheLumpName(key_lump_name, PU_CACHE));
-                    key_x += key_h_spacing;
-                }
+                V_DrawPatch(key_x, key_y, keybg_patch);
+                if (stats->has_key[k])
+                    V_DrawPatch(key_x + 2, key_y + 1, stats->keys[k]);
+                key_x += key_h_spacing;
             }
         }
         else
         {
             key_x = x + level_pos->keys_offset;
             key_y = y + key_start_offset;
-            for (int k = 0; k < 3; ++k)
+            for (int k = 0; k < stats->key_count; ++k)
             {
-                if (ap_level_info->keys[k])
+                V_DrawPatch(key_x, key_y, keybg_patch);
+                V_DrawPatch(key_x + 2, key_y + 1, stats->keys[k]);
+                if (stats->has_key[k])
                 {
-                    const char* key_lump_name = key_lump_names[k];
-                    if (ap_level_info->use_skull[k])
-                        key_lump_name = key_skull_lump_names[k];
-                    V_DrawPatch(key_x, key_y, W_CacheLumpName("KEYBG", PU_CACHE));
-                    V_DrawPatch(key_x + 2, key_y + 1, W_CacheLumpName(key_lump_name, PU_CACHE));
-                    if (ap_level_state->keys[k])
+                    if (level_pos->keys_offset < 0)
+                    {
+                        V_DrawPatch(key_x - 12, key_y - 1, checkmrk_patch);
+                    }
+                    else
                     {
-                        if (level_pos->keys_offset < 0)
-                        {
-                            V_DrawPatch(key_x - 12, key_y - 1, W_CacheLumpName("CHECKMRK", PU_CACHE));
-                        }
-                        else
-                        {
-                            V_DrawPatch(key_x + 12, key_y - 1, W_CacheLumpName("CHECKMRK", PU_CACHE));
-                        }
+                        V_DrawPatch(key_x + 12, key_y - 1, checkmrk_patch);
                     }
-                    key_y += key_spacing;
                 }
+                key_y += key_spacing;
             }
         }
 
@@ -694,9 +809,9 @@ void DrawEpisodicLevelSelectStats()
             progress_x = key_x + 8;
             progress_y = key_y + 2;
         }
-        print_right_aligned_yellow_digit(progress_x, progress_y, ap_level_state->check_count);
-        V_DrawPatch(progress_x + 1, progress_y, W_CacheLumpName("STYSLASH", PU_CACHE));
-        print_left_aligned_yellow_digit(progress_x + 8, progress_y, ap_level_info->check_count - ap_level_info->sanity_check_count);
+        print_right_aligned_yellow_digit(progress_x, progress_y, stats->check_count);
+        V_DrawPatch(progress_x + 1, progress_y, styslash_patch);
+        print_left_aligned_yellow_digit(progress_x + 8, progress_y, stats->check_total);
 
         // "You are here"
         if (i == selected_level[selected_ep] && urh_anim < 25)
@@ -719,7 +834,7 @@ void DrawEpisodicLevelSelectStats()
             }
             V_DrawPatch(x + x_offset + level_pos->urhere_x_offset, 
                         y + y_offset + level_pos->urhere_y_offset, 
-                        W_CacheLumpName(level_pos->urhere_lump_name, PU_CACHE));
+                        stats->urhere);
         }
     }
 
@@ -794,20 +909,32 @@ const char* get_win_map(int ep)
 }
 
 
+// Backgrounds kept resident by WI_CacheResident, NULL until then or if
+// it couldn't keep them
+static patch_t* win_map_patches[4];
+
+
+static patch_t* get_win_map_patch(int ep)
+{
+    if (!win_map_patches[ep])
+        win_map_patches[ep] = WI_CacheResident(get_win_map(ep));
+    if (win_map_patches[ep])
+        return win_map_patches[ep];
+    return W_CacheLumpName(get_win_map(ep), PU_CACHE);
+}
+
+
 void DrawLevelSelect()
 {
     int x_offset = ep_anim * 32;
 
-    char lump_name[9];
-    snprintf(lump_name, 9, "%s", get_win_map(selected_ep));
-    
     // [crispy] fill pillarboxes in widescreen mode
     if (SCREENWIDTH != NONWIDEWIDTH)
     {
         V_DrawFilledBox(0, 0, SCREENWIDTH, SCREENHEIGHT, 0);
     }
 
-    V_DrawPatch(x_offset, 0, W_CacheLumpName(lump_name, PU_CACHE));
+    V_DrawPatch(x_offset, 0, get_win_map_patch(selected_ep));
     if (ep_anim == 0)
     {
         WI_drawAnimatedBack();
@@ -816,11 +943,10 @@ void DrawLevelSelect()
     }
     else
     {
-        snprintf(lump_name, 9, "%s", get_win_map(prev_ep));
         if (ep_anim > 0)
             x_offset = -(10 - ep_anim) * 32;
         else
             x_offset = (10 + ep_anim) * 32;
-        V_DrawPatch(x_offset, 0, W_CacheLumpName(lump_name, PU_CACHE));
+        V_DrawPatch(x_offset, 0, get_win_map_patch(prev_ep));
     }
 }
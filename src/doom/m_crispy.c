@@ -231,7 +231,7 @@ void M_CrispyToggleColoredblood(int choice)
     ChangeSettingEnum(&crispy->coloredblood, choice, NUM_COLOREDBLOOD);
 
     // [crispy] switch NOBLOOD flag for Lost Souls
-    for (th = thinkercap.next; th && th != &thinkercap; th = th->next)
+    for (th = thinkerclasscap[th_mobj].cnext; th && th != &thinkerclasscap[th_mobj]; th = th->cnext)
     {
 	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
 	{
@@ -48,6 +48,7 @@
 
 #include "m_argv.h"
 #include "m_controls.h"
+#include "m_savethread.h"
 #include "p_saveg.h"
 #include "p_setup.h"
 #include "p_extsaveg.h" // [crispy] savewadfilename
@@ -146,6 +147,20 @@ char			savegamestrings[10][SAVESTRINGSIZE];
 int savepage = 0;
 static const int savepage_max = 7;
 
+// [AP] What M_ReadSaveStrings last read from each slot of each page, so
+// opening the menus or paging through them only stats the files. A slot
+// is read again once its file changed.
+typedef struct
+{
+    boolean valid;
+    time_t mtime;
+    off_t size;
+    size_t length; // Read by M_ReadSaveGameHead
+    char string[SAVESTRINGSIZE];
+} saveslotcache_t;
+
+static saveslotcache_t saveslotcache[8 * 10]; // savepage_max + 1 pages
+
 char	endstring[160];
 
 static boolean opldev;
@@ -850,25 +865,42 @@ menu_t  SaveDef =
 //
 void M_ReadSaveStrings(void)
 {
-    FILE   *handle;
     int     i;
     char    name[256];
 
+    G_FinishSaveGame(); // [AP]
+
     for (i = 0;i < load_end;i++)
     {
-        int retval;
+        saveslotcache_t *cache = &saveslotcache[10 * savepage + i];
+        struct stat st;
+
         M_StringCopy(name, P_SaveGameFile(i), sizeof(name));
 
-	handle = M_fopen(name, "rb");
-        if (handle == NULL)
+        if (M_stat(name, &st) != 0)
+        {
+            cache->valid = false;
+        }
+        else if (!cache->valid || cache->mtime != st.st_mtime
+              || cache->size != st.st_size)
+        {
+            // [AP] Compressed savegames too
+            memset(cache->string, 0, SAVESTRINGSIZE);
+            cache->length = M_ReadSaveGameHead(name, (byte *) cache->string,
+                                               SAVESTRINGSIZE);
+            cache->mtime = st.st_mtime;
+            cache->size = st.st_size;
+            cache->valid = true;
+        }
+
+        if (!cache->valid || cache->length == 0)
         {
             M_StringCopy(savegamestrings[i], EMPTYSTRING, SAVESTRINGSIZE);
             LoadMenu[i].status = 0;
             continue;
         }
-        retval = fread(&savegamestrings[i], 1, SAVESTRINGSIZE, handle);
-	fclose(handle);
-        LoadMenu[i].status = retval == SAVESTRINGSIZE;
+        memcpy(savegamestrings[i], cache->string, SAVESTRINGSIZE);
+        LoadMenu[i].status = cache->length == SAVESTRINGSIZE;
     }
 }
 
@@ -1007,6 +1039,9 @@ void M_DrawSave(void)
 //
 void M_DoSave(int slot)
 {
+    // [AP] Could be rewritten within the second, same size
+    saveslotcache[10 * savepage + slot].valid = false;
+
     G_SaveGame (slot,savegamestrings[slot]);
     M_ClearMenus ();
 
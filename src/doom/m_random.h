@@ -24,6 +24,9 @@
 #include "doomtype.h"
 
 
+// [AP] Where P_Random is in the table, doomstat.h has M_Random's
+extern int prndindex;
+
 // Returns a number from 0 to 255,
 // from a lookup table.
 int M_Random (void);
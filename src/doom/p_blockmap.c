@@ -19,16 +19,90 @@
 //
 
 #include <stdlib.h>
+#include <string.h>
 #include "i_system.h"
 #include "p_local.h"
+#include "p_setup.h"
 #include "z_zone.h"
 
+// [AP] Blockmaps built so far this session, kept outside the zone. AP
+// games go back and forth between the same levels, and a level needing
+// a new blockmap needs it every time it loads.
+typedef struct
+{
+  wad_file_t *wad_file; // Of the map's marker lump
+  int position;
+  int numlines, numvertexes; // In case the map was reloaded
+  fixed_t orgx, orgy;
+  int width, height;
+  int count; // Of lump, below
+  int32_t *lump;
+} blockmapcache_t;
+
+static blockmapcache_t *blockmapcache;
+static int numblockmapcache;
+
+static blockmapcache_t *P_FindCachedBlockMap(void)
+{
+  int i;
+
+  for (i = 0; i < numblockmapcache; i++)
+    {
+      blockmapcache_t *c = &blockmapcache[i];
+
+      if (c->wad_file == maplumpinfo->wad_file &&
+          c->position == maplumpinfo->position &&
+          c->numlines == numlines && c->numvertexes == numvertexes)
+        return c;
+    }
+
+  return NULL;
+}
+
+static void P_CacheBlockMap(int count)
+{
+  blockmapcache_t *c;
+
+  blockmapcache = I_Realloc(blockmapcache, (numblockmapcache + 1) * sizeof(*blockmapcache));
+  c = &blockmapcache[numblockmapcache];
+
+  c->lump = malloc(count * sizeof(*c->lump));
+  if (!c->lump)
+    return; // Just build it again next time
+
+  c->wad_file = maplumpinfo->wad_file;
+  c->position = maplumpinfo->position;
+  c->numlines = numlines;
+  c->numvertexes = numvertexes;
+  c->orgx = bmaporgx;
+  c->orgy = bmaporgy;
+  c->width = bmapwidth;
+  c->height = bmapheight;
+  c->count = count;
+  memcpy(c->lump, blockmaplump, count * sizeof(*c->lump));
+  numblockmapcache++;
+}
+
 // [crispy] taken from mbfsrc/P_SETUP.C:547-707, slightly adapted
 
 void P_CreateBlockMap(void)
 {
   register int i;
   fixed_t minx = INT_MAX, miny = INT_MAX, maxx = INT_MIN, maxy = INT_MIN;
+  blockmapcache_t *cached;
+  int lumpcount = 0;
+
+  // [AP] Built it before?
+  if ((cached = P_FindCachedBlockMap()) != NULL)
+    {
+      bmaporgx = cached->orgx;
+      bmaporgy = cached->orgy;
+      bmapwidth = cached->width;
+      bmapheight = cached->height;
+      blockmaplump = Z_ArenaMalloc(sizeof(*blockmaplump) * cached->count, PU_LEVEL);
+      memcpy(blockmaplump, cached->lump, sizeof(*blockmaplump) * cached->count);
+      goto done;
+    }
 
   // First find limits of map
 
@@ -154,7 +228,8 @@ void P_CreateBlockMap(void)
 	  count += bmap[i].n + 2; // 1 header word + 1 trailer word + blocklist
 
       // Allocate blockmap lump with computed count
-      blockmaplump = Z_Malloc(sizeof(*blockmaplump) * count, PU_LEVEL, 0);
+      blockmaplump = Z_ArenaMalloc(sizeof(*blockmaplump) * count, PU_LEVEL);
+      lumpcount = count;
     }
 
     // Now compress the blockmap.
@@ -182,11 +257,14 @@ void P_CreateBlockMap(void)
     }
   }
 
+  P_CacheBlockMap(lumpcount); // [AP]
+
+  done:
   // [crispy] copied over from P_LoadBlockMap()
   {
-    int count = sizeof(*blocklinks) * bmapwidth * bmapheight;
-    blocklinks = Z_Malloc(count, PU_LEVEL, 0);
-    memset(blocklinks, 0, count);
+    int count = sizeof(*blockthings) * bmapwidth * bmapheight;
+    blockthings = Z_ArenaMalloc(count, PU_LEVEL);
+    memset(blockthings, 0, count);
     blockmap = blockmaplump+4;
   }
 
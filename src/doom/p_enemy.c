@@ -23,6 +23,7 @@
 
 #include "m_random.h"
 #include "i_system.h"
+#include "z_zone.h"
 
 #include "doomdef.h"
 #include "p_local.h"
@@ -95,6 +96,21 @@ void A_Fall (mobj_t *actor);
 
 mobj_t*		soundtarget;
 
+// [AP] The flood only depends on which two-sided lines are open. Each
+// origin sector keeps the sectors it reached, with the soundtraversed
+// they ended with, and P_NoiseAlert replays that until one of the lines
+// opens or closes.
+typedef struct soundflood_s
+{
+    sector_t*	sector;
+    int		soundtraversed;
+} soundflood_t;
+
+static int		soundgeneration = 1;
+static sector_t**	soundvisited;
+static int		numsoundvisited;
+static int		maxsoundvisited;
+
 void
 P_RecursiveSound
 ( sector_t*	sec,
@@ -110,6 +126,17 @@ P_RecursiveSound
     {
 	return;		// already flooded
     }
+
+    // [AP] First time this flood gets here
+    if (sec->validcount != validcount)
+    {
+	if (numsoundvisited == maxsoundvisited)
+	{
+	    maxsoundvisited = maxsoundvisited ? 2 * maxsoundvisited : 64;
+	    soundvisited = I_Realloc(soundvisited, maxsoundvisited * sizeof(*soundvisited));
+	}
+	soundvisited[numsoundvisited++] = sec;
+    }
     
     sec->validcount = validcount;
     sec->soundtraversed = soundblocks+1;
@@ -122,6 +149,7 @@ P_RecursiveSound
 	    continue;
 	
 	P_LineOpening (check);
+	check->soundopen = openrange > 0; // [AP]
 
 	if (openrange <= 0)
 	    continue;	// closed door
@@ -153,13 +181,76 @@ P_NoiseAlert
 ( mobj_t*	target,
   mobj_t*	emmiter )
 {
+    sector_t*	sec;
+    sector_t*	other;
+    int		i;
+
     // [crispy] monsters are deaf with NOTARGET cheat
     if (target && target->player && (target->player->cheats & CF_NOTARGET))
         return;
 
+    sec = emmiter->subsector->sector;
     soundtarget = target;
     validcount++;
-    P_RecursiveSound (emmiter->subsector->sector, 0);
+
+    // [AP] Same as the last flood from here
+    if (sec->soundfloodgen == soundgeneration)
+    {
+	for (i = 0; i < sec->numsoundflood; i++)
+	{
+	    other = sec->soundflood[i].sector;
+	    other->validcount = validcount;
+	    other->soundtraversed = sec->soundflood[i].soundtraversed;
+	    other->soundtarget = soundtarget;
+	}
+	return;
+    }
+
+    numsoundvisited = 0;
+    P_RecursiveSound (sec, 0);
+
+    if (numsoundvisited > sec->maxsoundflood)
+    {
+	if (sec->soundflood)
+	    Z_Free(sec->soundflood);
+	sec->maxsoundflood = numsoundvisited;
+	sec->soundflood = Z_Malloc(numsoundvisited * sizeof(*sec->soundflood), PU_LEVEL, NULL);
+    }
+    for (i = 0; i < numsoundvisited; i++)
+    {
+	sec->soundflood[i].sector = soundvisited[i];
+	sec->soundflood[i].soundtraversed = soundvisited[i]->soundtraversed;
+    }
+    sec->numsoundflood = numsoundvisited;
+    sec->soundfloodgen = soundgeneration;
+}
+
+
+//
+// [AP] P_SoundSectorMoved
+// Floods recorded across one of the sector's lines are stale if the
+// move opened or closed it.
+//
+void P_SoundSectorMoved (sector_t* sector)
+{
+    int		i;
+    line_t*	check;
+    boolean	open;
+
+    for (i = 0; i < sector->linecount; i++)
+    {
+	check = sector->lines[i];
+	if (! (check->flags & ML_TWOSIDED) )
+	    continue;
+
+	P_LineOpening (check);
+	open = openrange > 0;
+	if (open != check->soundopen)
+	{
+	    check->soundopen = open;
+	    soundgeneration++;
+	}
+    }
 }
 
 
@@ -579,7 +670,7 @@ void A_KeenDie (mobj_t* mo)
     
     // scan the remaining thinkers
     // to see if all Keens are dead
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    for (th = thinkerclasscap[th_mobj].cnext ; th != &thinkerclasscap[th_mobj] ; th=th->cnext)
     {
 	if (th->function.acp1 != (actionf_p1)P_MobjThinker)
 	    continue;
@@ -1529,13 +1620,13 @@ A_PainShootSkull
     // count total number of skull currently on the level
     count = 0;
 
-    currentthinker = thinkercap.next;
-    while (currentthinker != &thinkercap)
+    currentthinker = thinkerclasscap[th_mobj].cnext;
+    while (currentthinker != &thinkerclasscap[th_mobj])
     {
 	if (   (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker)
 	    && ((mobj_t *)currentthinker)->type == MT_SKULL)
 	    count++;
-	currentthinker = currentthinker->next;
+	currentthinker = currentthinker->cnext;
     }
 
     // if there are allready 20 skulls on the level,
@@ -1767,7 +1858,7 @@ void A_BossDeath (mobj_t* mo)
     
     // scan the remaining thinkers to see
     // if all bosses are dead
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    for (th = thinkerclasscap[th_mobj].cnext ; th != &thinkerclasscap[th_mobj] ; th=th->cnext)
     {
 	if (th->function.acp1 != (actionf_p1)P_MobjThinker)
 	    continue;
@@ -1907,9 +1998,9 @@ void A_BrainAwake (mobj_t* mo)
     numbraintargets = 0;
     braintargeton = 0;
 
-    for (thinker = thinkercap.next ;
-	 thinker != &thinkercap ;
-	 thinker = thinker->next)
+    for (thinker = thinkerclasscap[th_mobj].cnext ;
+	 thinker != &thinkerclasscap[th_mobj] ;
+	 thinker = thinker->cnext)
     {
 	if (thinker->function.acp1 != (actionf_p1)P_MobjThinker)
 	    continue;	// not a mobj
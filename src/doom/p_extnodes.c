@@ -93,7 +93,7 @@ void P_LoadSegs_DeePBSP (int lump)
     mapseg_deepbsp_t *data;
 
     numsegs = W_LumpLength(lump) / sizeof(mapseg_deepbsp_t);
-    segs = Z_Malloc(numsegs * sizeof(seg_t), PU_LEVEL, 0);
+    segs = Z_ArenaMalloc(numsegs * sizeof(seg_t), PU_LEVEL);
     data = (mapseg_deepbsp_t *)W_CacheLumpNum(lump, PU_STATIC);
 
     for (i = 0; i < numsegs; i++)
@@ -168,7 +168,7 @@ void P_LoadSubsectors_DeePBSP (int lump)
     int i;
 
     numsubsectors = W_LumpLength(lump) / sizeof(mapsubsector_deepbsp_t);
-    subsectors = Z_Malloc(numsubsectors * sizeof(subsector_t), PU_LEVEL, 0);
+    subsectors = Z_ArenaMalloc(numsubsectors * sizeof(subsector_t), PU_LEVEL);
     data = (mapsubsector_deepbsp_t *)W_CacheLumpNum(lump, PU_STATIC);
 
     // [crispy] fail on missing subsectors
@@ -192,7 +192,7 @@ void P_LoadNodes_DeePBSP (int lump)
     int i;
 
     numnodes = (W_LumpLength (lump) - 8) / sizeof(mapnode_deepbsp_t);
-    nodes = Z_Malloc(numnodes * sizeof(node_t), PU_LEVEL, 0);
+    nodes = Z_ArenaMalloc(numnodes * sizeof(node_t), PU_LEVEL);
     data = W_CacheLumpNum (lump, PU_STATIC);
 
     // [crispy] warn about missing nodes
@@ -232,6 +232,15 @@ void P_LoadNodes_DeePBSP (int lump)
   W_ReleaseLumpNum(lump);
 }
 
+#ifdef HAVE_LIBZ
+// [AP] Inflated ZNOD data, kept from one level to the next so loading
+// only grows it when a bigger map comes along. Uncompressed nodes are
+// read in place from the lump (mapped straight from the WAD file when
+// it can be).
+static byte *znodbuffer;
+static int znodbuffersize;
+#endif
+
 // [crispy] support maps with compressed or uncompressed ZDBSP nodes
 // adapted from prboom-plus/src/p_setup.c:1040-1331
 // heavily modified, condensed and simplyfied
@@ -244,17 +253,10 @@ void P_LoadNodes_DeePBSP (int lump)
 void P_LoadNodes_ZDBSP (int lump, boolean compressed)
 {
     byte *data;
-    unsigned int i;
 #ifdef HAVE_LIBZ
     byte *output;
 #endif
 
-    unsigned int orgVerts, newVerts;
-    unsigned int numSubs, currSeg;
-    unsigned int numSegs;
-    unsigned int numNodes;
-    vertex_t *newvertarray = NULL;
-
     data = W_CacheLumpNum(lump, PU_LEVEL);
 
     // 0. Uncompress nodes lump (or simply skip header)
@@ -269,7 +271,13 @@ void P_LoadNodes_ZDBSP (int lump, boolean compressed)
 	// first estimate for compression rate:
 	// output buffer size == 2.5 * input size
 	outlen = 2.5 * len;
-	output = Z_Malloc(outlen, PU_STATIC, 0);
+	if (outlen > znodbuffersize)
+	{
+	    znodbuffer = I_Realloc(znodbuffer, outlen);
+	    znodbuffersize = outlen;
+	}
+	outlen = znodbuffersize;
+	output = znodbuffer;
 
 	// initialize stream state for decompression
 	zstream = malloc(sizeof(*zstream));
@@ -287,7 +295,8 @@ void P_LoadNodes_ZDBSP (int lump, boolean compressed)
 	{
 	    int outlen_old = outlen;
 	    outlen = 2 * outlen_old;
-	    output = I_Realloc(output, outlen);
+	    znodbuffer = output = I_Realloc(output, outlen);
+	    znodbuffersize = outlen;
 	    zstream->next_out = output + outlen_old;
 	    zstream->avail_out = outlen - outlen_old;
 	}
@@ -316,6 +325,23 @@ void P_LoadNodes_ZDBSP (int lump, boolean compressed)
 	data += 4;
     }
 
+    P_LoadNodes_XNOD(data);
+
+    if (!compressed)
+	W_ReleaseLumpNum(lump);
+}
+
+// [AP] The nodes lump past its magic, which is also what P_BuildNodes()
+// builds
+void P_LoadNodes_XNOD (byte *data)
+{
+    unsigned int i;
+    unsigned int orgVerts, newVerts;
+    unsigned int numSubs, currSeg;
+    unsigned int numSegs;
+    unsigned int numNodes;
+    vertex_t *newvertarray = NULL;
+
     // 1. Load new vertices added during node building
 
     orgVerts = LONG(*((unsigned int*)data));
@@ -330,7 +356,7 @@ void P_LoadNodes_ZDBSP (int lump, boolean compressed)
     }
     else
     {
-	newvertarray = Z_Malloc((orgVerts + newVerts) * sizeof(vertex_t), PU_LEVEL, 0);
+	newvertarray = Z_ArenaMalloc((orgVerts + newVerts) * sizeof(vertex_t), PU_LEVEL);
 	memcpy(newvertarray, vertexes, orgVerts * sizeof(vertex_t));
 	memset(newvertarray + orgVerts, 0, newVerts * sizeof(vertex_t));
     }
@@ -368,7 +394,7 @@ void P_LoadNodes_ZDBSP (int lump, boolean compressed)
 	I_Error("P_LoadNodes: No subsectors in map!");
 
     numsubsectors = numSubs;
-    subsectors = Z_Malloc(numsubsectors * sizeof(subsector_t), PU_LEVEL, 0);
+    subsectors = Z_ArenaMalloc(numsubsectors * sizeof(subsector_t), PU_LEVEL);
 
     for (i = currSeg = 0; i < numsubsectors; i++)
     {
@@ -393,7 +419,7 @@ void P_LoadNodes_ZDBSP (int lump, boolean compressed)
     }
 
     numsegs = numSegs;
-    segs = Z_Malloc(numsegs * sizeof(seg_t), PU_LEVEL, 0);
+    segs = Z_ArenaMalloc(numsegs * sizeof(seg_t), PU_LEVEL);
 
     for (i = 0; i < numsegs; i++)
     {
@@ -462,7 +488,7 @@ void P_LoadNodes_ZDBSP (int lump, boolean compressed)
     data += sizeof(numNodes);
 
     numnodes = numNodes;
-    nodes = Z_Malloc(numnodes * sizeof(node_t), PU_LEVEL, 0);
+    nodes = Z_ArenaMalloc(numnodes * sizeof(node_t), PU_LEVEL);
 
     for (i = 0; i < numnodes; i++)
     {
@@ -483,13 +509,6 @@ void P_LoadNodes_ZDBSP (int lump, boolean compressed)
 		no->bbox[j][k] = SHORT(mn->bbox[j][k])<<FRACBITS;
 	}
     }
-
-#ifdef HAVE_LIBZ
-    if (compressed)
-	Z_Free(output);
-    else
-#endif
-    W_ReleaseLumpNum(lump);
 }
 
 // [crispy] allow loading of Hexen-format maps
@@ -541,7 +560,7 @@ void P_LoadLineDefs_Hexen (int lump)
     int warn; // [crispy] warn about unknown linedef types
 
     numlines = W_LumpLength(lump) / sizeof(maplinedef_hexen_t);
-    lines = Z_Malloc(numlines * sizeof(line_t), PU_LEVEL, 0);
+    lines = Z_ArenaMalloc(numlines * sizeof(line_t), PU_LEVEL);
     memset(lines, 0, numlines * sizeof(line_t));
     data = W_CacheLumpNum(lump, PU_STATIC);
 
@@ -37,6 +37,7 @@ extern void P_LoadSegs_DeePBSP (int lump);
 extern void P_LoadSubsectors_DeePBSP (int lump);
 extern void P_LoadNodes_DeePBSP (int lump);
 extern void P_LoadNodes_ZDBSP (int lump, boolean compressed);
+extern void P_LoadNodes_XNOD (byte *data); // [AP]
 extern void P_LoadThings_Hexen (int lump);
 extern void P_LoadLineDefs_Hexen (int lump);
 
@@ -720,7 +720,8 @@ P_TouchSpecialThing
 	case SPR_APJI:
 	case SPR_APPI:
 	{
-		apdoom_check_location(ap_make_level_index(gameepisode, gamemap), special->index);
+		apdoom_check_location(ap_get_current_level(gameepisode, gamemap)->idx, special->index);
+		AM_RemoveLocation(special->index);
 		do_evil_grin();
 		break;
 	}
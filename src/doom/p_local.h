@@ -69,9 +69,24 @@
 extern	thinker_t	thinkercap;	
 
 
+// [AP] Besides the main list, which sets the order thinkers run in, each
+// thinker is in the list of its class, in the same relative order, so
+// searches for one kind don't walk everything.
+typedef enum
+{
+    th_mobj, // P_MobjThinker when added
+    th_misc, // Movers, lights and everything else
+    NUMTHCLASS
+} thclass_t;
+
+extern thinker_t thinkerclasscap[NUMTHCLASS];
+
 void P_InitThinkers (void);
 void P_AddThinker (thinker_t* thinker);
 void P_RemoveThinker (thinker_t* thinker);
+void* P_AllocThinker (size_t size); // [AP] Pooled, lives until the level ends
+void P_FreeThinker (thinker_t* thinker);
+void P_ClearThinkerPools (void);
 
 
 //
@@ -88,6 +103,8 @@ void P_DropWeapon (player_t* player);
 #define MLOOKUNIT	8
 #define PLAYER_SLOPE(a)	((((a)->lookdir / MLOOKUNIT) << FRACBITS) / 173)
 void	P_PlayerThink (player_t* player);
+void	P_MovePlayer (player_t* player);
+void	P_CalcHeight (player_t* player);
 
 
 //
@@ -115,9 +132,12 @@ P_SpawnMobj
   mobjtype_t	type );
 
 void 	P_RemoveMobj (mobj_t* th);
+void	P_SpawnPlayer (mapthing_t* mthing);
 mobj_t* P_SubstNullMobj (mobj_t* th);
 boolean	P_SetMobjState (mobj_t* mobj, statenum_t state);
 void 	P_MobjThinker (mobj_t* mobj);
+void	P_XYMovement (mobj_t* mo);
+void	P_ZMovement (mobj_t* mo);
 mobj_t *Crispy_PlayerSO (int p); // [crispy] weapon sound sources
 
 void	P_SpawnPuff (fixed_t x, fixed_t y, fixed_t z);
@@ -131,6 +151,7 @@ void	P_SpawnPuffSafe (fixed_t x, fixed_t y, fixed_t z, boolean safe);
 // P_ENEMY
 //
 void P_NoiseAlert (mobj_t* target, mobj_t* emmiter);
+void P_SoundSectorMoved (sector_t* sector); // [AP] After a plane moves
 
 
 //
@@ -181,6 +202,10 @@ void 	P_LineOpening (line_t* linedef);
 
 boolean P_BlockLinesIterator (int x, int y, boolean(*func)(line_t*) );
 boolean P_BlockThingsIterator (int x, int y, boolean(*func)(mobj_t*) );
+boolean P_BlockThingsIteratorNear (int x, int y, boolean(*func)(mobj_t*),
+                                   fixed_t tx, fixed_t ty, fixed_t radius); // [AP]
+boolean P_BlockThingsIteratorBlast (int x, int y, boolean(*func)(mobj_t*),
+                                    fixed_t bx, fixed_t by, int damage); // [AP]
 
 #define PT_ADDLINES		1
 #define PT_ADDTHINGS	2
@@ -233,6 +258,10 @@ boolean P_TryMove (mobj_t* thing, fixed_t x, fixed_t y);
 boolean P_TeleportMove (mobj_t* thing, fixed_t x, fixed_t y);
 void	P_SlideMove (mobj_t* mo);
 boolean P_CheckSight (mobj_t* t1, mobj_t* t2);
+void P_ClearSightCache (void); // [AP] After loading a level or savegame
+void P_SightSectorMoved (sector_t* sector); // [AP] After a plane moves
+void P_PrecomputeSight (void); // [AP] Threaded, with -aithreads
+void P_InitSightThreads (void);
 void 	P_UseLines (player_t* player);
 
 boolean P_ChangeSector (sector_t* sector, boolean crunch);
@@ -279,11 +308,30 @@ extern int		bmapwidth;
 extern int		bmapheight;	// in mapblocks
 extern fixed_t		bmaporgx;
 extern fixed_t		bmaporgy;	// origin of block map
-extern mobj_t**		blocklinks;	// for thing chains
+
+// [AP] Things in a block, packed with what the distance checks need so
+// they don't have to go through each mobj. Most recently linked last.
+typedef struct
+{
+    mobj_t*	mo;
+    fixed_t	x, y, radius; // As of linking
+} blockthing_t;
+
+typedef struct
+{
+    blockthing_t*	things;
+    int		numthings;
+    int		maxthings;
+} blockthings_t;
+
+extern blockthings_t*	blockthings;	// for thing chains
 
 // [crispy] factor out map lump name and number finding into a separate function
 extern int P_GetNumForMap (int episode, int map, boolean critical);
 
+// [AP] Reads the map's lumps ahead, for a level about to be picked
+extern void P_PrefetchMap (int episode, int map);
+
 // [crispy] blinking key or skull in the status bar
 #define KEYBLINKMASK 0x8
 #define KEYBLINKTICS (7*KEYBLINKMASK)
@@ -308,6 +356,18 @@ P_DamageMobj
   int		damage );
 
 
+//
+// P_PREDICT
+//
+// [AP] While predicting, the console player's mobj is a copy linked
+// nowhere and movement must have no side effects. predictedmo is the
+// real mobj while a prediction is shown.
+extern boolean	predicting;
+extern mobj_t*	predictedmo;
+
+void	P_PredictTics (ticcmd_t* cmds, int numcmds);
+
+
 //
 // P_SPEC
 //
@@ -390,7 +390,7 @@ boolean PIT_CheckThing (mobj_t* thing)
     if (thing->flags & MF_SPECIAL)
     {
 	solid = (thing->flags & MF_SOLID) != 0;
-	if (tmflags&MF_PICKUP)
+	if (tmflags&MF_PICKUP && !predicting) // [AP] not while predicting
 	{
 	    // can remove thing
 	    P_TouchSpecialThing (thing, tmthing);
@@ -541,7 +541,7 @@ P_CheckPosition
 
     for (bx=xl ; bx<=xh ; bx++)
 	for (by=yl ; by<=yh ; by++)
-	    if (!P_BlockThingsIterator(bx,by,PIT_CheckThing))
+	    if (!P_BlockThingsIteratorNear(bx,by,PIT_CheckThing,tmx,tmy,tmthing->radius))
 		return false;
     
     // check lines
@@ -602,7 +602,9 @@ P_TryMove
     
     // the move is ok,
     // so link the thing into its new position
-    P_UnsetThingPosition (thing);
+    // [AP] A predicted player is linked nowhere and triggers nothing
+    if (!predicting)
+	P_UnsetThingPosition (thing);
 
     oldx = thing->x;
     oldy = thing->y;
@@ -611,6 +613,12 @@ P_TryMove
     thing->x = x;
     thing->y = y;
 
+    if (predicting)
+    {
+	thing->subsector = R_PointInSubsector (x, y);
+	return true;
+    }
+
     P_SetThingPosition (thing);
     
     // if any special lines were hit, do the effect
@@ -1488,7 +1496,8 @@ P_RadiusAttack
 	
     for (y=yl ; y<=yh ; y++)
 	for (x=xl ; x<=xh ; x++)
-	    P_BlockThingsIterator (x, y, PIT_RadiusAttack );
+	    P_BlockThingsIteratorBlast (x, y, PIT_RadiusAttack,
+	                                spot->x, spot->y, damage); // [AP]
 }
 
 
@@ -1608,6 +1617,7 @@ P_ChangeSector
 	for (y=sector->blockbox[BOXBOTTOM];y<= sector->blockbox[BOXTOP] ; y++)
 	    P_BlockThingsIterator (x, y, PIT_ChangeSector);
 	
+    P_SoundSectorMoved (sector); // [AP]
 	
     return nofit;
 }
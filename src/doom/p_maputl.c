@@ -25,8 +25,11 @@
 #include <stdlib.h>
 
 
+#include <string.h>
+
 #include "i_system.h" // [crispy] I_Realloc()
 #include "m_bbox.h"
+#include "z_zone.h"
 
 #include "doomdef.h"
 #include "doomstat.h"
@@ -333,6 +336,72 @@ void P_LineOpening (line_t* linedef)
 //
 
 
+//
+// [AP] Blocks being iterated over, innermost first. Taking a thing out
+// of a block moves the ones after it down, so the iterators' positions
+// are moved with them; things not yet reached are then still reached
+// once, as with the old linked lists.
+//
+typedef struct blockiter_s
+{
+    blockthings_t*	block;
+    int			pos;
+    struct blockiter_s*	prev;
+} blockiter_t;
+
+static blockiter_t*	blockiters;
+
+static void P_UnlinkBlockThing (blockthings_t* block, mobj_t* thing)
+{
+    blockiter_t*	iter;
+    int			i;
+
+    for (i = block->numthings - 1; i >= 0; i--)
+    {
+	if (block->things[i].mo == thing)
+	    break;
+    }
+
+    if (i < 0)
+	return;
+
+    block->numthings--;
+    memmove(&block->things[i], &block->things[i + 1],
+	    (block->numthings - i) * sizeof(*block->things));
+
+    for (iter = blockiters; iter; iter = iter->prev)
+    {
+	if (iter->block == block && i < iter->pos)
+	    iter->pos--;
+    }
+}
+
+static void P_LinkBlockThing (blockthings_t* block, mobj_t* thing)
+{
+    blockthing_t*	bt;
+
+    if (block->numthings == block->maxthings)
+    {
+	blockthing_t*	things;
+
+	block->maxthings = block->maxthings ? block->maxthings * 2 : 8;
+	things = Z_Malloc(block->maxthings * sizeof(*things), PU_LEVEL, 0);
+	if (block->things)
+	{
+	    memcpy(things, block->things, block->numthings * sizeof(*things));
+	    Z_Free(block->things);
+	}
+	block->things = things;
+    }
+
+    bt = &block->things[block->numthings++];
+    bt->mo = thing;
+    bt->x = thing->x;
+    bt->y = thing->y;
+    bt->radius = thing->radius;
+}
+
+
 //
 // P_UnsetThingPosition
 // Unlinks a thing from block map and sectors.
@@ -342,9 +411,6 @@ void P_LineOpening (line_t* linedef)
 //
 void P_UnsetThingPosition (mobj_t* thing)
 {
-    int		blockx;
-    int		blocky;
-
     if ( ! (thing->flags & MF_NOSECTOR) )
     {
 	// inert things don't need to be in blockmap?
@@ -362,22 +428,10 @@ void P_UnsetThingPosition (mobj_t* thing)
     {
 	// inert things don't need to be in blockmap
 	// unlink from block map
-	if (thing->bnext)
-	    thing->bnext->bprev = thing->bprev;
-	
-	if (thing->bprev)
-	    thing->bprev->bnext = thing->bnext;
-	else
-	{
-	    blockx = (thing->x - bmaporgx)>>MAPBLOCKSHIFT;
-	    blocky = (thing->y - bmaporgy)>>MAPBLOCKSHIFT;
+	if (thing->blocknum >= 0 && thing->blocknum < bmapwidth*bmapheight)
+	    P_UnlinkBlockThing(&blockthings[thing->blocknum], thing);
 
-	    if (blockx>=0 && blockx < bmapwidth
-		&& blocky>=0 && blocky <bmapheight)
-	    {
-		blocklinks[blocky*bmapwidth+blockx] = thing->bnext;
-	    }
-	}
+	thing->blocknum = -1;
     }
 }
 
@@ -395,7 +449,6 @@ P_SetThingPosition (mobj_t* thing)
     sector_t*		sec;
     int			blockx;
     int			blocky;
-    mobj_t**		link;
 
     
     // link into subsector
@@ -429,18 +482,13 @@ P_SetThingPosition (mobj_t* thing)
 	    && blocky>=0
 	    && blocky < bmapheight)
 	{
-	    link = &blocklinks[blocky*bmapwidth+blockx];
-	    thing->bprev = NULL;
-	    thing->bnext = *link;
-	    if (*link)
-		(*link)->bprev = thing;
-
-	    *link = thing;
+	    thing->blocknum = blocky*bmapwidth+blockx;
+	    P_LinkBlockThing(&blockthings[thing->blocknum], thing);
 	}
 	else
 	{
 	    // thing is off the map
-	    thing->bnext = thing->bprev = NULL;
+	    thing->blocknum = -1;
 	}
     }
 }
@@ -511,7 +559,7 @@ P_BlockThingsIterator
   int			y,
   boolean(*func)(mobj_t*) )
 {
-    mobj_t*		mobj;
+    blockiter_t		iter;
 	
     if ( x<0
 	 || y<0
@@ -521,14 +569,130 @@ P_BlockThingsIterator
 	return true;
     }
     
+    // [AP] Most recently linked first, as the linked lists went
+    iter.block = &blockthings[y*bmapwidth+x];
+    iter.prev = blockiters;
+    blockiters = &iter;
+
+    for (iter.pos = iter.block->numthings - 1 ; iter.pos >= 0 ; iter.pos--)
+    {
+	if (!func( iter.block->things[iter.pos].mo ) )
+	{
+	    blockiters = iter.prev;
+	    return false;
+	}
+    }
+
+    blockiters = iter.prev;
+    return true;
+}
+
+
+//
+// [AP] P_BlockThingsIteratorNear
+// Same, but only calls func for things whose box touches the box of the
+// given radius around tx, ty: the test PIT_CheckThing starts with, done
+// on the packed copies. Only for functions that can't move tmthing, or
+// start another P_CheckPosition, and then carry on iterating.
+//
+boolean
+P_BlockThingsIteratorNear
+( int			x,
+  int			y,
+  boolean(*func)(mobj_t*),
+  fixed_t		tx,
+  fixed_t		ty,
+  fixed_t		radius )
+{
+    blockiter_t		iter;
+    const blockthing_t*	bt;
+    fixed_t		blockdist;
+
+    if ( x<0
+	 || y<0
+	 || x>=bmapwidth
+	 || y>=bmapheight)
+    {
+	return true;
+    }
+
+    iter.block = &blockthings[y*bmapwidth+x];
+    iter.prev = blockiters;
+    blockiters = &iter;
+
+    for (iter.pos = iter.block->numthings - 1 ; iter.pos >= 0 ; iter.pos--)
+    {
+	bt = &iter.block->things[iter.pos];
+	blockdist = bt->radius + radius;
+
+	if ( abs(bt->x - tx) >= blockdist
+	     || abs(bt->y - ty) >= blockdist )
+	    continue;
+
+	if (!func( bt->mo ) )
+	{
+	    blockiters = iter.prev;
+	    return false;
+	}
+    }
+
+    blockiters = iter.prev;
+    return true;
+}
+
+
+//
+// [AP] P_BlockThingsIteratorBlast
+// Same, but skips things a blast of the given damage at bx, by can't
+// reach, with PIT_RadiusAttack's range test on the packed copies. A
+// packed radius is never smaller than the mobj's, so this never skips a
+// thing PIT_RadiusAttack would have hit.
+//
+boolean
+P_BlockThingsIteratorBlast
+( int			x,
+  int			y,
+  boolean(*func)(mobj_t*),
+  fixed_t		bx,
+  fixed_t		by,
+  int			damage )
+{
+    blockiter_t		iter;
+    const blockthing_t*	bt;
+    fixed_t		dx;
+    fixed_t		dy;
+    fixed_t		dist;
+
+    if ( x<0
+	 || y<0
+	 || x>=bmapwidth
+	 || y>=bmapheight)
+    {
+	return true;
+    }
 
-    for (mobj = blocklinks[y*bmapwidth+x] ;
-	 mobj ;
-	 mobj = mobj->bnext)
+    iter.block = &blockthings[y*bmapwidth+x];
+    iter.prev = blockiters;
+    blockiters = &iter;
+
+    for (iter.pos = iter.block->numthings - 1 ; iter.pos >= 0 ; iter.pos--)
     {
-	if (!func( mobj ) )
+	bt = &iter.block->things[iter.pos];
+	dx = abs(bt->x - bx);
+	dy = abs(bt->y - by);
+	dist = dx>dy ? dx : dy;
+
+	if ( ((dist - bt->radius) >> FRACBITS) >= damage )
+	    continue;
+
+	if (!func( bt->mo ) )
+	{
+	    blockiters = iter.prev;
 	    return false;
+	}
     }
+
+    blockiters = iter.prev;
     return true;
 }
 
@@ -712,6 +876,48 @@ boolean PIT_AddThingIntercepts (mobj_t* thing)
 }
 
 
+//
+// [AP] P_TraverseSortedIntercepts
+// Sorts the intercepts once, then goes through them in order. The sort
+// is stable, so ties go in the order they were added, as when picking
+// the closest one each time. Blocks are added along the trace, so the
+// list is nearly sorted already and insertion sort is about linear.
+// Only for single player: a traverser that starts another trace would
+// reuse the buffer under either loop, but differently.
+//
+static boolean
+P_TraverseSortedIntercepts
+( traverser_t	func,
+  fixed_t	maxfrac )
+{
+    intercept_t*	scan;
+    intercept_t*	in;
+    intercept_t		tmp;
+
+    if (intercept_p == intercepts)
+	return true;		// nothing hit
+
+    for (scan = intercepts + 1 ; scan < intercept_p ; scan++)
+    {
+	tmp = *scan;
+	for (in = scan ; in > intercepts && (in - 1)->frac > tmp.frac ; in--)
+	    *in = *(in - 1);
+	*in = tmp;
+    }
+
+    for (in = intercepts ; in < intercept_p ; in++)
+    {
+	if (in->frac > maxfrac)
+	    return true;	// checked everything in range
+
+	if ( !func (in) )
+	    return false;	// don't bother going farther
+    }
+
+    return true;		// everything was traversed
+}
+
+
 //
 // P_TraverseIntercepts
 // Returns true if the traverser function returns true
@@ -727,6 +933,10 @@ P_TraverseIntercepts
     intercept_t*	scan;
     intercept_t*	in;
 	
+    // [AP] No demo or netgame to stay in step with
+    if (crispy->singleplayer)
+	return P_TraverseSortedIntercepts(func, maxfrac);
+
     count = intercept_p - intercepts;
     
     in = 0;			// shut up compiler warning
@@ -389,7 +389,8 @@ void P_ZMovement (mobj_t* mo)
 		if (!crispy->mouselook)
 		    mo->player->centering = true;
 		// [crispy] dead men don't say "oof"
-		if (mo->health > 0 || !crispy->soundfix)
+		// [AP] nor do predicted players, whose origin is temporary
+		if ((mo->health > 0 || !crispy->soundfix) && !predicting)
 		{
 		// [NS] Landing sound for longer falls. (Hexen's calculation.)
 		if (mo->momz < -GRAVITY * 12)
@@ -651,7 +652,7 @@ P_SpawnMobjSafe
     state_t*	st;
     mobjinfo_t*	info;
 	
-    mobj = Z_Malloc (sizeof(*mobj), PU_LEVEL, NULL);
+    mobj = P_AllocThinker (sizeof(*mobj));
     memset (mobj, 0, sizeof (*mobj));
     info = &mobjinfo[type];
 	
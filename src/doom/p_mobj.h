@@ -213,24 +213,25 @@ typedef struct mobj_s
     thinker_t		thinker;
 
     // Info for drawing: position.
+    // [AP] Must follow the thinker, as in degenmobj_t.
     fixed_t		x;
     fixed_t		y;
     fixed_t		z;
 
-    // More list: links in sector (if needed)
-    struct mobj_s*	snext;
-    struct mobj_s*	sprev;
+    // [AP] What P_MobjThinker, the movement code and PIT_CheckThing go
+    // through on every tic comes first, so it spans as few cache lines
+    // as it can. Savegames write the fields one by one, the order here
+    // doesn't matter to them.
 
-    //More drawing info: to determine current sprite.
-    angle_t		angle;	// orientation
-    spritenum_t		sprite;	// used to find patch_t and flip value
-    int			frame;	// might be ORed with FF_FULLBRIGHT
+    // Momentums, used to update position.
+    fixed_t		momx;
+    fixed_t		momy;
+    fixed_t		momz;
+
+    int			flags;
+    int			tics;	// state tic counter
+    state_t*		state;
 
-    // Interaction info, by BLOCKMAP.
-    // Links in blocks (if needed).
-    struct mobj_s*	bnext;
-    struct mobj_s*	bprev;
-    
     struct subsector_s*	subsector;
 
     // The closest interval over all contacted Sectors.
@@ -241,30 +242,41 @@ typedef struct mobj_s
     fixed_t		radius;
     fixed_t		height;	
 
-    // Momentums, used to update position.
-    fixed_t		momx;
-    fixed_t		momy;
-    fixed_t		momz;
+    // Interaction info, by BLOCKMAP.
+    // [AP] Block it's packed into (if needed), see blockthings.
+    int			blocknum;
 
     // If == validcount, already checked.
     int			validcount;
 
     mobjtype_t		type;
-    mobjinfo_t*		info;	// &mobjinfo[mobj->type]
-    
-    int			tics;	// state tic counter
-    state_t*		state;
-    int			flags;
     int			health;
 
-    // Movement direction, movement generation (zig-zagging).
-    int			movedir;	// 0-7
-    int			movecount;	// when 0, select a new dir
+    //More drawing info: to determine current sprite.
+    angle_t		angle;	// orientation
+    spritenum_t		sprite;	// used to find patch_t and flip value
+    int			frame;	// might be ORed with FF_FULLBRIGHT
+
+    // [AM] If true, ok to interpolate this tic.
+    int                 interp;
+
+    // [AM] Previous position of mobj before think.
+    //      Used to interpolate between positions.
+    fixed_t		oldx;
+    fixed_t		oldy;
+    fixed_t		oldz;
+    angle_t		oldangle;
 
     // Thing being chased/attacked (or NULL),
     // also the originator for missiles.
     struct mobj_s*	target;
 
+    mobjinfo_t*		info;	// &mobjinfo[mobj->type]
+
+    // Movement direction, movement generation (zig-zagging).
+    int			movedir;	// 0-7
+    int			movecount;	// when 0, select a new dir
+
     // Reaction time: if non 0, don't attack yet.
     // Used by player to freeze a bit after teleporting.
     int			reactiontime;   
@@ -273,28 +285,22 @@ typedef struct mobj_s
     // no matter what (even if shot)
     int			threshold;
 
+    // Player number last looked for.
+    int			lastlook;	
+
+    // More list: links in sector (if needed)
+    struct mobj_s*	snext;
+    struct mobj_s*	sprev;
+
     // Additional info record for player avatars only.
     // Only valid if type == MT_PLAYER
     struct player_s*	player;
 
-    // Player number last looked for.
-    int			lastlook;	
-
     // For nightmare respawn.
     mapthing_t		spawnpoint;	
 
     // Thing being chased/attacked for tracers.
     struct mobj_s*	tracer;	
-    
-    // [AM] If true, ok to interpolate this tic.
-    int                 interp;
-
-    // [AM] Previous position of mobj before think.
-    //      Used to interpolate between positions.
-    fixed_t		oldx;
-    fixed_t		oldy;
-    fixed_t		oldz;
-    angle_t		oldangle;
 
     // [AP] index of the obj in the file. This is how we uniquely refer
     int index;
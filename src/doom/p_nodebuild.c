@@ -0,0 +1,804 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	[AP] Node builder. It splits the segs of the lines by one of those
+//	lines until every set is convex, choosing the line that splits the
+//	fewest and balances the sides best, and writes the result as an
+//	uncompressed ZDBSP nodes lump, which P_LoadNodes_XNOD() then loads
+//	like a prebuilt one. Partitions are always whole map units, since
+//	they come from the map's own lines, so they fit the lump exactly.
+//	Scoring the candidates for a big set of segs is spread over jobs.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i_jobs.h"
+#include "i_swap.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_bbox.h"
+#include "m_config.h"
+#include "m_misc.h"
+#include "p_local.h"
+#include "p_nodebuild.h"
+#include "sha1.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+// Part of the cache key, change it when the output would change
+#define NODEBUILD_VERSION "APNODES1"
+
+#define SPLITCOST 8
+#define MAXCANDIDATES 64
+#define JOBSEGS 1024 // Fewer segs than this score on the main thread
+#define ONLINE_EPSILON (FRACUNIT / 64.0)
+
+enum
+{
+    SIDE_FRONT,
+    SIDE_BACK,
+    SIDE_SPLIT
+};
+
+typedef struct
+{
+    int v1, v2;
+    int linedef;
+    int side;
+} bseg_t;
+
+typedef struct
+{
+    fixed_t x, y;           // Whole map units
+    int dx, dy;             // In map units
+    int nodedx, nodedy;     // As short as the lump needs them
+    double epsilon;         // ONLINE_EPSILON, scaled like Cross()
+} partition_t;
+
+typedef struct
+{
+    const int *list;
+    int count;
+    const int *candidates;
+    int first, last;
+    int best, bestcost;
+} scorejob_t;
+
+static fixed_t *bvx, *bvy;
+static int numbverts, maxbverts;
+
+static bseg_t *bsegs;
+static int numbsegs, maxbsegs;
+
+// Output, in lump order
+static int *outsegs;
+static int numoutsegs, maxoutsegs;
+static int *outsubsectors;
+static int numoutsubsectors, maxoutsubsectors;
+static mapnode_zdbsp_t *outnodes;
+static int numoutnodes, maxoutnodes;
+
+//
+// P_NodesUsable
+//
+
+static boolean LumpIs (int lump, const char *name)
+{
+    return lump < numlumps && !strncasecmp(lumpinfo[lump]->name, name, 8);
+}
+
+boolean P_NodesUsable (int lumpnum, mapformat_t format)
+{
+    mapnode_t *mn;
+    mapsubsector_t *ms;
+    mapseg_t *ml;
+    int nodeslen, sslen, segslen;
+    int numn, nums, numg;
+    boolean usable = true;
+    int i, j;
+
+    // Only node builders write these, and they don't stop halfway
+    if (format & (MFMT_DEEPBSP | MFMT_ZDBSPX | MFMT_ZDBSPZ))
+	return true;
+
+    if (!LumpIs(lumpnum + ML_SEGS, "SEGS")
+     || !LumpIs(lumpnum + ML_SSECTORS, "SSECTORS")
+     || !LumpIs(lumpnum + ML_NODES, "NODES"))
+	return false;
+
+    nodeslen = W_LumpLength(lumpnum + ML_NODES);
+    sslen = W_LumpLength(lumpnum + ML_SSECTORS);
+    segslen = W_LumpLength(lumpnum + ML_SEGS);
+
+    if (nodeslen % sizeof(mapnode_t) || sslen % sizeof(mapsubsector_t)
+     || segslen % sizeof(mapseg_t))
+	return false;
+
+    numn = nodeslen / sizeof(mapnode_t);
+    nums = sslen / sizeof(mapsubsector_t);
+    numg = segslen / sizeof(mapseg_t);
+
+    // Nodes can't point at more subsectors than that
+    if (!nums || !numg || (!numn && nums != 1) || nums > NF_SUBSECTOR_VANILLA)
+	return false;
+
+    ml = W_CacheLumpNum(lumpnum + ML_SEGS, PU_STATIC);
+    for (i = 0; i < numg && usable; i++)
+    {
+	unsigned int v1 = (unsigned short) SHORT(ml[i].v1);
+	unsigned int v2 = (unsigned short) SHORT(ml[i].v2);
+	unsigned int linedef = (unsigned short) SHORT(ml[i].linedef);
+	int side = SHORT(ml[i].side);
+
+	usable = v1 < (unsigned) numvertexes && v2 < (unsigned) numvertexes
+	      && linedef < (unsigned) numlines && (side == 0 || side == 1)
+	      && lines[linedef].sidenum[side] < numsides;
+    }
+    W_ReleaseLumpNum(lumpnum + ML_SEGS);
+
+    ms = W_CacheLumpNum(lumpnum + ML_SSECTORS, PU_STATIC);
+    for (i = 0; i < nums && usable; i++)
+    {
+	int first = (unsigned short) SHORT(ms[i].firstseg);
+	int count = (unsigned short) SHORT(ms[i].numsegs);
+
+	usable = count > 0 && first + count <= numg;
+    }
+    W_ReleaseLumpNum(lumpnum + ML_SSECTORS);
+
+    if (numn)
+    {
+	mn = W_CacheLumpNum(lumpnum + ML_NODES, PU_STATIC);
+	for (i = 0; i < numn && usable; i++)
+	{
+	    for (j = 0; j < 2 && usable; j++)
+	    {
+		int child = (unsigned short) SHORT(mn[i].children[j]);
+
+		if (child == NO_INDEX)
+		    usable = false;
+		else if (child & NF_SUBSECTOR_VANILLA)
+		    usable = (child & ~NF_SUBSECTOR_VANILLA) < nums;
+		else
+		    usable = child < numn;
+	    }
+	}
+	W_ReleaseLumpNum(lumpnum + ML_NODES);
+    }
+
+    return usable;
+}
+
+//
+// Building
+//
+
+static int AddVertex (fixed_t x, fixed_t y)
+{
+    if (numbverts == maxbverts)
+    {
+	maxbverts = maxbverts ? maxbverts * 2 : 1024;
+	bvx = I_Realloc(bvx, maxbverts * sizeof(*bvx));
+	bvy = I_Realloc(bvy, maxbverts * sizeof(*bvy));
+    }
+
+    bvx[numbverts] = x;
+    bvy[numbverts] = y;
+
+    return numbverts++;
+}
+
+static int AddSeg (int v1, int v2, int linedef, int side)
+{
+    if (numbsegs == maxbsegs)
+    {
+	maxbsegs = maxbsegs ? maxbsegs * 2 : 1024;
+	bsegs = I_Realloc(bsegs, maxbsegs * sizeof(*bsegs));
+    }
+
+    bsegs[numbsegs].v1 = v1;
+    bsegs[numbsegs].v2 = v2;
+    bsegs[numbsegs].linedef = linedef;
+    bsegs[numbsegs].side = side;
+
+    return numbsegs++;
+}
+
+// The seg's line, facing the same way, or false if the lump can't hold it
+static boolean SegPartition (const bseg_t *seg, partition_t *p)
+{
+    const line_t *line = &lines[seg->linedef];
+    const vertex_t *v1 = seg->side ? line->v2 : line->v1;
+    const vertex_t *v2 = seg->side ? line->v1 : line->v2;
+
+    if ((v1->x | v1->y | v2->x | v2->y) & (FRACUNIT - 1))
+	return false;
+
+    p->x = v1->x;
+    p->y = v1->y;
+    p->dx = (v2->x - v1->x) >> FRACBITS;
+    p->dy = (v2->y - v1->y) >> FRACBITS;
+
+    if (!p->dx && !p->dy)
+	return false;
+
+    // Same line, fewer bits
+    p->nodedx = p->dx;
+    p->nodedy = p->dy;
+    while ((p->nodedx < -32768 || p->nodedx > 32767
+         || p->nodedy < -32768 || p->nodedy > 32767)
+        && !((p->nodedx | p->nodedy) & 1))
+    {
+	p->nodedx /= 2;
+	p->nodedy /= 2;
+    }
+
+    if (p->nodedx < -32768 || p->nodedx > 32767
+     || p->nodedy < -32768 || p->nodedy > 32767
+     || p->x >> FRACBITS < -32768 || p->x >> FRACBITS > 32767
+     || p->y >> FRACBITS < -32768 || p->y >> FRACBITS > 32767)
+	return false;
+
+    p->epsilon = ONLINE_EPSILON * sqrt((double) p->dx * p->dx
+                                       + (double) p->dy * p->dy);
+
+    return true;
+}
+
+// Positive on the left, the back, like R_PointOnSide()
+static int64_t Cross (const partition_t *p, int v)
+{
+    return (int64_t) p->dx * ((int64_t) bvy[v] - p->y)
+         - (int64_t) p->dy * ((int64_t) bvx[v] - p->x);
+}
+
+static int PointSide (const partition_t *p, int64_t cross)
+{
+    if (cross > p->epsilon)
+	return SIDE_BACK;
+    if (cross < -p->epsilon)
+	return SIDE_FRONT;
+    return -1; // On the line
+}
+
+static int SegSide (const bseg_t *seg, const partition_t *p)
+{
+    int s1 = PointSide(p, Cross(p, seg->v1));
+    int s2 = PointSide(p, Cross(p, seg->v2));
+
+    if (s1 == -1 && s2 == -1)
+    {
+	// Along the line, the side it faces
+	int64_t dot = (int64_t) p->dx * ((int64_t) bvx[seg->v2] - bvx[seg->v1])
+	            + (int64_t) p->dy * ((int64_t) bvy[seg->v2] - bvy[seg->v1]);
+
+	return dot > 0 ? SIDE_FRONT : SIDE_BACK;
+    }
+    if (s1 == -1)
+	return s2;
+    if (s2 == -1 || s1 == s2)
+	return s1;
+    return SIDE_SPLIT;
+}
+
+// Cost of a partition, or -1 if everything stays on the front
+static int ScorePartition (const int *list, int count, const partition_t *p,
+                           int bestcost)
+{
+    int front = 0, back = 0, splits = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+	switch (SegSide(&bsegs[list[i]], p))
+	{
+	    case SIDE_FRONT:
+		front++;
+		break;
+	    case SIDE_BACK:
+		back++;
+		break;
+	    default:
+		// Only gets worse from here
+		if (++splits * SPLITCOST > bestcost && bestcost >= 0)
+		    return -1;
+		break;
+	}
+    }
+
+    if (!back && !splits)
+	return -1;
+
+    return splits * SPLITCOST + abs(front - back);
+}
+
+static void ScoreCandidates (void *data, int worker)
+{
+    scorejob_t *job = data;
+    partition_t p;
+    int i, cost;
+
+    job->best = -1;
+    job->bestcost = -1;
+
+    for (i = job->first; i < job->last; i++)
+    {
+	if (!SegPartition(&bsegs[job->candidates[i]], &p))
+	    continue;
+
+	cost = ScorePartition(job->list, job->count, &p, job->bestcost);
+	if (cost >= 0 && (job->bestcost < 0 || cost < job->bestcost))
+	{
+	    job->best = i;
+	    job->bestcost = cost;
+	}
+    }
+}
+
+// The best of candidates, the same however many jobs score them
+static int BestCandidate (const int *list, int count,
+                          const int *candidates, int numcandidates)
+{
+    scorejob_t jobs[16];
+    int numjobs, best, bestcost, i;
+
+    numjobs = count < JOBSEGS ? 1 : I_JobThreads();
+    numjobs = BETWEEN(1, MIN(arrlen(jobs), numcandidates), numjobs);
+
+    for (i = 0; i < numjobs; i++)
+    {
+	jobs[i].list = list;
+	jobs[i].count = count;
+	jobs[i].candidates = candidates;
+	jobs[i].first = numcandidates * i / numjobs;
+	jobs[i].last = numcandidates * (i + 1) / numjobs;
+    }
+
+    if (numjobs == 1)
+    {
+	ScoreCandidates(&jobs[0], 0);
+    }
+    else
+    {
+	jobgroup_t *group = I_JobGroup();
+
+	for (i = 0; i < numjobs; i++)
+	    I_AddJob(group, ScoreCandidates, &jobs[i]);
+	I_FreeJobGroup(group);
+    }
+
+    best = -1;
+    bestcost = -1;
+    for (i = 0; i < numjobs; i++)
+    {
+	if (jobs[i].best >= 0 && (bestcost < 0 || jobs[i].bestcost < bestcost))
+	{
+	    best = jobs[i].best;
+	    bestcost = jobs[i].bestcost;
+	}
+    }
+
+    return best >= 0 ? candidates[best] : -1;
+}
+
+// False if the segs are convex already
+static boolean ChoosePartition (const int *list, int count, partition_t *p)
+{
+    int *candidates;
+    int numcandidates, best, i;
+
+    candidates = malloc(count * sizeof(*candidates));
+    if (!candidates)
+	I_Error("P_BuildNodes: Out of memory");
+
+    // A sample first, everything only if none of it would do
+    numcandidates = 0;
+    for (i = 0; i < MIN(count, MAXCANDIDATES); i++)
+	candidates[numcandidates++] = list[(int64_t) i * count / MIN(count, MAXCANDIDATES)];
+
+    best = BestCandidate(list, count, candidates, numcandidates);
+
+    if (best < 0 && count > MAXCANDIDATES)
+    {
+	memcpy(candidates, list, count * sizeof(*candidates));
+	best = BestCandidate(list, count, candidates, count);
+    }
+
+    free(candidates);
+
+    return best >= 0 && SegPartition(&bsegs[best], p);
+}
+
+static int SplitVertex (int seg, const partition_t *p, int firstnew)
+{
+    const bseg_t *s = &bsegs[seg];
+    // From the lower vertex, so both sides of a line split the same
+    int a = MIN(s->v1, s->v2), b = MAX(s->v1, s->v2);
+    double ca = (double) Cross(p, a), cb = (double) Cross(p, b);
+    double t = ca / (ca - cb);
+    fixed_t x = (fixed_t) lround(bvx[a] + t * ((double) bvx[b] - bvx[a]));
+    fixed_t y = (fixed_t) lround(bvy[a] + t * ((double) bvy[b] - bvy[a]));
+    int i;
+
+    for (i = firstnew; i < numbverts; i++)
+    {
+	if (bvx[i] == x && bvy[i] == y)
+	    return i;
+    }
+
+    return AddVertex(x, y);
+}
+
+static void SplitSegs (const int *list, int count, const partition_t *p,
+                       int *front, int *numfront, int *back, int *numback)
+{
+    int firstnew = numbverts;
+    int i;
+
+    *numfront = *numback = 0;
+
+    for (i = 0; i < count; i++)
+    {
+	int seg = list[i];
+	int v, rest;
+
+	switch (SegSide(&bsegs[seg], p))
+	{
+	    case SIDE_FRONT:
+		front[(*numfront)++] = seg;
+		break;
+	    case SIDE_BACK:
+		back[(*numback)++] = seg;
+		break;
+	    default:
+		v = SplitVertex(seg, p, firstnew);
+
+		// Rounding can land the split on an end
+		if (v == bsegs[seg].v1 || v == bsegs[seg].v2
+		 || (bvx[v] == bvx[bsegs[seg].v1] && bvy[v] == bvy[bsegs[seg].v1])
+		 || (bvx[v] == bvx[bsegs[seg].v2] && bvy[v] == bvy[bsegs[seg].v2]))
+		{
+		    if (PointSide(p, Cross(p, bsegs[seg].v1)) == SIDE_BACK
+		     || PointSide(p, Cross(p, bsegs[seg].v2)) == SIDE_BACK)
+			back[(*numback)++] = seg;
+		    else
+			front[(*numfront)++] = seg;
+		    break;
+		}
+
+		rest = AddSeg(v, bsegs[seg].v2, bsegs[seg].linedef, bsegs[seg].side);
+		bsegs[seg].v2 = v;
+
+		if (PointSide(p, Cross(p, bsegs[seg].v1)) == SIDE_FRONT)
+		{
+		    front[(*numfront)++] = seg;
+		    back[(*numback)++] = rest;
+		}
+		else
+		{
+		    back[(*numback)++] = seg;
+		    front[(*numfront)++] = rest;
+		}
+		break;
+	}
+    }
+}
+
+static void SegsBox (const int *list, int count, short *box)
+{
+    fixed_t bbox[4];
+    int i;
+
+    M_ClearBox(bbox);
+    for (i = 0; i < count; i++)
+    {
+	M_AddToBox(bbox, bvx[bsegs[list[i]].v1], bvy[bsegs[list[i]].v1]);
+	M_AddToBox(bbox, bvx[bsegs[list[i]].v2], bvy[bsegs[list[i]].v2]);
+    }
+
+    // Outwards to whole units
+    box[BOXTOP] = SHORT((short) ((bbox[BOXTOP] + FRACUNIT - 1) >> FRACBITS));
+    box[BOXBOTTOM] = SHORT((short) (bbox[BOXBOTTOM] >> FRACBITS));
+    box[BOXLEFT] = SHORT((short) (bbox[BOXLEFT] >> FRACBITS));
+    box[BOXRIGHT] = SHORT((short) ((bbox[BOXRIGHT] + FRACUNIT - 1) >> FRACBITS));
+}
+
+static int AddSubsector (const int *list, int count)
+{
+    int i;
+
+    if (numoutsegs + count > maxoutsegs)
+    {
+	while (numoutsegs + count > maxoutsegs)
+	    maxoutsegs = maxoutsegs ? maxoutsegs * 2 : 1024;
+	outsegs = I_Realloc(outsegs, maxoutsegs * sizeof(*outsegs));
+    }
+    for (i = 0; i < count; i++)
+	outsegs[numoutsegs++] = list[i];
+
+    if (numoutsubsectors == maxoutsubsectors)
+    {
+	maxoutsubsectors = maxoutsubsectors ? maxoutsubsectors * 2 : 256;
+	outsubsectors = I_Realloc(outsubsectors,
+	                          maxoutsubsectors * sizeof(*outsubsectors));
+    }
+    outsubsectors[numoutsubsectors] = count;
+
+    return numoutsubsectors++ | NF_SUBSECTOR;
+}
+
+// Children first, so the root ends up last like the renderer wants it
+static int BuildNode (const int *list, int count, short *box)
+{
+    mapnode_zdbsp_t node;
+    partition_t p;
+    short childbox[2][4];
+    int children[2];
+    int *front, *back;
+    int numfront, numback;
+
+    SegsBox(list, count, box);
+
+    if (!ChoosePartition(list, count, &p))
+	return AddSubsector(list, count);
+
+    // Splits add a seg to each side
+    front = malloc(count * sizeof(*front));
+    back = malloc(count * sizeof(*back));
+    if (!front || !back)
+	I_Error("P_BuildNodes: Out of memory");
+
+    SplitSegs(list, count, &p, front, &numfront, back, &numback);
+
+    // Splits that rounded away can leave a side empty, don't go around
+    // in circles over it
+    if (!numfront || !numback)
+    {
+	free(front);
+	free(back);
+	return AddSubsector(list, count);
+    }
+
+    node.x = SHORT((short) (p.x >> FRACBITS));
+    node.y = SHORT((short) (p.y >> FRACBITS));
+    node.dx = SHORT((short) p.nodedx);
+    node.dy = SHORT((short) p.nodedy);
+    children[0] = BuildNode(front, numfront, childbox[0]);
+    children[1] = BuildNode(back, numback, childbox[1]);
+    node.children[0] = LONG(children[0]);
+    node.children[1] = LONG(children[1]);
+    memcpy(node.bbox, childbox, sizeof(node.bbox));
+
+    free(front);
+    free(back);
+
+    if (numoutnodes == maxoutnodes)
+    {
+	maxoutnodes = maxoutnodes ? maxoutnodes * 2 : 256;
+	outnodes = I_Realloc(outnodes, maxoutnodes * sizeof(*outnodes));
+    }
+    outnodes[numoutnodes] = node;
+
+    return numoutnodes++;
+}
+
+static void WriteLong (byte **p, unsigned int value)
+{
+    (*p)[0] = value & 0xff;
+    (*p)[1] = (value >> 8) & 0xff;
+    (*p)[2] = (value >> 16) & 0xff;
+    (*p)[3] = value >> 24;
+    *p += 4;
+}
+
+// As a ZDBSP nodes lump
+static byte *WriteNodes (int *length)
+{
+    byte *data, *p;
+    int i;
+
+    *length = 4 + 8 + (numbverts - numvertexes) * 8
+            + 4 + numoutsubsectors * sizeof(mapsubsector_zdbsp_t)
+            + 4 + numoutsegs * sizeof(mapseg_zdbsp_t)
+            + 4 + numoutnodes * sizeof(mapnode_zdbsp_t);
+    data = p = Z_Malloc(*length, PU_STATIC, 0);
+
+    memcpy(p, "XNOD", 4);
+    p += 4;
+
+    WriteLong(&p, numvertexes);
+    WriteLong(&p, numbverts - numvertexes);
+    for (i = numvertexes; i < numbverts; i++)
+    {
+	WriteLong(&p, bvx[i]);
+	WriteLong(&p, bvy[i]);
+    }
+
+    WriteLong(&p, numoutsubsectors);
+    for (i = 0; i < numoutsubsectors; i++)
+	WriteLong(&p, outsubsectors[i]);
+
+    WriteLong(&p, numoutsegs);
+    for (i = 0; i < numoutsegs; i++)
+    {
+	const bseg_t *seg = &bsegs[outsegs[i]];
+
+	WriteLong(&p, seg->v1);
+	WriteLong(&p, seg->v2);
+	p[0] = seg->linedef & 0xff;
+	p[1] = seg->linedef >> 8;
+	p[2] = seg->side;
+	p += 3;
+    }
+
+    WriteLong(&p, numoutnodes);
+    memcpy(p, outnodes, numoutnodes * sizeof(*outnodes));
+
+    return data;
+}
+
+static byte *BuildNodes (int *length)
+{
+    short box[4];
+    int *list;
+    int i, j;
+
+    numbverts = numbsegs = numoutsegs = numoutsubsectors = numoutnodes = 0;
+
+    for (i = 0; i < numvertexes; i++)
+	AddVertex(vertexes[i].x, vertexes[i].y);
+
+    // The ZDBSP format's segs have room for 65536 lines
+    for (i = 0; i < numlines && i < 65536; i++)
+    {
+	for (j = 0; j < 2; j++)
+	{
+	    if (lines[i].sidenum[j] < numsides
+	     && (lines[i].v1->x != lines[i].v2->x
+	      || lines[i].v1->y != lines[i].v2->y))
+	    {
+		AddSeg(j ? lines[i].v2 - vertexes : lines[i].v1 - vertexes,
+		       j ? lines[i].v1 - vertexes : lines[i].v2 - vertexes,
+		       i, j);
+	    }
+	}
+    }
+
+    if (!numbsegs)
+	I_Error("P_BuildNodes: No lines to build nodes from!");
+
+    list = malloc(numbsegs * sizeof(*list));
+    if (!list)
+	I_Error("P_BuildNodes: Out of memory");
+    for (i = 0; i < numbsegs; i++)
+	list[i] = i;
+
+    BuildNode(list, numbsegs, box);
+    free(list);
+
+    return WriteNodes(length);
+}
+
+//
+// Cache
+//
+
+static char *NodesCachePath (int lumpnum)
+{
+    sha1_context_t sha1;
+    sha1_digest_t digest;
+    char hex[41];
+    char *dir, *path;
+    int i;
+
+    SHA1_Init(&sha1);
+    SHA1_UpdateString(&sha1, NODEBUILD_VERSION);
+    SHA1_Update(&sha1, W_CacheLumpNum(lumpnum + ML_VERTEXES, PU_STATIC),
+                W_LumpLength(lumpnum + ML_VERTEXES));
+    W_ReleaseLumpNum(lumpnum + ML_VERTEXES);
+    SHA1_Update(&sha1, W_CacheLumpNum(lumpnum + ML_LINEDEFS, PU_STATIC),
+                W_LumpLength(lumpnum + ML_LINEDEFS));
+    W_ReleaseLumpNum(lumpnum + ML_LINEDEFS);
+    SHA1_Final(digest, &sha1);
+
+    for (i = 0; i < 20; i++)
+	M_snprintf(hex + i * 2, 3, "%02x", digest[i]);
+
+    dir = M_StringJoin(configdir, "nodes", NULL);
+    M_MakeDirectory(dir);
+    path = M_StringJoin(dir, DIR_SEPARATOR_S, hex, ".xnod", NULL);
+    free(dir);
+
+    return path;
+}
+
+// What a cached file needs for P_LoadNodes_XNOD() not to read past it
+static boolean CachedNodesValid (const byte *data, int length)
+{
+    const byte *p = data + 4, *end = data + length;
+    unsigned int count;
+
+#define READLONG(v) \
+    do { if (end - p < 4) return false; \
+         v = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24); \
+         p += 4; } while (0)
+
+    if (length < 4 || memcmp(data, "XNOD", 4))
+	return false;
+
+    READLONG(count);
+    if (count != (unsigned int) numvertexes)
+	return false;
+    READLONG(count);
+    if ((unsigned int) (end - p) / 8 < count)
+	return false;
+    p += count * 8;
+
+    READLONG(count);
+    if ((unsigned int) (end - p) / sizeof(mapsubsector_zdbsp_t) < count)
+	return false;
+    p += count * sizeof(mapsubsector_zdbsp_t);
+
+    READLONG(count);
+    if ((unsigned int) (end - p) / sizeof(mapseg_zdbsp_t) < count)
+	return false;
+    p += count * sizeof(mapseg_zdbsp_t);
+
+    READLONG(count);
+    return (unsigned int) (end - p) == count * sizeof(mapnode_zdbsp_t);
+
+#undef READLONG
+}
+
+void P_BuildNodes (int lumpnum)
+{
+    char *path = NodesCachePath(lumpnum);
+    byte *data = NULL;
+    int length = 0;
+
+    if (M_FileExists(path))
+    {
+	length = M_ReadFile(path, &data);
+	if (!CachedNodesValid(data, length))
+	{
+	    Z_Free(data);
+	    data = NULL;
+	}
+    }
+
+    if (data)
+    {
+	fprintf(stderr, "P_BuildNodes: Nodes from %s\n", path);
+    }
+    else
+    {
+	int starttime = I_GetTimeMS();
+
+	data = BuildNodes(&length);
+	fprintf(stderr, "P_BuildNodes: %d nodes, %d subsectors, %d segs "
+	        "in %d ms\n", numoutnodes, numoutsubsectors, numoutsegs,
+	        I_GetTimeMS() - starttime);
+
+	if (!M_WriteFile(path, data, length))
+	    fprintf(stderr, "P_BuildNodes: Unable to write %s\n", path);
+    }
+
+    P_LoadNodes_XNOD(data + 4);
+
+    Z_Free(data);
+    free(path);
+}
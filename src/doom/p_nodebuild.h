@@ -0,0 +1,33 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	[AP] Node builder, for maps that come without usable nodes
+//
+
+#ifndef __P_NODEBUILD__
+#define __P_NODEBUILD__
+
+#include "doomtype.h"
+#include "p_extnodes.h"
+
+// False when the map's NODES, SSECTORS and SEGS are missing, or don't
+// fit together and with the lines and vertexes already loaded.
+boolean P_NodesUsable (int lumpnum, mapformat_t format);
+
+// Loads nodes built from the lines and vertexes already loaded, in place
+// of the map's. They're kept in the config dir, keyed by the map's
+// VERTEXES and LINEDEFS, so a map only builds on its first load.
+void P_BuildNodes (int lumpnum);
+
+#endif
@@ -163,7 +163,7 @@ EV_DoPlat
 	
 	// Find lowest & highest floors around sector
 	rtn = 1;
-	plat = Z_Malloc( sizeof(*plat), PU_LEVSPEC, 0);
+	plat = P_AllocThinker (sizeof(*plat));
 	P_AddThinker(&plat->thinker);
 		
 	plat->type = type;
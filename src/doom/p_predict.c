@@ -0,0 +1,166 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Local player prediction for netgames.
+//
+//	The console player's own ticcmds that the server hasn't sent back
+//	yet are run on a copy of its mobj, which is what the view and the
+//	automap then follow. Only movement is predicted: items, lines and
+//	sounds are left for when the tics really run. Before a real tic,
+//	the handful of player fields it touched are put back, so the game
+//	itself never sees the prediction.
+//
+
+#include "doomdef.h"
+#include "doomstat.h"
+#include "d_player.h"
+#include "p_local.h"
+#include "r_main.h"
+
+boolean predicting = false;
+mobj_t *predictedmo = NULL;
+
+// Player fields that prediction changes
+
+typedef struct
+{
+    mobj_t *mo;
+    fixed_t viewz, oldviewz;
+    fixed_t viewheight, deltaviewheight;
+    fixed_t bob, bob2;
+    int lookdir, oldlookdir;
+    boolean centering;
+    unsigned int jumpTics;
+} playersnapshot_t;
+
+static playersnapshot_t snapshot;
+static mobj_t ghost;
+
+static void SaveSnapshot(player_t *player)
+{
+    snapshot.mo = player->mo;
+    snapshot.viewz = player->viewz;
+    snapshot.oldviewz = player->oldviewz;
+    snapshot.viewheight = player->viewheight;
+    snapshot.deltaviewheight = player->deltaviewheight;
+    snapshot.bob = player->bob;
+    snapshot.bob2 = player->bob2;
+    snapshot.lookdir = player->lookdir;
+    snapshot.oldlookdir = player->oldlookdir;
+    snapshot.centering = player->centering;
+    snapshot.jumpTics = player->jumpTics;
+}
+
+static void RestoreSnapshot(player_t *player)
+{
+    player->mo = snapshot.mo;
+    player->viewz = snapshot.viewz;
+    player->oldviewz = snapshot.oldviewz;
+    player->viewheight = snapshot.viewheight;
+    player->deltaviewheight = snapshot.deltaviewheight;
+    player->bob = snapshot.bob;
+    player->bob2 = snapshot.bob2;
+    player->lookdir = snapshot.lookdir;
+    player->oldlookdir = snapshot.oldlookdir;
+    player->centering = snapshot.centering;
+    player->jumpTics = snapshot.jumpTics;
+}
+
+// The movement half of P_PlayerThink, then of P_MobjThinker
+
+static void PredictTic(player_t *player, ticcmd_t *cmd)
+{
+    mobj_t *mo = player->mo;
+
+    mo->interp = true;
+    mo->oldx = mo->x;
+    mo->oldy = mo->y;
+    mo->oldz = mo->z;
+    mo->oldangle = mo->angle;
+    player->oldviewz = player->viewz;
+    player->oldlookdir = player->lookdir;
+
+    player->cmd = *cmd;
+
+    if (player->cheats & CF_NOCLIP)
+	mo->flags |= MF_NOCLIP;
+    else
+	mo->flags &= ~MF_NOCLIP;
+
+    if (player->jumpTics)
+	player->jumpTics--;
+
+    if (mo->reactiontime)
+	mo->reactiontime--;
+    else
+	P_MovePlayer (player);
+
+    P_CalcHeight (player);
+
+    if (mo->momx || mo->momy)
+	P_XYMovement (mo);
+
+    if (mo->z != mo->floorz || mo->momz)
+	P_ZMovement (mo);
+}
+
+void P_PredictTics (ticcmd_t* cmds, int numcmds)
+{
+    player_t *player = &players[consoleplayer];
+    ticcmd_t savedcmd;
+    mobj_t *mo;
+    int savedflags;
+    int i;
+
+    if (predictedmo != NULL)
+    {
+	RestoreSnapshot(player);
+	predictedmo = NULL;
+    }
+
+    if (numcmds <= 0
+     || gamestate != GS_LEVEL
+     || demoplayback || demorecording
+     || paused
+     || !playeringame[consoleplayer]
+     || player->playerstate != PST_LIVE
+     || player->mo == NULL)
+    {
+	return;
+    }
+
+    mo = player->mo;
+
+    SaveSnapshot(player);
+    savedcmd = player->cmd;
+
+    // The copy must not bump into the real thing, which stays put
+    ghost = *mo;
+    savedflags = mo->flags;
+    mo->flags &= ~MF_SOLID;
+    player->mo = &ghost;
+
+    predicting = true;
+
+    for (i = 0; i < numcmds; ++i)
+    {
+	PredictTic(player, &cmds[i]);
+    }
+
+    predicting = false;
+
+    mo->flags = savedflags;
+    player->cmd = savedcmd;
+    predictedmo = mo;
+}
@@ -35,7 +35,7 @@
 
 #include "apdoom.h"
 
-FILE *save_stream;
+MEMFILE *save_stream;
 int savegamelength;
 boolean savegame_error;
 static int restoretargets_fail;
@@ -83,9 +83,11 @@ char *P_SaveGameFile(int slot)
 
 static byte saveg_read8(void)
 {
-    byte result = -1;
+    int result;
+
+    result = mem_fgetc(save_stream);
 
-    if (fread(&result, 1, 1, save_stream) < 1)
+    if (result == EOF)
     {
         if (!savegame_error)
         {
@@ -101,7 +103,7 @@ static byte saveg_read8(void)
 
 static void saveg_write8(byte value)
 {
-    if (fwrite(&value, 1, 1, save_stream) < 1)
+    if (mem_fputc(value, save_stream) == EOF)
     {
         if (!savegame_error)
         {
@@ -156,7 +158,7 @@ static void saveg_read_pad(void)
     int padding;
     int i;
 
-    pos = ftell(save_stream);
+    pos = mem_ftell(save_stream);
 
     padding = (4 - (pos & 3)) & 3;
 
@@ -172,7 +174,7 @@ static void saveg_write_pad(void)
     int padding;
     int i;
 
-    pos = ftell(save_stream);
+    pos = mem_ftell(save_stream);
 
     padding = (4 - (pos & 3)) & 3;
 
@@ -335,10 +337,10 @@ static void saveg_read_mobj_t(mobj_t *str)
     str->frame = saveg_read32();
 
     // struct mobj_s* bnext;
-    str->bnext = saveg_readp();
-
     // struct mobj_s* bprev;
-    str->bprev = saveg_readp();
+    // [AP] Replaced by blocknum, set again by P_SetThingPosition
+    saveg_readp();
+    saveg_readp();
 
     // struct subsector_s* subsector;
     str->subsector = saveg_readp();
@@ -453,7 +455,7 @@ uint32_t P_ThinkerToIndex (thinker_t* thinker)
     if (!thinker)
 	return 0;
 
-    for (th = thinkercap.next, i = 0; th != &thinkercap; th = th->next)
+    for (th = thinkerclasscap[th_mobj].cnext, i = 0; th != &thinkerclasscap[th_mobj]; th = th->cnext)
     {
 	if (th->function.acp1 == (actionf_p1) P_MobjThinker)
 	{
@@ -475,7 +477,7 @@ thinker_t* P_IndexToThinker (uint32_t index)
     if (!index)
 	return NULL;
 
-    for (th = thinkercap.next, i = 0; th != &thinkercap; th = th->next)
+    for (th = thinkerclasscap[th_mobj].cnext, i = 0; th != &thinkerclasscap[th_mobj]; th = th->cnext)
     {
 	if (th->function.acp1 == (actionf_p1) P_MobjThinker)
 	{
@@ -520,10 +522,10 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->frame);
 
     // struct mobj_s* bnext;
-    saveg_writep(str->bnext);
-
     // struct mobj_s* bprev;
-    saveg_writep(str->bprev);
+    // [AP] Replaced by blocknum, kept for the savegame layout
+    saveg_writep(NULL);
+    saveg_writep(NULL);
 
     // struct subsector_s* subsector;
     saveg_writep(str->subsector);
@@ -1624,6 +1626,8 @@ void P_UnArchiveWorld (void)
     line_t*		li;
     side_t*		si;
     
+    P_ClearSightCache (); // [AP] sector heights are about to change
+
     // do sectors
     for (i=0, sec = sectors ; i<numsectors ; i++,sec++)
     {
@@ -1631,6 +1635,11 @@ void P_UnArchiveWorld (void)
 	short floorpic, ceilingpic;
 	sec->floorheight = saveg_read16() << FRACBITS;
 	sec->ceilingheight = saveg_read16() << FRACBITS;
+	sec->surroundvalid = 0; // [AP]
+	sec->soundfloodgen = 0; // [AP]
+	// [AP] R_InterpolateSectors only updates the sectors that move
+	sec->interpfloorheight = sec->floorheight;
+	sec->interpceilingheight = sec->ceilingheight;
 	floorpic = saveg_read16();
 	ceilingpic = saveg_read16();
 	sec->lightlevel = saveg_read16();
@@ -1693,7 +1702,7 @@ void P_ArchiveThinkers (void)
     thinker_t*		th;
 
     // save off the current thinkers
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    for (th = thinkerclasscap[th_mobj].cnext ; th != &thinkerclasscap[th_mobj] ; th=th->cnext)
     {
 	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
 	{
@@ -1732,7 +1741,7 @@ void P_UnArchiveThinkers (void)
 	if (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker)
 	    P_RemoveMobj ((mobj_t *)currentthinker);
 	else
-	    Z_Free (currentthinker);
+	    P_FreeThinker (currentthinker);
 
 	currentthinker = next;
     }
@@ -1749,7 +1758,7 @@ void P_UnArchiveThinkers (void)
 			
 	  case tc_mobj:
 	    saveg_read_pad();
-	    mobj = Z_Malloc (sizeof(*mobj), PU_LEVEL, NULL);
+	    mobj = P_AllocThinker (sizeof(*mobj));
             saveg_read_mobj_t(mobj);
 
 	    // [crispy] restore mobj->target and mobj->tracer fields
@@ -1779,7 +1788,7 @@ void P_RestoreTargets (void)
     mobj_t*	mo;
     thinker_t*	th;
 
-    for (th = thinkercap.next; th != &thinkercap; th = th->next)
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj]; th = th->cnext)
     {
 	if (th->function.acp1 == (actionf_p1) P_MobjThinker)
 	{
@@ -1831,7 +1840,7 @@ void P_ArchiveSpecials (void)
     int			i;
 	
     // save off the current thinkers
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    for (th = thinkerclasscap[th_misc].cnext ; th != &thinkerclasscap[th_misc] ; th=th->cnext)
     {
 	if (th->function.acv == (actionf_v)NULL)
 	{
@@ -1949,7 +1958,7 @@ void P_UnArchiveSpecials (void)
 			
 	  case tc_ceiling:
 	    saveg_read_pad();
-	    ceiling = Z_Malloc (sizeof(*ceiling), PU_LEVEL, NULL);
+	    ceiling = P_AllocThinker (sizeof(*ceiling));
             saveg_read_ceiling_t(ceiling);
 	    ceiling->sector->specialdata = ceiling;
 
@@ -1962,7 +1971,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_door:
 	    saveg_read_pad();
-	    door = Z_Malloc (sizeof(*door), PU_LEVEL, NULL);
+	    door = P_AllocThinker (sizeof(*door));
             saveg_read_vldoor_t(door);
 	    door->sector->specialdata = door;
 	    door->thinker.function.acp1 = (actionf_p1)T_VerticalDoor;
@@ -1971,7 +1980,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_floor:
 	    saveg_read_pad();
-	    floor = Z_Malloc (sizeof(*floor), PU_LEVEL, NULL);
+	    floor = P_AllocThinker (sizeof(*floor));
             saveg_read_floormove_t(floor);
 	    floor->sector->specialdata = floor;
 	    floor->thinker.function.acp1 = (actionf_p1)T_MoveFloor;
@@ -1980,7 +1989,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_plat:
 	    saveg_read_pad();
-	    plat = Z_Malloc (sizeof(*plat), PU_LEVEL, NULL);
+	    plat = P_AllocThinker (sizeof(*plat));
             saveg_read_plat_t(plat);
 	    plat->sector->specialdata = plat;
 
@@ -1993,7 +2002,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_flash:
 	    saveg_read_pad();
-	    flash = Z_Malloc (sizeof(*flash), PU_LEVEL, NULL);
+	    flash = P_AllocThinker (sizeof(*flash));
             saveg_read_lightflash_t(flash);
 	    flash->thinker.function.acp1 = (actionf_p1)T_LightFlash;
 	    P_AddThinker (&flash->thinker);
@@ -2001,7 +2010,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_strobe:
 	    saveg_read_pad();
-	    strobe = Z_Malloc (sizeof(*strobe), PU_LEVEL, NULL);
+	    strobe = P_AllocThinker (sizeof(*strobe));
             saveg_read_strobe_t(strobe);
 	    strobe->thinker.function.acp1 = (actionf_p1)T_StrobeFlash;
 	    P_AddThinker (&strobe->thinker);
@@ -2009,7 +2018,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_glow:
 	    saveg_read_pad();
-	    glow = Z_Malloc (sizeof(*glow), PU_LEVEL, NULL);
+	    glow = P_AllocThinker (sizeof(*glow));
             saveg_read_glow_t(glow);
 	    glow->thinker.function.acp1 = (actionf_p1)T_Glow;
 	    P_AddThinker (&glow->thinker);
@@ -22,6 +22,8 @@
 
 #include <stdio.h>
 
+#include "memio.h"
+
 #define SAVEGAME_EOF 0x1d
 #define VERSIONSIZE 16
 
@@ -59,7 +61,7 @@ void P_ArchiveSpecials (void);
 void P_UnArchiveSpecials (void);
 void P_RestoreTargets (void);
 
-extern FILE *save_stream;
+extern MEMFILE *save_stream;
 extern boolean savegame_error;
 
 
@@ -32,7 +32,10 @@
 
 #include "g_game.h"
 
+#include "i_sound.h" // [AP] I_GetSfxLumpNum()
 #include "i_system.h"
+#include "i_trace.h" // [AP]
+#include "w_prefetch.h" // [AP] W_PrefetchLump()
 #include "w_wad.h"
 
 #include "doomdef.h"
@@ -44,10 +47,14 @@
 #include "doomstat.h"
 
 #include "p_extnodes.h" // [crispy] support extended node formats
+#include "p_extsaveg.h" // [AP] P_WriteExtendedSaveGameData()
+#include "p_nodebuild.h" // [AP] P_BuildNodes()
+#include "p_saveg.h" // [AP] P_ArchiveWorld() et al.
 
-#include "apdoom_c_def.h"
-#include "apdoom2_c_def.h"
+#include "am_map.h" // [AP] AM_InvalidateLineCache(), AM_BuildLocations()
 #include "apdoom.h"
+#include "ap_notif.h"
+#include "ap_rng.h"
 
 void	P_SpawnMapThing (mapthing_t*	mthing);
 
@@ -96,7 +103,7 @@ int32_t*	blockmaplump; // [crispy] BLOCKMAP limit
 fixed_t		bmaporgx;
 fixed_t		bmaporgy;
 // for thing chains
-mobj_t**	blocklinks;		
+blockthings_t*	blockthings;		
 
 
 // REJECT
@@ -208,7 +215,7 @@ void P_LoadSegs (int lump)
     int                 sidenum;
 	
     numsegs = W_LumpLength (lump) / sizeof(mapseg_t);
-    segs = Z_Malloc (numsegs*sizeof(seg_t),PU_LEVEL,0);	
+    segs = Z_ArenaMalloc (numsegs*sizeof(seg_t),PU_LEVEL);	
     memset (segs, 0, numsegs*sizeof(seg_t));
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
@@ -350,7 +357,7 @@ void P_LoadSubsectors (int lump)
     subsector_t*	ss;
 	
     numsubsectors = W_LumpLength (lump) / sizeof(mapsubsector_t);
-    subsectors = Z_Malloc (numsubsectors*sizeof(subsector_t),PU_LEVEL,0);	
+    subsectors = Z_ArenaMalloc (numsubsectors*sizeof(subsector_t),PU_LEVEL);	
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
     // [crispy] fail on missing subsectors
@@ -387,7 +394,7 @@ void P_LoadSectors (int lump)
 	I_Error("P_LoadSectors: No sectors in map!");
 
     numsectors = W_LumpLength (lump) / sizeof(mapsector_t);
-    sectors = Z_Malloc (numsectors*sizeof(sector_t),PU_LEVEL,0);	
+    sectors = Z_ArenaMalloc (numsectors*sizeof(sector_t),PU_LEVEL);	
     memset (sectors, 0, numsectors*sizeof(sector_t));
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
@@ -451,7 +458,7 @@ void P_LoadNodes (int lump)
     node_t*	no;
 	
     numnodes = W_LumpLength (lump) / sizeof(mapnode_t);
-    nodes = Z_Malloc (numnodes*sizeof(node_t),PU_LEVEL,0);	
+    nodes = Z_ArenaMalloc (numnodes*sizeof(node_t),PU_LEVEL);	
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
     // [crispy] warn about missing nodes
@@ -730,13 +737,15 @@ void get_fit_dimensions(fixed_t x, fixed_t y, fixed_t* fit_radius, fixed_t* fit_
 void P_LoadThings (int lump)
 {
     byte               *data;
-    int			i, j;
+    int			i;
     mapthing_t         *mt;
     mapthing_t          spawnthing;
     mapthing_t  spawnthing_player1_start;
     int			numthings;
     boolean		spawn;
     int bit;
+    ap_rng_t rng;
+    const unsigned char* spawn_plan;
 
     data = W_CacheLumpNum (lump,PU_STATIC);
     numthings = W_LumpLength (lump) / sizeof(mapthing_t);
@@ -745,14 +754,28 @@ void P_LoadThings (int lump)
     const char* ap_seed = apdoom_get_seed();
     unsigned long long seed = hash_seed(ap_seed);
     seed += gameepisode * 9 + gamemap;
-    srand(seed);
+    ap_rng_seed(&rng, seed);
 
-    int things_type_remap[1024] = {0};
+    // Sized from the THINGS lump, large PWAD maps have no fixed cap
+    int* things_type_remap = Z_ArenaMalloc(numthings * sizeof(int), PU_LEVEL);
 
-    mt = (mapthing_t *)data;
-    for (i = 0; i < numthings; i++, mt++)
+    // Randomized types are cached per level, reloading it skips the shuffle
+    ap_level_index_t level_idx = ap_get_current_level(gameepisode, gamemap)->idx;
+    int remap_key = ap_state.random_monsters | (ap_state.random_items << 4) | (gameskill << 8);
+    const int* cached_remap = ap_get_cached_type_remap(level_idx, remap_key, numthings);
+    boolean randomize = cached_remap == NULL;
+
+    if (cached_remap)
     {
-        things_type_remap[i] = mt->type;
+        memcpy(things_type_remap, cached_remap, sizeof(int) * numthings);
+    }
+    else
+    {
+        mt = (mapthing_t *)data;
+        for (i = 0; i < numthings; i++, mt++)
+        {
+            things_type_remap[i] = mt->type;
+        }
     }
 
 #define E1M8_CUTOFF_OFFSET 6176
@@ -760,7 +783,7 @@ void P_LoadThings (int lump)
     int do_random_monsters = ap_state.random_monsters;
     if (gamemode == commercial && gamemap == 7) do_random_monsters = 0;
 
-    if (do_random_monsters > 0)
+    if (randomize && do_random_monsters > 0)
     {
         random_monster_def_t* random_monster_defs = gamemode == commercial ? doom2_random_monster_defs : doom_random_monster_defs;
         int monster_def_count = gamemode == commercial ?
@@ -775,9 +798,9 @@ void P_LoadThings (int lump)
         else
             bit = 1<<(gameskill-1);
 
-        random_monster_def_t* monsters[1024] = {0};
+        random_monster_def_t** monsters = Z_Malloc(numthings * sizeof(random_monster_def_t*), PU_STATIC, NULL);
         int monster_count = 0;
-        monster_spawn_def_t spawns[1024] = {0};
+        monster_spawn_def_t* spawns = Z_Malloc(numthings * sizeof(monster_spawn_def_t), PU_STATIC, NULL);
         int spawn_count = 0;
 
         // Collect spawn points
@@ -836,12 +859,12 @@ void P_LoadThings (int lump)
 
             while (monster_count < spawn_count)
             {
-                int rnd = rand() % total;
+                int rnd = ap_rng_range(&rng, total);
                 for (int i = 0; i < NUM_RMC; ++i)
                 {
                     if (rnd < ratios[i])
                     {
-                        rnd = rand() % rmc_ratios[i];
+                        rnd = ap_rng_range(&rng, rmc_ratios[i]);
                         for (int j = 0; j < defs_by_rmc_count[i]; ++j)
                         {
                             if (rnd < defs_by_rmc[i][j]->frequency)
@@ -869,7 +892,7 @@ void P_LoadThings (int lump)
 
             while (monster_count < spawn_count)
             {
-                int rnd = rand() % total;
+                int rnd = ap_rng_range(&rng, total);
                 for (int i = 0; i < monster_def_count; ++i)
                 {
                     random_monster_def_t* monster = &random_monster_defs[i];
@@ -893,7 +916,7 @@ void P_LoadThings (int lump)
                     baron_count++;
             while (baron_count < 2)
             {
-                int i = rand() % monster_count;
+                int i = ap_rng_range(&rng, monster_count);
                 if (monsters[i]->doom_type != 3003)
                 {
                     monsters[i] = &random_monster_defs[7];
@@ -905,7 +928,7 @@ void P_LoadThings (int lump)
         // Randomly pick them until empty, and place them in different spots
         for (i = 0; i < spawn_count; i++)
         {
-            int idx = rand() % monster_count;
+            int idx = ap_rng_range(&rng, monster_count);
             spawns[i].monster = monsters[idx];
             monsters[idx] = monsters[monster_count - 1];
             monster_count--;
@@ -922,7 +945,7 @@ void P_LoadThings (int lump)
                 int tries = 1000;
                 while (tries--)
                 {
-                    int j = rand() % spawn_count;
+                    int j = ap_rng_range(&rng, spawn_count);
                     if (j == i) continue;
                     monster_spawn_def_t* spawn2 = &spawns[j];
                     if (spawn1->monster->height <= spawn2->fit_height &&
@@ -945,9 +968,12 @@ void P_LoadThings (int lump)
             monster_spawn_def_t* spawn = &spawns[i];
             things_type_remap[spawn->index] = spawn->monster->doom_type;
         }
+
+        Z_Free(spawns);
+        Z_Free(monsters);
     }
 
-    if (ap_state.random_items > 0)
+    if (randomize && ap_state.random_items > 0)
     {
         // Make sure at the right difficulty level
         if (gameskill == sk_baby)
@@ -959,9 +985,9 @@ void P_LoadThings (int lump)
 
         if (ap_state.random_items == 1) // Shuffle
         {
-            int items[1024];
+            int* items = Z_Malloc(numthings * sizeof(int), PU_STATIC, NULL);
             int item_count = 0;
-            int indices[1024];
+            int* indices = Z_Malloc(numthings * sizeof(int), PU_STATIC, NULL);
             int index_count = 0;
 
             // Collect all items
@@ -999,11 +1025,14 @@ void P_LoadThings (int lump)
             mt = (mapthing_t *)data;
             for (i = 0; i < index_count; i++)
             {
-                int idx = rand() % item_count;
+                int idx = ap_rng_range(&rng, item_count);
                 things_type_remap[indices[i]] = items[idx];
                 items[idx] = items[item_count - 1];
                 item_count--;
             }
+
+            Z_Free(indices);
+            Z_Free(items);
         }
         else if (ap_state.random_items == 2) // Random balanced
         {
@@ -1072,10 +1101,10 @@ void P_LoadThings (int lump)
                     case 2012: // medikit
                     case 2011: // Stimpack
                     {
-                        int rnd = rand() % total;
+                        int rnd = ap_rng_range(&rng, total);
                         if (rnd < ratios[0])
                         {
-                            switch (rand()%2)
+                            switch (ap_rng_range(&rng, 2))
                             {
                                 case 0: things_type_remap[i] = 2015; break; // armor bonus
                                 case 1: things_type_remap[i] = 2014; break; // health bonus
@@ -1083,7 +1112,7 @@ void P_LoadThings (int lump)
                         }
                         else if (rnd < ratios[0] + ratios[1])
                         {
-                            switch (rand()%5)
+                            switch (ap_rng_range(&rng, 5))
                             {
                                 case 0: things_type_remap[i] = 2011; break; // Stimpack
                                 case 1: things_type_remap[i] = 2008; break; // 4 shotgun shells
@@ -1094,7 +1123,7 @@ void P_LoadThings (int lump)
                         }
                         else
                         {
-                            switch (rand()%5)
+                            switch (ap_rng_range(&rng, 5))
                             {
                                 case 0: things_type_remap[i] = 2048; break; // box of bullets
                                 case 1: things_type_remap[i] = 2046; break; // box of rockets
@@ -1109,6 +1138,16 @@ void P_LoadThings (int lump)
             }
         }
     }
+
+    if (randomize)
+        ap_set_cached_type_remap(level_idx, remap_key, things_type_remap, numthings);
+
+    // Validate that the location indices match what we have in our data. If they don't then the WAD is not the same, we can't continue
+    spawn_plan = ap_build_spawn_plan(level_idx, things_type_remap, numthings);
+    if (!spawn_plan)
+    {
+        I_Error("WAD file doesn't match the one used to generate the logic.\nTo make sure it works as intended, get DOOM.WAD or DOOM2.WAD from the steam releases.");
+    }
 	
     mt = (mapthing_t *)data;
     for (i=0 ; i<numthings ; i++, mt++)
@@ -1147,38 +1186,11 @@ void P_LoadThings (int lump)
     auto type_before = spawnthing.type;
 
         // Replace AP locations with AP item
-        if ((gamemode != commercial && is_doom_type_ap_location(spawnthing.type)) ||
-            (gamemode == commercial && is_doom2_type_ap_location(spawnthing.type)))
+        switch (spawn_plan[i])
         {
-            // Validate that the location index matches what we have in our data. If it doesn't then the WAD is not the same, we can't continue
-            int ret = ap_validate_doom_location(ap_make_level_index(gameepisode, gamemap), spawnthing.type, i);
-            if (ret == -1)
-            {
-                I_Error("WAD file doesn't match the one used to generate the logic.\nTo make sure it works as intended, get DOOM.WAD or DOOM2.WAD from the steam releases.");
-            }
-            else if (ret == 0)
-            {
-                continue; // Skip it
-            }
-            else if (ret == 1)
-            {
-                if (apdoom_is_location_progression(ap_make_level_index(gameepisode, gamemap), i))
-                    spawnthing.type = 20001;
-                else
-                    spawnthing.type = 20000;
-                int skip = 0;
-                ap_level_state_t* level_state = ap_get_level_state(ap_make_level_index(gameepisode, gamemap));
-                for (j = 0; j < level_state->check_count; ++j)
-                {
-                    if (level_state->checks[j] == i)
-                    {
-                        skip = 1;
-                        break;
-                    }
-                }
-                if (skip)
-                    continue;
-            }
+            case AP_SPAWN_SKIP: continue;
+            case AP_SPAWN_AP_ITEM: spawnthing.type = 20000; break;
+            case AP_SPAWN_AP_PROGRESSION: spawnthing.type = 20001; break;
         }
 
         // [AP] On player start 1, put level select teleport "HUB"
@@ -1224,7 +1236,7 @@ void P_LoadLineDefs (int lump)
     int warn, warn2; // [crispy] warn about invalid linedefs
 	
     numlines = W_LumpLength (lump) / sizeof(maplinedef_t);
-    lines = Z_Malloc (numlines*sizeof(line_t),PU_LEVEL,0);	
+    lines = Z_ArenaMalloc (numlines*sizeof(line_t),PU_LEVEL);	
     memset (lines, 0, numlines*sizeof(line_t));
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
@@ -1409,7 +1421,7 @@ void P_LoadSideDefs (int lump)
     side_t*		sd;
 	
     numsides = W_LumpLength (lump) / sizeof(mapsidedef_t);
-    sides = Z_Malloc (numsides*sizeof(side_t),PU_LEVEL,0);	
+    sides = Z_ArenaMalloc (numsides*sizeof(side_t),PU_LEVEL);	
     memset (sides, 0, numsides*sizeof(side_t));
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
@@ -1470,7 +1482,7 @@ boolean P_LoadBlockMap (int lump)
     // adapted from boom202s/P_SETUP.C:1025-1076
     wadblockmaplump = Z_Malloc(lumplen, PU_LEVEL, NULL);
     W_ReadLump(lump, wadblockmaplump);
-    blockmaplump = Z_Malloc(sizeof(*blockmaplump) * count, PU_LEVEL, NULL);
+    blockmaplump = Z_ArenaMalloc(sizeof(*blockmaplump) * count, PU_LEVEL);
     blockmap = blockmaplump + 4;
 
     blockmaplump[0] = SHORT(wadblockmaplump[0]);
@@ -1497,9 +1509,9 @@ boolean P_LoadBlockMap (int lump)
 	
     // Clear out mobj chains
 
-    count = sizeof(*blocklinks) * bmapwidth * bmapheight;
-    blocklinks = Z_Malloc(count, PU_LEVEL, 0);
-    memset(blocklinks, 0, count);
+    count = sizeof(*blockthings) * bmapwidth * bmapheight;
+    blockthings = Z_ArenaMalloc(count, PU_LEVEL);
+    memset(blockthings, 0, count);
 
     // [crispy] (re-)create BLOCKMAP if necessary
     fprintf(stderr, ")\n");
@@ -1516,6 +1528,7 @@ boolean P_LoadBlockMap (int lump)
 void P_GroupLines (void)
 {
     line_t**		linebuffer;
+    sector_t**		neighborbuffer;
     int			i;
     int			j;
     line_t*		li;
@@ -1549,7 +1562,7 @@ void P_GroupLines (void)
     }
 
     // build line tables for each sector	
-    linebuffer = Z_Malloc (totallines*sizeof(line_t *), PU_LEVEL, 0);
+    linebuffer = Z_ArenaMalloc (totallines*sizeof(line_t *), PU_LEVEL);
 
     for (i=0; i<numsectors; ++i)
     {
@@ -1586,6 +1599,27 @@ void P_GroupLines (void)
             ++sector->linecount;
         }
     }
+
+    // [AP] Neighbor lists, as getNextSector() goes through the lines
+    neighborbuffer = Z_ArenaMalloc (totallines*sizeof(sector_t *), PU_LEVEL);
+
+    sector = sectors;
+    for (i=0 ; i<numsectors ; i++, sector++)
+    {
+	sector->neighbors = neighborbuffer;
+	sector->numneighbors = 0;
+	sector->surroundvalid = 0;
+
+	for (j=0 ; j<sector->linecount ; j++)
+	{
+	    sector_t* other = getNextSector(sector->lines[j], sector);
+
+	    if (other)
+		sector->neighbors[sector->numneighbors++] = other;
+	}
+
+	neighborbuffer += sector->numneighbors;
+    }
     
     // Generate bounding boxes for sectors
 	
@@ -1815,9 +1849,349 @@ int P_GetNumForMap (int episode, int map, boolean critical)
     return critical ? W_GetNumForName(lumpname) : W_CheckNumForName(lumpname);
 }
 
+// [AP] Sprite frames of every state the state (and all it can lead to)
+// leads to
+static void P_PrefetchStates (int state, byte *visited)
+{
+    for ( ; state != S_NULL && !visited[state] ; state = states[state].nextstate)
+    {
+	const state_t *st = &states[state];
+	int frame = st->frame & FF_FRAMEMASK;
+	int k;
+
+	visited[state] = 1;
+
+	if (st->sprite >= numsprites || frame >= sprites[st->sprite].numframes)
+	    continue;
+
+	for (k = 0; k < 8; k++)
+	    W_PrefetchLump(firstspritelump + sprites[st->sprite].spriteframes[frame].lump[k]);
+    }
+}
+
+static void P_PrefetchSound (int sound)
+{
+    int lump;
+
+    if (sound <= sfx_None || sound >= NUMSFX)
+	return;
+
+    lump = I_GetSfxLumpNum(&S_sfx[sound]);
+
+    if (lump > 0)
+    {
+	W_PrefetchLump(lump);
+	I_PreloadSound(&S_sfx[sound]);
+    }
+}
+
+// [AP] What weapons play and spawn from their action functions, which
+// weaponinfo[] doesn't say, and the thing that gives them
+static const struct
+{
+    mobjtype_t pickup;
+    mobjtype_t missiles[2];
+    int sounds[4];
+} weaponextras[NUMWEAPONS] = {
+    {MT_NULL,         {MT_NULL, MT_NULL},        {sfx_punch}},
+    {MT_NULL,         {MT_NULL, MT_NULL},        {sfx_pistol}},
+    {MT_SHOTGUN,      {MT_NULL, MT_NULL},        {sfx_shotgn}},
+    {MT_CHAINGUN,     {MT_NULL, MT_NULL},        {sfx_pistol}},
+    {MT_MISC27,       {MT_ROCKET, MT_NULL},      {sfx_rlaunc}},
+    {MT_MISC28,       {MT_PLASMA, MT_NULL},      {sfx_plasma}},
+    {MT_MISC25,       {MT_BFG, MT_EXTRABFG},     {sfx_bfg}},
+    {MT_MISC26,       {MT_NULL, MT_NULL},        {sfx_sawup, sfx_sawidl, sfx_sawful, sfx_sawhit}},
+    {MT_SUPERSHOTGUN, {MT_NULL, MT_NULL},        {sfx_dshtgn, sfx_dbopn, sfx_dbload, sfx_dbcls}},
+};
+
+// [AP] Map lumps the level select screen had read ahead, -1 if none
+static int prefetchedmap = -1;
+
+//
+// P_PrefetchMap
+// [AP] The level select screen calls this for the highlighted level, so
+// its map is likely read already when it's confirmed. Whatever was read
+// ahead for another level is dropped first.
+//
+void P_PrefetchMap (int episode, int map)
+{
+    int lumpnum = P_GetNumForMap(episode, map, false);
+    int i;
+
+    if (lumpnum < 0 || lumpnum == prefetchedmap)
+	return;
+
+    W_CancelPrefetch();
+    prefetchedmap = lumpnum;
+
+    for (i = ML_LABEL; i <= ML_BLOCKMAP; i++)
+	W_PrefetchLump(lumpnum + i);
+}
+
+//
+// P_PrefetchLevel
+// [AP] Queues everything the level's things, the console player's
+// weapons (and those lying around) and the level's walls and floors can
+// show or play, so first use doesn't wait on the disk. Sounds convert
+// on the sound thread meanwhile. R_PrecacheLevel only covers the frames
+// things show when the level starts.
+//
+static void P_PrefetchLevel (void)
+{
+    // Spawned by almost anything
+    static const mobjtype_t effects[] = {MT_PUFF, MT_BLOOD, MT_TFOG, MT_IFOG};
+    byte *typepresent;
+    byte *visited;
+    thinker_t *th;
+    player_t *player = &players[consoleplayer];
+    int i;
+
+    R_PrefetchLevel ();
+
+    typepresent = Z_Malloc(NUMMOBJTYPES, PU_STATIC, NULL);
+    visited = Z_Malloc(NUMSTATES, PU_STATIC, NULL);
+    memset(typepresent, 0, NUMMOBJTYPES);
+    memset(visited, 0, NUMSTATES);
+
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj]; th = th->cnext)
+    {
+	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
+	    typepresent[((mobj_t *)th)->type] = 1;
+    }
+
+    for (i = 0; i < (int) arrlen(effects); i++)
+	typepresent[effects[i]] = 1;
+
+    // Before the things, it adds what they fire
+    for (i = 0; i < NUMWEAPONS; i++)
+    {
+	int k;
+
+	if (!player->weaponowned[i]
+	 && (weaponextras[i].pickup == MT_NULL
+	  || !typepresent[weaponextras[i].pickup]))
+	    continue;
+
+	P_PrefetchStates(weaponinfo[i].upstate, visited);
+	P_PrefetchStates(weaponinfo[i].downstate, visited);
+	P_PrefetchStates(weaponinfo[i].readystate, visited);
+	P_PrefetchStates(weaponinfo[i].atkstate, visited);
+	P_PrefetchStates(weaponinfo[i].flashstate, visited);
+
+	for (k = 0; k < (int) arrlen(weaponextras[i].missiles); k++)
+	{
+	    if (weaponextras[i].missiles[k] != MT_NULL)
+		typepresent[weaponextras[i].missiles[k]] = 1;
+	}
+
+	for (k = 0; k < (int) arrlen(weaponextras[i].sounds); k++)
+	    P_PrefetchSound(weaponextras[i].sounds[k]);
+    }
+
+    // Picking anything up
+    P_PrefetchSound(sfx_itemup);
+    P_PrefetchSound(sfx_wpnup);
+    P_PrefetchSound(sfx_getpow);
+
+    for (i = 0; i < NUMMOBJTYPES; i++)
+    {
+	const mobjinfo_t *info = &mobjinfo[i];
+
+	if (!typepresent[i])
+	    continue;
+
+	P_PrefetchStates(info->spawnstate, visited);
+	P_PrefetchStates(info->seestate, visited);
+	P_PrefetchStates(info->painstate, visited);
+	P_PrefetchStates(info->meleestate, visited);
+	P_PrefetchStates(info->missilestate, visited);
+	P_PrefetchStates(info->deathstate, visited);
+	P_PrefetchStates(info->xdeathstate, visited);
+	P_PrefetchStates(info->raisestate, visited);
+
+	P_PrefetchSound(info->seesound);
+	P_PrefetchSound(info->attacksound);
+	P_PrefetchSound(info->painsound);
+	P_PrefetchSound(info->deathsound);
+	P_PrefetchSound(info->activesound);
+    }
+
+    Z_Free(visited);
+    Z_Free(typepresent);
+}
+
 // pointer to the current map lump info struct
 lumpinfo_t *maplumpinfo;
 
+// [AP] The level as it was right after P_SetupLevel, in savegame format,
+// so dying with reset_level_on_death restarts it without loading it again
+static void *levelsnapshot;
+static size_t levelsnapshotlength;
+static int levelsnapshotlump = -1;
+static skill_t levelsnapshotskill;
+static int levelsnapshottotals[3];
+
+static void P_SaveLevelSnapshot (int lumpnum, skill_t skill)
+{
+    MEMFILE *stream = save_stream; // A savegame may be loading this level
+    void *buf;
+    size_t length;
+
+    free(levelsnapshot);
+    levelsnapshot = NULL;
+    levelsnapshotlump = -1;
+
+    // Restarting doesn't use the random numbers loading does
+    if (netgame || demoplayback || demorecording)
+	return;
+
+    I_TraceBegin("level snapshot", NULL);
+    save_stream = mem_fopen_write();
+    P_ArchiveWorld ();
+    P_ArchiveThinkers ();
+    P_ArchiveSpecials ();
+    P_WriteExtendedSaveGameData ();
+
+    mem_get_buf(save_stream, &buf, &length);
+    levelsnapshot = malloc(length);
+    memcpy(levelsnapshot, buf, length);
+    levelsnapshotlength = length;
+    mem_fclose(save_stream);
+    save_stream = stream;
+
+    levelsnapshotlump = lumpnum;
+    levelsnapshotskill = skill;
+    levelsnapshottotals[0] = totalkills;
+    levelsnapshottotals[1] = totalitems;
+    levelsnapshottotals[2] = totalsecret;
+    I_TraceEnd("level snapshot");
+}
+
+// [AP] P_UnArchiveThinkers only marks the mobjs removed, counting on the
+// pools being cleared with the level. This one stays, so the thinkers go
+// back to their pools first.
+static void P_FreeLevelThinkers (void)
+{
+    thinker_t *th, *next;
+
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj]; th = next)
+    {
+	next = th->cnext;
+	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
+	    P_RemoveMobj((mobj_t *)th);
+    }
+
+    for (th = thinkercap.next; th != &thinkercap; th = next)
+    {
+	next = th->next;
+	P_FreeThinker(th);
+    }
+
+    P_InitThinkers();
+}
+
+//
+// P_RestoreLevel
+// [AP] Puts the level back the way P_SetupLevel left it, if it's the one
+// last loaded. Same as loading a savegame of it, then whatever got picked
+// up since is taken out and the players spawn again.
+//
+boolean P_RestoreLevel (int episode, int map, skill_t skill)
+{
+    MEMFILE *stream = save_stream;
+    ap_level_index_t level_idx;
+    thinker_t *th, *next;
+    int i;
+
+    if (!levelsnapshot || levelsnapshotskill != skill
+     || levelsnapshotlump != P_GetNumForMap(episode, map, false))
+	return false;
+
+    I_TraceBegin("P_RestoreLevel", NULL);
+
+    totalkills = levelsnapshottotals[0];
+    totalitems = levelsnapshottotals[1];
+    totalsecret = levelsnapshottotals[2];
+    wminfo.maxfrags = 0;
+    extrakills = 0;
+    for (i=0 ; i<MAXPLAYERS ; i++)
+    {
+	players[i].killcount = players[i].secretcount 
+	    = players[i].itemcount = 0;
+    }
+    players[consoleplayer].viewz = 1; 
+
+    S_Start ();
+    musinfo.from_savegame = false;
+
+    P_FreeLevelThinkers();
+
+    leveltime = 0;
+    leveltimesinceload = 0;
+    oldleveltime = 0;
+
+    memset(st_keyorskull, 0, sizeof(st_keyorskull));
+    bodyqueslot = 0;
+    iquehead = iquetail = 0;
+
+    // The specials point to thinkers that are about to be freed
+    for (i = 0;i < MAXCEILINGS;i++)
+	activeceilings[i] = NULL;
+    for (i = 0;i < MAXPLATS;i++)
+	activeplats[i] = NULL;
+    for (i = 0;i < maxbuttons;i++)
+	memset(&buttonlist[i],0,sizeof(button_t));
+
+    save_stream = mem_fopen_read(levelsnapshot, levelsnapshotlength);
+    P_UnArchiveWorld ();
+    P_UnArchiveThinkers ();
+    P_UnArchiveSpecials ();
+    P_RestoreTargets ();
+    P_ReadExtendedSaveGameData(1);
+    mem_fclose(save_stream);
+    save_stream = stream;
+
+    // Locations checked since are skipped when the level loads
+    level_idx = ap_get_current_level(episode, map)->idx;
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj]; th = next)
+    {
+	mobj_t *mo = (mobj_t *)th;
+
+	next = th->cnext;
+	if (th->function.acp1 != (actionf_p1)P_MobjThinker)
+	    continue;
+	if ((mo->info->doomednum == 20000 || mo->info->doomednum == 20001)
+	 && ap_is_location_checked(level_idx, mo->index))
+	    P_RemoveMobj(mo);
+    }
+
+    // Players come back the way P_LoadThings spawns them
+    for (i=0 ; i<MAXPLAYERS ; i++)
+    {
+	if (players[i].mo)
+	{
+	    players[i].mo->player = NULL;
+	    P_RemoveMobj(players[i].mo);
+	    players[i].mo = NULL;
+	}
+	if (playeringame[i])
+	    P_SpawnPlayer(&playerstarts[i]);
+    }
+
+    AM_BuildLocations ();
+
+    if (gamemode != shareware)
+    {
+	char lumpname[9];
+
+	M_StringCopy(lumpname, maplumpinfo->name, sizeof(lumpname));
+	S_ParseMusInfo(lumpname);
+    }
+
+    I_TraceEnd("P_RestoreLevel");
+    return true;
+}
+
 //
 // P_SetupLevel
 //
@@ -1833,6 +2207,8 @@ P_SetupLevel
     int		lumpnum;
     boolean	crispy_validblockmap;
     mapformat_t	crispy_mapformat;
+
+    I_TraceBegin("P_SetupLevel", NULL); // [AP]
 	
     totalkills = totalitems = totalsecret = wminfo.maxfrags = 0;
     // [crispy] count spawned monsters
@@ -1894,13 +2270,24 @@ P_SetupLevel
     }
     musinfo.from_savegame = false;
 
+    I_TraceBegin("free level", NULL); // [AP]
     Z_FreeTags (PU_LEVEL, PU_PURGELEVEL-1);
+    P_ClearThinkerPools (); // [AP] their slabs were PU_LEVEL
+    P_ClearSightCache (); // [AP]
+    R_ClearMovedSectors (); // [AP]
 
     // UNUSED W_Profile ();
     P_InitThinkers ();
 
+    // [AP] Anything still queued is for the last level, unless the level
+    // select screen read this one ahead
+    if (prefetchedmap < 0 || prefetchedmap != P_GetNumForMap(episode, map, false))
+	W_CancelPrefetch ();
+    prefetchedmap = -1;
+
     // if working with a devlopment map, reload it
     W_Reload ();
+    I_TraceEnd("free level"); // [AP]
 
 // [crispy] factor out map lump name and number finding into a separate function
 /*
@@ -1957,10 +2344,12 @@ P_SetupLevel
     crispy_mapformat = P_CheckMapFormat(lumpnum);
 
     // note: most of this ordering is important	
+    I_TraceBegin("load geometry", lumpname); // [AP]
     crispy_validblockmap = P_LoadBlockMap (lumpnum+ML_BLOCKMAP); // [crispy] (re-)create BLOCKMAP if necessary
     P_LoadVertexes (lumpnum+ML_VERTEXES);
     P_LoadSectors (lumpnum+ML_SECTORS);
     P_LoadSideDefs (lumpnum+ML_SIDEDEFS);
+    R_StartLevelComposites (); // [AP]
 
     if (crispy_mapformat & MFMT_HEXEN)
 	P_LoadLineDefs_Hexen (lumpnum+ML_LINEDEFS);
@@ -1972,6 +2361,10 @@ P_SetupLevel
 	extern void P_CreateBlockMap (void);
 	P_CreateBlockMap();
     }
+    // [AP] build them when the map's are missing or broken
+    if (!P_NodesUsable(lumpnum, crispy_mapformat))
+	P_BuildNodes (lumpnum);
+    else
     if (crispy_mapformat & (MFMT_ZDBSPX | MFMT_ZDBSPZ))
 	P_LoadNodes_ZDBSP (lumpnum+ML_NODES, crispy_mapformat & MFMT_ZDBSPZ);
     else
@@ -1987,23 +2380,44 @@ P_SetupLevel
     P_LoadNodes (lumpnum+ML_NODES);
     P_LoadSegs (lumpnum+ML_SEGS);
     }
+    I_TraceEnd("load geometry"); // [AP]
 
+    I_TraceBegin("group lines", NULL); // [AP]
     P_GroupLines ();
     P_LoadReject (lumpnum+ML_REJECT);
+    AM_InvalidateLineCache (); // [AP]
 
     // [crispy] remove slime trails
     P_RemoveSlimeTrails();
     // [crispy] fix long wall wobble
     P_SegLengths(false);
+    I_TraceEnd("group lines"); // [AP]
     // [crispy] blinking key or skull in the status bar
     memset(st_keyorskull, 0, sizeof(st_keyorskull));
 
     bodyqueslot = 0;
     deathmatch_p = deathmatchstarts;
+    I_TraceBegin("load things", NULL); // [AP]
     if (crispy_mapformat & MFMT_HEXEN)
 	P_LoadThings_Hexen (lumpnum+ML_THINGS);
     else
     P_LoadThings (lumpnum+ML_THINGS);
+    I_TraceEnd("load things"); // [AP]
+
+    // [AP] Start reading what the level will need while it finishes loading
+    P_PrefetchLevel ();
+
+    // [AP] Done before anything else caches lumps, which could retag the
+    // patches the composite thread is reading
+    I_TraceBegin("finish composites", NULL);
+    R_FinishLevelComposites ();
+    I_TraceEnd("finish composites");
+
+    // [AP] Things are all spawned, collect the automap's item markers
+    AM_BuildLocations ();
+
+    // [AP] Build notification icons now rather than on first pickup
+    ap_notif_precache();
     
     // if deathmatch, randomly spawn the active players
     if (deathmatch)
@@ -2026,17 +2440,27 @@ P_SetupLevel
     iquehead = iquetail = 0;		
 	
     // set up world state
+    I_TraceBegin("spawn specials", NULL); // [AP]
     P_SpawnSpecials ();
+    I_TraceEnd("spawn specials"); // [AP]
 	
     // build subsector connect matrix
     //	UNUSED P_ConnectSubsectors ();
 
     // preload graphics
+    I_TraceBegin("precache", NULL); // [AP]
     if (precache)
 	R_PrecacheLevel ();
 
+    R_BuildTextureAtlas (); // [AP]
+    I_TraceEnd("precache"); // [AP]
+
+    P_SaveLevelSnapshot (lumpnum, skill); // [AP]
+
     //printf ("free memory: 0x%x\n", Z_FreeMemory());
 
+    I_TraceEnd("P_SetupLevel"); // [AP]
+
 }
 
 
@@ -2049,6 +2473,7 @@ void P_Init (void)
     P_InitSwitchList ();
     P_InitPicAnims ();
     R_InitSprites (sprnames);
+    P_InitSightThreads (); // [AP]
 }
 
 
@@ -35,6 +35,10 @@ P_SetupLevel
   int		playermask,
   skill_t	skill);
 
+// [AP] Restarts the level P_SetupLevel last loaded without loading it
+// again. False if that was another level.
+boolean P_RestoreLevel (int episode, int map, skill_t skill);
+
 // Called by startup code.
 void P_Init (void);
 
@@ -17,28 +17,197 @@
 //
 
 
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+
 #include "doomdef.h"
 #include "doomstat.h"
 
 #include "i_system.h"
+#include "m_argv.h"
 #include "p_local.h"
 
 // State.
 #include "r_state.h"
 
+// [AP] The BSP trace state is per thread, so worker threads can trace
+// while the main thread does too (see P_PrecomputeSight)
+#ifdef _MSC_VER
+#define SIGHT_THREADLOCAL __declspec(thread)
+#else
+#define SIGHT_THREADLOCAL __thread
+#endif
+
+#define SIGHTMAXSECTORS 16 // Sectors an entry can depend on
+
 //
 // P_CheckSight
 //
-fixed_t		sightzstart;		// eye z of looker
+static SIGHT_THREADLOCAL fixed_t	sightzstart;		// eye z of looker
 fixed_t		topslope;
 fixed_t		bottomslope;		// slopes to top and bottom of target
 
-divline_t	strace;			// from t1 to t2
-fixed_t		t2x;
-fixed_t		t2y;
+static SIGHT_THREADLOCAL fixed_t	sighttopslope; // [AP] BSP trace only,
+static SIGHT_THREADLOCAL fixed_t	sightbottomslope; // the above are p_map's too
+
+static SIGHT_THREADLOCAL divline_t	strace;			// from t1 to t2
+static SIGHT_THREADLOCAL fixed_t	t2x;
+static SIGHT_THREADLOCAL fixed_t	t2y;
+
+// [AP] Workers can't share line->validcount with the main thread, so they
+// mark lines in an array of their own. NULL on the main thread.
+static SIGHT_THREADLOCAL int*	sightlinemarks;
+static SIGHT_THREADLOCAL int	numsightlinemarks;
+static SIGHT_THREADLOCAL int	sightmark;
+
+// [AP] Sectors whose heights the current trace looked at, -1 if too many
+static SIGHT_THREADLOCAL int	sightsectors[SIGHTMAXSECTORS];
+static SIGHT_THREADLOCAL int	numsightsectors;
 
 int		sightcounts[2];
 
+// [AP] Results of past sight checks. A check only depends on the two
+// mobjs' positions and heights and on the heights of the sectors on
+// either side of the lines it crossed, so an entry stays good until one
+// of those sectors moves a plane or the level changes. Keys are exact,
+// so a hit always returns what the traversal would have.
+#define SIGHTCACHESIZE 4096 // Power of two
+
+typedef struct
+{
+    fixed_t x1, y1, z1, h1;
+    fixed_t x2, y2, z2, h2;
+    unsigned int stamp;
+    unsigned int clock; // sightclock when traced
+    int numsectors; // -1 depends on every sector
+    int sectors[SIGHTMAXSECTORS];
+    boolean result;
+} sightcache_t;
+
+static sightcache_t sightcache[SIGHTCACHESIZE];
+static unsigned int sightstamp = 1;
+
+// [AP] sightclock ticks on every plane move; sightmoved has the tick each
+// sector last moved on, sightlastmove the tick any sector did. Grown as
+// levels with more sectors come up; older ticks are all behind new entries.
+static unsigned int* sightmoved;
+static int numsightmoved;
+static unsigned int sightclock;
+static unsigned int sightlastmove;
+
+static void P_SightGrowMoved (void)
+{
+    if (numsightmoved < numsectors)
+    {
+        sightmoved = I_Realloc(sightmoved, numsectors * sizeof(*sightmoved));
+        memset(sightmoved + numsightmoved, 0,
+               (numsectors - numsightmoved) * sizeof(*sightmoved));
+        numsightmoved = numsectors;
+    }
+}
+
+void P_ClearSightCache (void)
+{
+    // Entries start at 0, so never land on it
+    if (++sightstamp == 0)
+    {
+        memset(sightcache, 0, sizeof(sightcache));
+        sightstamp = 1;
+    }
+}
+
+void P_SightSectorMoved (sector_t* sector)
+{
+    P_SightGrowMoved();
+    sightmoved[sector - sectors] = sightlastmove = ++sightclock;
+}
+
+static sightcache_t *P_SightCacheEntry (const mobj_t *t1, const mobj_t *t2)
+{
+    unsigned int hash;
+
+    hash = (unsigned int) t1->x * 0x9e3779b1u;
+    hash = (hash ^ (unsigned int) t1->y) * 0x85ebca6bu;
+    hash = (hash ^ (unsigned int) t1->z) * 0xc2b2ae35u;
+    hash = (hash ^ (unsigned int) t2->x) * 0x9e3779b1u;
+    hash = (hash ^ (unsigned int) t2->y) * 0x85ebca6bu;
+    hash = (hash ^ (unsigned int) t2->z) * 0xc2b2ae35u;
+    hash ^= hash >> 16;
+
+    return &sightcache[hash & (SIGHTCACHESIZE - 1)];
+}
+
+static boolean P_SightCacheHit (const sightcache_t *entry,
+                                const mobj_t *t1, const mobj_t *t2)
+{
+    int i;
+
+    if (entry->stamp != sightstamp
+     || entry->x1 != t1->x || entry->y1 != t1->y
+     || entry->z1 != t1->z || entry->h1 != t1->height
+     || entry->x2 != t2->x || entry->y2 != t2->y
+     || entry->z2 != t2->z || entry->h2 != t2->height)
+    {
+        return false;
+    }
+
+    if (entry->numsectors < 0)
+        return sightlastmove <= entry->clock;
+
+    P_SightGrowMoved();
+
+    for (i = 0; i < entry->numsectors; i++)
+    {
+        if (sightmoved[entry->sectors[i]] > entry->clock)
+            return false;
+    }
+
+    return true;
+}
+
+static void P_SightCacheStore (sightcache_t *entry,
+                               const mobj_t *t1, const mobj_t *t2,
+                               boolean result, int numsectors,
+                               const int *sectors)
+{
+    entry->stamp = sightstamp;
+    entry->clock = sightclock;
+    entry->x1 = t1->x;
+    entry->y1 = t1->y;
+    entry->z1 = t1->z;
+    entry->h1 = t1->height;
+    entry->x2 = t2->x;
+    entry->y2 = t2->y;
+    entry->z2 = t2->z;
+    entry->h2 = t2->height;
+    entry->result = result;
+    entry->numsectors = numsectors;
+    if (numsectors > 0)
+        memcpy(entry->sectors, sectors, numsectors * sizeof(*sectors));
+}
+
+static void P_SightAddSector (const sector_t *sector)
+{
+    int index = sector - sectors;
+    int i;
+
+    if (numsightsectors < 0)
+        return;
+
+    for (i = 0; i < numsightsectors; i++)
+    {
+        if (sightsectors[i] == index)
+            return;
+    }
+
+    if (numsightsectors == SIGHTMAXSECTORS)
+        numsightsectors = -1;
+    else
+        sightsectors[numsightsectors++] = index;
+}
+
 
 // PTR_SightTraverse() for Doom 1.2 sight calculations
 // taken from prboom-plus/src/p_sight.c:69-102
@@ -199,10 +368,20 @@ boolean P_CrossSubsector (int num)
 	line = seg->linedef;
 
 	// allready checked other side?
-	if (line->validcount == validcount)
-	    continue;
+	if (sightlinemarks) // [AP] Worker thread
+	{
+	    if (sightlinemarks[line - lines] == sightmark)
+		continue;
+
+	    sightlinemarks[line - lines] = sightmark;
+	}
+	else
+	{
+	    if (line->validcount == validcount)
+		continue;
 	
-	line->validcount = validcount;
+	    line->validcount = validcount;
+	}
 
 	v1 = line->v1;
 	v2 = line->v2;
@@ -241,6 +420,10 @@ boolean P_CrossSubsector (int num)
 	front = seg->frontsector;
 	back = seg->backsector;
 
+	// [AP] The rest of the trace depends on their heights
+	P_SightAddSector(front);
+	P_SightAddSector(back);
+
 	// no wall to block sight with?
 	if (front->floorheight == back->floorheight
 	    && front->ceilingheight == back->ceilingheight)
@@ -268,18 +451,18 @@ boolean P_CrossSubsector (int num)
 	if (front->floorheight != back->floorheight)
 	{
 	    slope = FixedDiv (openbottom - sightzstart , frac);
-	    if (slope > bottomslope)
-		bottomslope = slope;
+	    if (slope > sightbottomslope)
+		sightbottomslope = slope;
 	}
 		
 	if (front->ceilingheight != back->ceilingheight)
 	{
 	    slope = FixedDiv (opentop - sightzstart , frac);
-	    if (slope < topslope)
-		topslope = slope;
+	    if (slope < sighttopslope)
+		sighttopslope = slope;
 	}
 		
-	if (topslope <= bottomslope)
+	if (sighttopslope <= sightbottomslope)
 	    return false;		// stop				
     }
     // passed the subsector ok
@@ -329,6 +512,30 @@ boolean P_CrossBSPNode (int bspnum)
 }
 
 
+//
+// [AP] P_SightTraceBSP
+// Sets up the trace and crosses the BSP. The caller bumps validcount (or
+// sightmark, on a worker) first.
+//
+static boolean P_SightTraceBSP (mobj_t *t1, mobj_t *t2)
+{
+    sightzstart = t1->z + t1->height - (t1->height>>2);
+    sighttopslope = (t2->z+t2->height) - sightzstart;
+    sightbottomslope = (t2->z) - sightzstart;
+    numsightsectors = 0;
+
+    strace.x = t1->x;
+    strace.y = t1->y;
+    t2x = t2->x;
+    t2y = t2->y;
+    strace.dx = t2->x - t1->x;
+    strace.dy = t2->y - t1->y;
+
+    // the head node is the last node output
+    return P_CrossBSPNode (numnodes-1);
+}
+
+
 //
 // P_CheckSight
 // Returns true
@@ -345,6 +552,8 @@ P_CheckSight
     int		pnum;
     int		bytenum;
     int		bitnum;
+    sightcache_t*	entry;
+    boolean	result;
     
     // First check for trivial rejection.
 
@@ -368,27 +577,242 @@ P_CheckSight
     // Now look from eyes of t1 to any part of t2.
     sightcounts[1]++;
 
+    // [AP] Seen this exact check since its sectors last moved?
+    entry = P_SightCacheEntry(t1, t2);
+    if (P_SightCacheHit(entry, t1, t2))
+    {
+        return entry->result;
+    }
+
     validcount++;
 	
-    sightzstart = t1->z + t1->height - (t1->height>>2);
-    topslope = (t2->z+t2->height) - sightzstart;
-    bottomslope = (t2->z) - sightzstart;
-	
     if (gameversion <= exe_doom_1_2)
     {
-        return P_PathTraverse(t1->x, t1->y, t2->x, t2->y,
-                              PT_EARLYOUT | PT_ADDLINES, PTR_SightTraverse);
+        sightzstart = t1->z + t1->height - (t1->height>>2);
+        topslope = (t2->z+t2->height) - sightzstart;
+        bottomslope = (t2->z) - sightzstart;
+
+        result = P_PathTraverse(t1->x, t1->y, t2->x, t2->y,
+                                PT_EARLYOUT | PT_ADDLINES, PTR_SightTraverse);
+        P_SightCacheStore(entry, t1, t2, result, -1, NULL);
+        return result;
     }
 
-    strace.x = t1->x;
-    strace.y = t1->y;
-    t2x = t2->x;
-    t2y = t2->y;
-    strace.dx = t2->x - t1->x;
-    strace.dy = t2->y - t1->y;
+    result = P_SightTraceBSP(t1, t2);
+    P_SightCacheStore(entry, t1, t2, result, numsightsectors, sightsectors);
+    return result;
+}
 
-    // the head node is the last node output
-    return P_CrossBSPNode (numnodes-1);	
+
+//
+// [AP] Threaded sight precomputation.
+//
+// Sight checks are the bulk of monster AI time, and they only read the
+// level. Right after a player's mobj has moved for the tic, the monsters
+// about to act have their checks against their targets (or the players,
+// if they have none) traced by a pool of threads, and the results go in
+// the cache. The monsters then think serially, in thinker order, as
+// always; a check whose mobjs or sectors changed in between misses the
+// cache and is traced again. Nothing but the cache sees the results, so
+// the game plays exactly as with one thread.
+//
+#define MAXSIGHTTHREADS 16
+#define MAXSIGHTTASKS 1024
+
+typedef struct
+{
+    mobj_t *t1, *t2;
+    boolean result;
+    int numsectors;
+    int sectors[SIGHTMAXSECTORS];
+} sighttask_t;
+
+static int numsightthreads = 1;
+static SDL_Thread* sightthreads[MAXSIGHTTHREADS];
+static SDL_sem* sightstart[MAXSIGHTTHREADS];
+static SDL_sem* sightdone;
+static volatile boolean sightquit = false;
+
+static sighttask_t sighttasks[MAXSIGHTTASKS];
+static int numsighttasks;
+
+static void P_RunSightSlice (int slice)
+{
+    int i;
+
+    if (slice)
+    {
+        // Lines can change between levels
+        if (numsightlinemarks < numlines)
+        {
+            free(sightlinemarks);
+            sightlinemarks = calloc(numlines, sizeof(*sightlinemarks));
+            if (!sightlinemarks)
+                I_Error("P_RunSightSlice: out of memory");
+            numsightlinemarks = numlines;
+            sightmark = 0;
+        }
+    }
+
+    for (i = slice; i < numsighttasks; i += numsightthreads)
+    {
+        sighttask_t *task = &sighttasks[i];
+
+        if (slice)
+            sightmark++;
+        else
+            validcount++;
+
+        task->result = P_SightTraceBSP(task->t1, task->t2);
+        task->numsectors = numsightsectors;
+        if (numsightsectors > 0)
+            memcpy(task->sectors, sightsectors, numsightsectors * sizeof(*sightsectors));
+    }
+}
+
+static int P_SightThread (void* data)
+{
+    int slice = (int)(intptr_t)data;
+
+    while (true)
+    {
+        SDL_SemWait(sightstart[slice]);
+        if (sightquit)
+            break;
+        P_RunSightSlice(slice);
+        SDL_SemPost(sightdone);
+    }
+
+    return 0;
+}
+
+static void P_AddSightTask (mobj_t *t1, mobj_t *t2)
+{
+    int pnum;
+
+    if (numsighttasks == MAXSIGHTTASKS)
+        return;
+
+    // Rejected checks never trace
+    pnum = (t1->subsector->sector - sectors) * numsectors
+         + (t2->subsector->sector - sectors);
+    if (rejectmatrix[pnum>>3] & (1 << (pnum&7)))
+        return;
+
+    if (P_SightCacheHit(P_SightCacheEntry(t1, t2), t1, t2))
+        return;
+
+    sighttasks[numsighttasks].t1 = t1;
+    sighttasks[numsighttasks].t2 = t2;
+    numsighttasks++;
+}
+
+void P_PrecomputeSight (void)
+{
+    thinker_t *th;
+    mobj_t *mo;
+    int i;
+
+    if (numsightthreads == 1 || gameversion <= exe_doom_1_2)
+        return;
+
+    numsighttasks = 0;
+
+    for (th = thinkerclasscap[th_mobj].cnext;
+         th != &thinkerclasscap[th_mobj]; th = th->cnext)
+    {
+        if (th->function.acp1 != (actionf_p1)P_MobjThinker)
+            continue;
+
+        mo = (mobj_t *)th;
+
+        // Only monsters whose next state, and so its action, is due
+        if (mo->tics != 1 || mo->health <= 0
+         || !(mo->flags & MF_COUNTKILL || mo->type == MT_SKULL))
+            continue;
+
+        if (mo->target)
+        {
+            if (mo->target->health > 0)
+                P_AddSightTask(mo, mo->target);
+            continue;
+        }
+
+        for (i = 0; i < MAXPLAYERS; i++)
+        {
+            if (playeringame[i] && players[i].mo && players[i].health > 0)
+                P_AddSightTask(mo, players[i].mo);
+        }
+    }
+
+    if (numsighttasks < numsightthreads)
+        return; // Not worth waking anyone
+
+    for (i = 1; i < numsightthreads; i++)
+        SDL_SemPost(sightstart[i]);
+    P_RunSightSlice(0);
+    for (i = 1; i < numsightthreads; i++)
+        SDL_SemWait(sightdone);
+
+    for (i = 0; i < numsighttasks; i++)
+    {
+        sighttask_t *task = &sighttasks[i];
+
+        P_SightCacheStore(P_SightCacheEntry(task->t1, task->t2),
+                          task->t1, task->t2, task->result,
+                          task->numsectors, task->sectors);
+    }
+}
+
+static void P_ShutdownSightThreads (void)
+{
+    int i;
+
+    numsighttasks = 0;
+    sightquit = true;
+    for (i = 1; i < numsightthreads; i++)
+        SDL_SemPost(sightstart[i]);
+    for (i = 1; i < numsightthreads; i++)
+        SDL_WaitThread(sightthreads[i], NULL);
+    numsightthreads = 1;
+}
+
+void P_InitSightThreads (void)
+{
+    int p, i;
+
+    //!
+    // @arg <n>
+    // @category game
+    //
+    // Trace the sight checks of monsters about to act on n threads,
+    // ahead of them thinking. Gameplay is identical to one thread.
+    //
+
+    p = M_CheckParmWithArgs("-aithreads", 1);
+    if (!p)
+        return;
+
+    numsightthreads = atoi(myargv[p+1]);
+    if (numsightthreads < 1)
+        numsightthreads = 1;
+    if (numsightthreads > MAXSIGHTTHREADS)
+        numsightthreads = MAXSIGHTTHREADS;
+    if (numsightthreads == 1)
+        return;
+
+    sightdone = SDL_CreateSemaphore(0);
+    for (i = 1; i < numsightthreads; i++)
+    {
+        sightstart[i] = SDL_CreateSemaphore(0);
+        sightthreads[i] = SDL_CreateThread(P_SightThread, "P_SightThread", (void*)(intptr_t)i);
+        if (!sightthreads[i])
+            I_Error("P_InitSightThreads: %s", SDL_GetError());
+    }
+
+    I_AtExit(P_ShutdownSightThreads, false);
+
+    printf("P_InitSightThreads: %i sight threads\n", numsightthreads);
 }
 
 
@@ -142,8 +142,15 @@ static size_t	maxanims;
 //
 #define MAXLINEANIMS            64*256
 
+// [AP] Scrolling sides and their direction (+1 for 48, -1 for 85) as
+// separate arrays, built once when the level's specials spawn, so the
+// per-tic and per-frame updates don't go through the linedefs
 short numlinespecials;
-line_t *linespeciallist[MAXLINEANIMS];
+static side_t *scrollsides[MAXLINEANIMS];
+static signed char scrolldirs[MAXLINEANIMS];
+
+// [AP] Frames only turn over every anim->speed tics
+static boolean animsdirty;
 
 
 
@@ -310,6 +317,28 @@ getNextSector
 
 
 
+//
+// [AP] P_SectorHeightChanged
+// Drops the cached P_Find*Surrounding results that depended on the
+// sector's heights: its own (P_FindLowestFloorSurrounding starts from
+// its floor) and its neighbors'.
+//
+void P_SectorHeightChanged (sector_t* sec)
+{
+    int		i;
+
+    sec->surroundvalid = 0;
+
+    for (i=0 ; i < sec->numneighbors ; i++)
+	sec->neighbors[i]->surroundvalid = 0;
+}
+
+#define SURROUND_LOWESTFLOOR	1
+#define SURROUND_HIGHESTFLOOR	2
+#define SURROUND_LOWESTCEILING	4
+#define SURROUND_HIGHESTCEILING	8
+
+
 //
 // P_FindLowestFloorSurrounding()
 // FIND LOWEST FLOOR HEIGHT IN SURROUNDING SECTORS
@@ -317,21 +346,22 @@ getNextSector
 fixed_t	P_FindLowestFloorSurrounding(sector_t* sec)
 {
     int			i;
-    line_t*		check;
     sector_t*		other;
     fixed_t		floor = sec->floorheight;
+
+    if (sec->surroundvalid & SURROUND_LOWESTFLOOR)
+	return sec->lowestfloor;
 	
-    for (i=0 ;i < sec->linecount ; i++)
+    for (i=0 ;i < sec->numneighbors ; i++)
     {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
-
-	if (!other)
-	    continue;
+	other = sec->neighbors[i];
 	
 	if (other->floorheight < floor)
 	    floor = other->floorheight;
     }
+
+    sec->lowestfloor = floor;
+    sec->surroundvalid |= SURROUND_LOWESTFLOOR;
     return floor;
 }
 
@@ -344,21 +374,22 @@ fixed_t	P_FindLowestFloorSurrounding(sector_t* sec)
 fixed_t	P_FindHighestFloorSurrounding(sector_t *sec)
 {
     int			i;
-    line_t*		check;
     sector_t*		other;
     fixed_t		floor = -500*FRACUNIT;
+
+    if (sec->surroundvalid & SURROUND_HIGHESTFLOOR)
+	return sec->highestfloor;
 	
-    for (i=0 ;i < sec->linecount ; i++)
+    for (i=0 ;i < sec->numneighbors ; i++)
     {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
-	
-	if (!other)
-	    continue;
+	other = sec->neighbors[i];
 	
 	if (other->floorheight > floor)
 	    floor = other->floorheight;
     }
+
+    sec->highestfloor = floor;
+    sec->surroundvalid |= SURROUND_HIGHESTFLOOR;
     return floor;
 }
 
@@ -382,7 +413,6 @@ P_FindNextHighestFloor
     int         i;
     int         h;
     int         min;
-    line_t*     check;
     sector_t*   other;
     fixed_t     height = currentheight;
     static fixed_t *heightlist = NULL;
@@ -390,22 +420,18 @@ P_FindNextHighestFloor
 
     // [crispy] remove MAX_ADJOINING_SECTORS Vanilla limit
     // from prboom-plus/src/p_spec.c:404-411
-    if (sec->linecount > heightlist_size)
+    if (sec->numneighbors > heightlist_size)
     {
 	do
 	{
 	    heightlist_size = heightlist_size ? 2 * heightlist_size : MAX_ADJOINING_SECTORS;
-	} while (sec->linecount > heightlist_size);
+	} while (sec->numneighbors > heightlist_size);
 	heightlist = I_Realloc(heightlist, heightlist_size * sizeof(*heightlist));
     }
 
-    for (i=0, h=0; i < sec->linecount; i++)
+    for (i=0, h=0; i < sec->numneighbors; i++)
     {
-        check = sec->lines[i];
-        other = getNextSector(check,sec);
-
-        if (!other)
-            continue;
+        other = sec->neighbors[i];
         
         if (other->floorheight > height)
         {
@@ -452,21 +478,22 @@ fixed_t
 P_FindLowestCeilingSurrounding(sector_t* sec)
 {
     int			i;
-    line_t*		check;
     sector_t*		other;
     fixed_t		height = INT_MAX;
+
+    if (sec->surroundvalid & SURROUND_LOWESTCEILING)
+	return sec->lowestceiling;
 	
-    for (i=0 ;i < sec->linecount ; i++)
+    for (i=0 ;i < sec->numneighbors ; i++)
     {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
-
-	if (!other)
-	    continue;
+	other = sec->neighbors[i];
 
 	if (other->ceilingheight < height)
 	    height = other->ceilingheight;
     }
+
+    sec->lowestceiling = height;
+    sec->surroundvalid |= SURROUND_LOWESTCEILING;
     return height;
 }
 
@@ -477,21 +504,22 @@ P_FindLowestCeilingSurrounding(sector_t* sec)
 fixed_t	P_FindHighestCeilingSurrounding(sector_t* sec)
 {
     int		i;
-    line_t*	check;
     sector_t*	other;
     fixed_t	height = 0;
+
+    if (sec->surroundvalid & SURROUND_HIGHESTCEILING)
+	return sec->highestceiling;
 	
-    for (i=0 ;i < sec->linecount ; i++)
+    for (i=0 ;i < sec->numneighbors ; i++)
     {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
-
-	if (!other)
-	    continue;
+	other = sec->neighbors[i];
 
 	if (other->ceilingheight > height)
 	    height = other->ceilingheight;
     }
+
+    sec->highestceiling = height;
+    sec->surroundvalid |= SURROUND_HIGHESTCEILING;
     return height;
 }
 
@@ -549,17 +577,12 @@ P_FindMinSurroundingLight
 {
     int		i;
     int		min;
-    line_t*	line;
     sector_t*	check;
 	
     min = max;
-    for (i=0 ; i < sector->linecount ; i++)
+    for (i=0 ; i < sector->numneighbors ; i++)
     {
-	line = sector->lines[i];
-	check = getNextSector(line,sector);
-
-	if (!check)
-	    continue;
+	check = sector->neighbors[i];
 
 	if (check->lightlevel < min)
 	    min = check->lightlevel;
@@ -1236,7 +1259,6 @@ void P_UpdateSpecials (void)
     anim_t*	anim;
     int		pic;
     int		i;
-    line_t*	line;
 
     
     //	LEVEL TIMER
@@ -1250,6 +1272,11 @@ void P_UpdateSpecials (void)
     //	ANIMATE FLATS AND TEXTURES GLOBALLY
     for (anim = anims ; anim < lastanim ; anim++)
     {
+	// [AP] Same pics as last tic? Level start and savegames aside,
+	// leveltime only ever goes up by one
+	if (!animsdirty && leveltime % anim->speed)
+	    continue;
+
 	for (i=anim->basepic ; i<anim->basepic+anim->numpics ; i++)
 	{
 	    pic = anim->basepic + ( (leveltime/anim->speed + i)%anim->numpics );
@@ -1267,29 +1294,18 @@ void P_UpdateSpecials (void)
 	    }
 	}
     }
+    animsdirty = false;
 
     
     //	ANIMATE LINE SPECIALS
     for (i = 0; i < numlinespecials; i++)
     {
-	line = linespeciallist[i];
-	switch(line->special)
-	{
-	  case 48:
-	    // EFFECT FIRSTCOL SCROLL +
-	    // [crispy] smooth texture scrolling
-	    sides[line->sidenum[0]].basetextureoffset += FRACUNIT;
-	    sides[line->sidenum[0]].textureoffset =
-	    sides[line->sidenum[0]].basetextureoffset;
-	    break;
-	  case 85:
-	    // [JN] (Boom) Scroll Texture Right
-	    // [crispy] smooth texture scrolling
-	    sides[line->sidenum[0]].basetextureoffset -= FRACUNIT;
-	    sides[line->sidenum[0]].textureoffset =
-	    sides[line->sidenum[0]].basetextureoffset;
-	    break;
-	}
+	// EFFECT FIRSTCOL SCROLL +, [JN] (Boom) Scroll Texture Right
+	// [crispy] smooth texture scrolling
+	side_t *const side = scrollsides[i];
+
+	side->basetextureoffset += scrolldirs[i] * FRACUNIT;
+	side->textureoffset = side->basetextureoffset;
     }
 
     
@@ -1352,18 +1368,9 @@ void R_InterpolateTextureOffsets (void)
 
 		for (i = 0; i < numlinespecials; i++)
 		{
-			const line_t *const line = linespeciallist[i];
-			side_t *const side = &sides[line->sidenum[0]];
+			side_t *const side = scrollsides[i];
 
-			if (line->special == 48)
-			{
-				side->textureoffset = side->basetextureoffset + fractionaltic;
-			}
-			else
-			if (line->special == 85)
-			{
-				side->textureoffset = side->basetextureoffset - fractionaltic;
-			}
+			side->textureoffset = side->basetextureoffset + scrolldirs[i] * fractionaltic;
 		}
 	}
 }
@@ -1526,7 +1533,7 @@ int EV_DoDonut(line_t*	line)
             }
 
 	    //	Spawn rising slime
-	    floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+	    floor = P_AllocThinker (sizeof(*floor));
 	    P_AddThinker (&floor->thinker);
 	    s2->specialdata = floor;
 	    floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
@@ -1540,7 +1547,7 @@ int EV_DoDonut(line_t*	line)
 	    floor->floordestheight = s3_floorheight;
 	    
 	    //	Spawn lowering donut-hole
-	    floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+	    floor = P_AllocThinker (sizeof(*floor));
 	    P_AddThinker (&floor->thinker);
 	    s1->specialdata = floor;
 	    floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
@@ -1667,6 +1674,7 @@ void P_SpawnSpecials (void)
 
     
     //	Init line EFFECTs
+    animsdirty = true; // [AP]
     numlinespecials = 0;
     for (i = 0;i < numlines; i++)
     {
@@ -1680,7 +1688,8 @@ void P_SpawnSpecials (void)
                         "(Vanilla limit is 64)", NumScrollers());
             }
 	    // EFFECT FIRSTCOL SCROLL+
-	    linespeciallist[numlinespecials] = &lines[i];
+	    scrollsides[numlinespecials] = &sides[lines[i].sidenum[0]];
+	    scrolldirs[numlinespecials] = lines[i].special == 48 ? 1 : -1;
 	    numlinespecials++;
 	    break;
 
@@ -88,6 +88,7 @@ getSide
   int		line,
   int		side );
 
+void P_SectorHeightChanged (sector_t* sec); // [AP]
 fixed_t P_FindLowestFloorSurrounding(sector_t* sec);
 fixed_t P_FindHighestFloorSurrounding(sector_t* sec);
 
@@ -18,6 +18,8 @@
 //
 
 
+#include "i_profile.h" // [AP]
+#include "i_system.h"
 #include "z_zone.h"
 #include "p_local.h"
 #include "s_musinfo.h" // [crispy] T_MAPMusic()
@@ -30,7 +32,7 @@ int leveltimesinceload;
 
 //
 // THINKERS
-// All thinkers should be allocated by Z_Malloc
+// All thinkers should be allocated by P_AllocThinker
 // so they can be operated on uniformly.
 // The actual structures will vary in size,
 // but the first element must be thinker_t.
@@ -41,13 +43,123 @@ int leveltimesinceload;
 // Both the head and tail of the thinker list.
 thinker_t	thinkercap;
 
+// [AP] Heads and tails of the class lists, linked through cprev/cnext
+thinker_t	thinkerclasscap[NUMTHCLASS];
+
+
+// [AP] Thinkers come from one pool per structure size (so per type:
+// mobj_t, vldoor_t, floormove_t...), carved out of PU_LEVEL slabs. Freed
+// thinkers queue up and are reused oldest first, which keeps memory of
+// just removed mobjs intact for a while, as the zone allocator did. The
+// slabs go away with the rest of the level in P_SetupLevel's Z_FreeTags.
+#define THINKERPOOLS 16
+#define THINKERSLAB 128 // Thinkers per slab
+
+typedef struct
+{
+    size_t size; // Of the thinker itself
+    thinker_t *freehead, *freetail; // Linked through thinker_t::next
+    byte *slab; // Current slab, used up to slabused
+    int slabused;
+} thinkerpool_t;
+
+// Put in front of every pooled thinker, so it can be freed without
+// knowing its type
+typedef union
+{
+    thinkerpool_t *pool;
+    int64_t align;
+} thinkerslot_t;
+
+static thinkerpool_t thinkerpools[THINKERPOOLS];
+static int numthinkerpools;
+
+// Called once the level's zone memory has been freed
+void P_ClearThinkerPools (void)
+{
+    numthinkerpools = 0;
+}
+
+static thinkerpool_t *P_ThinkerPool (size_t size)
+{
+    thinkerpool_t *pool;
+    int i;
+
+    for (i = 0; i < numthinkerpools; i++)
+    {
+	if (thinkerpools[i].size == size)
+	    return &thinkerpools[i];
+    }
+
+    if (numthinkerpools == THINKERPOOLS)
+	I_Error("P_ThinkerPool: too many thinker sizes");
+
+    pool = &thinkerpools[numthinkerpools++];
+    pool->size = size;
+    pool->freehead = pool->freetail = NULL;
+    pool->slab = NULL;
+    pool->slabused = THINKERSLAB;
+    return pool;
+}
+
+void *P_AllocThinker (size_t size)
+{
+    thinkerpool_t *pool;
+    thinkerslot_t *slot;
+    size_t slotsize;
+
+    // Keep every slot aligned
+    size = (size + sizeof(thinkerslot_t) - 1) & ~(sizeof(thinkerslot_t) - 1);
+    pool = P_ThinkerPool(size);
+
+    if (pool->freehead)
+    {
+	thinker_t *thinker = pool->freehead;
+
+	pool->freehead = thinker->next;
+	if (!pool->freehead)
+	    pool->freetail = NULL;
+	return thinker;
+    }
+
+    slotsize = sizeof(thinkerslot_t) + size;
+
+    if (pool->slabused == THINKERSLAB)
+    {
+	pool->slab = Z_ArenaMalloc(slotsize * THINKERSLAB, PU_LEVEL);
+	pool->slabused = 0;
+    }
+
+    slot = (thinkerslot_t *) (pool->slab + slotsize * pool->slabused++);
+    slot->pool = pool;
+    return slot + 1;
+}
+
+void P_FreeThinker (thinker_t *thinker)
+{
+    thinkerpool_t *pool = ((thinkerslot_t *) thinker - 1)->pool;
+
+    thinker->next = NULL;
+    if (pool->freetail)
+	pool->freetail->next = thinker;
+    else
+	pool->freehead = thinker;
+    pool->freetail = thinker;
+}
+
+
 
 //
 // P_InitThinkers
 //
 void P_InitThinkers (void)
 {
+    int i;
+
     thinkercap.prev = thinkercap.next  = &thinkercap;
+
+    for (i = 0; i < NUMTHCLASS; i++)
+	thinkerclasscap[i].cprev = thinkerclasscap[i].cnext = &thinkerclasscap[i];
 }
 
 
@@ -59,10 +171,20 @@ void P_InitThinkers (void)
 //
 void P_AddThinker (thinker_t* thinker)
 {
+    thinker_t* cap;
+
     thinkercap.prev->next = thinker;
     thinker->next = &thinkercap;
     thinker->prev = thinkercap.prev;
     thinkercap.prev = thinker;
+
+    // [AP] Mobjs have their thinker set before being added, other thinkers
+    // don't, but those never become mobjs
+    cap = &thinkerclasscap[thinker->function.acp1 == (actionf_p1)P_MobjThinker ? th_mobj : th_misc];
+    cap->cprev->cnext = thinker;
+    thinker->cnext = cap;
+    thinker->cprev = cap->cprev;
+    cap->cprev = thinker;
 }
 
 
@@ -106,12 +228,20 @@ void P_RunThinkers (void)
             nextthinker = currentthinker->next;
 	    currentthinker->next->prev = currentthinker->prev;
 	    currentthinker->prev->next = currentthinker->next;
-	    Z_Free(currentthinker);
+	    currentthinker->cnext->cprev = currentthinker->cprev;
+	    currentthinker->cprev->cnext = currentthinker->cnext;
+	    P_FreeThinker(currentthinker);
 	}
 	else
 	{
 	    if (currentthinker->function.acp1)
 		currentthinker->function.acp1 (currentthinker);
+
+	    // [AP] Players have moved, monsters are about to look for them
+	    if (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker
+	     && ((mobj_t *)currentthinker)->player)
+		P_PrecomputeSight();
+
             nextthinker = currentthinker->next;
 	}
 	currentthinker = nextthinker;
@@ -149,7 +279,9 @@ void P_Ticker (void)
 	if (playeringame[i])
 	    P_PlayerThink (&players[i]);
 			
+    I_ProfileBegin(PROFILE_THINKERS); // [AP]
     P_RunThinkers ();
+    I_ProfileEnd(PROFILE_THINKERS);
     P_UpdateSpecials ();
     P_RespawnSpecials ();
 
@@ -22,11 +22,13 @@
 #include "doomtype.h"
 #include "doomstat.h"
 #include "r_data.h"
+#include "r_draw.h" // [AP] R_THREADLOCAL
 #include "w_wad.h"
+#include "z_zone.h"
 
 // [crispy] brightmap data
 
-static const byte nobrightmap[256] = {0};
+const byte nobrightmap[256] = {0};
 
 static const byte notgray[256] =
 {
@@ -414,7 +416,7 @@ static const byte hacxlightning[256] =
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 };
 
-const byte *dc_brightmap = nobrightmap;
+R_THREADLOCAL const byte *dc_brightmap = nobrightmap;
 
 // [crispy] brightmaps for textures
 
@@ -699,38 +701,35 @@ static const byte *R_BrightmapForTexName_Hacx (const char *texname)
 // [crispy] adapted from russian-doom/src/doom/r_things.c:617-639
 static const byte *R_BrightmapForSprite_Doom (const int type)
 {
-	if (crispy->brightmaps & BRIGHTMAPS_SPRITES)
+	switch (type)
 	{
-		switch (type)
+		// Armor Bonus
+		case SPR_BON2:
+		// Cell Charge
+		case SPR_CELL:
 		{
-			// Armor Bonus
-			case SPR_BON2:
-			// Cell Charge
-			case SPR_CELL:
-			{
-				return greenonly2;
-				break;
-			}
-			// Barrel
-			case SPR_BAR1:
-			{
-				return greenonly3;
-				break;
-			}
-			// Cell Charge Pack
-			case SPR_CELP:
-			{
-				return yellowonly;
-				break;
-			}
-			// BFG9000
-			case SPR_BFUG:
-			// Plasmagun
-			case SPR_PLAS:
-			{
-				return redonly;
-				break;
-			}
+			return greenonly2;
+			break;
+		}
+		// Barrel
+		case SPR_BAR1:
+		{
+			return greenonly3;
+			break;
+		}
+		// Cell Charge Pack
+		case SPR_CELP:
+		{
+			return yellowonly;
+			break;
+		}
+		// BFG9000
+		case SPR_BFUG:
+		// Plasmagun
+		case SPR_PLAS:
+		{
+			return redonly;
+			break;
 		}
 	}
 
@@ -769,46 +768,43 @@ static const byte *R_BrightmapForSprite_Chex (const int type)
 
 static const byte *R_BrightmapForSprite_Hacx (const int type)
 {
-	if (crispy->brightmaps & BRIGHTMAPS_SPRITES)
+	switch (type)
 	{
-		switch (type)
+		// Chainsaw
+		case SPR_CSAW:
+		// Plasmagun
+		case SPR_PLAS:
+		// Cell Charge
+		case SPR_CELL:
+		// Cell Charge Pack
+		case SPR_CELP:
 		{
-			// Chainsaw
-			case SPR_CSAW:
-			// Plasmagun
-			case SPR_PLAS:
-			// Cell Charge
-			case SPR_CELL:
-			// Cell Charge Pack
-			case SPR_CELP:
-			{
-				return redonly;
-				break;
-			}
-			// Rocket launcher
-			case SPR_LAUN:
-			// Medikit
-			case SPR_MEDI:
-			{
-				return redandgreen;
-				break;
-			}
-			// Rocket
-			case SPR_ROCK:
-			// Box of rockets
-			case SPR_BROK:
-			{
-				return greenonly1;
-				break;
-			}
-			// Health Bonus
-			case SPR_BON1:
-			// Stimpack
-			case SPR_STIM:
-			{
-				return notgrayorbrown;
-				break;
-			}
+			return redonly;
+			break;
+		}
+		// Rocket launcher
+		case SPR_LAUN:
+		// Medikit
+		case SPR_MEDI:
+		{
+			return redandgreen;
+			break;
+		}
+		// Rocket
+		case SPR_ROCK:
+		// Box of rockets
+		case SPR_BROK:
+		{
+			return greenonly1;
+			break;
+		}
+		// Health Bonus
+		case SPR_BON1:
+		// Stimpack
+		case SPR_STIM:
+		{
+			return notgrayorbrown;
+			break;
 		}
 	}
 
@@ -821,14 +817,11 @@ static int bmapflatnum[12];
 
 static const byte *R_BrightmapForFlatNum_Doom (const int num)
 {
-	if (crispy->brightmaps & BRIGHTMAPS_TEXTURES)
+	if (num == bmapflatnum[0] ||
+	    num == bmapflatnum[1] ||
+	    num == bmapflatnum[2])
 	{
-		if (num == bmapflatnum[0] ||
-		    num == bmapflatnum[1] ||
-		    num == bmapflatnum[2])
-		{
-			return notgrayorbrown;
-		}
+		return notgrayorbrown;
 	}
 
 	return nobrightmap;
@@ -836,27 +829,24 @@ static const byte *R_BrightmapForFlatNum_Doom (const int num)
 
 static const byte *R_BrightmapForFlatNum_Hacx (const int num)
 {
-	if (crispy->brightmaps & BRIGHTMAPS_TEXTURES)
+	if (num == bmapflatnum[0] ||
+	    num == bmapflatnum[1] ||
+	    num == bmapflatnum[2] ||
+	    num == bmapflatnum[3] ||
+	    num == bmapflatnum[4] ||
+	    num == bmapflatnum[5] ||
+	    num == bmapflatnum[9] ||
+	    num == bmapflatnum[10] ||
+	    num == bmapflatnum[11])
 	{
-		if (num == bmapflatnum[0] ||
-		    num == bmapflatnum[1] ||
-		    num == bmapflatnum[2] ||
-		    num == bmapflatnum[3] ||
-		    num == bmapflatnum[4] ||
-		    num == bmapflatnum[5] ||
-		    num == bmapflatnum[9] ||
-		    num == bmapflatnum[10] ||
-		    num == bmapflatnum[11])
-		{
-			return notgrayorbrown;
-		}
+		return notgrayorbrown;
+	}
 
-		if (num == bmapflatnum[6] ||
-		    num == bmapflatnum[7] ||
-		    num == bmapflatnum[8])
-		{
-			return greenonly1;
-		}
+	if (num == bmapflatnum[6] ||
+	    num == bmapflatnum[7] ||
+	    num == bmapflatnum[8])
+	{
+		return greenonly1;
 	}
 
 	return nobrightmap;
@@ -871,18 +861,15 @@ static const byte *R_BrightmapForFlatNum_None (const int num)
 
 static const byte *R_BrightmapForState_Doom (const int state)
 {
-	if (crispy->brightmaps & BRIGHTMAPS_SPRITES)
+	switch (state)
 	{
-		switch (state)
+		case S_BFG1:
+		case S_BFG2:
+		case S_BFG3:
+		case S_BFG4:
 		{
-			case S_BFG1:
-			case S_BFG2:
-			case S_BFG3:
-			case S_BFG4:
-			{
-				return redonly;
-				break;
-			}
+			return redonly;
+			break;
 		}
 	}
 
@@ -891,29 +878,26 @@ static const byte *R_BrightmapForState_Doom (const int state)
 
 static const byte *R_BrightmapForState_Hacx (const int state)
 {
-	if (crispy->brightmaps & BRIGHTMAPS_SPRITES)
+	switch (state)
 	{
-		switch (state)
+		case S_SAW2:
+		case S_SAW3:
 		{
-			case S_SAW2:
-			case S_SAW3:
-			{
-				return hacxlightning;
-				break;
-			}
-			case S_MISSILE:
-			{
-				return redandgreen;
-				break;
-			}
-			case S_SAW:
-			case S_SAWB:
-			case S_PLASMA:
-			case S_PLASMA2:
-			{
-				return redonly;
-				break;
-			}
+			return hacxlightning;
+			break;
+		}
+		case S_MISSILE:
+		{
+			return redandgreen;
+			break;
+		}
+		case S_SAW:
+		case S_SAWB:
+		case S_PLASMA:
+		case S_PLASMA2:
+		{
+			return redonly;
+			break;
 		}
 	}
 
@@ -928,9 +912,55 @@ static const byte *R_BrightmapForState_None (const int state)
 // [crispy] initialize brightmaps
 
 const byte *(*R_BrightmapForTexName) (const char *texname);
-const byte *(*R_BrightmapForSprite) (const int type);
-const byte *(*R_BrightmapForFlatNum) (const int num);
-const byte *(*R_BrightmapForState) (const int state);
+
+// [AP] The sprite, flat and state brightmaps are looked up once here and
+// kept in tables, so the renderer only has to index them
+
+static const byte *spritebrightmap[NUMSPRITES];
+static const byte **flatbrightmap;
+static const byte *statebrightmap[NUMSTATES];
+
+static void R_FillBrightmapTables (const byte *(*forsprite) (const int type),
+                                   const byte *(*forflatnum) (const int num),
+                                   const byte *(*forstate) (const int state))
+{
+	int i;
+
+	for (i = 0; i < NUMSPRITES; i++)
+	{
+		spritebrightmap[i] = forsprite(i);
+	}
+
+	flatbrightmap = Z_Malloc(numflats * sizeof(*flatbrightmap), PU_STATIC, 0);
+
+	for (i = 0; i < numflats; i++)
+	{
+		flatbrightmap[i] = forflatnum(i);
+	}
+
+	for (i = 0; i < NUMSTATES; i++)
+	{
+		statebrightmap[i] = forstate(i);
+	}
+}
+
+const byte *R_BrightmapForSprite (const int type)
+{
+	return (crispy->brightmaps & BRIGHTMAPS_SPRITES) ?
+	       spritebrightmap[type] : nobrightmap;
+}
+
+const byte *R_BrightmapForFlatNum (const int num)
+{
+	return (crispy->brightmaps & BRIGHTMAPS_TEXTURES) ?
+	       flatbrightmap[num] : nobrightmap;
+}
+
+const byte *R_BrightmapForState (const int state)
+{
+	return (crispy->brightmaps & BRIGHTMAPS_SPRITES) ?
+	       statebrightmap[state] : nobrightmap;
+}
 
 void R_InitBrightmaps ()
 {
@@ -950,9 +980,9 @@ void R_InitBrightmaps ()
 		bmapflatnum[11] = R_FlatNumForName("SLIME15");
 
 		R_BrightmapForTexName = R_BrightmapForTexName_Hacx;
-		R_BrightmapForSprite = R_BrightmapForSprite_Hacx;
-		R_BrightmapForFlatNum = R_BrightmapForFlatNum_Hacx;
-		R_BrightmapForState = R_BrightmapForState_Hacx;
+		R_FillBrightmapTables(R_BrightmapForSprite_Hacx,
+		                      R_BrightmapForFlatNum_Hacx,
+		                      R_BrightmapForState_Hacx);
 	}
 	else
 	if (gameversion == exe_chex)
@@ -967,9 +997,9 @@ void R_InitBrightmaps ()
 		}
 
 		R_BrightmapForTexName = R_BrightmapForTexName_Chex;
-		R_BrightmapForSprite = R_BrightmapForSprite_Chex;
-		R_BrightmapForFlatNum = R_BrightmapForFlatNum_None;
-		R_BrightmapForState = R_BrightmapForState_None;
+		R_FillBrightmapTables(R_BrightmapForSprite_Chex,
+		                      R_BrightmapForFlatNum_None,
+		                      R_BrightmapForState_None);
 	}
 	else
 	{
@@ -979,8 +1009,8 @@ void R_InitBrightmaps ()
 		bmapflatnum[2] = R_FlatNumForName("CONS1_7");
 
 		R_BrightmapForTexName = R_BrightmapForTexName_Doom;
-		R_BrightmapForSprite = R_BrightmapForSprite_Doom;
-		R_BrightmapForFlatNum = R_BrightmapForFlatNum_Doom;
-		R_BrightmapForState = R_BrightmapForState_Doom;
+		R_FillBrightmapTables(R_BrightmapForSprite_Doom,
+		                      R_BrightmapForFlatNum_Doom,
+		                      R_BrightmapForState_Doom);
 	}
 }
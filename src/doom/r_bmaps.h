@@ -25,10 +25,14 @@
 extern void R_InitBrightmaps ();
 
 extern const byte *(*R_BrightmapForTexName) (const char *texname);
-extern const byte *(*R_BrightmapForSprite) (const int type);
-extern const byte *(*R_BrightmapForFlatNum) (const int num);
-extern const byte *(*R_BrightmapForState) (const int state);
+extern const byte *R_BrightmapForSprite (const int type);
+extern const byte *R_BrightmapForFlatNum (const int num);
+extern const byte *R_BrightmapForState (const int state);
 
 extern const byte **texturebrightmap;
 
+// [AP] All zeros: every pixel uses colormap 0. Column drawers compare
+// dc_brightmap against it to skip the brightmap lookup.
+extern const byte nobrightmap[256];
+
 #endif
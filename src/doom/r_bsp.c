@@ -19,11 +19,15 @@
 
 
 
+#include <stdlib.h>
+
 #include "doomdef.h"
 
+#include "m_argv.h" // [AP] -occlusion
 #include "m_bbox.h"
 
 #include "i_system.h"
+#include "p_local.h" // [AP] MAXMOVE
 
 #include "r_main.h"
 #include "r_plane.h"
@@ -239,6 +243,75 @@ R_ClipPassWallSegment
 
 
 
+// [AP] -occlusion: which columns the segs drawn so far close from top
+// to bottom, through solid walls or upper and lower textures meeting,
+// where solidsegs only knows the former. Counted by blocks, so a box
+// skips a closed block at once.
+#define OCCLUSIONBLOCK 32
+
+static boolean	occlusion;
+static fixed_t	occlusionmargin;
+static byte	closedcolumns[MAXWIDTH];
+static int	openblockcolumns[(MAXWIDTH + OCCLUSIONBLOCK - 1) / OCCLUSIONBLOCK];
+
+void R_InitOcclusion (void)
+{
+    int i;
+
+    //!
+    // @category video
+    //
+    // Skip BSP subtrees hidden behind columns that walls already fill top
+    // to bottom. Faster on big open maps, looks the same, but lines that
+    // only ever were hidden that way no longer show on the automap.
+    //
+
+    occlusion = M_ParmExists("-occlusion");
+
+    if (!occlusion)
+	return;
+
+    // A thing's sprite can stick out of its box by half its width, and
+    // interpolation can draw it up to a move away
+    occlusionmargin = 0;
+    for (i = 0; i < numspritelumps; i++)
+    {
+	occlusionmargin = MAX(occlusionmargin, abs(spriteoffset[i]));
+	occlusionmargin = MAX(occlusionmargin, abs(spritewidth[i] - spriteoffset[i]));
+    }
+    occlusionmargin += MAXMOVE;
+}
+
+static void R_ClearOcclusion (void)
+{
+    int b;
+
+    if (!occlusion)
+	return;
+
+    memset(closedcolumns, 0, viewwidth);
+
+    for (b = 0; b * OCCLUSIONBLOCK < viewwidth; b++)
+	openblockcolumns[b] = MIN(OCCLUSIONBLOCK, viewwidth - b * OCCLUSIONBLOCK);
+}
+
+void R_MarkClosedColumns (int start, int stop)
+{
+    int x;
+
+    if (!occlusion)
+	return;
+
+    for (x = start; x <= stop; x++)
+    {
+	if (!closedcolumns[x] && ceilingclip[x] + 1 >= floorclip[x])
+	{
+	    closedcolumns[x] = 1;
+	    openblockcolumns[x / OCCLUSIONBLOCK]--;
+	}
+    }
+}
+
 //
 // R_ClearClipSegs
 //
@@ -249,10 +322,12 @@ void R_ClearClipSegs (void)
     solidsegs[1].first = viewwidth;
     solidsegs[1].last = 0x7fffffff;
     newend = solidsegs+2;
+
+    R_ClearOcclusion (); // [AP]
 }
 
 // [AM] Interpolate the passed sector, if prudent.
-void R_MaybeInterpolateSector(sector_t* sector)
+static void R_MaybeInterpolateSector(sector_t* sector)
 {
     if (crispy->uncapped &&
         // Only if we moved the sector last tic ...
@@ -277,6 +352,57 @@ void R_MaybeInterpolateSector(sector_t* sector)
     }
 }
 
+// [AP] Sectors T_MovePlane moved, that may still need interpolating.
+//      Every other sector's interpolated heights are its heights, so
+//      the BSP walk just reads them and only these get updated, once
+//      per frame.
+static sector_t**	movedsectors;
+static int		nummovedsectors;
+static int		maxmovedsectors;
+
+void R_SectorMoved (sector_t* sector)
+{
+    if (sector->interplisted)
+        return;
+
+    if (nummovedsectors == maxmovedsectors)
+    {
+        maxmovedsectors = maxmovedsectors ? 2 * maxmovedsectors : 64;
+        movedsectors = I_Realloc(movedsectors, maxmovedsectors * sizeof(*movedsectors));
+    }
+    movedsectors[nummovedsectors++] = sector;
+    sector->interplisted = true;
+}
+
+void R_InterpolateSectors (void)
+{
+    int i;
+
+    for (i = 0; i < nummovedsectors; )
+    {
+        sector_t* sector = movedsectors[i];
+
+        R_MaybeInterpolateSector(sector);
+
+        // Done once it's back to its real heights for good
+        if (sector->oldgametic < gametic - 1)
+        {
+            sector->interplisted = false;
+            movedsectors[i] = movedsectors[--nummovedsectors];
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+// The sectors are about to be freed
+void R_ClearMovedSectors (void)
+{
+    nummovedsectors = 0;
+}
+
 //
 // R_AddLine
 // Clips the given segment
@@ -295,8 +421,8 @@ void R_AddLine (seg_t*	line)
 
     // OPTIMIZE: quickly reject orthogonal back sides.
     // [crispy] remove slime trails
-    angle1 = R_PointToAngleCrispy (line->v1->r_x, line->v1->r_y);
-    angle2 = R_PointToAngleCrispy (line->v2->r_x, line->v2->r_y);
+    R_PointsToAnglesCrispy (line->v1->r_x, line->v1->r_y,
+                            line->v2->r_x, line->v2->r_y, &angle1, &angle2); // [AP]
     
     // Clip to view edges.
     // OPTIMIZE: make constant out of 2*clipangle (FIELDOFVIEW).
@@ -350,11 +476,6 @@ void R_AddLine (seg_t*	line)
     if (!backsector)
 	goto clipsolid;		
 
-    // [AM] Interpolate sector movement before
-    //      running clipping tests.  Frontsector
-    //      should already be interpolated.
-    R_MaybeInterpolateSector(backsector);
-
     // Closed door.
     if (backsector->interpceilingheight <= frontsector->interpfloorheight
 	|| backsector->interpfloorheight >= frontsector->interpceilingheight)
@@ -410,7 +531,9 @@ int	checkcoord[12][4] =
 };
 
 
-boolean R_CheckBBox (fixed_t*	bspcoord)
+// [AP] The columns the box covers, from sx1 to sx2. -1 if it may cover
+// them all, the view being in it or on its edge, 0 if it covers none.
+static int R_BBoxColumns (fixed_t* bspcoord, int* psx1, int* psx2)
 {
     int			boxx;
     int			boxy;
@@ -426,8 +549,6 @@ boolean R_CheckBBox (fixed_t*	bspcoord)
     angle_t		span;
     angle_t		tspan;
     
-    cliprange_t*	start;
-
     int			sx1;
     int			sx2;
     
@@ -449,7 +570,7 @@ boolean R_CheckBBox (fixed_t*	bspcoord)
 		
     boxpos = (boxy<<2)+boxx;
     if (boxpos == 5)
-	return true;
+	return -1;
 	
     x1 = bspcoord[checkcoord[boxpos][0]];
     y1 = bspcoord[checkcoord[boxpos][1]];
@@ -457,14 +578,15 @@ boolean R_CheckBBox (fixed_t*	bspcoord)
     y2 = bspcoord[checkcoord[boxpos][3]];
     
     // check clip list for an open space
-    angle1 = R_PointToAngleCrispy (x1, y1) - viewangle;
-    angle2 = R_PointToAngleCrispy (x2, y2) - viewangle;
+    R_PointsToAnglesCrispy (x1, y1, x2, y2, &angle1, &angle2); // [AP]
+    angle1 -= viewangle;
+    angle2 -= viewangle;
 	
     span = angle1 - angle2;
 
     // Sitting on a line?
     if (span >= ANG180)
-	return true;
+	return -1;
     
     tspan = angle1 + clipangle;
 
@@ -474,7 +596,7 @@ boolean R_CheckBBox (fixed_t*	bspcoord)
 
 	// Totally off the left edge?
 	if (tspan >= span)
-	    return false;	
+	    return 0;	
 
 	angle1 = clipangle;
     }
@@ -485,7 +607,7 @@ boolean R_CheckBBox (fixed_t*	bspcoord)
 
 	// Totally off the left edge?
 	if (tspan >= span)
-	    return false;
+	    return 0;
 	
 	angle2 = -clipangle;
     }
@@ -501,8 +623,68 @@ boolean R_CheckBBox (fixed_t*	bspcoord)
 
     // Does not cross a pixel.
     if (sx1 == sx2)
-	return false;			
+	return 0;			
     sx2--;
+
+    *psx1 = sx1;
+    *psx2 = sx2;
+
+    return 1;
+}
+
+static fixed_t R_OcclusionGrow (fixed_t coord, fixed_t by)
+{
+    int64_t grown = (int64_t) coord + by;
+
+    return (fixed_t) BETWEEN(INT_MIN, INT_MAX, grown);
+}
+
+// Hidden if every column of the box, grown by the sprite margin, is closed
+static boolean R_BBoxOccluded (fixed_t* bspcoord)
+{
+    fixed_t	box[4];
+    int		sx1, sx2;
+    int		x;
+
+    box[BOXTOP] = R_OcclusionGrow(bspcoord[BOXTOP], occlusionmargin);
+    box[BOXBOTTOM] = R_OcclusionGrow(bspcoord[BOXBOTTOM], -occlusionmargin);
+    box[BOXLEFT] = R_OcclusionGrow(bspcoord[BOXLEFT], -occlusionmargin);
+    box[BOXRIGHT] = R_OcclusionGrow(bspcoord[BOXRIGHT], occlusionmargin);
+
+    if (R_BBoxColumns(box, &sx1, &sx2) != 1)
+	return false;
+
+    for (x = sx1; x <= sx2; )
+    {
+	if (!openblockcolumns[x / OCCLUSIONBLOCK])
+	{
+	    x = (x / OCCLUSIONBLOCK + 1) * OCCLUSIONBLOCK;
+	    continue;
+	}
+
+	if (!closedcolumns[x])
+	    return false;
+
+	x++;
+    }
+
+    return true;
+}
+
+boolean R_CheckBBox (fixed_t*	bspcoord)
+{
+    cliprange_t*	start;
+
+    int			sx1;
+    int			sx2;
+
+    switch (R_BBoxColumns (bspcoord, &sx1, &sx2)) // [AP]
+    {
+	case -1:
+	    return true;
+	case 0:
+	    return false;
+    }
 	
     start = solidsegs;
     while (start->last < sx2)
@@ -515,6 +697,10 @@ boolean R_CheckBBox (fixed_t*	bspcoord)
 	return false;
     }
 
+    // [AP] or the walls in front close all of it
+    if (occlusion && R_BBoxOccluded (bspcoord))
+	return false;
+
     return true;
 }
 
@@ -545,10 +731,6 @@ void R_Subsector (int num)
     count = sub->numlines;
     line = &segs[sub->firstline];
 
-    // [AM] Interpolate sector movement.  Usually only needed
-    //      when you're standing inside the sector.
-    R_MaybeInterpolateSector(frontsector);
-
     if (frontsector->interpfloorheight < viewz)
     {
 	floorplane = R_FindPlane(frontsector->interpfloorheight,
@@ -58,5 +58,14 @@ void R_ClearDrawSegs (void);
 
 void R_RenderBSPNode (int bspnum);
 
+// [AP] -occlusion, R_StoreWallRange marks the columns it closed
+void R_InitOcclusion (void);
+void R_MarkClosedColumns (int start, int stop);
+
+// [AP] Sector interpolation, only for the sectors that move
+void R_SectorMoved (sector_t* sector);
+void R_InterpolateSectors (void);
+void R_ClearMovedSectors (void);
+
 
 #endif
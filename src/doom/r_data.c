@@ -20,12 +20,18 @@
 #include <stdio.h>
 #include <stdlib.h> // [crispy] calloc()
 
+#include "SDL.h" // [AP] composite thread
+
 #include "deh_main.h"
+#include "i_jobs.h" // [AP] R_BuildTranMap()
 #include "i_swap.h"
 #include "i_system.h"
+#include "m_argv.h"
+#include "m_config.h" // [AP] configdir
 #include "z_zone.h"
 
 
+#include "w_prefetch.h" // [AP] W_PrefetchLump()
 #include "w_wad.h"
 
 #include "doomdef.h"
@@ -39,6 +45,7 @@
 
 #include "r_data.h"
 #include "v_trans.h" // [crispy] tranmap, CRMAX
+#include "v_video.h" // [AP] V_FlushLayers()
 #include "r_bmaps.h" // [crispy] R_BrightmapForTexName()
 
 //
@@ -158,6 +165,17 @@ byte**			texturecomposite; // [crispy] composited translucent mid-textures on 2S
 byte**			texturecomposite2; // [crispy] composited opaque textures
 const byte**	texturebrightmap; // [crispy] brightmaps
 
+// [AP] -textureatlas: opaque composites of the level's wall textures,
+// copied in order of first use into one PU_LEVEL arena. R_GetColumn reads
+// from here when a texture has an entry, so the seg loop walks one block
+// of memory instead of blocks scattered over the zone. Same layout as
+// texturecomposite2, so texturecolumnofs2 applies as is.
+static byte**		textureatlas;
+
+// [AP] Whether R_GenerateLookup has run for the texture. It runs the
+// first time a composite is made, not for every texture at startup.
+static byte*		texturelookup;
+
 // for global animation
 int*		flattranslation;
 int*		texturetranslation;
@@ -185,6 +203,8 @@ lighttable_t	*colormaps;
 
 
 // [crispy] replace R_DrawColumnInCache(), R_GenerateComposite() and R_GenerateLookup()
+
+static void R_GenerateLookup (int texnum);
 // with Lee Killough's implementations found in MBF to fix Medusa bug
 // taken from mbfsrc/R_DATA.C:136-425
 //
@@ -257,7 +277,32 @@ R_DrawColumnInCache
 //
 // Rewritten by Lee Killough for performance and to fix Medusa bug
 
-void R_GenerateComposite (int texnum)
+// [AP] Allocates the composite blocks. They stay PU_STATIC until
+// R_BuildComposite has filled them.
+static void R_AllocComposite (int texnum)
+{
+    texture_t*		texture = textures[texnum];
+
+    // [AP] Column offsets and composite size, on first use
+    if (!texturelookup[texnum])
+    {
+	R_GenerateLookup (texnum);
+	texturelookup[texnum] = 1;
+    }
+
+    Z_Malloc (texturecompositesize[texnum],
+	      PU_STATIC, 
+	      &texturecomposite[texnum]);	
+    // [crispy] memory block for opaque textures
+    Z_Malloc (texture->width * texture->height,
+	      PU_STATIC,
+	      &texturecomposite2[texnum]);
+}
+
+// [AP] Fills in blocks made by R_AllocComposite. With patches given (one
+// per texture patch, already cached), this doesn't touch the zone or the
+// WAD, so it is safe off the main thread.
+static void R_BuildComposite (int texnum, patch_t** patches)
 {
     byte*		block, *block2;
     texture_t*		texture;
@@ -275,13 +320,8 @@ void R_GenerateComposite (int texnum)
 	
     texture = textures[texnum];
 
-    block = Z_Malloc (texturecompositesize[texnum],
-		      PU_STATIC, 
-		      &texturecomposite[texnum]);	
-    // [crispy] memory block for opaque textures
-    block2 = Z_Malloc (texture->width * texture->height,
-		      PU_STATIC,
-		      &texturecomposite2[texnum]);
+    block = texturecomposite[texnum];
+    block2 = texturecomposite2[texnum];
 
     collump = texturecolumnlump[texnum];
     colofs = texturecolumnofs[texnum];
@@ -298,7 +338,7 @@ void R_GenerateComposite (int texnum)
 	 i<texture->patchcount;
 	 i++, patch++)
     {
-	realpatch = W_CacheLumpNum (patch->patch, PU_CACHE);
+	realpatch = patches ? patches[i] : W_CacheLumpNum (patch->patch, PU_CACHE);
 	x1 = patch->originx;
 	x2 = x1 + SHORT(realpatch->width);
 
@@ -393,11 +433,137 @@ void R_GenerateComposite (int texnum)
 
     free(source); // free temporary column
     free(marks); // free transparency marks
+}
+
+void R_GenerateComposite (int texnum)
+{
+    R_AllocComposite (texnum);
+    R_BuildComposite (texnum, NULL);
 
     // Now that the texture has been built in column cache,
     //  it is purgable from zone memory.
-    Z_ChangeTag (block, PU_CACHE);
-    Z_ChangeTag (block2, PU_CACHE);
+    Z_ChangeTag (texturecomposite[texnum], PU_CACHE);
+    Z_ChangeTag (texturecomposite2[texnum], PU_CACHE);
+}
+
+
+//
+// [AP] Level composites
+// Textures on the level's sidedefs are composited on a background thread
+//  while the rest of the level loads, instead of on first sight.
+// The main thread does every zone and WAD access up front: it allocates
+//  the blocks and caches the patches PU_STATIC. The thread only writes
+//  into those blocks. R_FinishLevelComposites waits for it and makes
+//  everything purgable again.
+//
+
+typedef struct
+{
+    int		texnum;
+    patch_t**	patches;
+} levelcomposite_t;
+
+static levelcomposite_t*	levelcomposites;
+static int			numlevelcomposites;
+static SDL_Thread*		compositethread;
+
+static int R_CompositeThread (void* unused)
+{
+    int i;
+
+    for (i = 0; i < numlevelcomposites; i++)
+	R_BuildComposite (levelcomposites[i].texnum, levelcomposites[i].patches);
+
+    return 0;
+}
+
+static void R_QueueLevelComposite (int texnum, char* queued)
+{
+    texture_t*		texture;
+    levelcomposite_t*	lc;
+    int			i;
+
+    if (texnum <= 0 || texnum >= numtextures || queued[texnum])
+	return;
+    queued[texnum] = 1;
+
+    // already built (and not purged)
+    if (texturecomposite[texnum] || texturecomposite2[texnum])
+	return;
+
+    texture = textures[texnum];
+    lc = &levelcomposites[numlevelcomposites++];
+    lc->texnum = texnum;
+    lc->patches = I_Realloc(NULL, texture->patchcount * sizeof(*lc->patches));
+
+    for (i = 0; i < texture->patchcount; i++)
+	lc->patches[i] = W_CacheLumpNum (texture->patches[i].patch, PU_STATIC);
+
+    R_AllocComposite (texnum);
+}
+
+// Called once the sidedefs are loaded
+void R_StartLevelComposites (void)
+{
+    char*	queued;
+    int		i;
+
+    R_FinishLevelComposites ();
+
+    // the atlas went with the previous level's PU_LEVEL memory
+    memset(textureatlas, 0, numtextures * sizeof(*textureatlas));
+
+    levelcomposites = I_Realloc(NULL, (numsides * 3 + 1) * sizeof(*levelcomposites));
+    queued = calloc(numtextures, 1);
+
+    for (i = 0 ; i < numsides ; i++)
+    {
+	R_QueueLevelComposite (sides[i].toptexture, queued);
+	R_QueueLevelComposite (sides[i].midtexture, queued);
+	R_QueueLevelComposite (sides[i].bottomtexture, queued);
+    }
+    R_QueueLevelComposite (skytexture, queued);
+
+    free(queued);
+
+    if (!numlevelcomposites)
+	return;
+
+    compositethread = SDL_CreateThread(R_CompositeThread, "R_CompositeThread", NULL);
+
+    // no thread, just do it now
+    if (!compositethread)
+	R_CompositeThread (NULL);
+}
+
+// Called before anything can be drawn from the level
+void R_FinishLevelComposites (void)
+{
+    int i, j;
+
+    if (compositethread)
+    {
+	SDL_WaitThread(compositethread, NULL);
+	compositethread = NULL;
+    }
+
+    for (i = 0; i < numlevelcomposites; i++)
+    {
+	const int texnum = levelcomposites[i].texnum;
+	const texture_t* texture = textures[texnum];
+
+	Z_ChangeTag (texturecomposite[texnum], PU_CACHE);
+	Z_ChangeTag (texturecomposite2[texnum], PU_CACHE);
+
+	for (j = 0; j < texture->patchcount; j++)
+	    W_ReleaseLumpNum (texture->patches[j].patch);
+
+	free(levelcomposites[i].patches);
+    }
+
+    free(levelcomposites);
+    levelcomposites = NULL;
+    numlevelcomposites = 0;
 }
 
 
@@ -408,7 +574,7 @@ void R_GenerateComposite (int texnum)
 // Rewritten by Lee Killough for performance and to fix Medusa bug
 //
 
-void R_GenerateLookup (int texnum)
+static void R_GenerateLookup (int texnum)
 {
     texture_t*		texture;
     byte*		patchcount;	// patchcount[texture->width]
@@ -602,11 +768,17 @@ R_GetColumn
     int		ofs;
 	
     col &= texturewidthmask[tex];
-    ofs = texturecolumnofs2[tex][col];
 
+    if (textureatlas[tex])
+	return textureatlas[tex] + texturecolumnofs2[tex][col];
+
+    // [AP] The offsets come with the first composite
     if (!texturecomposite2[tex])
 	R_GenerateComposite (tex);
+    else
+	Z_Touch (texturecomposite2[tex]); // [AP] keep it over colder blocks
 
+    ofs = texturecolumnofs2[tex][col];
     return texturecomposite2[tex] + ofs;
 }
 
@@ -616,18 +788,39 @@ R_GetColumnMod
 ( int		tex,
   int		col )
 {
-    int		ofs;
+    byte*	composite = R_GetMaskedComposite (tex); // [AP]
 
-    while (col < 0)
-	col += texturewidth[tex];
-
-    col %= texturewidth[tex];
-    ofs = texturecolumnofs[tex][col];
+    return composite + R_GetColumnModOffset (tex, col);
+}
 
+byte*
+R_GetMaskedComposite
+( int		tex )
+{
     if (!texturecomposite[tex])
 	R_GenerateComposite (tex);
+    else
+	Z_Touch (texturecomposite[tex]); // [AP]
 
-    return texturecomposite[tex] + ofs;
+    return texturecomposite[tex];
+}
+
+// Only after R_GetMaskedComposite has made the lookup
+int
+R_GetColumnModOffset
+( int		tex,
+  int		col )
+{
+    // [AP] most columns are in range, no need to divide for those
+    if ((unsigned) col >= (unsigned) texturewidth[tex])
+    {
+	while (col < 0)
+	    col += texturewidth[tex];
+
+	col %= texturewidth[tex];
+    }
+
+    return texturecolumnofs[tex][col];
 }
 
 
@@ -864,7 +1057,14 @@ void R_InitTextures (void)
     texturecolumnofs2 = Z_Malloc (numtextures * sizeof(*texturecolumnofs2), PU_STATIC, 0);
     texturecomposite = Z_Malloc (numtextures * sizeof(*texturecomposite), PU_STATIC, 0);
     texturecomposite2 = Z_Malloc (numtextures * sizeof(*texturecomposite2), PU_STATIC, 0);
+    // [AP] Nothing composited yet, R_GenerateLookup used to clear these
+    memset(texturecomposite, 0, numtextures * sizeof(*texturecomposite));
+    memset(texturecomposite2, 0, numtextures * sizeof(*texturecomposite2));
     texturecompositesize = Z_Malloc (numtextures * sizeof(*texturecompositesize), PU_STATIC, 0);
+    textureatlas = Z_Malloc (numtextures * sizeof(*textureatlas), PU_STATIC, 0);
+    memset(textureatlas, 0, numtextures * sizeof(*textureatlas));
+    texturelookup = Z_Malloc (numtextures, PU_STATIC, 0);
+    memset(texturelookup, 0, numtextures);
     texturewidthmask = Z_Malloc (numtextures * sizeof(*texturewidthmask), PU_STATIC, 0);
     texturewidth = Z_Malloc (numtextures * sizeof(*texturewidth), PU_STATIC, 0);
     textureheight = Z_Malloc (numtextures * sizeof(*textureheight), PU_STATIC, 0);
@@ -982,10 +1182,8 @@ void R_InitTextures (void)
     }
     free(texturelumps);
     
-    // Precalculate whatever possible.	
-
-    for (i=0 ; i<numtextures ; i++)
-	R_GenerateLookup (i);
+    // [AP] Lookups are generated with the first composite of each
+    // texture, see R_AllocComposite
     
     // Create translation table for global animation.
     texturetranslation = Z_Malloc ((numtextures+1)*sizeof(*texturetranslation), PU_STATIC, 0);
@@ -1058,6 +1256,124 @@ enum {
 
 static const int tran_filter_pct = 66;
 
+// [AP] Generating the map means a nearest color search for each of the
+// 65536 pairs, so it's split into jobs by background color and the result
+// is kept in the config dir, keyed by a hash of PLAYPAL.
+#define TRANMAP_JOBROWS 16
+#define TRANMAP_MAGIC "TRANMAP1"
+
+typedef struct
+{
+    byte *playpal;
+    int first, last; // Background colors, last excluded
+} tranmaprows_t;
+
+static void R_BuildTranMapRows (const tranmaprows_t *rows)
+{
+    byte *fg, *bg, blend[3], *tp = tranmap + (rows->first << 8);
+    int i, j, btmp;
+
+    // [crispy] background color
+    for (i = rows->first; i < rows->last; i++)
+    {
+	// [crispy] foreground color
+	for (j = 0; j < 256; j++)
+	{
+	    // [crispy] shortcut: identical foreground and background
+	    if (i == j)
+	    {
+		*tp++ = i;
+		continue;
+	    }
+
+	    bg = rows->playpal + 3*i;
+	    fg = rows->playpal + 3*j;
+
+	    // [crispy] blended color - emphasize blues
+	    // Colour matching in RGB space doesn't work very well with the blues
+	    // in Doom's palette. Rather than do any colour conversions, just
+	    // emphasize the blues when building the translucency table.
+	    btmp = fg[b] * 1.666 < (fg[r] + fg[g]) ? 0 : 50;
+	    blend[r] = (tran_filter_pct * fg[r] + (100 - tran_filter_pct) * bg[r]) / (100 + btmp);
+	    blend[g] = (tran_filter_pct * fg[g] + (100 - tran_filter_pct) * bg[g]) / (100 + btmp);
+	    blend[b] = (tran_filter_pct * fg[b] + (100 - tran_filter_pct) * bg[b]) / 100;
+
+	    *tp++ = V_GetPaletteIndex(rows->playpal, blend[r], blend[g], blend[b]);
+	}
+    }
+}
+
+static void R_TranMapJob (void *data, int worker)
+{
+    R_BuildTranMapRows(data);
+}
+
+static void R_BuildTranMap (byte *playpal)
+{
+    tranmaprows_t rows[256 / TRANMAP_JOBROWS];
+    jobgroup_t *group;
+    int i;
+
+    // Jobs smaller than a thread's share, so a slow one doesn't hold up
+    // the rest
+    group = I_JobGroup();
+    for (i = 0; i < arrlen(rows); i++)
+    {
+	rows[i].playpal = playpal;
+	rows[i].first = i * TRANMAP_JOBROWS;
+	rows[i].last = (i + 1) * TRANMAP_JOBROWS;
+	I_AddJob(group, R_TranMapJob, &rows[i]);
+    }
+    I_FreeJobGroup(group);
+}
+
+static unsigned int R_TranMapKey (const byte *playpal)
+{
+    unsigned int hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < 256 * 3; i++)
+	hash = (hash ^ playpal[i]) * 16777619u;
+    hash = (hash ^ tran_filter_pct) * 16777619u;
+
+    return hash;
+}
+
+static boolean R_LoadTranMapCache (const char *path, unsigned int key)
+{
+    byte *data;
+    int length;
+    boolean ok;
+
+    if (!M_FileExists(path))
+	return false;
+
+    length = M_ReadFile(path, &data);
+    ok = length == 8 + 4 + 256*256
+      && !memcmp(data, TRANMAP_MAGIC, 8)
+      && data[8] == (key & 0xff) && data[9] == ((key >> 8) & 0xff)
+      && data[10] == ((key >> 16) & 0xff) && data[11] == (key >> 24);
+    if (ok)
+	memcpy(tranmap, data + 12, 256*256);
+    Z_Free(data);
+
+    return ok;
+}
+
+static void R_SaveTranMapCache (const char *path, unsigned int key)
+{
+    byte *data = Z_Malloc(8 + 4 + 256*256, PU_STATIC, 0);
+
+    memcpy(data, TRANMAP_MAGIC, 8);
+    data[8] = key & 0xff;
+    data[9] = (key >> 8) & 0xff;
+    data[10] = (key >> 16) & 0xff;
+    data[11] = key >> 24;
+    memcpy(data + 12, tranmap, 256*256);
+    M_WriteFile(path, data, 8 + 4 + 256*256);
+    Z_Free(data);
+}
+
 static void R_InitTranMap()
 {
     int lump = W_CheckNumForName("TRANMAP");
@@ -1074,44 +1390,24 @@ static void R_InitTranMap()
     {
 	// Compose a default transparent filter map based on PLAYPAL.
 	unsigned char *playpal = W_CacheLumpName("PLAYPAL", PU_STATIC);
+	unsigned int key = R_TranMapKey(playpal);
+	char *path = M_StringJoin(configdir, "tranmap.dat", NULL);
 
 	tranmap = Z_Malloc(256*256, PU_STATIC, 0);
-	{
-	    byte *fg, *bg, blend[3], *tp = tranmap;
-	    int i, j, btmp;
 
-	    // [crispy] background color
-	    for (i = 0; i < 256; i++)
-	    {
-		// [crispy] foreground color
-		for (j = 0; j < 256; j++)
-		{
-		    // [crispy] shortcut: identical foreground and background
-		    if (i == j)
-		    {
-			*tp++ = i;
-			continue;
-		    }
-
-		    bg = playpal + 3*i;
-		    fg = playpal + 3*j;
-
-		    // [crispy] blended color - emphasize blues
-		    // Colour matching in RGB space doesn't work very well with the blues
-		    // in Doom's palette. Rather than do any colour conversions, just
-		    // emphasize the blues when building the translucency table.
-		    btmp = fg[b] * 1.666 < (fg[r] + fg[g]) ? 0 : 50;
-		    blend[r] = (tran_filter_pct * fg[r] + (100 - tran_filter_pct) * bg[r]) / (100 + btmp);
-		    blend[g] = (tran_filter_pct * fg[g] + (100 - tran_filter_pct) * bg[g]) / (100 + btmp);
-		    blend[b] = (tran_filter_pct * fg[b] + (100 - tran_filter_pct) * bg[b]) / 100;
-
-		    *tp++ = V_GetPaletteIndex(playpal, blend[r], blend[g], blend[b]);
-		}
-	    }
+	if (R_LoadTranMapCache(path, key))
+	{
+	    // [AP] loaded from the cache
+	    printf(":");
+	}
+	else
+	{
+	    R_BuildTranMap(playpal);
+	    R_SaveTranMapCache(path, key);
+	    printf(".");
 	}
 
-	printf(".");
-
+	free(path);
 	W_ReleaseLumpName("PLAYPAL");
     }
 }
@@ -1195,6 +1491,8 @@ void R_InitColormaps (void)
 
 		W_ReleaseLumpName("COLORMAP");
 	}
+
+	V_FlushLayers(); // [AP] cached HUD layers hold the old colors
 #endif
 
     // [crispy] initialize color translation and color strings tables
@@ -1346,6 +1644,113 @@ int R_TextureNumForName(const char *name)
 
 
 
+//
+// [AP] R_BuildTextureAtlas
+// Packs the opaque composites of the level's wall textures, and the sky,
+//  into one arena. Textures are laid out in the order sidedefs first
+//  use them, which roughly follows how the map was built.
+//
+static int R_AtlasTexture (int texnum, char* placed, int* order, int count)
+{
+    if (texnum > 0 && texnum < numtextures && !placed[texnum])
+    {
+	placed[texnum] = 1;
+	order[count++] = texnum;
+    }
+    return count;
+}
+
+void R_BuildTextureAtlas (void)
+{
+    static int	atlas = -1;
+    char*	placed;
+    int*	order;
+    int		count = 0;
+    int		size = 0;
+    int		i;
+    byte*	arena;
+
+    //!
+    // @category video
+    //
+    // Copy the wall textures of each level into one block of memory,
+    // in the order they are first used, for faster wall drawing.
+    //
+
+    if (atlas < 0)
+	atlas = M_ParmExists("-textureatlas");
+
+    if (!atlas)
+	return;
+
+    placed = calloc(numtextures, 1);
+    order = I_Realloc(NULL, (numsides * 3 + 1) * sizeof(*order));
+
+    for (i = 0 ; i < numsides ; i++)
+    {
+	count = R_AtlasTexture(sides[i].toptexture, placed, order, count);
+	count = R_AtlasTexture(sides[i].midtexture, placed, order, count);
+	count = R_AtlasTexture(sides[i].bottomtexture, placed, order, count);
+    }
+    count = R_AtlasTexture(skytexture, placed, order, count);
+
+    for (i = 0 ; i < count ; i++)
+	size += textures[order[i]]->width * textures[order[i]]->height;
+
+    arena = size > 0 ? Z_ArenaMalloc(size, PU_LEVEL) : NULL;
+
+    for (i = 0 ; i < count ; i++)
+    {
+	const int texnum = order[i];
+	const int texsize = textures[texnum]->width * textures[texnum]->height;
+
+	if (!texturecomposite2[texnum])
+	    R_GenerateComposite (texnum);
+
+	memcpy(arena, texturecomposite2[texnum], texsize);
+	textureatlas[texnum] = arena;
+	arena += texsize;
+    }
+
+    free(order);
+    free(placed);
+}
+
+
+//
+// R_PrefetchLevel
+// [AP] Same lumps as R_PrecacheLevel, but only queued, so the reads
+// overlap the rest of the level setup.
+//
+void R_PrefetchLevel (void)
+{
+    int		i;
+    int		j;
+    texture_t*	texture;
+
+    for (i=0 ; i<numsectors ; i++)
+    {
+	W_PrefetchLump(firstflat + sectors[i].floorpic);
+	W_PrefetchLump(firstflat + sectors[i].ceilingpic);
+    }
+
+    for (i=0 ; i<numsides ; i++)
+    {
+	const short texnums[3] = {
+	    sides[i].toptexture, sides[i].midtexture, sides[i].bottomtexture
+	};
+	int k;
+
+	for (k=0 ; k<3 ; k++)
+	{
+	    texture = textures[texnums[k]];
+
+	    for (j=0 ; j<texture->patchcount ; j++)
+		W_PrefetchLump(texture->patches[j].patch);
+	}
+    }
+}
+
 //
 // R_PrecacheLevel
 // Preloads all relevant graphics for the level.
@@ -1422,7 +1827,8 @@ void R_PrecacheLevel (void)
 	    continue;
 
 	// [crispy] precache composite textures
-	R_GenerateComposite(i);
+	if (!texturecomposite[i] || !texturecomposite2[i])
+	    R_GenerateComposite(i);
 
 	texture = textures[i];
 	
@@ -1440,7 +1846,7 @@ void R_PrecacheLevel (void)
     spritepresent = Z_Malloc(numsprites, PU_STATIC, NULL);
     memset (spritepresent,0, numsprites);
 	
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    for (th = thinkerclasscap[th_mobj].cnext ; th != &thinkerclasscap[th_mobj] ; th=th->cnext)
     {
 	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
 	    spritepresent[((mobj_t *)th)->sprite] = 1;
@@ -40,11 +40,36 @@ R_GetColumnMod
 ( int		tex,
   int		col );
 
+// [AP] R_GetColumnMod in two halves, so a masked seg can work out its
+// columns in the solid pass and only add them to the composite later.
+// The offsets stay good when the composite is purged and made again.
+byte*
+R_GetMaskedComposite
+( int		tex );
+
+int
+R_GetColumnModOffset
+( int		tex,
+  int		col );
+
 
 // I/O, setting up the stuff.
 void R_InitData (void);
 void R_PrecacheLevel (void);
 
+// [AP] Queues the level's flats and wall patches for reading ahead
+void R_PrefetchLevel (void);
+
+// [AP] Composite the level's wall textures on a background thread while
+// the rest of it loads. Start once the sidedefs are in, finish before
+// anything is drawn.
+void R_StartLevelComposites (void);
+void R_FinishLevelComposites (void);
+
+// [AP] With -textureatlas, packs the level's wall textures into one block
+// for R_GetColumn. Called at the end of level setup.
+void R_BuildTextureAtlas (void);
+
 
 // Retrieval.
 // Floor/ceiling opaque texture tiles,
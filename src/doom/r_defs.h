@@ -101,7 +101,7 @@ typedef struct
 // The SECTORS record, at runtime.
 // Stores things/mobjs.
 //
-typedef	struct
+typedef	struct sector_s
 {
     fixed_t	floorheight;
     fixed_t	ceilingheight;
@@ -134,6 +134,24 @@ typedef	struct
 
     int			linecount;
     struct line_s**	lines;	// [linecount] size
+
+    // [AP] Sectors across each two-sided line, in line order (repeats
+    // and all), and the P_Find*Surrounding results flagged in
+    // surroundvalid, until this sector or one of those moves a plane
+    int			numneighbors;
+    struct sector_s**	neighbors;	// [numneighbors] size
+    int			surroundvalid;
+    fixed_t		lowestfloor;
+    fixed_t		highestfloor;
+    fixed_t		lowestceiling;
+    fixed_t		highestceiling;
+
+    // [AP] What P_NoiseAlert's flood from this sector reached, replayed
+    // while soundfloodgen is current, see P_SoundSectorMoved
+    int			soundfloodgen;
+    int			numsoundflood;
+    int			maxsoundflood;
+    struct soundflood_s*	soundflood;	// [numsoundflood] size
     
     // [crispy] WiggleFix: [kb] for R_FixWiggle()
     int		cachedheight;
@@ -160,6 +178,9 @@ typedef	struct
     fixed_t	interpfloorheight;
     fixed_t	interpceilingheight;
 
+    // [AP] On the list R_InterpolateSectors goes through
+    boolean	interplisted;
+
     // [crispy] revealed secrets
     short	oldspecial;
 
@@ -248,6 +269,9 @@ typedef struct line_s
     // thinker_t for reversable actions
     void*	specialdata;		
 
+    // [AP] openrange > 0, last time sound or a plane move checked
+    boolean	soundopen;
+
     // [crispy] calculate sound origin of line to be its midpoint
     degenmobj_t	soundorg;
 } line_t;
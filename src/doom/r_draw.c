@@ -24,11 +24,14 @@
 #include "doomdef.h"
 #include "deh_main.h"
 
+#include "i_jobs.h" // [AP] R_UpscaleView()
+#include "i_simd.h"
 #include "i_system.h"
 #include "z_zone.h"
 #include "w_wad.h"
 
 #include "r_local.h"
+#include "r_bmaps.h" // [AP] nobrightmap
 
 // Needs access to LFB (guess what).
 #include "v_video.h"
@@ -80,16 +83,16 @@ static pixel_t *background_buffer = NULL;
 // R_DrawColumn
 // Source is the top of the column to scale.
 //
-lighttable_t*		dc_colormap[2]; // [crispy] brightmaps
-int			dc_x; 
-int			dc_yl; 
-int			dc_yh; 
-fixed_t			dc_iscale; 
-fixed_t			dc_texturemid;
-int			dc_texheight; // [crispy] Tutti-Frutti fix
+R_THREADLOCAL lighttable_t*		dc_colormap[2]; // [crispy] brightmaps
+R_THREADLOCAL int			dc_x; 
+R_THREADLOCAL int			dc_yl; 
+R_THREADLOCAL int			dc_yh; 
+R_THREADLOCAL fixed_t			dc_iscale; 
+R_THREADLOCAL fixed_t			dc_texturemid;
+R_THREADLOCAL int			dc_texheight; // [crispy] Tutti-Frutti fix
 
 // first pixel in a column (possibly virtual) 
-byte*			dc_source;		
+R_THREADLOCAL byte*			dc_source;		
 
 // just for profiling 
 int			dccount;
@@ -104,6 +107,86 @@ int			dccount;
 // [crispy] replace R_DrawColumn() with Lee Killough's implementation
 // found in MBF to fix Tutti-Frutti, taken from mbfsrc/R_DRAW.C:99-1979
 
+// [AP] The inner loops are generated once per texture height class
+// (power of two or not) and colormap kind (brightmapped or plain), so no
+// choice is made inside them. R_DrawColumn and R_DrawColumnLow pick one
+// from columndrawers / columndrawerslow for each column. Paletted and
+// CRISPY_TRUECOLOR builds get their own copies through pixel_t.
+
+#define COLUMN_PIXEL_BRIGHT(source) dc_colormap[dc_brightmap[source]][source]
+#define COLUMN_PIXEL_PLAIN(source)  dc_colormap[0][source]
+
+// heightmask is the Tutti-Frutti fix -- killough
+#define COLUMN_LOOP_POW2(PIXEL, WRITE) \
+    do \
+    { \
+	/* Re-map color indices from wall texture column */ \
+	/*  using a lighting/special effects LUT. */ \
+	const byte source = dc_source[(frac>>FRACBITS)&heightmask]; \
+	WRITE(PIXEL(source)); \
+	frac += fracstep; \
+    } while (count--)
+
+#define COLUMN_LOOP_NPOW2(PIXEL, WRITE) \
+    heightmask++; \
+    heightmask <<= FRACBITS; \
+    \
+    if (frac < 0) \
+	while ((frac += heightmask) < 0); \
+    else \
+	while (frac >= heightmask) \
+	    frac -= heightmask; \
+    \
+    do \
+    { \
+	const byte source = dc_source[frac>>FRACBITS]; \
+	WRITE(PIXEL(source)); \
+	if ((frac += fracstep) >= heightmask) \
+	    frac -= heightmask; \
+    } while (count--)
+
+#define COLUMN_WRITE(pixel) \
+    *dest = pixel; \
+    dest += SCREENWIDTH
+
+#define COLUMN_WRITE_LOW(pixel) \
+    *dest2 = *dest = pixel; \
+    dest += SCREENWIDTH; \
+    dest2 += SCREENWIDTH
+
+typedef void (*columnloop_t) (pixel_t *dest, fixed_t frac, fixed_t fracstep,
+                              int heightmask, int count);
+typedef void (*columnlooplow_t) (pixel_t *dest, pixel_t *dest2, fixed_t frac,
+                                 fixed_t fracstep, int heightmask, int count);
+
+#define COLUMN_DRAWERS(name, LOOP, PIXEL) \
+static void name (pixel_t *dest, fixed_t frac, fixed_t fracstep, \
+                  int heightmask, int count) \
+{ \
+    LOOP(PIXEL, COLUMN_WRITE); \
+} \
+static void name##Low (pixel_t *dest, pixel_t *dest2, fixed_t frac, \
+                       fixed_t fracstep, int heightmask, int count) \
+{ \
+    LOOP(PIXEL, COLUMN_WRITE_LOW); \
+}
+
+COLUMN_DRAWERS(R_ColumnPow2Bright, COLUMN_LOOP_POW2, COLUMN_PIXEL_BRIGHT)
+COLUMN_DRAWERS(R_ColumnPow2Plain, COLUMN_LOOP_POW2, COLUMN_PIXEL_PLAIN)
+COLUMN_DRAWERS(R_ColumnNPow2Bright, COLUMN_LOOP_NPOW2, COLUMN_PIXEL_BRIGHT)
+COLUMN_DRAWERS(R_ColumnNPow2Plain, COLUMN_LOOP_NPOW2, COLUMN_PIXEL_PLAIN)
+
+// Indexed by [not a power of 2][brightmapped]
+static const columnloop_t columndrawers[2][2] = {
+    {R_ColumnPow2Plain, R_ColumnPow2Bright},
+    {R_ColumnNPow2Plain, R_ColumnNPow2Bright},
+};
+
+static const columnlooplow_t columndrawerslow[2][2] = {
+    {R_ColumnPow2PlainLow, R_ColumnPow2BrightLow},
+    {R_ColumnNPow2PlainLow, R_ColumnNPow2BrightLow},
+};
+
 void R_DrawColumn (void) 
 { 
     int			count; 
@@ -138,49 +221,12 @@ void R_DrawColumn (void)
     // Inner loop that does the actual texture mapping,
     //  e.g. a DDA-lile scaling.
     // This is as fast as it gets.
-
-  // heightmask is the Tutti-Frutti fix -- killough
-  if (dc_texheight & heightmask) // not a power of 2 -- killough
-  {
-    heightmask++;
-    heightmask <<= FRACBITS;
-
-    if (frac < 0)
-	while ((frac += heightmask) < 0);
-    else
-	while (frac >= heightmask)
-	    frac -= heightmask;
-
-    do
-    {
-	// [crispy] brightmaps
-	const byte source = dc_source[frac>>FRACBITS];
-	*dest = dc_colormap[dc_brightmap[source]][source];
-
-	dest += SCREENWIDTH;
-	if ((frac += fracstep) >= heightmask)
-	    frac -= heightmask;
-    } while (count--);
-  }
-  else // texture height is a power of 2 -- killough
-  {
-    do 
-    {
-	// Re-map color indices from wall texture column
-	//  using a lighting/special effects LUT.
-	// [crispy] brightmaps
-	const byte source = dc_source[(frac>>FRACBITS)&heightmask];
-	*dest = dc_colormap[dc_brightmap[source]][source];
-	
-	dest += SCREENWIDTH; 
-	frac += fracstep;
-	
-    } while (count--); 
-  }
+    // [crispy] brightmaps
+    columndrawers[(dc_texheight & heightmask) != 0][dc_brightmap != nobrightmap]
+	(dest, frac, fracstep, heightmask, count);
 } 
 
 
-
 // UNUSED.
 // Loop unrolled.
 #if 0
@@ -275,46 +321,9 @@ void R_DrawColumnLow (void)
     fracstep = dc_iscale; 
     frac = dc_texturemid + (dc_yl-centery)*fracstep;
     
-  // heightmask is the Tutti-Frutti fix -- killough
-  if (dc_texheight & heightmask) // not a power of 2 -- killough
-  {
-    heightmask++;
-    heightmask <<= FRACBITS;
-
-    if (frac < 0)
-	while ((frac += heightmask) < 0);
-    else
-	while (frac >= heightmask)
-	    frac -= heightmask;
-
-    do
-    {
-	// [crispy] brightmaps
-	const byte source = dc_source[frac>>FRACBITS];
-	*dest2 = *dest = dc_colormap[dc_brightmap[source]][source];
-
-	dest += SCREENWIDTH;
-	dest2 += SCREENWIDTH;
-
-	if ((frac += fracstep) >= heightmask)
-	    frac -= heightmask;
-    } while (count--);
-  }
-  else // texture height is a power of 2 -- killough
-  {
-    do 
-    {
-	// Hack. Does not work corretly.
-	// [crispy] brightmaps
-	const byte source = dc_source[(frac>>FRACBITS)&heightmask];
-	*dest2 = *dest = dc_colormap[dc_brightmap[source]][source];
-	dest += SCREENWIDTH;
-	dest2 += SCREENWIDTH;
-
-	frac += fracstep; 
-
-    } while (count--);
-  }
+    // [crispy] brightmaps
+    columndrawerslow[(dc_texheight & heightmask) != 0][dc_brightmap != nobrightmap]
+	(dest, dest2, frac, fracstep, heightmask, count);
 }
 
 
@@ -336,7 +345,12 @@ int	fuzzoffset[FUZZTABLE] =
     FUZZOFF,FUZZOFF,-FUZZOFF,FUZZOFF,FUZZOFF,-FUZZOFF,FUZZOFF 
 }; 
 
-int	fuzzpos = 0; 
+R_THREADLOCAL int	fuzzpos = 0; 
+
+// [AP] fuzzoffset times SCREENWIDTH, twice over, so a run of up to
+// FUZZTABLE pixels from any fuzzpos reads it straight through. Set by
+// R_InitBuffer.
+static int	fuzzdelta[FUZZTABLE * 2];
 
 // [crispy] draw fuzz effect independent of rendering frame rate
 static int fuzzpos_tic;
@@ -354,6 +368,20 @@ void R_SetFuzzPosDraw (void)
 	fuzzpos = fuzzpos_tic;
 }
 
+// [AP] Same border adjustment and step count as R_DrawFuzzColumn and
+// R_DrawFuzzColumnLow
+void R_AdvanceFuzzPos (void)
+{
+    int yl = dc_yl ? dc_yl : 1;
+    int yh = dc_yh == viewheight-1 ? viewheight - 2 : dc_yh;
+    int count = yh - yl;
+
+    if (count < 0)
+	return;
+
+    fuzzpos = (fuzzpos + count + 1) % FUZZTABLE;
+}
+
 //
 // Framebuffer postprocessing.
 // Creates a fuzzy image by copying pixels
@@ -396,27 +424,50 @@ void R_DrawFuzzColumn (void)
     
     dest = ylookup[dc_yl] + columnofs[flipviewwidth[dc_x]];
 
-    // Looks like an attempt at dithering,
-    //  using the colormap #6 (of 0-31, a bit
-    //  brighter than average).
-    do 
+    // [AP] In runs that don't wrap around the table, with what the loop
+    // reads in locals: the compiler would otherwise reload them after
+    // every write through dest. Same pixels, in the same order, since
+    // a pixel may read the one just written above it.
     {
-	// Lookup framebuffer, and retrieve
-	//  a pixel that is either one column
-	//  left or right of the current one.
-	// Add index from colormap to index.
+	const int pitch = SCREENWIDTH;
+#ifndef CRISPY_TRUECOLOR
+	const lighttable_t *fuzzmap = colormaps + 6*256;
+#endif
+	int pos = fuzzpos;
+	int left = count + 1;
+
+	while (left > 0)
+	{
+	    const int *delta = fuzzdelta + pos;
+	    const int n = MIN(left, FUZZTABLE);
+	    int i;
+
+	    // Looks like an attempt at dithering,
+	    //  using the colormap #6 (of 0-31, a bit
+	    //  brighter than average).
+	    for (i = 0; i < n; i++)
+	    {
+		// Lookup framebuffer, and retrieve
+		//  a pixel that is either one column
+		//  left or right of the current one.
+		// Add index from colormap to index.
 #ifndef CRISPY_TRUECOLOR
-	*dest = colormaps[6*256+dest[SCREENWIDTH*fuzzoffset[fuzzpos]]]; 
+		*dest = fuzzmap[dest[delta[i]]];
 #else
-	*dest = I_BlendDark(dest[SCREENWIDTH*fuzzoffset[fuzzpos]], 0xD3);
+		*dest = V_BlendDark(dest[delta[i]], 0xD3);
 #endif
+		dest += pitch;
+	    }
+
+	    // Clamp table lookup index.
+	    pos += n;
+	    if (pos >= FUZZTABLE)
+		pos -= FUZZTABLE;
+	    left -= n;
+	}
 
-	// Clamp table lookup index.
-	if (++fuzzpos == FUZZTABLE) 
-	    fuzzpos = 0;
-	
-	dest += SCREENWIDTH;
-    } while (count--); 
+	fuzzpos = pos;
+    }
 
     // [crispy] if the line at the bottom had to be cut off,
     // draw one extra line using only pixels of that line and the one above
@@ -425,7 +476,7 @@ void R_DrawFuzzColumn (void)
 #ifndef CRISPY_TRUECOLOR
 	*dest = colormaps[6*256+dest[SCREENWIDTH*(fuzzoffset[fuzzpos]-FUZZOFF)/2]];
 #else
-	*dest = I_BlendDark(dest[SCREENWIDTH*(fuzzoffset[fuzzpos]-FUZZOFF)/2], 0xD3);
+	*dest = V_BlendDark(dest[SCREENWIDTH*(fuzzoffset[fuzzpos]-FUZZOFF)/2], 0xD3);
 #endif
     }
 } 
@@ -473,30 +524,50 @@ void R_DrawFuzzColumnLow (void)
     dest = ylookup[dc_yl] + columnofs[flipviewwidth[x]];
     dest2 = ylookup[dc_yl] + columnofs[flipviewwidth[x+1]];
 
-    // Looks like an attempt at dithering,
-    //  using the colormap #6 (of 0-31, a bit
-    //  brighter than average).
-    do 
+    // [AP] In runs, as in R_DrawFuzzColumn
     {
-	// Lookup framebuffer, and retrieve
-	//  a pixel that is either one column
-	//  left or right of the current one.
-	// Add index from colormap to index.
+	const int pitch = SCREENWIDTH;
 #ifndef CRISPY_TRUECOLOR
-	*dest = colormaps[6*256+dest[SCREENWIDTH*fuzzoffset[fuzzpos]]];
-	*dest2 = colormaps[6*256+dest2[SCREENWIDTH*fuzzoffset[fuzzpos]]];
+	const lighttable_t *fuzzmap = colormaps + 6*256;
+#endif
+	int pos = fuzzpos;
+	int left = count + 1;
+
+	while (left > 0)
+	{
+	    const int *delta = fuzzdelta + pos;
+	    const int n = MIN(left, FUZZTABLE);
+	    int i;
+
+	    // Looks like an attempt at dithering,
+	    //  using the colormap #6 (of 0-31, a bit
+	    //  brighter than average).
+	    for (i = 0; i < n; i++)
+	    {
+		// Lookup framebuffer, and retrieve
+		//  a pixel that is either one column
+		//  left or right of the current one.
+		// Add index from colormap to index.
+#ifndef CRISPY_TRUECOLOR
+		*dest = fuzzmap[dest[delta[i]]];
+		*dest2 = fuzzmap[dest2[delta[i]]];
 #else
-	*dest = I_BlendDark(dest[SCREENWIDTH*fuzzoffset[fuzzpos]], 0xD3);
-	*dest2 = I_BlendDark(dest2[SCREENWIDTH*fuzzoffset[fuzzpos]], 0xD3);
+		*dest = V_BlendDark(dest[delta[i]], 0xD3);
+		*dest2 = V_BlendDark(dest2[delta[i]], 0xD3);
 #endif
+		dest += pitch;
+		dest2 += pitch;
+	    }
+
+	    // Clamp table lookup index.
+	    pos += n;
+	    if (pos >= FUZZTABLE)
+		pos -= FUZZTABLE;
+	    left -= n;
+	}
 
-	// Clamp table lookup index.
-	if (++fuzzpos == FUZZTABLE) 
-	    fuzzpos = 0;
-	
-	dest += SCREENWIDTH;
-	dest2 += SCREENWIDTH;
-    } while (count--); 
+	fuzzpos = pos;
+    }
 
     // [crispy] if the line at the bottom had to be cut off,
     // draw one extra line using only pixels of that line and the one above
@@ -506,8 +577,8 @@ void R_DrawFuzzColumnLow (void)
 	*dest = colormaps[6*256+dest[SCREENWIDTH*(fuzzoffset[fuzzpos]-FUZZOFF)/2]];
 	*dest2 = colormaps[6*256+dest2[SCREENWIDTH*(fuzzoffset[fuzzpos]-FUZZOFF)/2]];
 #else
-	*dest = I_BlendDark(dest[SCREENWIDTH*(fuzzoffset[fuzzpos]-FUZZOFF)/2], 0xD3);
-	*dest2 = I_BlendDark(dest2[SCREENWIDTH*(fuzzoffset[fuzzpos]-FUZZOFF)/2], 0xD3);
+	*dest = V_BlendDark(dest[SCREENWIDTH*(fuzzoffset[fuzzpos]-FUZZOFF)/2], 0xD3);
+	*dest2 = V_BlendDark(dest2[SCREENWIDTH*(fuzzoffset[fuzzpos]-FUZZOFF)/2], 0xD3);
 #endif
     }
 } 
@@ -525,7 +596,7 @@ void R_DrawFuzzColumnLow (void)
 //  of the BaronOfHell, the HellKnight, uses
 //  identical sprites, kinda brightened up.
 //
-byte*	dc_translation;
+R_THREADLOCAL byte*	dc_translation;
 byte*	translationtables;
 
 void R_DrawTranslatedColumn (void) 
@@ -657,7 +728,7 @@ void R_DrawTLColumn (void)
         *dest = tranmap[(*dest<<8)+dc_colormap[0][dc_source[frac>>FRACBITS]]];
 #else
         const pixel_t destrgb = dc_colormap[0][dc_source[frac>>FRACBITS]];
-        *dest = blendfunc(*dest, destrgb);
+        *dest = V_BlendOver(*dest, destrgb);
 #endif
 	dest += SCREENWIDTH;
 
@@ -704,15 +775,97 @@ void R_DrawTLColumnLow (void)
 	*dest2 = tranmap[(*dest2<<8)+dc_colormap[0][dc_source[frac>>FRACBITS]]];
 #else
 	const pixel_t destrgb = dc_colormap[0][dc_source[frac>>FRACBITS]];
-	*dest = blendfunc(*dest, destrgb);
-	*dest2 = blendfunc(*dest2, destrgb);
+	*dest = V_BlendOver(*dest, destrgb);
+	*dest2 = V_BlendOver(*dest2, destrgb);
+#endif
+	dest += SCREENWIDTH;
+	dest2 += SCREENWIDTH;
+
+	frac += fracstep;
+    } while (count--);
+}
+
+#ifdef CRISPY_TRUECOLOR
+// [AP] additive versions of the above, for bright translucent sprites,
+// so the blend is fixed per drawer instead of called through a pointer
+void R_DrawTLAddColumn (void)
+{
+    int			count;
+    pixel_t*		dest;
+    fixed_t		frac;
+    fixed_t		fracstep;
+
+    count = dc_yh - dc_yl;
+    if (count < 0)
+	return;
+
+#ifdef RANGECHECK
+    if ((unsigned)dc_x >= SCREENWIDTH
+	|| dc_yl < 0
+	|| dc_yh >= SCREENHEIGHT)
+    {
+	I_Error ( "R_DrawColumn: %i to %i at %i",
+		  dc_yl, dc_yh, dc_x);
+    }
+#endif
+
+    dest = ylookup[dc_yl] + columnofs[flipviewwidth[dc_x]];
+
+    fracstep = dc_iscale;
+    frac = dc_texturemid + (dc_yl-centery)*fracstep;
+
+    do
+    {
+	*dest = V_BlendAdd(*dest, dc_colormap[0][dc_source[frac>>FRACBITS]]);
+	dest += SCREENWIDTH;
+
+	frac += fracstep;
+    } while (count--);
+}
+
+void R_DrawTLAddColumnLow (void)
+{
+    int			count;
+    pixel_t*		dest;
+    pixel_t*		dest2;
+    fixed_t		frac;
+    fixed_t		fracstep;
+    int                 x;
+
+    count = dc_yh - dc_yl;
+    if (count < 0)
+	return;
+
+    x = dc_x << 1;
+
+#ifdef RANGECHECK
+    if ((unsigned)x >= SCREENWIDTH
+	|| dc_yl < 0
+	|| dc_yh >= SCREENHEIGHT)
+    {
+	I_Error ( "R_DrawColumn: %i to %i at %i",
+		  dc_yl, dc_yh, x);
+    }
 #endif
+
+    dest = ylookup[dc_yl] + columnofs[flipviewwidth[x]];
+    dest2 = ylookup[dc_yl] + columnofs[flipviewwidth[x+1]];
+
+    fracstep = dc_iscale;
+    frac = dc_texturemid + (dc_yl-centery)*fracstep;
+
+    do
+    {
+	const pixel_t destrgb = dc_colormap[0][dc_source[frac>>FRACBITS]];
+	*dest = V_BlendAdd(*dest, destrgb);
+	*dest2 = V_BlendAdd(*dest2, destrgb);
 	dest += SCREENWIDTH;
 	dest2 += SCREENWIDTH;
 
 	frac += fracstep;
     } while (count--);
 }
+#endif
 
 //
 // R_InitTranslationTables
@@ -761,20 +914,20 @@ void R_InitTranslationTables (void)
 // In consequence, flats are not stored by column (like walls),
 //  and the inner loop has to step in texture space u and v.
 //
-int			ds_y; 
-int			ds_x1; 
-int			ds_x2;
+R_THREADLOCAL int			ds_y; 
+R_THREADLOCAL int			ds_x1; 
+R_THREADLOCAL int			ds_x2;
 
-lighttable_t*		ds_colormap[2];
-const byte*			ds_brightmap;
+R_THREADLOCAL lighttable_t*		ds_colormap[2];
+R_THREADLOCAL const byte*			ds_brightmap;
 
-fixed_t			ds_xfrac; 
-fixed_t			ds_yfrac; 
-fixed_t			ds_xstep; 
-fixed_t			ds_ystep;
+R_THREADLOCAL fixed_t			ds_xfrac; 
+R_THREADLOCAL fixed_t			ds_yfrac; 
+R_THREADLOCAL fixed_t			ds_xstep; 
+R_THREADLOCAL fixed_t			ds_ystep;
 
 // start of a 64*64 tile image 
-byte*			ds_source;	
+R_THREADLOCAL byte*			ds_source;	
 
 // just for profiling
 int			dscount;
@@ -787,8 +940,6 @@ void R_DrawSpan (void)
 //  unsigned int position, step;
     pixel_t *dest;
     int count;
-    int spot;
-    unsigned int xtemp, ytemp;
 
 #ifdef RANGECHECK
     if (ds_x2 < ds_x1
@@ -817,28 +968,32 @@ void R_DrawSpan (void)
 //  dest = ylookup[ds_y] + columnofs[ds_x1];
 
     // We do not check for zero spans here?
-    count = ds_x2 - ds_x1;
+    count = ds_x2 - ds_x1 + 1;
 
-    do
+    // [AP] Texture indices come a batch at a time from I_SpanSpots (SIMD
+    // when available); the lookups stay per pixel.
+    while (count > 0)
     {
-	byte source;
+	int spots[I_SPAN_SPOTS_BATCH];
+	int n = MIN(count, I_SPAN_SPOTS_BATCH);
+	int i;
+
 	// Calculate current texture index in u,v.
         // [crispy] fix flats getting more distorted the closer they are to the right
-        ytemp = (ds_yfrac >> 10) & 0x0fc0;
-        xtemp = (ds_xfrac >> 16) & 0x3f;
-        spot = xtemp | ytemp;
-
-	// Lookup pixel from flat texture tile,
-	//  re-index using light/colormap.
-	source = ds_source[spot];
-	dest = ylookup[ds_y] + columnofs[flipviewwidth[ds_x1++]];
-	*dest = ds_colormap[ds_brightmap[source]][source];
-
-//      position += step;
-        ds_xfrac += ds_xstep;
-        ds_yfrac += ds_ystep;
+	I_SpanSpots(spots, ds_xfrac, ds_yfrac, ds_xstep, ds_ystep, n);
 
-    } while (count--);
+	for (i = 0; i < n; i++)
+	{
+	    // Lookup pixel from flat texture tile,
+	    //  re-index using light/colormap.
+	    const byte source = ds_source[spots[i]];
+	    dest = ylookup[ds_y] + columnofs[flipviewwidth[ds_x1++]];
+	    *dest = ds_colormap[ds_brightmap[source]][source];
+	}
+	ds_xfrac = (fixed_t) ((unsigned int) ds_xfrac + n * (unsigned int) ds_xstep);
+	ds_yfrac = (fixed_t) ((unsigned int) ds_yfrac + n * (unsigned int) ds_ystep);
+	count -= n;
+    }
 }
 
 
@@ -922,10 +1077,8 @@ void R_DrawSpan (void)
 void R_DrawSpanLow (void)
 {
 //  unsigned int position, step;
-    unsigned int xtemp, ytemp;
     pixel_t *dest;
     int count;
-    int spot;
 
 #ifdef RANGECHECK
     if (ds_x2 < ds_x1
@@ -946,7 +1099,7 @@ void R_DrawSpanLow (void)
          | ((ds_ystep >> 6)  & 0x0000ffff);
 */
 
-    count = (ds_x2 - ds_x1);
+    count = ds_x2 - ds_x1 + 1;
 
     // Blocky mode, need to multiply by 2.
     ds_x1 <<= 1;
@@ -954,29 +1107,30 @@ void R_DrawSpanLow (void)
 
 //  dest = ylookup[ds_y] + columnofs[ds_x1];
 
-    do
+    while (count > 0)
     {
-	byte source;
+	int spots[I_SPAN_SPOTS_BATCH];
+	int n = MIN(count, I_SPAN_SPOTS_BATCH);
+	int i;
+
 	// Calculate current texture index in u,v.
         // [crispy] fix flats getting more distorted the closer they are to the right
-        ytemp = (ds_yfrac >> 10) & 0x0fc0;
-        xtemp = (ds_xfrac >> 16) & 0x3f;
-        spot = xtemp | ytemp;
+	I_SpanSpots(spots, ds_xfrac, ds_yfrac, ds_xstep, ds_ystep, n);
 
-	// Lowres/blocky mode does it twice,
-	//  while scale is adjusted appropriately.
-	source = ds_source[spot];
-	dest = ylookup[ds_y] + columnofs[flipviewwidth[ds_x1++]];
-	*dest = ds_colormap[ds_brightmap[source]][source];
-	dest = ylookup[ds_y] + columnofs[flipviewwidth[ds_x1++]];
-	*dest = ds_colormap[ds_brightmap[source]][source];
-
-//	position += step;
-	ds_xfrac += ds_xstep;
-	ds_yfrac += ds_ystep;
-
-
-    } while (count--);
+	for (i = 0; i < n; i++)
+	{
+	    // Lowres/blocky mode does it twice,
+	    //  while scale is adjusted appropriately.
+	    const byte source = ds_source[spots[i]];
+	    dest = ylookup[ds_y] + columnofs[flipviewwidth[ds_x1++]];
+	    *dest = ds_colormap[ds_brightmap[source]][source];
+	    dest = ylookup[ds_y] + columnofs[flipviewwidth[ds_x1++]];
+	    *dest = ds_colormap[ds_brightmap[source]][source];
+	}
+	ds_xfrac = (fixed_t) ((unsigned int) ds_xfrac + n * (unsigned int) ds_xstep);
+	ds_yfrac = (fixed_t) ((unsigned int) ds_yfrac + n * (unsigned int) ds_ystep);
+	count -= n;
+    }
 }
 
 void R_DrawSpanSolid (void)
@@ -1069,7 +1223,84 @@ R_InitBuffer
     // Preclaculate all row offsets.
     for (i=0 ; i<height ; i++) 
 	ylookup[i] = I_VideoBuffer + (i+viewwindowy)*SCREENWIDTH; 
+
+    // [AP] And the fuzz drawers' row steps
+    for (i=0 ; i<FUZZTABLE*2 ; i++)
+	fuzzdelta[i] = SCREENWIDTH*fuzzoffset[i % FUZZTABLE];
 } 
+
+
+// [AP] For each column of the window, which rendered one it shows. The
+// rendered ones are at the left, or the right with flipped levels, so
+// the stretch walks away from them and never reads a column it wrote.
+#define UPSCALE_MAXBANDS 16
+
+typedef struct
+{
+    int y1, y2;
+} upscaleband_t;
+
+static int upscalex[MAXWIDTH];
+static int upscalewidth, upscalerendered;
+
+void R_InitUpscale (int width, int rendered)
+{
+    int x;
+
+    upscalewidth = width;
+    upscalerendered = rendered;
+
+    for (x = 0; x < width; x++)
+    {
+	if (crispy->fliplevels)
+	    upscalex[width - 1 - x] = width - 1 - x * rendered / width;
+	else
+	    upscalex[x] = x * rendered / width;
+    }
+}
+
+static void R_UpscaleRows (void *data, int worker)
+{
+    const upscaleband_t *band = data;
+    int x, y;
+
+    for (y = band->y1; y < band->y2; y++)
+    {
+	pixel_t *row = ylookup[y] + viewwindowx;
+
+	if (crispy->fliplevels)
+	{
+	    for (x = 0; x < upscalewidth; x++)
+		row[x] = row[upscalex[x]];
+	}
+	else
+	{
+	    for (x = upscalewidth - 1; x >= 0; x--)
+		row[x] = row[upscalex[x]];
+	}
+    }
+}
+
+void R_UpscaleView (void)
+{
+    upscaleband_t bands[UPSCALE_MAXBANDS];
+    jobgroup_t *group;
+    int numbands, i;
+
+    if (upscalerendered == upscalewidth)
+	return;
+
+    numbands = BETWEEN(1, UPSCALE_MAXBANDS, I_JobThreads());
+
+    group = I_JobGroup();
+    for (i = 0; i < numbands; i++)
+    {
+	bands[i].y1 = viewheight * i / numbands;
+	bands[i].y2 = viewheight * (i + 1) / numbands;
+	I_AddJob(group, R_UpscaleRows, &bands[i]);
+    }
+    I_FreeJobGroup(group);
+}
  
  
 
@@ -21,19 +21,26 @@
 #define __R_DRAW__
 
 
+// [AP] The drawer parameters are per thread, so that r_threads.c can
+// replay recorded columns and spans on several threads at once.
+#if defined(_MSC_VER)
+#define R_THREADLOCAL __declspec(thread)
+#else
+#define R_THREADLOCAL __thread
+#endif
 
 
-extern lighttable_t*	dc_colormap[2];
-extern int		dc_x;
-extern int		dc_yl;
-extern int		dc_yh;
-extern fixed_t		dc_iscale;
-extern fixed_t		dc_texturemid;
-extern int		dc_texheight;
-extern const byte*		dc_brightmap;
+extern R_THREADLOCAL lighttable_t*	dc_colormap[2];
+extern R_THREADLOCAL int		dc_x;
+extern R_THREADLOCAL int		dc_yl;
+extern R_THREADLOCAL int		dc_yh;
+extern R_THREADLOCAL fixed_t		dc_iscale;
+extern R_THREADLOCAL fixed_t		dc_texturemid;
+extern R_THREADLOCAL int		dc_texheight;
+extern R_THREADLOCAL const byte*		dc_brightmap;
 
 // first pixel in a column
-extern byte*		dc_source;		
+extern R_THREADLOCAL byte*		dc_source;		
 
 
 // The span blitting interface.
@@ -50,6 +57,11 @@ void 	R_DrawFuzzColumnLow (void);
 void R_SetFuzzPosTic (void);
 void R_SetFuzzPosDraw (void);
 
+// [AP] Moves fuzzpos past the column the fuzz drawers would draw with
+// the current dc_ parameters, without drawing it.
+void R_AdvanceFuzzPos (void);
+extern R_THREADLOCAL int fuzzpos;
+
 // Draw with color translation tables,
 //  for player sprite rendering,
 //  Green/Red/Blue/Indigo shirts.
@@ -58,29 +70,33 @@ void	R_DrawTranslatedColumnLow (void);
 
 void	R_DrawTLColumn (void);
 void	R_DrawTLColumnLow (void);
+#ifdef CRISPY_TRUECOLOR
+void	R_DrawTLAddColumn (void);
+void	R_DrawTLAddColumnLow (void);
+#endif
 
 void
 R_VideoErase
 ( unsigned	ofs,
   int		count );
 
-extern int		ds_y;
-extern int		ds_x1;
-extern int		ds_x2;
+extern R_THREADLOCAL int		ds_y;
+extern R_THREADLOCAL int		ds_x1;
+extern R_THREADLOCAL int		ds_x2;
 
-extern lighttable_t*	ds_colormap[2];
-extern const byte*		ds_brightmap;
+extern R_THREADLOCAL lighttable_t*	ds_colormap[2];
+extern R_THREADLOCAL const byte*		ds_brightmap;
 
-extern fixed_t		ds_xfrac;
-extern fixed_t		ds_yfrac;
-extern fixed_t		ds_xstep;
-extern fixed_t		ds_ystep;
+extern R_THREADLOCAL fixed_t		ds_xfrac;
+extern R_THREADLOCAL fixed_t		ds_yfrac;
+extern R_THREADLOCAL fixed_t		ds_xstep;
+extern R_THREADLOCAL fixed_t		ds_ystep;
 
 // start of a 64*64 tile image
-extern byte*		ds_source;		
+extern R_THREADLOCAL byte*		ds_source;		
 
 extern byte*		translationtables;
-extern byte*		dc_translation;
+extern R_THREADLOCAL byte*		dc_translation;
 
 
 // Span blitting for rows, floor/ceiling.
@@ -101,6 +117,11 @@ R_InitBuffer
 ( int		width,
   int		height );
 
+// [AP] -dynres renders rendered columns of a width wide window, and
+// R_UpscaleView stretches them across it once the view is drawn
+void R_InitUpscale (int width, int rendered);
+void R_UpscaleView (void);
+
 
 // Initialize color translation tables,
 //  for player rendering etc.
@@ -29,14 +29,19 @@
 #include "doomdef.h"
 #include "doomstat.h" // [AM] leveltime, paused, menuactive
 #include "d_loop.h"
+#include "g_game.h" // [AP] G_PendingMouseView()
 
+#include "m_argv.h" // [AP] -dynres
 #include "m_bbox.h"
 #include "m_menu.h"
 
+#include "i_profile.h" // [AP]
 #include "i_system.h" // [crispy] I_Realloc()
 #include "p_local.h" // [crispy] MLOOKUNIT
 #include "r_local.h"
 #include "r_sky.h"
+#include "r_threads.h" // [AP]
+#include "r_views.h" // [AP]
 #include "st_stuff.h" // [crispy] ST_refreshBackground()
 #include "a11y.h" // [crispy] A11Y
 
@@ -84,6 +89,17 @@ player_t*		viewplayer;
 
 // 0 = high, 1 = low
 int			detailshift;	
+fixed_t			detailscale = FRACUNIT; // [AP]
+fixed_t			detailiscale = FRACUNIT;
+
+// [AP] -dynres renders renderscale / DYNRES_STEPS of the view's columns,
+// never less than half
+#define DYNRES_STEPS	16
+#define DYNRES_MIN	(DYNRES_STEPS / 2)
+#define DYNRES_HOLD	16 // Frames under budget before going back up
+
+static int		dynres_fps;
+static int		renderscale = DYNRES_STEPS;
 
 //
 // precalculated math tables
@@ -124,6 +140,9 @@ void (*basecolfunc) (void);
 void (*fuzzcolfunc) (void);
 void (*transcolfunc) (void);
 void (*tlcolfunc) (void);
+#ifdef CRISPY_TRUECOLOR
+void (*tladdcolfunc) (void); // [AP]
+#endif
 void (*spanfunc) (void);
 
 
@@ -286,93 +305,58 @@ R_PointOnSegSide
 
 
 
+// [AP] The octant picks the base angle and whether the tantoangle[]
+// value is subtracted, as base + ~t is base - 1 - t. That leaves one
+// divide and no branches to mispredict, with the exact same results.
+static const angle_t octantbase[8] =
+{
+    0, ANG90, 1, ANG270, ANG180, ANG90, ANG180, ANG270
+};
+
+static const angle_t octantflip[8] =
+{
+    0, ~0u, ~0u, 0, ~0u, 0, 0, ~0u
+};
+
 // [crispy] turned into a general R_PointToAngle() flavor
-// called with either slope_div = SlopeDivCrispy() from R_PointToAngleCrispy()
-// or slope_div = SlopeDiv() else
-angle_t
+// called with either crispy = true from R_PointToAngleCrispy()
+// or crispy = false else
+static inline angle_t
 R_PointToAngleSlope
 ( fixed_t	x,
   fixed_t	y,
-  int (*slope_div) (unsigned int num, unsigned int den))
-{	
+  boolean	crispy )
+{
+    // [AP] negated the way the old code did it, INT_MIN stays INT_MIN
+    int ax, ay, octant;
+    unsigned int num, den, slope;
+    uint64_t ans;
+
     x -= viewx;
     y -= viewy;
-    
+
     if ( (!x) && (!y) )
 	return 0;
 
-    if (x>= 0)
-    {
-	// x >=0
-	if (y>= 0)
-	{
-	    // y>= 0
-
-	    if (x>y)
-	    {
-		// octant 0
-		return tantoangle[slope_div(y,x)];
-	    }
-	    else
-	    {
-		// octant 1
-		return ANG90-1-tantoangle[slope_div(x,y)];
-	    }
-	}
-	else
-	{
-	    // y<0
-	    y = -y;
-
-	    if (x>y)
-	    {
-		// octant 8
-		return -tantoangle[slope_div(y,x)];
-	    }
-	    else
-	    {
-		// octant 7
-		return ANG270+tantoangle[slope_div(x,y)];
-	    }
-	}
-    }
+    ax = x < 0 ? (int) (0u - (unsigned int) x) : x;
+    ay = y < 0 ? (int) (0u - (unsigned int) y) : y;
+    octant = ((x < 0) << 2) | ((y < 0) << 1) | (ax <= ay);
+
+    // slope of y over x in the octants closer to the x axis
+    num = ax > ay ? ay : ax;
+    den = ax > ay ? ax : ay;
+
+    // SlopeDiv() or SlopeDivCrispy()
+    if (den < 512)
+	slope = SLOPERANGE;
     else
     {
-	// x<0
-	x = -x;
-
-	if (y>= 0)
-	{
-	    // y>= 0
-	    if (x>y)
-	    {
-		// octant 3
-		return ANG180-1-tantoangle[slope_div(y,x)];
-	    }
-	    else
-	    {
-		// octant 2
-		return ANG90+ tantoangle[slope_div(x,y)];
-	    }
-	}
-	else
-	{
-	    // y<0
-	    y = -y;
-
-	    if (x>y)
-	    {
-		// octant 4
-		return ANG180+tantoangle[slope_div(y,x)];
-	    }
-	    else
-	    {
-		 // octant 5
-		return ANG270-1-tantoangle[slope_div(x,y)];
-	    }
-	}
+	ans = crispy ? ((uint64_t) num << 3) / (den >> 8)
+	             : (uint64_t) ((num << 3) / (den >> 8));
+	slope = ans < SLOPERANGE ? (unsigned int) ans : SLOPERANGE;
     }
-    return 0;
+
+    return octantbase[octant] + (tantoangle[slope] ^ octantflip[octant]);
 }
 
 angle_t
@@ -380,13 +364,13 @@ R_PointToAngle
 ( fixed_t	x,
   fixed_t	y )
 {
-    return R_PointToAngleSlope (x, y, SlopeDiv);
+    return R_PointToAngleSlope (x, y, false);
 }
 
 // [crispy] overflow-safe R_PointToAngle() flavor
 // called only from R_CheckBBox(), R_AddLine() and P_SegLengths()
-angle_t
-R_PointToAngleCrispy
+static inline angle_t
+PointToAngleCrispy
 ( fixed_t	x,
   fixed_t	y )
 {
@@ -403,7 +387,30 @@ R_PointToAngleCrispy
 	y = y_viewy / 2 + viewy;
     }
 
-    return R_PointToAngleSlope (x, y, SlopeDivCrispy);
+    return R_PointToAngleSlope (x, y, true);
+}
+
+angle_t
+R_PointToAngleCrispy
+( fixed_t	x,
+  fixed_t	y )
+{
+    return PointToAngleCrispy (x, y);
+}
+
+// [AP] both ends of a seg or a bbox edge at once, the two divides
+// don't depend on each other and can overlap
+void
+R_PointsToAnglesCrispy
+( fixed_t	x1,
+  fixed_t	y1,
+  fixed_t	x2,
+  fixed_t	y2,
+  angle_t*	angle1,
+  angle_t*	angle2 )
+{
+    *angle1 = PointToAngleCrispy (x1, y1);
+    *angle2 = PointToAngleCrispy (x2, y2);
 }
 
 angle_t
@@ -417,7 +424,7 @@ R_PointToAngle2
     viewy = y1;
     
     // [crispy] R_PointToAngle2() is never called during rendering
-    return R_PointToAngleSlope (x2, y2, SlopeDiv);
+    return R_PointToAngleSlope (x2, y2, false);
 }
 
 
@@ -531,7 +538,7 @@ fixed_t R_ScaleFromGlobalAngle (angle_t visangle)
     // both sines are allways positive
     sinea = finesine[anglea>>ANGLETOFINESHIFT];	
     sineb = finesine[angleb>>ANGLETOFINESHIFT];
-    num = FixedMul(projection,sineb)<<detailshift;
+    num = FixedMul(FixedMul(projection,sineb), detailscale);
     den = FixedMul(rw_distance,sinea);
 
     if (den > num>>FRACBITS)
@@ -738,7 +745,7 @@ void R_InitLightTables (void)
 	LIGHTZSHIFT = 20;
     }
 
-    scalelight = malloc(LIGHTLEVELS * sizeof(*scalelight));
+    scalelight = calloc(LIGHTLEVELS, sizeof(*scalelight));
     scalelightfixed = malloc(MAXLIGHTSCALE * sizeof(*scalelightfixed));
     zlight = malloc(LIGHTLEVELS * sizeof(*zlight));
 
@@ -844,6 +851,15 @@ void R_ExecuteSetViewSize (void)
     detailshift = setdetail;
     viewwidth = scaledviewwidth>>detailshift;
     viewwidth_nonwide = scaledviewwidth_nonwide>>detailshift;
+
+    // [AP] -dynres only narrows high detail, low detail already halves it
+    if (dynres_fps && !detailshift)
+    {
+	viewwidth = scaledviewwidth * renderscale / DYNRES_STEPS;
+	viewwidth_nonwide = scaledviewwidth_nonwide * renderscale / DYNRES_STEPS;
+    }
+    detailscale = FixedDiv(scaledviewwidth_nonwide, viewwidth_nonwide);
+    detailiscale = FixedDiv(viewwidth_nonwide, scaledviewwidth_nonwide);
 	
     centery = viewheight/2;
     centerx = viewwidth/2;
@@ -858,6 +874,9 @@ void R_ExecuteSetViewSize (void)
 	fuzzcolfunc = R_DrawFuzzColumn;
 	transcolfunc = R_DrawTranslatedColumn;
 	tlcolfunc = R_DrawTLColumn;
+#ifdef CRISPY_TRUECOLOR
+	tladdcolfunc = R_DrawTLAddColumn;
+#endif
 	spanfunc = goobers_mode ? R_DrawSpanSolid : R_DrawSpan;
     }
     else
@@ -866,10 +885,15 @@ void R_ExecuteSetViewSize (void)
 	fuzzcolfunc = R_DrawFuzzColumnLow;
 	transcolfunc = R_DrawTranslatedColumnLow;
 	tlcolfunc = R_DrawTLColumnLow;
+#ifdef CRISPY_TRUECOLOR
+	tladdcolfunc = R_DrawTLAddColumnLow;
+#endif
 	spanfunc = goobers_mode ? R_DrawSpanSolidLow : R_DrawSpanLow;
     }
+    R_HookDrawThreads(); // [AP]
 
     R_InitBuffer (scaledviewwidth, viewheight);
+    R_InitUpscale (scaledviewwidth, detailshift ? scaledviewwidth : viewwidth); // [AP]
 	
     R_InitTextureMapping ();
     
@@ -886,7 +910,7 @@ void R_ExecuteSetViewSize (void)
     {
 	// [crispy] re-generate lookup-table for yslope[] (free look)
 	// whenever "detailshift" or "screenblocks" change
-	const fixed_t num = (viewwidth_nonwide<<detailshift)/2*FRACUNIT;
+	const fixed_t num = FixedMul(projection, detailscale);
 	for (j = 0; j < LOOKDIRS; j++)
 	{
 	dy = ((i-(viewheight/2 + ((j-LOOKDIRMIN) * (1 << crispy->hires)) * (screenblocks < 11 ? screenblocks : 11) / 10))<<FRACBITS)+FRACUNIT/2;
@@ -906,12 +930,14 @@ void R_ExecuteSetViewSize (void)
     //  for each level / scale combination.
     for (i=0 ; i< LIGHTLEVELS ; i++)
     {
-	scalelight[i] = malloc(MAXLIGHTSCALE * sizeof(**scalelight));
+	// [AP] Once, -dynres gets here often
+	if (!scalelight[i])
+	    scalelight[i] = malloc(MAXLIGHTSCALE * sizeof(**scalelight));
 
 	startmap = ((LIGHTLEVELS-LIGHTBRIGHT-i)*2)*NUMCOLORMAPS/LIGHTLEVELS;
 	for (j=0 ; j<MAXLIGHTSCALE ; j++)
 	{
-	    level = startmap - j*NONWIDEWIDTH/(viewwidth_nonwide<<detailshift)/DISTMAP;
+	    level = startmap - j*NONWIDEWIDTH/scaledviewwidth_nonwide/DISTMAP;
 	    
 	    if (level < 0)
 		level = 0;
@@ -964,6 +990,8 @@ void R_Init (void)
     R_InitTables ();
     // viewwidth / viewheight / detailLevel are set by the defaults
     printf (".");
+    R_InitDrawThreads (); // [AP]
+    R_InitViewRecording (); // [AP]
 
     R_SetViewSize (screenblocks, detailLevel);
     R_InitPlanes ();
@@ -972,6 +1000,7 @@ void R_Init (void)
     printf (".");
     R_InitSkyMap ();
     R_InitTranslationTables ();
+    R_InitOcclusion (); // [AP]
     printf (".");
 	
     framecount = 0;
@@ -1050,6 +1079,28 @@ void R_SetupFrame (player_t* player)
         pitch = player->lookdir / MLOOKUNIT + player->recoilpitch;
     }
 
+    // [AP] Show the mouse movement the next ticcmd will carry now. The
+    // angle isn't interpolated then, or the turn already shown would be
+    // played back again over the next tic.
+    {
+        angle_t turn;
+        int look;
+
+        if (G_PendingMouseView(player, &turn, &look))
+        {
+            viewangle = player->mo->angle + turn + viewangleoffset;
+            pitch = BETWEEN(-LOOKDIRMIN * MLOOKUNIT, LOOKDIRMAX * MLOOKUNIT,
+                            player->lookdir + look) / MLOOKUNIT
+                  + player->recoilpitch;
+        }
+    }
+
+    // [AP] -renderbench replays views that -recordviews wrote down
+    if (!R_OverrideView(&viewx, &viewy, &viewz, &viewangle, &pitch))
+    {
+        R_RecordView(viewx, viewy, viewz, viewangle, pitch);
+    }
+
     // [crispy] A11Y
     if (a11y_weapon_flash)
     {
@@ -1103,10 +1154,92 @@ void R_SetupFrame (player_t* player)
 //
 // R_RenderView
 //
+// [AP] Render time goes about with the number of columns, so the last
+// frame's tells how many fit in what's left of the budget. Drops right
+// away, goes back up one step at a time once there's room for it.
+void R_InitDynamicResolution (void)
+{
+    int p;
+
+    //!
+    // @arg <fps>
+    // @category video
+    //
+    // Lower the number of columns the view is rendered with, down to
+    // half, when frames take longer than this rate allows. The view is
+    // stretched back to the window's width. Uses high detail.
+    //
+
+    p = M_CheckParmWithArgs("-dynres", 1);
+    if (p > 0)
+    {
+	dynres_fps = atoi(myargv[p + 1]);
+	if (dynres_fps > 0)
+	    profiling = true;
+	else
+	    dynres_fps = 0;
+    }
+}
+
+static void R_UpdateDynamicResolution (void)
+{
+    static int underbudget;
+    unsigned int phase_us[NUMPROFILEPHASES];
+    unsigned int render_us, other_us, budget_us;
+    int scale, i;
+
+    if (!dynres_fps || detailshift)
+	return;
+
+    I_ProfileLastFrame(phase_us);
+    render_us = phase_us[PROFILE_BSP] + phase_us[PROFILE_PLANES]
+              + phase_us[PROFILE_MASKED];
+    if (render_us == 0)
+	return;
+
+    // Presenting waits for vsync, it's not work that lowering helps with
+    other_us = 0;
+    for (i = 0; i < NUMPROFILEPHASES; i++)
+    {
+	if (i != PROFILE_BSP && i != PROFILE_PLANES && i != PROFILE_MASKED
+	    && i != PROFILE_FINISHUPDATE)
+	    other_us += phase_us[i];
+    }
+    budget_us = 1000000 / dynres_fps;
+    budget_us = budget_us > other_us ? budget_us - other_us : 0;
+
+    scale = renderscale;
+    if (render_us > budget_us)
+    {
+	scale = (int) ((uint64_t) renderscale * budget_us / render_us);
+	underbudget = 0;
+    }
+    // Room for a step up with a tenth to spare
+    else if ((uint64_t) render_us * (renderscale + 1) * 10
+             < (uint64_t) budget_us * renderscale * 9)
+    {
+	if (++underbudget >= DYNRES_HOLD)
+	{
+	    scale = renderscale + 1;
+	    underbudget = 0;
+	}
+    }
+    else
+	underbudget = 0;
+
+    scale = BETWEEN(DYNRES_MIN, DYNRES_STEPS, scale);
+    if (scale != renderscale)
+    {
+	renderscale = scale;
+	R_ExecuteSetViewSize();
+    }
+}
+
 void R_RenderPlayerView (player_t* player)
 {	
     extern void V_DrawFilledBox (int x, int y, int w, int h, int c);
 
+    R_UpdateDynamicResolution (); // [AP]
     R_SetupFrame (player);
 
     // Clear buffers.
@@ -1116,7 +1249,9 @@ void R_RenderPlayerView (player_t* player)
     R_ClearSprites ();
     if (automapactive && !crispy->automapoverlay)
     {
+        I_ProfileBegin(PROFILE_BSP); // [AP]
         R_RenderBSPNode (numnodes-1);
+        I_ProfileEnd(PROFILE_BSP);
         return;
     }
     
@@ -1137,21 +1272,32 @@ void R_RenderPlayerView (player_t* player)
 
     // [crispy] smooth texture scrolling
     R_InterpolateTextureOffsets();
+    R_InterpolateSectors(); // [AP]
     // The head node is the last node output.
+    I_ProfileBegin(PROFILE_BSP); // [AP]
     R_RenderBSPNode (numnodes-1);
+    I_ProfileEnd(PROFILE_BSP);
     
     // Check for new console commands.
     NetUpdate ();
     
+    I_ProfileBegin(PROFILE_PLANES); // [AP]
     R_DrawPlanes ();
+    I_ProfileEnd(PROFILE_PLANES);
     
     // Check for new console commands.
     NetUpdate ();
     
     // [crispy] draw fuzz effect independent of rendering frame rate
     R_SetFuzzPosDraw();
+    I_ProfileBegin(PROFILE_MASKED); // [AP]
     R_DrawMasked ();
 
+    // [AP] Finish threaded drawing before anything reads the view back
+    R_FlushDrawThreads ();
+    R_UpscaleView (); // [AP] -dynres
+    I_ProfileEnd(PROFILE_MASKED);
+
     // Check for new console commands.
     NetUpdate ();				
 }
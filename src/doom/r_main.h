@@ -90,6 +90,16 @@ extern fixed_t          fractionaltic;
 //  0 = high, 1 = low
 extern	int		detailshift;	
 
+// [AP] What detailshift shifts by, as fixed point factors, so that
+// -dynres can render any number of columns in between. Multiplying by
+// them is exact at high and low detail.
+extern	fixed_t		detailscale;
+extern	fixed_t		detailiscale;
+
+// [AP] -dynres <fps> lowers the render width when a frame takes longer
+// than that rate allows. Call before I_InitProfile, it needs profiling.
+void R_InitDynamicResolution (void);
+
 
 //
 // Function pointers to switch refresh/drawing functions.
@@ -100,6 +110,9 @@ extern void		(*transcolfunc) (void);
 extern void		(*basecolfunc) (void);
 extern void		(*fuzzcolfunc) (void);
 extern void		(*tlcolfunc) (void);
+#ifdef CRISPY_TRUECOLOR
+extern void		(*tladdcolfunc) (void); // [AP]
+#endif
 // No shadow effects on floors.
 extern void		(*spanfunc) (void);
 
@@ -132,6 +145,15 @@ R_PointToAngleCrispy
 ( fixed_t	x,
   fixed_t	y );
 
+void
+R_PointsToAnglesCrispy
+( fixed_t	x1,
+  fixed_t	y1,
+  fixed_t	x2,
+  fixed_t	y2,
+  angle_t*	angle1,
+  angle_t*	angle2 ); // [AP]
+
 angle_t
 R_PointToAngle2
 ( fixed_t	x1,
@@ -33,6 +33,7 @@
 #include "r_sky.h"
 #include "r_bmaps.h" // [crispy] R_BrightmapForTexName()
 #include "r_swirl.h" // [crispy] R_DistortedFlat()
+#include "r_visplane.h"
 
 
 
@@ -45,11 +46,11 @@ planefunction_t		ceilingfunc;
 
 // Here comes the obnoxious "visplane".
 #define MAXVISPLANES	128
-visplane_t*		visplanes = NULL;
-visplane_t*		lastvisplane;
 visplane_t*		floorplane;
 visplane_t*		ceilingplane;
-static int		numvisplanes;
+
+// [AP] See r_visplane.h
+static visplanepool_t	visplanepool = VISPLANEPOOL(visplane_t, MAXVISPLANES);
 
 // ?
 #define MAXOPENINGS	MAXWIDTH*64*4
@@ -149,8 +150,8 @@ R_MapPlane
     {
 	cachedheight[y] = planeheight;
 	distance = cacheddistance[y] = FixedMul (planeheight, yslope[y]);
-	ds_xstep = cachedxstep[y] = (FixedMul (viewsin, planeheight) / dy) << detailshift;
-	ds_ystep = cachedystep[y] = (FixedMul (viewcos, planeheight) / dy) << detailshift;
+	ds_xstep = cachedxstep[y] = FixedMul(FixedMul (viewsin, planeheight) / dy, detailscale);
+	ds_ystep = cachedystep[y] = FixedMul(FixedMul (viewcos, planeheight) / dy, detailscale);
     }
     else
     {
@@ -202,7 +203,7 @@ void R_ClearPlanes (void)
 	ceilingclip[i] = -1;
     }
 
-    lastvisplane = visplanes;
+    R_ClearVisplanePool(&visplanepool);
     lastopening = openings;
     
     // texture calculation
@@ -218,29 +219,16 @@ void R_ClearPlanes (void)
 
 
 
-// [crispy] remove MAXVISPLANES Vanilla limit
-static void R_RaiseVisplanes (visplane_t** vp)
+static visplane_t* R_NewPlane (fixed_t height, int picnum, int lightlevel)
 {
-    if (lastvisplane - visplanes == numvisplanes)
-    {
-	int numvisplanes_old = numvisplanes;
-	visplane_t* visplanes_old = visplanes;
-
-	numvisplanes = numvisplanes ? 2 * numvisplanes : MAXVISPLANES;
-	visplanes = I_Realloc(visplanes, numvisplanes * sizeof(*visplanes));
-	memset(visplanes + numvisplanes_old, 0, (numvisplanes - numvisplanes_old) * sizeof(*visplanes));
-
-	lastvisplane = visplanes + numvisplanes_old;
-	floorplane = visplanes + (floorplane - visplanes_old);
-	ceilingplane = visplanes + (ceilingplane - visplanes_old);
+    visplane_t* pl;
 
-	if (numvisplanes_old)
-	    fprintf(stderr, "R_FindPlane: Hit MAXVISPLANES limit at %d, raised to %d.\n", numvisplanes_old, numvisplanes);
+    pl = R_NewVisplane(&visplanepool, height, picnum, lightlevel, 0);
+    pl->height = height;
+    pl->picnum = picnum;
+    pl->lightlevel = lightlevel;
 
-	// keep the pointer passed as argument in relation to the visplanes pointer
-	if (vp)
-	    *vp = visplanes + (*vp - visplanes_old);
-    }
+    return pl;
 }
 
 //
@@ -261,29 +249,12 @@ R_FindPlane
 	lightlevel = 0;
     }
 	
-    for (check=visplanes; check<lastvisplane; check++)
-    {
-	if (height == check->height
-	    && picnum == check->picnum
-	    && lightlevel == check->lightlevel)
-	{
-	    break;
-	}
-    }
-    
-			
-    if (check < lastvisplane)
+    check = R_FindVisplane(&visplanepool, height, picnum, lightlevel, 0);
+
+    if (check)
 	return check;
-		
-    R_RaiseVisplanes(&check); // [crispy] remove VISPLANES limit
-    if (lastvisplane - visplanes == MAXVISPLANES && false)
-	I_Error ("R_FindPlane: no more visplanes");
-		
-    lastvisplane++;
 
-    check->height = height;
-    check->picnum = picnum;
-    check->lightlevel = lightlevel;
+    check = R_NewPlane(height, picnum, lightlevel);
     check->minx = SCREENWIDTH;
     check->maxx = -1;
     
@@ -349,15 +320,7 @@ R_CheckPlane
   }
 	
     // make a new visplane
-    R_RaiseVisplanes(&pl); // [crispy] remove VISPLANES limit
-    lastvisplane->height = pl->height;
-    lastvisplane->picnum = pl->picnum;
-    lastvisplane->lightlevel = pl->lightlevel;
-    
-    if (lastvisplane - visplanes == MAXVISPLANES && false) // [crispy] remove VISPLANES limit
-	I_Error ("R_CheckPlane: no more visplanes");
-
-    pl = lastvisplane++;
+    pl = R_NewPlane(pl->height, pl->picnum, pl->lightlevel);
     pl->minx = start;
     pl->maxx = stop;
 
@@ -403,6 +366,73 @@ R_MakeSpans
 
 
 
+//
+// R_DrawSky
+// [AP] Every plane showing the level's sky, before the flats. The sky
+// column only depends on the screen x, so it's looked up once per frame
+// and shared by all the planes over that column. Nothing else gets
+// cached until the pass is done, the composite can't be purged under us.
+//
+static byte *skycolumns[MAXWIDTH];
+static unsigned int skycolumnframe[MAXWIDTH];
+static unsigned int skyframe;
+
+static void R_DrawSky (void)
+{
+    visplane_t*		pl;
+    boolean		setup = false;
+    int			i;
+    int			x;
+
+    skyframe++;
+
+    for (i = 0 ; i < visplanepool.count ; i++)
+    {
+	pl = R_Visplane(&visplanepool, i);
+
+	if (pl->minx > pl->maxx || pl->picnum != skyflatnum)
+	    continue;
+
+	if (!setup)
+	{
+	    // Sky is allways drawn full bright,
+	    //  i.e. colormaps[0] is used.
+	    // Because of this hack, sky is not affected
+	    //  by INVUL inverse mapping.
+	    // [crispy] no brightmaps for sky
+	    dc_colormap[0] = dc_colormap[1] = colormaps;
+	    dc_texturemid = skytexturemid;
+	    dc_texheight = textureheight[skytexture]>>FRACBITS; // [crispy] Tutti-Frutti fix
+	    dc_iscale = FixedMul(pspriteiscale, detailiscale);
+	    // [crispy] stretch sky
+	    if (crispy->stretchsky)
+	        dc_iscale = dc_iscale * dc_texheight / SKYSTRETCH_HEIGHT;
+	    setup = true;
+	}
+
+	for (x=pl->minx ; x <= pl->maxx ; x++)
+	{
+	    dc_yl = pl->top[x];
+	    dc_yh = pl->bottom[x];
+
+	    if ((unsigned) dc_yl <= dc_yh) // [crispy] 32-bit integer math
+	    {
+		if (skycolumnframe[x] != skyframe)
+		{
+		    skycolumns[x] = R_GetColumn(skytexture,
+		        (viewangle + xtoviewangle[x])>>ANGLETOSKYSHIFT);
+		    skycolumnframe[x] = skyframe;
+		}
+		dc_x = x;
+		dc_source = skycolumns[x];
+		colfunc ();
+	    }
+	}
+    }
+}
+
+
+
 //
 // R_DrawPlanes
 // At the end of each frame.
@@ -415,56 +445,47 @@ void R_DrawPlanes (void)
     int			stop;
     int			angle;
     int                 lumpnum;
+    int			i;
 				
 #ifdef RANGECHECK
     if (ds_p - drawsegs > numdrawsegs)
 	I_Error ("R_DrawPlanes: drawsegs overflow (%td)",
 		 ds_p - drawsegs);
     
-    if (lastvisplane - visplanes > numvisplanes)
-	I_Error ("R_DrawPlanes: visplane overflow (%td)",
-		 lastvisplane - visplanes);
-    
     if (lastopening - openings > MAXOPENINGS)
 	I_Error ("R_DrawPlanes: opening overflow (%td)",
 		 lastopening - openings);
 #endif
 
-    for (pl = visplanes ; pl < lastvisplane ; pl++)
+    R_DrawSky(); // [AP]
+
+    for (i = 0 ; i < visplanepool.count ; i++)
     {
 	boolean swirling;
 
-	if (pl->minx > pl->maxx)
+	pl = R_Visplane(&visplanepool, i);
+
+	if (pl->minx > pl->maxx || pl->picnum == skyflatnum)
 	    continue;
 
 	
 	// sky flat
 	// [crispy] add support for MBF sky tranfers
-	if (pl->picnum == skyflatnum || pl->picnum & PL_SKYFLAT)
+	if (pl->picnum & PL_SKYFLAT)
 	{
-	    int texture;
-	    angle_t an = viewangle, flip;
-	    if (pl->picnum & PL_SKYFLAT)
-	    {
-		const line_t *l = &lines[pl->picnum & ~PL_SKYFLAT];
-		const side_t *s = *l->sidenum + sides;
-		texture = texturetranslation[s->toptexture];
-		dc_texturemid = s->rowoffset - 28*FRACUNIT;
-		// [crispy] stretch sky
-		if (crispy->stretchsky)
-		{
-		    dc_texturemid = dc_texturemid * (textureheight[texture]>>FRACBITS) / SKYSTRETCH_HEIGHT;
-		}
-		flip = (l->special == 272) ? 0u : ~0u;
-		an += s->textureoffset;
-	    }
-	    else
+	    const line_t *l = &lines[pl->picnum & ~PL_SKYFLAT];
+	    const side_t *s = *l->sidenum + sides;
+	    int texture = texturetranslation[s->toptexture];
+	    angle_t an = viewangle + s->textureoffset;
+	    angle_t flip = (l->special == 272) ? 0u : ~0u;
+
+	    dc_texturemid = s->rowoffset - 28*FRACUNIT;
+	    // [crispy] stretch sky
+	    if (crispy->stretchsky)
 	    {
-		texture = skytexture;
-		dc_texturemid = skytexturemid;
-		flip = 0;
+		dc_texturemid = dc_texturemid * (textureheight[texture]>>FRACBITS) / SKYSTRETCH_HEIGHT;
 	    }
-	    dc_iscale = pspriteiscale>>detailshift;
+	    dc_iscale = FixedMul(pspriteiscale, detailiscale);
 	    
 	    // Sky is allways drawn full bright,
 	    //  i.e. colormaps[0] is used.
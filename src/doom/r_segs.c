@@ -44,6 +44,7 @@ boolean		markfloor;
 boolean		markceiling;
 
 boolean		maskedtexture;
+static int	maskedtexnum; // [AP]
 int		toptexture;
 int		bottomtexture;
 int		midtexture;
@@ -197,6 +198,7 @@ R_RenderMaskedSegRange
     column_t*	col;
     int		lightnum;
     int		texnum;
+    byte*	composite; // [AP]
     
     // Calculate light table.
     // Use different light tables
@@ -249,6 +251,11 @@ R_RenderMaskedSegRange
 			
     if (fixedcolormap)
 	dc_colormap[0] = dc_colormap[1] = fixedcolormap;
+    else
+	dc_brightmap = texturebrightmap[texnum]; // [crispy] brightmaps for mid-textures
+
+    // [AP] once here, the columns are offsets into it
+    composite = R_GetMaskedComposite(texnum);
     
     // draw the columns
     for (dc_x = x1 ; dc_x <= x2 ; dc_x++)
@@ -263,8 +270,6 @@ R_RenderMaskedSegRange
 		if (index >=  MAXLIGHTSCALE )
 		    index = MAXLIGHTSCALE-1;
 
-		// [crispy] brightmaps for mid-textures
-		dc_brightmap = texturebrightmap[texnum];
 		dc_colormap[0] = walllights[index];
 		dc_colormap[1] = (crispy->brightmaps & BRIGHTMAPS_TEXTURES) ? colormaps : dc_colormap[0];
 	    }
@@ -298,9 +303,29 @@ R_RenderMaskedSegRange
 	    dc_iscale = 0xffffffffu / (unsigned)spryscale;
 	    
 	    // draw the texture
-	    col = (column_t *)( 
-		(byte *)R_GetColumnMod(texnum,maskedtexturecol[dc_x]) -3);
-			
+	    col = (column_t *)(composite + maskedtexturecol[dc_x] - 3);
+
+	    // [AP] one post from the top, like any solid column: skip
+	    // walking the posts
+	    if (col->topdelta == 0
+	     && ((column_t *)((byte *)col + col->length + 4))->topdelta == 0xff)
+	    {
+		dc_yl = (int)((sprtopscreen+FRACUNIT-1)>>FRACBITS); // [crispy] WiggleFix
+		dc_yh = (int)((sprtopscreen+spryscale*col->length-1)>>FRACBITS); // [crispy] WiggleFix
+
+		if (dc_yh >= mfloorclip[dc_x])
+		    dc_yh = mfloorclip[dc_x]-1;
+		if (dc_yl <= mceilingclip[dc_x])
+		    dc_yl = mceilingclip[dc_x]+1;
+
+		if (dc_yl <= dc_yh)
+		{
+		    dc_source = (byte *)col + 3;
+		    dc_texheight = 0; // [crispy] Tutti-Frutti fix
+		    colfunc ();
+		}
+	    }
+	    else
 	    R_DrawMaskedColumn (col);
 	    maskedtexturecol[dc_x] = INT_MAX; // [crispy] 32-bit integer math
 	}
@@ -485,7 +510,8 @@ void R_RenderSegLoop (void)
 	    {
 		// save texturecol
 		//  for backdrawing of masked mid texture
-		maskedtexturecol[rw_x] = texturecolumn;
+		// [AP] as where it is in the composite, wrapped already
+		maskedtexturecol[rw_x] = R_GetColumnModOffset(maskedtexnum, texturecolumn);
 	    }
 	}
 		
@@ -504,7 +530,7 @@ fixed_t R_ScaleFromGlobalAngle (angle_t visangle)
     angle_t	anglea = ANG90 + (visangle - viewangle);
     angle_t	angleb = ANG90 + (visangle - rw_normalangle);
     int		den = FixedMul(rw_distance, finesine[anglea >> ANGLETOFINESHIFT]);
-    fixed_t	num = FixedMul(projection, finesine[angleb >> ANGLETOFINESHIFT])<<detailshift;
+    fixed_t	num = FixedMul(FixedMul(projection, finesine[angleb >> ANGLETOFINESHIFT]), detailscale);
     fixed_t 	scale;
 
     if (den > (num >> 16))
@@ -617,7 +643,7 @@ R_StoreWallRange
 			
 	    gxt = FixedMul(trx,viewcos); 
 	    gyt = -FixedMul(try,viewsin); 
-	    ds_p->scale1 = FixedDiv(projection, gxt-gyt)<<detailshift;
+	    ds_p->scale1 = FixedMul(FixedDiv(projection, gxt-gyt), detailscale);
 	}
 #endif
 	ds_p->scale2 = ds_p->scale1;
@@ -802,6 +828,10 @@ R_StoreWallRange
 	    maskedtexture = true;
 	    ds_p->maskedtexturecol = maskedtexturecol = lastopening - rw_x;
 	    lastopening += rw_stopx - rw_x;
+
+	    // [AP] for its lookup, R_GetColumnModOffset needs it
+	    maskedtexnum = texturetranslation[sidedef->midtexture];
+	    R_GetMaskedComposite(maskedtexnum);
 	}
     }
     
@@ -927,5 +957,7 @@ R_StoreWallRange
 	ds_p->bsilheight = INT_MAX;
     }
     ds_p++;
+
+    R_MarkClosedColumns (start, stop); // [AP]
 }
 
@@ -26,6 +26,7 @@
 #include <z_zone.h>
 
 #include "doomstat.h"
+#include "r_threads.h"
 
 // swirl factors determine the number of waves per flat width
 
@@ -89,36 +90,92 @@ void R_InitDistortedFlats()
 	}
 }
 
+// [AP] One distorted copy per swirling flat, so that several of them in
+// view are each remapped once per tic rather than once per visplane.
+
+#define SWIRLCACHE 8
+
+typedef struct
+{
+	int flatnum;
+	int tic;
+	char pixels[FLATSIZE];
+} swirlflat_t;
+
+static swirlflat_t swirlcache[SWIRLCACHE];
+static int swirlslots;
+static int swirlevict;
+
 char *R_DistortedFlat(int flatnum)
 {
 	static int swirltic = -1;
-	static int swirlflat = -1;
-	static char distortedflat[FLATSIZE];
+	swirlflat_t *flat = NULL;
+	char *normalflat;
+	int i;
 
 	if (swirltic != leveltime)
 	{
 		offset = offsets + ((leveltime & (SEQUENCE - 1)) * FLATSIZE);
 
 		swirltic = leveltime;
-		swirlflat = -1;
 	}
 
-	if (swirlflat != flatnum)
+	for (i = 0; i < swirlslots; i++)
 	{
-		char *normalflat;
-		int i;
+		if (swirlcache[i].flatnum == flatnum)
+		{
+			flat = &swirlcache[i];
+			break;
+		}
+	}
+
+	if (flat == NULL)
+	{
+		// Take a free slot, then one not used this tic, and only then
+		// one that is
 
+		if (swirlslots < SWIRLCACHE)
+		{
+			flat = &swirlcache[swirlslots++];
+		}
+		else
+		{
+			for (i = 0; i < SWIRLCACHE; i++)
+			{
+				if (swirlcache[i].tic != leveltime)
+				{
+					flat = &swirlcache[i];
+					break;
+				}
+			}
+
+			if (flat == NULL)
+			{
+				flat = &swirlcache[swirlevict];
+				swirlevict = (swirlevict + 1) % SWIRLCACHE;
+
+		// [AP] spans of the evicted flat may still be waiting to be drawn
+		R_FlushDrawThreads();
+			}
+		}
+
+		flat->flatnum = flatnum;
+		flat->tic = -1;
+	}
+
+	if (flat->tic != leveltime)
+	{
 		normalflat = W_CacheLumpNum(flatnum, PU_STATIC);
 
 		for (i = 0; i < FLATSIZE; i++)
 		{
-			distortedflat[i] = normalflat[offset[i]];
+			flat->pixels[i] = normalflat[offset[i]];
 		}
 
 		W_ReleaseLumpNum(flatnum);
 
-		swirlflat = flatnum;
+		flat->tic = leveltime;
 	}
 
-	return distortedflat;
+	return flat->pixels;
 }
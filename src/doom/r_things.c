@@ -19,6 +19,7 @@
 
 
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -187,6 +188,22 @@ R_InstallSpriteLump
 
 
 
+//
+// [AP] First 4 characters of a lump name, upper cased, as one int.
+// Equal keys are what strncasecmp(a, b, 4) finds equal.
+//
+static unsigned int R_SpriteKey (const char *name)
+{
+    unsigned int key = 0;
+    int i;
+
+    for (i = 0; i < 4 && name[i]; i++)
+	key |= (unsigned int) toupper((unsigned char) name[i]) << (i * 8);
+
+    return key;
+}
+
+
 //
 // R_InitSpriteDefs
 // Pass a null terminated list of sprite names
@@ -212,6 +229,12 @@ void R_InitSpriteDefs(const char **namelist)
     int		start;
     int		end;
     int		patched;
+    int		numlumps;
+    int		hashsize;
+    int*	hashfirst; // [AP] sprite lumps by R_SpriteKey
+    int*	hashnext;
+    unsigned int* keys;
+    unsigned int key;
 		
     // count the number of sprite names
     check = namelist;
@@ -227,22 +250,51 @@ void R_InitSpriteDefs(const char **namelist)
 	
     start = firstspritelump-1;
     end = lastspritelump+1;
+
+    // [AP] Index the sprite lumps by their first 4 characters once,
+    //  instead of going through all of them for each sprite name.
+    //  Chains are in lump order, like the scan was.
+    numlumps = end - (start + 1);
+    hashsize = 64;
+    while (hashsize < numlumps)
+	hashsize <<= 1;
+    hashfirst = malloc(hashsize * sizeof(*hashfirst));
+    hashnext = malloc((numlumps > 0 ? numlumps : 1) * sizeof(*hashnext));
+    keys = malloc((numlumps > 0 ? numlumps : 1) * sizeof(*keys));
+    memset(hashfirst, -1, hashsize * sizeof(*hashfirst));
+
+    for (l = numlumps - 1; l >= 0; l--)
+    {
+	int bucket;
+
+	keys[l] = R_SpriteKey(lumpinfo[start + 1 + l]->name);
+	bucket = (keys[l] * 2654435761u) & (hashsize - 1);
+	hashnext[l] = hashfirst[bucket];
+	hashfirst[bucket] = l;
+    }
 	
     // scan all the lump names for each of the names,
     //  noting the highest frame letter.
     // Just compare 4 characters as ints
     for (i=0 ; i<numsprites ; i++)
     {
+	int	index;
+
 	spritename = DEH_String(namelist[i]);
 	memset (sprtemp,-1, sizeof(sprtemp));
 		
 	maxframe = -1;
+	key = R_SpriteKey(spritename);
 	
 	// scan the lumps,
 	//  filling in the frames for whatever is found
-	for (l=start+1 ; l<end ; l++)
+	for (index = hashfirst[(key * 2654435761u) & (hashsize - 1)];
+	     index != -1;
+	     index = hashnext[index])
 	{
-	    if (!strncasecmp(lumpinfo[l]->name, spritename, 4))
+	    l = start + 1 + index;
+
+	    if (keys[index] == key)
 	    {
 		frame = lumpinfo[l]->name[4] - 'A';
 		rotation = lumpinfo[l]->name[5];
@@ -315,6 +367,9 @@ void R_InitSpriteDefs(const char **namelist)
 	memcpy (sprites[i].spriteframes, sprtemp, maxframe*sizeof(spriteframe_t));
     }
 
+    free(keys);
+    free(hashnext);
+    free(hashfirst);
 }
 
 
@@ -508,14 +563,15 @@ R_DrawVisSprite
 	    (vis->mobjflags & MF_NOGRAVITY && crispy->translucency & TRANSLUCENCY_MISSILE) ||
 	    (vis->mobjflags & MF_COUNTITEM && crispy->translucency & TRANSLUCENCY_ITEM))
 	{
-	    colfunc = tlcolfunc;
-	}
 #ifdef CRISPY_TRUECOLOR
-	blendfunc = vis->blendfunc;
+	    colfunc = vis->blendfunc == I_BlendAdd ? tladdcolfunc : tlcolfunc;
+#else
+	    colfunc = tlcolfunc;
 #endif
+	}
     }
 	
-    dc_iscale = abs(vis->xiscale)>>detailshift;
+    dc_iscale = FixedMul(abs(vis->xiscale), detailiscale);
     dc_texturemid = vis->texturemid;
     frac = vis->startfrac;
     spryscale = vis->scale;
@@ -543,9 +599,6 @@ R_DrawVisSprite
     }
 
     colfunc = basecolfunc;
-#ifdef CRISPY_TRUECOLOR
-    blendfunc = I_BlendOver;
-#endif
 }
 
 
@@ -591,6 +644,13 @@ void R_ProjectSprite (mobj_t* thing)
     fixed_t             interpz;
     fixed_t             interpangle;
 
+    // [AP] The console player is seen from where it is predicted to be,
+    // which its real mobj may be in front of
+    if (thing == predictedmo)
+    {
+        return;
+    }
+
     // [AM] Interpolate between current and last position,
     //      if prudent.
     if (crispy->uncapped &&
@@ -728,7 +788,7 @@ void R_ProjectSprite (mobj_t* thing)
     vis = R_NewVisSprite ();
     vis->translation = NULL; // [crispy] no color translation
     vis->mobjflags = thing->flags;
-    vis->scale = xscale<<detailshift;
+    vis->scale = FixedMul(xscale, detailscale);
     vis->gx = interpx;
     vis->gy = interpy;
     vis->gz = interpz;
@@ -773,7 +833,7 @@ void R_ProjectSprite (mobj_t* thing)
     else
     {
 	// diminished light
-	index = xscale>>(LIGHTSCALESHIFT-detailshift+crispy->hires);
+	index = FixedMul(xscale, detailscale)>>(LIGHTSCALESHIFT+crispy->hires);
 
 	if (index >= MAXLIGHTSCALE) 
 	    index = MAXLIGHTSCALE-1;
@@ -916,7 +976,7 @@ static void R_DrawLSprite (void)
 #endif
     vis->xiscale = FixedDiv (FRACUNIT, xscale);
     vis->texturemid = laserspot->z - viewz;
-    vis->scale = xscale<<detailshift;
+    vis->scale = FixedMul(xscale, detailscale);
 
     tx -= SHORT(patch->width/2)<<FRACBITS;
     vis->x1 =  (centerxfrac + FixedMul(tx, xscale))>>FRACBITS;
@@ -1032,7 +1092,7 @@ void R_DrawPSprite (pspdef_t* psp, psprnum_t psprnum) // [crispy] differentiate
     vis->texturemid = (BASEYCENTER<<FRACBITS)+FRACUNIT/4-(psp->sy2-spritetopoffset[lump]);
     vis->x1 = x1 < 0 ? 0 : x1;
     vis->x2 = x2 >= viewwidth ? viewwidth-1 : x2;	
-    vis->scale = pspritescale<<detailshift;
+    vis->scale = FixedMul(pspritescale, detailscale);
     
     if (flip)
     {
@@ -1119,7 +1179,7 @@ void R_DrawPSprite (pspdef_t* psp, psprnum_t psprnum) // [crispy] differentiate
     }
 
     // [crispy] free look
-    vis->texturemid += FixedMul(((centery - viewheight / 2) << FRACBITS), pspriteiscale) >> detailshift;
+    vis->texturemid += FixedMul(FixedMul(((centery - viewheight / 2) << FRACBITS), pspriteiscale), detailiscale);
 
     R_DrawVisSprite (vis, vis->x1, vis->x2);
 }
@@ -1205,51 +1265,79 @@ void R_SortVisSprites (void)
 #else
 vissprite_t	vsprsortedhead;
 
+// [AP] Sort order, as indices into vissprites[]. Grown with the pool and
+// kept between frames.
+static int*	vsprorder;
+static int*	vsprordertemp;
+static int	numvsprorder;
 
+// [AP] A stable LSD radix sort by scale, a byte at a time. Equal scales
+// keep their projection order, the same result as the vanilla selection
+// sort without its O(n^2) cost.
 void R_SortVisSprites (void)
 {
     int			i;
     int			count;
-    vissprite_t*	ds;
-    vissprite_t*	best;
-    vissprite_t		unsorted;
-    fixed_t		bestscale;
+    int			shift;
+    int*		order;
+    int*		temp;
 
     count = vissprite_p - vissprites;
-	
-    unsorted.next = unsorted.prev = &unsorted;
+
+    vsprsortedhead.next = vsprsortedhead.prev = &vsprsortedhead;
 
     if (!count)
 	return;
-		
-    for (ds=vissprites ; ds<vissprite_p ; ds++)
+
+    if (numvsprorder < numvissprites)
     {
-	ds->next = ds+1;
-	ds->prev = ds-1;
+	numvsprorder = numvissprites;
+	vsprorder = I_Realloc(vsprorder, numvsprorder * sizeof(*vsprorder));
+	vsprordertemp = I_Realloc(vsprordertemp, numvsprorder * sizeof(*vsprordertemp));
     }
-    
-    vissprites[0].prev = &unsorted;
-    unsorted.next = &vissprites[0];
-    (vissprite_p-1)->next = &unsorted;
-    unsorted.prev = vissprite_p-1;
-    
-    // pull the vissprites out by scale
 
-    vsprsortedhead.next = vsprsortedhead.prev = &vsprsortedhead;
+    order = vsprorder;
+    temp = vsprordertemp;
+
     for (i=0 ; i<count ; i++)
+	order[i] = i;
+
+    for (shift=0 ; shift<32 ; shift+=8)
     {
-	bestscale = INT_MAX;
-        best = unsorted.next;
-	for (ds=unsorted.next ; ds!= &unsorted ; ds=ds->next)
+	int	counts[256] = {0};
+	int	sum = 0;
+	int*	swap;
+
+	for (i=0 ; i<count ; i++)
+	    counts[(((unsigned int) vissprites[i].scale ^ 0x80000000u) >> shift) & 0xff]++;
+
+	// all in one bucket, this byte doesn't change the order
+	if (counts[(((unsigned int) vissprites[0].scale ^ 0x80000000u) >> shift) & 0xff] == count)
+	    continue;
+
+	for (i=0 ; i<256 ; i++)
 	{
-	    if (ds->scale < bestscale)
-	    {
-		bestscale = ds->scale;
-		best = ds;
-	    }
+	    const int n = counts[i];
+	    counts[i] = sum;
+	    sum += n;
 	}
-	best->next->prev = best->prev;
-	best->prev->next = best->next;
+
+	for (i=0 ; i<count ; i++)
+	{
+	    const vissprite_t* vis = &vissprites[order[i]];
+	    temp[counts[(((unsigned int) vis->scale ^ 0x80000000u) >> shift) & 0xff]++] = order[i];
+	}
+
+	swap = order;
+	order = temp;
+	temp = swap;
+    }
+
+    // link them up back to front
+    for (i=0 ; i<count ; i++)
+    {
+	vissprite_t* best = &vissprites[order[i]];
+
 	best->next = &vsprsortedhead;
 	best->prev = vsprsortedhead.prev;
 	vsprsortedhead.prev->next = best;
@@ -1260,20 +1348,155 @@ void R_SortVisSprites (void)
 
 
 
+// [AP] Drawsegs that can clip sprites (silhouette or masked midtexture),
+// bucketed by DSBUCKETWIDTH wide screen strips. Each bucket lists drawseg
+// indices in ascending order, so R_DrawSprite can still walk them from
+// last to first without looking at drawsegs far away on screen.
+#define DSBUCKETSHIFT	5
+#define DSBUCKETWIDTH	(1 << DSBUCKETSHIFT)
+#define MAXDSBUCKETS	((MAXWIDTH + DSBUCKETWIDTH - 1) >> DSBUCKETSHIFT)
+
+static int	dsbucketstart[MAXDSBUCKETS + 1];
+static int*	dsbucketlist;
+static int	dsbucketlistsize;
+
+static void R_BucketDrawSegs (void)
+{
+    drawseg_t*	ds;
+    int		fill[MAXDSBUCKETS];
+    int		b;
+    int		total;
+
+    memset(dsbucketstart, 0, sizeof(dsbucketstart));
+
+    for (ds=drawsegs ; ds<ds_p ; ds++)
+    {
+	if (!ds->silhouette && !ds->maskedtexturecol)
+	    continue;
+	for (b = ds->x1 >> DSBUCKETSHIFT ; b <= ds->x2 >> DSBUCKETSHIFT ; b++)
+	    dsbucketstart[b + 1]++;
+    }
+
+    for (b=0 ; b<MAXDSBUCKETS ; b++)
+    {
+	fill[b] = dsbucketstart[b];
+	dsbucketstart[b + 1] += dsbucketstart[b];
+    }
+
+    total = dsbucketstart[MAXDSBUCKETS];
+    if (total > dsbucketlistsize)
+    {
+	dsbucketlistsize = 2 * total;
+	dsbucketlist = I_Realloc(dsbucketlist, dsbucketlistsize * sizeof(*dsbucketlist));
+    }
+
+    for (ds=drawsegs ; ds<ds_p ; ds++)
+    {
+	if (!ds->silhouette && !ds->maskedtexturecol)
+	    continue;
+	for (b = ds->x1 >> DSBUCKETSHIFT ; b <= ds->x2 >> DSBUCKETSHIFT ; b++)
+	    dsbucketlist[fill[b]++] = ds - drawsegs;
+    }
+}
+
+static void
+R_ClipSpriteToDrawSeg
+( vissprite_t*	spr,
+  drawseg_t*	ds,
+  int*		clipbot,
+  int*		cliptop )
+{
+    int			x;
+    int			r1;
+    int			r2;
+    fixed_t		scale;
+    fixed_t		lowscale;
+    int			silhouette;
+
+    // determine if the drawseg obscures the sprite
+    if (ds->x1 > spr->x2
+	|| ds->x2 < spr->x1
+	|| (!ds->silhouette
+	    && !ds->maskedtexturecol) )
+    {
+	// does not cover sprite
+	return;
+    }
+
+    r1 = ds->x1 < spr->x1 ? spr->x1 : ds->x1;
+    r2 = ds->x2 > spr->x2 ? spr->x2 : ds->x2;
+
+    if (ds->scale1 > ds->scale2)
+    {
+	lowscale = ds->scale2;
+	scale = ds->scale1;
+    }
+    else
+    {
+	lowscale = ds->scale1;
+	scale = ds->scale2;
+    }
+
+    if (scale < spr->scale
+	|| ( lowscale < spr->scale
+	     && !R_PointOnSegSide (spr->gx, spr->gy, ds->curline) ) )
+    {
+	// masked mid texture?
+	if (ds->maskedtexturecol)	
+	    R_RenderMaskedSegRange (ds, r1, r2);
+	// seg is behind sprite
+	return;
+    }
+
+
+    // clip this piece of the sprite
+    silhouette = ds->silhouette;
+
+    if (spr->gz >= ds->bsilheight)
+	silhouette &= ~SIL_BOTTOM;
+
+    if (spr->gzt <= ds->tsilheight)
+	silhouette &= ~SIL_TOP;
+
+    if (silhouette == 1)
+    {
+	// bottom sil
+	for (x=r1 ; x<=r2 ; x++)
+	    if (clipbot[x] == -2)
+		clipbot[x] = ds->sprbottomclip[x];
+    }
+    else if (silhouette == 2)
+    {
+	// top sil
+	for (x=r1 ; x<=r2 ; x++)
+	    if (cliptop[x] == -2)
+		cliptop[x] = ds->sprtopclip[x];
+    }
+    else if (silhouette == 3)
+    {
+	// both
+	for (x=r1 ; x<=r2 ; x++)
+	{
+	    if (clipbot[x] == -2)
+		clipbot[x] = ds->sprbottomclip[x];
+	    if (cliptop[x] == -2)
+		cliptop[x] = ds->sprtopclip[x];
+	}
+    }
+}
+
 //
 // R_DrawSprite
 //
 void R_DrawSprite (vissprite_t* spr)
 {
-    drawseg_t*		ds;
     int		clipbot[MAXWIDTH]; // [crispy] 32-bit integer math
     int		cliptop[MAXWIDTH]; // [crispy] 32-bit integer math
+    int		pos[MAXDSBUCKETS];
     int			x;
-    int			r1;
-    int			r2;
-    fixed_t		scale;
-    fixed_t		lowscale;
-    int			silhouette;
+    int			b;
+    int			b1;
+    int			b2;
 		
     for (x = spr->x1 ; x<=spr->x2 ; x++)
 	clipbot[x] = cliptop[x] = -2;
@@ -1281,79 +1504,30 @@ void R_DrawSprite (vissprite_t* spr)
     // Scan drawsegs from end to start for obscuring segs.
     // The first drawseg that has a greater scale
     //  is the clip seg.
-    for (ds=ds_p-1 ; ds >= drawsegs ; ds--)
+    // [AP] Only the buckets under the sprite are merged, newest first,
+    //  each drawseg once.
+    b1 = spr->x1 >> DSBUCKETSHIFT;
+    b2 = spr->x2 >> DSBUCKETSHIFT;
+
+    for (b=b1 ; b<=b2 ; b++)
+	pos[b] = dsbucketstart[b + 1] - 1;
+
+    while (true)
     {
-	// determine if the drawseg obscures the sprite
-	if (ds->x1 > spr->x2
-	    || ds->x2 < spr->x1
-	    || (!ds->silhouette
-		&& !ds->maskedtexturecol) )
-	{
-	    // does not cover sprite
-	    continue;
-	}
-			
-	r1 = ds->x1 < spr->x1 ? spr->x1 : ds->x1;
-	r2 = ds->x2 > spr->x2 ? spr->x2 : ds->x2;
+	int best = -1;
 
-	if (ds->scale1 > ds->scale2)
-	{
-	    lowscale = ds->scale2;
-	    scale = ds->scale1;
-	}
-	else
-	{
-	    lowscale = ds->scale1;
-	    scale = ds->scale2;
-	}
-		
-	if (scale < spr->scale
-	    || ( lowscale < spr->scale
-		 && !R_PointOnSegSide (spr->gx, spr->gy, ds->curline) ) )
-	{
-	    // masked mid texture?
-	    if (ds->maskedtexturecol)	
-		R_RenderMaskedSegRange (ds, r1, r2);
-	    // seg is behind sprite
-	    continue;			
-	}
+	for (b=b1 ; b<=b2 ; b++)
+	    if (pos[b] >= dsbucketstart[b] && dsbucketlist[pos[b]] > best)
+		best = dsbucketlist[pos[b]];
 
-	
-	// clip this piece of the sprite
-	silhouette = ds->silhouette;
-	
-	if (spr->gz >= ds->bsilheight)
-	    silhouette &= ~SIL_BOTTOM;
+	if (best < 0)
+	    break;
 
-	if (spr->gzt <= ds->tsilheight)
-	    silhouette &= ~SIL_TOP;
-			
-	if (silhouette == 1)
-	{
-	    // bottom sil
-	    for (x=r1 ; x<=r2 ; x++)
-		if (clipbot[x] == -2)
-		    clipbot[x] = ds->sprbottomclip[x];
-	}
-	else if (silhouette == 2)
-	{
-	    // top sil
-	    for (x=r1 ; x<=r2 ; x++)
-		if (cliptop[x] == -2)
-		    cliptop[x] = ds->sprtopclip[x];
-	}
-	else if (silhouette == 3)
-	{
-	    // both
-	    for (x=r1 ; x<=r2 ; x++)
-	    {
-		if (clipbot[x] == -2)
-		    clipbot[x] = ds->sprbottomclip[x];
-		if (cliptop[x] == -2)
-		    cliptop[x] = ds->sprtopclip[x];
-	    }
-	}
-		
+	for (b=b1 ; b<=b2 ; b++)
+	    if (pos[b] >= dsbucketstart[b] && dsbucketlist[pos[b]] == best)
+		pos[b]--;
+
+	R_ClipSpriteToDrawSeg(spr, drawsegs + best, clipbot, cliptop);
     }
     
     // all clipping has been performed, so draw the sprite
@@ -1388,6 +1562,8 @@ void R_DrawMasked (void)
 
     if (vissprite_p > vissprites)
     {
+	R_BucketDrawSegs ();
+
 	// draw all vissprites back to front
 #ifdef HAVE_QSORT
 	for (spr = vissprites;
@@ -0,0 +1,365 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Optional threaded column/span drawing.
+//
+//	Every pixel belongs to exactly one slice, chosen by its view x
+//	(before flipping, so columns and spans agree). A slice replays the
+//	records in the order they were made, so each pixel sees the same
+//	writes in the same order as the serial renderer, and translucent
+//	and fuzz columns read the same background. Output is identical.
+//
+
+#include <stdlib.h>
+
+#include "SDL.h"
+
+#include "crispy.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "z_zone.h"
+
+#include "r_local.h"
+#include "r_threads.h"
+
+#define MAXDRAWTHREADS 16
+#define MAXDRAWCMDS 16384 // Flushed early when full
+
+typedef void (*drawerfunc_t) (void);
+
+typedef enum
+{
+    DRAW_COLUMN,
+    DRAW_SPAN
+} drawkind_t;
+
+typedef struct
+{
+    drawerfunc_t func;
+    drawkind_t kind;
+    lighttable_t* colormap[2];
+    const byte* brightmap;
+    byte* source;
+    int x1, x2; // Column: x1 is dc_x
+    int y, yh; // Column: dc_yl, dc_yh. Span: ds_y
+    fixed_t iscale;
+    fixed_t texturemid;
+    int texheight;
+    byte* translation;
+    int fuzzpos;
+    fixed_t xfrac, yfrac, xstep, ystep;
+} drawcmd_t;
+
+static int numdrawthreads = 1;
+static SDL_Thread* drawthreads[MAXDRAWTHREADS];
+static SDL_sem* drawstart[MAXDRAWTHREADS];
+static SDL_sem* drawdone;
+static volatile boolean drawquit = false;
+
+static drawcmd_t* drawcmds;
+static int numdrawcmds;
+
+static void R_StoreColumn (drawcmd_t* cmd)
+{
+    cmd->kind = DRAW_COLUMN;
+    cmd->colormap[0] = dc_colormap[0];
+    cmd->colormap[1] = dc_colormap[1];
+    cmd->brightmap = dc_brightmap;
+    cmd->source = dc_source;
+    cmd->x1 = dc_x;
+    cmd->y = dc_yl;
+    cmd->yh = dc_yh;
+    cmd->iscale = dc_iscale;
+    cmd->texturemid = dc_texturemid;
+    cmd->texheight = dc_texheight;
+    cmd->translation = dc_translation;
+    cmd->fuzzpos = fuzzpos;
+}
+
+static void R_LoadColumn (const drawcmd_t* cmd)
+{
+    dc_colormap[0] = cmd->colormap[0];
+    dc_colormap[1] = cmd->colormap[1];
+    dc_brightmap = cmd->brightmap;
+    dc_source = cmd->source;
+    dc_x = cmd->x1;
+    dc_yl = cmd->y;
+    dc_yh = cmd->yh;
+    dc_iscale = cmd->iscale;
+    dc_texturemid = cmd->texturemid;
+    dc_texheight = cmd->texheight;
+    dc_translation = cmd->translation;
+    fuzzpos = cmd->fuzzpos;
+}
+
+static void R_StoreSpan (drawcmd_t* cmd)
+{
+    cmd->kind = DRAW_SPAN;
+    cmd->colormap[0] = ds_colormap[0];
+    cmd->colormap[1] = ds_colormap[1];
+    cmd->brightmap = ds_brightmap;
+    cmd->source = ds_source;
+    cmd->x1 = ds_x1;
+    cmd->x2 = ds_x2;
+    cmd->y = ds_y;
+    cmd->xfrac = ds_xfrac;
+    cmd->yfrac = ds_yfrac;
+    cmd->xstep = ds_xstep;
+    cmd->ystep = ds_ystep;
+}
+
+// Loads the part of the span from x1 to x2
+static void R_LoadSpan (const drawcmd_t* cmd, int x1, int x2)
+{
+    // Same wrap-around as stepping one pixel at a time
+    unsigned int skip = (unsigned int)(x1 - cmd->x1);
+
+    ds_colormap[0] = cmd->colormap[0];
+    ds_colormap[1] = cmd->colormap[1];
+    ds_brightmap = cmd->brightmap;
+    ds_source = cmd->source;
+    ds_x1 = x1;
+    ds_x2 = x2;
+    ds_y = cmd->y;
+    ds_xfrac = (fixed_t)((unsigned int)cmd->xfrac + skip * (unsigned int)cmd->xstep);
+    ds_yfrac = (fixed_t)((unsigned int)cmd->yfrac + skip * (unsigned int)cmd->ystep);
+    ds_xstep = cmd->xstep;
+    ds_ystep = cmd->ystep;
+}
+
+static drawcmd_t* R_NewDrawCmd (drawerfunc_t func)
+{
+    drawcmd_t* cmd;
+
+    if (numdrawcmds == MAXDRAWCMDS)
+	R_FlushDrawThreads();
+
+    cmd = &drawcmds[numdrawcmds++];
+    cmd->func = func;
+    return cmd;
+}
+
+static void R_QueueColumn (drawerfunc_t func)
+{
+    R_StoreColumn(R_NewDrawCmd(func));
+}
+
+static void R_QueueSpan (drawerfunc_t func)
+{
+    R_StoreSpan(R_NewDrawCmd(func));
+}
+
+#define QUEUED_COLUMN(func) \
+    static void func##Queued (void) { R_QueueColumn(func); }
+#define QUEUED_FUZZ_COLUMN(func) \
+    static void func##Queued (void) { R_QueueColumn(func); R_AdvanceFuzzPos(); }
+#define QUEUED_SPAN(func) \
+    static void func##Queued (void) { R_QueueSpan(func); }
+
+QUEUED_COLUMN(R_DrawColumn)
+QUEUED_COLUMN(R_DrawColumnLow)
+QUEUED_FUZZ_COLUMN(R_DrawFuzzColumn)
+QUEUED_FUZZ_COLUMN(R_DrawFuzzColumnLow)
+QUEUED_COLUMN(R_DrawTranslatedColumn)
+QUEUED_COLUMN(R_DrawTranslatedColumnLow)
+QUEUED_COLUMN(R_DrawTLColumn)
+QUEUED_COLUMN(R_DrawTLColumnLow)
+#ifdef CRISPY_TRUECOLOR
+QUEUED_COLUMN(R_DrawTLAddColumn)
+QUEUED_COLUMN(R_DrawTLAddColumnLow)
+#endif
+QUEUED_SPAN(R_DrawSpan)
+QUEUED_SPAN(R_DrawSpanLow)
+QUEUED_SPAN(R_DrawSpanSolid)
+QUEUED_SPAN(R_DrawSpanSolidLow)
+
+static const struct
+{
+    drawerfunc_t func;
+    drawerfunc_t queued;
+} queueddrawers[] = {
+    {R_DrawColumn,              R_DrawColumnQueued},
+    {R_DrawColumnLow,           R_DrawColumnLowQueued},
+    {R_DrawFuzzColumn,          R_DrawFuzzColumnQueued},
+    {R_DrawFuzzColumnLow,       R_DrawFuzzColumnLowQueued},
+    {R_DrawTranslatedColumn,    R_DrawTranslatedColumnQueued},
+    {R_DrawTranslatedColumnLow, R_DrawTranslatedColumnLowQueued},
+    {R_DrawTLColumn,            R_DrawTLColumnQueued},
+    {R_DrawTLColumnLow,         R_DrawTLColumnLowQueued},
+#ifdef CRISPY_TRUECOLOR
+    {R_DrawTLAddColumn,         R_DrawTLAddColumnQueued},
+    {R_DrawTLAddColumnLow,      R_DrawTLAddColumnLowQueued},
+#endif
+    {R_DrawSpan,                R_DrawSpanQueued},
+    {R_DrawSpanLow,             R_DrawSpanLowQueued},
+    {R_DrawSpanSolid,           R_DrawSpanSolidQueued},
+    {R_DrawSpanSolidLow,        R_DrawSpanSolidLowQueued},
+};
+
+static drawerfunc_t R_QueuedDrawer (drawerfunc_t func)
+{
+    int i;
+
+    for (i = 0; i < (int)arrlen(queueddrawers); i++)
+    {
+	if (queueddrawers[i].func == func)
+	    return queueddrawers[i].queued;
+    }
+
+    return func; // Unknown drawer, let it draw immediately
+}
+
+// Replays every record touching view columns [sx1, sx2]. The dc_ and ds_
+// globals are thread local, so this is safe to run on any thread.
+static void R_RunDrawSlice (int slice)
+{
+    int sx1 = viewwidth * slice / numdrawthreads;
+    int sx2 = viewwidth * (slice + 1) / numdrawthreads - 1;
+    int i;
+
+    for (i = 0; i < numdrawcmds; i++)
+    {
+	const drawcmd_t* cmd = &drawcmds[i];
+
+	if (cmd->kind == DRAW_COLUMN)
+	{
+	    if (cmd->x1 < sx1 || cmd->x1 > sx2)
+		continue;
+	    R_LoadColumn(cmd);
+	}
+	else
+	{
+	    int x1 = MAX(cmd->x1, sx1);
+	    int x2 = MIN(cmd->x2, sx2);
+
+	    if (x1 > x2)
+		continue;
+	    R_LoadSpan(cmd, x1, x2);
+	}
+
+	cmd->func();
+    }
+}
+
+static int R_DrawThread (void* data)
+{
+    int slice = (int)(intptr_t)data;
+
+    while (true)
+    {
+	SDL_SemWait(drawstart[slice]);
+	if (drawquit)
+	    break;
+	R_RunDrawSlice(slice);
+	SDL_SemPost(drawdone);
+    }
+
+    return 0;
+}
+
+void R_FlushDrawThreads (void)
+{
+    drawcmd_t column, span;
+    int i;
+
+    if (!numdrawcmds)
+	return;
+
+    // This thread draws the first slice too. It may be in the middle of
+    // setting up the next column or span, so put its parameters back after.
+    R_StoreColumn(&column);
+    R_StoreSpan(&span);
+
+    for (i = 1; i < numdrawthreads; i++)
+	SDL_SemPost(drawstart[i]);
+    R_RunDrawSlice(0);
+    for (i = 1; i < numdrawthreads; i++)
+	SDL_SemWait(drawdone);
+
+    R_LoadColumn(&column);
+    R_LoadSpan(&span, span.x1, span.x2);
+
+    numdrawcmds = 0;
+}
+
+static void R_ShutdownDrawThreads (void)
+{
+    int i;
+
+    numdrawcmds = 0;
+    drawquit = true;
+    for (i = 1; i < numdrawthreads; i++)
+	SDL_SemPost(drawstart[i]);
+    for (i = 1; i < numdrawthreads; i++)
+	SDL_WaitThread(drawthreads[i], NULL);
+    numdrawthreads = 1;
+}
+
+void R_InitDrawThreads (void)
+{
+    int p, i;
+
+    //!
+    // @arg <n>
+    // @category video
+    //
+    // Draw walls, floors and sprites on n threads, each drawing a
+    // vertical slice of the view. Output is identical to one thread.
+    //
+
+    p = M_CheckParmWithArgs("-rthreads", 1);
+    if (!p)
+	return;
+
+    numdrawthreads = atoi(myargv[p+1]);
+    if (numdrawthreads < 1)
+	numdrawthreads = 1;
+    if (numdrawthreads > MAXDRAWTHREADS)
+	numdrawthreads = MAXDRAWTHREADS;
+    if (numdrawthreads == 1)
+	return;
+
+    drawcmds = malloc(MAXDRAWCMDS * sizeof(*drawcmds));
+    drawdone = SDL_CreateSemaphore(0);
+    for (i = 1; i < numdrawthreads; i++)
+    {
+	drawstart[i] = SDL_CreateSemaphore(0);
+	drawthreads[i] = SDL_CreateThread(R_DrawThread, "R_DrawThread", (void*)(intptr_t)i);
+	if (!drawthreads[i])
+	    I_Error("R_InitDrawThreads: %s", SDL_GetError());
+    }
+
+    // Purging a cached patch or flat would pull it from under records
+    // still waiting to be drawn
+    Z_SetPurgeCallback(R_FlushDrawThreads);
+    I_AtExit(R_ShutdownDrawThreads, false);
+
+    printf("R_InitDrawThreads: %i draw threads\n", numdrawthreads);
+}
+
+void R_HookDrawThreads (void)
+{
+    if (numdrawthreads == 1)
+	return;
+
+    colfunc = R_QueuedDrawer(colfunc);
+    basecolfunc = R_QueuedDrawer(basecolfunc);
+    fuzzcolfunc = R_QueuedDrawer(fuzzcolfunc);
+    transcolfunc = R_QueuedDrawer(transcolfunc);
+    tlcolfunc = R_QueuedDrawer(tlcolfunc);
+#ifdef CRISPY_TRUECOLOR
+    tladdcolfunc = R_QueuedDrawer(tladdcolfunc);
+#endif
+    spanfunc = R_QueuedDrawer(spanfunc);
+}
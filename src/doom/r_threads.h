@@ -0,0 +1,39 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Optional threaded column/span drawing. BSP traversal, clipping and
+//	sprite sorting stay serial; the column and span drawers only record
+//	what they would draw, and the records are replayed by a pool of
+//	threads, each owning a vertical slice of the view.
+//
+
+#ifndef __R_THREADS__
+#define __R_THREADS__
+
+#include "doomtype.h"
+
+// Reads -rthreads and starts the pool. One thread means no pool at all.
+void R_InitDrawThreads (void);
+
+// Swaps colfunc, spanfunc and friends for their recording versions, if
+// the pool is running. Called after the drawers are picked for the
+// current detail level.
+void R_HookDrawThreads (void);
+
+// Draws everything recorded so far and waits for it. Must be called
+// before the view is read back, and before any memory a record points
+// to (patches, flats) can go away.
+void R_FlushDrawThreads (void);
+
+#endif
@@ -0,0 +1,187 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Recorded viewpoints.
+//
+//	The file is VIEWMAGIC, then one record of VIEWRECORDSIZE bytes per
+//	frame: x, y, z and angle as 32-bit little-endian values, the pitch
+//	as 16 bits, then the episode and map.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomstat.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "r_views.h"
+
+#define VIEWMAGIC "APVIEWS1"
+#define VIEWRECORDSIZE 20
+
+static FILE *record_file;
+static const rview_t *override_view;
+
+static void CloseViewRecording (void)
+{
+    if (record_file != NULL)
+    {
+	fclose(record_file);
+	record_file = NULL;
+    }
+}
+
+void R_InitViewRecording (void)
+{
+    int p;
+
+    //!
+    // @arg <file>
+    // @category video
+    //
+    // Write where every frame is rendered from to a file, for
+    // -renderbench to render again.
+    //
+
+    p = M_CheckParmWithArgs("-recordviews", 1);
+
+    if (p == 0)
+    {
+	return;
+    }
+
+    record_file = M_fopen(myargv[p + 1], "wb");
+
+    if (record_file == NULL)
+    {
+	I_Error("R_InitViewRecording: Unable to write %s", myargv[p + 1]);
+    }
+
+    fwrite(VIEWMAGIC, 1, strlen(VIEWMAGIC), record_file);
+    I_AtExit(CloseViewRecording, true);
+}
+
+static void WriteInt32 (byte *p, unsigned int value)
+{
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+}
+
+static unsigned int ReadInt32 (const byte *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+void R_RecordView (fixed_t x, fixed_t y, fixed_t z, angle_t angle, int pitch)
+{
+    byte record[VIEWRECORDSIZE];
+
+    if (record_file == NULL)
+    {
+	return;
+    }
+
+    WriteInt32(record, x);
+    WriteInt32(record + 4, y);
+    WriteInt32(record + 8, z);
+    WriteInt32(record + 12, angle);
+    record[16] = pitch & 0xff;
+    record[17] = (pitch >> 8) & 0xff;
+    record[18] = gameepisode;
+    record[19] = gamemap;
+
+    fwrite(record, 1, sizeof(record), record_file);
+}
+
+int R_LoadViews (const char *filename, rview_t **views)
+{
+    byte record[VIEWRECORDSIZE];
+    char magic[sizeof(VIEWMAGIC) - 1];
+    FILE *f;
+    long size;
+    int count, i;
+
+    f = M_fopen(filename, "rb");
+
+    if (f == NULL)
+    {
+	I_Error("R_LoadViews: Unable to open %s", filename);
+    }
+
+    if (fread(magic, 1, sizeof(magic), f) != sizeof(magic)
+     || memcmp(magic, VIEWMAGIC, sizeof(magic)) != 0)
+    {
+	I_Error("R_LoadViews: %s is not a -recordviews file", filename);
+    }
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f) - (long) sizeof(magic);
+    fseek(f, sizeof(magic), SEEK_SET);
+
+    count = size / VIEWRECORDSIZE;
+    *views = malloc((count ? count : 1) * sizeof(**views));
+
+    if (*views == NULL)
+    {
+	I_Error("R_LoadViews: Out of memory");
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+	rview_t *view = &(*views)[i];
+
+	if (fread(record, 1, sizeof(record), f) != sizeof(record))
+	{
+	    break;
+	}
+
+	view->x = ReadInt32(record);
+	view->y = ReadInt32(record + 4);
+	view->z = ReadInt32(record + 8);
+	view->angle = ReadInt32(record + 12);
+	view->pitch = (short) (record[16] | (record[17] << 8));
+	view->episode = record[18];
+	view->map = record[19];
+    }
+
+    fclose(f);
+
+    return i;
+}
+
+void R_SetViewOverride (const rview_t *view)
+{
+    override_view = view;
+}
+
+boolean R_OverrideView (fixed_t *x, fixed_t *y, fixed_t *z, angle_t *angle,
+                        int *pitch)
+{
+    if (override_view == NULL)
+    {
+	return false;
+    }
+
+    *x = override_view->x;
+    *y = override_view->y;
+    *z = override_view->z;
+    *angle = override_view->angle;
+    *pitch = override_view->pitch;
+
+    return true;
+}
@@ -0,0 +1,54 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Recorded viewpoints. -recordviews writes down where every frame
+//	was rendered from, after interpolation, and -renderbench renders
+//	from them again.
+//
+
+#ifndef __R_VIEWS__
+#define __R_VIEWS__
+
+#include "doomtype.h"
+#include "m_fixed.h"
+#include "tables.h"
+
+typedef struct
+{
+    fixed_t x, y, z;
+    angle_t angle;
+    int pitch;
+    int episode, map;
+} rview_t;
+
+// Reads -recordviews and opens the file.
+void R_InitViewRecording (void);
+
+// Called by R_SetupFrame with the view it came up with.
+void R_RecordView (fixed_t x, fixed_t y, fixed_t z, angle_t angle, int pitch);
+
+// Reads a -recordviews file. Returns the number of views, with *views
+// allocated to hold them.
+int R_LoadViews (const char *filename, rview_t **views);
+
+// Makes R_SetupFrame use view instead of the player's, until called
+// with NULL.
+void R_SetViewOverride (const rview_t *view);
+
+// Called by R_SetupFrame: if a view is set, fills in the arguments from
+// it and returns true.
+boolean R_OverrideView (fixed_t *x, fixed_t *y, fixed_t *z, angle_t *angle,
+                        int *pitch);
+
+#endif
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 
 #include "i_sound.h"
+#include "i_soundstats.h"
 #include "i_system.h"
 
 #include "deh_str.h"
@@ -78,6 +79,13 @@ typedef struct
 
     int pitch;
 
+    // [AP] next channel whose origin is in the same bucket, or -1
+    int originnext;
+
+    // [AP] Whether the parameters sent for the origin at x, y still hold
+    boolean paramsvalid;
+    fixed_t x, y;
+
 } channel_t;
 
 // The set of channels available
@@ -85,6 +93,26 @@ typedef struct
 static channel_t *channels;
 static degenmobj_t *sobjs;
 
+// [AP] Channels by origin. There is at most one per origin, as
+// S_StartSound stops the old one first.
+
+#define ORIGIN_HASH 64
+
+static int originhash[ORIGIN_HASH];
+
+// [AP] Tournament tree over the channels' priorities, free ones
+// counting as INT_MAX, so S_GetChannel finds the same channel the
+// vanilla scan did, in log time. Leaves start at chanleaves.
+
+static int *chanprio;
+static int chanleaves;
+
+// [AP] Listener as of the last S_UpdateSounds
+static mobj_t *lastlistener;
+static fixed_t lastlistener_x, lastlistener_y;
+static angle_t lastlistener_angle;
+static int lastsfxvolume, laststereo_swing;
+
 // Maximum volume of a sound effect.
 // Internal default is max out of 0-15.
 
@@ -239,6 +267,126 @@ static void S_RegisterAltMusic()
 //  allocates channel buffer, sets S_sfx lookup.
 //
 
+// [AP] Channel bookkeeping
+
+static int S_OriginHash(mobj_t *origin)
+{
+    uintptr_t key = (uintptr_t) origin;
+
+    return ((key >> 4) ^ (key >> 10)) % ORIGIN_HASH;
+}
+
+static void S_LinkOrigin(int cnum)
+{
+    channel_t *c = &channels[cnum];
+
+    if (c->origin)
+    {
+        int *head = &originhash[S_OriginHash(c->origin)];
+
+        c->originnext = *head;
+        *head = cnum;
+    }
+}
+
+static void S_UnlinkOrigin(int cnum)
+{
+    channel_t *c = &channels[cnum];
+    int *link;
+
+    if (!c->origin)
+    {
+        return;
+    }
+
+    for (link = &originhash[S_OriginHash(c->origin)]; *link != -1;
+         link = &channels[*link].originnext)
+    {
+        if (*link == cnum)
+        {
+            *link = c->originnext;
+            break;
+        }
+    }
+}
+
+static int S_OriginChannel(mobj_t *origin)
+{
+    int cnum;
+
+    for (cnum = originhash[S_OriginHash(origin)]; cnum != -1;
+         cnum = channels[cnum].originnext)
+    {
+        if (channels[cnum].origin == origin)
+        {
+            break;
+        }
+    }
+
+    return cnum;
+}
+
+static void S_UpdateChannelPriority(int cnum)
+{
+    const sfxinfo_t *sfx = channels[cnum].sfxinfo;
+    int node = chanleaves + cnum;
+
+    chanprio[node] = sfx ? sfx->priority : INT_MAX;
+
+    for (node >>= 1; node > 0; node >>= 1)
+    {
+        chanprio[node] = MAX(chanprio[node * 2], chanprio[node * 2 + 1]);
+    }
+}
+
+// Lowest numbered channel with a priority of at least prio, or -1.
+
+static int S_FindChannelPriority(int prio)
+{
+    int node = 1;
+
+    if (chanprio[node] < prio)
+    {
+        return -1;
+    }
+
+    while (node < chanleaves)
+    {
+        node = chanprio[node * 2] >= prio ? node * 2 : node * 2 + 1;
+    }
+
+    return node - chanleaves;
+}
+
+// Free all channels, after the number of them changed.
+
+static void S_InitChannels(void)
+{
+    int i;
+
+    for (chanleaves = 1; chanleaves < snd_channels; chanleaves <<= 1);
+
+    chanprio = I_Realloc(chanprio, 2 * chanleaves * sizeof(*chanprio));
+
+    for (i = 0; i < 2 * chanleaves; i++)
+    {
+        chanprio[i] = INT_MIN;
+    }
+
+    for (i = 0; i < ORIGIN_HASH; i++)
+    {
+        originhash[i] = -1;
+    }
+
+    for (i = 0; i < snd_channels; i++)
+    {
+        channels[i].sfxinfo = NULL;
+        channels[i].origin = NULL;
+        S_UpdateChannelPriority(i);
+    }
+}
+
+
 void S_Init(int sfxVolume, int musicVolume)
 {
     int i;
@@ -272,10 +420,7 @@ void S_Init(int sfxVolume, int musicVolume)
     sobjs = I_Realloc(NULL, snd_channels*sizeof(degenmobj_t));
 
     // Free all channels for use
-    for (i=0 ; i<snd_channels ; i++)
-    {
-        channels[i].sfxinfo = 0;
-    }
+    S_InitChannels();
 
     // no sounds are playing, and they are not mus_paused
     mus_paused = 0;
@@ -320,7 +465,6 @@ void S_Shutdown(void)
 
 static void S_StopChannel(int cnum)
 {
-    int i;
     channel_t *c;
 
     c = &channels[cnum];
@@ -334,51 +478,24 @@ static void S_StopChannel(int cnum)
             I_StopSound(c->handle);
         }
 
-        // check to see if other channels are playing the sound
-
-        for (i=0; i<snd_channels; i++)
-        {
-            if (cnum != i && c->sfxinfo == channels[i].sfxinfo)
-            {
-                break;
-            }
-        }
-
         // degrade usefulness of sound data
 
+        S_UnlinkOrigin(cnum);
         c->sfxinfo->usefulness--;
         c->sfxinfo = NULL;
         c->origin = NULL;
+        S_UpdateChannelPriority(cnum);
     }
 }
 
 //
-// Per level startup code.
-// Kills playing sounds at start of level,
-//  determines music if any, changes music.
+// Music for a level: the one AP picked, if any, else the game's own.
 //
-static short prevmap = -1;
-
-void S_Start(void)
+static int S_LevelMusic(int episode, int map)
 {
-    int cnum;
     int mnum;
 
-    // kill all playing sounds at start of level
-    //  (trust me - a good idea)
-    for (cnum=0 ; cnum<snd_channels ; cnum++)
-    {
-        if (channels[cnum].sfxinfo)
-        {
-            S_StopChannel(cnum);
-        }
-    }
-
-    // start new music for the level
-    if (musicVolume) // [crispy] do not reset pause state at zero music volume
-    mus_paused = 0;
-
-    ap_level_state_t* level_state = ap_get_level_state(ap_make_level_index(gameepisode, gamemap));
+    ap_level_state_t* level_state = ap_get_level_state(ap_make_level_index(episode, map));
     mnum = level_state->music;
     if (!mnum)
     {
@@ -397,13 +514,13 @@ void S_Start(void)
                 mus_ddtbl2,
             };
 
-            if ((gameepisode == 2 || gamemission == pack_nerve) &&
-                gamemap <= arrlen(nmus))
+            if ((episode == 2 || gamemission == pack_nerve) &&
+                map <= arrlen(nmus))
             {
-                mnum = nmus[gamemap - 1];
+                mnum = nmus[map - 1];
             }
             else
-            mnum = mus_runnin + gamemap - 1;
+            mnum = mus_runnin + map - 1;
         }
         else
         {
@@ -422,17 +539,17 @@ void S_Start(void)
                 mus_e1m9,        // Tim          e4m9
             };
 
-            if (gameepisode < 4 || gameepisode == 5) // [crispy] Sigil
+            if (episode < 4 || episode == 5) // [crispy] Sigil
             {
-                mnum = mus_e1m1 + (gameepisode-1)*9 + gamemap-1;
+                mnum = mus_e1m1 + (episode-1)*9 + map-1;
             }
             else
             {
-                mnum = spmus[gamemap-1];
+                mnum = spmus[map-1];
 
                 // [crispy] support dedicated music tracks for the 4th episode
                 {
-                    const int sp_mnum = mus_e1m1 + 3 * 9 + gamemap - 1;
+                    const int sp_mnum = mus_e1m1 + 3 * 9 + map - 1;
 
                     if (S_music[sp_mnum].lumpnum > 0)
                     {
@@ -443,6 +560,37 @@ void S_Start(void)
         }
     }
 
+    return mnum;
+}
+
+//
+// Per level startup code.
+// Kills playing sounds at start of level,
+//  determines music if any, changes music.
+//
+static short prevmap = -1;
+
+void S_Start(void)
+{
+    int cnum;
+    int mnum;
+
+    // kill all playing sounds at start of level
+    //  (trust me - a good idea)
+    for (cnum=0 ; cnum<snd_channels ; cnum++)
+    {
+        if (channels[cnum].sfxinfo)
+        {
+            S_StopChannel(cnum);
+        }
+    }
+
+    // start new music for the level
+    if (musicVolume) // [crispy] do not reset pause state at zero music volume
+    mus_paused = 0;
+
+    mnum = S_LevelMusic(gameepisode, gamemap);
+
     // [crispy] do not change music if not changing map (preserves IDMUS choice)
     // [AP] Ok we actually want that for AP
  //   {
@@ -464,6 +612,19 @@ void S_StopSound(mobj_t *origin)
 {
     int cnum;
 
+    // [AP] Sounds without an origin aren't linked
+    if (origin)
+    {
+        cnum = S_OriginChannel(origin);
+
+        if (cnum != -1)
+        {
+            S_StopChannel(cnum);
+        }
+
+        return;
+    }
+
     for (cnum=0 ; cnum<snd_channels ; cnum++)
     {
         if (channels[cnum].sfxinfo && channels[cnum].origin == origin)
@@ -487,17 +648,17 @@ void S_UnlinkSound(mobj_t *origin)
 
     if (origin)
     {
-        for (cnum=0 ; cnum<snd_channels ; cnum++)
+        cnum = S_OriginChannel(origin);
+
+        if (cnum != -1)
         {
-            if (channels[cnum].sfxinfo && channels[cnum].origin == origin)
-            {
-                degenmobj_t *const sobj = &sobjs[cnum];
-                sobj->x = origin->x;
-                sobj->y = origin->y;
-                sobj->z = origin->z;
-                channels[cnum].origin = (mobj_t *) sobj;
-                break;
-            }
+            degenmobj_t *const sobj = &sobjs[cnum];
+            sobj->x = origin->x;
+            sobj->y = origin->y;
+            sobj->z = origin->z;
+            S_UnlinkOrigin(cnum);
+            channels[cnum].origin = (mobj_t *) sobj;
+            S_LinkOrigin(cnum);
         }
     }
 }
@@ -511,36 +672,28 @@ static int S_GetChannel(mobj_t *origin, sfxinfo_t *sfxinfo)
 {
     // channel number to use
     int                cnum;
+    int                ocnum;
 
     channel_t*        c;
 
     // Find an open channel
-    for (cnum=0 ; cnum<snd_channels ; cnum++)
+    // [AP] The first free one, or the origin's own if it comes before
+    cnum = S_FindChannelPriority(INT_MAX);
+    ocnum = origin ? S_OriginChannel(origin) : -1;
+
+    if (ocnum != -1 && (cnum == -1 || ocnum < cnum))
     {
-        if (!channels[cnum].sfxinfo)
-        {
-            break;
-        }
-        else if (origin && channels[cnum].origin == origin)
-        {
-            S_StopChannel(cnum);
-            break;
-        }
+        S_StopChannel(ocnum);
+        cnum = ocnum;
     }
 
     // None available
-    if (cnum == snd_channels)
+    if (cnum == -1)
     {
         // Look for lower priority
-        for (cnum=0 ; cnum<snd_channels ; cnum++)
-        {
-            if (channels[cnum].sfxinfo->priority >= sfxinfo->priority)
-            {
-                break;
-            }
-        }
+        cnum = S_FindChannelPriority(sfxinfo->priority);
 
-        if (cnum == snd_channels)
+        if (cnum == -1)
         {
             // FUCK!  No lower priority.  Sorry, Charlie.
             return -1;
@@ -549,6 +702,7 @@ static int S_GetChannel(mobj_t *origin, sfxinfo_t *sfxinfo)
         {
             // Otherwise, kick out lower priority.
             S_StopChannel(cnum);
+            I_SoundStatsCount(SNDSTATS_CHANNEL_STEAL);
         }
     }
 
@@ -557,6 +711,9 @@ static int S_GetChannel(mobj_t *origin, sfxinfo_t *sfxinfo)
     // channel is decided to be cnum.
     c->sfxinfo = sfxinfo;
     c->origin = origin;
+    c->paramsvalid = false;
+    S_LinkOrigin(cnum);
+    S_UpdateChannelPriority(cnum);
 
     return cnum;
 }
@@ -769,6 +926,19 @@ void S_StartSoundOnce (void *origin_p, int sfx_id)
     int cnum;
     const sfxinfo_t *const sfx = &S_sfx[sfx_id];
 
+    if (origin_p)
+    {
+        cnum = S_OriginChannel(origin_p);
+
+        if (cnum != -1 && channels[cnum].sfxinfo == sfx)
+        {
+            return;
+        }
+
+        S_StartSound(origin_p, sfx_id);
+        return;
+    }
+
     for (cnum = 0; cnum < snd_channels; cnum++)
     {
         if (channels[cnum].sfxinfo == sfx &&
@@ -826,11 +996,28 @@ void S_UpdateSounds(mobj_t *listener)
     int                cnum;
     int                volume;
     int                sep;
+    boolean            moved;
     sfxinfo_t*        sfx;
     channel_t*        c;
 
     I_UpdateSound();
 
+    // [AP] Parameters only need recomputing for sounds that moved,
+    // unless the listener or the settings they depend on changed
+    moved = listener != lastlistener
+         || listener->x != lastlistener_x
+         || listener->y != lastlistener_y
+         || listener->angle != lastlistener_angle
+         || snd_SfxVolume != lastsfxvolume
+         || stereo_swing != laststereo_swing;
+
+    lastlistener = listener;
+    lastlistener_x = listener->x;
+    lastlistener_y = listener->y;
+    lastlistener_angle = listener->angle;
+    lastsfxvolume = snd_SfxVolume;
+    laststereo_swing = stereo_swing;
+
     for (cnum=0; cnum<snd_channels; cnum++)
     {
         c = &channels[cnum];
@@ -862,6 +1049,12 @@ void S_UpdateSounds(mobj_t *listener)
                 //  or modify their params
                 if (c->origin && listener != c->origin && c->origin != players[displayplayer].so) // [crispy] weapon sound source
                 {
+                    if (!moved && c->paramsvalid
+                     && c->origin->x == c->x && c->origin->y == c->y)
+                    {
+                        continue;
+                    }
+
                     audible = S_AdjustSoundParams(listener,
                                                   c->origin,
                                                   &volume,
@@ -873,6 +1066,9 @@ void S_UpdateSounds(mobj_t *listener)
                     }
                     else
                     {
+                        c->paramsvalid = true;
+                        c->x = c->origin->x;
+                        c->y = c->origin->y;
                         I_UpdateSoundParams(c->handle, volume, sep);
                     }
                 }
@@ -919,6 +1115,43 @@ void S_SetSfxVolume(int volume)
     snd_SfxVolume = volume;
 }
 
+//
+// Reads ahead the music a level will play, for a level that is about to
+// be entered.
+//
+
+void S_PrecacheLevelMusic(int episode, int map)
+{
+    musicinfo_t *music;
+    char namebuf[9];
+    int lumpnum;
+    int mnum;
+
+    if (nodrawers && singletics)
+	return;
+
+    mnum = S_LevelMusic(episode, map);
+
+    if (mnum <= mus_None || mnum >= NUMMUSIC)
+	return;
+
+    music = &S_music[mnum];
+    lumpnum = music->lumpnum;
+
+    if (!lumpnum)
+    {
+        M_snprintf(namebuf, sizeof(namebuf), "d_%s", DEH_String(music->name));
+        lumpnum = W_CheckNumForName(namebuf);
+    }
+
+    // Releasing the playing song's lump would let the zone purge it.
+    if (lumpnum < 0 || (mus_playing && mus_playing->lumpnum == lumpnum))
+	return;
+
+    I_PrecacheSong(W_CacheLumpNum(lumpnum, PU_STATIC), W_LumpLength(lumpnum));
+    W_ReleaseLumpNum(lumpnum);
+}
+
 //
 // Starts some music with the music id found in sounds.h.
 //
@@ -1137,10 +1370,7 @@ void S_UpdateSndChannels (int choice)
 	channels = I_Realloc(channels, snd_channels * sizeof(channel_t));
 	sobjs = I_Realloc(sobjs, snd_channels * sizeof(degenmobj_t));
 
-	for (i = 0; i < snd_channels; i++)
-	{
-		channels[i].sfxinfo = 0;
-	}
+	S_InitChannels();
 }
 
 void S_UpdateStereoSeparation (void)
@@ -62,6 +62,9 @@ void S_UnlinkSound(mobj_t *origin);
 // Start music using <music_id> from sounds.h
 void S_StartMusic(int music_id);
 
+// [AP] Read ahead the music of a level about to be entered
+void S_PrecacheLevelMusic(int episode, int map);
+
 // Start music using <music_id> from sounds.h,
 //  and set whether looping
 void S_ChangeMusic(int music_id, int looping);
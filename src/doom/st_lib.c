@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#include <string.h>
 
 #include "deh_main.h"
 #include "doomdef.h"
@@ -75,6 +76,61 @@ STlib_initNum
 }
 
 
+// [AP] The digits are drawn through V_DrawLayer, keyed on the number and
+// how it's drawn, so the Crispy HUD, which redraws them every frame over
+// the view, mostly just copies them.
+
+typedef struct
+{
+    int		x;
+    int		y;
+    patch_t**	p;
+    int		num;
+    int		width;
+    byte*	translation;
+    int		widescreendelta;
+} numkey_t;
+
+static void STlib_drawDigits(void *data)
+{
+    const numkey_t *key = data;
+    int		numdigits = key->width;
+    int		num = key->num;
+    int		w = SHORT(key->p[0]->width);
+    int		x = key->x;
+    int		neg = num < 0;
+
+    if (neg)
+    {
+	if (numdigits == 2 && num < -9)
+	    num = -9;
+	else if (numdigits == 3 && num < -99)
+	    num = -99;
+	
+	num = -num;
+    }
+
+    // if non-number, do not draw it
+    if (num == 1994)
+	return;
+
+    // in the special case of 0, you draw 0
+    if (!num)
+	V_DrawPatch(x - w, key->y, key->p[ 0 ]);
+
+    // draw the new number
+    while (num && numdigits--)
+    {
+	x -= w;
+	V_DrawPatch(x, key->y, key->p[ num % 10 ]);
+	num /= 10;
+    }
+
+    // draw a minus sign if necessary
+    if (neg && sttminus)
+	V_DrawPatch(x - 8, key->y, sttminus);
+}
+
 // 
 // A fairly efficient way to draw a number
 //  based on differences from the old number.
@@ -93,7 +149,7 @@ STlib_drawNum
     int		h = SHORT(n->p[0]->height);
     int		x = n->x;
     
-    int		neg;
+    numkey_t	key;
 
     // [crispy] redraw only if necessary
     if (n->oldnum == num && !refresh)
@@ -103,18 +159,6 @@ STlib_drawNum
 
     n->oldnum = *n->num;
 
-    neg = num < 0;
-
-    if (neg)
-    {
-	if (numdigits == 2 && num < -9)
-	    num = -9;
-	else if (numdigits == 3 && num < -99)
-	    num = -99;
-	
-	num = -num;
-    }
-
     // clear the area
     x = n->x - numdigits*w;
 
@@ -124,27 +168,16 @@ STlib_drawNum
     if (screenblocks < CRISPY_HUD || (automapactive && !crispy->automapoverlay))
     V_CopyRect(x + WIDESCREENDELTA, n->y - ST_Y, st_backing_screen, w*numdigits, h, x + WIDESCREENDELTA, n->y);
 
-    // if non-number, do not draw it
-    if (num == 1994)
-	return;
-
-    x = n->x;
-
-    // in the special case of 0, you draw 0
-    if (!num)
-	V_DrawPatch(x - w, n->y, n->p[ 0 ]);
-
-    // draw the new number
-    while (num && numdigits--)
-    {
-	x -= w;
-	V_DrawPatch(x, n->y, n->p[ num % 10 ]);
-	num /= 10;
-    }
+    memset(&key, 0, sizeof(key));
+    key.x = n->x;
+    key.y = n->y;
+    key.p = n->p;
+    key.num = num;
+    key.width = numdigits;
+    key.translation = dp_translation;
+    key.widescreendelta = WIDESCREENDELTA;
 
-    // draw a minus sign if necessary
-    if (neg && sttminus)
-	V_DrawPatch(x - 8, n->y, sttminus);
+    V_DrawLayer(&key, sizeof(key), STlib_drawDigits, &key);
 }
 
 
@@ -569,7 +569,7 @@ static int ST_cheat_massacre()
     extern int numbraintargets;
     extern void A_PainDie(mobj_t *);
 
-    for (th = thinkercap.next; th != &thinkercap; th = th->next)
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj]; th = th->cnext)
     {
 	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
 	{
@@ -764,7 +764,6 @@ ST_Responder (event_t* ev)
 	if (plyr->playerstate == PST_DEAD)
 	{
 	    signed int an;
-	    extern void P_SpawnPlayer (mapthing_t* mthing);
 
 	    mt.x = plyr->mo->x >> FRACBITS;
 	    mt.y = plyr->mo->y >> FRACBITS;
@@ -1016,7 +1015,7 @@ ST_Responder (event_t* ev)
 		thinker_t *th;
 
 		// [crispy] let mobjs forget their target and tracer
-		for (th = thinkercap.next; th != &thinkercap; th = th->next)
+		for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj]; th = th->cnext)
 		{
 			if (th->function.acp1 == (actionf_p1)P_MobjThinker)
 			{
@@ -17,16 +17,26 @@
  Functions for presenting the information captured from the statistics
  buffer to a file.
 
+ [AP] Also the -runlog run log: a JSON line per level played, with its
+ load time, frame times and Archipelago progress next to the usual
+ statistics, written as each level ends so that a crash keeps the
+ levels before it.
+
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "d_player.h"
 #include "d_mode.h"
+#include "doomstat.h"
+#include "i_system.h"
+#include "i_timer.h"
 #include "m_argv.h"
 #include "m_misc.h"
+#include "apdoom.h"
 
 #include "statdump.h"
 
@@ -355,3 +365,217 @@ void StatDump(void)
     }
 }
 
+
+// [AP] Run log. Frame times go into a histogram of FRAMEBUCKET_US wide
+// buckets, the last of which holds every frame slower than that, so
+// a level of any length takes the same memory.
+
+#define FRAMEBUCKET_US 100
+#define NUMFRAMEBUCKETS 1000
+
+typedef struct
+{
+    int episode;
+    int map;
+    uint64_t start_us;
+    unsigned int load_us;
+    int start_checks;
+    int items_received;
+    unsigned int frames;
+    uint64_t frame_total_us;
+    unsigned int frame_buckets[NUMFRAMEBUCKETS];
+    unsigned int overruns;
+    uint64_t menu_us;
+    uint64_t levelselect_us;
+} runlevel_t;
+
+static FILE *runlog_file;
+static runlevel_t runlevel;
+static boolean runlevel_open;
+static uint64_t levelselect_us;
+static uint64_t last_frame_us;
+
+static int LevelChecks(int episode, int map)
+{
+    return ap_get_level_state(ap_make_level_index(episode, map))->check_count;
+}
+
+static unsigned int FramePercentile(int percent)
+{
+    unsigned int count = 0;
+    unsigned int target = (runlevel.frames * percent) / 100;
+    int i;
+
+    for (i = 0; i < NUMFRAMEBUCKETS - 1; ++i)
+    {
+        count += runlevel.frame_buckets[i];
+
+        if (count > target)
+        {
+            break;
+        }
+    }
+
+    return (i + 1) * FRAMEBUCKET_US;
+}
+
+void StatLevelEnd(const char *reason)
+{
+    const player_t *player = &players[consoleplayer];
+    ap_level_index_t idx;
+
+    if (runlog_file == NULL || !runlevel_open)
+    {
+        return;
+    }
+
+    runlevel_open = false;
+    idx = ap_make_level_index(runlevel.episode, runlevel.map);
+
+    fprintf(runlog_file,
+            "{\"time\":%ld,\"episode\":%i,\"map\":%i,\"skill\":%i,"
+            "\"exit\":\"%s\",\"leveltime_s\":%.2f,\"realtime_s\":%.2f,"
+            "\"load_ms\":%.1f,",
+            (long) time(NULL), runlevel.episode, runlevel.map,
+            (int) gameskill + 1, reason, (double) leveltime / TICRATE,
+            (I_GetTimeUS() - runlevel.start_us) / 1000000.0,
+            runlevel.load_us / 1000.0);
+    fprintf(runlog_file,
+            "\"frames\":%u,\"frame_avg_ms\":%.2f,\"frame_p99_ms\":%.1f,"
+            "\"tic_overruns\":%u,",
+            runlevel.frames,
+            runlevel.frames > 0 ? runlevel.frame_total_us / 1000.0
+                                  / runlevel.frames : 0.0,
+            runlevel.frames > 0 ? FramePercentile(99) / 1000.0 : 0.0,
+            runlevel.overruns);
+    fprintf(runlog_file,
+            "\"checks\":%i,\"checks_total\":%i,\"items_received\":%i,"
+            "\"menu_s\":%.2f,\"levelselect_s\":%.2f,",
+            LevelChecks(runlevel.episode, runlevel.map) - runlevel.start_checks,
+            ap_get_level_check_total(idx), runlevel.items_received,
+            runlevel.menu_us / 1000000.0,
+            runlevel.levelselect_us / 1000000.0);
+    fprintf(runlog_file,
+            "\"kills\":%i,\"maxkills\":%i,\"items\":%i,\"maxitems\":%i,"
+            "\"secrets\":%i,\"maxsecrets\":%i}\n",
+            player->killcount, totalkills, player->itemcount, totalitems,
+            player->secretcount, totalsecret);
+
+    fflush(runlog_file);
+}
+
+void StatLevelStart(unsigned int load_us)
+{
+    if (runlog_file == NULL)
+    {
+        return;
+    }
+
+    StatLevelEnd("left");
+
+    memset(&runlevel, 0, sizeof(runlevel));
+    runlevel.episode = gameepisode;
+    runlevel.map = gamemap;
+    runlevel.load_us = load_us;
+    runlevel.start_checks = LevelChecks(gameepisode, gamemap);
+    runlevel.levelselect_us = levelselect_us;
+    runlevel.start_us = I_GetTimeUS();
+    runlevel_open = true;
+
+    levelselect_us = 0;
+
+    // The level load isn't a frame
+    last_frame_us = runlevel.start_us;
+}
+
+void StatFrame(void)
+{
+    uint64_t now, frame_us;
+
+    if (runlog_file == NULL)
+    {
+        return;
+    }
+
+    now = I_GetTimeUS();
+    frame_us = now - last_frame_us;
+    last_frame_us = now;
+
+    if (gamestate == GS_LEVEL_SELECT)
+    {
+        levelselect_us += frame_us;
+    }
+
+    if (!runlevel_open)
+    {
+        return;
+    }
+
+    if (menuactive)
+    {
+        runlevel.menu_us += frame_us;
+    }
+
+    ++runlevel.frames;
+    runlevel.frame_total_us += frame_us;
+    ++runlevel.frame_buckets[frame_us / FRAMEBUCKET_US < NUMFRAMEBUCKETS
+                             ? frame_us / FRAMEBUCKET_US
+                             : NUMFRAMEBUCKETS - 1];
+
+    // Slower than a tic, so the game had to catch up
+
+    if (frame_us > 1000000 / TICRATE)
+    {
+        ++runlevel.overruns;
+    }
+}
+
+void StatItemReceived(void)
+{
+    if (runlevel_open)
+    {
+        ++runlevel.items_received;
+    }
+}
+
+static void CloseRunLog(void)
+{
+    StatLevelEnd("quit");
+    fclose(runlog_file);
+    runlog_file = NULL;
+}
+
+void StatRunLogInit(void)
+{
+    int i;
+
+    //!
+    // @category obscure
+    // @arg <filename>
+    //
+    // Append a line of JSON to the specified file for each level
+    // played: how it ended, its level and real time, load time,
+    // average and 99th percentile frame time, frames slower than a
+    // tic, Archipelago checks collected and items received, time in
+    // menus and in level select before it, and kills, items and
+    // secrets.
+    //
+
+    i = M_CheckParmWithArgs("-runlog", 1);
+
+    if (i == 0)
+    {
+        return;
+    }
+
+    runlog_file = M_fopen(myargv[i + 1], "a");
+
+    if (runlog_file == NULL)
+    {
+        fprintf(stderr, "StatRunLogInit: Unable to write %s\n",
+                myargv[i + 1]);
+        return;
+    }
+
+    I_AtExit(CloseRunLog, true);
+}
@@ -20,4 +20,11 @@
 void StatCopy(const wbstartstruct_t *stats);
 void StatDump(void);
 
+// [AP] -runlog
+void StatRunLogInit(void);
+void StatLevelStart(unsigned int load_us);
+void StatLevelEnd(const char *reason);
+void StatFrame(void);
+void StatItemReceived(void);
+
 #endif /* #ifndef DOOM_STATDUMP_H */
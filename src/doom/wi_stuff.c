@@ -406,6 +406,22 @@ static unsigned int	num_lnames;
 // Buffer storing the backdrop
 static patch_t *background;
 
+// [AP] Lumps cached by the last WI_loadData, for WI_unloadData
+static lumpindex_t *loadedlumps;
+static int numloadedlumps, maxloadedlumps;
+
+// [AP] The level select screen loads the intermission graphics again
+// every time it opens or changes episode. As many as fit in the budget
+// stay PU_STATIC for good instead of being released, so coming back to
+// the hub doesn't go to the disk.
+#define WI_RESIDENTBYTES (2 << 20)
+
+static byte *residentlumps; // Indexed by lump
+static unsigned int numresidentlumps;
+static size_t residentbytes;
+
+void WI_unloadData(void);
+
 //
 // CODE
 //
@@ -780,7 +796,6 @@ WI_drawTime
 
 void WI_End(void)
 {
-    void WI_unloadData(void);
     WI_unloadData();
 }
 
@@ -1900,17 +1915,78 @@ static void WI_loadUnloadData(load_callback_t callback)
     callback(name, &background);
 }
 
+// [AP] True if the lump is, or now is, kept for good
+static boolean WI_KeepResident(lumpindex_t lump)
+{
+    int size;
+
+    if (numresidentlumps < numlumps)
+    {
+	residentlumps = I_Realloc(residentlumps, numlumps);
+	memset(residentlumps + numresidentlumps, 0, numlumps - numresidentlumps);
+	numresidentlumps = numlumps;
+    }
+
+    if (residentlumps[lump])
+	return true;
+
+    size = W_LumpLength(lump);
+
+    if (residentbytes + size > WI_RESIDENTBYTES)
+	return false;
+
+    residentlumps[lump] = 1;
+    residentbytes += size;
+    return true;
+}
+
+patch_t *WI_CacheResident(const char *name)
+{
+    lumpindex_t lump = W_CheckNumForName(name);
+    patch_t *patch;
+
+    if (lump < 0)
+	return NULL;
+
+    patch = W_CacheLumpNum(lump, PU_STATIC);
+
+    if (!WI_KeepResident(lump))
+    {
+	W_ReleaseLumpNum(lump);
+	return NULL;
+    }
+
+    return patch;
+}
+
 static void WI_loadCallback(const char *name, patch_t **variable)
 {
+  lumpindex_t lump = W_CheckNumForName(name);
+
   // [crispy] prevent crashes with maps without map title graphics lump
-  if (W_CheckNumForName(name) != -1)
-    *variable = W_CacheLumpName(name, PU_STATIC);
+  if (lump != -1)
+  {
+    *variable = W_CacheLumpNum(lump, PU_STATIC);
+    WI_KeepResident(lump); // [AP]
+
+    if (numloadedlumps == maxloadedlumps)
+    {
+      maxloadedlumps = maxloadedlumps ? maxloadedlumps * 2 : 128;
+      loadedlumps = I_Realloc(loadedlumps, maxloadedlumps * sizeof(*loadedlumps));
+    }
+    loadedlumps[numloadedlumps++] = lump;
+  }
   else
     *variable = NULL;
 }
 
 void WI_loadData(void)
 {
+    // [AP] The level select screen loads again without unloading first
+    WI_unloadData();
+    if (lnames != NULL)
+	Z_Free(lnames);
+
     if (gamemode == commercial)
     {
 	NUMCMAPS = (crispy->havemap33) ? 33 : 32;
@@ -1941,12 +2017,25 @@ void WI_loadData(void)
 
 static void WI_unloadCallback(const char *name, patch_t **variable)
 {
-    W_ReleaseLumpName(name);
     *variable = NULL;
 }
 
 void WI_unloadData(void)
 {
+    int i;
+
+    if (numloadedlumps == 0)
+	return;
+
+    // [AP] By lump and not by name, the episode may have changed since.
+    // Resident ones stay.
+    for (i = 0; i < numloadedlumps; i++)
+    {
+	if (!residentlumps[loadedlumps[i]])
+	    W_ReleaseLumpNum(loadedlumps[i]);
+    }
+    numloadedlumps = 0;
+
     WI_loadUnloadData(WI_unloadCallback);
 
     // We do not free these lumps as they are shared with the status
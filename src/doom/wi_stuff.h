@@ -22,6 +22,7 @@
 //#include "v_video.h"
 
 #include "doomdef.h"
+#include "v_patch.h" // [AP] patch_t
 
 // States for the intermission
 
@@ -45,4 +46,8 @@ void WI_Start(wbstartstruct_t*	 wbstartstruct);
 // Shut down the intermission screen
 void WI_End(void);
 
+// [AP] Caches a patch PU_STATIC for good, for the level select screen.
+// NULL if it's missing or over the budget, use W_CacheLumpName then.
+patch_t *WI_CacheResident(const char *name);
+
 #endif
@@ -4,12 +4,13 @@
 #include "doomdef.h"
 #include "i_video.h"
 #include <stdlib.h>
+#include "ap_msg_log.h"
+#include "m_misc.h"
 
 
 #define HU_APMSGTIMEOUT	    (5*TICRATE)
 #define HU_MAXLINES		    4
 #define HU_MAXLINELENGTH	80
-#define HU_MAX_LINE_BUFFER  500
 
 
 typedef struct
@@ -21,75 +22,34 @@ typedef struct
 } ap_message_t;
 
 
-static char ap_message_buffer[HU_MAX_LINE_BUFFER][HU_MAXLINELENGTH + 1];
 static ap_message_t ap_messages[HU_MAXLINES];
-static int ap_message_buffer_count = 0;
 static int ap_message_anim = 0;
 
 
 void HU_AddAPLine(const char* line, int len)
 {
-    char baked_line[HU_MAXLINELENGTH + 1];
-    memcpy(baked_line, line, len);
-    baked_line[len] = '\0';
-
-    // Add to buffer
-    if (ap_message_buffer_count >= HU_MAX_LINE_BUFFER)
-        return; // No more room
-    memcpy(ap_message_buffer[ap_message_buffer_count], baked_line, len + 1);
-    ap_message_buffer_count++;
+    ap_msg_log_push(line, len);
 }
 
 
 void HU_AddAPMessage(const char* message)
 {
-    int len = strlen(message);
-
-    int i = 0;
-    int j = 0;
-    char baked_line[HU_MAXLINELENGTH + 1];
-    baked_line[HU_MAXLINELENGTH] = '\0';
-    int word_start = 0;
-    while (i < len)
+    static int glyph_widths[256];
+    static boolean glyph_widths_set = false;
+
+    if (!glyph_widths_set)
     {
-        if (message[j] == ' ')
-        {
-            word_start = j;
-        }
-        if (message[j] != '\n')
+        for (int c = 0; c < 256; ++c)
         {
-            int w = MN_TextAWidth_len(message + i, j - i);
-            if (w >= ORIGWIDTH + WIDESCREENDELTA - 8 && word_start == i)
-            {
-                if (j > i && word_start == i) --j;
-            }
+            char glyph[2] = {(char)c, '\0'};
+            if (c == '~')
+                glyph_widths[c] = 0; // Always skipped with the next char
             else
-            {
-                if (w < ORIGWIDTH + WIDESCREENDELTA - 8 && (j - i) + 2 < HU_MAXLINELENGTH && j < len)
-                {
-                    j++;
-                    continue;
-                }
-                if (j < len) j = word_start;
-            }
-        }
-        else
-        {
-            j++;
-            word_start = j;
-        }
-        memcpy(baked_line + 2, message + i, j - i);
-        baked_line[0] = '~'; baked_line[1] = '2'; // Always make sure to use white
-        HU_AddAPLine(baked_line, (j - i) + 2);
-        i = j;
-        word_start = j;
-        while (message[i] == ' ')
-        {
-            i++;
-            j++;
-            word_start++;
+                glyph_widths[c] = (c < 128) ? MN_TextAWidth_len(glyph, 1) : 4;
         }
+        glyph_widths_set = true;
     }
+    ap_msg_log_push_wrapped(message, glyph_widths, ORIGWIDTH + WIDESCREENDELTA - 8);
 }
 
 
@@ -133,23 +93,17 @@ void HU_UpdateAPMessagePosition(int i)
 
 void HU_TickAPMessages()
 {
-    while (HU_HasAPMessageRoom() && ap_message_buffer_count && ap_message_anim == 0)
+    while (HU_HasAPMessageRoom() && ap_msg_log_count() && ap_message_anim == 0)
     {
         // Shift currents
         for (int i = 3; i > 0; --i)
         {
             memcpy(&ap_messages[i], &ap_messages[i - 1], sizeof(ap_message_t));
         }
-	    memcpy(ap_messages[0].message, ap_message_buffer[0], HU_MAXLINELENGTH);
+	    M_StringCopy(ap_messages[0].message, ap_msg_log_front(), HU_MAXLINELENGTH);
 	    ap_messages[0].on = true;
 	    ap_messages[0].counter = HU_APMSGTIMEOUT;
-
-        // Shift buffers
-        for (int i = 1; i < ap_message_buffer_count; ++i)
-        {
-            memcpy(ap_message_buffer[i - 1], ap_message_buffer[i], HU_MAXLINELENGTH + 1);
-        }
-        ap_message_buffer_count--;
+        ap_msg_log_pop();
     }
 
     if (ap_message_anim == 0)
@@ -158,7 +112,7 @@ void HU_TickAPMessages()
         {
             if (ap_messages[i].counter)
             {
-                ap_messages[i].counter -= max(1, ap_message_buffer_count / 6);
+                ap_messages[i].counter -= max(1, ap_msg_log_count() / 6);
                 if (ap_messages[i].counter <= 0)
                 {
                     ap_messages[i].counter = 0;
@@ -176,7 +130,7 @@ void HU_TickAPMessages()
 
     if (ap_message_anim > 0)
     {
-        ap_message_anim -= min(4, max(1, ap_message_buffer_count / 10));
+        ap_message_anim -= min(4, max(1, ap_msg_log_count() / 10));
         if (ap_message_anim < 0) ap_message_anim = 0;
     }
 }
@@ -184,7 +138,7 @@ void HU_TickAPMessages()
 
 void HU_ClearAPMessages()
 {
-    ap_message_buffer_count = 0;
+    ap_msg_log_clear();
     for (int i = 0; i < HU_MAXLINES; ++i)
         ap_messages[i].on = false;
 }
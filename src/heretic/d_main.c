@@ -33,6 +33,7 @@
 #include "i_input.h"
 #include "i_joystick.h"
 #include "i_sound.h"
+#include "i_startup.h" // [AP]
 #include "i_swap.h" // [crispy] SHORT()
 #include "i_system.h"
 #include "i_timer.h"
@@ -53,6 +54,7 @@
 
 #include "level_select.h" // [ap]
 #include "ap_msg.h"
+#include "ap_msg_log.h"
 #include "ap_notif.h"
 
 #define CT_KEY_GREEN    'g'
@@ -115,16 +117,22 @@ void on_ap_victory()
 }
 
 
+// [AP] apdoom_init as a startup stage
+static int D_StartAP(void *settings)
+{
+    return apdoom_init(settings);
+}
+
+
 boolean P_GiveArmor(player_t* player, int armortype);
 boolean P_GiveWeapon(player_t* player, weapontype_t weapon, boolean dropped);
 
 
-// Kind of a copy of P_TouchSpecialThing
-void on_ap_give_item(int doom_type, int ep, int map)
+// Kind of a copy of P_TouchSpecialThing. Returns the pickup sound, -1 when
+// the item changed nothing.
+static int give_ap_item(player_t* player, ap_level_info_t* level_info, int doom_type, int ep, int map)
 {
-    player_t* player = &players[consoleplayer];
     int sound = sfx_itemup;
-    ap_level_info_t* level_info = ap_get_level_info(ap_make_level_index(gameepisode, gamemap));
 
     switch (doom_type)
     {
@@ -269,37 +277,102 @@ void on_ap_give_item(int doom_type, int ep, int map)
         // Junk
         case 12: // Crystal Geode
             if (!P_GiveAmmo(player, am_goldwand, AMMO_GWND_HEFTY))
-                return;
+                return -1;
             player->message = DEH_String(TXT_AMMOGOLDWAND2);
             break;
         case 55: // Energy Orb
             if (!P_GiveAmmo(player, am_blaster, AMMO_BLSR_HEFTY))
-                return;
+                return -1;
             player->message = DEH_String(TXT_AMMOBLASTER2);
             break;
         case 21: // Greater Runes
             if (!P_GiveAmmo(player, am_skullrod, AMMO_SKRD_HEFTY))
-                return;
+                return -1;
             player->message = DEH_String(TXT_AMMOSKULLROD2);
             break;
         case 23: // Inferno Orb
             if (!P_GiveAmmo(player, am_phoenixrod, AMMO_PHRD_HEFTY))
-                return;
+                return -1;
             player->message = DEH_String(TXT_AMMOPHOENIXROD2);
             break;
         case 16: // Pile of Mace Spheres
             if (!P_GiveAmmo(player, am_mace, AMMO_MACE_HEFTY))
-                return;
+                return -1;
             player->message = DEH_String(TXT_AMMOMACE2);
             break;
         case 19: // Quiver of Ethereal Arrows
             if (!P_GiveAmmo(player, am_crossbow, AMMO_CBOW_HEFTY))
-                return;
+                return -1;
             player->message = DEH_String(TXT_AMMOCROSSBOW2);
             break;
     }
 
-	S_StartSound(NULL, sound); // [NS] Fallback to itemup.
+    return sound;
+}
+
+
+// Higher is more important, when several items only get one sound
+static int ap_sound_priority(int sound)
+{
+    if (sound == sfx_keyup) return 3;
+    if (sound == sfx_wpnup) return 2;
+    if (sound == sfx_itemup) return 1;
+    return 0;
+}
+
+
+void on_ap_give_item(int doom_type, int ep, int map)
+{
+    player_t* player = &players[consoleplayer];
+    ap_level_info_t* level_info = ap_get_current_level(gameepisode, gamemap)->info;
+    int sound;
+
+    sound = give_ap_item(player, level_info, doom_type, ep, map);
+    if (sound != -1)
+        S_StartSound(NULL, sound);
+}
+
+
+// [AP] Everything that was received while in the menu, at once. Still one
+// message and one sound, like picking up a single item.
+void on_ap_give_items(const ap_given_item_t* items, int count)
+{
+    static char summary[64];
+    player_t* player = &players[consoleplayer];
+    ap_level_info_t* level_info = ap_get_current_level(gameepisode, gamemap)->info;
+    const char* previous_message = player->message;
+    const char* message = NULL;
+    int message_count = 0;
+    int best_sound = -1;
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        int sound;
+
+        player->message = NULL;
+        sound = give_ap_item(player, level_info, items[i].doom_type, items[i].ep, items[i].map);
+        if (player->message)
+        {
+            message = player->message;
+            message_count++;
+        }
+        if (ap_sound_priority(sound) > ap_sound_priority(best_sound))
+            best_sound = sound;
+    }
+
+    if (message_count > 1)
+    {
+        M_snprintf(summary, sizeof(summary), "Received %d items", count);
+        player->message = summary;
+    }
+    else
+    {
+        player->message = message ? message : previous_message;
+    }
+
+    if (best_sound != -1)
+        S_StartSound(NULL, best_sound);
 }
 
 //---------------------------------------------------------------------------
@@ -415,8 +488,8 @@ static void CrispyDrawStats (void)
         MN_DrTextA(str, left_widget_x, 1*height);
         left_widget_w = MN_TextAWidth(str); // Assume that kills is longest string
 
-        ap_level_state_t* level_state = ap_get_level_state(ap_make_level_index(gameepisode, gamemap));
-        const ap_level_info_t* level_info = ap_get_level_info(ap_make_level_index(gameepisode, gamemap));
+        ap_level_state_t* level_state = ap_get_current_level(gameepisode, gamemap)->state;
+        const ap_level_info_t* level_info = ap_get_current_level(gameepisode, gamemap)->info;
         M_snprintf(str, sizeof(str), "I %d/%d", level_state->check_count, level_info->check_count - level_info->sanity_check_count);
         MN_DrTextA(str, left_widget_x, 2*height);
 
@@ -1147,6 +1220,7 @@ void D_DoomMain(void)
     char file[256];
     char demolumpname[9];
     ap_settings_t ap_settings;
+    startuptask_t* ap_task;
     memset(&ap_settings, 0, sizeof(ap_settings));
 
     I_PrintBanner(PACKAGE_STRING);
@@ -1382,6 +1456,17 @@ void D_DoomMain(void)
     if (M_CheckParm("-apdeathlinkoff"))
         ap_settings.force_deathlink_off = 1;
 
+    int tracker_port_id = M_CheckParmWithArgs("-aptracker", 1);
+    if (tracker_port_id)
+        ap_settings.tracker_port = atoi(myargv[tracker_port_id + 1]);
+
+    if (M_CheckParm("-apstate-export-json"))
+        ap_settings.export_state_json = 1;
+
+    int message_log_id = M_CheckParmWithArgs("-apmessagelog", 1);
+    if (message_log_id)
+        ap_msg_log_open(myargv[message_log_id + 1]);
+
     int reset_level_on_death_id = M_CheckParmWithArgs("-apresetlevelondeath", 1);
     if (reset_level_on_death_id)
     {
@@ -1411,11 +1496,12 @@ void D_DoomMain(void)
     ap_settings.passwd = password;
     ap_settings.message_callback = on_ap_message;
     ap_settings.give_item_callback = on_ap_give_item;
+    ap_settings.give_items_callback = on_ap_give_items;
     ap_settings.victory_callback = on_ap_victory;
-    if (!apdoom_init(&ap_settings))
-    {
-	    I_Error("Failed to initialize Archipelago.");
-    }
+
+    // [AP] Connecting waits on the server, so it's done while the WADs,
+    // menus and graphics load, which don't need the AP state
+    ap_task = I_StartupTask("AP connect", D_StartAP, &ap_settings);
 
 
     DEH_printf("W_Init: Init WADfiles.\n");
@@ -1712,6 +1798,11 @@ void D_DoomMain(void)
     R_Init();
     tprintf("\n", 0);
 
+    if (!I_StartupWait(ap_task))
+    {
+	    I_Error("Failed to initialize Archipelago.");
+    }
+
     tprintf(DEH_String("P_Init: Init Playloop state.\n"), 1);
     hprintf(DEH_String("Init game engine."));
     P_Init();
@@ -1421,6 +1421,12 @@ void G_Ticker(void)
                     HU_AddAPMessage("Death by Deathlink");
                     P_KillMobj_Real(NULL, players[consoleplayer].mo, false);
                 }
+                if (players[consoleplayer].mo)
+                {
+                    mobj_t *mo = players[consoleplayer].mo;
+                    ap_report_player_position(mo->x >> FRACBITS, mo->y >> FRACBITS,
+                                              (int)((mo->angle >> 16) * 360 >> 16));
+                }
             }
             break;
         case GS_INTERMISSION:
@@ -1783,7 +1789,7 @@ void set_ap_player_states()
         if (i == pw_flight || i == pw_allmap) continue;
         p->powers[i] = ap_state.player_state.powers[i];
     }
-    p->powers[pw_allmap] = ap_get_level_state(ap_make_level_index(gameepisode, gamemap))->has_map;
+    p->powers[pw_allmap] = ap_get_current_level(gameepisode, gamemap)->state->has_map;
     for (int i = 0; i < NUMWEAPONS; ++i)
         p->weaponowned[i] = ap_state.player_state.weapon_owned[i];
     for (int i = 0; i < NUMAMMO; ++i)
@@ -1809,8 +1815,8 @@ void set_ap_player_states()
     }
 
     // Cards
-    ap_level_state_t* level_state = ap_get_level_state(ap_make_level_index(gameepisode, gamemap));
-    ap_level_info_t* level_info = ap_get_level_info(ap_make_level_index(gameepisode, gamemap));
+    ap_level_state_t* level_state = ap_get_current_level(gameepisode, gamemap)->state;
+    ap_level_info_t* level_info = ap_get_current_level(gameepisode, gamemap)->info;
 
     p->keys[0] = level_state->keys[0];
     p->keys[1] = level_state->keys[1];
@@ -1933,7 +1939,7 @@ void G_DoCompleted(void)
 
     // [AP]
     cache_ap_player_state();
-    apdoom_complete_level(ap_make_level_index(gameepisode, gamemap));
+    apdoom_complete_level(ap_get_current_level(gameepisode, gamemap)->idx);
     apdoom_save_state();
     G_DoSaveGame();
 
@@ -46,16 +46,8 @@ void P_RemoveMobj(mobj_t* mobj);
 
 void A_check_collected(mobj_t *actor, player_t *player, pspdef_t *psp)
 {
-	int j, lenj;
-	ap_level_state_t* level_state = ap_get_level_state(ap_make_level_index(gameepisode, gamemap));
-    for (j = 0, lenj = level_state->check_count; j < lenj; ++j)
-    {
-        if (level_state->checks[j] == actor->index)
-        {
-			P_RemoveMobj(actor);
-			return;
-        }
-    }
+    if (ap_is_location_checked(ap_get_current_level(gameepisode, gamemap)->idx, actor->index))
+        P_RemoveMobj(actor);
 }
 
 
@@ -22,12 +22,13 @@
 #include "i_swap.h"
 #include "i_system.h"
 #include "m_misc.h"
+#include "memio.h"
 #include "p_local.h"
 #include "v_video.h"
 
 #include "apdoom.h"
 
-static FILE *SaveGameFP;
+static MEMFILE *SaveGameFP;
 
 int vanilla_savegame_limit = 1;
 
@@ -64,14 +65,29 @@ char *SV_Filename(int slot)
 //
 //==========================================================================
 
+// The whole savegame is held in memory: built up and written out by
+// SV_Close, or read in by SV_OpenRead. A loaded one stays around until
+// the next savegame is opened.
+
+static void SV_Release(void)
+{
+    if (SaveGameFP != NULL)
+    {
+        mem_fclose(SaveGameFP);
+        SaveGameFP = NULL;
+    }
+}
+
 void SV_Open(char *fileName)
 {
-    SaveGameFP = M_fopen(fileName, "wb");
+    SV_Release();
+    SaveGameFP = mem_fopen_write();
 }
 
 void SV_OpenRead(char *filename)
 {
-    SaveGameFP = M_fopen(filename, "rb");
+    SV_Release();
+    SaveGameFP = mem_fopen_file(filename);
 
     if (SaveGameFP == NULL)
     {
@@ -91,12 +107,17 @@ void SV_Close(char *fileName)
 
     // Enforce the same savegame size limit as in Vanilla Heretic
 
-    if (vanilla_savegame_limit && ftell(SaveGameFP) > SAVEGAMESIZE)
+    if (vanilla_savegame_limit && mem_ftell(SaveGameFP) > SAVEGAMESIZE)
     {
         I_Error("Savegame buffer overrun");
     }
 
-    fclose(SaveGameFP);
+    if (!mem_fwrite_file(SaveGameFP, fileName))
+    {
+        I_Error("Could not save game %s", fileName);
+    }
+
+    SV_Release();
 }
 
 //==========================================================================
@@ -107,12 +128,12 @@ void SV_Close(char *fileName)
 
 void SV_Write(void *buffer, int size)
 {
-    fwrite(buffer, size, 1, SaveGameFP);
+    mem_fwrite(buffer, size, 1, SaveGameFP);
 }
 
 void SV_WriteByte(byte val)
 {
-    SV_Write(&val, sizeof(byte));
+    mem_fputc(val, SaveGameFP);
 }
 
 void SV_WriteWord(unsigned short val)
@@ -142,7 +163,7 @@ void SV_WritePtr(const void *ptr)
 
 void SV_Read(void *buffer, int size)
 {
-    int retval = fread(buffer, 1, size, SaveGameFP);
+    int retval = mem_fread(buffer, 1, size, SaveGameFP);
     if (retval != size)
     {
         I_Error("Incomplete read in SV_Read: Expected %d, got %d bytes",
@@ -152,8 +173,13 @@ void SV_Read(void *buffer, int size)
 
 byte SV_ReadByte(void)
 {
-    byte result;
-    SV_Read(&result, sizeof(byte));
+    int result = mem_fgetc(SaveGameFP);
+
+    if (result == EOF)
+    {
+        I_Error("Incomplete read in SV_Read: Expected 1, got 0 bytes");
+    }
+
     return result;
 }
 
@@ -28,8 +28,9 @@
 #include "s_sound.h"
 #include "p_extnodes.h"
 
-#include "apheretic_c_def.h"
 #include "apdoom.h"
+#include "ap_notif.h"
+#include "ap_rng.h"
 
 void P_SpawnMapThing(mapthing_t * mthing, int index);
 
@@ -565,7 +566,7 @@ void get_fit_dimensions(fixed_t x, fixed_t y, fixed_t* fit_radius, fixed_t* fit_
 void P_LoadThings(int lump)
 {
     byte *data;
-    int i, j;
+    int i;
     mapthing_t spawnthing;
     mapthing_t spawnthing_player1_start;
     mapthing_t *mt;
@@ -575,24 +576,40 @@ void P_LoadThings(int lump)
     data = W_CacheLumpNum(lump, PU_STATIC);
     numthings = W_LumpLength(lump) / sizeof(mapthing_t);
 
-    // Generate unique random seed from ap seed + level
-    const char* ap_seed = apdoom_get_seed();
-    unsigned long long seed = hash_seed(ap_seed);
-    seed += gameepisode * 9 + gamemap;
-    srand(seed);
+    // Sized from the THINGS lump, large PWAD maps have no fixed cap
+    int* things_type_remap = Z_Malloc(numthings * sizeof(int), PU_LEVEL, NULL);
 
-    int things_type_remap[1024] = {0};
+    // Randomized types are cached per level, reloading it skips the shuffle
+    ap_level_index_t level_idx = ap_get_current_level(gameepisode, gamemap)->idx;
+    int remap_key = ap_state.random_monsters | (ap_state.random_items << 4) | (gameskill << 8);
+    const int* cached_remap = ap_get_cached_type_remap(level_idx, remap_key, numthings);
+    boolean randomize = cached_remap == NULL;
 
-    mt = (mapthing_t *)data;
-    for (i = 0; i < numthings; i++, mt++)
+    ap_rng_t rng;
+
+    if (cached_remap)
     {
-        things_type_remap[i] = mt->type;
+        memcpy(things_type_remap, cached_remap, sizeof(int) * numthings);
+    }
+    else
+    {
+        // Generate unique random seed from ap seed + level
+        const char* ap_seed = apdoom_get_seed();
+        unsigned long long seed = hash_seed(ap_seed);
+        seed += gameepisode * 9 + gamemap;
+        ap_rng_seed(&rng, seed);
+
+        mt = (mapthing_t *)data;
+        for (i = 0; i < numthings; i++, mt++)
+        {
+            things_type_remap[i] = mt->type;
+        }
     }
     
 #define E1M8_CUTOFF_OFFSET -1984
 
     int do_random_monsters = ap_state.random_monsters;
-    if (do_random_monsters > 0)
+    if (randomize && do_random_monsters > 0)
     {
         // Make sure at the right difficulty level
         if (gameskill == sk_baby)
@@ -602,9 +619,9 @@ void P_LoadThings(int lump)
         else
             bit = 1<<(gameskill-1);
 
-        random_monster_def_t* monsters[1024] = {0};
+        random_monster_def_t** monsters = Z_Malloc(numthings * sizeof(random_monster_def_t*), PU_STATIC, NULL);
         int monster_count = 0;
-        monster_spawn_def_t spawns[1024] = {0};
+        monster_spawn_def_t* spawns = Z_Malloc(numthings * sizeof(monster_spawn_def_t), PU_STATIC, NULL);
         int spawn_count = 0;
 
         // Collect spawn points
@@ -665,12 +682,12 @@ void P_LoadThings(int lump)
 
             while (monster_count < spawn_count)
             {
-                int rnd = rand() % total;
+                int rnd = ap_rng_range(&rng, total);
                 for (int i = 0; i < NUM_RMC; ++i)
                 {
                     if (rnd < ratios[i])
                     {
-                        rnd = rand() % rmc_ratios[i];
+                        rnd = ap_rng_range(&rng, rmc_ratios[i]);
                         for (int j = 0; j < defs_by_rmc_count[i]; ++j)
                         {
                             if (rnd < defs_by_rmc[i][j]->frequency)
@@ -698,7 +715,7 @@ void P_LoadThings(int lump)
 
             while (monster_count < spawn_count)
             {
-                int rnd = rand() % total;
+                int rnd = ap_rng_range(&rng, total);
                 for (int i = 0; i < monster_def_count; ++i)
                 {
                     random_monster_def_t* monster = &random_monster_defs[i];
@@ -722,7 +739,7 @@ void P_LoadThings(int lump)
                     iron_lynch_count++;
             while (iron_lynch_count < 2)
             {
-                int i = rand() % monster_count;
+                int i = ap_rng_range(&rng, monster_count);
                 if (monsters[i]->doom_type != 6)
                 {
                     monsters[i] = &random_monster_defs[12];
@@ -734,7 +751,7 @@ void P_LoadThings(int lump)
         // Randomly pick them until empty, and place them in different spots
         for (i = 0; i < spawn_count; i++)
         {
-            int idx = rand() % monster_count;
+            int idx = ap_rng_range(&rng, monster_count);
             spawns[i].monster = monsters[idx];
             monsters[idx] = monsters[monster_count - 1];
             monster_count--;
@@ -751,7 +768,7 @@ void P_LoadThings(int lump)
                 int tries = 1000;
                 while (tries--)
                 {
-                    int j = rand() % spawn_count;
+                    int j = ap_rng_range(&rng, spawn_count);
                     if (j == i) continue;
                     monster_spawn_def_t* spawn2 = &spawns[j];
                     if (spawn1->monster->height <= spawn2->fit_height &&
@@ -774,9 +791,12 @@ void P_LoadThings(int lump)
             monster_spawn_def_t* spawn = &spawns[i];
             things_type_remap[spawn->index] = spawn->monster->doom_type;
         }
+
+        Z_Free(spawns);
+        Z_Free(monsters);
     }
 
-    if (ap_state.random_items > 0)
+    if (randomize && ap_state.random_items > 0)
     {
         // Make sure at the right difficulty level
         if (gameskill == sk_baby)
@@ -788,9 +808,9 @@ void P_LoadThings(int lump)
 
         if (ap_state.random_items == 1) // Shuffle
         {
-            int items[1024];
+            int* items = Z_Malloc(numthings * sizeof(int), PU_STATIC, NULL);
             int item_count = 0;
-            int indices[1024];
+            int* indices = Z_Malloc(numthings * sizeof(int), PU_STATIC, NULL);
             int index_count = 0;
 
             // Collect all items
@@ -830,11 +850,14 @@ void P_LoadThings(int lump)
             mt = (mapthing_t *)data;
             for (i = 0; i < index_count; i++)
             {
-                int idx = rand() % item_count;
+                int idx = ap_rng_range(&rng, item_count);
                 things_type_remap[indices[i]] = items[idx];
                 items[idx] = items[item_count - 1];
                 item_count--;
             }
+
+            Z_Free(indices);
+            Z_Free(items);
         }
         else if (ap_state.random_items == 2) // Random balanced
         {
@@ -909,10 +932,10 @@ void P_LoadThings(int lump)
                     case 10: // Wand Crystal
                     case 81: // Crystal Vial
                     {
-                        int rnd = rand() % total;
+                        int rnd = ap_rng_range(&rng, total);
                         if (rnd < ratios[0])
                         {
-                            switch (rand()%2)
+                            switch (ap_rng_range(&rng, 2))
                             {
                                 case 0: things_type_remap[i] = 81; break; // Crystal Vial
                                 case 1: things_type_remap[i] = 10; break; // Wand Crystal
@@ -921,7 +944,7 @@ void P_LoadThings(int lump)
                         }
                         else if (rnd < ratios[0] + ratios[1])
                         {
-                            switch (rand()%4)
+                            switch (ap_rng_range(&rng, 4))
                             {
                                 case 0: things_type_remap[i] = 54; break; // Claw Orb
                                 case 1: things_type_remap[i] = 22; break; // Flame Orb
@@ -931,7 +954,7 @@ void P_LoadThings(int lump)
                         }
                         else
                         {
-                            switch (rand()%6)
+                            switch (ap_rng_range(&rng, 6))
                             {
                                 case 0: things_type_remap[i] = 12; break; // Crystal Geode
                                 case 1: things_type_remap[i] = 55; break; // Energy Orb
@@ -950,6 +973,16 @@ void P_LoadThings(int lump)
     }
 
 
+    if (randomize)
+        ap_set_cached_type_remap(level_idx, remap_key, things_type_remap, numthings);
+
+    // Validate that the location indices match what we have in our data. If they don't then the WAD is not the same, we can't continue
+    const unsigned char* spawn_plan = ap_build_spawn_plan(level_idx, things_type_remap, numthings);
+    if (!spawn_plan)
+    {
+        I_Error("WAD file doesn't match the one used to generate the logic.\nTo make sure it works as intended, get HERETIC.WAD from the steam releases.");
+    }
+
     mt = (mapthing_t *) data;
     for (i = 0; i < numthings; i++, mt++)
     {
@@ -966,37 +999,11 @@ void P_LoadThings(int lump)
         int type_before = spawnthing.type;
 
         // Replace AP locations with AP item
-        if (is_heretic_type_ap_location(spawnthing.type))
+        switch (spawn_plan[i])
         {
-            // Validate that the location index matches what we have in our data. If it doesn't then the WAD is not the same, we can't continue
-            int ret = ap_validate_doom_location(ap_make_level_index(gameepisode, gamemap), spawnthing.type, i);
-            if (ret == -1)
-            {
-                I_Error("WAD file doesn't match the one used to generate the logic.\nTo make sure it works as intended, get HERETIC.WAD from the steam releases.");
-            }
-            else if (ret == 0)
-            {
-                continue; // Skip it
-            }
-            else if (ret == 1)
-            {
-                if (apdoom_is_location_progression(ap_make_level_index(gameepisode, gamemap), i))
-                    spawnthing.type = 20001;
-                else
-                    spawnthing.type = 20000;
-                int skip = 0;
-                ap_level_state_t* level_state = ap_get_level_state(ap_make_level_index(gameepisode, gamemap));
-                for (j = 0; j < level_state->check_count; ++j)
-                {
-                    if (level_state->checks[j] == i)
-                    {
-                        skip = 1;
-                        break;
-                    }
-                }
-                if (skip)
-                    continue;
-            }
+            case AP_SPAWN_SKIP: continue;
+            case AP_SPAWN_AP_ITEM: spawnthing.type = 20000; break;
+            case AP_SPAWN_AP_PROGRESSION: spawnthing.type = 20001; break;
         }
 
         // [AP] On player start 1, put level select teleport "HUB"
@@ -1460,6 +1467,9 @@ void P_SetupLevel(int episode, int map, int playermask, skill_t skill)
     P_LoadThings(lumpnum + ML_THINGS);
     P_CloseWeapons();
 
+    // [AP] Build notification icons now rather than on first pickup
+    ap_notif_precache();
+
 //
 // if deathmatch, randomly spawn the active players
 //
@@ -17,6 +17,7 @@
 
 #include "doomdef.h"
 #include "deh_str.h"
+#include "i_simd.h"
 #include "r_local.h"
 #include "i_video.h"
 #include "v_video.h"
@@ -219,16 +220,30 @@ void R_DrawTLColumn(void)
     }
     else // texture height is a power of 2 -- killough
     {
-        do
+        // [AP] Texel indices come a batch at a time from I_ColumnSpots
+        // (SIMD when available); the lookups stay per pixel. The tables
+        // are read through locals, which the stores through dest can't
+        // alias.
+        const byte *source = dc_source;
+        const lighttable_t *colormap = dc_colormap[0];
+        const byte *tint = tinttable;
+
+        ++count;
+        while (count > 0)
         {
-            *dest =
-                tinttable[((*dest) << 8) +
-                          dc_colormap[0][dc_source[(frac >> FRACBITS) & heightmask]]];
-
-            dest += SCREENWIDTH;
-            frac += fracstep;
+            int spots[I_COLUMN_SPOTS_BATCH];
+            int n = MIN(count, I_COLUMN_SPOTS_BATCH);
+            int i;
+
+            I_ColumnSpots(spots, frac, fracstep, heightmask, n);
+            for (i = 0; i < n; i++)
+            {
+                *dest = tint[(*dest << 8) + colormap[source[spots[i]]]];
+                dest += SCREENWIDTH;
+            }
+            frac = (fixed_t) ((unsigned int) frac + n * (unsigned int) fracstep);
+            count -= n;
         }
-        while (count--);
     }
 }
 
@@ -361,7 +376,7 @@ void R_DrawSpan(void)
 {
     fixed_t xfrac, yfrac;
     byte *dest;
-    int count, spot;
+    int count;
 
 #ifdef RANGECHECK
     if (ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= SCREENWIDTH
@@ -374,24 +389,32 @@ void R_DrawSpan(void)
     yfrac = ds_yfrac;
 
     dest = ylookup[ds_y] + columnofs[ds_x1];
-    count = ds_x2 - ds_x1;
-    do
+    count = ds_x2 - ds_x1 + 1;
+    // [AP] Texture indices come a batch at a time from I_SpanSpots (SIMD
+    // when available); the lookups stay per pixel.
+    while (count > 0)
     {
-        byte source;
-        spot = ((yfrac >> (16 - 6)) & (63 * 64)) + ((xfrac >> 16) & 63);
-        source = ds_source[spot];
-        *dest++ = ds_colormap[ds_brightmap[source]][source];
-        xfrac += ds_xstep;
-        yfrac += ds_ystep;
+        int spots[I_SPAN_SPOTS_BATCH];
+        int n = MIN(count, I_SPAN_SPOTS_BATCH);
+        int i;
+
+        I_SpanSpots(spots, xfrac, yfrac, ds_xstep, ds_ystep, n);
+        for (i = 0; i < n; i++)
+        {
+            byte source = ds_source[spots[i]];
+            *dest++ = ds_colormap[ds_brightmap[source]][source];
+        }
+        xfrac = (fixed_t) ((unsigned int) xfrac + n * (unsigned int) ds_xstep);
+        yfrac = (fixed_t) ((unsigned int) yfrac + n * (unsigned int) ds_ystep);
+        count -= n;
     }
-    while (count--);
 }
 
 void R_DrawSpanLow(void)
 {
     fixed_t xfrac, yfrac;
     byte *dest;
-    int count, spot;
+    int count;
 
 #ifdef RANGECHECK
     if (ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= SCREENWIDTH
@@ -404,17 +427,23 @@ void R_DrawSpanLow(void)
     yfrac = ds_yfrac;
 
     dest = ylookup[ds_y] + columnofs[ds_x1];
-    count = ds_x2 - ds_x1;
-    do
+    count = ds_x2 - ds_x1 + 1;
+    while (count > 0)
     {
-        byte source;
-        spot = ((yfrac >> (16 - 6)) & (63 * 64)) + ((xfrac >> 16) & 63);
-        source = ds_source[spot];
-        *dest = ds_colormap[ds_brightmap[source]][source];
-        xfrac += ds_xstep;
-        yfrac += ds_ystep;
+        int spots[I_SPAN_SPOTS_BATCH];
+        int n = MIN(count, I_SPAN_SPOTS_BATCH);
+        int i;
+
+        I_SpanSpots(spots, xfrac, yfrac, ds_xstep, ds_ystep, n);
+        for (i = 0; i < n; i++)
+        {
+            byte source = ds_source[spots[i]];
+            *dest = ds_colormap[ds_brightmap[source]][source];
+        }
+        xfrac = (fixed_t) ((unsigned int) xfrac + n * (unsigned int) ds_xstep);
+        yfrac = (fixed_t) ((unsigned int) yfrac + n * (unsigned int) ds_ystep);
+        count -= n;
     }
-    while (count--);
 }
 
 
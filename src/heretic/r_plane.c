@@ -22,6 +22,7 @@
 #include "r_bmaps.h" // [crispy] R_BrightmapForTexName()
 #include "r_local.h"
 #include "r_swirl.h" // [crispy] R_DistortedFlat()
+#include "r_visplane.h"
 
 planefunction_t floorfunc, ceilingfunc;
 
@@ -37,9 +38,10 @@ fixed_t skyiscale;
 // opening
 //
 
-visplane_t *visplanes = NULL, *lastvisplane;
 visplane_t *floorplane, *ceilingplane;
-static int numvisplanes;
+
+// [AP] See r_visplane.h
+static visplanepool_t visplanepool = VISPLANEPOOL(visplane_t, MAXVISPLANES);
 
 int openings[MAXOPENINGS], *lastopening; // [crispy] 32-bit integer math
 
@@ -206,7 +208,7 @@ void R_ClearPlanes(void)
         ceilingclip[i] = -1;
     }
 
-    lastvisplane = visplanes;
+    R_ClearVisplanePool(&visplanepool);
     lastopening = openings;
 
 //
@@ -221,29 +223,18 @@ void R_ClearPlanes(void)
 }
 
 
-// [crispy] remove MAXVISPLANES limit
-static void R_RaiseVisplanes (visplane_t** vp)
+static visplane_t *R_NewPlane(fixed_t height, int picnum,
+                              int lightlevel, int special)
 {
-    if (lastvisplane - visplanes == numvisplanes)
-    {
-	int numvisplanes_old = numvisplanes;
-	visplane_t* visplanes_old = visplanes;
-
-	numvisplanes = numvisplanes ? 2 * numvisplanes : MAXVISPLANES;
-	visplanes = I_Realloc(visplanes, numvisplanes * sizeof(*visplanes));
-	memset(visplanes + numvisplanes_old, 0, (numvisplanes - numvisplanes_old) * sizeof(*visplanes));
-
-	lastvisplane = visplanes + numvisplanes_old;
-	floorplane = visplanes + (floorplane - visplanes_old);
-	ceilingplane = visplanes + (ceilingplane - visplanes_old);
+    visplane_t *pl;
 
-	if (numvisplanes_old)
-	    fprintf(stderr, "R_FindPlane: Hit MAXVISPLANES limit at %d, raised to %d.\n", numvisplanes_old, numvisplanes);
+    pl = R_NewVisplane(&visplanepool, height, picnum, lightlevel, special);
+    pl->height = height;
+    pl->picnum = picnum;
+    pl->lightlevel = lightlevel;
+    pl->special = special;
 
-	// keep the pointer passed as argument in relation to the visplanes pointer
-	if (vp)
-	    *vp = visplanes + (*vp - visplanes_old);
-    }
+    return pl;
 }
 
 /*
@@ -266,26 +257,14 @@ visplane_t *R_FindPlane(fixed_t height, int picnum,
         lightlevel = 0;
     }
 
-    for (check = visplanes; check < lastvisplane; check++)
-    {
-        if (height == check->height
-            && picnum == check->picnum
-            && lightlevel == check->lightlevel && special == check->special)
-            break;
-    }
+    check = R_FindVisplane(&visplanepool, height, picnum, lightlevel, special);
 
-    if (check < lastvisplane)
+    if (check)
     {
         return (check);
     }
 
-    R_RaiseVisplanes(&check);
-
-    lastvisplane++;
-    check->height = height;
-    check->picnum = picnum;
-    check->lightlevel = lightlevel;
-    check->special = special;
+    check = R_NewPlane(height, picnum, lightlevel, special);
     check->minx = SCREENWIDTH;
     check->maxx = -1;
     memset(check->top, 0xff, sizeof(check->top));
@@ -341,12 +320,7 @@ visplane_t *R_CheckPlane(visplane_t * pl, int start, int stop)
 
 // make a new visplane
 
-    R_RaiseVisplanes(&pl);
-    lastvisplane->height = pl->height;
-    lastvisplane->picnum = pl->picnum;
-    lastvisplane->lightlevel = pl->lightlevel;
-    lastvisplane->special = pl->special;
-    pl = lastvisplane++;
+    pl = R_NewPlane(pl->height, pl->picnum, pl->lightlevel, pl->special);
     pl->minx = start;
     pl->maxx = stop;
     memset(pl->top, 0xff, sizeof(pl->top));
@@ -418,21 +392,21 @@ void R_DrawPlanes(void)
     int count;
     fixed_t frac, fracstep;
     int heightmask; // [crispy]
+    int i;
 
 #ifdef RANGECHECK
     if (ds_p - drawsegs > numdrawsegs)
         I_Error("R_DrawPlanes: drawsegs overflow (%td)",
                 ds_p - drawsegs);
-    if (lastvisplane - visplanes > numvisplanes)
-        I_Error("R_DrawPlanes: visplane overflow (%td)",
-                lastvisplane - visplanes);
     if (lastopening - openings > MAXOPENINGS)
         I_Error("R_DrawPlanes: opening overflow (%td)",
                 lastopening - openings);
 #endif
 
-    for (pl = visplanes; pl < lastvisplane; pl++)
+    for (i = 0; i < visplanepool.count; i++)
     {
+        pl = R_Visplane(&visplanepool, i);
+
         if (pl->minx > pl->maxx)
             continue;
         //
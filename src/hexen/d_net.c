@@ -90,7 +90,8 @@ static loop_interface_t hexen_loop_interface = {
     H2_ProcessEvents,
     G_BuildTiccmd,
     RunTic,
-    MN_Ticker
+    MN_Ticker,
+    NULL
 };
 
 
@@ -1055,7 +1055,8 @@ struct seqnode_s
     int sequence;
     mobj_t *mobj;
     int currentSoundID;
-    int delayTics;
+    int channel;                // [AP] What currentSoundID was started on
+    unsigned int wakeUpdate;    // [AP] Sleeps until this update, see SN_GetSequenceDelay
     int volume;
     int stopSound;
     seqnode_t *prev;
@@ -1065,6 +1066,8 @@ struct seqnode_s
 extern int ActiveSequences;
 extern seqnode_t *SequenceListHead;
 
+int SN_GetSequenceDelay(seqnode_t *node); // [AP]
+
 //----------------------
 // Interlude (IN_lude.c)
 //----------------------
@@ -40,6 +40,32 @@
 #define TEXTURE_MIDDLE 1
 #define TEXTURE_BOTTOM 2
 
+// [AP] PCodeCmds indices of the instructions T_InterpretACS runs inline
+#define PCD_PUSHNUMBER 3
+#define PCD_ADD 14
+#define PCD_SUBTRACT 15
+#define PCD_EQ 19
+#define PCD_NE 20
+#define PCD_LT 21
+#define PCD_GT 22
+#define PCD_LE 23
+#define PCD_GE 24
+#define PCD_ASSIGNSCRIPTVAR 25
+#define PCD_ASSIGNMAPVAR 26
+#define PCD_PUSHSCRIPTVAR 28
+#define PCD_PUSHMAPVAR 29
+#define PCD_PUSHWORLDVAR 30
+#define PCD_ADDSCRIPTVAR 31
+#define PCD_INCSCRIPTVAR 46
+#define PCD_INCMAPVAR 47
+#define PCD_DECSCRIPTVAR 49
+#define PCD_GOTO 52
+#define PCD_IFGOTO 53
+#define PCD_DROP 54
+#define PCD_DELAYDIRECT 56
+#define PCD_IFNOTGOTO 79
+#define PCD_CASEGOTO 84
+
 // TYPES -------------------------------------------------------------------
 
 typedef PACKED_STRUCT (
@@ -185,6 +211,9 @@ acsstore_t ACSStore[MAX_ACS_STORE + 1]; // +1 for termination marker
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
 static char EvalContext[64];
+static int EvalScript = -1; // [AP] EvalContext is only formatted on failure
+static unsigned int EvalOffset;
+static int EvalCmd;
 static acs_t *ACScript;
 static unsigned int PCodeOffset;
 static byte SpecArgs[8];
@@ -320,6 +349,18 @@ static void ACSAssert(int condition, const char *fmt, ...)
         return;
     }
 
+    // [AP] Running a script, which doesn't keep EvalContext up to date
+    if (EvalScript >= 0 && EvalCmd >= 0)
+    {
+        M_snprintf(EvalContext, sizeof(EvalContext), "script %d @0x%x, cmd=%d",
+                   EvalScript, EvalOffset, EvalCmd);
+    }
+    else if (EvalScript >= 0)
+    {
+        M_snprintf(EvalContext, sizeof(EvalContext), "script %d @0x%x",
+                   EvalScript, EvalOffset);
+    }
+
     va_start(args, fmt);
     M_vsnprintf(buf, sizeof(buf), fmt, args);
     va_end(args);
@@ -455,6 +496,7 @@ void P_LoadACScripts(int lump)
     ActionCodeBase = W_CacheLumpNum(lump, PU_LEVEL);
     ActionCodeSize = W_LumpLength(lump);
 
+    EvalScript = -1;
     M_snprintf(EvalContext, sizeof(EvalContext),
                "header parsing of lump #%d", lump);
 
@@ -768,11 +810,88 @@ void P_ACSInitNewGame(void)
 //
 //==========================================================================
 
+//==========================================================================
+//
+// Interpreter fast path
+//
+// [AP] As ReadCodeInt, Push, Pop and friends, but on the instruction offset
+// and stack pointer T_InterpretACS keeps in locals while it runs the
+// instructions it handles inline. The checks are the same.
+//
+//==========================================================================
+
+static inline int FetchCode(unsigned int *pc)
+{
+    int result;
+
+    if (*pc + 3 >= ActionCodeSize)
+    {
+        ACSAssert(false, "unexpectedly reached end of ACS lump");
+    }
+
+    result = LONG(*(int *) (ActionCodeBase + *pc));
+    *pc += 4;
+
+    return result;
+}
+
+static inline int FetchVar(unsigned int *pc, int count, const char *kind)
+{
+    int var = FetchCode(pc);
+
+    if (var < 0 || var >= count)
+    {
+        ACSAssert(var >= 0, "negative %s variable: %d < 0", kind, var);
+        ACSAssert(false, "invalid %s variable: %d >= %d", kind, var, count);
+    }
+
+    return var;
+}
+
+static inline int FetchOffset(unsigned int *pc)
+{
+    int offset = FetchCode(pc);
+
+    if (offset < 0 || offset >= ActionCodeSize)
+    {
+        ACSAssert(offset >= 0, "negative lump offset %d", offset);
+        ACSAssert(false, "invalid lump offset: %d >= %d",
+                  offset, ActionCodeSize);
+    }
+
+    return offset;
+}
+
+static inline void FastPush(int *stack, int *sp, int value)
+{
+    if (*sp >= ACS_STACK_DEPTH)
+    {
+        ACSAssert(false, "maximum stack depth exceeded: %d >= %d",
+                  *sp, ACS_STACK_DEPTH);
+    }
+
+    stack[(*sp)++] = value;
+}
+
+static inline int FastPop(int *stack, int *sp, const char *message)
+{
+    if (*sp <= 0)
+    {
+        ACSAssert(false, "%s", message);
+    }
+
+    return stack[--(*sp)];
+}
+
 void T_InterpretACS(thinker_t *thinker)
 {
     acs_t *script = (acs_t *) thinker;
     int cmd;
     int action;
+    unsigned int pc;
+    int sp;
+    int *stack;
+    int operand, offset;
 
     if (ACSInfo[script->infoIndex].state == ASTE_TERMINATING)
     {
@@ -791,23 +910,158 @@ void T_InterpretACS(thinker_t *thinker)
         return;
     }
     ACScript = script;
-    PCodeOffset = ACScript->ip;
+    EvalScript = ACSInfo[script->infoIndex].number;
+
+    // [AP] The most common instructions are run right here, with the
+    // instruction offset and stack pointer in locals. The others go
+    // through PCodeCmds, with both written back around the call.
+    pc = ACScript->ip;
+    sp = ACScript->stackPtr;
+    stack = ACScript->stack;
 
     do
     {
-        M_snprintf(EvalContext, sizeof(EvalContext), "script %d @0x%x",
-                   ACSInfo[script->infoIndex].number, PCodeOffset);
-        cmd = ReadCodeInt();
-        M_snprintf(EvalContext, sizeof(EvalContext), "script %d @0x%x, cmd=%d",
-                   ACSInfo[script->infoIndex].number, PCodeOffset, cmd);
-        ACSAssert(cmd >= 0, "negative ACS instruction %d", cmd);
-        ACSAssert(cmd < arrlen(PCodeCmds),
-                  "invalid ACS instruction %d (maybe this WAD is designed "
-                  "for an advanced source port and is not vanilla "
-                  "compatible)", cmd);
-        action = PCodeCmds[cmd]();
+        EvalOffset = pc;
+        EvalCmd = -1;
+        cmd = FetchCode(&pc);
+        EvalOffset = pc;
+        EvalCmd = cmd;
+        action = SCRIPT_CONTINUE;
+
+        switch (cmd)
+        {
+            case PCD_PUSHNUMBER:
+                FastPush(stack, &sp, FetchCode(&pc));
+                break;
+            case PCD_ADD:
+                operand = FastPop(stack, &sp, "pop of empty stack");
+                FastPush(stack, &sp,
+                         FastPop(stack, &sp, "pop of empty stack") + operand);
+                break;
+            case PCD_SUBTRACT:
+                operand = FastPop(stack, &sp, "pop of empty stack");
+                FastPush(stack, &sp,
+                         FastPop(stack, &sp, "pop of empty stack") - operand);
+                break;
+            case PCD_EQ:
+                operand = FastPop(stack, &sp, "pop of empty stack");
+                FastPush(stack, &sp,
+                         FastPop(stack, &sp, "pop of empty stack") == operand);
+                break;
+            case PCD_NE:
+                operand = FastPop(stack, &sp, "pop of empty stack");
+                FastPush(stack, &sp,
+                         FastPop(stack, &sp, "pop of empty stack") != operand);
+                break;
+            case PCD_LT:
+                operand = FastPop(stack, &sp, "pop of empty stack");
+                FastPush(stack, &sp,
+                         FastPop(stack, &sp, "pop of empty stack") < operand);
+                break;
+            case PCD_GT:
+                operand = FastPop(stack, &sp, "pop of empty stack");
+                FastPush(stack, &sp,
+                         FastPop(stack, &sp, "pop of empty stack") > operand);
+                break;
+            case PCD_LE:
+                operand = FastPop(stack, &sp, "pop of empty stack");
+                FastPush(stack, &sp,
+                         FastPop(stack, &sp, "pop of empty stack") <= operand);
+                break;
+            case PCD_GE:
+                operand = FastPop(stack, &sp, "pop of empty stack");
+                FastPush(stack, &sp,
+                         FastPop(stack, &sp, "pop of empty stack") >= operand);
+                break;
+            case PCD_ASSIGNSCRIPTVAR:
+                operand = FetchVar(&pc, MAX_ACS_SCRIPT_VARS, "script");
+                ACScript->vars[operand] =
+                    FastPop(stack, &sp, "pop of empty stack");
+                break;
+            case PCD_ASSIGNMAPVAR:
+                operand = FetchVar(&pc, MAX_ACS_MAP_VARS, "map");
+                MapVars[operand] = FastPop(stack, &sp, "pop of empty stack");
+                break;
+            case PCD_PUSHSCRIPTVAR:
+                operand = FetchVar(&pc, MAX_ACS_SCRIPT_VARS, "script");
+                FastPush(stack, &sp, ACScript->vars[operand]);
+                break;
+            case PCD_PUSHMAPVAR:
+                operand = FetchVar(&pc, MAX_ACS_MAP_VARS, "map");
+                FastPush(stack, &sp, MapVars[operand]);
+                break;
+            case PCD_PUSHWORLDVAR:
+                operand = FetchVar(&pc, MAX_ACS_WORLD_VARS, "world");
+                FastPush(stack, &sp, WorldVars[operand]);
+                break;
+            case PCD_ADDSCRIPTVAR:
+                operand = FetchVar(&pc, MAX_ACS_SCRIPT_VARS, "script");
+                ACScript->vars[operand] +=
+                    FastPop(stack, &sp, "pop of empty stack");
+                break;
+            case PCD_INCSCRIPTVAR:
+                ++ACScript->vars[FetchVar(&pc, MAX_ACS_SCRIPT_VARS, "script")];
+                break;
+            case PCD_INCMAPVAR:
+                ++MapVars[FetchVar(&pc, MAX_ACS_MAP_VARS, "map")];
+                break;
+            case PCD_DECSCRIPTVAR:
+                --ACScript->vars[FetchVar(&pc, MAX_ACS_SCRIPT_VARS, "script")];
+                break;
+            case PCD_GOTO:
+                pc = FetchOffset(&pc);
+                break;
+            case PCD_IFGOTO:
+                offset = FetchOffset(&pc);
+                if (FastPop(stack, &sp, "pop of empty stack") != 0)
+                {
+                    pc = offset;
+                }
+                break;
+            case PCD_IFNOTGOTO:
+                offset = FetchOffset(&pc);
+                if (FastPop(stack, &sp, "pop of empty stack") == 0)
+                {
+                    pc = offset;
+                }
+                break;
+            case PCD_DROP:
+                FastPop(stack, &sp, "drop on empty stack");
+                break;
+            case PCD_CASEGOTO:
+                operand = FetchCode(&pc);
+                offset = FetchOffset(&pc);
+                if (sp <= 0)
+                {
+                    ACSAssert(false, "read from top of empty stack");
+                }
+                if (stack[sp - 1] == operand)
+                {
+                    pc = offset;
+                    --sp;
+                }
+                break;
+            case PCD_DELAYDIRECT:
+                ACScript->delayCount = FetchCode(&pc);
+                action = SCRIPT_STOP;
+                break;
+            default:
+                ACSAssert(cmd >= 0, "negative ACS instruction %d", cmd);
+                ACSAssert(cmd < arrlen(PCodeCmds),
+                          "invalid ACS instruction %d (maybe this WAD is "
+                          "designed for an advanced source port and is not "
+                          "vanilla compatible)", cmd);
+                PCodeOffset = pc;
+                ACScript->stackPtr = sp;
+                action = PCodeCmds[cmd]();
+                pc = PCodeOffset;
+                sp = ACScript->stackPtr;
+                break;
+        }
     } while (action == SCRIPT_CONTINUE);
 
+    PCodeOffset = pc;
+    ACScript->stackPtr = sp;
     ACScript->ip = PCodeOffset;
 
     if (action == SCRIPT_TERMINATE)
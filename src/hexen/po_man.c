@@ -44,6 +44,7 @@ static void RotatePt(int an, fixed_t * x, fixed_t * y, fixed_t startSpotX,
                      fixed_t startSpotY);
 static void UnLinkPolyobj(polyobj_t * po);
 static void LinkPolyobj(polyobj_t * po);
+static void FindBlockingCandidates(polyobj_t * po);
 static boolean CheckMobjBlocking(seg_t * seg, polyobj_t * po);
 static void InitBlockMap(void);
 static void IterFindPolySegs(int x, int y, seg_t ** segList);
@@ -805,6 +806,7 @@ boolean PO_MovePolyobj(int num, int x, int y, boolean interp)
         (*prevPts).x += x;      // previous points are unique for each seg
         (*prevPts).y += y;
     }
+    FindBlockingCandidates(po); // [AP]
     segList = po->segs;
     for (count = po->numsegs; count; count--, segList++)
     {
@@ -997,6 +999,7 @@ boolean PO_RotatePolyobj(int num, angle_t angle, boolean interp)
     po->rtheta = po->dtheta = 0; // [crispy]
     RotatePolyVertices(po, angle); // [crispy] prevPts get set here.
 
+    FindBlockingCandidates(po); // [AP]
     segList = po->segs;
     blocked = false;
     validcount++;
@@ -1181,20 +1184,124 @@ static void LinkPolyobj(polyobj_t * po)
     }
 }
 
+//==========================================================================
+//
+// FindBlockingCandidates
+//
+// [AP] Gathers the mobjs that CheckMobjBlocking could find for any seg of
+// a polyobj, so that a move looks through the blockmap once rather than
+// once per seg. The area covers the seg line boxes both before and after
+// the move, as PO_RotatePolyobj checks some segs before updating their
+// boxes. Mobjs that don't touch it can't block any seg and are left out.
+//
+//==========================================================================
+
+typedef struct
+{
+    mobj_t *mobj;
+    int blockx, blocky;
+} polycandidate_t;
+
+static polycandidate_t *PolyCandidates;
+static int NumPolyCandidates;
+static int MaxPolyCandidates;
+
+static void AddToBox(fixed_t *box, fixed_t x, fixed_t y)
+{
+    box[BOXLEFT] = MIN(box[BOXLEFT], x);
+    box[BOXRIGHT] = MAX(box[BOXRIGHT], x);
+    box[BOXBOTTOM] = MIN(box[BOXBOTTOM], y);
+    box[BOXTOP] = MAX(box[BOXTOP], y);
+}
+
+static void FindBlockingCandidates(polyobj_t * po)
+{
+    fixed_t box[4];
+    int left, right, top, bottom;
+    int i, j, count;
+    seg_t **segList;
+    line_t *ld;
+    mobj_t *mobj;
+
+    box[BOXLEFT] = box[BOXBOTTOM] = INT_MAX;
+    box[BOXRIGHT] = box[BOXTOP] = INT_MIN;
+
+    for (count = po->numsegs, segList = po->segs; count; count--, segList++)
+    {
+        ld = (*segList)->linedef;
+        AddToBox(box, ld->bbox[BOXLEFT], ld->bbox[BOXBOTTOM]);
+        AddToBox(box, ld->bbox[BOXRIGHT], ld->bbox[BOXTOP]);
+        AddToBox(box, (*segList)->v1->x, (*segList)->v1->y);
+        AddToBox(box, (*segList)->v2->x, (*segList)->v2->y);
+    }
+
+    top = (box[BOXTOP] - bmaporgy + MAXRADIUS) >> MAPBLOCKSHIFT;
+    bottom = (box[BOXBOTTOM] - bmaporgy - MAXRADIUS) >> MAPBLOCKSHIFT;
+    left = (box[BOXLEFT] - bmaporgx - MAXRADIUS) >> MAPBLOCKSHIFT;
+    right = (box[BOXRIGHT] - bmaporgx + MAXRADIUS) >> MAPBLOCKSHIFT;
+
+    bottom = BETWEEN(0, bmapheight - 1, bottom);
+    top = BETWEEN(0, bmapheight - 1, top);
+    left = BETWEEN(0, bmapwidth - 1, left);
+    right = BETWEEN(0, bmapwidth - 1, right);
+
+    NumPolyCandidates = 0;
+
+    // In the order CheckMobjBlocking would come across them
+
+    for (j = bottom; j <= top; j++)
+    {
+        for (i = left; i <= right; i++)
+        {
+            for (mobj = blocklinks[j * bmapwidth + i]; mobj;
+                 mobj = mobj->bnext)
+            {
+                if (!(mobj->flags & MF_SOLID || mobj->player)
+                 || mobj->x + mobj->radius <= box[BOXLEFT]
+                 || mobj->x - mobj->radius >= box[BOXRIGHT]
+                 || mobj->y + mobj->radius <= box[BOXBOTTOM]
+                 || mobj->y - mobj->radius >= box[BOXTOP])
+                {
+                    continue;
+                }
+
+                if (NumPolyCandidates == MaxPolyCandidates)
+                {
+                    MaxPolyCandidates = MaxPolyCandidates ?
+                                        MaxPolyCandidates * 2 : 64;
+                    PolyCandidates = I_Realloc(PolyCandidates,
+                                               MaxPolyCandidates
+                                               * sizeof(*PolyCandidates));
+                }
+
+                PolyCandidates[NumPolyCandidates].mobj = mobj;
+                PolyCandidates[NumPolyCandidates].blockx = i;
+                PolyCandidates[NumPolyCandidates].blocky = j;
+                NumPolyCandidates++;
+            }
+        }
+    }
+}
+
 //==========================================================================
 //
 // CheckMobjBlocking
 //
+// [AP] Looks through the candidates FindBlockingCandidates gathered, for
+// those in the blocks near the seg that the blockmap used to be searched
+// for.
+//
 //==========================================================================
 
 static boolean CheckMobjBlocking(seg_t * seg, polyobj_t * po)
 {
     mobj_t *mobj;
-    int i, j;
+    int i;
     int left, right, top, bottom;
     int tmbbox[4];
     line_t *ld;
     boolean blocked;
+    polycandidate_t *candidate;
 
     ld = seg->linedef;
 
@@ -1214,34 +1321,43 @@ static boolean CheckMobjBlocking(seg_t * seg, polyobj_t * po)
     right = right < 0 ? 0 : right;
     right = right >= bmapwidth ? bmapwidth - 1 : right;
 
-    for (j = bottom * bmapwidth; j <= top * bmapwidth; j += bmapwidth)
+    for (i = 0, candidate = PolyCandidates; i < NumPolyCandidates;
+         i++, candidate++)
     {
-        for (i = left; i <= right; i++)
+        mobj = candidate->mobj;
+
+        if (candidate->blockx < left || candidate->blockx > right
+         || candidate->blocky < bottom || candidate->blocky > top)
         {
-            for (mobj = blocklinks[j + i]; mobj; mobj = mobj->bnext)
+            continue;
+        }
+
+        // Thrusting an earlier one can kill it, or remove it from the map
+        if (mobj->thinker.function == (think_t) - 1)
+        {
+            continue;
+        }
+
+        if (mobj->flags & MF_SOLID || mobj->player)
+        {
+            tmbbox[BOXTOP] = mobj->y + mobj->radius;
+            tmbbox[BOXBOTTOM] = mobj->y - mobj->radius;
+            tmbbox[BOXLEFT] = mobj->x - mobj->radius;
+            tmbbox[BOXRIGHT] = mobj->x + mobj->radius;
+
+            if (tmbbox[BOXRIGHT] <= ld->bbox[BOXLEFT]
+                || tmbbox[BOXLEFT] >= ld->bbox[BOXRIGHT]
+                || tmbbox[BOXTOP] <= ld->bbox[BOXBOTTOM]
+                || tmbbox[BOXBOTTOM] >= ld->bbox[BOXTOP])
             {
-                if (mobj->flags & MF_SOLID || mobj->player)
-                {
-                    tmbbox[BOXTOP] = mobj->y + mobj->radius;
-                    tmbbox[BOXBOTTOM] = mobj->y - mobj->radius;
-                    tmbbox[BOXLEFT] = mobj->x - mobj->radius;
-                    tmbbox[BOXRIGHT] = mobj->x + mobj->radius;
-
-                    if (tmbbox[BOXRIGHT] <= ld->bbox[BOXLEFT]
-                        || tmbbox[BOXLEFT] >= ld->bbox[BOXRIGHT]
-                        || tmbbox[BOXTOP] <= ld->bbox[BOXBOTTOM]
-                        || tmbbox[BOXBOTTOM] >= ld->bbox[BOXTOP])
-                    {
-                        continue;
-                    }
-                    if (P_BoxOnLineSide(tmbbox, ld) != -1)
-                    {
-                        continue;
-                    }
-                    ThrustMobj(mobj, seg, po);
-                    blocked = true;
-                }
+                continue;
             }
+            if (P_BoxOnLineSide(tmbbox, ld) != -1)
+            {
+                continue;
+            }
+            ThrustMobj(mobj, seg, po);
+            blocked = true;
         }
     }
     return blocked;
@@ -21,6 +21,7 @@
 #include "i_system.h"
 #include "r_local.h"
 #include "p_spec.h"
+#include "r_visplane.h"
 
 
 // MACROS ------------------------------------------------------------------
@@ -48,8 +49,9 @@ boolean DoubleSky;
 planefunction_t floorfunc, ceilingfunc;
 
 // Opening
-visplane_t visplanes[MAXVISPLANES], *lastvisplane;
 visplane_t *floorplane, *ceilingplane;
+// [AP] See r_visplane.h
+static visplanepool_t visplanepool = VISPLANEPOOL(visplane_t, MAXVISPLANES);
 int openings[MAXOPENINGS], *lastopening; // [crispy] 32-bit integer math
 
 // Clip values are the solid pixel bounding the range.
@@ -219,7 +221,7 @@ void R_ClearPlanes(void)
         ceilingclip[i] = -1;
     }
 
-    lastvisplane = visplanes;
+    R_ClearVisplanePool(&visplanepool);
     lastopening = openings;
 
     // Texture calculation
@@ -230,6 +232,26 @@ void R_ClearPlanes(void)
     baseyscale = -FixedDiv(finesine[angle], centerxfrac);
 }
 
+//==========================================================================
+//
+// R_NewPlane
+//
+//==========================================================================
+
+static visplane_t *R_NewPlane(fixed_t height, int picnum,
+                              int lightlevel, int special)
+{
+    visplane_t *pl;
+
+    pl = R_NewVisplane(&visplanepool, height, picnum, lightlevel, special);
+    pl->height = height;
+    pl->picnum = picnum;
+    pl->lightlevel = lightlevel;
+    pl->special = special;
+
+    return pl;
+}
+
 //==========================================================================
 //
 // R_FindPlane
@@ -252,29 +274,14 @@ visplane_t *R_FindPlane(fixed_t height, int picnum,
         lightlevel = 0;
     }
 
-    for (check = visplanes; check < lastvisplane; check++)
-    {
-        if (height == check->height
-            && picnum == check->picnum
-            && lightlevel == check->lightlevel && special == check->special)
-            break;
-    }
+    check = R_FindVisplane(&visplanepool, height, picnum, lightlevel, special);
 
-    if (check < lastvisplane)
+    if (check)
     {
         return (check);
     }
 
-    if (lastvisplane - visplanes == MAXVISPLANES)
-    {
-        I_Error("R_FindPlane: no more visplanes");
-    }
-
-    lastvisplane++;
-    check->height = height;
-    check->picnum = picnum;
-    check->lightlevel = lightlevel;
-    check->special = special;
+    check = R_NewPlane(height, picnum, lightlevel, special);
     check->minx = SCREENWIDTH;
     check->maxx = -1;
     memset(check->top, 0xff, sizeof(check->top));
@@ -330,11 +337,7 @@ visplane_t *R_CheckPlane(visplane_t * pl, int start, int stop)
     }
 
     // Make a new visplane
-    lastvisplane->height = pl->height;
-    lastvisplane->picnum = pl->picnum;
-    lastvisplane->lightlevel = pl->lightlevel;
-    lastvisplane->special = pl->special;
-    pl = lastvisplane++;
+    pl = R_NewPlane(pl->height, pl->picnum, pl->lightlevel, pl->special);
     pl->minx = start;
     pl->maxx = stop;
     memset(pl->top, 0xff, sizeof(pl->top));
@@ -403,6 +406,7 @@ void R_DrawPlanes(void)
     int fracstep = FRACUNIT >> crispy->hires;
     static int interpfactor; // [crispy]
     int heightmask; // [crispy]
+    int i;
 
 #ifdef RANGECHECK
     if (ds_p - drawsegs > MAXDRAWSEGS)
@@ -410,11 +414,6 @@ void R_DrawPlanes(void)
         I_Error("R_DrawPlanes: drawsegs overflow (%td)",
                 ds_p - drawsegs);
     }
-    if (lastvisplane - visplanes > MAXVISPLANES)
-    {
-        I_Error("R_DrawPlanes: visplane overflow (%td)",
-                lastvisplane - visplanes);
-    }
     if (lastopening - openings > MAXOPENINGS)
     {
         I_Error("R_DrawPlanes: opening overflow (%td)",
@@ -422,8 +421,10 @@ void R_DrawPlanes(void)
     }
 #endif
 
-    for (pl = visplanes; pl < lastvisplane; pl++)
+    for (i = 0; i < visplanepool.count; i++)
     {
+        pl = R_Visplane(&visplanepool, i);
+
         if (pl->minx > pl->maxx)
         {
             continue;
@@ -363,7 +363,8 @@ static mobj_t *GetSoundListener(void)
 //
 //==========================================================================
 
-void S_StartSoundAtVolume(mobj_t * origin, int sound_id, int volume)
+// [AP] Returns the channel it got, or -1
+static int StartSoundAtVolume(mobj_t * origin, int sound_id, int volume)
 {
     mobj_t *listener;
     int dist, vol;
@@ -378,7 +379,7 @@ void S_StartSoundAtVolume(mobj_t * origin, int sound_id, int volume)
     int chan;
 
     if (sound_id == 0 || snd_MaxVolume == 0)
-        return;
+        return -1;
 
     listener = GetSoundListener();
 
@@ -388,7 +389,7 @@ void S_StartSoundAtVolume(mobj_t * origin, int sound_id, int volume)
     }
     if (volume == 0)
     {
-        return;
+        return -1;
     }
 
     // calculate the distance before other stuff so that we can throw out
@@ -399,7 +400,7 @@ void S_StartSoundAtVolume(mobj_t * origin, int sound_id, int volume)
     dist >>= FRACBITS;
     if (dist >= MAX_SND_DIST)
     {
-        return;                 // sound is beyond the hearing range...
+        return -1;              // sound is beyond the hearing range...
     }
     if (dist < 0)
     {
@@ -411,7 +412,7 @@ void S_StartSoundAtVolume(mobj_t * origin, int sound_id, int volume)
     // TODO
     if (!S_StopSoundID(sound_id, priority))
     {
-        return;                 // other sounds have greater priority
+        return -1;              // other sounds have greater priority
     }
     #endif
     for (i = 0; i < snd_Channels; i++)
@@ -455,7 +456,7 @@ void S_StartSoundAtVolume(mobj_t * origin, int sound_id, int volume)
             }
             if (chan != -1)
             {
-                return;         //no free channels.
+                return -1;      //no free channels.
             }
             else                //replace the lower priority sound.
             {
@@ -527,6 +528,23 @@ void S_StartSoundAtVolume(mobj_t * origin, int sound_id, int volume)
     {
         S_sfx[sound_id].usefulness++;
     }
+    return i;
+}
+
+void S_StartSoundAtVolume(mobj_t * origin, int sound_id, int volume)
+{
+    StartSoundAtVolume(origin, sound_id, volume);
+}
+
+//==========================================================================
+//
+// S_StartSequenceSound
+//
+//==========================================================================
+
+int S_StartSequenceSound(mobj_t * origin, int sound_id, int volume)
+{
+    return StartSoundAtVolume(origin, sound_id, volume);
 }
 
 //==========================================================================
@@ -899,6 +917,27 @@ boolean S_GetSoundPlayingInfo(mobj_t * mobj, int sound_id)
     return false;
 }
 
+//==========================================================================
+//
+// S_GetChannelPlayingInfo
+//
+// [AP] As S_GetSoundPlayingInfo, looking at the channel the sound was
+// started on first. Only a miss scans them all, something else may have
+// played it on the mobj since.
+//
+//==========================================================================
+
+boolean S_GetChannelPlayingInfo(int channel, mobj_t * mobj, int sound_id)
+{
+    if (channel >= 0 && channel < snd_Channels
+     && Channel[channel].mo == mobj && Channel[channel].sound_id == sound_id
+     && I_SoundIsPlaying(Channel[channel].handle))
+    {
+        return true;
+    }
+    return S_GetSoundPlayingInfo(mobj, sound_id);
+}
+
 //==========================================================================
 //
 // S_SetMusicVolume
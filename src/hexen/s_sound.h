@@ -88,6 +88,8 @@ void S_Init(void);
 void S_GetChannelInfo(SoundInfo_t * s);
 void S_SetMusicVolume(void);
 boolean S_GetSoundPlayingInfo(mobj_t * mobj, int sound_id);
+int S_StartSequenceSound(mobj_t * origin, int sound_id, int volume); // [AP]
+boolean S_GetChannelPlayingInfo(int channel, mobj_t * mobj, int sound_id);
 boolean S_StartCustomCDTrack(int tracknum);
 int S_GetCurrentCDTrack(void);
 void S_UpdateSndChannels (int option); // [crispy]
@@ -129,6 +129,10 @@ static int *SequenceData[SS_MAX_SCRIPTS];
 int ActiveSequences;
 seqnode_t *SequenceListHead;
 
+// [AP] Counts the updates, so that a delayed node just sleeps until one
+// instead of counting down
+static unsigned int SequenceUpdate;
+
 // CODE --------------------------------------------------------------------
 
 //==========================================================================
@@ -321,7 +325,8 @@ void SN_StartSequence(mobj_t * mobj, int sequence)
     node->sequencePtr = SequenceData[SequenceTranslate[sequence].scriptNum];
     node->sequence = sequence;
     node->mobj = mobj;
-    node->delayTics = 0;
+    node->channel = -1;
+    node->wakeUpdate = SequenceUpdate + 1;
     node->stopSound = SequenceTranslate[sequence].stopSound;
     node->volume = 127;         // Start at max volume
 
@@ -404,58 +409,66 @@ void SN_StopSequence(mobj_t * mobj)
 //
 //==========================================================================
 
+static boolean SequenceSoundPlaying(seqnode_t *node)
+{
+    return S_GetChannelPlayingInfo(node->channel, node->mobj,
+                                   node->currentSoundID);
+}
+
 void SN_UpdateActiveSequences(void)
 {
     seqnode_t *node;
-    boolean sndPlaying;
 
     if (!ActiveSequences || paused)
     {                           // No sequences currently playing/game is paused
         return;
     }
+    SequenceUpdate++;
     for (node = SequenceListHead; node; node = node->next)
     {
-        if (node->delayTics)
+        if ((int) (node->wakeUpdate - SequenceUpdate) > 0)
         {
-            node->delayTics--;
             continue;
         }
-        sndPlaying = S_GetSoundPlayingInfo(node->mobj, node->currentSoundID);
         switch (*node->sequencePtr)
         {
             case SS_CMD_PLAY:
-                if (!sndPlaying)
+                if (!SequenceSoundPlaying(node))
                 {
                     node->currentSoundID = *(node->sequencePtr + 1);
-                    S_StartSoundAtVolume(node->mobj, node->currentSoundID,
-                                         node->volume);
+                    node->channel = S_StartSequenceSound(node->mobj,
+                                                         node->currentSoundID,
+                                                         node->volume);
                 }
                 node->sequencePtr += 2;
                 break;
             case SS_CMD_WAITUNTILDONE:
-                if (!sndPlaying)
+                if (!SequenceSoundPlaying(node))
                 {
                     node->sequencePtr++;
                     node->currentSoundID = 0;
                 }
                 break;
             case SS_CMD_PLAYREPEAT:
-                if (!sndPlaying)
+                if (!SequenceSoundPlaying(node))
                 {
                     node->currentSoundID = *(node->sequencePtr + 1);
-                    S_StartSoundAtVolume(node->mobj, node->currentSoundID,
-                                         node->volume);
+                    node->channel = S_StartSequenceSound(node->mobj,
+                                                         node->currentSoundID,
+                                                         node->volume);
                 }
                 break;
             case SS_CMD_DELAY:
-                node->delayTics = *(node->sequencePtr + 1);
+                node->wakeUpdate = SequenceUpdate + 1
+                                 + *(node->sequencePtr + 1);
                 node->sequencePtr += 2;
                 node->currentSoundID = 0;
                 break;
             case SS_CMD_DELAYRAND:
-                node->delayTics = *(node->sequencePtr + 1) +
-                    M_Random() % (*(node->sequencePtr + 2) -
-                                  *(node->sequencePtr + 1));
+                node->wakeUpdate = SequenceUpdate + 1
+                                 + *(node->sequencePtr + 1)
+                                 + M_Random() % (*(node->sequencePtr + 2) -
+                                                 *(node->sequencePtr + 1));
                 node->sequencePtr += 2;
                 node->currentSoundID = 0;
                 break;
@@ -498,6 +511,20 @@ void SN_StopAllSequences(void)
 //
 //==========================================================================
 
+//==========================================================================
+//
+//  SN_GetSequenceDelay
+//
+//      [AP] How many updates the node still skips, as saved games have it
+//==========================================================================
+
+int SN_GetSequenceDelay(seqnode_t *node)
+{
+    int delay = (int) (node->wakeUpdate - SequenceUpdate) - 1;
+
+    return delay > 0 ? delay : 0;
+}
+
 int SN_GetSequenceOffset(int sequence, int *sequencePtr)
 {
     return (sequencePtr -
@@ -528,7 +555,7 @@ void SN_ChangeNodeData(int nodeNum, int seqOffset, int delayTics, int volume,
     {                           // reach the end of the list before finding the nodeNum-th node
         return;
     }
-    node->delayTics = delayTics;
+    node->wakeUpdate = SequenceUpdate + 1 + delayTics;
     node->volume = volume;
     node->sequencePtr += seqOffset;
     node->currentSoundID = currentSoundID;
@@ -17,9 +17,12 @@
 
 // HEADER FILES ------------------------------------------------------------
 
+#include <stdlib.h>
+
 #include "h2def.h"
 #include "i_system.h"
 #include "m_misc.h"
+#include "memio.h"
 #include "i_swap.h"
 #include "p_local.h"
 
@@ -33,6 +36,7 @@
 #define REBORN_SLOT 7
 #define REBORN_DESCRIPTION "TEMP GAME"
 #define MAX_THINKER_SIZE 256
+#define GAME_FILE MAX_MAPS // [AP] Slot file index of hexN.hxs
 
 // TYPES -------------------------------------------------------------------
 
@@ -51,6 +55,13 @@ typedef enum
     ASEG_END
 } gameArchiveSegment_t;
 
+// [AP] A save file held in memory
+typedef struct
+{
+    byte *data;
+    int length;
+} slotfile_t;
+
 typedef enum
 {
     TC_NULL,
@@ -117,10 +128,11 @@ static void RestorePlatRaise(thinker_t *thinker);
 static void RestoreMoveCeiling(thinker_t *thinker);
 static void AssertSegment(gameArchiveSegment_t segType);
 static void CopySaveSlot(int sourceSlot, int destSlot);
-static void CopyFile(char *sourceName, char *destName);
+static void ClearSlotFiles(int slot);
 static boolean ExistingFile(char *name);
-static void SV_OpenRead(char *fileName);
-static void SV_OpenWrite(char *fileName);
+static boolean SlotFileExists(int slot, int map);
+static void SV_OpenRead(int slot, int map);
+static void SV_OpenWrite(int slot, int map);
 static void SV_Close(void);
 static void SV_Read(void *buffer, int size);
 static byte SV_ReadByte(void);
@@ -152,7 +164,15 @@ static mobj_t **MobjList;
 static mobj_t ***TargetPlayerAddrs;
 static int TargetPlayerCount;
 static boolean SavingPlayers;
-static FILE *SavingFP;
+static MEMFILE *SavingFP;
+static slotfile_t *SavingFile; // Filled in by SV_Close
+
+// [AP] The base and reborn slots are only ever used by the running game,
+// so their files are kept in memory: changing maps within a hub, and
+// the reborn save made on every map change, don't touch the disk. A
+// slot is only written out when the game is saved to it.
+static slotfile_t BaseSlotFiles[MAX_MAPS + 1];
+static slotfile_t RebornSlotFiles[MAX_MAPS + 1];
 
 // CODE --------------------------------------------------------------------
 
@@ -1976,7 +1996,6 @@ static void StreamOut_floorWaggle_t(thinker_t *thinker)
 
 void SV_SaveGame(int slot, const char *description)
 {
-    char fileName[100];
     char versionText[HXS_VERSION_TEXT_LENGTH];
     unsigned int i;
 
@@ -1987,8 +2006,7 @@ void SV_SaveGame(int slot, const char *description)
     }
 
     // Open the output file
-    M_snprintf(fileName, sizeof(fileName), "%shex%d.hxs", SavePath, BASE_SLOT);
-    SV_OpenWrite(fileName);
+    SV_OpenWrite(BASE_SLOT, GAME_FILE);
 
     // Write game save description
     SV_Write(description, HXS_DESCRIPTION_LENGTH);
@@ -2027,10 +2045,7 @@ void SV_SaveGame(int slot, const char *description)
     // Save out the current map
     SV_SaveMap(true);           // true = save player info
 
-    // Clear all save files at destination slot
-    SV_ClearSaveSlot(slot);
-
-    // Copy base slot to destination slot
+    // Copy base slot to destination slot, replacing what it had
     CopySaveSlot(BASE_SLOT, slot);
 }
 
@@ -2042,14 +2057,10 @@ void SV_SaveGame(int slot, const char *description)
 
 void SV_SaveMap(boolean savePlayers)
 {
-    char fileName[100];
-
     SavingPlayers = savePlayers;
 
     // Open the output file
-    M_snprintf(fileName, sizeof(fileName), "%shex%d%02d.hxs",
-                SavePath, BASE_SLOT, gamemap);
-    SV_OpenWrite(fileName);
+    SV_OpenWrite(BASE_SLOT, gamemap);
 
     // Place a header marker
     SV_WriteLong(ASEG_MAP_HEADER);
@@ -2084,7 +2095,6 @@ void SV_SaveMap(boolean savePlayers)
 void SV_LoadGame(int slot)
 {
     int i;
-    char fileName[100];
     char version_text[HXS_VERSION_TEXT_LENGTH];
     player_t playerBackup[MAXPLAYERS];
     mobj_t *mobj;
@@ -2098,18 +2108,14 @@ void SV_LoadGame(int slot)
     // Copy all needed save files to the base slot
     if (slot != BASE_SLOT)
     {
-        SV_ClearSaveSlot(BASE_SLOT);
         CopySaveSlot(slot, BASE_SLOT);
     }
 
-    // Create the name
-    M_snprintf(fileName, sizeof(fileName), "%shex%d.hxs", SavePath, BASE_SLOT);
-
     // Load the file
-    SV_OpenRead(fileName);
+    SV_OpenRead(BASE_SLOT, GAME_FILE);
 
     // Set the save pointer and skip the description field
-    fseek(SavingFP, HXS_DESCRIPTION_LENGTH, SEEK_CUR);
+    mem_fseek(SavingFP, HXS_DESCRIPTION_LENGTH, MEM_SEEK_CUR);
 
     // Check the version text
 
@@ -2119,6 +2125,7 @@ void SV_LoadGame(int slot)
     }
     if (strncmp(version_text, HXS_VERSION_TEXT, HXS_VERSION_TEXT_LENGTH) != 0)
     {                           // Bad version
+        SV_Close();
         return;
     }
 
@@ -2184,7 +2191,6 @@ void SV_LoadGame(int slot)
 
 void SV_UpdateRebornSlot(void)
 {
-    SV_ClearSaveSlot(REBORN_SLOT);
     CopySaveSlot(BASE_SLOT, REBORN_SLOT);
 }
 
@@ -2209,7 +2215,6 @@ void SV_MapTeleport(int map, int position)
 {
     int i;
     int j;
-    char fileName[100];
     player_t playerBackup[MAXPLAYERS];
     mobj_t *targetPlayerMobj;
     mobj_t *mobj;
@@ -2230,7 +2235,7 @@ void SV_MapTeleport(int map, int position)
         }
         else
         {                       // Entering new cluster - clear base slot
-            SV_ClearSaveSlot(BASE_SLOT);
+            ClearSlotFiles(BASE_SLOT);
         }
     }
 
@@ -2251,9 +2256,7 @@ void SV_MapTeleport(int map, int position)
     TargetPlayerAddrs = NULL;
 
     gamemap = map;
-    M_snprintf(fileName, sizeof(fileName),
-                "%shex%d%02d.hxs", SavePath, BASE_SLOT, gamemap);
-    if (!deathmatch && ExistingFile(fileName))
+    if (!deathmatch && SlotFileExists(BASE_SLOT, gamemap))
     {                           // Unarchive map
         SV_LoadMap();
     }
@@ -2400,10 +2403,7 @@ int SV_GetRebornSlot(void)
 
 boolean SV_RebornSlotAvailable(void)
 {
-    char fileName[100];
-
-    M_snprintf(fileName, sizeof(fileName), "%shex%d.hxs", SavePath, REBORN_SLOT);
-    return ExistingFile(fileName);
+    return SlotFileExists(REBORN_SLOT, GAME_FILE);
 }
 
 //==========================================================================
@@ -2414,20 +2414,14 @@ boolean SV_RebornSlotAvailable(void)
 
 void SV_LoadMap(void)
 {
-    char fileName[100];
-
     // Load a base level
     G_InitNew(gameskill, gameepisode, gamemap);
 
     // Remove all thinkers
     RemoveAllThinkers();
 
-    // Create the name
-    M_snprintf(fileName, sizeof(fileName),
-                "%shex%d%02d.hxs", SavePath, BASE_SLOT, gamemap);
-
     // Load the file
-    SV_OpenRead(fileName);
+    SV_OpenRead(BASE_SLOT, gamemap);
 
     AssertSegment(ASEG_MAP_HEADER);
 
@@ -2457,7 +2451,7 @@ void SV_LoadMap(void)
 
 void SV_InitBaseSlot(void)
 {
-    SV_ClearSaveSlot(BASE_SLOT);
+    ClearSlotFiles(BASE_SLOT);
 }
 
 //==========================================================================
@@ -3116,7 +3110,7 @@ static void ArchiveSounds(void)
     for (node = SequenceListHead; node; node = node->next)
     {
         SV_WriteLong(node->sequence);
-        SV_WriteLong(node->delayTics);
+        SV_WriteLong(SN_GetSequenceDelay(node));
         SV_WriteLong(node->volume);
         SV_WriteLong(SN_GetSequenceOffset(node->sequence,
                                            node->sequencePtr));
@@ -3268,135 +3262,239 @@ static void AssertSegment(gameArchiveSegment_t segType)
 
 void SV_ClearSaveSlot(int slot)
 {
-    int i;
-    char fileName[100];
-
     // [crispy] get expanded save slot number
     if (slot != BASE_SLOT && slot != REBORN_SLOT)
     {
         slot += savepage * 10;
     }
 
-    for (i = 0; i < MAX_MAPS; i++)
+    ClearSlotFiles(slot);
+}
+
+//==========================================================================
+//
+// MemorySlotFile
+//
+// [AP] Returns the in-memory file for a map of the base or reborn slot,
+// or NULL for slots that live on disk.
+//
+//==========================================================================
+
+static slotfile_t *MemorySlotFile(int slot, int map)
+{
+    switch (slot)
+    {
+        case BASE_SLOT:
+            return &BaseSlotFiles[map];
+        case REBORN_SLOT:
+            return &RebornSlotFiles[map];
+        default:
+            return NULL;
+    }
+}
+
+static void SlotFileName(char *name, size_t name_len, int slot, int map)
+{
+    if (map == GAME_FILE)
     {
-        M_snprintf(fileName, sizeof(fileName),
-                   "%shex%d%02d.hxs", SavePath, slot, i);
-        M_remove(fileName);
+        M_snprintf(name, name_len, "%shex%d.hxs", SavePath, slot);
+    }
+    else
+    {
+        M_snprintf(name, name_len, "%shex%d%02d.hxs", SavePath, slot, map);
     }
-    M_snprintf(fileName, sizeof(fileName), "%shex%d.hxs", SavePath, slot);
-    M_remove(fileName);
+}
+
+static void FreeSlotFile(slotfile_t *file)
+{
+    free(file->data);
+    file->data = NULL;
+    file->length = 0;
 }
 
 //==========================================================================
 //
-// CopySaveSlot
+// ClearSlotFiles
 //
-// Copies all the save game files from one slot to another.
+// As SV_ClearSaveSlot, for a slot number that is already expanded.
 //
 //==========================================================================
 
-static void CopySaveSlot(int sourceSlot, int destSlot)
+static void ClearSlotFiles(int slot)
 {
     int i;
-    char sourceName[100];
-    char destName[100];
+    char fileName[100];
 
-    for (i = 0; i < MAX_MAPS; i++)
+    for (i = 0; i <= GAME_FILE; i++)
     {
-        M_snprintf(sourceName, sizeof(sourceName),
-                   "%shex%d%02d.hxs", SavePath, sourceSlot, i);
-        if (ExistingFile(sourceName))
+        if (MemorySlotFile(slot, i) != NULL)
         {
-            M_snprintf(destName, sizeof(destName),
-                       "%shex%d%02d.hxs", SavePath, destSlot, i);
-            CopyFile(sourceName, destName);
+            FreeSlotFile(MemorySlotFile(slot, i));
+        }
+        else
+        {
+            SlotFileName(fileName, sizeof(fileName), slot, i);
+            M_remove(fileName);
         }
     }
-    M_snprintf(sourceName, sizeof(sourceName),
-               "%shex%d.hxs", SavePath, sourceSlot);
-    if (ExistingFile(sourceName))
-    {
-        M_snprintf(destName, sizeof(destName),
-                   "%shex%d.hxs", SavePath, destSlot);
-        CopyFile(sourceName, destName);
-    }
-    else
+}
+
+//==========================================================================
+//
+// VanillaCopyLimit
+//
+// Vanilla savegame emulation.
+//
+// CopyFile() typically calls M_ReadFile() which stores the entire file
+// in memory: Chocolate Hexen should force an allocation error here
+// whenever it's appropriate.
+//
+//==========================================================================
+
+static void VanillaCopyLimit(int length)
+{
+    if (vanilla_savegame_limit)
     {
-        I_Error("Could not load savegame %s", sourceName);
+        Z_Free(Z_Malloc(length, PU_STATIC, NULL));
     }
 }
 
 //==========================================================================
 //
-// CopyFile
+// ReadSlotFile
+//
+// Loads a save file from disk into memory.
 //
-// This function was rewritten to copy files with minimal strain on zone
-// allocation and allow for big maps that technically work in vanilla to
-// save without error.
 //==========================================================================
 
-static void CopyFile(char *source_name, char *dest_name)
+static void ReadSlotFile(char *name, slotfile_t *file)
 {
-    const int BUFFER_CHUNK_SIZE = 0x10000;
+    FILE *handle;
 
-    byte *buffer;
-    int file_length, file_remaining;
-    FILE *read_handle, *write_handle;
-    int buf_count, read_count, write_count;
+    handle = M_fopen(name, "rb");
+    if (handle == NULL)
+    {
+        I_Error("Couldn't read file %s", name);
+    }
+
+    file->length = M_FileLength(handle);
+    VanillaCopyLimit(file->length);
+    file->data = malloc(file->length);
 
-    read_handle = M_fopen(source_name, "rb");
-    if (read_handle == NULL)
+    if (file->data == NULL
+     || fread(file->data, 1, file->length, handle) < (size_t) file->length)
     {
-        I_Error ("Couldn't read file %s", source_name);
+        I_Error("Couldn't read file %s", name);
     }
-    file_length = file_remaining = M_FileLength(read_handle);
 
-    // Vanilla savegame emulation.
-    //
-    // CopyFile() typically calls M_ReadFile() which stores the entire file
-    // in memory: Chocolate Hexen should force an allocation error here
-    // whenever it's appropriate.
+    fclose(handle);
+}
 
-    if (vanilla_savegame_limit)
+//==========================================================================
+//
+// CopySaveSlot
+//
+// Copies all the save game files from one slot to another, replacing
+// those the destination slot had.
+//
+// [AP] Only saving to a slot on disk writes files. They are written
+// next to the old ones first and only renamed over them once all have
+// been written, with hexN.hxs last, so a failed save leaves the old
+// one alone.
+//
+//==========================================================================
+
+static void CopySaveSlot(int sourceSlot, int destSlot)
+{
+    int i;
+    char sourceName[100];
+    char destName[100];
+    char *tempName;
+    slotfile_t *source;
+    slotfile_t *dest;
+
+    if (!SlotFileExists(sourceSlot, GAME_FILE))
     {
-        buffer = Z_Malloc(file_length, PU_STATIC, NULL);
-        Z_Free(buffer);
+        SlotFileName(sourceName, sizeof(sourceName), sourceSlot, GAME_FILE);
+        I_Error("Could not load savegame %s", sourceName);
     }
 
-    write_handle = M_fopen(dest_name, "wb");
-    if (write_handle == NULL)
+    if (MemorySlotFile(destSlot, GAME_FILE) != NULL)
     {
-        I_Error ("Couldn't read file %s", dest_name);
+        ClearSlotFiles(destSlot);
+
+        for (i = 0; i <= GAME_FILE; i++)
+        {
+            if (!SlotFileExists(sourceSlot, i))
+            {
+                continue;
+            }
+
+            source = MemorySlotFile(sourceSlot, i);
+            dest = MemorySlotFile(destSlot, i);
+
+            if (source == NULL)
+            {
+                SlotFileName(sourceName, sizeof(sourceName), sourceSlot, i);
+                ReadSlotFile(sourceName, dest);
+                continue;
+            }
+
+            VanillaCopyLimit(source->length);
+            dest->data = malloc(source->length);
+            if (dest->data == NULL)
+            {
+                I_Error("CopySaveSlot: Out of memory");
+            }
+            memcpy(dest->data, source->data, source->length);
+            dest->length = source->length;
+        }
+
+        return;
     }
 
-    buffer = Z_Malloc (BUFFER_CHUNK_SIZE, PU_STATIC, NULL);
+    // Games are only saved to disk from the base slot
 
-    do
+    for (i = 0; i <= GAME_FILE; i++)
     {
-        buf_count = BUFFER_CHUNK_SIZE;
-        if( file_remaining < BUFFER_CHUNK_SIZE)
+        source = MemorySlotFile(sourceSlot, i);
+
+        if (source->data == NULL)
         {
-            buf_count = file_remaining;
+            continue;
         }
 
-        read_count = fread(buffer, 1, buf_count, read_handle);
-        if (read_count < buf_count)
+        VanillaCopyLimit(source->length);
+        SlotFileName(destName, sizeof(destName), destSlot, i);
+        tempName = M_StringJoin(destName, ".tmp", NULL);
+
+        if (!M_WriteFile(tempName, source->data, source->length))
         {
-            I_Error ("Couldn't read file %s", source_name);
+            I_Error("Could not save game %s", destName);
         }
 
-        write_count = fwrite(buffer, 1, buf_count, write_handle);
-        if (write_count < buf_count)
+        free(tempName);
+    }
+
+    ClearSlotFiles(destSlot);
+
+    for (i = 0; i <= GAME_FILE; i++)
+    {
+        if (MemorySlotFile(sourceSlot, i)->data == NULL)
         {
-            I_Error ("Couldn't write to file %s", dest_name);
+            continue;
         }
 
-        file_remaining -= buf_count;
-    } while (file_remaining > 0);
+        SlotFileName(destName, sizeof(destName), destSlot, i);
+        tempName = M_StringJoin(destName, ".tmp", NULL);
 
-    Z_Free(buffer);
-    fclose(read_handle);
-    fclose(write_handle);
+        if (M_rename(tempName, destName) != 0)
+        {
+            I_Error("Could not save game %s", destName);
+        }
+
+        free(tempName);
+    }
 }
 
 //==========================================================================
@@ -3420,15 +3518,41 @@ static boolean ExistingFile(char *name)
     }
 }
 
+static boolean SlotFileExists(int slot, int map)
+{
+    char fileName[100];
+
+    if (MemorySlotFile(slot, map) != NULL)
+    {
+        return MemorySlotFile(slot, map)->data != NULL;
+    }
+
+    SlotFileName(fileName, sizeof(fileName), slot, map);
+    return ExistingFile(fileName);
+}
+
 //==========================================================================
 //
 // SV_Open
 //
 //==========================================================================
 
-static void SV_OpenRead(char *fileName)
+static void SV_OpenRead(int slot, int map)
 {
-    SavingFP = M_fopen(fileName, "rb");
+    char fileName[100];
+    slotfile_t *file = MemorySlotFile(slot, map);
+
+    SlotFileName(fileName, sizeof(fileName), slot, map);
+
+    if (file != NULL)
+    {
+        SavingFP = file->data != NULL
+                 ? mem_fopen_read(file->data, file->length) : NULL;
+    }
+    else
+    {
+        SavingFP = mem_fopen_file(fileName);
+    }
 
     // Should never happen, only if hex6.hxs cannot ever be created.
     if (SavingFP == NULL)
@@ -3437,9 +3561,10 @@ static void SV_OpenRead(char *fileName)
     }
 }
 
-static void SV_OpenWrite(char *fileName)
+static void SV_OpenWrite(int slot, int map)
 {
-    SavingFP = M_fopen(fileName, "wb");
+    SavingFP = mem_fopen_write();
+    SavingFile = MemorySlotFile(slot, map);
 }
 
 //==========================================================================
@@ -3450,10 +3575,30 @@ static void SV_OpenWrite(char *fileName)
 
 static void SV_Close(void)
 {
+    void *buf;
+    size_t length;
+
     if (SavingFP)
     {
-        fclose(SavingFP);
+        // [AP] Written files go to the in-memory slots
+        if (SavingFile != NULL)
+        {
+            mem_get_buf(SavingFP, &buf, &length);
+            FreeSlotFile(SavingFile);
+            SavingFile->data = malloc(length);
+            if (SavingFile->data == NULL)
+            {
+                I_Error("Could not save game: Out of memory");
+            }
+            memcpy(SavingFile->data, buf, length);
+            SavingFile->length = length;
+        }
+
+        mem_fclose(SavingFP);
+        SavingFP = NULL;
     }
+
+    SavingFile = NULL;
 }
 
 //==========================================================================
@@ -3464,7 +3609,7 @@ static void SV_Close(void)
 
 static void SV_Read(void *buffer, int size)
 {
-    int retval = fread(buffer, 1, size, SavingFP);
+    int retval = mem_fread(buffer, 1, size, SavingFP);
     if (retval != size)
     {
         I_Error("Incomplete read in SV_Read: Expected %d, got %d bytes",
@@ -3474,8 +3619,13 @@ static void SV_Read(void *buffer, int size)
 
 static byte SV_ReadByte(void)
 {
-    byte result;
-    SV_Read(&result, sizeof(byte));
+    int result = mem_fgetc(SavingFP);
+
+    if (result == EOF)
+    {
+        I_Error("Incomplete read in SV_Read: Expected 1, got 0 bytes");
+    }
+
     return result;
 }
 
@@ -3506,24 +3656,24 @@ static void *SV_ReadPtr(void)
 
 static void SV_Write(const void *buffer, int size)
 {
-    fwrite(buffer, size, 1, SavingFP);
+    mem_fwrite(buffer, size, 1, SavingFP);
 }
 
 static void SV_WriteByte(byte val)
 {
-    fwrite(&val, sizeof(byte), 1, SavingFP);
+    mem_fputc(val, SavingFP);
 }
 
 static void SV_WriteWord(unsigned short val)
 {
     val = SHORT(val);
-    fwrite(&val, sizeof(unsigned short), 1, SavingFP);
+    mem_fwrite(&val, sizeof(unsigned short), 1, SavingFP);
 }
 
 static void SV_WriteLong(unsigned int val)
 {
     val = LONG(val);
-    fwrite(&val, sizeof(int), 1, SavingFP);
+    mem_fwrite(&val, sizeof(int), 1, SavingFP);
 }
 
 static void SV_WritePtr(void *val)
@@ -0,0 +1,640 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Frame capture.
+//
+//	The game thread only copies the frame as it is, 8-bit with its
+//	palette or 32-bit with the channel shifts of its format, into a free
+//	slot. A worker expands it to 24-bit RGB and writes it. Frames go to
+//	their own numbered files, so any worker can take any of them; a pipe
+//	gets a single worker so the frames reach it in order.
+//
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBPNG
+#include <png.h>
+#endif
+
+#include "SDL.h"
+
+#include "i_capture.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_misc.h"
+
+#define CAPTURE_SLOTS 16
+#define CAPTURE_WORKERS 4
+
+typedef enum
+{
+    CAPTURE_PPM,
+    CAPTURE_QOI,
+    CAPTURE_PNG
+} captureformat_t;
+
+typedef struct
+{
+    // The frame as copied from the surface
+    byte *pixels;
+    size_t size;
+    int width, height, pitch, bpp;
+    byte palette[256][3];
+    int rshift, gshift, bshift;
+    int frame;
+
+    // Worker buffers, kept for the next frame in the slot
+    byte *rgb;
+    size_t rgb_size;
+    byte *encoded;
+    size_t encoded_size;
+} captureslot_t;
+
+boolean capturing = false;
+
+static captureformat_t captureformat;
+static const char *captureext;
+static char *capturedir;
+static FILE *capturepipe;
+static int nextframe;
+
+static captureslot_t slots[CAPTURE_SLOTS];
+static SDL_Thread *workers[CAPTURE_WORKERS];
+static int numworkers;
+static SDL_mutex *capturelock;
+static SDL_cond *capturecond;
+static boolean capturequit;
+
+// Behind capturelock: slots waiting to be written and free ones, each
+// a FIFO of slot numbers
+static int pending[CAPTURE_SLOTS], firstpending, numpending;
+static int freeslots[CAPTURE_SLOTS], firstfree, numfree;
+
+static void PushSlot(int *queue, int *first, int *count, int slot)
+{
+    queue[(*first + *count) % CAPTURE_SLOTS] = slot;
+    ++*count;
+}
+
+static int PopSlot(int *queue, int *first, int *count)
+{
+    int slot = queue[*first];
+
+    *first = (*first + 1) % CAPTURE_SLOTS;
+    --*count;
+
+    return slot;
+}
+
+static byte *GrowBuffer(byte **buffer, size_t *size, size_t needed)
+{
+    if (*size < needed)
+    {
+        *buffer = I_Realloc(*buffer, needed);
+        *size = needed;
+    }
+
+    return *buffer;
+}
+
+static void ConvertFrame(captureslot_t *slot)
+{
+    byte *dest;
+    int x, y;
+
+    dest = GrowBuffer(&slot->rgb, &slot->rgb_size,
+                      (size_t) slot->width * slot->height * 3);
+
+    for (y = 0; y < slot->height; y++)
+    {
+        const byte *src = slot->pixels + (size_t) y * slot->pitch;
+
+        if (slot->bpp == 1)
+        {
+            for (x = 0; x < slot->width; x++)
+            {
+                memcpy(dest, slot->palette[src[x]], 3);
+                dest += 3;
+            }
+        }
+        else
+        {
+            const uint32_t *src32 = (const uint32_t *) src;
+
+            for (x = 0; x < slot->width; x++)
+            {
+                dest[0] = (src32[x] >> slot->rshift) & 0xff;
+                dest[1] = (src32[x] >> slot->gshift) & 0xff;
+                dest[2] = (src32[x] >> slot->bshift) & 0xff;
+                dest += 3;
+            }
+        }
+    }
+}
+
+static boolean WritePPM(FILE *file, captureslot_t *slot)
+{
+    size_t length = (size_t) slot->width * slot->height * 3;
+
+    return fprintf(file, "P6\n%d %d\n255\n", slot->width, slot->height) > 0
+        && fwrite(slot->rgb, 1, length, file) == length;
+}
+
+// QOI, "the Quite OK Image format": lossless, and several times
+// faster to write than PNG while not much bigger for game frames.
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+
+#define QOI_HASH(r, g, b) (((r) * 3 + (g) * 5 + (b) * 7 + 255 * 11) % 64)
+
+static void WriteBigLong(byte *p, unsigned int value)
+{
+    p[0] = (value >> 24) & 0xff;
+    p[1] = (value >> 16) & 0xff;
+    p[2] = (value >> 8) & 0xff;
+    p[3] = value & 0xff;
+}
+
+static boolean WriteQOI(FILE *file, captureslot_t *slot)
+{
+    static const byte padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    byte index[64][3];
+    boolean indexed[64];
+    byte prev[3] = {0, 0, 0};
+    const byte *px, *end;
+    byte *out, *p;
+    int run = 0;
+
+    out = GrowBuffer(&slot->encoded, &slot->encoded_size,
+                     14 + (size_t) slot->width * slot->height * 4
+                        + sizeof(padding));
+
+    memcpy(out, "qoif", 4);
+    WriteBigLong(out + 4, slot->width);
+    WriteBigLong(out + 8, slot->height);
+    out[12] = 3; // RGB
+    out[13] = 0; // sRGB
+    p = out + 14;
+
+    memset(indexed, 0, sizeof(indexed));
+
+    px = slot->rgb;
+    end = px + (size_t) slot->width * slot->height * 3;
+
+    for (; px < end; px += 3)
+    {
+        int h;
+
+        if (px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2])
+        {
+            ++run;
+
+            if (run == 62 || px + 3 == end)
+            {
+                *p++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            continue;
+        }
+
+        if (run > 0)
+        {
+            *p++ = QOI_OP_RUN | (run - 1);
+            run = 0;
+        }
+
+        h = QOI_HASH(px[0], px[1], px[2]);
+
+        if (indexed[h] && !memcmp(index[h], px, 3))
+        {
+            *p++ = QOI_OP_INDEX | h;
+        }
+        else
+        {
+            signed char dr, dg, db, dr_dg, db_dg;
+
+            memcpy(index[h], px, 3);
+            indexed[h] = true;
+
+            dr = (signed char) (px[0] - prev[0]);
+            dg = (signed char) (px[1] - prev[1]);
+            db = (signed char) (px[2] - prev[2]);
+            dr_dg = dr - dg;
+            db_dg = db - dg;
+
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1
+             && db >= -2 && db <= 1)
+            {
+                *p++ = QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2)
+                                   | (db + 2);
+            }
+            else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7
+                  && db_dg >= -8 && db_dg <= 7)
+            {
+                *p++ = QOI_OP_LUMA | (dg + 32);
+                *p++ = ((dr_dg + 8) << 4) | (db_dg + 8);
+            }
+            else
+            {
+                *p++ = QOI_OP_RGB;
+                *p++ = px[0];
+                *p++ = px[1];
+                *p++ = px[2];
+            }
+        }
+
+        memcpy(prev, px, 3);
+    }
+
+    memcpy(p, padding, sizeof(padding));
+    p += sizeof(padding);
+
+    return fwrite(out, 1, p - out, file) == (size_t) (p - out);
+}
+
+#ifdef HAVE_LIBPNG
+static boolean WritePNG(FILE *file, captureslot_t *slot)
+{
+    png_structp ppng;
+    png_infop pinfo;
+    int y;
+
+    ppng = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!ppng)
+    {
+        return false;
+    }
+
+    pinfo = png_create_info_struct(ppng);
+    if (!pinfo)
+    {
+        png_destroy_write_struct(&ppng, NULL);
+        return false;
+    }
+
+    png_init_io(ppng, file);
+
+    // Capture is about keeping up, not small files
+    png_set_compression_level(ppng, 1);
+
+    png_set_IHDR(ppng, pinfo, slot->width, slot->height,
+                 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(ppng, pinfo);
+
+    for (y = 0; y < slot->height; y++)
+    {
+        png_write_row(ppng, slot->rgb + (size_t) y * slot->width * 3);
+    }
+
+    png_write_end(ppng, pinfo);
+    png_destroy_write_struct(&ppng, &pinfo);
+
+    return true;
+}
+#endif
+
+static void WriteFrame(captureslot_t *slot)
+{
+    char *filename;
+    size_t filename_len;
+    FILE *file;
+    boolean result;
+
+    ConvertFrame(slot);
+
+    if (capturepipe != NULL)
+    {
+        if (!WritePPM(capturepipe, slot))
+        {
+            fprintf(stderr, "WriteFrame: Failed to write frame %d "
+                            "to the capture pipe\n", slot->frame);
+        }
+
+        return;
+    }
+
+    filename_len = strlen(capturedir) + 32;
+    filename = malloc(filename_len);
+    M_snprintf(filename, filename_len, "%s" DIR_SEPARATOR_S "frame%06d.%s",
+               capturedir, slot->frame, captureext);
+
+    file = M_fopen(filename, "wb");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "WriteFrame: Couldn't create %s\n", filename);
+        free(filename);
+        return;
+    }
+
+    switch (captureformat)
+    {
+#ifdef HAVE_LIBPNG
+        case CAPTURE_PNG:
+            result = WritePNG(file, slot);
+            break;
+#endif
+        case CAPTURE_QOI:
+            result = WriteQOI(file, slot);
+            break;
+
+        default:
+            result = WritePPM(file, slot);
+            break;
+    }
+
+    if (fclose(file) != 0 || !result)
+    {
+        fprintf(stderr, "WriteFrame: Failed to write %s\n", filename);
+    }
+
+    free(filename);
+}
+
+static int CaptureThread(void *unused)
+{
+    int slot;
+
+    SDL_LockMutex(capturelock);
+
+    while (true)
+    {
+        while (numpending == 0 && !capturequit)
+        {
+            SDL_CondWait(capturecond, capturelock);
+        }
+
+        // Frames still queued are written before quitting
+        if (numpending == 0)
+        {
+            break;
+        }
+
+        slot = PopSlot(pending, &firstpending, &numpending);
+
+        SDL_UnlockMutex(capturelock);
+        WriteFrame(&slots[slot]);
+        SDL_LockMutex(capturelock);
+
+        PushSlot(freeslots, &firstfree, &numfree, slot);
+        SDL_CondBroadcast(capturecond);
+    }
+
+    SDL_UnlockMutex(capturelock);
+
+    return 0;
+}
+
+static void I_ShutdownCapture(void)
+{
+    int i;
+
+    SDL_LockMutex(capturelock);
+    capturequit = true;
+    SDL_CondBroadcast(capturecond);
+    SDL_UnlockMutex(capturelock);
+
+    for (i = 0; i < numworkers; i++)
+    {
+        SDL_WaitThread(workers[i], NULL);
+    }
+
+    numworkers = 0;
+
+    if (capturepipe != NULL)
+    {
+#ifdef _WIN32
+        _pclose(capturepipe);
+#else
+        pclose(capturepipe);
+#endif
+        capturepipe = NULL;
+    }
+
+    printf("I_ShutdownCapture: %d frames captured\n", nextframe);
+}
+
+void I_InitCapture(void)
+{
+    const char *command = NULL;
+    int wanted;
+    int i;
+
+    //!
+    // @arg <dir>
+    // @category video
+    //
+    // Write every frame to dir as a numbered image, in the format picked
+    // with -captureformat. Nothing is dropped: the game waits when the
+    // writers fall behind. Best used with -timedemo or -playdemo.
+    //
+
+    i = M_CheckParmWithArgs("-capture", 1);
+
+    if (i > 0)
+    {
+        capturedir = M_StringDuplicate(myargv[i + 1]);
+    }
+
+    //!
+    // @arg <command>
+    // @category video
+    //
+    // Run command and write every frame to its standard input as a
+    // stream of PPM images, e.g. for ffmpeg -f image2pipe -i -.
+    //
+
+    i = M_CheckParmWithArgs("-capturepipe", 1);
+
+    if (i > 0)
+    {
+        command = myargv[i + 1];
+    }
+
+    if (capturedir == NULL && command == NULL)
+    {
+        return;
+    }
+
+    //!
+    // @arg <format>
+    // @category video
+    //
+    // Image format for -capture: ppm (the default), qoi, or png if the
+    // game was built with libpng.
+    //
+
+    captureformat = CAPTURE_PPM;
+    captureext = "ppm";
+
+    i = M_CheckParmWithArgs("-captureformat", 1);
+
+    if (i > 0)
+    {
+        if (!strcasecmp(myargv[i + 1], "qoi"))
+        {
+            captureformat = CAPTURE_QOI;
+            captureext = "qoi";
+        }
+#ifdef HAVE_LIBPNG
+        else if (!strcasecmp(myargv[i + 1], "png"))
+        {
+            captureformat = CAPTURE_PNG;
+            captureext = "png";
+        }
+#endif
+        else if (strcasecmp(myargv[i + 1], "ppm"))
+        {
+            I_Error("I_InitCapture: Unknown capture format '%s'",
+                    myargv[i + 1]);
+        }
+    }
+
+    if (command != NULL)
+    {
+#ifdef _WIN32
+        capturepipe = _popen(command, "wb");
+#else
+        capturepipe = popen(command, "w");
+#endif
+
+        if (capturepipe == NULL)
+        {
+            I_Error("I_InitCapture: Couldn't run '%s'", command);
+        }
+
+        printf("I_InitCapture: Writing frames to '%s'\n", command);
+        wanted = 1;
+    }
+    else
+    {
+        M_MakeDirectory(capturedir);
+        printf("I_InitCapture: Writing %s frames to %s\n",
+               captureext, capturedir);
+        wanted = SDL_GetCPUCount() - 1;
+
+        if (wanted < 1)
+        {
+            wanted = 1;
+        }
+        else if (wanted > CAPTURE_WORKERS)
+        {
+            wanted = CAPTURE_WORKERS;
+        }
+    }
+
+    for (i = 0; i < CAPTURE_SLOTS; i++)
+    {
+        PushSlot(freeslots, &firstfree, &numfree, i);
+    }
+
+    capturelock = SDL_CreateMutex();
+    capturecond = SDL_CreateCond();
+
+    for (numworkers = 0; numworkers < wanted; numworkers++)
+    {
+        workers[numworkers] = SDL_CreateThread(CaptureThread, "I_Capture",
+                                               NULL);
+
+        if (workers[numworkers] == NULL)
+        {
+            fprintf(stderr, "I_InitCapture: %s\n", SDL_GetError());
+            break;
+        }
+    }
+
+    capturing = true;
+
+    // Also on I_Error, so the frames up to it are kept
+    I_AtExit(I_ShutdownCapture, true);
+}
+
+void I_CaptureFrame(SDL_Surface *surface, const SDL_Color *palette)
+{
+    captureslot_t *slot;
+    size_t rowsize;
+    int index;
+    int y;
+
+    if (numworkers > 0)
+    {
+        SDL_LockMutex(capturelock);
+
+        while (numfree == 0)
+        {
+            SDL_CondWait(capturecond, capturelock);
+        }
+
+        index = PopSlot(freeslots, &firstfree, &numfree);
+        SDL_UnlockMutex(capturelock);
+    }
+    else
+    {
+        index = 0;
+    }
+
+    slot = &slots[index];
+    slot->width = surface->w;
+    slot->height = surface->h;
+    slot->bpp = surface->format->BytesPerPixel;
+    slot->frame = nextframe++;
+
+    rowsize = (size_t) slot->width * slot->bpp;
+    slot->pitch = (int) rowsize;
+    GrowBuffer(&slot->pixels, &slot->size, rowsize * slot->height);
+
+    for (y = 0; y < slot->height; y++)
+    {
+        memcpy(slot->pixels + rowsize * y,
+               (const byte *) surface->pixels + (size_t) y * surface->pitch,
+               rowsize);
+    }
+
+    if (palette != NULL)
+    {
+        for (y = 0; y < 256; y++)
+        {
+            slot->palette[y][0] = palette[y].r;
+            slot->palette[y][1] = palette[y].g;
+            slot->palette[y][2] = palette[y].b;
+        }
+    }
+    else
+    {
+        slot->rshift = surface->format->Rshift;
+        slot->gshift = surface->format->Gshift;
+        slot->bshift = surface->format->Bshift;
+    }
+
+    if (numworkers == 0)
+    {
+        WriteFrame(slot);
+        return;
+    }
+
+    SDL_LockMutex(capturelock);
+    PushSlot(pending, &firstpending, &numpending, index);
+    SDL_CondBroadcast(capturecond);
+    SDL_UnlockMutex(capturelock);
+}
@@ -0,0 +1,40 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Frame capture for -capture and -capturepipe. Every frame that
+//	I_FinishUpdate finishes is copied into one of a few slots and
+//	written out by worker threads, as numbered image files or as a
+//	stream of PPM frames to an encoder. When all the slots are taken
+//	the game waits for one, so no frame is dropped.
+//
+
+#ifndef __I_CAPTURE__
+#define __I_CAPTURE__
+
+#include "doomtype.h"
+
+struct SDL_Surface;
+struct SDL_Color;
+
+extern boolean capturing;
+
+// Checks the command line and starts the workers if capturing.
+void I_InitCapture(void);
+
+// Queues a copy of the frame in surface, 8-bit with palette or 32-bit
+// with palette NULL.
+void I_CaptureFrame(struct SDL_Surface *surface,
+                    const struct SDL_Color *palette);
+
+#endif
@@ -19,6 +19,9 @@
 
 #ifdef HAVE_FLUIDSYNTH
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "fluidsynth.h"
 
 #if (FLUIDSYNTH_VERSION_MAJOR < 2 ||                                           \
@@ -33,11 +36,13 @@ typedef fluid_long_long_t fluid_int_t;
 
 #endif
 
+#include "SDL.h"
 #include "SDL_mixer.h"
 
 #include "doomtype.h"
 #include "i_system.h"
 #include "i_sound.h"
+#include "i_soundstats.h"
 #include "m_misc.h"
 #include "memio.h"
 #include "mus2mid.h"
@@ -55,22 +60,188 @@ float fsynth_reverb_damp = 0.4f;
 float fsynth_reverb_level = 0.15f;
 float fsynth_reverb_roomsize = 0.6f;
 float fsynth_reverb_width = 4.0f;
+int fsynth_buffer_ms = 100;
 
 static fluid_synth_t *synth = NULL;
 static fluid_settings_t *settings = NULL;
 static fluid_player_t *player = NULL;
 
+// FluidSynth renders on its own thread, FL_BLOCK frames at a time, into a
+// ring that the mixer callback only copies from. The head and tail count
+// frames; the ring is a whole number of blocks, so a block never wraps.
+
+#define FL_BLOCK 512
+
+static int16_t *fl_ring = NULL;
+static unsigned int fl_ring_frames;
+static SDL_atomic_t fl_head, fl_tail;
+static SDL_atomic_t fl_flush;
+
+static SDL_Thread *fl_thread = NULL;
+static SDL_mutex *fl_render_lock;  // Held while a block renders
+static SDL_sem *fl_wake;
+static SDL_atomic_t fl_quit;
+
 static void FL_Mix_Callback(void *udata, Uint8 *stream, int len)
 {
-    int result;
+    int16_t *out = (int16_t *) stream;
+    unsigned int frames = len / 4;
+    unsigned int head, avail, n, pos;
+    boolean playing;
+
+    if (SDL_AtomicSet(&fl_flush, 0))
+    {
+        SDL_AtomicSet(&fl_head, SDL_AtomicGet(&fl_tail));
+    }
+
+    head = SDL_AtomicGet(&fl_head);
+    avail = (unsigned int) SDL_AtomicGet(&fl_tail) - head;
 
-    result = fluid_synth_write_s16(synth, len / 4, stream, 0, 2, stream, 1, 2);
+    playing = player != NULL
+           && fluid_player_get_status(player) == FLUID_PLAYER_PLAYING;
 
-    if (result != FLUID_OK)
+    if (playing)
     {
-        fprintf(stderr,
-                "FL_Mix_Callback: Error generating FluidSynth audio.\n");
+        I_SoundStatsFill(SNDSTATS_FLUIDSYNTH, avail);
+    }
+
+    n = avail < frames ? avail : frames;
+
+    while (n > 0)
+    {
+        unsigned int run;
+
+        pos = head % fl_ring_frames;
+        run = fl_ring_frames - pos;
+
+        if (run > n)
+        {
+            run = n;
+        }
+
+        memcpy(out, fl_ring + pos * 2, run * 4);
+        out += run * 2;
+        head += run;
+        n -= run;
+    }
+
+    SDL_AtomicSet(&fl_head, head);
+
+    if (avail < frames)
+    {
+        memset(out, 0, (frames - avail) * 4);
+
+        if (playing)
+        {
+            I_SoundStatsUnderrun(SNDSTATS_FLUIDSYNTH);
+        }
+    }
+
+    SDL_SemPost(fl_wake);
+}
+
+static int FL_RenderThread(void *unused)
+{
+    while (!SDL_AtomicGet(&fl_quit))
+    {
+        unsigned int tail;
+        boolean rendered = false;
+
+        SDL_LockMutex(fl_render_lock);
+
+        tail = SDL_AtomicGet(&fl_tail);
+
+        if (player != NULL
+         && tail - (unsigned int) SDL_AtomicGet(&fl_head) + FL_BLOCK
+            <= fl_ring_frames)
+        {
+            int16_t *block = fl_ring + (tail % fl_ring_frames) * 2;
+            Uint64 start = I_SoundStatsBegin();
+
+            if (fluid_synth_write_s16(synth, FL_BLOCK, block, 0, 2,
+                                      block, 1, 2) != FLUID_OK)
+            {
+                memset(block, 0, FL_BLOCK * 4);
+            }
+
+            I_SoundStatsCallback(SNDSTATS_FLUIDSYNTH, FL_BLOCK, start);
+
+            SDL_AtomicSet(&fl_tail, tail + FL_BLOCK);
+            rendered = true;
+        }
+
+        SDL_UnlockMutex(fl_render_lock);
+
+        if (!rendered)
+        {
+            // The timeout covers a wake up missed between the checks
+            SDL_SemWaitTimeout(fl_wake, 10);
+        }
+    }
+
+    return 0;
+}
+
+// Drops what's buffered, so that a stop or a new song is heard at once.
+
+static void FL_Flush(void)
+{
+    SDL_AtomicSet(&fl_flush, 1);
+}
+
+static boolean FL_StartThread(void)
+{
+    int frames;
+
+    frames = (int) ((long long) snd_samplerate * fsynth_buffer_ms / 1000);
+
+    // Room for at least one block while the mixer holds another
+    if (frames < 2 * FL_BLOCK)
+    {
+        frames = 2 * FL_BLOCK;
     }
+
+    fl_ring_frames = (frames + FL_BLOCK - 1) / FL_BLOCK * FL_BLOCK;
+
+    fl_ring = malloc(fl_ring_frames * 4);
+    SDL_AtomicSet(&fl_head, 0);
+    SDL_AtomicSet(&fl_tail, 0);
+    SDL_AtomicSet(&fl_flush, 0);
+    SDL_AtomicSet(&fl_quit, 0);
+
+    fl_render_lock = SDL_CreateMutex();
+    fl_wake = SDL_CreateSemaphore(0);
+    fl_thread = SDL_CreateThread(FL_RenderThread, "FL_Render", NULL);
+
+    if (fl_thread == NULL)
+    {
+        fprintf(stderr, "FL_StartThread: %s\n", SDL_GetError());
+        SDL_DestroySemaphore(fl_wake);
+        SDL_DestroyMutex(fl_render_lock);
+        free(fl_ring);
+        fl_ring = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static void FL_StopThread(void)
+{
+    if (fl_thread == NULL)
+    {
+        return;
+    }
+
+    SDL_AtomicSet(&fl_quit, 1);
+    SDL_SemPost(fl_wake);
+    SDL_WaitThread(fl_thread, NULL);
+    fl_thread = NULL;
+
+    SDL_DestroySemaphore(fl_wake);
+    SDL_DestroyMutex(fl_render_lock);
+    free(fl_ring);
+    fl_ring = NULL;
 }
 
 static boolean I_FL_InitMusic(void)
@@ -134,6 +305,15 @@ static boolean I_FL_InitMusic(void)
         return false;
     }
 
+    if (!FL_StartThread())
+    {
+        delete_fluid_synth(synth);
+        synth = NULL;
+        delete_fluid_settings(settings);
+        settings = NULL;
+        return false;
+    }
+
     printf("I_FL_InitMusic: Using '%s'.\n", fsynth_sf_path);
 
     return true;
@@ -149,6 +329,7 @@ static void I_FL_SetMusicVolume(int volume)
 static void I_FL_PauseSong(void)
 {
     fluid_player_stop(player);
+    FL_Flush();
 }
 
 static void I_FL_ResumeSong(void)
@@ -158,6 +339,7 @@ static void I_FL_ResumeSong(void)
 
 static void I_FL_PlaySong(void *handle, boolean looping)
 {
+    FL_Flush();
     fluid_player_set_loop(player, looping ? -1 : 1);
     fluid_player_play(player);
 }
@@ -167,54 +349,55 @@ static void I_FL_StopSong(void)
     if (player)
     {
         fluid_player_stop(player);
+        FL_Flush();
     }
 }
 
 static void *I_FL_RegisterSong(void *data, int len)
 {
     int result = FLUID_FAILED;
+    fluid_player_t *new_player;
 
-    player = new_fluid_player(synth);
+    new_player = new_fluid_player(synth);
 
     if (IsMid(data, len))
     {
-        result = fluid_player_add_mem(player, data, len);
+        result = fluid_player_add_mem(new_player, data, len);
 
         if (result == FLUID_FAILED)
         {
             fprintf(stderr,
                     "I_FL_RegisterSong: FluidSynth failed to load MIDI.\n");
+            delete_fluid_player(new_player);
             return NULL;
         }
     }
     else
     {
         // Assume a MUS file and try to convert
-        MEMFILE *instream;
-        MEMFILE *outstream;
-        void *outbuf;
-        size_t outbuf_len;
-
-        instream = mem_fopen_read(data, len);
-        outstream = mem_fopen_write();
+        const void *mid;
+        size_t mid_len;
 
-        if (mus2mid(instream, outstream) == 0)
+        // [AP] Cached, songs come back often
+        if (mus2mid_cached(data, len, &mid, &mid_len))
         {
-            mem_get_buf(outstream, &outbuf, &outbuf_len);
-            result = fluid_player_add_mem(player, outbuf, outbuf_len);
+            result = fluid_player_add_mem(new_player, mid, mid_len);
         }
 
-        mem_fclose(instream);
-        mem_fclose(outstream);
-
         if (result == FLUID_FAILED)
         {
             fprintf(stderr,
                     "I_FL_RegisterSong: FluidSynth failed to load MUS.\n");
+            delete_fluid_player(new_player);
             return NULL;
         }
     }
 
+    // The render thread picks the player up once it's complete
+    SDL_LockMutex(fl_render_lock);
+    player = new_player;
+    SDL_UnlockMutex(fl_render_lock);
+
     Mix_HookMusic(FL_Mix_Callback, NULL);
     return player;
 }
@@ -223,13 +406,19 @@ static void I_FL_UnRegisterSong(void *handle)
 {
     if (player)
     {
+        Mix_HookMusic(NULL, NULL);
+
+        SDL_LockMutex(fl_render_lock);
+
         fluid_synth_program_reset(synth);
         fluid_synth_system_reset(synth);
 
-        Mix_HookMusic(NULL, NULL);
-
         delete_fluid_player(player);
         player = NULL;
+
+        SDL_UnlockMutex(fl_render_lock);
+
+        FL_Flush();
     }
 }
 
@@ -237,6 +426,7 @@ static void I_FL_ShutdownMusic(void)
 {
     I_FL_StopSong();
     I_FL_UnRegisterSong(NULL);
+    FL_StopThread();
 
     if (synth)
     {
@@ -111,6 +111,14 @@ int mouse_y_invert = 0;
 
 int runcentering = 1; // [crispy]
 
+// [AP] Read the mouse every frame and turn the view with it right away,
+// rather than when the next ticcmd runs. Only Doom binds this.
+int fast_mouse = 0;
+
+// [AP] Have SDL report raw, unaccelerated relative motion, whatever the
+// platform default or environment says.
+int raw_mouse = 1;
+
 // Translates the SDL key to a value of the type found in doomkeys.h
 static int TranslateKey(SDL_Keysym *sym)
 {
@@ -494,7 +502,8 @@ void I_ReadMouse(void)
 
     SDL_GetRelativeMouseState(&x, &y);
 
-    if (crispy->uncapped)
+    // [AP] Read every frame, there's no sampling jitter to spread out
+    if (crispy->uncapped && !fast_mouse)
     {
         SmoothMouse(&x, &y);
     }
@@ -520,6 +529,21 @@ void I_ReadMouse(void)
     }
 }
 
+// [AP] Takes effect when relative mouse mode is next turned on.
+void I_SetMouseHints(void)
+{
+    if (raw_mouse)
+    {
+        SDL_SetHint(SDL_HINT_MOUSE_RELATIVE_MODE_WARP, "0");
+#ifdef SDL_HINT_MOUSE_RELATIVE_SYSTEM_SCALE
+        SDL_SetHint(SDL_HINT_MOUSE_RELATIVE_SYSTEM_SCALE, "0");
+#endif
+#ifdef SDL_HINT_MOUSE_RELATIVE_SPEED_SCALE
+        SDL_SetHint(SDL_HINT_MOUSE_RELATIVE_SPEED_SCALE, "1.0");
+#endif
+    }
+}
+
 // [crispy]
 void I_BindStrifeInputVariables(void)
 {
@@ -536,4 +560,5 @@ void I_BindInputVariables(void)
     M_BindFloatVariable("mouse_acceleration_y",    &mouse_acceleration_y); // [crispy]
     M_BindIntVariable("mouse_threshold_y",         &mouse_threshold_y); // [crispy]
     M_BindIntVariable("mouse_y_invert",            &mouse_y_invert); // [crispy]
+    M_BindIntVariable("raw_mouse",                 &raw_mouse); // [AP]
 }
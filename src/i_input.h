@@ -34,10 +34,13 @@ extern int mouse_threshold_y; // [crispy]
 extern int mouse_y_invert; // [crispy]
 extern int novert; // [crispy]
 extern int runcentering; // [crispy]
+extern int fast_mouse; // [AP]
+extern int raw_mouse; // [AP]
 
 void I_BindStrifeInputVariables(void); // [crispy]
 void I_BindInputVariables(void);
 void I_ReadMouse(void);
+void I_SetMouseHints(void); // [AP]
 
 // I_StartTextInput begins text input, activating the on-screen keyboard
 // (if one is used). The caller indicates that any entered text will be
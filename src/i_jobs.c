@@ -0,0 +1,444 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Job pool. Each thread has its own queue: it takes its newest job
+//	first, and steals the oldest from the others when it runs out.
+//	The main thread is thread 0, and jobs added from a thread that's
+//	not in the pool go in its queue.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "doomtype.h"
+#include "i_jobs.h"
+#include "i_system.h"
+#include "i_trace.h"
+#include "m_argv.h"
+
+#if defined(_MSC_VER)
+#define I_THREADLOCAL __declspec(thread)
+#else
+#define I_THREADLOCAL __thread
+#endif
+
+#define MAXJOBTHREADS 16
+#define JOBQUEUESIZE 1024 // Power of two
+#define JOBSCRATCHSIZE (1 << 20)
+#define JOBCHUNKSIZE (64 << 10)
+#define JOBALIGN 16
+
+typedef struct
+{
+    jobfunc_t func;
+    void *data;
+    jobgroup_t *group;
+} job_t;
+
+typedef struct
+{
+    SDL_SpinLock lock;
+    job_t jobs[JOBQUEUESIZE];
+    unsigned int head; // Oldest, stolen from here
+    unsigned int tail; // Newest, taken from here
+    byte *scratch;
+    size_t scratchused;
+    SDL_Thread *thread;
+} jobthread_t;
+
+typedef struct jobchunk_s
+{
+    struct jobchunk_s *next;
+    size_t size;
+    size_t used;
+} jobchunk_t;
+
+struct jobgroup_s
+{
+    SDL_atomic_t pending;
+    SDL_SpinLock alloclock;
+    jobchunk_t *chunks;
+};
+
+static jobthread_t threads[MAXJOBTHREADS];
+static int numthreads = 1;
+static SDL_sem *jobsignal; // Once per job queued
+static SDL_mutex *donelock;
+static SDL_cond *donecond; // When a group has none left
+static boolean jobquit;
+
+// -1 for threads outside the pool
+static I_THREADLOCAL int jobthread = -1;
+
+static size_t Align(size_t size)
+{
+    return (size + JOBALIGN - 1) & ~(size_t) (JOBALIGN - 1);
+}
+
+static void FinishJob(jobgroup_t *group)
+{
+    if (SDL_AtomicAdd(&group->pending, -1) == 1)
+    {
+        SDL_LockMutex(donelock);
+        SDL_CondBroadcast(donecond);
+        SDL_UnlockMutex(donelock);
+    }
+}
+
+static void RunJob(job_t *job, int self)
+{
+    jobthread_t *thread = &threads[self];
+    size_t scratchused = thread->scratchused;
+
+    job->func(job->data, self);
+
+    // A job waiting on others may have run them on top of its scratch
+    thread->scratchused = scratchused;
+
+    FinishJob(job->group);
+}
+
+static boolean TakeJob(jobthread_t *thread, job_t *job, boolean newest)
+{
+    boolean found = false;
+
+    SDL_AtomicLock(&thread->lock);
+
+    if (thread->head != thread->tail)
+    {
+        if (newest)
+        {
+            *job = thread->jobs[--thread->tail & (JOBQUEUESIZE - 1)];
+        }
+        else
+        {
+            *job = thread->jobs[thread->head++ & (JOBQUEUESIZE - 1)];
+        }
+
+        found = true;
+    }
+
+    SDL_AtomicUnlock(&thread->lock);
+
+    return found;
+}
+
+static boolean RunOneJob(int self)
+{
+    job_t job;
+    int i;
+
+    if (TakeJob(&threads[self], &job, true))
+    {
+        RunJob(&job, self);
+        return true;
+    }
+
+    for (i = 1; i < numthreads; ++i)
+    {
+        if (TakeJob(&threads[(self + i) % numthreads], &job, false))
+        {
+            RunJob(&job, self);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int JobThread(void *data)
+{
+    jobthread = (int) (intptr_t) data;
+
+    while (1)
+    {
+        SDL_SemWait(jobsignal);
+
+        if (jobquit)
+        {
+            break;
+        }
+
+        // Someone waiting may have run it already
+        RunOneJob(jobthread);
+    }
+
+    return 0;
+}
+
+static void I_ShutdownJobs(void)
+{
+    int i;
+
+    jobquit = true;
+
+    for (i = 1; i < numthreads; ++i)
+    {
+        SDL_SemPost(jobsignal);
+    }
+
+    for (i = 1; i < numthreads; ++i)
+    {
+        SDL_WaitThread(threads[i].thread, NULL);
+    }
+
+    numthreads = 1;
+}
+
+void I_InitJobs(void)
+{
+    int p, i;
+
+    jobthread = 0;
+    threads[0].scratch = malloc(JOBSCRATCHSIZE);
+    donelock = SDL_CreateMutex();
+    donecond = SDL_CreateCond();
+
+    if (threads[0].scratch == NULL || donelock == NULL || donecond == NULL)
+    {
+        I_Error("I_InitJobs: Out of memory");
+    }
+
+    //!
+    // @arg <n>
+    // @category obscure
+    //
+    // Run jobs on n threads, the main thread included. 1 runs them on
+    // the main thread as they come. The default is one per CPU.
+    //
+
+    p = M_CheckParmWithArgs("-jobthreads", 1);
+
+    if (p > 0)
+    {
+        numthreads = atoi(myargv[p + 1]);
+    }
+    else
+    {
+        numthreads = SDL_GetCPUCount();
+    }
+
+    if (numthreads < 1)
+    {
+        numthreads = 1;
+    }
+
+    if (numthreads > MAXJOBTHREADS)
+    {
+        numthreads = MAXJOBTHREADS;
+    }
+
+    if (numthreads == 1)
+    {
+        return;
+    }
+
+    jobsignal = SDL_CreateSemaphore(0);
+
+    if (jobsignal == NULL)
+    {
+        numthreads = 1;
+        return;
+    }
+
+    for (i = 1; i < numthreads; ++i)
+    {
+        threads[i].scratch = malloc(JOBSCRATCHSIZE);
+        threads[i].thread = SDL_CreateThread(JobThread, "I_JobThread",
+                                             (void *) (intptr_t) i);
+
+        if (threads[i].scratch == NULL || threads[i].thread == NULL)
+        {
+            break;
+        }
+    }
+
+    // Fewer then, the queues of the ones that didn't start stay empty
+    numthreads = i;
+
+    I_AtExit(I_ShutdownJobs, true);
+}
+
+int I_JobThreads(void)
+{
+    return numthreads;
+}
+
+jobgroup_t *I_JobGroup(void)
+{
+    jobgroup_t *group;
+
+    group = calloc(1, sizeof(*group));
+
+    if (group == NULL)
+    {
+        I_Error("I_JobGroup: Out of memory");
+    }
+
+    return group;
+}
+
+void I_AddJob(jobgroup_t *group, jobfunc_t func, void *data)
+{
+    jobthread_t *thread;
+    job_t job;
+    boolean queued = false;
+
+    job.func = func;
+    job.data = data;
+    job.group = group;
+    SDL_AtomicAdd(&group->pending, 1);
+
+    if (numthreads == 1)
+    {
+        RunJob(&job, 0);
+        return;
+    }
+
+    thread = &threads[jobthread >= 0 ? jobthread : 0];
+
+    SDL_AtomicLock(&thread->lock);
+
+    if (thread->tail - thread->head < JOBQUEUESIZE)
+    {
+        thread->jobs[thread->tail++ & (JOBQUEUESIZE - 1)] = job;
+        queued = true;
+    }
+
+    SDL_AtomicUnlock(&thread->lock);
+
+    if (queued)
+    {
+        SDL_SemPost(jobsignal);
+    }
+    else if (jobthread >= 0)
+    {
+        RunJob(&job, jobthread);
+    }
+    else
+    {
+        // Outside the pool, and the main thread has a full queue
+        job.func(job.data, 0);
+        FinishJob(group);
+    }
+}
+
+void I_WaitJobs(jobgroup_t *group)
+{
+    if (SDL_AtomicGet(&group->pending) == 0)
+    {
+        return;
+    }
+
+    I_TraceBegin("wait jobs", NULL);
+
+    // Help while there's anything to take
+    if (jobthread >= 0)
+    {
+        while (SDL_AtomicGet(&group->pending) > 0 && RunOneJob(jobthread))
+        {
+        }
+    }
+
+    // Then the last ones are running elsewhere
+    SDL_LockMutex(donelock);
+
+    while (SDL_AtomicGet(&group->pending) > 0)
+    {
+        SDL_CondWait(donecond, donelock);
+    }
+
+    SDL_UnlockMutex(donelock);
+
+    I_TraceEnd("wait jobs");
+}
+
+void I_FreeJobGroup(jobgroup_t *group)
+{
+    jobchunk_t *chunk, *next;
+
+    I_WaitJobs(group);
+
+    for (chunk = group->chunks; chunk != NULL; chunk = next)
+    {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    free(group);
+}
+
+void *I_JobScratch(size_t size)
+{
+    jobthread_t *thread;
+    void *result;
+
+    if (jobthread < 0)
+    {
+        I_Error("I_JobScratch: Not called from a job");
+    }
+
+    thread = &threads[jobthread];
+    size = Align(size);
+
+    if (size > JOBSCRATCHSIZE - thread->scratchused)
+    {
+        I_Error("I_JobScratch: %d bytes don't fit", (int) size);
+    }
+
+    result = thread->scratch + thread->scratchused;
+    thread->scratchused += size;
+
+    return result;
+}
+
+void *I_JobGroupAlloc(jobgroup_t *group, size_t size)
+{
+    jobchunk_t *chunk;
+    void *result;
+    size_t header = Align(sizeof(jobchunk_t));
+
+    size = Align(size);
+
+    SDL_AtomicLock(&group->alloclock);
+
+    chunk = group->chunks;
+
+    if (chunk == NULL || size > chunk->size - chunk->used)
+    {
+        size_t chunksize = size > JOBCHUNKSIZE ? size : JOBCHUNKSIZE;
+
+        chunk = malloc(header + chunksize);
+
+        if (chunk == NULL)
+        {
+            SDL_AtomicUnlock(&group->alloclock);
+            I_Error("I_JobGroupAlloc: Out of memory");
+        }
+
+        chunk->size = chunksize;
+        chunk->used = 0;
+        chunk->next = group->chunks;
+        group->chunks = chunk;
+    }
+
+    result = (byte *) chunk + header + chunk->used;
+    chunk->used += size;
+
+    SDL_AtomicUnlock(&group->alloclock);
+
+    return result;
+}
@@ -0,0 +1,60 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	One pool of worker threads for whatever can be split into jobs.
+//	Jobs go in groups, and waiting for a group runs its jobs, or
+//	anyone else's, instead of sleeping. A job must not touch the zone
+//	or the WAD, which belong to the main thread; it gets scratch
+//	memory and can keep what it produces in its group instead.
+//
+
+#ifndef __I_JOBS__
+#define __I_JOBS__
+
+#include <stddef.h>
+
+typedef struct jobgroup_s jobgroup_t;
+
+// worker is which thread runs it, from 0 to I_JobThreads() - 1
+typedef void (*jobfunc_t)(void *data, int worker);
+
+// Starts the workers. Call after I_InitTimer.
+void I_InitJobs(void);
+
+// How many threads run jobs, the main thread included. Enough jobs to
+// keep them all busy is a good way to split work.
+int I_JobThreads(void);
+
+jobgroup_t *I_JobGroup(void);
+
+// Runs func(data) on some thread. With no workers it runs right away.
+// Jobs can add jobs, to their group or another.
+void I_AddJob(jobgroup_t *group, jobfunc_t func, void *data);
+
+// Returns once every job added to the group has run. The group can
+// take more jobs afterwards.
+void I_WaitJobs(jobgroup_t *group);
+
+// Waits for the group, then frees it and what was allocated in it.
+void I_FreeJobGroup(jobgroup_t *group);
+
+// Memory for the job that's running on this thread, gone when it
+// returns.
+void *I_JobScratch(size_t size);
+
+// Memory from any thread that lasts until the group is freed, for what
+// the jobs hand back.
+void *I_JobGroupAlloc(jobgroup_t *group, size_t size);
+
+#endif
@@ -44,7 +44,7 @@ int main(int argc, char **argv)
     // save arguments
 
     myargc = argc;
-    myargv = malloc(argc * sizeof(char *));
+    myargv = malloc((argc + 1) * sizeof(char *));
     assert(myargv != NULL);
 
     for (int i = 0; i < argc; i++)
@@ -52,6 +52,11 @@ int main(int argc, char **argv)
         myargv[i] = M_StringDuplicate(argv[i]);
     }
 
+#ifdef BENCH_PRG
+    // [AP] crispy-bench is the game, running its microbenchmarks
+    myargv[myargc++] = M_StringDuplicate("-microbench");
+#endif
+
     //!
     // Print the program version and exit.
     //
@@ -98,12 +98,6 @@ char *music_pack_path = "";
 //  * If a PWAD reuses music from an IWAD (even from a different game), we get
 //    the high quality version of the music automatically (neat!)
 
-typedef struct
-{
-    const char *hash_prefix;
-    const char *filename;
-} subst_music_t;
-
 #if !USE_SDL_MIXER_LOOPING
 // Structure containing parsed metadata read from a digital music track:
 typedef struct
@@ -112,11 +106,52 @@ typedef struct
     unsigned int samplerate_hz;
     int start_time, end_time;
 } file_metadata_t;
+
+// Loop points already read from a file, kept in LOOP_INDEX_FILE between
+// runs. The file's size and modification time tell whether they still
+// apply.
+typedef struct
+{
+    char *filename;
+    long size;
+    long mtime;
+    file_metadata_t metadata;
+    int next;
+} loop_index_t;
+
+#define LOOP_INDEX_FILE "musicpack.idx"
 #endif // !USE_SDL_MIXER_LOOPING
 
+typedef struct
+{
+    const char *hash_prefix;
+    const char *filename;
+
+    // Filled in on first use.
+    int exists;  // -1 for not checked yet
+    int next;    // Next entry in the same subst_hash chain
+#if !USE_SDL_MIXER_LOOPING
+    boolean metadata_read;
+    file_metadata_t metadata;
+#endif
+} subst_music_t;
+
 static subst_music_t *subst_music = NULL;
 static unsigned int subst_music_len = 0;
 
+// Substitutes hashed by their whole hash prefix. Prefixes can be of any
+// length, so subst_prefix_len notes which lengths to try.
+#define SUBST_HASH 256
+static int subst_hash[SUBST_HASH];
+static boolean subst_prefix_len[sizeof(sha1_digest_t) * 2 + 1];
+
+#if !USE_SDL_MIXER_LOOPING
+static loop_index_t *loop_index = NULL;
+static int loop_index_len = 0;
+static int loop_index_hash[SUBST_HASH];
+static boolean loop_index_dirty = false;
+#endif
+
 static boolean music_initialized = false;
 
 // If this is true, this module initialized SDL sound and has the 
@@ -134,8 +169,51 @@ static file_metadata_t file_metadata;
 static unsigned int current_track_pos;
 #endif // !USE_SDL_MIXER_LOOPING
 
+// A registered substitute track. The file may have been read ahead into
+// data, which SDL_mixer then decodes from memory.
+typedef struct
+{
+    Mix_Music *music;
+    void *data;
+#if !USE_SDL_MIXER_LOOPING
+    file_metadata_t metadata;
+#endif
+    boolean unregistered;  // Freed once its fade out is over
+} pack_song_t;
+
 // Currently playing music track.
 static Mix_Music *current_track_music = NULL;
+static pack_song_t *current_song = NULL;
+
+// Song fading out, and the one to start once it has.
+static pack_song_t *fading_song = NULL;
+static pack_song_t *pending_song = NULL;
+static boolean pending_loop;
+
+// Length of the fade between songs, in milliseconds; 0 to cut.
+int music_pack_fade_ms = 250;
+
+// Bigger files are left for SDL_mixer to stream from disk.
+#define MAX_PRELOAD (64 << 20)
+
+enum
+{
+    PRELOAD_NONE,
+    PRELOAD_QUEUED,
+    PRELOAD_READING,
+    PRELOAD_DONE
+};
+
+// Thread that reads the next song's file ahead of time. It only ever has
+// the one file to read; queueing another drops it.
+static SDL_Thread *preload_thread = NULL;
+static SDL_mutex *preload_lock;
+static SDL_cond *preload_cond;
+static boolean preload_quit;
+static int preload_state = PRELOAD_NONE;
+static char *preload_filename = NULL;
+static void *preload_data = NULL;
+static size_t preload_len;
 
 // If true, the currently playing track is being played on loop.
 static boolean current_track_loop;
@@ -658,16 +736,226 @@ static void ReadLoopPoints(const char *filename, file_metadata_t *metadata)
 }
 #endif // !USE_SDL_MIXER_LOOPING
 
+static unsigned int HashString(const char *s, size_t len)
+{
+    unsigned int result = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len && s[i] != '\0'; ++i)
+    {
+        result = (result ^ (byte) s[i]) * 16777619u;
+    }
+
+    return result % SUBST_HASH;
+}
+
+#if !USE_SDL_MIXER_LOOPING
+static loop_index_t *FindLoopIndex(const char *filename)
+{
+    int i;
+
+    for (i = loop_index_hash[HashString(filename, strlen(filename))];
+         i >= 0; i = loop_index[i].next)
+    {
+        if (!strcmp(loop_index[i].filename, filename))
+        {
+            return &loop_index[i];
+        }
+    }
+
+    return NULL;
+}
+
+static loop_index_t *AddLoopIndex(const char *filename)
+{
+    loop_index_t *l;
+    unsigned int h;
+
+    loop_index = I_Realloc(loop_index, (loop_index_len + 1) * sizeof(*loop_index));
+    l = &loop_index[loop_index_len];
+    l->filename = M_StringDuplicate(filename);
+
+    h = HashString(filename, strlen(filename));
+    l->next = loop_index_hash[h];
+    loop_index_hash[h] = loop_index_len++;
+
+    return l;
+}
+
+static void ReadLoopIndex(void)
+{
+    char *path;
+    char line[1024];
+    FILE *fs;
+    int i;
+
+    for (i = 0; i < SUBST_HASH; ++i)
+    {
+        loop_index_hash[i] = -1;
+    }
+
+    path = M_StringJoin(configdir, LOOP_INDEX_FILE, NULL);
+    fs = M_fopen(path, "r");
+    free(path);
+
+    if (fs == NULL)
+    {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fs) != NULL)
+    {
+        loop_index_t *l;
+        file_metadata_t metadata;
+        long size, mtime;
+        int valid, n;
+
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (sscanf(line, "%ld %ld %d %u %d %d %n", &size, &mtime, &valid,
+                   &metadata.samplerate_hz, &metadata.start_time,
+                   &metadata.end_time, &n) != 6
+         || line[n] == '\0' || FindLoopIndex(line + n) != NULL)
+        {
+            continue;
+        }
+
+        metadata.valid = valid != 0;
+
+        l = AddLoopIndex(line + n);
+        l->size = size;
+        l->mtime = mtime;
+        l->metadata = metadata;
+    }
+
+    fclose(fs);
+}
+
+static void WriteLoopIndex(void)
+{
+    char *path;
+    FILE *fs;
+    int i;
+
+    if (!loop_index_dirty)
+    {
+        return;
+    }
+
+    path = M_StringJoin(configdir, LOOP_INDEX_FILE, NULL);
+    fs = M_fopen(path, "w");
+    free(path);
+
+    if (fs == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < loop_index_len; ++i)
+    {
+        const file_metadata_t *m = &loop_index[i].metadata;
+
+        fprintf(fs, "%ld %ld %d %u %d %d %s\n", loop_index[i].size,
+                loop_index[i].mtime, m->valid ? 1 : 0, m->samplerate_hz,
+                m->start_time, m->end_time, loop_index[i].filename);
+    }
+
+    fclose(fs);
+    loop_index_dirty = false;
+}
+
+// Loop points for a substitute, read from the file only the first time it
+// is seen or after it changes.
+
+static const file_metadata_t *GetLoopPoints(subst_music_t *s)
+{
+    struct stat st;
+    loop_index_t *l;
+
+    if (s->metadata_read)
+    {
+        return &s->metadata;
+    }
+
+    s->metadata_read = true;
+
+    if (M_stat(s->filename, &st) != 0)
+    {
+        ReadLoopPoints(s->filename, &s->metadata);
+        return &s->metadata;
+    }
+
+    l = FindLoopIndex(s->filename);
+
+    if (l != NULL && l->size == (long) st.st_size
+     && l->mtime == (long) st.st_mtime)
+    {
+        s->metadata = l->metadata;
+        return &s->metadata;
+    }
+
+    ReadLoopPoints(s->filename, &s->metadata);
+
+    if (l == NULL)
+    {
+        l = AddLoopIndex(s->filename);
+    }
+
+    l->size = (long) st.st_size;
+    l->mtime = (long) st.st_mtime;
+    l->metadata = s->metadata;
+    loop_index_dirty = true;
+
+    return &s->metadata;
+}
+#endif // !USE_SDL_MIXER_LOOPING
+
+static boolean SubstituteExists(subst_music_t *s)
+{
+    if (s->exists < 0)
+    {
+        s->exists = M_FileExists(s->filename);
+    }
+
+    return s->exists != 0;
+}
+
+// Build subst_hash once all substitutes are loaded.
+
+static void HashSubstituteMusic(void)
+{
+    unsigned int i;
+    size_t len;
+    int h;
+
+    for (h = 0; h < SUBST_HASH; ++h)
+    {
+        subst_hash[h] = -1;
+    }
+
+    // Chains are built back to front so that they keep the list order.
+    for (i = subst_music_len; i-- > 0; )
+    {
+        len = strlen(subst_music[i].hash_prefix);
+        h = HashString(subst_music[i].hash_prefix, len);
+        subst_music[i].exists = -1;
+        subst_music[i].next = subst_hash[h];
+        subst_hash[h] = i;
+        subst_prefix_len[len] = true;
+    }
+}
+
 // Given a MUS lump, look up a substitute MUS file to play instead
 // (or NULL to just use normal MIDI playback).
 
-static const char *GetSubstituteMusicFile(void *data, size_t data_len)
+static subst_music_t *GetSubstituteMusicFile(void *data, size_t data_len)
 {
     sha1_context_t context;
     sha1_digest_t hash;
-    const char *filename;
     char hash_str[sizeof(sha1_digest_t) * 2 + 1];
-    unsigned int i;
+    int found, last;
+    size_t len;
+    int i;
 
     // Don't bother doing a hash if we're never going to find anything.
     if (subst_music_len == 0)
@@ -690,27 +978,46 @@ static const char *GetSubstituteMusicFile(void *data, size_t data_len)
     // The substitute mapping list can (intentionally) contain multiple
     // filename mappings for the same hash. This allows us to try
     // different files and fall back if our first choice isn't found.
+    // The first match whose file exists wins, else the last match so
+    // that we can print an error message saying it doesn't exist.
 
-    filename = NULL;
+    found = -1;
+    last = -1;
 
-    for (i = 0; i < subst_music_len; ++i)
+    for (len = 1; len < arrlen(subst_prefix_len); ++len)
     {
-        if (M_StringStartsWith(hash_str, subst_music[i].hash_prefix))
+        if (!subst_prefix_len[len])
         {
-            filename = subst_music[i].filename;
+            continue;
+        }
+
+        for (i = subst_hash[HashString(hash_str, len)]; i >= 0;
+             i = subst_music[i].next)
+        {
+            if (strlen(subst_music[i].hash_prefix) != len
+             || strncmp(subst_music[i].hash_prefix, hash_str, len) != 0)
+            {
+                continue;
+            }
 
-            // If the file exists, then use this file in preference to
-            // any fallbacks. But we always return a filename if it's
-            // in the list, even if it's just so we can print an error
-            // message to the user saying it doesn't exist.
-            if (M_FileExists(filename))
+            if (i > last)
             {
-                break;
+                last = i;
+            }
+
+            if ((found < 0 || i < found) && SubstituteExists(&subst_music[i]))
+            {
+                found = i;
             }
         }
     }
 
-    return filename;
+    if (found < 0)
+    {
+        found = last;
+    }
+
+    return found < 0 ? NULL : &subst_music[found];
 }
 
 static char *GetFullPath(const char *musicdir, const char *path)
@@ -793,6 +1100,7 @@ static void AddSubstituteMusic(const char *musicdir, const char *hash_prefix,
     subst_music =
         I_Realloc(subst_music, sizeof(subst_music_t) * subst_music_len);
     s = &subst_music[subst_music_len - 1];
+    memset(s, 0, sizeof(*s));
     s->hash_prefix = hash_prefix;
     s->filename = path;
 }
@@ -1016,6 +1324,12 @@ static void LoadSubstituteConfigs(void)
                subst_music_len - old_music_len);
     }
 
+    HashSubstituteMusic();
+
+#if !USE_SDL_MIXER_LOOPING
+    ReadLoopIndex();
+#endif
+
     free(musicdir);
 }
 
@@ -1101,15 +1415,220 @@ static void DumpSubstituteConfig(const char *filename)
     I_Quit();
 }
 
+static void *PreloadRead(const char *filename, size_t *len)
+{
+    FILE *fs;
+    long size;
+    void *result;
+
+    fs = M_fopen(filename, "rb");
+
+    if (fs == NULL)
+    {
+        return NULL;
+    }
+
+    size = M_FileLength(fs);
+    result = NULL;
+
+    if (size > 0 && size <= MAX_PRELOAD)
+    {
+        result = malloc(size);
+    }
+
+    if (result != NULL && fread(result, 1, size, fs) != (size_t) size)
+    {
+        free(result);
+        result = NULL;
+    }
+
+    fclose(fs);
+    *len = size;
+
+    return result;
+}
+
+static int PreloadThread(void *unused)
+{
+    SDL_LockMutex(preload_lock);
+
+    while (true)
+    {
+        char *filename;
+        void *data;
+        size_t len;
+
+        while (preload_state != PRELOAD_QUEUED && !preload_quit)
+        {
+            SDL_CondWait(preload_cond, preload_lock);
+        }
+
+        if (preload_quit)
+        {
+            break;
+        }
+
+        filename = M_StringDuplicate(preload_filename);
+        preload_state = PRELOAD_READING;
+        SDL_UnlockMutex(preload_lock);
+
+        data = PreloadRead(filename, &len);
+
+        SDL_LockMutex(preload_lock);
+
+        if (preload_state == PRELOAD_READING
+         && !strcmp(preload_filename, filename))
+        {
+            preload_data = data;
+            preload_len = len;
+            preload_state = PRELOAD_DONE;
+        }
+        else
+        {
+            // Replaced meanwhile
+            free(data);
+        }
+
+        free(filename);
+        SDL_CondBroadcast(preload_cond);
+    }
+
+    SDL_UnlockMutex(preload_lock);
+
+    return 0;
+}
+
+static void ShutdownPreload(void)
+{
+    if (preload_thread == NULL)
+    {
+        return;
+    }
+
+    SDL_LockMutex(preload_lock);
+    preload_quit = true;
+    SDL_CondBroadcast(preload_cond);
+    SDL_UnlockMutex(preload_lock);
+
+    SDL_WaitThread(preload_thread, NULL);
+    preload_thread = NULL;
+
+    free(preload_data);
+    free(preload_filename);
+    preload_data = NULL;
+    preload_filename = NULL;
+    preload_state = PRELOAD_NONE;
+}
+
+static void QueuePreload(const char *filename)
+{
+    if (preload_thread == NULL)
+    {
+        preload_lock = SDL_CreateMutex();
+        preload_cond = SDL_CreateCond();
+        preload_quit = false;
+        preload_thread = SDL_CreateThread(PreloadThread, "I_MP_Preload", NULL);
+
+        if (preload_thread == NULL)
+        {
+            fprintf(stderr, "QueuePreload: %s\n", SDL_GetError());
+            return;
+        }
+    }
+
+    SDL_LockMutex(preload_lock);
+
+    if (preload_filename == NULL || strcmp(preload_filename, filename) != 0)
+    {
+        free(preload_data);
+        free(preload_filename);
+        preload_data = NULL;
+        preload_filename = M_StringDuplicate(filename);
+        preload_state = PRELOAD_QUEUED;
+        SDL_CondBroadcast(preload_cond);
+    }
+
+    SDL_UnlockMutex(preload_lock);
+}
+
+// Takes the contents of filename if it was queued, waiting for the read
+// if it's still going. Returns NULL otherwise.
+
+static void *TakePreload(const char *filename, size_t *len)
+{
+    void *result = NULL;
+
+    if (preload_thread == NULL)
+    {
+        return NULL;
+    }
+
+    SDL_LockMutex(preload_lock);
+
+    if (preload_filename != NULL && !strcmp(preload_filename, filename))
+    {
+        while (preload_state == PRELOAD_QUEUED
+            || preload_state == PRELOAD_READING)
+        {
+            SDL_CondWait(preload_cond, preload_lock);
+        }
+
+        result = preload_data;
+        *len = preload_len;
+
+        free(preload_filename);
+        preload_data = NULL;
+        preload_filename = NULL;
+        preload_state = PRELOAD_NONE;
+    }
+
+    SDL_UnlockMutex(preload_lock);
+
+    return result;
+}
+
+static void FreeSong(pack_song_t *song)
+{
+    Mix_FreeMusic(song->music);
+    free(song->data);
+    free(song);
+}
+
+// Cuts a fade out short, dropping the song that was to follow it.
+
+static void FinishFade(void)
+{
+    if (fading_song == NULL)
+    {
+        return;
+    }
+
+    Mix_HaltMusic();
+
+    if (fading_song->unregistered)
+    {
+        FreeSong(fading_song);
+    }
+
+    fading_song = NULL;
+    pending_song = NULL;
+}
+
 // Shutdown music
 
 static void I_MP_ShutdownMusic(void)
 {
     if (music_initialized)
     {
+        FinishFade();
+        ShutdownPreload();
         Mix_HaltMusic();
         music_initialized = false;
 
+#if !USE_SDL_MIXER_LOOPING
+        WriteLoopIndex();
+#endif
+
         if (sdl_was_initialized)
         {
             Mix_CloseAudio();
@@ -1207,23 +1726,12 @@ static void I_MP_SetMusicVolume(int volume)
     Mix_VolumeMusic((volume * MIX_MAX_VOLUME) / 127);
 }
 
-// Start playing a mid
-
-static void I_MP_PlaySong(void *handle, boolean looping)
+static void StartSong(pack_song_t *song, boolean looping, int fade_ms)
 {
     int loops;
 
-    if (!music_initialized)
-    {
-        return;
-    }
-
-    if (handle == NULL)
-    {
-        return;
-    }
-
-    current_track_music = (Mix_Music *) handle;
+    current_song = song;
+    current_track_music = song->music;
     current_track_loop = looping;
 
     if (looping)
@@ -1236,6 +1744,8 @@ static void I_MP_PlaySong(void *handle, boolean looping)
     }
 
 #if !USE_SDL_MIXER_LOOPING
+    file_metadata = song->metadata;
+
     // Don't loop when playing substitute music, as we do it
     // ourselves instead.
     if (file_metadata.valid)
@@ -1247,13 +1757,39 @@ static void I_MP_PlaySong(void *handle, boolean looping)
     }
 #endif // !USE_SDL_MIXER_LOOPING
 
-    if (Mix_PlayMusic(current_track_music, loops) == -1)
+    if (Mix_FadeInMusic(current_track_music, loops, fade_ms) == -1)
     {
         fprintf(stderr, "I_MP_PlaySong: Error starting track: %s\n",
                 Mix_GetError());
     }
 }
 
+// Start playing a mid
+
+static void I_MP_PlaySong(void *handle, boolean looping)
+{
+    if (!music_initialized)
+    {
+        return;
+    }
+
+    if (handle == NULL)
+    {
+        return;
+    }
+
+    // SDL_mixer has the one music stream, so the new song fades in once
+    // the old one has faded out.
+    if (fading_song != NULL)
+    {
+        pending_song = (pack_song_t *) handle;
+        pending_loop = looping;
+        return;
+    }
+
+    StartSong((pack_song_t *) handle, looping, 0);
+}
+
 static void I_MP_PauseSong(void)
 {
     if (!music_initialized)
@@ -1281,13 +1817,25 @@ static void I_MP_StopSong(void)
         return;
     }
 
-    Mix_HaltMusic();
+    pending_song = NULL;
+
+    if (current_song != NULL && fading_song == NULL && music_pack_fade_ms > 0
+     && !Mix_PausedMusic() && Mix_FadeOutMusic(music_pack_fade_ms))
+    {
+        fading_song = current_song;
+    }
+    else if (fading_song == NULL)
+    {
+        Mix_HaltMusic();
+    }
+
+    current_song = NULL;
     current_track_music = NULL;
 }
 
 static void I_MP_UnRegisterSong(void *handle)
 {
-    Mix_Music *music = (Mix_Music *) handle;
+    pack_song_t *song = (pack_song_t *) handle;
 
     if (!music_initialized)
     {
@@ -1299,13 +1847,28 @@ static void I_MP_UnRegisterSong(void *handle)
         return;
     }
 
-    Mix_FreeMusic(music);
+    if (song == pending_song)
+    {
+        pending_song = NULL;
+    }
+
+    if (song == fading_song)
+    {
+        song->unregistered = true;
+        return;
+    }
+
+    FreeSong(song);
 }
 
 static void *I_MP_RegisterSong(void *data, int len)
 {
+    subst_music_t *subst;
     const char *filename;
     Mix_Music *music;
+    pack_song_t *song;
+    void *file_data;
+    size_t file_len;
 
     if (!music_initialized)
     {
@@ -1313,28 +1876,81 @@ static void *I_MP_RegisterSong(void *data, int len)
     }
 
     // See if we're substituting this MUS for a high-quality replacement.
-    filename = GetSubstituteMusicFile(data, len);
-    if (filename == NULL)
+    subst = GetSubstituteMusicFile(data, len);
+    if (subst == NULL)
     {
+        // Some other module will play it, and SDL_mixer won't start a
+        // song while one is fading out.
+        FinishFade();
         return NULL;
     }
 
-    music = Mix_LoadMUS(filename);
+    filename = subst->filename;
+
+    music = NULL;
+    file_data = TakePreload(filename, &file_len);
+
+    if (file_data != NULL)
+    {
+        music = Mix_LoadMUS_RW(SDL_RWFromConstMem(file_data, file_len), 1);
+
+        if (music == NULL)
+        {
+            free(file_data);
+            file_data = NULL;
+        }
+    }
+
+    if (music == NULL)
+    {
+        music = Mix_LoadMUS(filename);
+    }
+
     if (music == NULL)
     {
         // Fall through and play MIDI normally, but print an error
         // message.
         fprintf(stderr, "Failed to load substitute music file: %s: %s\n",
                 filename, Mix_GetError());
+        FinishFade();
         return NULL;
     }
 
+    song = calloc(1, sizeof(*song));
+    song->music = music;
+    song->data = file_data;
+
 #if !USE_SDL_MIXER_LOOPING
     // Read loop point metadata from the file so that we know where
     // to loop the music.
-    ReadLoopPoints(filename, &file_metadata);
+    song->metadata = *GetLoopPoints(subst);
 #endif // !USE_SDL_MIXER_LOOPING
-    return music;
+    return song;
+}
+
+// Read the substitute for this lump ahead of time, so that registering
+// it later doesn't wait on the disk.
+
+static void I_MP_PrecacheSong(void *data, int len)
+{
+    subst_music_t *subst;
+
+    if (!music_initialized)
+    {
+        return;
+    }
+
+    subst = GetSubstituteMusicFile(data, len);
+
+    if (subst == NULL || !SubstituteExists(subst))
+    {
+        return;
+    }
+
+#if !USE_SDL_MIXER_LOOPING
+    GetLoopPoints(subst);
+#endif
+    QueuePreload(subst->filename);
 }
 
 // Is the song playing?
@@ -1345,7 +1961,12 @@ static boolean I_MP_MusicIsPlaying(void)
         return false;
     }
 
-    return Mix_PlayingMusic();
+    if (pending_song != NULL)
+    {
+        return true;
+    }
+
+    return fading_song == NULL && Mix_PlayingMusic();
 }
 
 #if !USE_SDL_MIXER_LOOPING
@@ -1386,6 +2007,27 @@ static void RestartCurrentTrack(void)
 // then we need to go back.
 static void I_MP_PollMusic(void)
 {
+    if (fading_song != NULL)
+    {
+        if (Mix_PlayingMusic())
+        {
+            return;
+        }
+
+        if (fading_song->unregistered)
+        {
+            FreeSong(fading_song);
+        }
+
+        fading_song = NULL;
+
+        if (pending_song != NULL)
+        {
+            StartSong(pending_song, pending_loop, music_pack_fade_ms);
+            pending_song = NULL;
+        }
+    }
+
 #if !USE_SDL_MIXER_LOOPING
     // When playing substitute tracks, loop tags only apply if we're playing
     // a looping track. Tracks like the title screen music have the loop
@@ -1425,6 +2067,7 @@ const music_module_t music_pack_module =
     I_MP_StopSong,
     I_MP_MusicIsPlaying,
     I_MP_PollMusic,
+    I_MP_PrecacheSong,
 };
 
 
@@ -26,6 +26,7 @@
 
 #include "deh_main.h"
 #include "i_sound.h"
+#include "i_soundstats.h"
 #include "i_swap.h"
 #include "m_misc.h"
 #include "w_wad.h"
@@ -1605,36 +1606,24 @@ static void I_OPL_UnRegisterSong(void *handle)
     }
 }
 
-static boolean ConvertMus(byte *musdata, int len, char *filename)
-{
-    MEMFILE *instream;
-    MEMFILE *outstream;
-    void *outbuf;
-    size_t outbuf_len;
-    int result;
+// [AP] Convert a MUS lump and parse the result, without a temp file.
 
-    instream = mem_fopen_read(musdata, len);
-    outstream = mem_fopen_write();
-
-    result = mus2mid(instream, outstream);
+static midi_file_t *LoadMus(byte *musdata, int len)
+{
+    const void *mid;
+    size_t mid_len;
 
-    if (result == 0)
+    if (!mus2mid_cached(musdata, len, &mid, &mid_len))
     {
-        mem_get_buf(outstream, &outbuf, &outbuf_len);
-
-        M_WriteFile(filename, outbuf, outbuf_len);
+        return NULL;
     }
 
-    mem_fclose(instream);
-    mem_fclose(outstream);
-
-    return result;
+    return MIDI_LoadFromMemory(mid, mid_len);
 }
 
 static void *I_OPL_RegisterSong(void *data, int len)
 {
     midi_file_t *result;
-    char *filename;
 
     if (!music_initialized)
     {
@@ -1644,32 +1633,23 @@ static void *I_OPL_RegisterSong(void *data, int len)
     // MUS files begin with "MUS"
     // Reject anything which doesnt have this signature
 
-    filename = M_TempFile("doom.mid");
-
     // [crispy] remove MID file size limit
     if (IsMid(data, len) /* && len < MAXMIDLENGTH */)
     {
-        M_WriteFile(filename, data, len);
+        result = MIDI_LoadFromMemory(data, len);
     }
     else
     {
         // Assume a MUS file and try to convert
 
-        ConvertMus(data, len, filename);
+        result = LoadMus(data, len);
     }
 
-    result = MIDI_LoadFile(filename);
-
     if (result == NULL)
     {
         fprintf(stderr, "I_OPL_RegisterSong: Failed to load MID.\n");
     }
 
-    // remove file now
-
-    M_remove(filename);
-    free(filename);
-
     return result;
 }
 
@@ -1705,6 +1685,11 @@ static void I_OPL_ShutdownMusic(void)
     }
 }
 
+static void OPLMixStats(unsigned int samples, unsigned int us)
+{
+    I_SoundStatsTime(SNDSTATS_OPL, samples, us);
+}
+
 // Initialize music subsystem
 
 static boolean I_OPL_InitMusic(void)
@@ -1713,6 +1698,7 @@ static boolean I_OPL_InitMusic(void)
     opl_init_result_t chip_type;
 
     OPL_SetSampleRate(snd_samplerate);
+    OPL_SetMixStats(snd_stats ? OPLMixStats : NULL);
 
     chip_type = OPL_Init(opl_io_port);
     if (chip_type == OPL_INIT_NONE)
@@ -0,0 +1,334 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Frame profiler.
+//
+//	Everything timed runs on the game thread, so there is no locking:
+//	each phase adds up its time over the frame, and I_ProfileFrame
+//	moves the totals into a ring of the last NUMFRAMES frames that the
+//	overlay takes its min, average and 99th percentile from.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "i_profile.h"
+#include "i_system.h"
+#include "i_trace.h"
+#include "m_argv.h"
+#include "m_misc.h"
+
+#define NUMFRAMES 256
+
+typedef struct
+{
+    unsigned int min_us;
+    unsigned int avg_us;
+    unsigned int p99_us;
+} phasesummary_t;
+
+static const char *phase_names[NUMPROFILEPHASES] =
+{
+    "TICKER",
+    "THINK",
+    "BSP",
+    "PLANES",
+    "MASKED",
+    "HUD",
+    "STBAR",
+    "NOTIF",
+    "APUPD",
+    "FINISH",
+    "NETUPD",
+    "SOUND",
+};
+
+boolean profiling = false;
+
+static Uint64 ticks_per_us;
+static Uint64 phase_start[NUMPROFILEPHASES];
+static Uint64 phase_ticks[NUMPROFILEPHASES];
+static Uint64 frame_start;
+
+static unsigned int frames[NUMFRAMES][NUMPROFILEPHASES];
+static unsigned int frame_total[NUMFRAMES];
+static unsigned int frame_count;
+
+static FILE *csv_file;
+
+static phasesummary_t overlay[NUMPROFILEPHASES];
+static phasesummary_t overlay_total;
+static unsigned int overlay_time;
+
+static void CloseCSV(void)
+{
+    if (csv_file != NULL)
+    {
+        fclose(csv_file);
+        csv_file = NULL;
+    }
+}
+
+static void OpenCSV(const char *filename)
+{
+    int i;
+
+    csv_file = M_fopen(filename, "w");
+
+    if (csv_file == NULL)
+    {
+        fprintf(stderr, "I_InitProfile: Unable to write %s\n", filename);
+        return;
+    }
+
+    fprintf(csv_file, "frame");
+
+    for (i = 0; i < NUMPROFILEPHASES; ++i)
+    {
+        fprintf(csv_file, ",%s", phase_names[i]);
+    }
+
+    fprintf(csv_file, ",FRAME\n");
+
+    I_AtExit(CloseCSV, true);
+}
+
+void I_InitProfile(void)
+{
+    static boolean initialized = false;
+    int p;
+
+    if (initialized)
+    {
+        return;
+    }
+
+    initialized = true;
+
+    //!
+    // @category obscure
+    //
+    // Time the phases of each frame (game tics, rendering, HUD, network
+    // and sound updates, and so on) and show their minimum, average and
+    // 99th percentile over the last 256 frames next to the FPS counter.
+    //
+
+    if (M_ParmExists("-profile"))
+    {
+        profiling = true;
+    }
+
+    //!
+    // @category obscure
+    // @arg <file>
+    //
+    // As -profile, and also write each frame's timings, in
+    // milliseconds, to a CSV file.
+    //
+
+    p = M_CheckParmWithArgs("-profilecsv", 1);
+
+    if (p > 0)
+    {
+        profiling = true;
+        OpenCSV(myargv[p + 1]);
+    }
+
+    if (!profiling)
+    {
+        return;
+    }
+
+    ticks_per_us = SDL_GetPerformanceFrequency() / 1000000;
+
+    if (ticks_per_us == 0)
+    {
+        ticks_per_us = 1;
+    }
+
+    frame_start = SDL_GetPerformanceCounter();
+}
+
+void I_ProfileBegin(profile_phase_t phase)
+{
+    if ((!profiling && !tracing) || phase_start[phase] != 0)
+    {
+        return;
+    }
+
+    phase_start[phase] = SDL_GetPerformanceCounter();
+    I_TraceBegin(phase_names[phase], NULL);
+}
+
+void I_ProfileEnd(profile_phase_t phase)
+{
+    if (phase_start[phase] == 0)
+    {
+        return;
+    }
+
+    phase_ticks[phase] += SDL_GetPerformanceCounter() - phase_start[phase];
+    phase_start[phase] = 0;
+    I_TraceEnd(phase_names[phase]);
+}
+
+void I_ProfileFrame(void)
+{
+    unsigned int *frame;
+    Uint64 now;
+    int i;
+
+    I_TraceFrame();
+
+    if (!profiling)
+    {
+        memset(phase_ticks, 0, sizeof(phase_ticks));
+        return;
+    }
+
+    now = SDL_GetPerformanceCounter();
+    frame = frames[frame_count % NUMFRAMES];
+
+    for (i = 0; i < NUMPROFILEPHASES; ++i)
+    {
+        frame[i] = (unsigned int) (phase_ticks[i] / ticks_per_us);
+        phase_ticks[i] = 0;
+    }
+
+    frame_total[frame_count % NUMFRAMES] =
+        (unsigned int) ((now - frame_start) / ticks_per_us);
+    frame_start = now;
+
+    if (csv_file != NULL)
+    {
+        fprintf(csv_file, "%u", frame_count);
+
+        for (i = 0; i < NUMPROFILEPHASES; ++i)
+        {
+            fprintf(csv_file, ",%.3f", frame[i] / 1000.0);
+        }
+
+        fprintf(csv_file, ",%.3f\n",
+                frame_total[frame_count % NUMFRAMES] / 1000.0);
+    }
+
+    frame_count++;
+}
+
+unsigned int I_ProfileLastFrame(unsigned int *phase_us)
+{
+    int last = (frame_count + NUMFRAMES - 1) % NUMFRAMES;
+
+    memcpy(phase_us, frames[last], sizeof(frames[last]));
+
+    return frame_total[last];
+}
+
+const char *I_ProfilePhaseName(profile_phase_t phase)
+{
+    return phase_names[phase];
+}
+
+static int CompareTimes(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *) a;
+    unsigned int y = *(const unsigned int *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void Summarize(unsigned int *times, int count, phasesummary_t *s)
+{
+    Uint64 total = 0;
+    int i;
+
+    qsort(times, count, sizeof(*times), CompareTimes);
+
+    for (i = 0; i < count; ++i)
+    {
+        total += times[i];
+    }
+
+    s->min_us = times[0];
+    s->avg_us = (unsigned int) (total / count);
+    s->p99_us = times[(count * 99) / 100];
+}
+
+static void UpdateOverlay(void)
+{
+    unsigned int times[NUMFRAMES];
+    int count = frame_count < NUMFRAMES ? frame_count : NUMFRAMES;
+    int i, j;
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    for (i = 0; i < NUMPROFILEPHASES; ++i)
+    {
+        for (j = 0; j < count; ++j)
+        {
+            times[j] = frames[j][i];
+        }
+
+        Summarize(times, count, &overlay[i]);
+    }
+
+    memcpy(times, frame_total, count * sizeof(*times));
+    Summarize(times, count, &overlay_total);
+}
+
+static void FormatLine(char *buf, size_t buf_len, const char *name,
+                       phasesummary_t *s)
+{
+    M_snprintf(buf, buf_len, "%-6s %6.2f %6.2f %6.2f", name,
+               s->min_us / 1000.0, s->avg_us / 1000.0, s->p99_us / 1000.0);
+}
+
+boolean I_ProfileText(int line, char *buf, size_t buf_len)
+{
+    unsigned int now;
+
+    if (!profiling || line > NUMPROFILEPHASES + 1)
+    {
+        return false;
+    }
+
+    now = SDL_GetTicks();
+
+    if (line == 0 && now - overlay_time >= 1000)
+    {
+        UpdateOverlay();
+        overlay_time = now;
+    }
+
+    if (line == 0)
+    {
+        M_snprintf(buf, buf_len, "MS        MIN    AVG    P99");
+    }
+    else if (line == 1)
+    {
+        FormatLine(buf, buf_len, "FRAME", &overlay_total);
+    }
+    else
+    {
+        FormatLine(buf, buf_len, phase_names[line - 2], &overlay[line - 2]);
+    }
+
+    return true;
+}
@@ -0,0 +1,65 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Frame profiler, enabled with -profile. Times the phases of each
+//	frame, shown next to the FPS counter and optionally written to a
+//	CSV file with -profilecsv.
+//
+
+#ifndef __I_PROFILE__
+#define __I_PROFILE__
+
+#include "doomtype.h"
+
+typedef enum
+{
+    PROFILE_TICKER,
+    PROFILE_THINKERS,
+    PROFILE_BSP,
+    PROFILE_PLANES,
+    PROFILE_MASKED,
+    PROFILE_HUD,
+    PROFILE_STATUSBAR,
+    PROFILE_NOTIF,
+    PROFILE_APUPDATE,
+    PROFILE_FINISHUPDATE,
+    PROFILE_NETUPDATE,
+    PROFILE_SOUND,
+    NUMPROFILEPHASES
+} profile_phase_t;
+
+// Set before I_InitProfile to profile without -profile.
+extern boolean profiling;
+
+void I_InitProfile(void);
+
+// Time spent between the two is added to the phase for this frame.
+// Nested calls for a phase that is already running are ignored.
+// With -trace, each phase is also a slice on the timeline.
+void I_ProfileBegin(profile_phase_t phase);
+void I_ProfileEnd(profile_phase_t phase);
+
+// Call once at the end of each frame.
+void I_ProfileFrame(void);
+
+// Copies the phase times of the last frame into phase_us, which has room
+// for NUMPROFILEPHASES, and returns the whole frame's time.
+unsigned int I_ProfileLastFrame(unsigned int *phase_us);
+
+const char *I_ProfilePhaseName(profile_phase_t phase);
+
+// Fills buf with line number line of the overlay; false past the last.
+boolean I_ProfileText(int line, char *buf, size_t buf_len);
+
+#endif
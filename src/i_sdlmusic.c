@@ -336,28 +336,18 @@ static void I_SDL_UnRegisterSong(void *handle)
 
 static boolean ConvertMus(byte *musdata, int len, const char *filename)
 {
-    MEMFILE *instream;
-    MEMFILE *outstream;
-    void *outbuf;
-    size_t outbuf_len;
-    int result;
+    const void *mid;
+    size_t mid_len;
 
-    instream = mem_fopen_read(musdata, len);
-    outstream = mem_fopen_write();
-
-    result = mus2mid(instream, outstream);
-
-    if (result == 0)
+    // [AP] Cached, songs come back often
+    if (!mus2mid_cached(musdata, len, &mid, &mid_len))
     {
-        mem_get_buf(outstream, &outbuf, &outbuf_len);
-
-        M_WriteFile(filename, outbuf, outbuf_len);
+        return true;
     }
 
-    mem_fclose(instream);
-    mem_fclose(outstream);
+    M_WriteFile(filename, mid, mid_len);
 
-    return result;
+    return false;
 }
 
 static void *I_SDL_RegisterSong(void *data, int len)
@@ -31,8 +31,11 @@
 #endif
 
 #include "deh_str.h"
+#include "i_simd.h"
 #include "i_sound.h"
+#include "i_soundstats.h"
 #include "i_system.h"
+#include "i_trace.h"
 #include "i_swap.h"
 #include "m_argv.h"
 #include "m_misc.h"
@@ -61,7 +64,7 @@ float libsamplerate_scale = 0.65f;
 
 #define LOW_PASS_FILTER
 //#define DEBUG_DUMP_WAVS
-#define NUM_CHANNELS 16*2 // [crispy] support up to 32 sound channels
+#define NUM_CHANNELS 64 // [AP] cheap with our own mixer; the menu stops at 32
 
 typedef struct allocated_sound_s allocated_sound_t;
 
@@ -70,7 +73,7 @@ struct allocated_sound_s
     sfxinfo_t *sfxinfo;
     Mix_Chunk chunk;
     int use_count;
-    int pitch;
+    boolean stale; // [AP] Replaced by a newer conversion
     allocated_sound_t *prev, *next;
 };
 
@@ -78,6 +81,82 @@ static boolean sound_initialized = false;
 
 static allocated_sound_t *channels_playing[NUM_CHANNELS];
 
+// [AP] Sound effects are mixed by MixSFX, an SDL_mixer post-mix hook,
+// on top of the music. The game thread drives it through a
+// single-producer, single-consumer command ring. Every command gets a
+// serial; the mixer publishes the last one it has processed, and for
+// each channel, the serial of the START whose voice ran out. Sound
+// data can only be unlocked once the mixer is known to be done with
+// it. Voices step through the samples in 16.16 fixed point, so pitch
+// variations need no extra copies. Streamed sounds (sfxinfo_t::stream)
+// are resampled from their raw mono samples as they're mixed instead
+// of expanded into the cache first.
+
+#define MIX_COMMANDS 512
+#define MIX_FRAMES 512 // Mixed per pass
+
+enum
+{
+    MIX_START,
+    MIX_STOP,
+    MIX_PARAMS
+};
+
+typedef struct
+{
+    int type;
+    int channel;
+    unsigned int serial;
+    const Sint16 *data; // START
+    const byte *stream; // START, instead of data
+    int stream_bits;    // START
+    int stream_gain;    // START, Q15
+    uint32_t frames;    // START
+    uint32_t step;      // START
+    int left, right;    // START and PARAMS, Q15
+} mixcommand_t;
+
+typedef struct
+{
+    const Sint16 *data; // NULL when idle, unless streaming
+    const byte *stream; // NULL unless streaming
+    int stream_bits;
+    int stream_gain;
+    uint32_t frames;
+    uint64_t pos;
+    uint32_t step;
+    int left, right;
+    unsigned int serial;
+} mixvoice_t;
+
+typedef struct
+{
+    allocated_sound_t *snd; // Or NULL
+    byte *stream;           // Samples copied for streaming, or NULL
+    unsigned int serial;    // Of the STOP
+} retiredsound_t;
+
+// Shared. The lock is only contended when the ring is full and the
+// game thread drains it itself.
+static mixcommand_t mix_commands[MIX_COMMANDS];
+static SDL_atomic_t mix_head, mix_tail;
+static SDL_atomic_t mix_processed;
+static SDL_atomic_t mix_ended[NUM_CHANNELS];
+static SDL_mutex *mix_lock;
+
+// Mixer only
+static mixvoice_t mix_voices[NUM_CHANNELS];
+static int32_t mix_accum[MIX_FRAMES * 2];
+
+// Game thread only
+static unsigned int mix_serial;
+static unsigned int channel_serial[NUM_CHANNELS];
+static int channel_left[NUM_CHANNELS], channel_right[NUM_CHANNELS];
+static boolean channel_streaming[NUM_CHANNELS];
+static byte *channel_stream_copy[NUM_CHANNELS]; // NULL if mapped
+static retiredsound_t *retired_sounds;
+static int num_retired_sounds, max_retired_sounds;
+
 static int mixer_freq;
 static Uint16 mixer_format;
 static int mixer_channels;
@@ -86,7 +165,9 @@ static boolean (*ExpandSoundData)(sfxinfo_t *sfxinfo,
                                   byte *data,
                                   int samplerate,
                                   int bits,
-                                  int length) = NULL;
+                                  int length,
+                                  byte **result,
+                                  uint32_t *result_len) = NULL;
 
 // Doubly-linked list of allocated sounds.
 // When a sound is played, it is moved to the head, so that the oldest
@@ -167,6 +248,7 @@ static boolean FindAndFreeSound(void)
         if (snd->use_count == 0)
         {
             FreeAllocatedSound(snd);
+            I_SoundStatsCount(SNDSTATS_CACHE_EVICT);
             return true;
         }
 
@@ -236,7 +318,7 @@ static allocated_sound_t *AllocateSound(sfxinfo_t *sfxinfo, size_t len)
     snd->chunk.alen = len;
     snd->chunk.allocated = 1;
     snd->chunk.volume = MIX_MAX_VOLUME;
-    snd->pitch = NORM_PITCH;
+    snd->stale = false;
 
     snd->sfxinfo = sfxinfo;
     snd->use_count = 0;
@@ -250,6 +332,25 @@ static allocated_sound_t *AllocateSound(sfxinfo_t *sfxinfo, size_t len)
     return snd;
 }
 
+// Put an expanded sound effect (malloc'd, freed here) into the cache.
+
+static allocated_sound_t *InstallSound(sfxinfo_t *sfxinfo,
+                                       byte *data, uint32_t len)
+{
+    allocated_sound_t *snd;
+
+    snd = AllocateSound(sfxinfo, len);
+
+    if (snd != NULL)
+    {
+        memcpy(snd->chunk.abuf, data, len);
+    }
+
+    free(data);
+
+    return snd;
+}
+
 // Lock a sound, to indicate that it may not be freed.
 
 static void LockAllocatedSound(allocated_sound_t *snd)
@@ -281,16 +382,16 @@ static void UnlockAllocatedSound(allocated_sound_t *snd)
     //printf("-- %s: Use count=%i\n", snd->sfxinfo->name, snd->use_count);
 }
 
-// Search through the list of allocated sounds and return the one that matches
-// the supplied sfxinfo entry and pitch level.
+// Search through the list of allocated sounds and return the current one
+// for the supplied sfxinfo entry.
 
-static allocated_sound_t * GetAllocatedSoundBySfxInfoAndPitch(sfxinfo_t *sfxinfo, int pitch)
+static allocated_sound_t *GetAllocatedSoundBySfxInfo(sfxinfo_t *sfxinfo)
 {
     allocated_sound_t * p = allocated_sounds_head;
 
     while (p != NULL)
     {
-        if (p->sfxinfo == sfxinfo && p->pitch == pitch)
+        if (p->sfxinfo == sfxinfo && !p->stale)
         {
             return p;
         }
@@ -300,47 +401,277 @@ static allocated_sound_t * GetAllocatedSoundBySfxInfoAndPitch(sfxinfo_t *sfxinfo
     return NULL;
 }
 
-// Allocate a new sound chunk and pitch-shift an existing sound up-or-down
-// into it.
+// Unlock a sound the mixer is done with. If it has been replaced and
+// it's not in use, immediately free it.
+
+static void ReleaseSound(allocated_sound_t *snd)
+{
+    UnlockAllocatedSound(snd);
+
+    if (snd->stale && snd->use_count <= 0)
+    {
+        FreeAllocatedSound(snd);
+    }
+}
+
+// [AP] Mixer side.
 
-static allocated_sound_t * PitchShift(allocated_sound_t *insnd, int pitch)
+static void ProcessMixCommands(void)
 {
-    allocated_sound_t * outsnd;
-    Sint16 *inp, *outp;
-    Sint16 *srcbuf, *dstbuf;
-    Uint32 srclen, dstlen;
+    int head = SDL_AtomicGet(&mix_head);
+    int tail = SDL_AtomicGet(&mix_tail);
+
+    while (head != tail)
+    {
+        const mixcommand_t *cmd = &mix_commands[head];
+        mixvoice_t *voice = &mix_voices[cmd->channel];
+
+        switch (cmd->type)
+        {
+            case MIX_START:
+                voice->data = cmd->data;
+                voice->stream = cmd->stream;
+                voice->stream_bits = cmd->stream_bits;
+                voice->stream_gain = cmd->stream_gain;
+                voice->frames = cmd->frames;
+                voice->pos = 0;
+                voice->step = cmd->step;
+                voice->left = cmd->left;
+                voice->right = cmd->right;
+                voice->serial = cmd->serial;
+                break;
+
+            case MIX_STOP:
+                voice->data = NULL;
+                voice->stream = NULL;
+                break;
+
+            case MIX_PARAMS:
+                voice->left = cmd->left;
+                voice->right = cmd->right;
+                break;
+        }
 
-    srcbuf = (Sint16 *)insnd->chunk.abuf;
-    srclen = insnd->chunk.alen;
+        SDL_AtomicSet(&mix_processed, cmd->serial);
+        head = (head + 1) % MIX_COMMANDS;
+    }
 
-    // determine ratio pitch:NORM_PITCH and apply to srclen, then invert.
-    // This is an approximation of vanilla behaviour based on measurements
-    dstlen = (int)((1 + (1 - (float)pitch / NORM_PITCH)) * srclen);
+    SDL_AtomicSet(&mix_head, head);
+}
 
-    // ensure that the new buffer is an even length
-    if ((dstlen % 2) == 0)
+static void MixVoice(int channel, int frames)
+{
+    mixvoice_t *voice = &mix_voices[channel];
+    uint32_t pos = voice->pos >> 16;
+
+    if (voice->step == (1 << 16))
     {
-        dstlen++;
+        if ((uint32_t) frames > voice->frames - pos)
+        {
+            frames = voice->frames - pos;
+        }
+
+        I_MixAdd(mix_accum, voice->data + pos * 2, frames,
+                 voice->left, voice->right);
+        voice->pos += (uint64_t) frames << 16;
     }
+    else
+    {
+        int32_t *accum = mix_accum;
 
-    outsnd = AllocateSound(insnd->sfxinfo, dstlen);
+        // Nearest sample, as vanilla did
+        for (; frames > 0 && pos < voice->frames; frames--, accum += 2)
+        {
+            accum[0] += (voice->data[pos * 2] * voice->left) >> 15;
+            accum[1] += (voice->data[pos * 2 + 1] * voice->right) >> 15;
+            voice->pos += voice->step;
+            pos = voice->pos >> 16;
+        }
+    }
 
-    if (!outsnd)
+    if ((voice->pos >> 16) >= voice->frames)
     {
-        return NULL;
+        voice->data = NULL;
+        SDL_AtomicSet(&mix_ended[channel], voice->serial);
+    }
+}
+
+static int StreamSample(const mixvoice_t *voice, uint32_t pos)
+{
+    if (voice->stream_bits == 16)
+    {
+        return (Sint16) (voice->stream[pos * 2] | (voice->stream[pos * 2 + 1] << 8));
     }
 
-    outsnd->pitch = pitch;
-    dstbuf = (Sint16 *)outsnd->chunk.abuf;
+    // Same expansion as ExpandSoundData_SDL
+    return (voice->stream[pos] | (voice->stream[pos] << 8)) - 32768;
+}
+
+// [AP] Linear interpolation between the source samples, which is what
+// the default use_libsamplerate does too.
 
-    // loop over output buffer. find corresponding input cell, copy over
-    for (outp = dstbuf; outp < dstbuf + dstlen/2; ++outp)
+static void MixStream(int channel, int frames)
+{
+    mixvoice_t *voice = &mix_voices[channel];
+    int32_t *accum = mix_accum;
+    uint32_t pos = voice->pos >> 16;
+
+    for (; frames > 0 && pos < voice->frames; frames--, accum += 2)
     {
-        inp = srcbuf + (int)((float)(outp - dstbuf) / dstlen * srclen);
-        *outp = *inp;
+        int frac = (voice->pos & 0xffff) >> 1;
+        int a = StreamSample(voice, pos);
+        int b = pos + 1 < voice->frames ? StreamSample(voice, pos + 1) : a;
+        int sample = ((a + (((b - a) * frac) >> 15)) * voice->stream_gain) >> 15;
+
+        accum[0] += (sample * voice->left) >> 15;
+        accum[1] += (sample * voice->right) >> 15;
+        voice->pos += voice->step;
+        pos = voice->pos >> 16;
     }
 
-    return outsnd;
+    if (pos >= voice->frames)
+    {
+        voice->stream = NULL;
+        SDL_AtomicSet(&mix_ended[channel], voice->serial);
+    }
+}
+
+static void MixSFX(void *udata, Uint8 *stream, int len)
+{
+    Sint16 *out = (Sint16 *) stream;
+    int frames = len / 4;
+    Uint64 start = I_SoundStatsBegin();
+
+    SDL_LockMutex(mix_lock);
+
+    ProcessMixCommands();
+
+    if (snd_stats)
+    {
+        int i, active = 0;
+
+        for (i = 0; i < NUM_CHANNELS; ++i)
+        {
+            active += mix_voices[i].data != NULL || mix_voices[i].stream != NULL;
+        }
+
+        I_SoundStatsVoices(active);
+    }
+
+    while (frames > 0)
+    {
+        int n = frames < MIX_FRAMES ? frames : MIX_FRAMES;
+        boolean mixed = false;
+        int i;
+
+        for (i = 0; i < NUM_CHANNELS; ++i)
+        {
+            if (mix_voices[i].data == NULL && mix_voices[i].stream == NULL)
+            {
+                continue;
+            }
+
+            if (!mixed)
+            {
+                int j;
+
+                for (j = 0; j < n * 2; ++j)
+                {
+                    mix_accum[j] = out[j];
+                }
+
+                mixed = true;
+            }
+
+            if (mix_voices[i].stream != NULL)
+            {
+                MixStream(i, n);
+            }
+            else
+            {
+                MixVoice(i, n);
+            }
+        }
+
+        if (!mixed)
+        {
+            break;
+        }
+
+        I_MixClamp(out, mix_accum, n * 2);
+
+        out += n * 2;
+        frames -= n;
+    }
+
+    SDL_UnlockMutex(mix_lock);
+
+    I_SoundStatsCallback(SNDSTATS_SFX, len / 4, start);
+}
+
+// [AP] Game side.
+
+static unsigned int SendMixCommand(mixcommand_t *cmd)
+{
+    int tail = SDL_AtomicGet(&mix_tail);
+    int next = (tail + 1) % MIX_COMMANDS;
+
+    if (next == SDL_AtomicGet(&mix_head))
+    {
+        // The mixer has stalled, or the device is paused
+        SDL_LockMutex(mix_lock);
+        ProcessMixCommands();
+        SDL_UnlockMutex(mix_lock);
+    }
+
+    cmd->serial = ++mix_serial;
+    mix_commands[tail] = *cmd;
+    SDL_AtomicSet(&mix_tail, next);
+
+    return cmd->serial;
+}
+
+// Stereo separation and volume to Q15 gains.
+
+static void GetSoundGains(int vol, int sep, int *left, int *right)
+{
+    int l, r;
+
+    l = ((254 - sep) * vol) / 127;
+    r = ((sep) * vol) / 127;
+
+    if (l < 0) l = 0;
+    else if ( l > 255) l = 255;
+    if (r < 0) r = 0;
+    else if (r > 255) r = 255;
+
+    *left = (l * 32767) / 255;
+    *right = (r * 32767) / 255;
+}
+
+// Free the sounds stopped before the last command the mixer processed.
+
+static void FreeRetiredSounds(void)
+{
+    unsigned int processed = SDL_AtomicGet(&mix_processed);
+    int i;
+
+    for (i = 0; i < num_retired_sounds; )
+    {
+        if ((int) (processed - retired_sounds[i].serial) >= 0)
+        {
+            if (retired_sounds[i].snd != NULL)
+            {
+                ReleaseSound(retired_sounds[i].snd);
+            }
+            free(retired_sounds[i].stream);
+            retired_sounds[i] = retired_sounds[--num_retired_sounds];
+        }
+        else
+        {
+            ++i;
+        }
+    }
 }
 
 // When a sound stops, check if it is still playing.  If it is not,
@@ -350,24 +681,44 @@ static allocated_sound_t * PitchShift(allocated_sound_t *insnd, int pitch)
 static void ReleaseSoundOnChannel(int channel)
 {
     allocated_sound_t *snd = channels_playing[channel];
+    byte *stream = channel_stream_copy[channel];
+    mixcommand_t cmd;
 
-    Mix_HaltChannel(channel);
-
-    if (snd == NULL)
+    if (snd == NULL && !channel_streaming[channel])
     {
         return;
     }
 
     channels_playing[channel] = NULL;
+    channel_streaming[channel] = false;
+    channel_stream_copy[channel] = NULL;
 
-    UnlockAllocatedSound(snd);
+    if ((unsigned int) SDL_AtomicGet(&mix_ended[channel]) == channel_serial[channel])
+    {
+        if (snd != NULL)
+        {
+            ReleaseSound(snd);
+        }
+        free(stream);
+        return;
+    }
+
+    // Still playing; the data has to stay until the mixer has seen the STOP
 
-    // if the sound is a pitch-shift and it's not in use, immediately
-    // free it
-    if (snd->pitch != NORM_PITCH && snd->use_count <= 0)
+    cmd.type = MIX_STOP;
+    cmd.channel = channel;
+
+    if (num_retired_sounds == max_retired_sounds)
     {
-        FreeAllocatedSound(snd);
+        max_retired_sounds = max_retired_sounds ? max_retired_sounds * 2 : NUM_CHANNELS;
+        retired_sounds = I_Realloc(retired_sounds,
+                                   max_retired_sounds * sizeof(*retired_sounds));
     }
+
+    retired_sounds[num_retired_sounds].snd = snd;
+    retired_sounds[num_retired_sounds].stream = stream;
+    retired_sounds[num_retired_sounds].serial = SendMixCommand(&cmd);
+    num_retired_sounds++;
 }
 
 #ifdef HAVE_LIBSAMPLERATE
@@ -405,12 +756,15 @@ static int SRC_ConversionMode(void)
 //   samplerate --> mixer_freq
 // Returns number of clipped samples.
 // DWF 2008-02-10 with cleanups by Simon Howard.
+// [AP] Only touches its arguments, so it can run on the conversion thread.
 
 static boolean ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
                                    byte *data,
                                    int samplerate,
                                    int bits,
-                                   int length)
+                                   int length,
+                                   byte **result,
+                                   uint32_t *result_len)
 {
     SRC_DATA src_data;
     float *data_in;
@@ -418,8 +772,7 @@ static boolean ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
 //    uint32_t alen;
     int retn;
     int16_t *expanded;
-    allocated_sound_t *snd;
-    Mix_Chunk *chunk;
+    uint32_t expanded_length;
     uint32_t samplecount = length / (bits / 8);
 
     src_data.input_frames = samplecount;
@@ -463,16 +816,16 @@ static boolean ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
 
 //    alen = src_data.output_frames_gen * 4;
 
-    snd = AllocateSound(sfxinfo, src_data.output_frames_gen * 4);
+    expanded_length = src_data.output_frames_gen * 4;
+    expanded = malloc(expanded_length);
 
-    if (snd == NULL)
+    if (expanded == NULL)
     {
+        free(data_in);
+        free(src_data.data_out);
         return false;
     }
 
-    chunk = &snd->chunk;
-    expanded = (int16_t *) chunk->abuf;
-
     // Convert the result back into 16-bit integers.
 
     for (i=0; i<src_data.output_frames_gen; ++i)
@@ -527,9 +880,12 @@ static boolean ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
     {
         fprintf(stderr, "Sound '%s': clipped %u samples (%0.2f %%)\n", 
                         sfxinfo->name, clipped,
-                        400.0 * clipped / chunk->alen);
+                        400.0 * clipped / expanded_length);
     }
 
+    *result = (byte *) expanded;
+    *result_len = expanded_length;
+
     return true;
 }
 
@@ -621,11 +977,12 @@ static boolean ExpandSoundData_SDL(sfxinfo_t *sfxinfo,
                                    byte *data,
                                    int samplerate,
                                    int bits,
-                                   int length)
+                                   int length,
+                                   byte **result,
+                                   uint32_t *result_len)
 {
     SDL_AudioCVT convertor;
-    allocated_sound_t *snd;
-    Mix_Chunk *chunk;
+    byte *abuf;
     uint32_t expanded_length;
     uint32_t samplecount = length / (bits / 8);
 
@@ -639,15 +996,13 @@ static boolean ExpandSoundData_SDL(sfxinfo_t *sfxinfo,
 
     // Allocate a chunk in which to expand the sound
 
-    snd = AllocateSound(sfxinfo, expanded_length);
+    abuf = malloc(expanded_length);
 
-    if (snd == NULL)
+    if (abuf == NULL)
     {
         return false;
     }
 
-    chunk = &snd->chunk;
-
     // If we can, use the standard / optimized SDL conversion routines.
 
     if (samplerate <= mixer_freq
@@ -663,12 +1018,12 @@ static boolean ExpandSoundData_SDL(sfxinfo_t *sfxinfo,
 
         SDL_ConvertAudio(&convertor);
 
-        memcpy(chunk->abuf, convertor.buf, chunk->alen);
+        memcpy(abuf, convertor.buf, expanded_length);
         free(convertor.buf);
     }
     else
     {
-        Sint16 *expanded = (Sint16 *) chunk->abuf;
+        Sint16 *expanded = (Sint16 *) abuf;
         int expanded_length;
         int expand_ratio;
         int i;
@@ -738,27 +1093,37 @@ static boolean ExpandSoundData_SDL(sfxinfo_t *sfxinfo,
 #endif /* #ifdef LOW_PASS_FILTER */
     }
 
+    *result = abuf;
+    *result_len = expanded_length;
+
     return true;
 }
 
-// Load and convert a sound effect
-// Returns true if successful
+// [AP] A sound effect's samples, copied out of its lump so that it can be
+// converted away from the zone; and the result, once converted in the
+// background.
 
-static boolean CacheSFX(sfxinfo_t *sfxinfo)
+typedef struct sfxjob_s sfxjob_t;
+
+struct sfxjob_s
 {
-    int lumpnum;
-    unsigned int lumplen;
-    int samplerate;
-    unsigned int bits;
-    unsigned int length;
+    sfxinfo_t *sfxinfo;
     byte *data;
+    int samplerate;
+    int bits;
+    int length;
+    boolean urgent;     // About to be played; goes before precaching
+    byte *result;
+    uint32_t result_len;
+    sfxjob_t *next;
+};
 
-    // need to load the sound
-
-    lumpnum = sfxinfo->lumpnum;
-    data = W_CacheLumpNum(lumpnum, PU_STATIC);
-    lumplen = W_LumpLength(lumpnum);
+// [AP] Find the samples in a sound effect lump.
+// Returns NULL if it isn't a valid sound
 
+static byte *ParseSFX(byte *data, unsigned int lumplen, int *samplerate,
+                      unsigned int *bits, unsigned int *length)
+{
     // [crispy] Check if this is a valid RIFF wav file
     if (lumplen > 44 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVEfmt ", 8) == 0)
     {
@@ -769,30 +1134,30 @@ static boolean CacheSFX(sfxinfo_t *sfxinfo)
         // "fmt " chunk size must == 16
         check = data[16] | (data[17] << 8) | (data[18] << 16) | (data[19] << 24);
         if (check != 16)
-            return false;
+            return NULL;
 
         // Format must == 1 (PCM)
         check = data[20] | (data[21] << 8);
         if (check != 1)
-            return false;
+            return NULL;
 
         // FIXME: can't handle stereo wavs
         // Number of channels must == 1
         check = data[22] | (data[23] << 8);
         if (check != 1)
-            return false;
+            return NULL;
 
-        samplerate = data[24] | (data[25] << 8) | (data[26] << 16) | (data[27] << 24);
-        length = data[40] | (data[41] << 8) | (data[42] << 16) | (data[43] << 24);
+        *samplerate = data[24] | (data[25] << 8) | (data[26] << 16) | (data[27] << 24);
+        *length = data[40] | (data[41] << 8) | (data[42] << 16) | (data[43] << 24);
 
-        if (length > lumplen - 44)
-            length = lumplen - 44;
+        if (*length > lumplen - 44)
+            *length = lumplen - 44;
 
-        bits = data[34] | (data[35] << 8);
+        *bits = data[34] | (data[35] << 8);
 
         // Reject non 8 or 16 bit
-        if (bits != 16 && bits != 8)
-            return false;
+        if (*bits != 16 && *bits != 8)
+            return NULL;
 
         data += 44 - 8;
     }
@@ -802,8 +1167,8 @@ static boolean CacheSFX(sfxinfo_t *sfxinfo)
         // Valid DOOM sound
 
         // 16 bit sample rate field, 32 bit length field
-        samplerate = (data[3] << 8) | data[2];
-        length = (data[7] << 24) | (data[6] << 16) | (data[5] << 8) | data[4];
+        *samplerate = (data[3] << 8) | data[2];
+        *length = (data[7] << 24) | (data[6] << 16) | (data[5] << 8) | data[4];
 
         // If the header specifies that the length of the sound is greater than
         // the length of the lump itself, this is an invalid sound lump
@@ -814,29 +1179,104 @@ static boolean CacheSFX(sfxinfo_t *sfxinfo)
         // further investigation to better understand the correct
         // behavior.
 
-        if (length > lumplen - 8 || length <= 48)
+        if (*length > lumplen - 8 || *length <= 48)
         {
-            return false;
+            return NULL;
         }
 
         // All Doom sounds are 8-bit
-        bits = 8;
+        *bits = 8;
 
         // The DMX sound library seems to skip the first 16 and last 16
         // bytes of the lump - reason unknown.
 
         data += 16;
-        length -= 32;
+        *length -= 32;
     }
     else
     {
         // Invalid sound
+        return NULL;
+    }
+
+    return data + 8;
+}
+
+// Load a sound effect lump and copy out its samples
+// Returns true if successful
+
+static boolean ReadSFX(sfxinfo_t *sfxinfo, sfxjob_t *job)
+{
+    int lumpnum;
+    int samplerate;
+    unsigned int bits;
+    unsigned int length;
+    byte *data;
+    byte *samples;
+
+    // need to load the sound
+
+    lumpnum = sfxinfo->lumpnum;
+    data = W_CacheLumpNum(lumpnum, PU_STATIC);
+    samples = ParseSFX(data, W_LumpLength(lumpnum), &samplerate, &bits, &length);
+
+    if (samples == NULL)
+    {
+        goto invalid;
+    }
+
+    job->data = malloc(length);
+
+    if (job->data == NULL)
+    {
+        goto invalid;
+    }
+
+    memcpy(job->data, samples, length);
+    job->samplerate = samplerate;
+    job->bits = bits;
+    job->length = length;
+
+    // don't need the original lump any more
+
+    W_ReleaseLumpNum(lumpnum);
+
+    return true;
+
+invalid:
+    W_ReleaseLumpNum(lumpnum);
+
+    return false;
+}
+
+// Load and convert a sound effect
+// Returns true if successful
+
+static boolean CacheSFX(sfxinfo_t *sfxinfo)
+{
+    sfxjob_t job;
+    boolean expanded;
+
+    if (!ReadSFX(sfxinfo, &job))
+    {
         return false;
     }
 
     // Sample rate conversion
 
-    if (!ExpandSoundData(sfxinfo, data + 8, samplerate, bits, length))
+    I_TraceBegin("CacheSFX", sfxinfo->name);
+    expanded = ExpandSoundData(sfxinfo, job.data, job.samplerate, job.bits,
+                               job.length, &job.result, &job.result_len);
+    I_TraceEnd("CacheSFX");
+
+    free(job.data);
+
+    if (!expanded)
+    {
+        return false;
+    }
+
+    if (InstallSound(sfxinfo, job.result, job.result_len) == NULL)
     {
         return false;
     }
@@ -848,18 +1288,230 @@ static boolean CacheSFX(sfxinfo_t *sfxinfo)
 
         M_snprintf(filename, sizeof(filename), "%s.wav",
                    DEH_String(sfxinfo->name));
-        snd = GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH);
+        snd = GetAllocatedSoundBySfxInfo(sfxinfo);
         WriteWAV(filename, snd->chunk.abuf, snd->chunk.alen,mixer_freq);
     }
 #endif
 
-    // don't need the original lump any more
-  
-    W_ReleaseLumpNum(lumpnum);
-
     return true;
 }
 
+// [AP] With libsamplerate, conversion can take long enough to be felt
+// when a sound is first played, so it's done on a thread instead: ahead
+// of time for precached sounds, or straight away for one about to be
+// played, which meanwhile plays as converted by ExpandSoundData_SDL.
+// The thread only sees jobs; the cache is only touched by the game
+// thread, in CollectSFX. A pending job is the sound's driver_data.
+
+static SDL_Thread *sfx_thread;
+static SDL_mutex *sfx_lock;
+static SDL_cond *sfx_cond;
+static boolean sfx_quit;
+
+// Behind sfx_lock
+static sfxjob_t *sfx_queue;     // Waiting, in order
+static sfxjob_t *sfx_done;      // Converted, or failed with no result
+
+static int SFXThread(void *unused)
+{
+    sfxjob_t **link, **pick, *job;
+
+    SDL_LockMutex(sfx_lock);
+
+    while (true)
+    {
+        while (sfx_queue == NULL && !sfx_quit)
+        {
+            SDL_CondWait(sfx_cond, sfx_lock);
+        }
+
+        if (sfx_quit)
+        {
+            break;
+        }
+
+        pick = &sfx_queue;
+
+        for (link = &sfx_queue; *link != NULL; link = &(*link)->next)
+        {
+            if ((*link)->urgent)
+            {
+                pick = link;
+                break;
+            }
+        }
+
+        job = *pick;
+        *pick = job->next;
+
+        SDL_UnlockMutex(sfx_lock);
+
+        I_TraceBegin("ExpandSoundData", job->sfxinfo->name);
+
+        if (!ExpandSoundData(job->sfxinfo, job->data, job->samplerate,
+                             job->bits, job->length,
+                             &job->result, &job->result_len))
+        {
+            job->result = NULL;
+        }
+
+        I_TraceEnd("ExpandSoundData");
+
+        SDL_LockMutex(sfx_lock);
+
+        job->next = sfx_done;
+        sfx_done = job;
+    }
+
+    SDL_UnlockMutex(sfx_lock);
+
+    return 0;
+}
+
+static void FreeSFXJobs(sfxjob_t *job)
+{
+    sfxjob_t *next;
+
+    for (; job != NULL; job = next)
+    {
+        next = job->next;
+        job->sfxinfo->driver_data = NULL;
+        free(job->data);
+        free(job->result);
+        free(job);
+    }
+}
+
+static void StartSFXThread(void)
+{
+    sfx_quit = false;
+    sfx_lock = SDL_CreateMutex();
+    sfx_cond = SDL_CreateCond();
+    sfx_thread = SDL_CreateThread(SFXThread, "I_SDL_SFX", NULL);
+
+    if (sfx_thread == NULL)
+    {
+        fprintf(stderr, "I_SDL_InitSound: %s\n", SDL_GetError());
+    }
+}
+
+static void StopSFXThread(void)
+{
+    if (sfx_thread == NULL)
+    {
+        return;
+    }
+
+    SDL_LockMutex(sfx_lock);
+    sfx_quit = true;
+    SDL_CondBroadcast(sfx_cond);
+    SDL_UnlockMutex(sfx_lock);
+
+    SDL_WaitThread(sfx_thread, NULL);
+    sfx_thread = NULL;
+
+    FreeSFXJobs(sfx_queue);
+    FreeSFXJobs(sfx_done);
+    sfx_queue = sfx_done = NULL;
+
+    SDL_DestroyCond(sfx_cond);
+    SDL_DestroyMutex(sfx_lock);
+}
+
+// Queue a sound effect to be converted, unless it already is. Returns
+// its job, or NULL if the lump isn't a valid sound.
+
+static sfxjob_t *QueueSFX(sfxinfo_t *sfxinfo, boolean urgent)
+{
+    sfxjob_t *job = sfxinfo->driver_data;
+    sfxjob_t **link;
+
+    if (job != NULL)
+    {
+        if (urgent)
+        {
+            SDL_LockMutex(sfx_lock);
+            job->urgent = true;
+            SDL_UnlockMutex(sfx_lock);
+        }
+
+        return job;
+    }
+
+    job = calloc(1, sizeof(*job));
+
+    if (job == NULL || !ReadSFX(sfxinfo, job))
+    {
+        free(job);
+        return NULL;
+    }
+
+    job->sfxinfo = sfxinfo;
+    job->urgent = urgent;
+    sfxinfo->driver_data = job;
+
+    SDL_LockMutex(sfx_lock);
+
+    for (link = &sfx_queue; *link != NULL; link = &(*link)->next);
+
+    *link = job;
+    SDL_CondSignal(sfx_cond);
+    SDL_UnlockMutex(sfx_lock);
+
+    return job;
+}
+
+// Swap in the sound effects converted since last time. Older versions
+// still playing are left to be freed when they stop.
+
+static void CollectSFX(void)
+{
+    allocated_sound_t *snd, *prev;
+    sfxjob_t *done, *job;
+
+    if (sfx_thread == NULL)
+    {
+        return;
+    }
+
+    SDL_LockMutex(sfx_lock);
+    done = sfx_done;
+    sfx_done = NULL;
+    SDL_UnlockMutex(sfx_lock);
+
+    for (job = done; job != NULL; job = job->next)
+    {
+        if (job->result == NULL)
+        {
+            continue;
+        }
+
+        for (snd = allocated_sounds_tail; snd != NULL; snd = prev)
+        {
+            prev = snd->prev;
+
+            if (snd->sfxinfo != job->sfxinfo)
+            {
+                continue;
+            }
+
+            if (snd->use_count == 0)
+            {
+                FreeAllocatedSound(snd);
+            }
+            else
+            {
+                snd->stale = true;
+            }
+        }
+
+        InstallSound(job->sfxinfo, job->result, job->result_len);
+        job->result = NULL;
+    }
+
+    FreeSFXJobs(done);
+}
+
 static void GetSfxLumpName(sfxinfo_t *sfx, char *buf, size_t buf_len)
 {
     // Linked sfx lumps? Get the lump number for the sound linked to.
@@ -883,12 +1535,31 @@ static void GetSfxLumpName(sfxinfo_t *sfx, char *buf, size_t buf_len)
 }
 
 // Preload all the sound effects - stops nasty ingame freezes
+// [AP] With the conversion thread, they're only queued, so startup
+// doesn't wait for them either.
 
 static void I_SDL_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
 {
     char namebuf[9];
     int i;
 
+    if (sfx_thread != NULL)
+    {
+        for (i=0; i<num_sounds; ++i)
+        {
+            GetSfxLumpName(&sounds[i], namebuf, sizeof(namebuf));
+
+            sounds[i].lumpnum = W_CheckNumForName(namebuf);
+
+            if (sounds[i].lumpnum != -1)
+            {
+                QueueSFX(&sounds[i], false);
+            }
+        }
+
+        return;
+    }
+
     printf("I_SDL_PrecacheSounds: Precaching all sound effects..");
 
     for (i=0; i<num_sounds; ++i)
@@ -912,20 +1583,54 @@ static void I_SDL_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
     printf("\n");
 }
 
+// [AP] Quickly convert a sound effect still waiting for the conversion
+// thread, to play until that's done.
+
+static boolean DraftSFX(sfxjob_t *job)
+{
+    byte *result;
+    uint32_t result_len;
+
+    if (!ExpandSoundData_SDL(job->sfxinfo, job->data, job->samplerate,
+                             job->bits, job->length, &result, &result_len))
+    {
+        return false;
+    }
+
+    return InstallSound(job->sfxinfo, result, result_len) != NULL;
+}
+
 // Load a SFX chunk into memory and ensure that it is locked.
 
 static boolean LockSound(sfxinfo_t *sfxinfo)
 {
+    CollectSFX();
+
     // If the sound isn't loaded, load it now
-    if (GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH) == NULL)
+    if (GetAllocatedSoundBySfxInfo(sfxinfo) != NULL)
     {
-        if (!CacheSFX(sfxinfo))
+        I_SoundStatsCount(SNDSTATS_CACHE_HIT);
+    }
+    else
+    {
+        I_SoundStatsCount(SNDSTATS_CACHE_MISS);
+
+        if (sfx_thread != NULL)
+        {
+            sfxjob_t *job = QueueSFX(sfxinfo, true);
+
+            if (job == NULL || !DraftSFX(job))
+            {
+                return false;
+            }
+        }
+        else if (!CacheSFX(sfxinfo))
         {
             return false;
         }
     }
 
-    LockAllocatedSound(GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH));
+    LockAllocatedSound(GetAllocatedSoundBySfxInfo(sfxinfo));
 
     return true;
 }
@@ -945,24 +1650,128 @@ static int I_SDL_GetSfxLumpNum(sfxinfo_t *sfx)
     return W_CheckNumForName(namebuf);
 }
 
+// [AP] Convert a sound effect the level is likely to play ahead of time
+
+static void I_SDL_PreloadSound(sfxinfo_t *sfxinfo)
+{
+    if (!sound_initialized)
+    {
+        return;
+    }
+
+    if (sfxinfo->lumpnum < 0)
+    {
+        sfxinfo->lumpnum = I_SDL_GetSfxLumpNum(sfxinfo);
+
+        if (sfxinfo->lumpnum < 0)
+        {
+            return;
+        }
+    }
+
+    if (sfx_thread != NULL)
+    {
+        CollectSFX();
+
+        if (sfxinfo->driver_data != NULL
+         || GetAllocatedSoundBySfxInfo(sfxinfo) == NULL)
+        {
+            QueueSFX(sfxinfo, true);
+        }
+    }
+    else if (GetAllocatedSoundBySfxInfo(sfxinfo) == NULL)
+    {
+        CacheSFX(sfxinfo);
+    }
+}
+
 static void I_SDL_UpdateSoundParams(int handle, int vol, int sep)
 {
-    int left, right;
+    mixcommand_t cmd;
 
     if (!sound_initialized || handle < 0 || handle >= NUM_CHANNELS)
     {
         return;
     }
 
-    left = ((254 - sep) * vol) / 127;
-    right = ((sep) * vol) / 127;
+    GetSoundGains(vol, sep, &cmd.left, &cmd.right);
+
+    // Called every tic for every channel; only send changes
+    if (cmd.left == channel_left[handle] && cmd.right == channel_right[handle])
+    {
+        return;
+    }
+
+    channel_left[handle] = cmd.left;
+    channel_right[handle] = cmd.right;
+
+    cmd.type = MIX_PARAMS;
+    cmd.channel = handle;
+    SendMixCommand(&cmd);
+}
+
+// [AP] Play a sound from its raw samples: where they are if the WAD is
+// mapped, else from a copy that lives as long as the sound plays. It
+// never goes through ExpandSoundData or the cache.
+
+static boolean StartStream(sfxinfo_t *sfxinfo, int channel, mixcommand_t *cmd)
+{
+    int samplerate;
+    unsigned int bits;
+    unsigned int length;
+    byte *samples;
+    byte *copy = NULL;
+
+    if (sfxinfo->lumpnum < 0)
+    {
+        return false;
+    }
+
+    if (lumpinfo[sfxinfo->lumpnum]->wad_file->mapped != NULL)
+    {
+        samples = ParseSFX(W_CacheLumpNum(sfxinfo->lumpnum, PU_STATIC),
+                           W_LumpLength(sfxinfo->lumpnum),
+                           &samplerate, &bits, &length);
+
+        if (samples == NULL)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        sfxjob_t job;
+
+        if (!ReadSFX(sfxinfo, &job))
+        {
+            return false;
+        }
 
-    if (left < 0) left = 0;
-    else if ( left > 255) left = 255;
-    if (right < 0) right = 0;
-    else if (right > 255) right = 255;
+        samples = copy = job.data;
+        samplerate = job.samplerate;
+        bits = job.bits;
+        length = job.length;
+    }
 
-    Mix_SetPanning(handle, left, right);
+    cmd->data = NULL;
+    cmd->stream = samples;
+    cmd->stream_bits = bits;
+    cmd->stream_gain = 32767;
+    cmd->frames = length / (bits / 8);
+    cmd->step = ((uint64_t) samplerate << 16) / mixer_freq;
+
+#ifdef HAVE_LIBSAMPLERATE
+    // As loud as it would have been converted
+    if (ExpandSoundData == ExpandSoundData_SRC)
+    {
+        cmd->stream_gain = (int) (libsamplerate_scale * 32767);
+    }
+#endif
+
+    channel_streaming[channel] = true;
+    channel_stream_copy[channel] = copy;
+
+    return true;
 }
 
 //
@@ -974,13 +1783,14 @@ static void I_SDL_UpdateSoundParams(int handle, int vol, int sep)
 //  it is ignored.
 // As our sound handling does not handle
 //  priority, it is ignored.
-// Pitching (that is, increased speed of playback)
-//  is set, but currently not used by mixing.
+// [AP] Pitching (that is, increased speed of playback)
+//  is done by the mixer's step through the samples.
 //
 
 static int I_SDL_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep, int pitch)
 {
     allocated_sound_t *snd;
+    mixcommand_t cmd;
 
     if (!sound_initialized || channel < 0 || channel >= NUM_CHANNELS)
     {
@@ -992,52 +1802,59 @@ static int I_SDL_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep, i
 
     ReleaseSoundOnChannel(channel);
 
-    // Get the sound data
+    cmd.type = MIX_START;
+    cmd.channel = channel;
 
-    if (!LockSound(sfxinfo))
+    if (sfxinfo->stream)
     {
-        return -1;
-    }
+        // [AP] Nothing to cache, and always played at its own pitch
 
-    snd = GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, pitch);
+        if (!StartStream(sfxinfo, channel, &cmd))
+        {
+            return -1;
+        }
 
-    if (snd == NULL)
+        snd = NULL;
+        pitch = NORM_PITCH;
+    }
+    else
     {
-        allocated_sound_t *newsnd;
-        // fetch the base sound effect, un-pitch-shifted
-        snd = GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH);
+        // Get the sound data
 
-        if (snd == NULL)
+        if (!LockSound(sfxinfo))
         {
             return -1;
         }
 
-        if (snd_pitchshift)
-        {
-            newsnd = PitchShift(snd, pitch);
+        snd = GetAllocatedSoundBySfxInfo(sfxinfo);
 
-            if (newsnd)
-            {
-                LockAllocatedSound(newsnd);
-                UnlockAllocatedSound(snd);
-                snd = newsnd;
-            }
-        }
-    }
-    else
-    {
-        LockAllocatedSound(snd);
+        cmd.data = (const Sint16 *) snd->chunk.abuf;
+        cmd.stream = NULL;
+        cmd.frames = snd->chunk.alen / 4;
+        cmd.step = 1 << 16;
     }
 
-    // play sound
+    // The length used to scale by (2 - pitch / NORM_PITCH), an
+    // approximation of vanilla behaviour based on measurements
 
-    Mix_PlayChannel(channel, &snd->chunk, 0);
+    if (snd_pitchshift && pitch != NORM_PITCH)
+    {
+        if (pitch < 0) pitch = 0;
+        else if (pitch > 2 * NORM_PITCH - 1) pitch = 2 * NORM_PITCH - 1;
 
-    channels_playing[channel] = snd;
+        cmd.step = (NORM_PITCH << 16) / (2 * NORM_PITCH - pitch);
+    }
 
     // set separation, etc.
 
-    I_SDL_UpdateSoundParams(channel, vol, sep);
+    GetSoundGains(vol, sep, &cmd.left, &cmd.right);
+    channel_left[channel] = cmd.left;
+    channel_right[channel] = cmd.right;
+
+    // play sound
+
+    channels_playing[channel] = snd;
+    channel_serial[channel] = SendMixCommand(&cmd);
 
     return channel;
 }
@@ -1063,7 +1880,8 @@ static boolean I_SDL_SoundIsPlaying(int handle)
         return false;
     }
 
-    return Mix_Playing(handle);
+    return (channels_playing[handle] != NULL || channel_streaming[handle])
+        && (unsigned int) SDL_AtomicGet(&mix_ended[handle]) != channel_serial[handle];
 }
 
 //
@@ -1074,11 +1892,15 @@ static void I_SDL_UpdateSound(void)
 {
     int i;
 
+    CollectSFX(); // [AP]
+    FreeRetiredSounds();
+
     // Check all channels to see if a sound has finished
 
     for (i=0; i<NUM_CHANNELS; ++i)
     {
-        if (channels_playing[i] && !I_SDL_SoundIsPlaying(i))
+        if ((channels_playing[i] || channel_streaming[i])
+         && !I_SDL_SoundIsPlaying(i))
         {
             // Sound has finished playing on this channel,
             // but sound data has not been released to cache
@@ -1090,12 +1912,31 @@ static void I_SDL_UpdateSound(void)
 
 static void I_SDL_ShutdownSound(void)
 {
+    int i;
+
     if (!sound_initialized)
     {
         return;
     }
 
+    StopSFXThread(); // [AP]
+
+    Mix_SetPostMix(NULL, NULL);
     Mix_CloseAudio();
+
+    // [AP] Nothing reads the sound data anymore
+    SDL_AtomicSet(&mix_head, SDL_AtomicGet(&mix_tail));
+    SDL_AtomicSet(&mix_processed, mix_serial);
+
+    for (i = 0; i < NUM_CHANNELS; ++i)
+    {
+        mix_voices[i].data = NULL;
+        mix_voices[i].stream = NULL;
+        SDL_AtomicSet(&mix_ended[i], channel_serial[i]);
+        ReleaseSoundOnChannel(i);
+    }
+
+    FreeRetiredSounds();
     SDL_QuitSubSystem(SDL_INIT_AUDIO);
 
     sound_initialized = false;
@@ -1176,7 +2017,20 @@ static boolean I_SDL_InitSound(boolean _use_sfx_prefix)
     }
 #endif
 
-    Mix_AllocateChannels(NUM_CHANNELS);
+    // [AP] Only worth it for the slow conversion
+    if (ExpandSoundData != ExpandSoundData_SDL)
+    {
+        StartSFXThread();
+    }
+
+    // [AP] Mixed here rather than on SDL_mixer channels
+    I_InitMixSIMD();
+    if (mix_lock == NULL)
+    {
+        mix_lock = SDL_CreateMutex();
+    }
+
+    Mix_SetPostMix(MixSFX, NULL);
 
     SDL_PauseAudio(0);
 
@@ -1208,6 +2062,7 @@ const sound_module_t sound_sdl_module =
     I_SDL_StopSound,
     I_SDL_SoundIsPlaying,
     I_SDL_PrecacheSounds,
+    I_SDL_PreloadSound,
 };
 
 
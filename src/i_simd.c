@@ -0,0 +1,389 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	SIMD helpers for the span and column drawers, picked at runtime.
+//	There is no gather on SSE2 or NEON, so the flat, colormap and tint
+//	table lookups stay scalar in the drawers; this only computes the
+//	texel indices, four at a time.
+//
+//	The mixer helpers work on unpitched voices, whose samples are
+//	contiguous, and on the final clamp. Both give the same results as
+//	the scalar versions.
+//
+
+#include <stdio.h>
+
+#include "SDL.h"
+
+#include "i_simd.h"
+#include "m_argv.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SPAN_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HAVE_SPAN_NEON
+#include <arm_neon.h>
+#endif
+
+static void I_SpanSpotsSelect (int *spots, unsigned int xfrac, unsigned int yfrac,
+                               unsigned int xstep, unsigned int ystep, int count);
+static void I_ColumnSpotsSelect (int *spots, unsigned int frac, unsigned int step,
+                                 int mask, int count);
+
+void (*I_SpanSpots) (int *spots, unsigned int xfrac, unsigned int yfrac,
+                     unsigned int xstep, unsigned int ystep, int count) = I_SpanSpotsSelect;
+void (*I_ColumnSpots) (int *spots, unsigned int frac, unsigned int step,
+                       int mask, int count) = I_ColumnSpotsSelect;
+
+static void I_SpanSpotsScalar (int *spots, unsigned int xfrac, unsigned int yfrac,
+                               unsigned int xstep, unsigned int ystep, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        spots[i] = ((yfrac >> 10) & 0xfc0) | ((xfrac >> 16) & 63);
+        xfrac += xstep;
+        yfrac += ystep;
+    }
+}
+
+#ifdef HAVE_SPAN_SSE2
+static void I_SpanSpotsSSE2 (int *spots, unsigned int xfrac, unsigned int yfrac,
+                             unsigned int xstep, unsigned int ystep, int count)
+{
+    const __m128i ymask = _mm_set1_epi32(0xfc0);
+    const __m128i xmask = _mm_set1_epi32(63);
+    const __m128i xstep4 = _mm_set1_epi32((int)(xstep * 4));
+    const __m128i ystep4 = _mm_set1_epi32((int)(ystep * 4));
+    __m128i x = _mm_set_epi32((int)(xfrac + xstep * 3), (int)(xfrac + xstep * 2),
+                              (int)(xfrac + xstep), (int)xfrac);
+    __m128i y = _mm_set_epi32((int)(yfrac + ystep * 3), (int)(yfrac + ystep * 2),
+                              (int)(yfrac + ystep), (int)yfrac);
+    int buffer[4];
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4)
+    {
+        __m128i spot = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(y, 10), ymask),
+                                    _mm_and_si128(_mm_srli_epi32(x, 16), xmask));
+        _mm_storeu_si128((__m128i *)(spots + i), spot);
+        x = _mm_add_epi32(x, xstep4);
+        y = _mm_add_epi32(y, ystep4);
+    }
+
+    if (i < count)
+    {
+        __m128i spot = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(y, 10), ymask),
+                                    _mm_and_si128(_mm_srli_epi32(x, 16), xmask));
+        _mm_storeu_si128((__m128i *)buffer, spot);
+        for (; i < count; i++)
+            spots[i] = buffer[i & 3];
+    }
+}
+#endif
+
+#ifdef HAVE_SPAN_NEON
+static void I_SpanSpotsNEON (int *spots, unsigned int xfrac, unsigned int yfrac,
+                             unsigned int xstep, unsigned int ystep, int count)
+{
+    const uint32x4_t ymask = vdupq_n_u32(0xfc0);
+    const uint32x4_t xmask = vdupq_n_u32(63);
+    const uint32x4_t xstep4 = vdupq_n_u32(xstep * 4);
+    const uint32x4_t ystep4 = vdupq_n_u32(ystep * 4);
+    const unsigned int xstart[4] = {xfrac, xfrac + xstep, xfrac + xstep * 2, xfrac + xstep * 3};
+    const unsigned int ystart[4] = {yfrac, yfrac + ystep, yfrac + ystep * 2, yfrac + ystep * 3};
+    uint32x4_t x = vld1q_u32(xstart);
+    uint32x4_t y = vld1q_u32(ystart);
+    unsigned int buffer[4];
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4)
+    {
+        uint32x4_t spot = vorrq_u32(vandq_u32(vshrq_n_u32(y, 10), ymask),
+                                    vandq_u32(vshrq_n_u32(x, 16), xmask));
+        vst1q_s32(spots + i, vreinterpretq_s32_u32(spot));
+        x = vaddq_u32(x, xstep4);
+        y = vaddq_u32(y, ystep4);
+    }
+
+    if (i < count)
+    {
+        uint32x4_t spot = vorrq_u32(vandq_u32(vshrq_n_u32(y, 10), ymask),
+                                    vandq_u32(vshrq_n_u32(x, 16), xmask));
+        vst1q_u32(buffer, spot);
+        for (; i < count; i++)
+            spots[i] = (int)buffer[i & 3];
+    }
+}
+#endif
+
+static void I_ColumnSpotsScalar (int *spots, unsigned int frac, unsigned int step,
+                                 int mask, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        spots[i] = (frac >> 16) & mask;
+        frac += step;
+    }
+}
+
+#ifdef HAVE_SPAN_SSE2
+static void I_ColumnSpotsSSE2 (int *spots, unsigned int frac, unsigned int step,
+                               int mask, int count)
+{
+    const __m128i mask4 = _mm_set1_epi32(mask);
+    const __m128i step4 = _mm_set1_epi32((int)(step * 4));
+    __m128i f = _mm_set_epi32((int)(frac + step * 3), (int)(frac + step * 2),
+                              (int)(frac + step), (int)frac);
+    int buffer[4];
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(spots + i),
+                         _mm_and_si128(_mm_srli_epi32(f, 16), mask4));
+        f = _mm_add_epi32(f, step4);
+    }
+
+    if (i < count)
+    {
+        _mm_storeu_si128((__m128i *)buffer,
+                         _mm_and_si128(_mm_srli_epi32(f, 16), mask4));
+        for (; i < count; i++)
+            spots[i] = buffer[i & 3];
+    }
+}
+#endif
+
+#ifdef HAVE_SPAN_NEON
+static void I_ColumnSpotsNEON (int *spots, unsigned int frac, unsigned int step,
+                               int mask, int count)
+{
+    const uint32x4_t mask4 = vdupq_n_u32((unsigned int)mask);
+    const uint32x4_t step4 = vdupq_n_u32(step * 4);
+    const unsigned int start[4] = {frac, frac + step, frac + step * 2, frac + step * 3};
+    uint32x4_t f = vld1q_u32(start);
+    unsigned int buffer[4];
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4)
+    {
+        vst1q_s32(spots + i, vreinterpretq_s32_u32(vandq_u32(vshrq_n_u32(f, 16), mask4)));
+        f = vaddq_u32(f, step4);
+    }
+
+    if (i < count)
+    {
+        vst1q_u32(buffer, vandq_u32(vshrq_n_u32(f, 16), mask4));
+        for (; i < count; i++)
+            spots[i] = (int)buffer[i & 3];
+    }
+}
+#endif
+
+// Picks the span and column helpers, on first use of either.
+
+static void I_SelectDrawerSIMD (void)
+{
+    const char *name = "scalar";
+
+    I_SpanSpots = I_SpanSpotsScalar;
+    I_ColumnSpots = I_ColumnSpotsScalar;
+
+    //!
+    // @category video
+    //
+    // Don't use SSE2 or NEON in the span and column drawers.
+    //
+
+    if (!M_CheckParm("-nosimd"))
+    {
+#ifdef HAVE_SPAN_SSE2
+        if (SDL_HasSSE2())
+        {
+            I_SpanSpots = I_SpanSpotsSSE2;
+            I_ColumnSpots = I_ColumnSpotsSSE2;
+            name = "SSE2";
+        }
+#endif
+#ifdef HAVE_SPAN_NEON
+        if (SDL_HasNEON())
+        {
+            I_SpanSpots = I_SpanSpotsNEON;
+            I_ColumnSpots = I_ColumnSpotsNEON;
+            name = "NEON";
+        }
+#endif
+    }
+
+    printf("I_SpanSpots: using %s span and column drawers\n", name);
+}
+
+static void I_SpanSpotsSelect (int *spots, unsigned int xfrac, unsigned int yfrac,
+                               unsigned int xstep, unsigned int ystep, int count)
+{
+    I_SelectDrawerSIMD();
+    I_SpanSpots(spots, xfrac, yfrac, xstep, ystep, count);
+}
+
+static void I_ColumnSpotsSelect (int *spots, unsigned int frac, unsigned int step,
+                                 int mask, int count)
+{
+    I_SelectDrawerSIMD();
+    I_ColumnSpots(spots, frac, step, mask, count);
+}
+
+static void I_MixAddScalar (int32_t *accum, const int16_t *src, int frames,
+                            int left, int right)
+{
+    int i;
+
+    for (i = 0; i < frames; i++)
+    {
+        accum[i * 2] += (src[i * 2] * left) >> 15;
+        accum[i * 2 + 1] += (src[i * 2 + 1] * right) >> 15;
+    }
+}
+
+static void I_MixClampScalar (int16_t *dest, const int32_t *accum, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        int32_t sample = accum[i];
+
+        if (sample > INT16_MAX)
+            sample = INT16_MAX;
+        else if (sample < INT16_MIN)
+            sample = INT16_MIN;
+
+        dest[i] = sample;
+    }
+}
+
+void (*I_MixAdd) (int32_t *accum, const int16_t *src, int frames,
+                  int left, int right) = I_MixAddScalar;
+void (*I_MixClamp) (int16_t *dest, const int32_t *accum, int count) = I_MixClampScalar;
+
+#ifdef HAVE_SPAN_SSE2
+static void I_MixAddSSE2 (int32_t *accum, const int16_t *src, int frames,
+                          int left, int right)
+{
+    const __m128i gain = _mm_set_epi16(right, left, right, left,
+                                       right, left, right, left);
+    int i;
+
+    // Four frames, eight samples at a time; the full products come from
+    // interleaving the low and high halves
+    for (i = 0; i + 4 <= frames; i += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        __m128i lo = _mm_mullo_epi16(s, gain);
+        __m128i hi = _mm_mulhi_epi16(s, gain);
+        __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 15);
+        __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 15);
+        __m128i *a = (__m128i *)(accum + i * 2);
+
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), p0));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), p1));
+    }
+
+    I_MixAddScalar(accum + i * 2, src + i * 2, frames - i, left, right);
+}
+
+static void I_MixClampSSE2 (int16_t *dest, const int32_t *accum, int count)
+{
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8)
+    {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(accum + i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(accum + i + 4));
+
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_packs_epi32(a0, a1));
+    }
+
+    I_MixClampScalar(dest + i, accum + i, count - i);
+}
+#endif
+
+#ifdef HAVE_SPAN_NEON
+static void I_MixAddNEON (int32_t *accum, const int16_t *src, int frames,
+                          int left, int right)
+{
+    const int16_t gains[4] = {left, right, left, right};
+    const int16x4_t gain = vld1_s16(gains);
+    int i;
+
+    for (i = 0; i + 2 <= frames; i += 2)
+    {
+        int32x4_t p = vshrq_n_s32(vmull_s16(vld1_s16(src + i * 2), gain), 15);
+
+        vst1q_s32(accum + i * 2, vaddq_s32(vld1q_s32(accum + i * 2), p));
+    }
+
+    I_MixAddScalar(accum + i * 2, src + i * 2, frames - i, left, right);
+}
+
+static void I_MixClampNEON (int16_t *dest, const int32_t *accum, int count)
+{
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4)
+    {
+        vst1_s16(dest + i, vqmovn_s32(vld1q_s32(accum + i)));
+    }
+
+    I_MixClampScalar(dest + i, accum + i, count - i);
+}
+#endif
+
+void I_InitMixSIMD (void)
+{
+    const char *name = "scalar";
+
+    I_MixAdd = I_MixAddScalar;
+    I_MixClamp = I_MixClampScalar;
+
+    // -nosimd, as for the span drawers
+
+    if (!M_CheckParm("-nosimd"))
+    {
+#ifdef HAVE_SPAN_SSE2
+        if (SDL_HasSSE2())
+        {
+            I_MixAdd = I_MixAddSSE2;
+            I_MixClamp = I_MixClampSSE2;
+            name = "SSE2";
+        }
+#endif
+#ifdef HAVE_SPAN_NEON
+        if (SDL_HasNEON())
+        {
+            I_MixAdd = I_MixAddNEON;
+            I_MixClamp = I_MixClampNEON;
+            name = "NEON";
+        }
+#endif
+    }
+
+    printf("I_InitMixSIMD: using %s sound mixer\n", name);
+}
@@ -0,0 +1,64 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	SIMD helpers for the span and column drawers and the sound effect
+//	mixer, picked at runtime.
+//
+
+#ifndef __I_SIMD__
+#define __I_SIMD__
+
+#include "doomtype.h"
+
+// Largest count I_SpanSpots is called with
+#define I_SPAN_SPOTS_BATCH 8
+
+// Fills spots[0..count-1] with the 64x64 flat texel index of each pixel
+// of a span, the same way the scalar span drawers compute it:
+//   ((yfrac >> 10) & 0xfc0) | ((xfrac >> 16) & 63)
+// where xfrac and yfrac step by xstep and ystep for every pixel.
+// count is 1 .. I_SPAN_SPOTS_BATCH.
+//
+// Uses SSE2 or NEON when the CPU has them, unless -nosimd is given, which
+// keeps the plain C version as a reference for demo comparisons.
+extern void (*I_SpanSpots) (int *spots, unsigned int xfrac, unsigned int yfrac,
+                            unsigned int xstep, unsigned int ystep, int count);
+
+// Largest count I_ColumnSpots is called with
+#define I_COLUMN_SPOTS_BATCH 8
+
+// Fills spots[0..count-1] with the texel index of each pixel of a column
+// of a texture whose height is a power of 2, the same way the scalar
+// column drawers compute it:
+//   (frac >> FRACBITS) & mask
+// where frac steps by step for every pixel and mask is the height - 1.
+// count is 1 .. I_COLUMN_SPOTS_BATCH. -nosimd applies as for I_SpanSpots.
+extern void (*I_ColumnSpots) (int *spots, unsigned int frac, unsigned int step,
+                              int mask, int count);
+
+// Sound effect mixing. Gains are Q15, 32767 being full volume.
+
+// Adds frames of 16-bit stereo src, scaled by left and right, into the
+// 32-bit stereo accum.
+extern void (*I_MixAdd) (int32_t *accum, const int16_t *src, int frames,
+                         int left, int right);
+
+// Saturates count 32-bit samples into dest.
+extern void (*I_MixClamp) (int16_t *dest, const int32_t *accum, int count);
+
+// Picks the mixing functions. The mixer runs on the audio thread, so
+// this is done up front, not on first use.
+void I_InitMixSIMD (void);
+
+#endif
@@ -25,6 +25,7 @@
 
 #include "gusconf.h"
 #include "i_sound.h"
+#include "i_soundstats.h"
 #include "i_video.h"
 #include "m_argv.h"
 #include "m_config.h"
@@ -241,6 +242,8 @@ void I_InitSound(boolean use_sfx_prefix)
     // Auto configure the music pack directory.
     M_SetMusicPackDir();
 
+    I_InitSoundStats();
+
     // Initialize the sound and music subsystems.
 
     if (!nosound && !screensaver_mode)
@@ -404,6 +407,14 @@ void I_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
     }
 }
 
+void I_PreloadSound(sfxinfo_t *sfxinfo)
+{
+    if (sound_module != NULL && sound_module->PreloadSound != NULL)
+    {
+        sound_module->PreloadSound(sfxinfo);
+    }
+}
+
 void I_InitMusic(void)
 {
 }
@@ -521,6 +532,17 @@ void I_StopSong(void)
     }
 }
 
+// Music packs read the substitute for a song that is likely to be played
+// next in the background. Others don't need this.
+
+void I_PrecacheSong(void *data, int len)
+{
+    if (music_packs_active && music_pack_module.PrecacheSong != NULL)
+    {
+        music_pack_module.PrecacheSong(data, len);
+    }
+}
+
 boolean I_MusicIsPlaying(void)
 {
     if (active_music_module != NULL)
@@ -550,6 +572,7 @@ void I_BindSoundVariables(void)
     M_BindIntVariable("snd_pitchshift",          &snd_pitchshift);
 
     M_BindStringVariable("music_pack_path",      &music_pack_path);
+    M_BindIntVariable("music_pack_fade_ms",      &music_pack_fade_ms);
     M_BindStringVariable("timidity_cfg_path",    &timidity_cfg_path);
     M_BindStringVariable("gus_patch_path",       &gus_patch_path);
     M_BindIntVariable("gus_ram_kb",              &gus_ram_kb);
@@ -574,6 +597,7 @@ void I_BindSoundVariables(void)
     M_BindFloatVariable("fsynth_reverb_level",      &fsynth_reverb_level);
     M_BindFloatVariable("fsynth_reverb_roomsize",   &fsynth_reverb_roomsize);
     M_BindFloatVariable("fsynth_reverb_width",      &fsynth_reverb_width);
+    M_BindIntVariable("fsynth_buffer_ms",           &fsynth_buffer_ms);
     M_BindStringVariable("fsynth_sf_path",          &fsynth_sf_path);
 #endif // HAVE_FLUIDSYNTH
 
@@ -66,6 +66,10 @@ struct sfxinfo_struct
 
     // data used by the low level code
     void *driver_data;
+
+    // [AP] Long and played once in a while (Strife voices): drivers that
+    // can play it straight from the lump instead of caching it
+    boolean stream;
 };
 
 //
@@ -150,6 +154,11 @@ typedef struct
 
     void (*CacheSounds)(sfxinfo_t *sounds, int num_sounds);
 
+    // [AP] Called at level start for sound effects the level will
+    // probably play, so they're ready ahead of time (optional)
+
+    void (*PreloadSound)(sfxinfo_t *sfxinfo);
+
 } sound_module_t;
 
 void I_InitSound(boolean use_sfx_prefix);
@@ -161,6 +170,7 @@ int I_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep, int pitch);
 void I_StopSound(int channel);
 boolean I_SoundIsPlaying(int channel);
 void I_PrecacheSounds(sfxinfo_t *sounds, int num_sounds);
+void I_PreloadSound(sfxinfo_t *sfxinfo);
 
 // Interface for music modules
 
@@ -215,6 +225,10 @@ typedef struct
     // Invoked periodically to poll.
 
     void (*Poll)(void);
+
+    // Optional: get ready to register the song soon.
+
+    void (*PrecacheSong)(void *data, int len);
 } music_module_t;
 
 void I_InitMusic(void);
@@ -227,6 +241,7 @@ void I_UnRegisterSong(void *handle);
 void I_PlaySong(void *handle, boolean looping);
 void I_StopSong(void);
 boolean I_MusicIsPlaying(void);
+void I_PrecacheSong(void *data, int len);
 
 boolean IsMid(byte *mem, int len);
 boolean IsMus(byte *mem, int len);
@@ -272,6 +287,7 @@ extern int opl_io_port;
 // For native music module:
 
 extern char *music_pack_path;
+extern int music_pack_fade_ms;
 extern char *timidity_cfg_path;
 #ifdef _WIN32
 extern char *winmm_midi_device;
@@ -297,6 +313,7 @@ extern float fsynth_reverb_damp;
 extern float fsynth_reverb_level;
 extern float fsynth_reverb_roomsize;
 extern float fsynth_reverb_width;
+extern int fsynth_buffer_ms;
 #endif // HAVE_FLUIDSYNTH
 
 #endif
@@ -0,0 +1,344 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Audio performance counters.
+//
+//	Callbacks run on the audio and render threads, so each source's
+//	numbers are behind a spinlock that the overlay and the dump only
+//	hold long enough to take a copy.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "i_sound.h"
+#include "i_soundstats.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_config.h"
+#include "m_misc.h"
+
+// Callback times: under 32us, then doubling up to 32ms and over.
+#define NUMBUCKETS 12
+#define FIRSTBUCKET_US 32
+
+typedef struct
+{
+    unsigned int calls;
+    unsigned int late;
+    unsigned int underruns;
+    unsigned int min_fill;
+    Uint64 total_us;
+    Uint64 audio_us;  // Length of the audio produced
+    unsigned int max_us;
+    unsigned int buckets[NUMBUCKETS];
+} sourcestats_t;
+
+static const char *source_names[NUMSNDSTATSSOURCES] =
+{
+    "SFX",
+    "OPL",
+    "FSYNTH",
+};
+
+boolean snd_stats = false;
+
+static sourcestats_t sources[NUMSNDSTATSSOURCES];
+static SDL_SpinLock source_locks[NUMSNDSTATSSOURCES];
+static unsigned int counters[NUMSNDSTATSCOUNTERS];
+static SDL_atomic_t voices, max_voices;
+static Uint64 ticks_per_us;
+
+// Overlay figures are for the last second
+static sourcestats_t overlay_prev[NUMSNDSTATSSOURCES];
+static sourcestats_t overlay[NUMSNDSTATSSOURCES];
+static unsigned int overlay_time;
+
+static void CopySource(int source, sourcestats_t *dest)
+{
+    SDL_AtomicLock(&source_locks[source]);
+    *dest = sources[source];
+    SDL_AtomicUnlock(&source_locks[source]);
+}
+
+static void WriteSoundStats(void)
+{
+    char *filename;
+    FILE *fstream;
+    int i, j;
+
+    filename = M_StringJoin(configdir, "audiostats.txt", NULL);
+    fstream = M_fopen(filename, "w");
+
+    if (fstream == NULL)
+    {
+        fprintf(stderr, "WriteSoundStats: Unable to write %s\n", filename);
+        free(filename);
+        return;
+    }
+
+    fprintf(fstream, "snd_sfxdevice %d\nsnd_musicdevice %d\n"
+                     "snd_samplerate %d\nsnd_cachesize %d\n\n",
+            snd_sfxdevice, snd_musicdevice, snd_samplerate, snd_cachesize);
+
+    for (i = 0; i < NUMSNDSTATSSOURCES; ++i)
+    {
+        sourcestats_t s;
+
+        CopySource(i, &s);
+
+        if (s.calls == 0)
+        {
+            continue;
+        }
+
+        fprintf(fstream, "%s: %u callbacks, mean %.1f us, max %u us, "
+                         "%.1f%% of the audio time, %u late, %u underruns",
+                source_names[i], s.calls, (double) s.total_us / s.calls,
+                s.max_us, s.audio_us ? 100.0 * s.total_us / s.audio_us : 0.0,
+                s.late, s.underruns);
+
+        if (s.min_fill != 0)
+        {
+            fprintf(fstream, ", lowest buffer fill %u frames",
+                    s.min_fill - 1);
+        }
+
+        fprintf(fstream, "\n");
+
+        for (j = 0; j < NUMBUCKETS; ++j)
+        {
+            unsigned int low = j ? FIRSTBUCKET_US << (j - 1) : 0;
+
+            if (j == NUMBUCKETS - 1)
+            {
+                fprintf(fstream, "    >= %5u us: %u\n", low, s.buckets[j]);
+            }
+            else
+            {
+                fprintf(fstream, "    %5u-%5u us: %u\n", low,
+                        FIRSTBUCKET_US << j, s.buckets[j]);
+            }
+        }
+    }
+
+    fprintf(fstream, "\nSFX cache: %u hits, %u misses, %u evictions\n"
+                     "Channel steals: %u\nMost voices mixed at once: %d\n",
+            counters[SNDSTATS_CACHE_HIT], counters[SNDSTATS_CACHE_MISS],
+            counters[SNDSTATS_CACHE_EVICT], counters[SNDSTATS_CHANNEL_STEAL],
+            SDL_AtomicGet(&max_voices));
+
+    fclose(fstream);
+    printf("Audio stats written to %s\n", filename);
+    free(filename);
+}
+
+void I_InitSoundStats(void)
+{
+    //!
+    // @category sound
+    //
+    // Time the audio callbacks and count SFX cache use and channel
+    // steals. The numbers are shown next to the FPS counter and written
+    // to audiostats.txt in the config directory on exit.
+    //
+
+    if (snd_stats || !M_ParmExists("-audiostats"))
+    {
+        return;
+    }
+
+    snd_stats = true;
+    ticks_per_us = SDL_GetPerformanceFrequency() / 1000000;
+
+    if (ticks_per_us == 0)
+    {
+        ticks_per_us = 1;
+    }
+
+    I_AtExit(WriteSoundStats, true);
+}
+
+Uint64 I_SoundStatsBegin(void)
+{
+    return snd_stats ? SDL_GetPerformanceCounter() : 0;
+}
+
+void I_SoundStatsCallback(sndstats_source_t source, unsigned int frames,
+                          Uint64 start)
+{
+    if (!snd_stats || start == 0)
+    {
+        return;
+    }
+
+    I_SoundStatsTime(source, frames,
+                     (SDL_GetPerformanceCounter() - start) / ticks_per_us);
+}
+
+void I_SoundStatsTime(sndstats_source_t source, unsigned int frames,
+                      unsigned int us)
+{
+    sourcestats_t *s = &sources[source];
+    unsigned int audio_us;
+    int bucket;
+
+    if (!snd_stats)
+    {
+        return;
+    }
+
+    audio_us = (unsigned int) ((Uint64) frames * 1000000 / snd_samplerate);
+
+    for (bucket = 0; bucket < NUMBUCKETS - 1
+                  && us >= (unsigned int) FIRSTBUCKET_US << bucket; ++bucket);
+
+    SDL_AtomicLock(&source_locks[source]);
+    s->calls++;
+    s->total_us += us;
+    s->audio_us += audio_us;
+    s->buckets[bucket]++;
+
+    if (us > s->max_us)
+    {
+        s->max_us = us;
+    }
+
+    if (us > audio_us)
+    {
+        s->late++;
+    }
+
+    SDL_AtomicUnlock(&source_locks[source]);
+}
+
+void I_SoundStatsUnderrun(sndstats_source_t source)
+{
+    if (!snd_stats)
+    {
+        return;
+    }
+
+    SDL_AtomicLock(&source_locks[source]);
+    sources[source].underruns++;
+    SDL_AtomicUnlock(&source_locks[source]);
+}
+
+void I_SoundStatsFill(sndstats_source_t source, unsigned int frames)
+{
+    if (!snd_stats)
+    {
+        return;
+    }
+
+    // Kept one higher, so that 0 is "never measured"
+    SDL_AtomicLock(&source_locks[source]);
+
+    if (sources[source].min_fill == 0 || frames + 1 < sources[source].min_fill)
+    {
+        sources[source].min_fill = frames + 1;
+    }
+
+    SDL_AtomicUnlock(&source_locks[source]);
+}
+
+void I_SoundStatsVoices(int n)
+{
+    if (!snd_stats)
+    {
+        return;
+    }
+
+    SDL_AtomicSet(&voices, n);
+
+    if (n > SDL_AtomicGet(&max_voices))
+    {
+        SDL_AtomicSet(&max_voices, n);
+    }
+}
+
+void I_SoundStatsCount(sndstats_counter_t counter)
+{
+    counters[counter]++;
+}
+
+boolean I_SoundStatsText(int line, char *buf, size_t buf_len)
+{
+    unsigned int now;
+    int i;
+
+    if (!snd_stats)
+    {
+        return false;
+    }
+
+    now = SDL_GetTicks();
+
+    if (line == 0 && now - overlay_time >= 1000)
+    {
+        for (i = 0; i < NUMSNDSTATSSOURCES; ++i)
+        {
+            sourcestats_t s;
+            sourcestats_t *o = &overlay[i];
+
+            CopySource(i, &s);
+            o->calls = s.calls - overlay_prev[i].calls;
+            o->total_us = s.total_us - overlay_prev[i].total_us;
+            o->audio_us = s.audio_us - overlay_prev[i].audio_us;
+            o->late = s.late;
+            o->underruns = s.underruns;
+            overlay_prev[i] = s;
+        }
+
+        overlay_time = now;
+    }
+
+    if (line == 0)
+    {
+        M_snprintf(buf, buf_len, "SND %d VOICES %u/%u/%u CACHE",
+                   SDL_AtomicGet(&voices), counters[SNDSTATS_CACHE_HIT],
+                   counters[SNDSTATS_CACHE_MISS],
+                   counters[SNDSTATS_CACHE_EVICT]);
+        return true;
+    }
+
+    // One line for each source that has run, with its share of the
+    // audio time over the last second
+    for (i = 0; i < NUMSNDSTATSSOURCES; ++i)
+    {
+        if (overlay_prev[i].calls == 0 || --line > 0)
+        {
+            continue;
+        }
+
+        M_snprintf(buf, buf_len, "%s %.1f%% %u LATE %u XRUN",
+                   source_names[i],
+                   overlay[i].audio_us ?
+                       100.0 * overlay[i].total_us / overlay[i].audio_us : 0.0,
+                   overlay[i].late, overlay[i].underruns);
+        return true;
+    }
+
+    if (line == 1 && counters[SNDSTATS_CHANNEL_STEAL] > 0)
+    {
+        M_snprintf(buf, buf_len, "%u STEALS",
+                   counters[SNDSTATS_CHANNEL_STEAL]);
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,69 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Audio performance counters, enabled with -audiostats. Shown next
+//	to the FPS counter and written to audiostats.txt on exit.
+//
+
+#ifndef __I_SOUNDSTATS__
+#define __I_SOUNDSTATS__
+
+#include "SDL.h"
+
+#include "doomtype.h"
+
+// Code that fills audio buffers, each timed separately.
+typedef enum
+{
+    SNDSTATS_SFX,
+    SNDSTATS_OPL,
+    SNDSTATS_FLUIDSYNTH,
+    NUMSNDSTATSSOURCES
+} sndstats_source_t;
+
+// Events counted on the game thread.
+typedef enum
+{
+    SNDSTATS_CACHE_HIT,
+    SNDSTATS_CACHE_MISS,
+    SNDSTATS_CACHE_EVICT,
+    SNDSTATS_CHANNEL_STEAL,
+    NUMSNDSTATSCOUNTERS
+} sndstats_counter_t;
+
+extern boolean snd_stats;
+
+void I_InitSoundStats(void);
+
+// Returns the time to pass to I_SoundStatsCallback, or 0 if stats are off.
+Uint64 I_SoundStatsBegin(void);
+
+// Records a callback that started at start and produced frames of audio.
+// Callbacks taking longer than the audio they produce count as late.
+void I_SoundStatsCallback(sndstats_source_t source, unsigned int frames,
+                          Uint64 start);
+void I_SoundStatsTime(sndstats_source_t source, unsigned int frames,
+                      unsigned int us);
+
+// Records an underrun, or how full a source's buffer was, from any thread.
+void I_SoundStatsUnderrun(sndstats_source_t source);
+void I_SoundStatsFill(sndstats_source_t source, unsigned int frames);
+
+void I_SoundStatsVoices(int voices);
+void I_SoundStatsCount(sndstats_counter_t counter);
+
+// Fills buf with line number line of the overlay; false past the last.
+boolean I_SoundStatsText(int line, char *buf, size_t buf_len);
+
+#endif
@@ -0,0 +1,108 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Startup stages run alongside the rest of startup.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SDL.h"
+
+#include "i_startup.h"
+#include "i_trace.h"
+#include "m_argv.h"
+
+struct startuptask_s
+{
+    const char *name;
+    int (*func)(void *data);
+    void *data;
+    int result;
+    SDL_Thread *thread;
+};
+
+static int StartupThread(void *arg)
+{
+    startuptask_t *task = arg;
+
+    I_TraceBegin(task->name, NULL);
+    task->result = task->func(task->data);
+    I_TraceEnd(task->name);
+
+    return 0;
+}
+
+startuptask_t *I_StartupTask(const char *name, int (*func)(void *data),
+                             void *data)
+{
+    startuptask_t *task;
+
+    task = calloc(1, sizeof(*task));
+    task->name = name;
+    task->func = func;
+    task->data = data;
+
+    //!
+    // @category obscure
+    //
+    // Run the startup stages one after the other on the main thread,
+    // rather than alongside the rest of startup.
+    //
+
+    if (!M_ParmExists("-serialstartup"))
+    {
+        task->thread = SDL_CreateThread(StartupThread, name, task);
+
+        if (task->thread == NULL)
+        {
+            fprintf(stderr, "I_StartupTask: %s\n", SDL_GetError());
+        }
+    }
+
+    if (task->thread == NULL)
+    {
+        StartupThread(task);
+    }
+
+    return task;
+}
+
+int I_StartupWait(startuptask_t *task)
+{
+    int result;
+
+    if (task->thread != NULL)
+    {
+        Uint32 start = SDL_GetTicks();
+        Uint32 waited;
+
+        I_TraceBegin("startup wait", task->name);
+        SDL_WaitThread(task->thread, NULL);
+        I_TraceEnd("startup wait");
+
+        waited = SDL_GetTicks() - start;
+
+        if (waited > 0)
+        {
+            printf("I_StartupWait: waited %u ms for %s\n",
+                   (unsigned int) waited, task->name);
+        }
+    }
+
+    result = task->result;
+    free(task);
+
+    return result;
+}
@@ -0,0 +1,36 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Startup stages run alongside the rest of startup. A stage is
+//	started as soon as what it needs is ready, and waited for just
+//	before the first thing that needs it, so the dependencies between
+//	stages are where the start and the wait are placed. A stage must not
+//	touch the zone or the WAD, which belong to the main thread.
+//
+
+#ifndef __I_STARTUP__
+#define __I_STARTUP__
+
+typedef struct startuptask_s startuptask_t;
+
+// Runs func(data) on a thread of its own. It runs right away instead if
+// there's no thread or with -serialstartup.
+startuptask_t *I_StartupTask(const char *name, int (*func)(void *data),
+                             void *data);
+
+// Waits for a stage to finish and returns what its func returned. The
+// task is freed.
+int I_StartupWait(startuptask_t *task);
+
+#endif
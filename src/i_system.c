@@ -26,7 +26,9 @@
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <psapi.h>
 #else
+#include <sys/resource.h>
 #include <unistd.h>
 #endif
 
@@ -226,6 +228,41 @@ boolean I_ConsoleStdout(void)
 #endif
 }
 
+//
+// I_PeakMemoryUsage
+//
+// Returns the most memory the process has had resident, in bytes, or 0
+// if the system can't tell.
+//
+
+size_t I_PeakMemoryUsage(void)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                                 sizeof(counters)))
+    {
+        return 0;
+    }
+
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return (size_t) usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
 //
 // I_Init
 //
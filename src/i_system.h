@@ -36,6 +36,9 @@ byte*	I_ZoneBase (int *size);
 
 boolean I_ConsoleStdout(void);
 
+// Most memory the process has had resident, in bytes; 0 if unknown.
+size_t I_PeakMemoryUsage(void);
+
 
 // Asynchronous interrupt functions should maintain private queues
 // that are read by the synchronous functions
@@ -18,6 +18,13 @@
 
 #include "SDL.h"
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #include "i_timer.h"
 #include "m_fixed.h" // [crispy]
 #include "doomtype.h"
@@ -87,6 +94,148 @@ void I_WaitVBL(int count)
     I_Sleep((count * 1000) / 70);
 }
 
+#ifdef _WIN32
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+static HANDLE waittimer;
+static boolean waittimerinit;
+
+#endif
+
+// Sleep for a specified number of us, without rounding up to the
+// scheduler's granularity where the platform can avoid it.
+
+static void PreciseSleep(int us)
+{
+#ifdef _WIN32
+    LARGE_INTEGER due;
+
+    if (!waittimerinit)
+    {
+        // High resolution timers are Windows 10 1803 and later
+        waittimer = CreateWaitableTimerExW(NULL, NULL,
+                                           CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                           TIMER_ALL_ACCESS);
+        if (waittimer == NULL)
+        {
+            waittimer = CreateWaitableTimerW(NULL, TRUE, NULL);
+        }
+        waittimerinit = true;
+    }
+
+    if (waittimer != NULL)
+    {
+        due.QuadPart = -(LONGLONG) us * 10; // Relative, in 100ns units
+
+        if (SetWaitableTimer(waittimer, &due, 0, NULL, NULL, FALSE))
+        {
+            WaitForSingleObject(waittimer, INFINITE);
+            return;
+        }
+    }
+
+    SDL_Delay((us + 999) / 1000);
+#else
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000L;
+
+#if defined(__linux__)
+    while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) != 0);
+#else
+    while (nanosleep(&ts, &ts) != 0);
+#endif
+#endif
+}
+
+// [AP] Frames are paced against deadlines one period apart, not against
+// when the last wait ended, so that late wakeups don't add up. The
+// sleep stops short of the deadline by how late sleeps have been waking
+// up lately, and the rest is spun.
+
+#define PACE_SPIN_US 200
+#define PACE_MAX_OVERSLEEP_US 2000
+
+void I_PaceFrame(uint64_t period_us)
+{
+    static uint64_t deadline;
+    static uint64_t last_period;
+    static int64_t oversleep = 500;
+    uint64_t now;
+
+    now = I_GetTimeUS();
+
+    if (period_us != last_period || now > deadline + period_us)
+    {
+        // A new pace, or more than a frame behind: start again from now
+        last_period = period_us;
+        deadline = now + period_us;
+    }
+    else
+    {
+        deadline += period_us;
+    }
+
+    while (now < deadline)
+    {
+        int64_t remaining = deadline - now;
+
+        if (remaining > oversleep + PACE_SPIN_US)
+        {
+            int64_t request = remaining - oversleep - PACE_SPIN_US;
+            int64_t late;
+
+            PreciseSleep((int) request);
+
+            late = (int64_t) (I_GetTimeUS() - now) - request;
+
+            // Follow the scheduler slowly, a single long wakeup
+            // shouldn't make every frame spin
+            oversleep += (late - oversleep) / 8;
+
+            if (oversleep < 0)
+            {
+                oversleep = 0;
+            }
+            else if (oversleep > PACE_MAX_OVERSLEEP_US)
+            {
+                oversleep = PACE_MAX_OVERSLEEP_US;
+            }
+        }
+
+        now = I_GetTimeUS();
+    }
+}
+
+void I_WaitForTic(boolean (*wake)(int timeout_ms))
+{
+    int deadline;
+    int now;
+
+    // The first ms at which I_GetTime() goes up
+    deadline = (int) ((((int64_t) I_GetTime() + 1) * 1000 + TICRATE - 1)
+                      / TICRATE);
+
+    while ((now = I_GetTimeMS()) < deadline)
+    {
+        if (wake != NULL)
+        {
+            if (wake(deadline - now))
+            {
+                return;
+            }
+        }
+        else
+        {
+            PreciseSleep((deadline - now) * 1000);
+        }
+    }
+}
+
 
 void I_InitTimer(void)
 {
@@ -20,6 +20,7 @@
 #ifndef __I_TIMER__
 #define __I_TIMER__
 
+#include "doomtype.h"
 #include "m_fixed.h" // [crispy]
 
 #define TICRATE 35
@@ -37,6 +38,17 @@ uint64_t I_GetTimeUS(void); // [crispy]
 // Pause for a specified number of ms
 void I_Sleep(int ms);
 
+// Block until the next tic starts, using a high resolution timer where
+// there is one. If wake is given, it is called instead to block for up
+// to the ms left, and returning true ends the wait early (when a packet
+// arrives, for instance).
+void I_WaitForTic(boolean (*wake)(int timeout_ms));
+
+// [AP] Paces frames to one every period_us, sleeping while that is safe
+// and spinning the rest, for steady frame times. Falling behind by more than a frame restarts the
+// schedule from now.
+void I_PaceFrame(uint64_t period_us);
+
 // Initialize timer
 void I_InitTimer(void);
 
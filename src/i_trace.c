@@ -0,0 +1,273 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Timeline tracing.
+//
+//	Events go into a buffer and are only formatted and written out when
+//	it fills up or the game exits, so that tracing doesn't add file I/O
+//	to every slice. The write shows up in the trace itself, as "flush".
+//	Sound, prefetch and AP threads trace too, so the buffer is locked.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "i_system.h"
+#include "i_timer.h"
+#include "i_trace.h"
+#include "m_argv.h"
+#include "m_misc.h"
+
+#define MAXEVENTS 16384
+#define DETAILLEN 16
+
+typedef struct
+{
+    const char *name;
+    char detail[DETAILLEN];
+    char ph;
+    unsigned long tid;
+    uint64_t ts_us;
+    uint64_t dur_us;
+} traceevent_t;
+
+boolean tracing = false;
+
+static FILE *trace_file;
+static SDL_mutex *trace_lock;
+static traceevent_t *events;
+static int num_events;
+static boolean first_event;
+static unsigned long main_tid;
+static uint64_t frame_start_us;
+static unsigned int frame_count;
+
+static void WriteEvent(const traceevent_t *event)
+{
+    const char *p;
+
+    fprintf(trace_file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,"
+                        "\"pid\":1,\"tid\":%lu",
+            first_event ? "" : ",\n", event->name, event->ph,
+            (unsigned long long) event->ts_us, event->tid);
+    first_event = false;
+
+    if (event->ph == 'X')
+    {
+        fprintf(trace_file, ",\"dur\":%llu",
+                (unsigned long long) event->dur_us);
+    }
+    else if (event->ph == 'i')
+    {
+        fprintf(trace_file, ",\"s\":\"t\"");
+    }
+
+    if (event->detail[0] != '\0')
+    {
+        fprintf(trace_file, ",\"args\":{\"detail\":\"");
+
+        // Lump and sound names can have anything in them
+
+        for (p = event->detail; *p != '\0'; ++p)
+        {
+            fputc(*p == '"' || *p == '\\' || *p < ' ' || *p > '~' ? '?' : *p,
+                  trace_file);
+        }
+
+        fprintf(trace_file, "\"}");
+    }
+
+    fputc('}', trace_file);
+}
+
+// Called with trace_lock held.
+static void FlushEvents(void)
+{
+    traceevent_t flush;
+    int i;
+
+    flush.name = "flush";
+    flush.detail[0] = '\0';
+    flush.ph = 'X';
+    flush.tid = SDL_ThreadID();
+    flush.ts_us = I_GetTimeUS();
+
+    for (i = 0; i < num_events; ++i)
+    {
+        WriteEvent(&events[i]);
+    }
+
+    num_events = 0;
+
+    flush.dur_us = I_GetTimeUS() - flush.ts_us;
+    WriteEvent(&flush);
+}
+
+static void AddEvent(char ph, const char *name, const char *detail,
+                     uint64_t ts_us, uint64_t dur_us)
+{
+    traceevent_t *event;
+
+    SDL_LockMutex(trace_lock);
+
+    // Another thread can get here after CloseTrace
+
+    if (trace_file == NULL)
+    {
+        SDL_UnlockMutex(trace_lock);
+        return;
+    }
+
+    if (num_events == MAXEVENTS)
+    {
+        FlushEvents();
+    }
+
+    event = &events[num_events++];
+    event->name = name;
+    event->ph = ph;
+    event->tid = SDL_ThreadID();
+    event->ts_us = ts_us;
+    event->dur_us = dur_us;
+
+    if (detail != NULL)
+    {
+        M_StringCopy(event->detail, detail, sizeof(event->detail));
+    }
+    else
+    {
+        event->detail[0] = '\0';
+    }
+
+    SDL_UnlockMutex(trace_lock);
+}
+
+static void CloseTrace(void)
+{
+    if (!tracing)
+    {
+        return;
+    }
+
+    SDL_LockMutex(trace_lock);
+
+    FlushEvents();
+    fprintf(trace_file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(trace_file);
+    trace_file = NULL;
+    tracing = false;
+
+    SDL_UnlockMutex(trace_lock);
+}
+
+void I_InitTrace(void)
+{
+    int p;
+
+    //!
+    // @category obscure
+    // @arg <file>
+    //
+    // Write a timeline of frames, game tics, level loads, lump and
+    // sound loads, Archipelago updates and network packets to a file,
+    // in the Chrome trace-event format. Open it in chrome://tracing or
+    // ui.perfetto.dev to look at hitches that averages hide.
+    //
+
+    p = M_CheckParmWithArgs("-trace", 1);
+
+    if (p == 0)
+    {
+        return;
+    }
+
+    trace_file = M_fopen(myargv[p + 1], "w");
+
+    if (trace_file == NULL)
+    {
+        fprintf(stderr, "I_InitTrace: Unable to write %s\n", myargv[p + 1]);
+        return;
+    }
+
+    events = malloc(MAXEVENTS * sizeof(*events));
+    trace_lock = SDL_CreateMutex();
+
+    if (events == NULL || trace_lock == NULL)
+    {
+        I_Error("I_InitTrace: Failed to set up the event buffer");
+    }
+
+    main_tid = SDL_ThreadID();
+
+    fprintf(trace_file, "{\"traceEvents\":[\n");
+    fprintf(trace_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                        "\"tid\":%lu,\"args\":{\"name\":\"game\"}}",
+            main_tid);
+    first_event = false;
+
+    frame_start_us = I_GetTimeUS();
+    tracing = true;
+
+    I_AtExit(CloseTrace, true);
+}
+
+void I_TraceBegin(const char *name, const char *detail)
+{
+    if (!tracing)
+    {
+        return;
+    }
+
+    AddEvent('B', name, detail, I_GetTimeUS(), 0);
+}
+
+void I_TraceEnd(const char *name)
+{
+    if (!tracing)
+    {
+        return;
+    }
+
+    AddEvent('E', name, NULL, I_GetTimeUS(), 0);
+}
+
+void I_TraceInstant(const char *name, const char *detail)
+{
+    if (!tracing)
+    {
+        return;
+    }
+
+    AddEvent('i', name, detail, I_GetTimeUS(), 0);
+}
+
+void I_TraceFrame(void)
+{
+    char detail[DETAILLEN];
+    uint64_t now;
+
+    if (!tracing)
+    {
+        return;
+    }
+
+    now = I_GetTimeUS();
+    M_snprintf(detail, sizeof(detail), "%u", frame_count++);
+
+    AddEvent('X', "frame", detail, frame_start_us, now - frame_start_us);
+    frame_start_us = now;
+}
@@ -0,0 +1,41 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Timeline tracing, enabled with -trace. Writes Chrome trace-event
+//	JSON, which chrome://tracing and ui.perfetto.dev both open.
+//
+
+#ifndef __I_TRACE__
+#define __I_TRACE__
+
+#include "doomtype.h"
+
+extern boolean tracing;
+
+void I_InitTrace(void);
+
+// Open and close a slice on the calling thread. name must be a string
+// that stays around; detail, which may be NULL, is copied and shown as
+// an argument. Slices on the same thread must nest.
+// Safe to call from any thread.
+void I_TraceBegin(const char *name, const char *detail);
+void I_TraceEnd(const char *name);
+
+// A single point in time, such as a network packet.
+void I_TraceInstant(const char *name, const char *detail);
+
+// Call once at the end of each frame, to add a slice for the whole frame.
+void I_TraceFrame(void);
+
+#endif
@@ -36,6 +36,7 @@
 #include "d_loop.h"
 #include "deh_str.h"
 #include "doomtype.h"
+#include "i_capture.h"
 #include "i_input.h"
 #include "i_joystick.h"
 #include "i_system.h"
@@ -46,6 +47,7 @@
 #include "m_misc.h"
 #include "tables.h"
 #include "v_diskicon.h"
+#include "v_trans.h"
 #include "v_video.h"
 #include "w_wad.h"
 #include "z_zone.h"
@@ -78,6 +80,11 @@ static SDL_Surface *argbbuffer = NULL;
 static SDL_Texture *texture = NULL;
 static SDL_Texture *texture_upscaled = NULL;
 
+// [AP] True when the rendered area is an exact integer multiple of the
+// screen, so the upscaled texture would only be copied 1:1 to screen
+// and the frame can be drawn with one "nearest" pass instead of two.
+static boolean upscale_exact = false;
+
 #ifndef CRISPY_TRUECOLOR
 static SDL_Rect blit_rect = {
     0,
@@ -98,13 +105,20 @@ static SDL_Texture *yelpane = NULL;
 static SDL_Texture *grnpane = NULL;
 static int pane_alpha;
 static unsigned int rmask, gmask, bmask, amask; // [crispy] moved up here
-static const uint8_t blend_alpha = 0xa8;
+pixel_t blend_rgbmask, blend_amask; // [AP] for the inline blends
 extern pixel_t* colormaps; // [crispy] evil hack to get FPS dots working as in Vanilla
 #else
 static SDL_Color palette[256];
 #endif
 static boolean palette_to_set;
 
+#ifndef CRISPY_TRUECOLOR
+// [AP] palette in the texture's pixel format, for writing straight into
+// the locked streaming texture
+
+static uint32_t palette_lut[256];
+#endif
+
 // display has been set up?
 
 static boolean initialized = false;
@@ -118,6 +132,10 @@ int usemouse = 1;
 
 int png_screenshots = 1; // [crispy]
 
+// zlib level PNG screenshots are written with, 1 (fastest) to 9 (smallest).
+
+int png_compression = 6; // [AP]
+
 // SDL video driver name
 
 char *video_driver = "";
@@ -160,6 +178,12 @@ int integer_scaling = false;
 
 int vga_porch_flash = false;
 
+// [AP] With vsync and the FPS limit off, limit to just below the display's
+// refresh rate, which keeps variable refresh rate displays in range.
+
+int vrr_limit = false;
+static int refresh_rate;
+
 // Force software rendering, for systems which lack effective hardware
 // acceleration
 
@@ -199,6 +223,24 @@ static boolean display_fps_dots;
 
 static boolean noblit;
 
+#ifndef CRISPY_TRUECOLOR
+// [AP] With -blitthread and uncapped framerate, the 8-bit to 32-bit blit of
+// a frame runs on its own thread while the game renders the next one.
+// SDL's render API has to stay on the thread that made the renderer, so
+// the texture upload and present still happen here, one frame behind.
+
+static boolean blitthread_wanted;
+static SDL_Thread *blitthread;
+static SDL_sem *blitstart;
+static SDL_sem *blitdone;
+static volatile boolean blitquit;
+static boolean blitpending;
+static SDL_Surface *blitsource; // Copy of screenbuffer being converted
+static SDL_Surface *blittarget; // Swapped with argbbuffer once converted
+
+static void StopBlitThread(void);
+#endif
+
 // Callback function to invoke to determine whether to grab the 
 // mouse pointer.
 
@@ -294,6 +336,9 @@ void I_ShutdownGraphics(void)
 {
     if (initialized)
     {
+#ifndef CRISPY_TRUECOLOR
+        StopBlitThread();
+#endif
         SetShowCursor(true);
 
         SDL_QuitSubSystem(SDL_INIT_VIDEO);
@@ -708,6 +753,9 @@ static void CreateUpscaledTexture(boolean force)
 
     LimitTextureSize(&w_upscale, &h_upscale);
 
+    upscale_exact = w == w_upscale * SCREENWIDTH
+                 && h == h_upscale * SCREENHEIGHT;
+
     // Create a new texture only if the upscale factors have actually changed.
 
     if (h_upscale == h_upscale_old && w_upscale == w_upscale_old && !force)
@@ -746,15 +794,166 @@ fixed_t fractionaltic;
 //
 // I_FinishUpdate
 //
+#ifndef CRISPY_TRUECOLOR
+static int BlitThread(void *unused)
+{
+    while (true)
+    {
+        SDL_SemWait(blitstart);
+        if (blitquit)
+        {
+            break;
+        }
+        SDL_LowerBlit(blitsource, &blit_rect, blittarget, &blit_rect);
+        SDL_SemPost(blitdone);
+    }
+
+    return 0;
+}
+
+// Waits for the frame being converted, if any. After this the blit
+// surfaces can be touched again.
+static void WaitBlitThread(void)
+{
+    if (blitpending)
+    {
+        SDL_SemWait(blitdone);
+        blitpending = false;
+    }
+}
+
+static void CreateBlitSurfaces(void)
+{
+    if (blitsource != NULL)
+    {
+        SDL_FreeSurface(blitsource);
+        SDL_FreeSurface(blittarget);
+    }
+
+    blitsource = SDL_CreateRGBSurface(0, SCREENWIDTH, SCREENHEIGHT, 8,
+                                      0, 0, 0, 0);
+    SDL_SetPaletteColors(blitsource->format->palette, palette, 0, 256);
+    blittarget = SDL_CreateRGBSurface(0, SCREENWIDTH, SCREENHEIGHT,
+                                      argbbuffer->format->BitsPerPixel,
+                                      argbbuffer->format->Rmask,
+                                      argbbuffer->format->Gmask,
+                                      argbbuffer->format->Bmask,
+                                      argbbuffer->format->Amask);
+    SDL_FillRect(blittarget, NULL, 0);
+}
+
+static void StartBlitThread(void)
+{
+    if (!blitthread_wanted || blitthread != NULL)
+    {
+        return;
+    }
+
+    CreateBlitSurfaces();
+    blitstart = SDL_CreateSemaphore(0);
+    blitdone = SDL_CreateSemaphore(0);
+    blitthread = SDL_CreateThread(BlitThread, "BlitThread", NULL);
+
+    if (blitthread == NULL)
+    {
+        fprintf(stderr, "StartBlitThread: %s\n", SDL_GetError());
+    }
+}
+
+static void StopBlitThread(void)
+{
+    if (blitthread == NULL)
+    {
+        return;
+    }
+
+    WaitBlitThread();
+    blitquit = true;
+    SDL_SemPost(blitstart);
+    SDL_WaitThread(blitthread, NULL);
+    blitthread = NULL;
+}
+
+// [AP] Expands the paletted screen through palette_lut straight into the
+// streaming texture's memory, instead of blitting to argbbuffer and then
+// copying that into the texture. Returns false if the texture can't be
+// locked, and the caller takes the copying path this frame.
+static boolean UploadPalettedFrame(void)
+{
+    void *pixels;
+    int pitch;
+    int y;
+
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch) < 0)
+    {
+        return false;
+    }
+
+    for (y = 0; y < SCREENHEIGHT; y++)
+    {
+        const byte *src = (const byte *) screenbuffer->pixels
+                        + y * screenbuffer->pitch;
+        uint32_t *dest = (uint32_t *) ((byte *) pixels + y * pitch);
+        int x = 0;
+
+        for (; x + 4 <= SCREENWIDTH; x += 4)
+        {
+            dest[x] = palette_lut[src[x]];
+            dest[x + 1] = palette_lut[src[x + 1]];
+            dest[x + 2] = palette_lut[src[x + 2]];
+            dest[x + 3] = palette_lut[src[x + 3]];
+        }
+        for (; x < SCREENWIDTH; x++)
+        {
+            dest[x] = palette_lut[src[x]];
+        }
+    }
+
+    SDL_UnlockTexture(texture);
+    return true;
+}
+
+// Hands the finished frame to the blit thread and takes back the one
+// before it, already converted, in argbbuffer.
+static void QueueBlit(void)
+{
+    SDL_Surface *converted;
+
+    WaitBlitThread();
+
+    converted = blittarget;
+    blittarget = argbbuffer;
+    argbbuffer = converted;
+
+    memcpy(blitsource->pixels, screenbuffer->pixels,
+           (size_t) screenbuffer->pitch * screenbuffer->h);
+
+    blitpending = true;
+    SDL_SemPost(blitstart);
+}
+#endif
+
 void I_FinishUpdate (void)
 {
     static int lasttic;
     int tics;
     int i;
+    boolean uploaded = false;
 
     if (!initialized)
         return;
 
+    // [AP] Frames are captured even with -noblit, before the disk icon
+    // and the FPS dots are drawn on them
+    if (capturing)
+    {
+#ifndef CRISPY_TRUECOLOR
+        I_CaptureFrame(screenbuffer, palette);
+#else
+        I_CaptureFrame(argbbuffer, NULL);
+#endif
+    }
+
     if (noblit)
         return;
 
@@ -848,6 +1047,18 @@ void I_FinishUpdate (void)
         SDL_SetPaletteColors(screenbuffer->format->palette, palette, 0, 256);
         palette_to_set = false;
 
+        for (i = 0; i < 256; i++)
+        {
+            palette_lut[i] = SDL_MapRGB(argbbuffer->format, palette[i].r,
+                                        palette[i].g, palette[i].b);
+        }
+
+        if (blitsource != NULL)
+        {
+            WaitBlitThread();
+            SDL_SetPaletteColors(blitsource->format->palette, palette, 0, 256);
+        }
+
         if (vga_porch_flash)
         {
             // "flash" the pillars/letterboxes with palette changes, emulating
@@ -860,18 +1071,35 @@ void I_FinishUpdate (void)
     // Blit from the paletted 8-bit screen buffer to the intermediate
     // 32-bit RGBA buffer that we can load into the texture.
 
-    SDL_LowerBlit(screenbuffer, &blit_rect, argbbuffer, &blit_rect);
+    if (blitthread != NULL && crispy->uncapped && !singletics)
+    {
+        QueueBlit();
+    }
+    else
+    {
+        WaitBlitThread();
+        uploaded = argbbuffer->format->BytesPerPixel == 4
+                && UploadPalettedFrame();
+
+        if (!uploaded)
+        {
+            SDL_LowerBlit(screenbuffer, &blit_rect, argbbuffer, &blit_rect);
+        }
+    }
 #endif
 
     // Update the intermediate texture with the contents of the RGBA buffer.
 
-    SDL_UpdateTexture(texture, NULL, argbbuffer->pixels, argbbuffer->pitch);
+    if (!uploaded)
+    {
+        SDL_UpdateTexture(texture, NULL, argbbuffer->pixels, argbbuffer->pitch);
+    }
 
     // Make sure the pillarboxes are kept clear each frame.
 
     SDL_RenderClear(renderer);
 
-    if (crispy->smoothscaling && !force_software_renderer)
+    if (crispy->smoothscaling && !force_software_renderer && !upscale_exact)
     {
     // Render this intermediate texture into the upscaled texture
     // using "nearest" integer scaling.
@@ -904,31 +1132,18 @@ void I_FinishUpdate (void)
 
     if (crispy->uncapped && !singletics)
     {
-        // Limit framerate
-        if (crispy->fpslimit >= TICRATE)
-        {
-            uint64_t target_time = 1000000ull / crispy->fpslimit;
-            static uint64_t start_time;
+        int fpslimit = crispy->fpslimit;
 
-            while (1)
-            {
-                uint64_t current_time = I_GetTimeUS();
-                uint64_t elapsed_time = current_time - start_time;
-                uint64_t remaining_time = 0;
-
-                if (elapsed_time >= target_time)
-                {
-                    start_time = current_time;
-                    break;
-                }
-
-                remaining_time = target_time - elapsed_time;
+        if (fpslimit < TICRATE && vrr_limit && !crispy->vsync
+         && refresh_rate > TICRATE + 3)
+        {
+            fpslimit = refresh_rate - 3;
+        }
 
-                if (remaining_time > 1000)
-                {
-                    I_Sleep((remaining_time - 1000) / 1000);
-                }
-            }
+        // Limit framerate
+        if (fpslimit >= TICRATE)
+        {
+            I_PaceFrame(1000000ull / fpslimit);
         }
 
         // [AM] Figure out how far into the current tic we're in as a fixed_t.
@@ -1140,6 +1355,18 @@ void I_GraphicsCheckCommandLine(void)
 
     noblit = M_CheckParm ("-noblit");
 
+#ifndef CRISPY_TRUECOLOR
+    //!
+    // @category video
+    //
+    // With uncapped framerate, convert each frame for display on a
+    // separate thread while the next one renders. Adds a frame of
+    // latency.
+    //
+
+    blitthread_wanted = M_ParmExists("-blitthread");
+#endif
+
     //!
     // @category video 
     //
@@ -1459,6 +1686,8 @@ static void SetVideoMode(void)
         video_display, SDL_GetError());
     }
 
+    refresh_rate = mode.refresh_rate; // [AP]
+
     // Turn on vsync if we aren't in a -timedemo
     if (!singletics && mode.refresh_rate > 0)
     {
@@ -1565,6 +1794,9 @@ static void SetVideoMode(void)
                                           SCREENWIDTH, SCREENHEIGHT, bpp,
                                           rmask, gmask, bmask, amask);
 #ifdef CRISPY_TRUECOLOR
+        blend_rgbmask = rmask | gmask | bmask;
+        blend_amask = amask;
+
         SDL_FillRect(argbbuffer, NULL, I_MapRGB(0xff, 0x0, 0x0));
         redpane = SDL_CreateTextureFromSurface(renderer, argbbuffer);
         SDL_SetTextureBlendMode(redpane, SDL_BLENDMODE_BLEND);
@@ -1698,6 +1930,7 @@ void I_InitGraphics(void)
     }
 
     SetSDLVideoDriver();
+    I_SetMouseHints(); // [AP]
 
     if (SDL_Init(SDL_INIT_VIDEO) < 0) 
     {
@@ -1782,6 +2015,12 @@ void I_InitGraphics(void)
   
     while (SDL_PollEvent(&dummy));
 
+#ifndef CRISPY_TRUECOLOR
+    StartBlitThread();
+#endif
+
+    I_InitCapture(); // [AP]
+
     initialized = true;
 
     // Call I_ShutdownGraphics on quit
@@ -1810,6 +2049,7 @@ void I_ReInitGraphics (int reinit)
 		V_Init();
 
 #ifndef CRISPY_TRUECOLOR
+		WaitBlitThread();
 		SDL_FreeSurface(screenbuffer);
 		screenbuffer = SDL_CreateRGBSurface(0,
 				                    SCREENWIDTH, SCREENHEIGHT, 8,
@@ -1823,8 +2063,14 @@ void I_ReInitGraphics (int reinit)
 		                                  SCREENWIDTH, SCREENHEIGHT, 32,
 		                                  rmask, gmask, bmask, amask);
 #ifndef CRISPY_TRUECOLOR
+		if (blitthread != NULL)
+		{
+			CreateBlitSurfaces();
+		}
+
 		// [crispy] re-set the framebuffer pointer
 		I_VideoBuffer = screenbuffer->pixels;
+		palette_to_set = true; // [AP] rebuild palette_lut
 #else
 		I_VideoBuffer = argbbuffer->pixels;
 #endif
@@ -1973,7 +2219,7 @@ void I_RenderReadPixels(byte **data, int *w, int *h, int *p)
 	// already contains the scene that we actually want to capture.
 	if (crispy->post_rendering_hook)
 	{
-		SDL_RenderCopy(renderer, crispy->smoothscaling ? texture_upscaled : texture, NULL, NULL);
+		SDL_RenderCopy(renderer, crispy->smoothscaling && !upscale_exact ? texture_upscaled : texture, NULL, NULL);
 		SDL_RenderPresent(renderer);
 	}
 
@@ -1999,6 +2245,7 @@ void I_BindVideoVariables(void)
     M_BindIntVariable("aspect_ratio_correct",      &aspect_ratio_correct);
     M_BindIntVariable("integer_scaling",           &integer_scaling);
     M_BindIntVariable("vga_porch_flash",           &vga_porch_flash);
+    M_BindIntVariable("vrr_limit",                 &vrr_limit);
     M_BindIntVariable("startup_delay",             &startup_delay);
     M_BindIntVariable("fullscreen_width",          &fullscreen_width);
     M_BindIntVariable("fullscreen_height",         &fullscreen_height);
@@ -2011,46 +2258,26 @@ void I_BindVideoVariables(void)
     M_BindStringVariable("window_position",        &window_position);
     M_BindIntVariable("usegamma",                  &usegamma);
     M_BindIntVariable("png_screenshots",           &png_screenshots);
+    M_BindIntVariable("png_compression",           &png_compression);
 }
 
 #ifdef CRISPY_TRUECOLOR
 const pixel_t I_BlendAdd (const pixel_t bg, const pixel_t fg)
 {
-	uint32_t r, g, b;
-
-	if ((r = (fg & rmask) + (bg & rmask)) > rmask) r = rmask;
-	if ((g = (fg & gmask) + (bg & gmask)) > gmask) g = gmask;
-	if ((b = (fg & bmask) + (bg & bmask)) > bmask) b = bmask;
-
-	return amask | r | g | b;
+	return V_BlendAdd(bg, fg);
 }
 
 // [crispy] http://stereopsis.com/doubleblend.html
 const pixel_t I_BlendDark (const pixel_t bg, const int d)
 {
-	const uint32_t ag = (bg & 0xff00ff00) >> 8;
-	const uint32_t rb =  bg & 0x00ff00ff;
-
-	uint32_t sag = d * ag;
-	uint32_t srb = d * rb;
-
-	sag = sag & 0xff00ff00;
-	srb = (srb >> 8) & 0x00ff00ff;
-
-	return amask | sag | srb;
+	return V_BlendDark(bg, d);
 }
 
 const pixel_t I_BlendOver (const pixel_t bg, const pixel_t fg)
 {
-	const uint32_t r = ((blend_alpha * (fg & rmask) + (0xff - blend_alpha) * (bg & rmask)) >> 8) & rmask;
-	const uint32_t g = ((blend_alpha * (fg & gmask) + (0xff - blend_alpha) * (bg & gmask)) >> 8) & gmask;
-	const uint32_t b = ((blend_alpha * (fg & bmask) + (0xff - blend_alpha) * (bg & bmask)) >> 8) & bmask;
-
-	return amask | r | g | b;
+	return V_BlendOver(bg, fg);
 }
 
-const pixel_t (*blendfunc) (const pixel_t fg, const pixel_t bg) = I_BlendOver;
-
 const pixel_t I_MapRGB (const uint8_t r, const uint8_t g, const uint8_t b)
 {
 /*
@@ -111,9 +111,11 @@ extern int fullscreen;
 extern int aspect_ratio_correct;
 extern int integer_scaling;
 extern int vga_porch_flash;
+extern int vrr_limit;
 extern int force_software_renderer;
 
 extern int png_screenshots;
+extern int png_compression;
 
 extern char *window_position;
 void I_GetWindowPosition(int *x, int *y, int w, int h);
@@ -1325,36 +1325,24 @@ static void I_WIN_ResumeSong(void)
     }
 }
 
-static boolean ConvertMus(byte *musdata, int len, const char *filename)
-{
-    MEMFILE *instream;
-    MEMFILE *outstream;
-    void *outbuf;
-    size_t outbuf_len;
-    int result;
-
-    instream = mem_fopen_read(musdata, len);
-    outstream = mem_fopen_write();
+// [AP] Convert a MUS lump and parse the result, without a temp file.
 
-    result = mus2mid(instream, outstream);
+static midi_file_t *LoadMus(byte *musdata, int len)
+{
+    const void *mid;
+    size_t mid_len;
 
-    if (result == 0)
+    if (!mus2mid_cached(musdata, len, &mid, &mid_len))
     {
-        mem_get_buf(outstream, &outbuf, &outbuf_len);
-
-        M_WriteFile(filename, outbuf, outbuf_len);
+        return NULL;
     }
 
-    mem_fclose(instream);
-    mem_fclose(outstream);
-
-    return result;
+    return MIDI_LoadFromMemory(mid, mid_len);
 }
 
 static void *I_WIN_RegisterSong(void *data, int len)
 {
     unsigned int i;
-    char *filename;
     midi_file_t *file;
 
     MIDIPROPTIMEDIV prop_timediv;
@@ -1364,24 +1352,17 @@ static void *I_WIN_RegisterSong(void *data, int len)
     // MUS files begin with "MUS"
     // Reject anything which doesnt have this signature
 
-    filename = M_TempFile("doom.mid");
-
     if (IsMid(data, len))
     {
-        M_WriteFile(filename, data, len);
+        file = MIDI_LoadFromMemory(data, len);
     }
     else
     {
         // Assume a MUS file and try to convert
 
-        ConvertMus(data, len, filename);
+        file = LoadMus(data, len);
     }
 
-    file = MIDI_LoadFile(filename);
-
-    M_remove(filename);
-    free(filename);
-
     if (file == NULL)
     {
         fprintf(stderr, "I_WIN_RegisterSong: Failed to load MID.\n");
@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
@@ -100,6 +101,18 @@ typedef struct
     default_t *defaults;
     int numdefaults;
     const char *filename;
+
+    // [AP] Name hash, built on the first search. Entries are indexes
+    // into defaults, -1 ending a chain.
+    int *hash;
+    int *hashnext;
+    int hashsize;
+
+    // [AP] What was last written, and where, so that an unchanged
+    // config isn't written again.
+    char *saved;
+    size_t saved_len;
+    char *saved_filename;
 } default_collection_t;
 
 #define CONFIG_VARIABLE_GENERIC(name, type) \
@@ -808,6 +821,15 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_INT(vga_porch_flash),
 
+    //!
+    // If non-zero, with uncapped framerate and with both vsync and the
+    // framerate limit off, the framerate is limited to just below the
+    // display's refresh rate. This keeps a variable refresh rate display
+    // in its range without the latency of vsync.
+    //
+
+    CONFIG_VARIABLE_INT(vrr_limit),
+
     //!
     // Window width when running in windowed mode.
     //
@@ -894,6 +916,14 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_INT(png_screenshots),
 
+    //!
+    // zlib compression level of PNG screenshots, from 1 (fastest) to 9
+    // (smallest files). Screenshots are encoded in the background either
+    // way.
+    //
+
+    CONFIG_VARIABLE_INT(png_compression),
+
     //!
     // Vertical mouse acceleration factor.  When the speed of mouse movement
     // exceeds the threshold value (mouse_threshold), the speed is
@@ -910,6 +940,13 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_INT(mouse_threshold_y),
 
+    //!
+    // If non-zero, SDL is asked for raw relative mouse motion, without
+    // any system acceleration or speed scaling.
+    //
+
+    CONFIG_VARIABLE_INT(raw_mouse),
+
     //!
     // Sound output sample rate, in Hz.  Typical values to use are
     // 11025, 22050, 44100 and 48000.
@@ -1010,6 +1047,13 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_STRING(music_pack_path),
 
+    //!
+    // Length in milliseconds of the fade between two music pack
+    // tracks. Zero switches straight away.
+    //
+
+    CONFIG_VARIABLE_INT(music_pack_fade_ms),
+
 #ifdef HAVE_FLUIDSYNTH
     //!
     // If 1, activate the FluidSynth chorus effects module. If 0, no chorus
@@ -1095,6 +1139,13 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_FLOAT(fsynth_reverb_width),
 
+    //!
+    // Milliseconds of FluidSynth output rendered ahead of the mixer.
+    // Raise if music breaks up with heavy soundfonts. Default is 100.
+    //
+
+    CONFIG_VARIABLE_INT(fsynth_buffer_ms),
+
     //!
     // Full path to a soundfont file to use with FluidSynth MIDI playback.
     //
@@ -1169,6 +1220,26 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_INT(vanilla_savegame_limit),
 
+    //!
+    // @game doom
+    //
+    // If non-zero, savegames are compressed when written, if the game
+    // was built with zlib. Uncompressed savegames load either way.
+    //
+
+    CONFIG_VARIABLE_INT(compress_savegames),
+
+    //!
+    // @game doom
+    //
+    // If non-zero and the framerate is uncapped, the mouse is read every
+    // frame and the view turns with it at once, before the ticcmd that
+    // carries the turn runs. Mouse acceleration then applies to each
+    // frame's motion.
+    //
+
+    CONFIG_VARIABLE_INT(fast_mouse),
+
     //!
     // @game doom strife
     //
@@ -2497,13 +2568,66 @@ static default_collection_t extra_defaults =
     NULL,
 };
 
+static unsigned int HashDefaultName(const char *name)
+{
+    unsigned int result = 5381;
+
+    while (*name != '\0')
+    {
+        result = result * 33 + (unsigned char) *name;
+        ++name;
+    }
+
+    return result;
+}
+
+// [AP] Chains keep list order, so a name listed twice still finds the
+// first entry.
+
+static void HashCollection(default_collection_t *collection)
+{
+    int i, h;
+
+    collection->hashsize = 1;
+
+    while (collection->hashsize < collection->numdefaults * 2)
+    {
+        collection->hashsize <<= 1;
+    }
+
+    collection->hash = malloc(collection->hashsize
+                              * sizeof(*collection->hash));
+    collection->hashnext = malloc(collection->numdefaults
+                                  * sizeof(*collection->hashnext));
+
+    for (i = 0; i < collection->hashsize; ++i)
+    {
+        collection->hash[i] = -1;
+    }
+
+    for (i = collection->numdefaults - 1; i >= 0; --i)
+    {
+        h = HashDefaultName(collection->defaults[i].name)
+          & (collection->hashsize - 1);
+        collection->hashnext[i] = collection->hash[h];
+        collection->hash[h] = i;
+    }
+}
+
 // Search a collection for a variable
 
 static default_t *SearchCollection(default_collection_t *collection, const char *name)
 {
     int i;
 
-    for (i=0; i<collection->numdefaults; ++i) 
+    if (collection->hash == NULL)
+    {
+        HashCollection(collection);
+    }
+
+    for (i = collection->hash[HashDefaultName(name)
+                              & (collection->hashsize - 1)];
+         i >= 0; i = collection->hashnext[i])
     {
         if (!strcmp(name, collection->defaults[i].name))
         {
@@ -2545,22 +2669,62 @@ static const int scantokey[128] =
 };
 
 
+// [AP] The config is put together in memory first, so it can be
+// compared with what was last written.
+
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t size;
+} configtext_t;
+
+static void AppendConfig(configtext_t *text, const char *fmt, ...)
+{
+    va_list args;
+    int needed;
+
+    va_start(args, fmt);
+    needed = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    if (needed < 0)
+    {
+        return;
+    }
+
+    if (text->len + needed + 1 > text->size)
+    {
+        while (text->len + needed + 1 > text->size)
+        {
+            text->size = text->size ? text->size * 2 : 16384;
+        }
+
+        text->data = I_Realloc(text->data, text->size);
+    }
+
+    va_start(args, fmt);
+    M_vsnprintf(text->data + text->len, text->size - text->len, fmt, args);
+    va_end(args);
+
+    text->len += needed;
+}
+
+// [AP] Skipped when nothing changed since it was last written here;
+// otherwise written to a temporary file that is then renamed over the
+// config, so a crash mid-write can't leave it cut short.
+
 static void SaveDefaultCollection(default_collection_t *collection)
 {
     default_t *defaults;
+    configtext_t text = {NULL, 0, 0};
+    char *temp_path;
     int i, v;
-    FILE *f;
-	
-    f = M_fopen(collection->filename, "w");
-    if (!f)
-	return; // can't write the file, but don't complain
 
     defaults = collection->defaults;
 		
     for (i=0 ; i<collection->numdefaults ; i++)
     {
-        int chars_written;
-
         // Ignore unbound variables
 
         if (!defaults[i].bound)
@@ -2570,10 +2734,7 @@ static void SaveDefaultCollection(default_collection_t *collection)
 
         // Print the name and line up all values at 30 characters
 
-        chars_written = fprintf(f, "%s ", defaults[i].name);
-
-        for (; chars_written < 30; ++chars_written)
-            fprintf(f, " ");
+        AppendConfig(&text, "%-29s ", defaults[i].name);
 
         // Print the value
 
@@ -2622,30 +2783,59 @@ static void SaveDefaultCollection(default_collection_t *collection)
                     }
                 }
 
-	        fprintf(f, "%i", v);
+	        AppendConfig(&text, "%i", v);
                 break;
 
             case DEFAULT_INT:
-	        fprintf(f, "%i", *defaults[i].location.i);
+	        AppendConfig(&text, "%i", *defaults[i].location.i);
                 break;
 
             case DEFAULT_INT_HEX:
-	        fprintf(f, "0x%x", *defaults[i].location.i);
+	        AppendConfig(&text, "0x%x", *defaults[i].location.i);
                 break;
 
             case DEFAULT_FLOAT:
-                fprintf(f, "%f", *defaults[i].location.f);
+                AppendConfig(&text, "%f", *defaults[i].location.f);
                 break;
 
             case DEFAULT_STRING:
-	        fprintf(f,"\"%s\"", *defaults[i].location.s);
+	        AppendConfig(&text, "\"%s\"", *defaults[i].location.s);
                 break;
         }
 
-        fprintf(f, "\n");
+        AppendConfig(&text, "\n");
     }
 
-    fclose (f);
+    if (collection->saved != NULL
+     && collection->saved_len == text.len
+     && !memcmp(collection->saved, text.data, text.len)
+     && !strcmp(collection->saved_filename, collection->filename)
+     && M_FileExists(collection->filename))
+    {
+        free(text.data);
+        return;
+    }
+
+    temp_path = M_StringJoin(collection->filename, ".tmp", NULL);
+
+    if (!M_WriteFile(temp_path, text.data, text.len))
+    {
+        // can't write the file, but don't complain
+        M_remove(temp_path);
+        free(temp_path);
+        free(text.data);
+        return;
+    }
+
+    M_remove(collection->filename);
+    M_rename(temp_path, collection->filename);
+    free(temp_path);
+
+    free(collection->saved);
+    free(collection->saved_filename);
+    collection->saved = text.data;
+    collection->saved_len = text.len;
+    collection->saved_filename = M_StringDuplicate(collection->filename);
 }
 
 // Parses integer values in the configuration file
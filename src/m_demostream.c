@@ -0,0 +1,270 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Streamed demos.
+//
+//	A stream is DEMOSTREAM_MAGIC, then blocks. Each block has a header
+//	of three 32-bit little-endian values: its decoded length, its
+//	stored length and the number of ticcmds in it. The stored bytes
+//	follow: a zlib stream, or the demo bytes as they are if the stored
+//	length has STOREDRAW set, which is how a block is written without
+//	zlib or when deflating wouldn't make it smaller.
+//
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include "m_demostream.h"
+#include "m_misc.h"
+
+#define DEMOSTREAM_MAGIC "APDEMOZ1"
+#define MAGICLEN (sizeof(DEMOSTREAM_MAGIC) - 1)
+#define BLOCKHEADER 12
+#define STOREDRAW 0x80000000u
+
+struct demowriter_s
+{
+    FILE *file;
+    byte *buf;
+    size_t buf_len;
+};
+
+static void WriteLong(byte *p, unsigned int value)
+{
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+}
+
+static unsigned int ReadLong(const byte *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+demowriter_t *M_DemoWriterOpen(const char *filename)
+{
+    demowriter_t *writer;
+    FILE *file;
+
+    file = M_fopen(filename, "wb");
+
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    if (fwrite(DEMOSTREAM_MAGIC, 1, MAGICLEN, file) != MAGICLEN)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    writer = calloc(1, sizeof(*writer));
+    writer->file = file;
+
+    return writer;
+}
+
+// Makes sure the writer's buffer holds a header and length more bytes.
+
+static boolean ReserveBuffer(demowriter_t *writer, size_t length)
+{
+    byte *buf;
+
+    if (writer->buf_len >= BLOCKHEADER + length)
+    {
+        return true;
+    }
+
+    buf = realloc(writer->buf, BLOCKHEADER + length);
+
+    if (buf == NULL)
+    {
+        return false;
+    }
+
+    writer->buf = buf;
+    writer->buf_len = BLOCKHEADER + length;
+
+    return true;
+}
+
+boolean M_DemoWriterBlock(demowriter_t *writer, const byte *data,
+                          size_t length, int ticcmds)
+{
+    unsigned int stored = STOREDRAW | (unsigned int) length;
+    size_t stored_len = length;
+
+#ifdef HAVE_LIBZ
+    {
+        uLongf deflated_len = compressBound(length);
+
+        if (!ReserveBuffer(writer, deflated_len))
+        {
+            return false;
+        }
+
+        if (compress2(writer->buf + BLOCKHEADER, &deflated_len, data, length,
+                      Z_BEST_SPEED) == Z_OK && deflated_len < length)
+        {
+            stored = (unsigned int) deflated_len;
+            stored_len = deflated_len;
+        }
+    }
+#endif
+
+    if (stored & STOREDRAW)
+    {
+        if (!ReserveBuffer(writer, length))
+        {
+            return false;
+        }
+
+        memcpy(writer->buf + BLOCKHEADER, data, length);
+    }
+
+    WriteLong(writer->buf, (unsigned int) length);
+    WriteLong(writer->buf + 4, stored);
+    WriteLong(writer->buf + 8, (unsigned int) ticcmds);
+
+    // Flushed so that a crash keeps every block written so far
+
+    return fwrite(writer->buf, 1, BLOCKHEADER + stored_len, writer->file)
+               == BLOCKHEADER + stored_len
+        && fflush(writer->file) == 0;
+}
+
+boolean M_DemoWriterClose(demowriter_t *writer)
+{
+    boolean result = fclose(writer->file) == 0;
+
+    free(writer->buf);
+    free(writer);
+
+    return result;
+}
+
+boolean M_IsDemoStream(const byte *data, size_t length)
+{
+    return length >= MAGICLEN && memcmp(data, DEMOSTREAM_MAGIC, MAGICLEN) == 0;
+}
+
+void M_DemoReaderInit(demoreader_t *reader, const byte *data, size_t length)
+{
+    reader->data = data;
+    reader->length = length;
+    reader->pos = M_IsDemoStream(data, length) ? MAGICLEN : length;
+}
+
+// The stored length of the block at pos, or 0 if it doesn't fit.
+
+static size_t StoredLength(const byte *data, size_t length, size_t pos)
+{
+    size_t stored_len;
+
+    if (length - pos < BLOCKHEADER)
+    {
+        return 0;
+    }
+
+    stored_len = ReadLong(data + pos + 4) & ~STOREDRAW;
+
+    if (length - pos - BLOCKHEADER < stored_len)
+    {
+        return 0;
+    }
+
+    return stored_len;
+}
+
+int M_DemoStreamTiccmds(const byte *data, size_t length)
+{
+    demoreader_t reader;
+    size_t stored_len;
+    int ticcmds = 0;
+
+    M_DemoReaderInit(&reader, data, length);
+
+    while (reader.pos < length
+        && (stored_len = StoredLength(data, length, reader.pos)) > 0)
+    {
+        ticcmds += ReadLong(data + reader.pos + 8);
+        reader.pos += BLOCKHEADER + stored_len;
+    }
+
+    return ticcmds;
+}
+
+size_t M_DemoReaderNextSize(demoreader_t *reader)
+{
+    if (reader->pos >= reader->length
+     || StoredLength(reader->data, reader->length, reader->pos) == 0)
+    {
+        return 0;
+    }
+
+    return ReadLong(reader->data + reader->pos);
+}
+
+boolean M_DemoReaderNext(demoreader_t *reader, byte *buf)
+{
+    const byte *block;
+    size_t length, stored_len;
+    unsigned int stored;
+
+    length = M_DemoReaderNextSize(reader);
+
+    if (length == 0)
+    {
+        return false;
+    }
+
+    block = reader->data + reader->pos;
+    stored = ReadLong(block + 4);
+    stored_len = stored & ~STOREDRAW;
+    reader->pos += BLOCKHEADER + stored_len;
+
+    if (stored & STOREDRAW)
+    {
+        if (stored_len != length)
+        {
+            return false;
+        }
+
+        memcpy(buf, block + BLOCKHEADER, length);
+        return true;
+    }
+
+#ifdef HAVE_LIBZ
+    {
+        uLongf inflated_len = length;
+
+        return uncompress(buf, &inflated_len, block + BLOCKHEADER,
+                          stored_len) == Z_OK
+            && inflated_len == length;
+    }
+#else
+    fprintf(stderr, "M_DemoReaderNext: Built without zlib, "
+                    "can't read a compressed demo\n");
+    return false;
+#endif
+}
@@ -0,0 +1,61 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Streamed demos, for -streamdemo. The demo is written out a block at
+//	a time while it records, each block deflated if zlib is there, so a
+//	crash only loses the last block, and read back a block at a time.
+//
+
+#ifndef __M_DEMOSTREAM__
+#define __M_DEMOSTREAM__
+
+#include "doomtype.h"
+
+typedef struct demowriter_s demowriter_t;
+
+typedef struct
+{
+    const byte *data;
+    size_t length;
+    size_t pos;
+} demoreader_t;
+
+// Creates the file and writes the stream header. NULL if it can't.
+demowriter_t *M_DemoWriterOpen(const char *filename);
+
+// Appends a block holding length bytes of demo with ticcmds ticcmds in
+// them, and flushes the file.
+boolean M_DemoWriterBlock(demowriter_t *writer, const byte *data,
+                          size_t length, int ticcmds);
+
+boolean M_DemoWriterClose(demowriter_t *writer);
+
+// True if a demo lump is a stream rather than a plain demo.
+boolean M_IsDemoStream(const byte *data, size_t length);
+
+// Adds up the ticcmds of all the blocks, without decoding them.
+int M_DemoStreamTiccmds(const byte *data, size_t length);
+
+void M_DemoReaderInit(demoreader_t *reader, const byte *data,
+                      size_t length);
+
+// The decoded size of the next block, or 0 at the end of the stream or
+// at a block cut short.
+size_t M_DemoReaderNextSize(demoreader_t *reader);
+
+// Decodes the next block into buf, which must have room for
+// M_DemoReaderNextSize bytes. False at the end or on a damaged block.
+boolean M_DemoReaderNext(demoreader_t *reader, byte *buf);
+
+#endif
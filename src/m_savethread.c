@@ -0,0 +1,431 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Background savegame writes.
+//
+//	One savegame is in flight at a time. The thread only touches the
+//	job's malloc'd buffer and paths and the filesystem; the outcome is
+//	picked up by the game thread, which does any reporting.
+//
+//	A compressed savegame is SAVEGAME_ZMAGIC, the uncompressed length
+//	as 32-bit little endian, then a zlib stream. Nothing else starts
+//	with the magic, as an uncompressed savegame starts with its
+//	description.
+//
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include "SDL.h"
+
+#include "i_system.h"
+#include "m_misc.h"
+#include "m_savethread.h"
+#include "z_zone.h"
+
+#define SAVEGAME_ZMAGIC "APSAVEZ1"
+#define SAVEGAME_ZMAGICLEN 8
+#define SAVEGAME_ZHEADER (SAVEGAME_ZMAGICLEN + 4)
+#define SAVEGAME_HEADREAD 4096 // Compressed bytes read for M_ReadSaveGameHead
+
+int compress_savegames = 1;
+
+static boolean saveinit;
+static SDL_Thread *savethread;
+static SDL_mutex *savelock;
+static SDL_cond *savecond;
+static boolean savequit;
+
+// Behind savelock
+static savethread_status_t savestatus = SAVETHREAD_IDLE;
+static byte *savedata;
+static size_t savelength;
+static boolean savecompress;
+static char *savetemppath, *savepath, *saverecoverypath;
+
+#ifdef HAVE_LIBZ
+
+// Returns the compressed savegame in a new malloc'd buffer, or NULL
+static byte *CompressSaveGame(const byte *data, size_t length,
+                              size_t *result_length)
+{
+    z_stream zstream;
+    byte *result;
+    uLong bound;
+
+    memset(&zstream, 0, sizeof(zstream));
+
+    // Savegames are mostly zeros and small numbers; the fastest level
+    // already gets most of the way there
+    if (deflateInit(&zstream, Z_BEST_SPEED) != Z_OK)
+    {
+        return NULL;
+    }
+
+    bound = deflateBound(&zstream, length);
+    result = malloc(SAVEGAME_ZHEADER + bound);
+
+    if (result != NULL)
+    {
+        memcpy(result, SAVEGAME_ZMAGIC, SAVEGAME_ZMAGICLEN);
+        result[SAVEGAME_ZMAGICLEN] = length & 0xff;
+        result[SAVEGAME_ZMAGICLEN + 1] = (length >> 8) & 0xff;
+        result[SAVEGAME_ZMAGICLEN + 2] = (length >> 16) & 0xff;
+        result[SAVEGAME_ZMAGICLEN + 3] = (length >> 24) & 0xff;
+
+        zstream.next_in = (Bytef *) data;
+        zstream.avail_in = length;
+        zstream.next_out = result + SAVEGAME_ZHEADER;
+        zstream.avail_out = bound;
+
+        if (deflate(&zstream, Z_FINISH) == Z_STREAM_END)
+        {
+            *result_length = SAVEGAME_ZHEADER + zstream.total_out;
+        }
+        else
+        {
+            free(result);
+            result = NULL;
+        }
+    }
+
+    deflateEnd(&zstream);
+
+    return result;
+}
+
+#endif
+
+static savethread_status_t WriteSaveGame(void)
+{
+#ifdef HAVE_LIBZ
+    if (savecompress)
+    {
+        byte *compressed;
+        size_t length;
+
+        compressed = CompressSaveGame(savedata, savelength, &length);
+
+        // Otherwise it's written as is
+        if (compressed != NULL)
+        {
+            free(savedata);
+            savedata = compressed;
+            savelength = length;
+        }
+    }
+#endif
+
+    if (M_WriteFile(savetemppath, savedata, savelength))
+    {
+        // Overwrite the old savegame only now it's fully written
+        M_remove(savepath);
+        M_rename(savetemppath, savepath);
+
+        return SAVETHREAD_DONE;
+    }
+
+    if (saverecoverypath != NULL
+     && M_WriteFile(saverecoverypath, savedata, savelength))
+    {
+        return SAVETHREAD_RECOVERED;
+    }
+
+    return SAVETHREAD_FAILED;
+}
+
+static int SaveThread(void *unused)
+{
+    savethread_status_t status;
+
+    SDL_LockMutex(savelock);
+
+    while (true)
+    {
+        while (savestatus != SAVETHREAD_PENDING && !savequit)
+        {
+            SDL_CondWait(savecond, savelock);
+        }
+
+        // A savegame still pending goes out before quitting
+        if (savestatus != SAVETHREAD_PENDING)
+        {
+            break;
+        }
+
+        SDL_UnlockMutex(savelock);
+
+        status = WriteSaveGame();
+        free(savedata);
+        savedata = NULL;
+
+        SDL_LockMutex(savelock);
+        savestatus = status;
+        SDL_CondBroadcast(savecond);
+    }
+
+    SDL_UnlockMutex(savelock);
+
+    return 0;
+}
+
+static void M_ShutdownSaveThread(void)
+{
+    SDL_LockMutex(savelock);
+    savequit = true;
+    SDL_CondBroadcast(savecond);
+    SDL_UnlockMutex(savelock);
+
+    SDL_WaitThread(savethread, NULL);
+    savethread = NULL;
+}
+
+static boolean M_InitSaveThread(void)
+{
+    if (saveinit)
+    {
+        return savethread != NULL;
+    }
+
+    saveinit = true;
+
+    savelock = SDL_CreateMutex();
+    savecond = SDL_CreateCond();
+    savethread = SDL_CreateThread(SaveThread, "M_SaveThread", NULL);
+
+    if (savethread == NULL)
+    {
+        fprintf(stderr, "M_InitSaveThread: %s\n", SDL_GetError());
+        return false;
+    }
+
+    // Also on I_Error, so the savegame made just before isn't lost
+    I_AtExit(M_ShutdownSaveThread, true);
+
+    return true;
+}
+
+void M_SaveThreadWrite(byte *data, size_t length, const char *temp_path,
+                       const char *path, const char *recovery_path)
+{
+    boolean threaded = M_InitSaveThread();
+
+    if (threaded)
+    {
+        SDL_LockMutex(savelock);
+
+        while (savestatus == SAVETHREAD_PENDING)
+        {
+            SDL_CondWait(savecond, savelock);
+        }
+    }
+
+    free(savetemppath);
+    free(savepath);
+    free(saverecoverypath);
+
+    savedata = data;
+    savelength = length;
+    savecompress = compress_savegames != 0;
+    savetemppath = M_StringDuplicate(temp_path);
+    savepath = M_StringDuplicate(path);
+    saverecoverypath = recovery_path ? M_StringDuplicate(recovery_path) : NULL;
+
+    if (threaded)
+    {
+        savestatus = SAVETHREAD_PENDING;
+        SDL_CondBroadcast(savecond);
+        SDL_UnlockMutex(savelock);
+    }
+    else
+    {
+        savestatus = WriteSaveGame();
+        free(savedata);
+        savedata = NULL;
+    }
+}
+
+savethread_status_t M_SaveThreadPoll(void)
+{
+    savethread_status_t result;
+
+    if (savethread == NULL)
+    {
+        result = savestatus;
+        savestatus = SAVETHREAD_IDLE;
+        return result;
+    }
+
+    SDL_LockMutex(savelock);
+
+    result = savestatus;
+
+    if (result != SAVETHREAD_PENDING)
+    {
+        savestatus = SAVETHREAD_IDLE;
+    }
+
+    SDL_UnlockMutex(savelock);
+
+    return result;
+}
+
+void M_SaveThreadWait(void)
+{
+    if (savethread == NULL)
+    {
+        return;
+    }
+
+    SDL_LockMutex(savelock);
+
+    while (savestatus == SAVETHREAD_PENDING)
+    {
+        SDL_CondWait(savecond, savelock);
+    }
+
+    SDL_UnlockMutex(savelock);
+}
+
+static boolean IsCompressed(const byte *data, size_t length)
+{
+    return length >= SAVEGAME_ZHEADER
+        && !memcmp(data, SAVEGAME_ZMAGIC, SAVEGAME_ZMAGICLEN);
+}
+
+MEMFILE *M_ReadSaveGame(const char *path)
+{
+    MEMFILE *stream;
+    void *buf;
+    size_t length;
+
+    stream = mem_fopen_file(path);
+
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+
+    mem_get_buf(stream, &buf, &length);
+
+    if (!IsCompressed(buf, length))
+    {
+        return stream;
+    }
+
+#ifdef HAVE_LIBZ
+    {
+        const byte *data = buf;
+        z_stream zstream;
+        byte *result;
+        size_t result_length;
+        int err;
+
+        result_length = data[SAVEGAME_ZMAGICLEN]
+                      | (data[SAVEGAME_ZMAGICLEN + 1] << 8)
+                      | (data[SAVEGAME_ZMAGICLEN + 2] << 16)
+                      | ((size_t) data[SAVEGAME_ZMAGICLEN + 3] << 24);
+
+        memset(&zstream, 0, sizeof(zstream));
+
+        if (inflateInit(&zstream) != Z_OK)
+        {
+            mem_fclose(stream);
+            return NULL;
+        }
+
+        result = Z_Malloc(result_length + 1, PU_STATIC, NULL);
+
+        zstream.next_in = (Bytef *) data + SAVEGAME_ZHEADER;
+        zstream.avail_in = length - SAVEGAME_ZHEADER;
+        zstream.next_out = result;
+        zstream.avail_out = result_length;
+
+        err = inflate(&zstream, Z_FINISH);
+        inflateEnd(&zstream);
+        mem_fclose(stream);
+
+        if (err != Z_STREAM_END || zstream.total_out != result_length)
+        {
+            fprintf(stderr, "M_ReadSaveGame: %s is corrupt\n", path);
+            Z_Free(result);
+            return NULL;
+        }
+
+        return mem_fopen_buffer(result, result_length);
+    }
+#else
+    fprintf(stderr, "M_ReadSaveGame: %s is compressed, "
+                    "but this build has no zlib\n", path);
+    mem_fclose(stream);
+
+    return NULL;
+#endif
+}
+
+size_t M_ReadSaveGameHead(const char *path, byte *buf, size_t size)
+{
+    FILE *handle;
+    byte *data;
+    size_t length, result = 0;
+
+    handle = M_fopen(path, "rb");
+
+    if (handle == NULL)
+    {
+        return 0;
+    }
+
+    data = malloc(SAVEGAME_HEADREAD);
+    length = data ? fread(data, 1, SAVEGAME_HEADREAD, handle) : 0;
+    fclose(handle);
+
+    if (!IsCompressed(data, length))
+    {
+        result = length < size ? length : size;
+        memcpy(buf, data, result);
+    }
+#ifdef HAVE_LIBZ
+    else
+    {
+        z_stream zstream;
+
+        memset(&zstream, 0, sizeof(zstream));
+
+        if (inflateInit(&zstream) == Z_OK)
+        {
+            zstream.next_in = data + SAVEGAME_ZHEADER;
+            zstream.avail_in = length - SAVEGAME_ZHEADER;
+            zstream.next_out = buf;
+            zstream.avail_out = size;
+
+            // Stops once buf is full
+            inflate(&zstream, Z_SYNC_FLUSH);
+            result = zstream.total_out;
+            inflateEnd(&zstream);
+        }
+    }
+#endif
+
+    free(data);
+
+    return result;
+}
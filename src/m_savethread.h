@@ -0,0 +1,60 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Background savegame writes. The game serializes into memory and
+//	hands the buffer over; a thread writes it to a temporary file and
+//	renames that over the savegame, so the game loop never waits on
+//	the disk. Savegames are deflated on the way out if zlib is there
+//	and compress_savegames is set; uncompressed ones still load.
+//
+
+#ifndef __M_SAVETHREAD__
+#define __M_SAVETHREAD__
+
+#include "doomtype.h"
+#include "memio.h"
+
+extern int compress_savegames;
+
+typedef enum
+{
+    SAVETHREAD_IDLE,
+    SAVETHREAD_PENDING,
+    SAVETHREAD_DONE,        // Renamed into place
+    SAVETHREAD_RECOVERED,   // The temporary file failed; saved to recovery
+    SAVETHREAD_FAILED       // Neither file could be written
+} savethread_status_t;
+
+// Queues data (malloc'd, freed once written) to be written to temp_path
+// and renamed to path, or written to recovery_path if temp_path can't be
+// written. Waits for the previous savegame first. Writes right away if
+// there's no thread.
+void M_SaveThreadWrite(byte *data, size_t length, const char *temp_path,
+                       const char *path, const char *recovery_path);
+
+// Returns the outcome of the last savegame once, then SAVETHREAD_IDLE.
+savethread_status_t M_SaveThreadPoll(void);
+
+// Waits until the last savegame is on disk.
+void M_SaveThreadWait(void);
+
+// Loads a savegame, compressed or not, into a read stream. NULL if it
+// can't be read.
+MEMFILE *M_ReadSaveGame(const char *path);
+
+// Reads the first size bytes of a savegame, such as its description,
+// without loading all of it. Returns how many were read.
+size_t M_ReadSaveGameHead(const char *path, byte *buf, size_t size);
+
+#endif
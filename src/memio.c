@@ -22,6 +22,7 @@
 
 #include "memio.h"
 
+#include "m_misc.h"
 #include "z_zone.h"
 
 typedef enum {
@@ -35,6 +36,7 @@ struct _MEMFILE {
 	size_t alloced;
 	unsigned int position;
 	memfile_mode_t mode;
+	int owned; // Read stream's buffer is freed on close
 };
 
 // Open a memory area for reading
@@ -49,10 +51,54 @@ MEMFILE *mem_fopen_read(void *buf, size_t buflen)
 	file->buflen = buflen;
 	file->position = 0;
 	file->mode = MODE_READ;
+	file->owned = 0;
 
 	return file;
 }
 
+// Open a Z_Malloc'd buffer for reading; it's freed on close
+
+MEMFILE *mem_fopen_buffer(void *buf, size_t buflen)
+{
+	MEMFILE *file;
+
+	file = mem_fopen_read(buf, buflen);
+	file->owned = 1;
+
+	return file;
+}
+
+// Open a file for reading, loading all of it into memory. Returns NULL
+// if it can't be read.
+
+MEMFILE *mem_fopen_file(const char *filename)
+{
+	FILE *handle;
+	unsigned char *buf;
+	long length;
+
+	handle = M_fopen(filename, "rb");
+
+	if (handle == NULL)
+	{
+		return NULL;
+	}
+
+	length = M_FileLength(handle);
+	buf = Z_Malloc(length + 1, PU_STATIC, 0);
+
+	if (fread(buf, 1, length, handle) < (size_t) length)
+	{
+		fclose(handle);
+		Z_Free(buf);
+		return NULL;
+	}
+
+	fclose(handle);
+
+	return mem_fopen_buffer(buf, length);
+}
+
 // Read bytes
 
 size_t mem_fread(void *buf, size_t size, size_t nmemb, MEMFILE *stream)
@@ -85,6 +131,52 @@ size_t mem_fread(void *buf, size_t size, size_t nmemb, MEMFILE *stream)
 	return items;
 }
 
+// Read a single byte, or EOF
+
+int mem_fgetc(MEMFILE *stream)
+{
+	if (stream->mode != MODE_READ || stream->position >= stream->buflen)
+	{
+		return EOF;
+	}
+
+	return stream->buf[stream->position++];
+}
+
+// Read up to a newline, as fgets
+
+char *mem_fgets(char *str, int count, MEMFILE *stream)
+{
+	int i, c;
+
+	if (count <= 0)
+	{
+		return NULL;
+	}
+
+	for (i = 0; i < count - 1; ++i)
+	{
+		c = mem_fgetc(stream);
+
+		if (c == EOF)
+		{
+			break;
+		}
+
+		str[i] = c;
+
+		if (c == '\n')
+		{
+			++i;
+			break;
+		}
+	}
+
+	str[i] = '\0';
+
+	return i > 0 ? str : NULL;
+}
+
 // Open a memory area for writing
 
 MEMFILE *mem_fopen_write(void)
@@ -98,6 +190,7 @@ MEMFILE *mem_fopen_write(void)
 	file->buflen = 0;
 	file->position = 0;
 	file->mode = MODE_WRITE;
+	file->owned = 1;
 
 	return file;
 }
@@ -140,6 +233,25 @@ size_t mem_fwrite(const void *ptr, size_t size, size_t nmemb, MEMFILE *stream)
 	return nmemb;
 }
 
+// Write a single byte
+
+int mem_fputc(int c, MEMFILE *stream)
+{
+	unsigned char value = c;
+
+	if (stream->mode == MODE_WRITE && stream->position < stream->alloced)
+	{
+		stream->buf[stream->position++] = value;
+
+		if (stream->position > stream->buflen)
+			stream->buflen = stream->position;
+
+		return value;
+	}
+
+	return mem_fwrite(&value, 1, 1, stream) == 1 ? value : EOF;
+}
+
 int mem_fputs(const char *str, MEMFILE *stream)
 {
 	if (str == NULL)
@@ -156,9 +268,16 @@ void mem_get_buf(MEMFILE *stream, void **buf, size_t *buflen)
 	*buflen = stream->buflen;
 }
 
+// Write everything written to the stream out to a file
+
+int mem_fwrite_file(MEMFILE *stream, const char *filename)
+{
+	return M_WriteFile(filename, stream->buf, stream->buflen);
+}
+
 void mem_fclose(MEMFILE *stream)
 {
-	if (stream->mode == MODE_WRITE)
+	if (stream->owned)
 	{
 		Z_Free(stream->buf);
 	}
@@ -192,7 +311,7 @@ int mem_fseek(MEMFILE *stream, signed long position, mem_rel_t whence)
 			return -1;
 	}
 
-	if (newpos < stream->buflen)
+	if (newpos <= stream->buflen)
 	{
 		stream->position = newpos;
 		return 0;
@@ -26,11 +26,17 @@ typedef enum
 } mem_rel_t;
 
 MEMFILE *mem_fopen_read(void *buf, size_t buflen);
+MEMFILE *mem_fopen_buffer(void *buf, size_t buflen);
+MEMFILE *mem_fopen_file(const char *filename);
 size_t mem_fread(void *buf, size_t size, size_t nmemb, MEMFILE *stream);
+int mem_fgetc(MEMFILE *stream);
+char *mem_fgets(char *str, int count, MEMFILE *stream);
 MEMFILE *mem_fopen_write(void);
 size_t mem_fwrite(const void *ptr, size_t size, size_t nmemb, MEMFILE *stream);
+int mem_fputc(int c, MEMFILE *stream);
 int mem_fputs(const char *str, MEMFILE *stream);
 void mem_get_buf(MEMFILE *stream, void **buf, size_t *buflen);
+int mem_fwrite_file(MEMFILE *stream, const char *filename);
 void mem_fclose(MEMFILE *stream);
 long mem_ftell(MEMFILE *stream);
 int mem_fseek(MEMFILE *stream, signed long offset, mem_rel_t whence);
@@ -24,11 +24,11 @@
 #include "i_swap.h"
 #include "i_system.h"
 #include "m_misc.h"
+#include "memio.h"
 #include "midifile.h"
 
 #define HEADER_CHUNK_ID "MThd"
 #define TRACK_CHUNK_ID  "MTrk"
-#define MAX_BUFFER_SIZE 0x10000
 
 // haleyjd 09/09/10: packing required
 #ifdef _MSC_VER
@@ -60,10 +60,11 @@ typedef struct
 
     unsigned int data_len;
 
-    // Events in this track:
+    // Events in this track, in the file's event arena:
 
     midi_event_t *events;
     int num_events;
+    unsigned int first_event;
 } midi_track_t;
 
 struct midi_track_iter_s
@@ -81,11 +82,30 @@ struct midi_file_s
     midi_track_t *tracks;
     unsigned int num_tracks;
 
-    // Data buffer used to store data read for SysEx or meta events:
+    // [AP] Copy of the file data; SysEx and meta event data point
+    // into it:
     byte *buffer;
     unsigned int buffer_size;
+
+    // [AP] Events of all tracks, one after the other:
+    midi_event_t *events;
+    unsigned int num_events;
+    unsigned int max_events;
+
+    // [AP] Loads not freed yet, if it's in the cache; see MIDI_FreeFile
+    int refcount;
+    boolean cached;
+    unsigned int lastuse;
 };
 
+// [AP] Files stay parsed after they're freed, in case the same data is
+// loaded again. Least recently used goes first.
+
+#define MIDICACHESIZE 8
+
+static midi_file_t *midicache[MIDICACHESIZE];
+static unsigned int midicacheuse;
+
 // Check the header of a chunk:
 
 static boolean CheckChunkHeader(chunk_header_t *chunk,
@@ -109,11 +129,11 @@ static boolean CheckChunkHeader(chunk_header_t *chunk,
 
 // Read a single byte.  Returns false on error.
 
-static boolean ReadByte(byte *result, FILE *stream)
+static boolean ReadByte(byte *result, MEMFILE *stream)
 {
     int c;
 
-    c = fgetc(stream);
+    c = mem_fgetc(stream);
 
     if (c == EOF)
     {
@@ -130,7 +150,7 @@ static boolean ReadByte(byte *result, FILE *stream)
 
 // Read a variable-length value.
 
-static boolean ReadVariableLength(unsigned int *result, FILE *stream)
+static boolean ReadVariableLength(unsigned int *result, MEMFILE *stream)
 {
     int i;
     byte b = 0;
@@ -164,38 +184,27 @@ static boolean ReadVariableLength(unsigned int *result, FILE *stream)
     return false;
 }
 
-// Read a byte sequence into the data buffer.
+// [AP] Skip over a byte sequence and return where it is in the data
+// buffer.
 
-static void *ReadByteSequence(unsigned int num_bytes, FILE *stream)
+static void *ReadByteSequence(unsigned int num_bytes, MEMFILE *stream)
 {
-    unsigned int i;
-    byte *result;
+    void *buf;
+    size_t buflen;
+    long position;
 
-    // Allocate a buffer. Allocate one extra byte, as malloc(0) is
-    // non-portable.
+    mem_get_buf(stream, &buf, &buflen);
+    position = mem_ftell(stream);
 
-    result = malloc(num_bytes + 1);
-
-    if (result == NULL)
+    if (num_bytes > buflen - position)
     {
-        fprintf(stderr, "ReadByteSequence: Failed to allocate buffer\n");
+        fprintf(stderr, "ReadByteSequence: Unexpected end of file\n");
         return NULL;
     }
 
-    // Read the data:
-
-    for (i=0; i<num_bytes; ++i)
-    {
-        if (!ReadByte(&result[i], stream))
-        {
-            fprintf(stderr, "ReadByteSequence: Error while reading byte %u\n",
-                            i);
-            free(result);
-            return NULL;
-        }
-    }
+    mem_fseek(stream, num_bytes, MEM_SEEK_CUR);
 
-    return result;
+    return (byte *) buf + position;
 }
 
 // Read a MIDI channel event.
@@ -204,7 +213,7 @@ static void *ReadByteSequence(unsigned int num_bytes, FILE *stream)
 
 static boolean ReadChannelEvent(midi_event_t *event,
                                 byte event_type, boolean two_param,
-                                FILE *stream)
+                                MEMFILE *stream)
 {
     byte b = 0;
 
@@ -244,7 +253,7 @@ static boolean ReadChannelEvent(midi_event_t *event,
 // Read sysex event:
 
 static boolean ReadSysExEvent(midi_event_t *event, int event_type,
-                              FILE *stream)
+                              MEMFILE *stream)
 {
     event->event_type = event_type;
 
@@ -270,7 +279,7 @@ static boolean ReadSysExEvent(midi_event_t *event, int event_type,
 
 // Read meta event:
 
-static boolean ReadMetaEvent(midi_event_t *event, FILE *stream)
+static boolean ReadMetaEvent(midi_event_t *event, MEMFILE *stream)
 {
     byte b = 0;
 
@@ -309,7 +318,7 @@ static boolean ReadMetaEvent(midi_event_t *event, FILE *stream)
 }
 
 static boolean ReadEvent(midi_event_t *event, unsigned int *last_event_type,
-                         FILE *stream)
+                         MEMFILE *stream)
 {
     byte event_type = 0;
 
@@ -334,7 +343,7 @@ static boolean ReadEvent(midi_event_t *event, unsigned int *last_event_type,
     {
         event_type = *last_event_type;
 
-        if (fseek(stream, -1, SEEK_CUR) < 0)
+        if (mem_fseek(stream, -1, MEM_SEEK_CUR) < 0)
         {
             fprintf(stderr, "ReadEvent: Unable to seek in stream\n");
             return false;
@@ -387,38 +396,14 @@ static boolean ReadEvent(midi_event_t *event, unsigned int *last_event_type,
     return false;
 }
 
-// Free an event:
-
-static void FreeEvent(midi_event_t *event)
-{
-    // Some event types have dynamically allocated buffers assigned
-    // to them that must be freed.
-
-    switch (event->event_type)
-    {
-        case MIDI_EVENT_SYSEX:
-        case MIDI_EVENT_SYSEX_SPLIT:
-            free(event->data.sysex.data);
-            break;
-
-        case MIDI_EVENT_META:
-            free(event->data.meta.data);
-            break;
-
-        default:
-            // Nothing to do.
-            break;
-    }
-}
-
 // Read and check the track chunk header
 
-static boolean ReadTrackHeader(midi_track_t *track, FILE *stream)
+static boolean ReadTrackHeader(midi_track_t *track, MEMFILE *stream)
 {
     size_t records_read;
     chunk_header_t chunk_header;
 
-    records_read = fread(&chunk_header, sizeof(chunk_header_t), 1, stream);
+    records_read = mem_fread(&chunk_header, sizeof(chunk_header_t), 1, stream);
 
     if (records_read < 1)
     {
@@ -435,14 +420,15 @@ static boolean ReadTrackHeader(midi_track_t *track, FILE *stream)
     return true;
 }
 
-static boolean ReadTrack(midi_track_t *track, FILE *stream)
+static boolean ReadTrack(midi_file_t *file, midi_track_t *track,
+                         MEMFILE *stream)
 {
-    midi_event_t *new_events;
     midi_event_t *event;
     unsigned int last_event_type;
 
     track->num_events = 0;
     track->events = NULL;
+    track->first_event = file->num_events;
 
     // Read the header:
 
@@ -457,20 +443,24 @@ static boolean ReadTrack(midi_track_t *track, FILE *stream)
 
     for (;;)
     {
-        // Resize the track slightly larger to hold another event:
+        // Make room for another event:
 
-        new_events = I_Realloc(track->events, 
-                             sizeof(midi_event_t) * (track->num_events + 1));
-        track->events = new_events;
+        if (file->num_events == file->max_events)
+        {
+            file->max_events = file->max_events ? file->max_events * 2 : 256;
+            file->events = I_Realloc(file->events,
+                                     sizeof(midi_event_t) * file->max_events);
+        }
 
         // Read the next event:
 
-        event = &track->events[track->num_events];
+        event = &file->events[file->num_events];
         if (!ReadEvent(event, &last_event_type, stream))
         {
             return false;
         }
 
+        ++file->num_events;
         ++track->num_events;
 
         // End of track?
@@ -485,21 +475,7 @@ static boolean ReadTrack(midi_track_t *track, FILE *stream)
     return true;
 }
 
-// Free a track:
-
-static void FreeTrack(midi_track_t *track)
-{
-    unsigned int i;
-
-    for (i=0; i<track->num_events; ++i)
-    {
-        FreeEvent(&track->events[i]);
-    }
-
-    free(track->events);
-}
-
-static boolean ReadAllTracks(midi_file_t *file, FILE *stream)
+static boolean ReadAllTracks(midi_file_t *file, MEMFILE *stream)
 {
     unsigned int i;
 
@@ -518,23 +494,30 @@ static boolean ReadAllTracks(midi_file_t *file, FILE *stream)
 
     for (i=0; i<file->num_tracks; ++i)
     {
-        if (!ReadTrack(&file->tracks[i], stream))
+        if (!ReadTrack(file, &file->tracks[i], stream))
         {
             return false;
         }
     }
 
+    // The arena is done growing
+
+    for (i=0; i<file->num_tracks; ++i)
+    {
+        file->tracks[i].events = file->events + file->tracks[i].first_event;
+    }
+
     return true;
 }
 
 // Read and check the header chunk.
 
-static boolean ReadFileHeader(midi_file_t *file, FILE *stream)
+static boolean ReadFileHeader(midi_file_t *file, MEMFILE *stream)
 {
     size_t records_read;
     unsigned int format_type;
 
-    records_read = fread(&file->header, sizeof(midi_header_t), 1, stream);
+    records_read = mem_fread(&file->header, sizeof(midi_header_t), 1, stream);
 
     if (records_read < 1)
     {
@@ -564,27 +547,82 @@ static boolean ReadFileHeader(midi_file_t *file, FILE *stream)
     return true;
 }
 
+static void FreeFile(midi_file_t *file)
+{
+    free(file->tracks);
+    free(file->events);
+    free(file->buffer);
+    free(file);
+}
+
 void MIDI_FreeFile(midi_file_t *file)
 {
+    if (file->cached)
+    {
+        file->refcount--;
+    }
+    else
+    {
+        FreeFile(file);
+    }
+}
+
+// [AP] Puts a file just loaded in the place of the least recently used
+// one nothing holds. Stays uncached if they're all held.
+
+static void CacheFile(midi_file_t *file)
+{
+    int best = -1;
     int i;
 
-    if (file->tracks != NULL)
+    for (i = 0; i < MIDICACHESIZE; ++i)
     {
-        for (i=0; i<file->num_tracks; ++i)
+        if (midicache[i] == NULL)
         {
-            FreeTrack(&file->tracks[i]);
+            best = i;
+            break;
         }
 
-        free(file->tracks);
+        if (midicache[i]->refcount == 0
+         && (best < 0 || midicache[i]->lastuse < midicache[best]->lastuse))
+        {
+            best = i;
+        }
     }
 
-    free(file);
+    if (best < 0)
+    {
+        return;
+    }
+
+    if (midicache[best] != NULL)
+    {
+        FreeFile(midicache[best]);
+    }
+
+    midicache[best] = file;
+    file->cached = true;
 }
 
-midi_file_t *MIDI_LoadFile(char *filename)
+midi_file_t *MIDI_LoadFromMemory(const void *data, size_t len)
 {
     midi_file_t *file;
-    FILE *stream;
+    MEMFILE *stream;
+    boolean ok;
+    int i;
+
+    for (i = 0; i < MIDICACHESIZE; ++i)
+    {
+        file = midicache[i];
+
+        if (file != NULL && file->buffer_size == len
+         && !memcmp(file->buffer, data, len))
+        {
+            file->refcount++;
+            file->lastuse = ++midicacheuse;
+            return file;
+        }
+    }
 
     file = malloc(sizeof(midi_file_t));
 
@@ -595,39 +633,65 @@ midi_file_t *MIDI_LoadFile(char *filename)
 
     file->tracks = NULL;
     file->num_tracks = 0;
-    file->buffer = NULL;
-    file->buffer_size = 0;
+    file->events = NULL;
+    file->num_events = 0;
+    file->max_events = 0;
+    file->buffer_size = len;
+    file->refcount = 1;
+    file->cached = false;
+    file->lastuse = ++midicacheuse;
 
-    // Open file
+    // Allocate one extra byte, as malloc(0) is non-portable.
 
-    stream = M_fopen(filename, "rb");
+    file->buffer = malloc(len + 1);
 
-    if (stream == NULL)
+    if (file->buffer == NULL)
     {
-        fprintf(stderr, "MIDI_LoadFile: Failed to open '%s'\n", filename);
         MIDI_FreeFile(file);
         return NULL;
     }
 
-    // Read MIDI file header
+    memcpy(file->buffer, data, len);
+
+    stream = mem_fopen_read(file->buffer, len);
+
+    // Read MIDI file header, then all tracks:
 
-    if (!ReadFileHeader(file, stream))
+    ok = ReadFileHeader(file, stream) && ReadAllTracks(file, stream);
+
+    mem_fclose(stream);
+
+    if (!ok)
     {
-        fclose(stream);
         MIDI_FreeFile(file);
         return NULL;
     }
 
-    // Read all tracks:
+    CacheFile(file);
+
+    return file;
+}
+
+midi_file_t *MIDI_LoadFile(char *filename)
+{
+    midi_file_t *file;
+    MEMFILE *stream;
+    void *buf;
+    size_t buflen;
 
-    if (!ReadAllTracks(file, stream))
+    // Open file
+
+    stream = mem_fopen_file(filename);
+
+    if (stream == NULL)
     {
-        fclose(stream);
-        MIDI_FreeFile(file);
+        fprintf(stderr, "MIDI_LoadFile: Failed to open '%s'\n", filename);
         return NULL;
     }
 
-    fclose(stream);
+    mem_get_buf(stream, &buf, &buflen);
+    file = MIDI_LoadFromMemory(buf, buflen);
+    mem_fclose(stream);
 
     return file;
 }
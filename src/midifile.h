@@ -173,7 +173,13 @@ typedef struct
 
 midi_file_t *MIDI_LoadFile(char *filename);
 
-// Free a MIDI file.
+// [AP] Load a MIDI file from memory. The data is copied. Loading the same
+// data as a file loaded lately returns that file again, so a song
+// restarting doesn't parse it again.
+
+midi_file_t *MIDI_LoadFromMemory(const void *data, size_t len);
+
+// Free a MIDI file. [AP] Once per load.
 
 void MIDI_FreeFile(midi_file_t *file);
 
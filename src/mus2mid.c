@@ -17,6 +17,8 @@
 // Use to convert a MUS file into a single track, type 0 MIDI file.
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "doomtype.h"
 #include "i_swap.h"
@@ -692,6 +694,93 @@ boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput)
     return false;
 }
 
+// [AP] Songs converted lately, least recently used goes first. Random
+// music and reloading the level on death play the same few again.
+
+#define MUSCACHESIZE 16
+
+typedef struct
+{
+    byte *mus;
+    size_t mus_len;
+    byte *mid;
+    size_t mid_len;
+    unsigned int lastuse;
+} muscache_t;
+
+static muscache_t muscache[MUSCACHESIZE];
+static unsigned int muscacheuse;
+
+boolean mus2mid_cached(const byte *musdata, size_t len,
+                       const void **mid, size_t *mid_len)
+{
+    MEMFILE *instream;
+    MEMFILE *outstream;
+    void *outbuf;
+    size_t outbuf_len;
+    muscache_t *entry;
+    boolean failed;
+    int i;
+
+    entry = &muscache[0];
+
+    for (i = 0; i < MUSCACHESIZE; ++i)
+    {
+        if (muscache[i].mus != NULL && muscache[i].mus_len == len
+         && !memcmp(muscache[i].mus, musdata, len))
+        {
+            muscache[i].lastuse = ++muscacheuse;
+            *mid = muscache[i].mid;
+            *mid_len = muscache[i].mid_len;
+            return true;
+        }
+
+        if (muscache[i].lastuse < entry->lastuse)
+        {
+            entry = &muscache[i];
+        }
+    }
+
+    instream = mem_fopen_read((void *) musdata, len);
+    outstream = mem_fopen_write();
+
+    failed = mus2mid(instream, outstream);
+
+    if (!failed)
+    {
+        mem_get_buf(outstream, &outbuf, &outbuf_len);
+
+        free(entry->mus);
+        free(entry->mid);
+        entry->mus = malloc(len);
+        entry->mid = malloc(outbuf_len);
+
+        if (entry->mus == NULL || entry->mid == NULL)
+        {
+            free(entry->mus);
+            free(entry->mid);
+            entry->mus = entry->mid = NULL;
+            entry->lastuse = 0;
+            failed = true;
+        }
+        else
+        {
+            memcpy(entry->mus, musdata, len);
+            memcpy(entry->mid, outbuf, outbuf_len);
+            entry->mus_len = len;
+            entry->mid_len = outbuf_len;
+            entry->lastuse = ++muscacheuse;
+            *mid = entry->mid;
+            *mid_len = entry->mid_len;
+        }
+    }
+
+    mem_fclose(instream);
+    mem_fclose(outstream);
+
+    return !failed;
+}
+
 #ifdef STANDALONE
 
 #include "m_misc.h"
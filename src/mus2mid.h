@@ -25,5 +25,11 @@
 
 boolean mus2mid(MEMFILE *musinput, MEMFILE *midioutput);
 
+// [AP] Same conversion, reusing the result if the same MUS data was
+// converted lately. Returns false if it fails. *mid stays valid until the
+// next call.
+boolean mus2mid_cached(const byte *musdata, size_t len,
+                       const void **mid, size_t *mid_len);
+
 #endif /* #ifndef MUS2MID_H */
 
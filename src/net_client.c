@@ -39,6 +39,7 @@
 #include "net_query.h"
 #include "net_server.h"
 #include "net_structrw.h"
+#include "net_thread.h"
 #include "net_petname.h"
 #include "w_checksum.h"
 #include "w_wad.h"
@@ -175,7 +176,14 @@ unsigned int net_local_is_freedoom;
 
 static void NET_CL_Disconnected(void)
 {
-    D_ReceiveTic(NULL, NULL);
+    if (NET_ThreadRunning())
+    {
+        NET_ThreadPushTic(NULL, NULL);
+    }
+    else
+    {
+        D_ReceiveTic(NULL, NULL);
+    }
 }
 
 // Called when a packet is received from the server containing game
@@ -186,6 +194,7 @@ static void UpdateClockSync(unsigned int seq,
 {
     static int last_error, cumul_error;
     int latency, error;
+    fixed_t offset;
 
     if (seq == send_queue[seq % BACKUPTICS].seq)
     {
@@ -212,15 +221,25 @@ static void UpdateClockSync(unsigned int seq,
     error = latency - remote_latency;
     cumul_error += error;
 
-    offsetms = KP * (FRACUNIT * error)
-             - KI * (FRACUNIT * cumul_error)
-             + (KD * FRACUNIT) * (last_error - error);
+    offset = KP * (FRACUNIT * error)
+           - KI * (FRACUNIT * cumul_error)
+           + (KD * FRACUNIT) * (last_error - error);
+
+    // [AP] offsetms belongs to the game thread
+    if (NET_ThreadRunning())
+    {
+        NET_ThreadSetOffset(offset);
+    }
+    else
+    {
+        offsetms = offset;
+    }
 
     last_error = error;
     last_latency = latency;
 
     NET_Log("client: latency %d, remote %d -> offset=%dms, cumul_error=%d",
-            latency, remote_latency, offsetms / FRACUNIT, cumul_error);
+            latency, remote_latency, offset / FRACUNIT, cumul_error);
 }
 
 // Expand a net_full_ticcmd_t, applying the diffs in cmd->cmds as
@@ -268,11 +287,26 @@ static void NET_CL_AdvanceWindow(void)
 
     while (recvwindow[0].active)
     {
+        // [AP] Leave the rest for when the game thread has caught up
+
+        if (NET_ThreadRunning() && !NET_ThreadCanPushTic())
+        {
+            break;
+        }
+
         // Expand tic diff data into d_net.c structures
 
         NET_CL_ExpandFullTiccmd(&recvwindow[0].cmd, recvwindow_start,
                                 ticcmds);
-        D_ReceiveTic(ticcmds, recvwindow[0].cmd.playeringame);
+
+        if (NET_ThreadRunning())
+        {
+            NET_ThreadPushTic(ticcmds, recvwindow[0].cmd.playeringame);
+        }
+        else
+        {
+            D_ReceiveTic(ticcmds, recvwindow[0].cmd.playeringame);
+        }
 
         // Advance the window
 
@@ -340,6 +374,8 @@ static void NET_CL_SendGameDataACK(void)
 static void NET_CL_SendTics(int start, int end)
 {
     net_packet_t *packet;
+    net_ticpacker_t packer;
+    boolean packed;
     int i;
 
     if (!net_client_connected)
@@ -349,6 +385,14 @@ static void NET_CL_SendTics(int start, int end)
         return;
     }
 
+    packed = client_connection.protocol == NET_PROTOCOL_APDOOM_PACKED_0;
+
+    // [AP] The server doesn't acknowledge our tics, so always send the
+    // last few again
+
+    if (packed && end - start < NET_TicRedundancy())
+        start = end - NET_TicRedundancy();
+
     if (start < 0)
         start = 0;
     
@@ -366,16 +410,28 @@ static void NET_CL_SendTics(int start, int end)
 
     // Add the tics.
 
+    NET_InitTicPacker(&packer, packet);
+
     for (i=start; i<=end; ++i)
     {
         net_server_send_t *sendobj;
 
         sendobj = &send_queue[i % BACKUPTICS];
 
-        NET_WriteInt16(packet, last_latency);
+        if (packed)
+        {
+            NET_WritePackedTiccmdDiff(&packer, last_latency, &sendobj->cmd,
+                                      settings.lowres_turn);
+        }
+        else
+        {
+            NET_WriteInt16(packet, last_latency);
 
-        NET_WriteTiccmdDiff(packet, &sendobj->cmd, settings.lowres_turn);
+            NET_WriteTiccmdDiff(packet, &sendobj->cmd, settings.lowres_turn);
+        }
     }
+
+    NET_FinishTicPacker(&packer);
     
     // Send the packet
 
@@ -423,6 +479,7 @@ void NET_CL_SendTiccmd(ticcmd_t *ticcmd, int maketic)
     NET_Log("client: generated tic %d, sending %d-%d",
             maketic, starttic, endtic);
     NET_CL_SendTics(starttic, endtic);
+    NET_FlushPackets(client_context);
 }
 
 // Parse a SYN packet received back from the server indicating a successful
@@ -733,6 +790,8 @@ static void NET_CL_CheckResends(void)
 static void NET_CL_ParseGameData(net_packet_t *packet)
 {
     net_server_recv_t *recvobj;
+    net_ticpacker_t packer;
+    boolean packed;
     unsigned int seq, num_tics;
     unsigned int nowtime;
     int resend_start, resend_end;
@@ -764,13 +823,18 @@ static void NET_CL_ParseGameData(net_packet_t *packet)
     seq = NET_CL_ExpandTicNum(seq);
     NET_Log("client: got game data, seq=%d, num_tics=%d", seq, num_tics);
 
+    packed = client_connection.protocol == NET_PROTOCOL_APDOOM_PACKED_0;
+    NET_InitTicPacker(&packer, packet);
+
     for (i=0; i<num_tics; ++i)
     {
         net_full_ticcmd_t cmd;
 
         index = seq - recvwindow_start + i;
 
-        if (!NET_ReadFullTiccmd(packet, &cmd, settings.lowres_turn))
+        if (packed ? !NET_ReadPackedFullTiccmd(&packer, &cmd,
+                                               settings.lowres_turn)
+                   : !NET_ReadFullTiccmd(packet, &cmd, settings.lowres_turn))
         {
             NET_Log("client: error: failed to read ticcmd %d", i);
             return;
@@ -1039,6 +1103,8 @@ void NET_CL_Run(void)
 
         NET_CL_CheckResends();
     }
+
+    NET_FlushPackets(client_context);
 }
 
 static void NET_CL_SendSYN(net_connect_data_t *data)
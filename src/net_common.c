@@ -428,6 +428,50 @@ unsigned int NET_ExpandTicNum(unsigned int relative, unsigned int b)
     return result;
 }
 
+// [AP] How many earlier tics may go again with each new one under
+// NET_PROTOCOL_APDOOM_PACKED_0
+
+#define DEFAULT_TIC_REDUNDANCY 4
+#define MAX_TIC_REDUNDANCY 32
+
+int NET_TicRedundancy(void)
+{
+    static int redundancy = -1;
+    int p;
+
+    if (redundancy < 0)
+    {
+        redundancy = DEFAULT_TIC_REDUNDANCY;
+
+        //!
+        // @category net
+        // @arg <n>
+        //
+        // Send up to n unacknowledged tics again with every new tic, so
+        // that lost packets are made up for without asking for them
+        // again. The default is 4; 0 turns this off.
+        //
+
+        p = M_CheckParmWithArgs("-ticredundancy", 1);
+
+        if (p > 0)
+        {
+            redundancy = atoi(myargv[p + 1]);
+
+            if (redundancy < 0)
+            {
+                redundancy = 0;
+            }
+            else if (redundancy > MAX_TIC_REDUNDANCY)
+            {
+                redundancy = MAX_TIC_REDUNDANCY;
+            }
+        }
+    }
+
+    return redundancy;
+}
+
 // Check that game settings are valid
 
 boolean NET_ValidGameSettings(GameMode_t mode, GameMission_t mission,
@@ -26,7 +26,7 @@
 #include "m_argv.h"
 
 #include "net_common.h"
-#include "net_sdl.h"
+#include "net_udp.h"
 #include "net_server.h"
 
 // 
@@ -61,20 +61,94 @@ static void CheckForClientOptions(void)
     }
 }
 
+// [AP] Number of games to host, from -games
+
+static int NumGames(net_module_t *module)
+{
+    int numgames = 1;
+    int i;
+
+    //!
+    // @arg <n>
+    // @category net
+    //
+    // When running a dedicated server, host n separate games at once,
+    // on consecutive ports starting from the one given with -port.
+    //
+
+    i = M_CheckParmWithArgs("-games", 1);
+
+    if (i > 0)
+    {
+        numgames = atoi(myargv[i + 1]);
+
+        if (numgames < 1 || numgames > NET_UDP_MAXSOCKETS)
+        {
+            I_Error("-games must be between 1 and %i", NET_UDP_MAXSOCKETS);
+        }
+
+        if (numgames > 1 && module != &net_udp_module)
+        {
+            I_Error("-games can't be used with -sdlnet");
+        }
+    }
+
+    return numgames;
+}
+
 void NET_DedicatedServer(void)
 {
+    net_module_t *module = NET_UDP_DefaultModule();
+    net_server_t *servers[NET_UDP_MAXSOCKETS];
+    int numgames;
+    int i;
+
     CheckForClientOptions();
 
     NET_OpenLog();
-    NET_SV_Init();
-    NET_SV_AddModule(&net_sdl_module);
-    NET_SV_RegisterWithMaster();
+
+    numgames = NumGames(module);
+
+    // Each game has a server and socket of its own; the first is the
+    // default server, on the socket from InitServer
+
+    for (i = 0; i < numgames; ++i)
+    {
+        servers[i] = i == 0 ? NULL : NET_SV_NewServer();
+        NET_SV_SelectServer(servers[i]);
+
+        if (i > 0)
+        {
+            NET_UDP_SelectSocket(NET_UDP_OpenGameSocket());
+        }
+
+        NET_SV_Init();
+        NET_SV_AddModule(module);
+        NET_SV_RegisterWithMaster();
+    }
 
     while (true)
     {
-        NET_SV_Run();
-        // TODO: Block on socket instead of polling.
-        I_Sleep(1);
+        for (i = 0; i < numgames; ++i)
+        {
+            if (numgames > 1)
+            {
+                NET_UDP_SelectSocket(i);
+            }
+
+            NET_SV_SelectServer(servers[i]);
+            NET_SV_Run();
+        }
+
+        // Everything but packets runs on timeouts of a second or so
+        if (module->WaitPacket != NULL)
+        {
+            module->WaitPacket(10);
+        }
+        else
+        {
+            I_Sleep(1);
+        }
     }
 }
 
@@ -88,6 +88,16 @@ struct _net_module_s
     // Try to resolve a name to an address
 
     net_addr_t *(*ResolveAddress)(const char *addr);
+
+    // Send any packets SendPacket has queued up.  NULL if it sends
+    // them straight away.
+
+    void (*Flush)(void);
+
+    // Block until a packet can be received or timeout_ms have passed.
+    // Returns true if one can be.  NULL if the module can only be polled.
+
+    boolean (*WaitPacket)(int timeout_ms);
 };
 
 // net_addr_t
@@ -123,6 +133,11 @@ typedef enum
     // number in this enum.
     NET_PROTOCOL_CHOCOLATE_DOOM_0,
 
+    // [AP] As CHOCOLATE_DOOM_0, but game data tics are bit-packed (see
+    // net_structrw.c) and the unacknowledged ones are sent again with
+    // each new tic, up to -ticredundancy of them.
+    NET_PROTOCOL_APDOOM_PACKED_0,
+
     // Add your own protocol here; be sure to add a name for it to the list
     // in net_common.c too.
 
@@ -151,6 +166,8 @@ typedef enum
     NET_PACKET_TYPE_QUERY_RESPONSE,
     NET_PACKET_TYPE_LAUNCH,
     NET_PACKET_TYPE_NAT_HOLE_PUNCH,
+    NET_PACKET_TYPE_STATS_QUERY,        // [AP]
+    NET_PACKET_TYPE_STATS_RESPONSE,
 } net_packet_type_t;
 
 typedef enum
@@ -256,6 +273,25 @@ typedef struct
     net_protocol_t protocol;
 } net_querydata_t;
 
+// [AP] Connection statistics the server keeps for each client, for
+// diagnosing lag. Sent in reply to NET_PACKET_TYPE_STATS_QUERY.
+
+#define NET_RTT_BUCKETS 8   // Under 25ms, 50ms, ... 1600ms, and above
+
+typedef struct
+{
+    const char *name;
+    int player_number;                  // -1 for drones
+    unsigned int rtt;                   // Latest, in ms
+    unsigned int rtt_histogram[NET_RTT_BUCKETS];
+    unsigned int tics_received;
+    unsigned int tics_lost;             // Missing when later ones came
+    unsigned int resend_requests;       // Sent to the client
+    unsigned int tics_resent;           // At the client's request
+    unsigned int deadlocks;
+    unsigned int backlog;               // Tics sent, not acknowledged
+} net_clientstats_t;
+
 // Data sent by the server while waiting for the game to start.
 
 typedef struct
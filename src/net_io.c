@@ -19,6 +19,8 @@
 #include <stdio.h>
 
 #include "i_system.h"
+#include "i_trace.h"
+#include "m_misc.h"
 #include "net_defs.h"
 #include "net_io.h"
 #include "z_zone.h"
@@ -73,8 +75,20 @@ net_addr_t *NET_ResolveAddress(net_context_t *context, const char *addr)
     return NULL;
 }
 
+static void TracePacket(const char *name, net_packet_t *packet)
+{
+    char detail[16];
+
+    if (tracing)
+    {
+        M_snprintf(detail, sizeof(detail), "%d bytes", (int) packet->len);
+        I_TraceInstant(name, detail);
+    }
+}
+
 void NET_SendPacket(net_addr_t *addr, net_packet_t *packet)
 {
+    TracePacket("send packet", packet);
     addr->module->SendPacket(addr, packet);
 }
 
@@ -82,6 +96,8 @@ void NET_SendBroadcast(net_context_t *context, net_packet_t *packet)
 {
     int i;
 
+    TracePacket("broadcast packet", packet);
+
     for (i=0; i<context->num_modules; ++i)
     {
         context->modules[i]->SendPacket(&net_broadcast_addr, packet);
@@ -100,6 +116,7 @@ boolean NET_RecvPacket(net_context_t *context,
     {
         if (context->modules[i]->RecvPacket(addr, packet))
         {
+            TracePacket("receive packet", *packet);
             NET_ReferenceAddress(*addr);
             return true;
         }
@@ -108,6 +125,19 @@ boolean NET_RecvPacket(net_context_t *context,
     return false;
 }
 
+void NET_FlushPackets(net_context_t *context)
+{
+    int i;
+
+    for (i=0; i<context->num_modules; ++i)
+    {
+        if (context->modules[i]->Flush != NULL)
+        {
+            context->modules[i]->Flush();
+        }
+    }
+}
+
 // Note: this prints into a static buffer, calling again overwrites
 // the first result
 
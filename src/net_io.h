@@ -41,6 +41,10 @@ void NET_SendBroadcast(net_context_t *context, net_packet_t *packet);
 boolean NET_RecvPacket(net_context_t *context, net_addr_t **addr,
                        net_packet_t **packet);
 
+// Send the packets any module in the given context has queued up. Modules
+// may hold back packets until this is called or they next receive.
+void NET_FlushPackets(net_context_t *context);
+
 // Return a string representation of the given address. The result points to a
 // static buffer and will become invalid with the next call.
 char *NET_AddrToString(net_addr_t *addr);
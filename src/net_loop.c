@@ -98,7 +98,7 @@ static boolean NET_CL_InitServer(void)
 
 static void NET_CL_SendPacket(net_addr_t *addr, net_packet_t *packet)
 {
-    QueuePush(&server_queue, NET_PacketDup(packet));
+    QueuePush(&server_queue, NET_PacketShare(packet));
 }
 
 static boolean NET_CL_RecvPacket(net_addr_t **addr, net_packet_t **packet)
@@ -151,6 +151,8 @@ net_module_t net_loop_client_module =
     NET_CL_AddrToString,
     NET_CL_FreeAddress,
     NET_CL_ResolveAddress,
+    NULL,
+    NULL,
 };
 
 //-----------------------------------------------------------------------------
@@ -174,7 +176,7 @@ static boolean NET_SV_InitServer(void)
 
 static void NET_SV_SendPacket(net_addr_t *addr, net_packet_t *packet)
 {
-    QueuePush(&client_queue, NET_PacketDup(packet));
+    QueuePush(&client_queue, NET_PacketShare(packet));
 }
 
 static boolean NET_SV_RecvPacket(net_addr_t **addr, net_packet_t **packet)
@@ -226,6 +228,8 @@ net_module_t net_loop_server_module =
     NET_SV_AddrToString,
     NET_SV_FreeAddress,
     NET_SV_ResolveAddress,
+    NULL,
+    NULL,
 };
 
 
@@ -16,33 +16,149 @@
 //
 
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
+#include "i_system.h"
 #include "m_misc.h"
 #include "net_packet.h"
-#include "z_zone.h"
+
+// Packets and their buffers come from free lists kept outside the zone,
+// so a server doesn't allocate anything per tic once it's warmed up.
+// Buffers are in power of two size classes and counted, so that a packet
+// can be queued more than once without copying; writing to a shared
+// buffer copies it first.
+
+#define MIN_PACKET_CLASS 6   // 64 bytes
+#define NUM_PACKET_CLASSES 11 // Up to 64k; bigger buffers aren't kept
+#define MAX_FREE_PER_CLASS 64
+
+typedef struct packetbuf_s
+{
+    struct packetbuf_s *next; // On the free list
+    int refcount;
+    int sizeclass;
+} packetbuf_t;
+
+typedef struct packethead_s
+{
+    net_packet_t packet;      // Must be first
+    packetbuf_t *buf;
+    struct packethead_s *next;
+} packethead_t;
+
+static packetbuf_t *free_bufs[NUM_PACKET_CLASSES];
+static int num_free_bufs[NUM_PACKET_CLASSES];
+static packethead_t *free_heads;
 
 static int total_packet_memory = 0;
 
+static void *NET_PacketAlloc(size_t size)
+{
+    void *result = malloc(size);
+
+    if (result == NULL)
+    {
+        I_Error("NET_PacketAlloc: Failed to allocate %i bytes", (int) size);
+    }
+
+    return result;
+}
+
+static packetbuf_t *NET_NewPacketBuf(size_t size, size_t *alloced)
+{
+    packetbuf_t *buf;
+    int sizeclass;
+
+    for (sizeclass = 0; sizeclass < NUM_PACKET_CLASSES
+      && ((size_t) 1 << (sizeclass + MIN_PACKET_CLASS)) < size; ++sizeclass);
+
+    if (sizeclass < NUM_PACKET_CLASSES)
+    {
+        *alloced = (size_t) 1 << (sizeclass + MIN_PACKET_CLASS);
+    }
+    else
+    {
+        *alloced = size;
+    }
+
+    buf = sizeclass < NUM_PACKET_CLASSES ? free_bufs[sizeclass] : NULL;
+
+    if (buf != NULL)
+    {
+        free_bufs[sizeclass] = buf->next;
+        --num_free_bufs[sizeclass];
+    }
+    else
+    {
+        buf = NET_PacketAlloc(sizeof(packetbuf_t) + *alloced);
+        total_packet_memory += *alloced;
+    }
+
+    buf->next = NULL;
+    buf->refcount = 1;
+    buf->sizeclass = sizeclass;
+
+    return buf;
+}
+
+static void NET_ReleasePacketBuf(packetbuf_t *buf, size_t alloced)
+{
+    if (--buf->refcount > 0)
+    {
+        return;
+    }
+
+    if (buf->sizeclass < NUM_PACKET_CLASSES
+     && num_free_bufs[buf->sizeclass] < MAX_FREE_PER_CLASS)
+    {
+        buf->next = free_bufs[buf->sizeclass];
+        free_bufs[buf->sizeclass] = buf;
+        ++num_free_bufs[buf->sizeclass];
+    }
+    else
+    {
+        total_packet_memory -= alloced;
+        free(buf);
+    }
+}
+
+static net_packet_t *NET_NewPacketHead(packetbuf_t *buf, size_t alloced)
+{
+    packethead_t *head = free_heads;
+
+    if (head != NULL)
+    {
+        free_heads = head->next;
+    }
+    else
+    {
+        head = NET_PacketAlloc(sizeof(packethead_t));
+        total_packet_memory += sizeof(packethead_t);
+    }
+
+    head->buf = buf;
+    head->next = NULL;
+    head->packet.data = (byte *) (buf + 1);
+    head->packet.alloced = alloced;
+    head->packet.len = 0;
+    head->packet.pos = 0;
+
+    return &head->packet;
+}
+
 net_packet_t *NET_NewPacket(int initial_size)
 {
-    net_packet_t *packet;
+    packetbuf_t *buf;
+    size_t alloced;
 
-    packet = (net_packet_t *) Z_Malloc(sizeof(net_packet_t), PU_STATIC, 0);
-    
     if (initial_size == 0)
         initial_size = 256;
 
-    packet->alloced = initial_size;
-    packet->data = Z_Malloc(initial_size, PU_STATIC, 0);
-    packet->len = 0;
-    packet->pos = 0;
-
-    total_packet_memory += sizeof(net_packet_t) + initial_size;
+    buf = NET_NewPacketBuf(initial_size, &alloced);
 
     //printf("total packet memory: %i bytes\n", total_packet_memory);
-    //printf("%p: allocated\n", packet);
 
-    return packet;
+    return NET_NewPacketHead(buf, alloced);
 }
 
 // duplicates an existing packet
@@ -58,13 +174,58 @@ net_packet_t *NET_PacketDup(net_packet_t *packet)
     return newpacket;
 }
 
+// Another packet with the same contents, read from the start. The data
+// is shared until one of them is written to.
+
+net_packet_t *NET_PacketShare(net_packet_t *packet)
+{
+    packethead_t *head = (packethead_t *) packet;
+    net_packet_t *newpacket;
+
+    ++head->buf->refcount;
+    newpacket = NET_NewPacketHead(head->buf, packet->alloced);
+    newpacket->len = packet->len;
+
+    return newpacket;
+}
+
 void NET_FreePacket(net_packet_t *packet)
 {
-    //printf("%p: destroyed\n", packet);
-    
-    total_packet_memory -= sizeof(net_packet_t) + packet->alloced;
-    Z_Free(packet->data);
-    Z_Free(packet);
+    packethead_t *head = (packethead_t *) packet;
+
+    NET_ReleasePacketBuf(head->buf, packet->alloced);
+
+    head->next = free_heads;
+    free_heads = head;
+}
+
+// Make room to write size more bytes, into a buffer of our own.
+
+static void NET_ReservePacket(net_packet_t *packet, size_t size)
+{
+    packethead_t *head = (packethead_t *) packet;
+    packetbuf_t *newbuf;
+    size_t alloced;
+
+    if (head->buf->refcount == 1 && packet->len + size <= packet->alloced)
+    {
+        return;
+    }
+
+    alloced = packet->alloced;
+
+    while (packet->len + size > alloced)
+    {
+        alloced *= 2;
+    }
+
+    newbuf = NET_NewPacketBuf(alloced, &alloced);
+    memcpy(newbuf + 1, packet->data, packet->len);
+    NET_ReleasePacketBuf(head->buf, packet->alloced);
+
+    head->buf = newbuf;
+    packet->data = (byte *) (newbuf + 1);
+    packet->alloced = alloced;
 }
 
 // Read a byte from the packet, returning true if read
@@ -236,30 +397,11 @@ char *NET_ReadSafeString(net_packet_t *packet)
 
 // Dynamically increases the size of a packet
 
-static void NET_IncreasePacket(net_packet_t *packet)
-{
-    byte *newdata;
-
-    total_packet_memory -= packet->alloced;
-   
-    packet->alloced *= 2;
-
-    newdata = Z_Malloc(packet->alloced, PU_STATIC, 0);
-
-    memcpy(newdata, packet->data, packet->len);
-
-    Z_Free(packet->data);
-    packet->data = newdata;
-
-    total_packet_memory += packet->alloced;
-}
-
 // Write a single byte to the packet
 
 void NET_WriteInt8(net_packet_t *packet, unsigned int i)
 {
-    if (packet->len + 1 > packet->alloced)
-        NET_IncreasePacket(packet);
+    NET_ReservePacket(packet, 1);
 
     packet->data[packet->len] = i;
     packet->len += 1;
@@ -271,8 +413,7 @@ void NET_WriteInt16(net_packet_t *packet, unsigned int i)
 {
     byte *p;
     
-    if (packet->len + 2 > packet->alloced)
-        NET_IncreasePacket(packet);
+    NET_ReservePacket(packet, 2);
 
     p = packet->data + packet->len;
 
@@ -289,8 +430,7 @@ void NET_WriteInt32(net_packet_t *packet, unsigned int i)
 {
     byte *p;
 
-    if (packet->len + 4 > packet->alloced)
-        NET_IncreasePacket(packet);
+    NET_ReservePacket(packet, 4);
 
     p = packet->data + packet->len;
 
@@ -309,12 +449,7 @@ void NET_WriteString(net_packet_t *packet, const char *string)
 
     string_size = strlen(string) + 1;
 
-    // Increase the packet size until large enough to hold the string
-
-    while (packet->len + string_size > packet->alloced)
-    {
-        NET_IncreasePacket(packet);
-    }
+    NET_ReservePacket(packet, string_size);
 
     p = packet->data + packet->len;
 
@@ -30,7 +30,7 @@
 #include "net_packet.h"
 #include "net_query.h"
 #include "net_structrw.h"
-#include "net_sdl.h"
+#include "net_udp.h"
 
 // DNS address of the Internet master server.
 
@@ -40,6 +40,11 @@
 
 #define QUERY_TIMEOUT_SECS 2
 
+// [AP] Servers on the LAN answer a broadcast within milliseconds, so
+// it's repeated, and given up on, sooner.
+
+#define BROADCAST_TIMEOUT_MS 500
+
 // Time to wait for secure demo signatures before declaring a timeout.
 
 #define SIGNATURE_TIMEOUT_SECS 5
@@ -84,7 +89,6 @@ static int num_targets;
 
 static boolean query_loop_running = false;
 static boolean printed_header = false;
-static int last_query_time = 0;
 
 static char *securedemo_start_message = NULL;
 
@@ -415,7 +419,9 @@ static void NET_Query_GetResponse(net_query_callback_t callback,
     net_addr_t *addr;
     net_packet_t *packet;
 
-    if (NET_RecvPacket(query_context, &addr, &packet))
+    // [AP] Everything that has come in, so results show up together
+
+    while (NET_RecvPacket(query_context, &addr, &packet))
     {
         NET_Query_ParsePacket(addr, packet, callback, user_data);
         NET_ReleaseAddress(addr);
@@ -423,64 +429,64 @@ static void NET_Query_GetResponse(net_query_callback_t callback,
     }
 }
 
-// Find a target we have not yet queried and send a query.
+// [AP] How long to wait for an answer to a query before repeating it
 
-static void SendOneQuery(void)
+static unsigned int TargetTimeout(query_target_t *target)
 {
-    unsigned int now;
-    unsigned int i;
+    if (target->type == QUERY_TARGET_BROADCAST)
+    {
+        return BROADCAST_TIMEOUT_MS;
+    }
 
-    now = I_GetTimeMS();
+    return QUERY_TIMEOUT_SECS * 1000;
+}
 
-    // Rate limit - only send one query every 50ms.
+// Send a query to every target not queried yet, or whose last query
+// timed out without a response, all in one burst.
 
-    if (now - last_query_time < 50)
-    {
-        return;
-    }
+static void SendQueries(void)
+{
+    unsigned int now;
+    int i;
+
+    now = I_GetTimeMS();
 
     for (i = 0; i < num_targets; ++i)
     {
         // Not queried yet?
         // Or last query timed out without a response?
 
-        if (targets[i].state == QUERY_TARGET_QUEUED
-         || (targets[i].state == QUERY_TARGET_QUERIED
-             && now - targets[i].query_time > QUERY_TIMEOUT_SECS * 1000))
+        if (targets[i].state != QUERY_TARGET_QUEUED
+         && (targets[i].state != QUERY_TARGET_QUERIED
+          || now - targets[i].query_time <= TargetTimeout(&targets[i])))
         {
-            break;
+            continue;
         }
-    }
 
-    if (i >= num_targets)
-    {
-        return;
-    }
+        // Send a query; how to do this depends on the target type.
 
-    // Found a target to query.  Send a query; how to do this depends on
-    // the target type.
+        switch (targets[i].type)
+        {
+            case QUERY_TARGET_SERVER:
+                NET_Query_SendQuery(targets[i].addr);
+                break;
 
-    switch (targets[i].type)
-    {
-        case QUERY_TARGET_SERVER:
-            NET_Query_SendQuery(targets[i].addr);
-            break;
+            case QUERY_TARGET_BROADCAST:
+                NET_Query_SendQuery(NULL);
+                break;
 
-        case QUERY_TARGET_BROADCAST:
-            NET_Query_SendQuery(NULL);
-            break;
+            case QUERY_TARGET_MASTER:
+                NET_Query_SendMasterQuery(targets[i].addr);
+                break;
+        }
 
-        case QUERY_TARGET_MASTER:
-            NET_Query_SendMasterQuery(targets[i].addr);
-            break;
+        //printf("Queried %s\n", NET_AddrToString(targets[i].addr));
+        targets[i].state = QUERY_TARGET_QUERIED;
+        targets[i].query_time = now;
+        ++targets[i].query_attempts;
     }
 
-    //printf("Queried %s\n", NET_AddrToString(targets[i].addr));
-    targets[i].state = QUERY_TARGET_QUERIED;
-    targets[i].query_time = now;
-    ++targets[i].query_attempts;
-
-    last_query_time = now;
+    NET_FlushPackets(query_context);
 }
 
 // Time out servers that have been queried and not responded.
@@ -506,7 +512,7 @@ static void CheckTargetTimeouts(void)
 
         if (targets[i].state == QUERY_TARGET_QUERIED
          && targets[i].query_attempts >= QUERY_MAX_ATTEMPTS
-         && now - targets[i].query_time > QUERY_TIMEOUT_SECS * 1000)
+         && now - targets[i].query_time > TargetTimeout(&targets[i]))
         {
             targets[i].state = QUERY_TARGET_NO_RESPONSE;
 
@@ -544,15 +550,15 @@ static boolean AllTargetsDone(void)
 
 int NET_Query_Poll(net_query_callback_t callback, void *user_data)
 {
-    CheckTargetTimeouts();
+    // Check for responses first, so they aren't timed late
 
-    // Send a query.  This will only send a single query at once.
+    NET_Query_GetResponse(callback, user_data);
 
-    SendOneQuery();
+    CheckTargetTimeouts();
 
-    // Check for a response
+    // Send all the queries that are due.
 
-    NET_Query_GetResponse(callback, user_data);
+    SendQueries();
 
     return !AllTargetsDone();
 }
@@ -573,9 +579,14 @@ static void NET_Query_QueryLoop(net_query_callback_t callback, void *user_data)
 
     while (query_loop_running && NET_Query_Poll(callback, user_data))
     {
-        // Don't thrash the CPU
+        // [AP] Sleep until a response comes in; resends and timeouts
+        // can wait this long
 
-        I_Sleep(1);
+        if (NET_UDP_DefaultModule()->WaitPacket == NULL
+         || !NET_UDP_DefaultModule()->WaitPacket(20))
+        {
+            I_Sleep(1);
+        }
     }
 }
 
@@ -584,8 +595,8 @@ void NET_Query_Init(void)
     if (query_context == NULL)
     {
         query_context = NET_NewContext();
-        NET_AddModule(query_context, &net_sdl_module);
-        net_sdl_module.InitClient();
+        NET_AddModule(query_context, NET_UDP_DefaultModule());
+        NET_UDP_DefaultModule()->InitClient();
     }
 
     free(targets);
@@ -1003,3 +1014,72 @@ char *NET_EndSecureDemo(sha1_digest_t demo_hash)
     return signature;
 }
 
+
+// [AP] Print the lag statistics a server keeps for each client. The
+// server must be running with -netstats.
+
+void NET_QueryStats(const char *addr_str)
+{
+    net_packet_t *request, *response = NULL;
+    net_clientstats_t stats;
+    net_addr_t *addr;
+    unsigned int num_clients;
+    unsigned int i, j;
+
+    NET_Query_Init();
+
+    addr = NET_ResolveAddress(query_context, addr_str);
+
+    if (addr == NULL)
+    {
+        I_Error("NET_QueryStats: Host '%s' not found!", addr_str);
+    }
+
+    printf("\nQuerying statistics from '%s'...\n", addr_str);
+
+    for (i = 0; i < QUERY_MAX_ATTEMPTS && response == NULL; ++i)
+    {
+        request = NET_NewPacket(10);
+        NET_WriteInt16(request, NET_PACKET_TYPE_STATS_QUERY);
+        NET_SendPacket(addr, request);
+        NET_FreePacket(request);
+
+        response = BlockForPacket(addr, NET_PACKET_TYPE_STATS_RESPONSE,
+                                  QUERY_TIMEOUT_SECS * 1000);
+    }
+
+    if (response == NULL)
+    {
+        I_Error("No response from '%s'; is it running with -netstats?",
+                addr_str);
+    }
+
+    if (!NET_ReadInt8(response, &num_clients))
+    {
+        num_clients = 0;
+    }
+
+    printf("\n%u client(s) connected.\n", num_clients);
+
+    for (i = 0; i < num_clients && NET_ReadClientStats(response, &stats); ++i)
+    {
+        printf("\n%s (%s):\n", stats.name,
+               stats.player_number < 0 ? "drone" : "player");
+        printf("  round trip: %ums, histogram:", stats.rtt);
+
+        for (j = 0; j < NET_RTT_BUCKETS; ++j)
+        {
+            printf(" %u", stats.rtt_histogram[j]);
+        }
+
+        printf("\n  tics lost: %u of %u\n",
+               stats.tics_lost, stats.tics_received + stats.tics_lost);
+        printf("  resend requests: %u, tics resent: %u\n",
+               stats.resend_requests, stats.tics_resent);
+        printf("  backlog: %u tics, deadlocks: %u\n",
+               stats.backlog, stats.deadlocks);
+    }
+
+    NET_FreePacket(response);
+    NET_ReleaseAddress(addr);
+}
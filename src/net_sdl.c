@@ -27,7 +27,6 @@
 #include "net_io.h"
 #include "net_packet.h"
 #include "net_sdl.h"
-#include "z_zone.h"
 
 //
 // NETWORKING
@@ -52,18 +51,24 @@ typedef struct
     IPaddress sdl_addr;
 } addrpair_t;
 
-static addrpair_t **addr_table;
-static int addr_table_size = -1;
+// Open addressing table of the addresses in use, keyed by host and port
+// and probed linearly. Entries are removed as soon as their refcount
+// drops to zero, so there are no tombstones: the entries after a removed
+// one are shifted back into the gap instead.
 
-// Initializes the address table
+static addrpair_t **addr_table;
+static unsigned int addr_table_size = 0;  // Power of two
+static unsigned int addr_table_used = 0;
 
-static void NET_SDL_InitAddrTable(void)
+static unsigned int AddressHash(const IPaddress *addr)
 {
-    addr_table_size = 16;
+    unsigned int h;
+
+    h = (unsigned int) addr->host * 0x9e3779b1u;
+    h ^= (unsigned int) addr->port * 0x85ebca6bu;
+    h ^= h >> 15;
 
-    addr_table = Z_Malloc(sizeof(addrpair_t *) * addr_table_size,
-                          PU_STATIC, 0);
-    memset(addr_table, 0, sizeof(addrpair_t *) * addr_table_size);
+    return h & (addr_table_size - 1);
 }
 
 static boolean AddressesEqual(IPaddress *a, IPaddress *b)
@@ -72,89 +77,134 @@ static boolean AddressesEqual(IPaddress *a, IPaddress *b)
         && a->port == b->port;
 }
 
-// Finds an address by searching the table.  If the address is not found,
+static void NET_SDL_ResizeAddrTable(unsigned int new_size)
+{
+    addrpair_t **old_table = addr_table;
+    unsigned int old_size = addr_table_size;
+    unsigned int i, j;
+
+    addr_table = calloc(new_size, sizeof(addrpair_t *));
+
+    if (addr_table == NULL)
+    {
+        I_Error("NET_SDL_ResizeAddrTable: Failed to allocate address table");
+    }
+
+    addr_table_size = new_size;
+
+    for (i = 0; i < old_size; ++i)
+    {
+        if (old_table[i] == NULL)
+        {
+            continue;
+        }
+
+        for (j = AddressHash(&old_table[i]->sdl_addr); addr_table[j] != NULL;
+             j = (j + 1) & (addr_table_size - 1));
+
+        addr_table[j] = old_table[i];
+    }
+
+    free(old_table);
+}
+
+// Finds an address in the table.  If the address is not found,
 // it is added to the table.
 
 static net_addr_t *NET_SDL_FindAddress(IPaddress *addr)
 {
     addrpair_t *new_entry;
-    int empty_entry = -1;
-    int i;
+    unsigned int i;
 
-    if (addr_table_size < 0)
+    if (addr_table_size == 0)
     {
-        NET_SDL_InitAddrTable();
+        NET_SDL_ResizeAddrTable(16);
     }
 
-    for (i=0; i<addr_table_size; ++i)
+    for (i = AddressHash(addr); addr_table[i] != NULL;
+         i = (i + 1) & (addr_table_size - 1))
     {
-        if (addr_table[i] != NULL
-         && AddressesEqual(addr, &addr_table[i]->sdl_addr))
+        if (AddressesEqual(addr, &addr_table[i]->sdl_addr))
         {
             return &addr_table[i]->net_addr;
         }
-
-        if (empty_entry < 0 && addr_table[i] == NULL)
-            empty_entry = i;
     }
 
-    // Was not found in list.  We need to add it.
-
-    // Is there any space in the table? If not, increase the table size
+    // Was not found in table.  We need to add it, keeping the table at
+    // most half full.
 
-    if (empty_entry < 0)
+    if ((addr_table_used + 1) * 2 > addr_table_size)
     {
-        addrpair_t **new_addr_table;
-        int new_addr_table_size;
-
-        // after reallocing, we will add this in as the first entry
-        // in the new block of memory
-
-        empty_entry = addr_table_size;
-        
-        // allocate a new array twice the size, init to 0 and copy 
-        // the existing table in.  replace the old table.
-
-        new_addr_table_size = addr_table_size * 2;
-        new_addr_table = Z_Malloc(sizeof(addrpair_t *) * new_addr_table_size,
-                                  PU_STATIC, 0);
-        memset(new_addr_table, 0, sizeof(addrpair_t *) * new_addr_table_size);
-        memcpy(new_addr_table, addr_table, 
-               sizeof(addrpair_t *) * addr_table_size);
-        Z_Free(addr_table);
-        addr_table = new_addr_table;
-        addr_table_size = new_addr_table_size;
+        NET_SDL_ResizeAddrTable(addr_table_size * 2);
+
+        for (i = AddressHash(addr); addr_table[i] != NULL;
+             i = (i + 1) & (addr_table_size - 1));
     }
 
-    // Add a new entry
-    
-    new_entry = Z_Malloc(sizeof(addrpair_t), PU_STATIC, 0);
+    new_entry = malloc(sizeof(addrpair_t));
+
+    if (new_entry == NULL)
+    {
+        I_Error("NET_SDL_FindAddress: Failed to allocate address");
+    }
 
     new_entry->sdl_addr = *addr;
     new_entry->net_addr.refcount = 0;
     new_entry->net_addr.handle = &new_entry->sdl_addr;
     new_entry->net_addr.module = &net_sdl_module;
 
-    addr_table[empty_entry] = new_entry;
+    addr_table[i] = new_entry;
+    ++addr_table_used;
 
     return &new_entry->net_addr;
 }
 
 static void NET_SDL_FreeAddress(net_addr_t *addr)
 {
-    int i;
-    
-    for (i=0; i<addr_table_size; ++i)
+    unsigned int i, j, home;
+
+    if (addr_table_size == 0)
     {
-        if (addr == &addr_table[i]->net_addr)
+        I_Error("NET_SDL_FreeAddress: Attempted to remove an unused address!");
+    }
+
+    for (i = AddressHash(addr->handle); addr_table[i] != NULL;
+         i = (i + 1) & (addr_table_size - 1))
+    {
+        if (&addr_table[i]->net_addr == addr)
         {
-            Z_Free(addr_table[i]);
-            addr_table[i] = NULL;
-            return;
+            break;
         }
     }
 
-    I_Error("NET_SDL_FreeAddress: Attempted to remove an unused address!");
+    if (addr_table[i] == NULL)
+    {
+        I_Error("NET_SDL_FreeAddress: Attempted to remove an unused address!");
+    }
+
+    free(addr_table[i]);
+    addr_table[i] = NULL;
+    --addr_table_used;
+
+    // Move back the following entries that can no longer be reached
+    // across the gap.
+
+    for (j = (i + 1) & (addr_table_size - 1); addr_table[j] != NULL;
+         j = (j + 1) & (addr_table_size - 1))
+    {
+        home = AddressHash(&addr_table[j]->sdl_addr);
+
+        // Leave it alone if its home slot is cyclically in (i, j]
+        if (((j - home) & (addr_table_size - 1))
+          < ((j - i) & (addr_table_size - 1)))
+        {
+            continue;
+        }
+
+        addr_table[i] = addr_table[j];
+        addr_table[j] = NULL;
+        i = j;
+    }
 }
 
 static boolean NET_SDL_InitClient(void)
@@ -378,6 +428,8 @@ net_module_t net_sdl_module =
     NET_SDL_AddrToString,
     NET_SDL_FreeAddress,
     NET_SDL_ResolveAddress,
+    NULL,
+    NULL,
 };
 
 
@@ -435,6 +487,8 @@ net_module_t net_sdl_module =
     NET_NULL_AddrToString,
     NET_NULL_FreeAddress,
     NET_NULL_ResolveAddress,
+    NULL,
+    NULL,
 };
 
 
@@ -90,10 +90,11 @@ typedef struct
     boolean recording_lowres;
 
     // send queue: items to send to the client
-    // this is a circular buffer
+    // this is a circular buffer of BACKUPTICS entries, only allocated
+    // while the client is active
 
     int sendseq;
-    net_full_ticcmd_t sendqueue[BACKUPTICS];
+    net_full_ticcmd_t *sendqueue;
 
     // Latest acknowledged by the client
 
@@ -120,6 +121,12 @@ typedef struct
 
     int player_class;
 
+    // [AP] Statistics, and when each tic in the send queue first went
+    // out, for measuring the round trip
+
+    net_clientstats_t stats;
+    unsigned int send_time[BACKUPTICS];
+
 } net_client_t;
 
 // structure used for the recv window
@@ -143,27 +150,46 @@ typedef struct
     net_ticdiff_t diff;
 } net_client_recv_t;
 
-static net_server_state_t server_state;
-static boolean server_initialized = false;
-static net_client_t clients[MAXNETNODES];
-static net_client_t *sv_players[NET_MAXPLAYERS];
-static net_context_t *server_context;
-static unsigned int sv_gamemode;
-static unsigned int sv_gamemission;
-static net_gamesettings_t sv_settings;
+// [AP] Everything one game needs, so that a dedicated server can host
+// many of them.
+
+struct _net_server_s
+{
+    net_server_state_t state;
+    boolean initialized;
+    net_client_t clients[MAXNETNODES];
+    net_client_t *players[NET_MAXPLAYERS];
+    net_context_t *context;
+    unsigned int gamemode;
+    unsigned int gamemission;
+    net_gamesettings_t settings;
+
+    // For registration with master server:
+
+    net_addr_t *master_server;
+    unsigned int master_refresh_time;
+    unsigned int master_resolve_time;
+
+    // receive window
+
+    unsigned int recvwindow_start;
+    net_client_recv_t recvwindow[BACKUPTICS][NET_MAXPLAYERS];
 
-// For registration with master server:
+    // Last time statistics were logged
 
-static net_addr_t *master_server = NULL;
-static unsigned int master_refresh_time;
-static unsigned int master_resolve_time;
+    unsigned int stats_time;
+};
 
-// receive window
+// The server the NET_SV_* functions act on
 
-static unsigned int recvwindow_start;
-static net_client_recv_t recvwindow[BACKUPTICS][NET_MAXPLAYERS];
+static net_server_t default_server;
+static net_server_t *sv = &default_server;
 
-#define NET_SV_ExpandTicNum(b) NET_ExpandTicNum(recvwindow_start, (b))
+// [AP] Seconds between statistics log lines, from -netstats; 0 if off
+
+static int stats_period = -1;
+
+#define NET_SV_ExpandTicNum(b) NET_ExpandTicNum(sv->recvwindow_start, (b))
 
 static void NET_SV_DisconnectClient(net_client_t *client)
 {
@@ -216,9 +242,9 @@ static void NET_SV_BroadcastMessage(const char *s, ...)
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]))
+        if (ClientConnected(&sv->clients[i]))
         {
-            NET_SV_SendConsoleMessage(&clients[i], "%s", buf);
+            NET_SV_SendConsoleMessage(&sv->clients[i], "%s", buf);
         }
     }
 
@@ -237,24 +263,24 @@ static void NET_SV_AssignPlayers(void)
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]))
+        if (ClientConnected(&sv->clients[i]))
         {
-            if (!clients[i].drone)
+            if (!sv->clients[i].drone)
             {
-                sv_players[pl] = &clients[i];
-                sv_players[pl]->player_number = pl;
+                sv->players[pl] = &sv->clients[i];
+                sv->players[pl]->player_number = pl;
                 ++pl;
             }
             else
             {
-                clients[i].player_number = -1;
+                sv->clients[i].player_number = -1;
             }
         }
     }
 
     for (; pl<NET_MAXPLAYERS; ++pl)
     {
-        sv_players[pl] = NULL;
+        sv->players[pl] = NULL;
     }
 }
 
@@ -269,7 +295,7 @@ static int NET_SV_NumPlayers(void)
 
     for (i=0; i<NET_MAXPLAYERS; ++i)
     {
-        if (sv_players[i] != NULL && ClientConnected(sv_players[i]))
+        if (sv->players[i] != NULL && ClientConnected(sv->players[i]))
         {
             result += 1;
         }
@@ -287,8 +313,8 @@ static int NET_SV_NumReadyPlayers(void)
 
     for (i = 0; i < MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i])
-         && !clients[i].drone && clients[i].ready)
+        if (ClientConnected(&sv->clients[i])
+         && !sv->clients[i].drone && sv->clients[i].ready)
         {
             ++result;
         }
@@ -305,9 +331,9 @@ static int NET_SV_MaxPlayers(void)
 
     for (i = 0; i < MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]))
+        if (ClientConnected(&sv->clients[i]))
         {
-            return clients[i].max_players;
+            return sv->clients[i].max_players;
         }
     }
 
@@ -325,7 +351,7 @@ static int NET_SV_NumDrones(void)
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]) && clients[i].drone)
+        if (ClientConnected(&sv->clients[i]) && sv->clients[i].drone)
         {
             result += 1;
         }
@@ -345,7 +371,7 @@ static int NET_SV_NumClients(void)
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]))
+        if (ClientConnected(&sv->clients[i]))
         {
             ++count;
         }
@@ -369,14 +395,14 @@ static net_client_t *NET_SV_Controller(void)
     {
         // Can't be controller?
 
-        if (!ClientConnected(&clients[i]) || clients[i].drone)
+        if (!ClientConnected(&sv->clients[i]) || sv->clients[i].drone)
         {
             continue;
         }
 
-        if (best == NULL || clients[i].connect_time < best->connect_time)
+        if (best == NULL || sv->clients[i].connect_time < best->connect_time)
         {
-            best = &clients[i];
+            best = &sv->clients[i];
         }
     }
 
@@ -421,10 +447,10 @@ static void NET_SV_SendWaitingData(net_client_t *client)
     for (i = 0; i < wait_data.num_players; ++i)
     {
         M_StringCopy(wait_data.player_names[i],
-                     sv_players[i]->name,
+                     sv->players[i]->name,
                      MAXPLAYERNAME);
         M_StringCopy(wait_data.player_addrs[i],
-                     NET_AddrToString(sv_players[i]->addr),
+                     NET_AddrToString(sv->players[i]->addr),
                      MAXPLAYERNAME);
     }
 
@@ -450,11 +476,11 @@ static unsigned int NET_SV_LatestAcknowledged(void)
 
     for (i=0; i<MAXNETNODES; ++i) 
     {
-        if (ClientConnected(&clients[i]))
+        if (ClientConnected(&sv->clients[i]))
         {
-            if (clients[i].acknowledged < lowtic)
+            if (sv->clients[i].acknowledged < lowtic)
             {
-                lowtic = clients[i].acknowledged;
+                lowtic = sv->clients[i].acknowledged;
             }
         }
     }
@@ -480,7 +506,7 @@ static void NET_SV_AdvanceWindow(void)
 
     // Advance the recv window until it catches up with lowtic
 
-    while (recvwindow_start < lowtic)
+    while (sv->recvwindow_start < lowtic)
     {
         boolean should_advance;
 
@@ -491,12 +517,12 @@ static void NET_SV_AdvanceWindow(void)
 
         for (i=0; i<NET_MAXPLAYERS; ++i)
         {
-            if (sv_players[i] == NULL || !ClientConnected(sv_players[i]))
+            if (sv->players[i] == NULL || !ClientConnected(sv->players[i]))
             {
                 continue;
             }
 
-            if (!recvwindow[0][i].active)
+            if (!sv->recvwindow[0][i].active)
             {
                 should_advance = false;
                 break;
@@ -514,11 +540,11 @@ static void NET_SV_AdvanceWindow(void)
         
         // Advance the window
 
-        memmove(recvwindow, recvwindow + 1,
-                sizeof(*recvwindow) * (BACKUPTICS - 1));
-        memset(&recvwindow[BACKUPTICS-1], 0, sizeof(*recvwindow));
-        ++recvwindow_start;
-        NET_Log("server: advanced receive window to %d", recvwindow_start);
+        memmove(sv->recvwindow, sv->recvwindow + 1,
+                sizeof(*sv->recvwindow) * (BACKUPTICS - 1));
+        memset(&sv->recvwindow[BACKUPTICS-1], 0, sizeof(*sv->recvwindow));
+        ++sv->recvwindow_start;
+        NET_Log("server: advanced receive window to %d", sv->recvwindow_start);
     }
 }
 
@@ -530,11 +556,11 @@ static net_client_t *NET_SV_FindClient(net_addr_t *addr)
 
     for (i=0; i<MAXNETNODES; ++i) 
     {
-        if (clients[i].active && clients[i].addr == addr)
+        if (sv->clients[i].active && sv->clients[i].addr == addr)
         {
             // found the client
 
-            return &clients[i];
+            return &sv->clients[i];
         }
     }
 
@@ -575,7 +601,19 @@ static void NET_SV_InitNewClient(net_client_t *client, net_addr_t *addr,
 
     client->last_gamedata_time = 0;
 
-    memset(client->sendqueue, 0xff, sizeof(client->sendqueue));
+    memset(&client->stats, 0, sizeof(client->stats));
+
+    if (client->sendqueue == NULL)
+    {
+        client->sendqueue = malloc(BACKUPTICS * sizeof(*client->sendqueue));
+
+        if (client->sendqueue == NULL)
+        {
+            I_Error("NET_SV_InitNewClient: out of memory");
+        }
+    }
+
+    memset(client->sendqueue, 0xff, BACKUPTICS * sizeof(*client->sendqueue));
 
     NET_Log("server: initialized new client from %s", NET_AddrToString(addr));
 }
@@ -675,10 +713,10 @@ static void NET_SV_ParseSYN(net_packet_t *packet, net_client_t *client,
     // At this point we have received a valid SYN.
 
     // Not accepting new connections?
-    if (server_state != SERVER_WAITING_LAUNCH)
+    if (sv->state != SERVER_WAITING_LAUNCH)
     {
         NET_Log("server: error: not in waiting launch state, server_state=%d",
-                server_state);
+                sv->state);
         NET_SV_SendReject(addr,
                           "Server is not currently accepting connections");
         return;
@@ -704,23 +742,23 @@ static void NET_SV_ParseSYN(net_packet_t *packet, net_client_t *client,
     // Adopt the game mode and mission of the first connecting client:
     if (num_players == 0 && !data.drone)
     {
-        sv_gamemode = data.gamemode;
-        sv_gamemission = data.gamemission;
+        sv->gamemode = data.gamemode;
+        sv->gamemission = data.gamemission;
         NET_Log("server: new game, mode=%d, mission=%d",
-                sv_gamemode, sv_gamemission);
+                sv->gamemode, sv->gamemission);
     }
 
     // Check the connecting client is playing the same game as all
     // the other clients
-    if (data.gamemode != sv_gamemode || data.gamemission != sv_gamemission)
+    if (data.gamemode != sv->gamemode || data.gamemission != sv->gamemission)
     {
         char msg[128];
         NET_Log("server: wrong mode/mission, %d != %d || %d != %d",
-                data.gamemode, sv_gamemode, data.gamemission, sv_gamemission);
+                data.gamemode, sv->gamemode, data.gamemission, sv->gamemission);
         M_snprintf(msg, sizeof(msg),
                    "Game mismatch: server is %s (%s), client is %s (%s)",
-                   D_GameMissionString(sv_gamemission),
-                   D_GameModeString(sv_gamemode),
+                   D_GameMissionString(sv->gamemission),
+                   D_GameModeString(sv->gamemode),
                    D_GameMissionString(data.gamemission),
                    D_GameModeString(data.gamemode));
 
@@ -735,9 +773,9 @@ static void NET_SV_ParseSYN(net_packet_t *packet, net_client_t *client,
 
         for (i=0; i<MAXNETNODES; ++i)
         {
-            if (!clients[i].active)
+            if (!sv->clients[i].active)
             {
-                client = &clients[i];
+                client = &sv->clients[i];
                 break;
             }
         }
@@ -807,10 +845,10 @@ static void NET_SV_ParseLaunch(net_packet_t *packet, net_client_t *client)
 
     // Can only launch when we are in the waiting state.
 
-    if (server_state != SERVER_WAITING_LAUNCH)
+    if (sv->state != SERVER_WAITING_LAUNCH)
     {
         NET_Log("server: error: not in waiting launch state, state=%d",
-                server_state);
+                sv->state);
         return;
     }
 
@@ -821,17 +859,17 @@ static void NET_SV_ParseLaunch(net_packet_t *packet, net_client_t *client)
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (!ClientConnected(&clients[i]))
+        if (!ClientConnected(&sv->clients[i]))
             continue;
 
-        launchpacket = NET_Conn_NewReliable(&clients[i].connection,
+        launchpacket = NET_Conn_NewReliable(&sv->clients[i].connection,
                                             NET_PACKET_TYPE_LAUNCH);
         NET_WriteInt8(launchpacket, num_players);
     }
 
     // Now in launch state.
 
-    server_state = SERVER_WAITING_START;
+    sv->state = SERVER_WAITING_START;
 }
 
 // Transition to the in-game state and send all players the start game
@@ -850,29 +888,29 @@ static void StartGame(void)
 
     // Check if anyone is recording a demo and set lowres_turn if so.
 
-    sv_settings.lowres_turn = false;
+    sv->settings.lowres_turn = false;
 
     for (i = 0; i < NET_MAXPLAYERS; ++i)
     {
-        if (sv_players[i] != NULL && sv_players[i]->recording_lowres)
+        if (sv->players[i] != NULL && sv->players[i]->recording_lowres)
         {
-            sv_settings.lowres_turn = true;
+            sv->settings.lowres_turn = true;
         }
     }
 
-    sv_settings.num_players = NET_SV_NumPlayers();
+    sv->settings.num_players = NET_SV_NumPlayers();
 
     // Copy player classes:
 
     for (i = 0; i < NET_MAXPLAYERS; ++i)
     {
-        if (sv_players[i] != NULL)
+        if (sv->players[i] != NULL)
         {
-            sv_settings.player_classes[i] = sv_players[i]->player_class;
+            sv->settings.player_classes[i] = sv->players[i]->player_class;
         }
         else
         {
-            sv_settings.player_classes[i] = 0;
+            sv->settings.player_classes[i] = 0;
         }
     }
 
@@ -882,25 +920,25 @@ static void StartGame(void)
 
     for (i = 0; i < MAXNETNODES; ++i)
     {
-        if (!ClientConnected(&clients[i]))
+        if (!ClientConnected(&sv->clients[i]))
             continue;
 
-        clients[i].last_gamedata_time = nowtime;
+        sv->clients[i].last_gamedata_time = nowtime;
 
-        startpacket = NET_Conn_NewReliable(&clients[i].connection,
+        startpacket = NET_Conn_NewReliable(&sv->clients[i].connection,
                                            NET_PACKET_TYPE_GAMESTART);
 
-        sv_settings.consoleplayer = clients[i].player_number;
+        sv->settings.consoleplayer = sv->clients[i].player_number;
 
-        NET_WriteSettings(startpacket, &sv_settings);
+        NET_WriteSettings(startpacket, &sv->settings);
     }
 
     // Change server state
     NET_Log("server: beginning game state");
-    server_state = SERVER_IN_GAME;
+    sv->state = SERVER_IN_GAME;
 
-    memset(recvwindow, 0, sizeof(recvwindow));
-    recvwindow_start = 0;
+    memset(sv->recvwindow, 0, sizeof(sv->recvwindow));
+    sv->recvwindow_start = 0;
 }
 
 // Returns true when all nodes have indicated readiness to start the game.
@@ -911,7 +949,7 @@ static boolean AllNodesReady(void)
 
     for (i = 0; i < MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]) && !clients[i].ready)
+        if (ClientConnected(&sv->clients[i]) && !sv->clients[i].ready)
         {
             return false;
         }
@@ -943,9 +981,9 @@ static void SendAllWaitingData(void)
 
     for (i = 0; i < MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]) && clients[i].ready)
+        if (ClientConnected(&sv->clients[i]) && sv->clients[i].ready)
         {
-            NET_SV_SendWaitingData(&clients[i]);
+            NET_SV_SendWaitingData(&sv->clients[i]);
         }
     }
 }
@@ -960,10 +998,10 @@ static void NET_SV_ParseGameStart(net_packet_t *packet, net_client_t *client)
 
     // Can only start a game if we are in the waiting start state.
 
-    if (server_state != SERVER_WAITING_START)
+    if (sv->state != SERVER_WAITING_START)
     {
         NET_Log("server: error: not in waiting start state, server_state=%d",
-                server_state);
+                sv->state);
         return;
     }
 
@@ -978,13 +1016,13 @@ static void NET_SV_ParseGameStart(net_packet_t *packet, net_client_t *client)
 
         // Check the game settings are valid
 
-        if (!NET_ValidGameSettings(sv_gamemode, sv_gamemission, &settings))
+        if (!NET_ValidGameSettings(sv->gamemode, sv->gamemission, &settings))
         {
             NET_Log("server: error: invalid game settings");
             return;
         }
 
-        sv_settings = settings;
+        sv->settings = settings;
     }
 
     client->ready = true;
@@ -1011,6 +1049,8 @@ static void NET_SV_SendResendRequest(net_client_t *client, int start, int end)
     NET_Log("server: send resend to %s for tics %d-%d",
             NET_AddrToString(client->addr), start, end);
 
+    ++client->stats.resend_requests;
+
     packet = NET_NewPacket(20);
 
     NET_WriteInt16(packet, NET_PACKET_TYPE_GAMEDATA_RESEND);
@@ -1026,7 +1066,7 @@ static void NET_SV_SendResendRequest(net_client_t *client, int start, int end)
 
     for (i=start; i<=end; ++i)
     {
-        index = i - recvwindow_start;
+        index = i - sv->recvwindow_start;
 
         if (index >= BACKUPTICS)
         {
@@ -1035,7 +1075,7 @@ static void NET_SV_SendResendRequest(net_client_t *client, int start, int end)
             continue;
         }
         
-        recvobj = &recvwindow[index][client->player_number];
+        recvobj = &sv->recvwindow[index][client->player_number];
 
         recvobj->resend_time = nowtime;
     }
@@ -1061,7 +1101,7 @@ static void NET_SV_CheckResends(net_client_t *client)
         net_client_recv_t *recvobj;
         boolean need_resend;
 
-        recvobj = &recvwindow[i][player];
+        recvobj = &sv->recvwindow[i][player];
 
         // if need_resend is true, this tic needs another retransmit
         // request (300ms timeout)
@@ -1084,12 +1124,12 @@ static void NET_SV_CheckResends(net_client_t *client)
             // End of a run of resend tics
             NET_Log("server: resend request to %s timed out for %d-%d (%d)",
                     NET_AddrToString(client->addr),
-                    recvwindow_start + resend_start,
-                    recvwindow_start + resend_end,
-                    &recvwindow[resend_start][player].resend_time);
+                    sv->recvwindow_start + resend_start,
+                    sv->recvwindow_start + resend_end,
+                    &sv->recvwindow[resend_start][player].resend_time);
             NET_SV_SendResendRequest(client, 
-                                     recvwindow_start + resend_start,
-                                     recvwindow_start + resend_end);
+                                     sv->recvwindow_start + resend_start,
+                                     sv->recvwindow_start + resend_end);
 
             resend_start = -1;
         }
@@ -1099,20 +1139,59 @@ static void NET_SV_CheckResends(net_client_t *client)
     {
         NET_Log("server: resend request to %s timed out for %d-%d (%d)",
                 NET_AddrToString(client->addr),
-                recvwindow_start + resend_start,
-                recvwindow_start + resend_end,
-                &recvwindow[resend_start][player].resend_time);
+                sv->recvwindow_start + resend_start,
+                sv->recvwindow_start + resend_end,
+                &sv->recvwindow[resend_start][player].resend_time);
         NET_SV_SendResendRequest(client,
-                                 recvwindow_start + resend_start,
-                                 recvwindow_start + resend_end);
+                                 sv->recvwindow_start + resend_start,
+                                 sv->recvwindow_start + resend_end);
     }
 }
 
+// [AP] Move the acknowledgement point up, and time the round trip of
+// the last tic the client now has. Acks can wait for the client's next
+// ticcmd, so this reads up to a tic high.
+
+static void NET_SV_Acknowledge(net_client_t *client, unsigned int ackseq)
+{
+    unsigned int rtt;
+    int bucket;
+
+    if (ackseq <= client->acknowledged)
+    {
+        return;
+    }
+
+    NET_Log("server: acknowledged up to %d", ackseq);
+    client->acknowledged = ackseq;
+
+    if (ackseq > (unsigned int) client->sendseq
+     || client->sendseq - (ackseq - 1) > BACKUPTICS)
+    {
+        return;
+    }
+
+    rtt = I_GetTimeMS() - client->send_time[(ackseq - 1) % BACKUPTICS];
+    client->stats.rtt = rtt;
+
+    for (bucket = 0; bucket < NET_RTT_BUCKETS - 1; ++bucket)
+    {
+        if (rtt < (25u << bucket))
+        {
+            break;
+        }
+    }
+
+    ++client->stats.rtt_histogram[bucket];
+}
+
 // Process game data from a client
 
 static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
 {
     net_client_recv_t *recvobj;
+    net_ticpacker_t packer;
+    boolean packed;
     unsigned int seq;
     unsigned int ackseq;
     unsigned int num_tics;
@@ -1122,10 +1201,10 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
     int resend_start, resend_end;
     int index;
 
-    if (server_state != SERVER_IN_GAME)
+    if (sv->state != SERVER_IN_GAME)
     {
         NET_Log("server: error: not in game state: server_state=%d",
-                server_state);
+                sv->state);
         return;
     }
 
@@ -1159,18 +1238,29 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
 
     // Sanity checks
 
+    packed = client->connection.protocol == NET_PROTOCOL_APDOOM_PACKED_0;
+    NET_InitTicPacker(&packer, packet);
+
     for (i=0; i<num_tics; ++i)
     {
         net_ticdiff_t diff;
         signed int latency;
 
-        if (!NET_ReadSInt16(packet, &latency)
-         || !NET_ReadTiccmdDiff(packet, &diff, sv_settings.lowres_turn))
+        if (packed)
+        {
+            if (!NET_ReadPackedTiccmdDiff(&packer, &latency, &diff,
+                                          sv->settings.lowres_turn))
+            {
+                return;
+            }
+        }
+        else if (!NET_ReadSInt16(packet, &latency)
+              || !NET_ReadTiccmdDiff(packet, &diff, sv->settings.lowres_turn))
         {
             return;
         }
 
-        index = seq + i - recvwindow_start;
+        index = seq + i - sv->recvwindow_start;
 
         if (index < 0 || index >= BACKUPTICS)
         {
@@ -1179,7 +1269,13 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
             continue;
         }
 
-        recvobj = &recvwindow[index][player];
+        recvobj = &sv->recvwindow[index][player];
+
+        if (!recvobj->active)
+        {
+            ++client->stats.tics_received;
+        }
+
         recvobj->active = true;
         recvobj->diff = diff;
         recvobj->latency = latency;
@@ -1190,11 +1286,7 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
 
     // Higher acknowledgement point?
 
-    if (ackseq > client->acknowledged)
-    {
-        NET_Log("server: acknowledged up to %d", ackseq);
-        client->acknowledged = ackseq;
-    }
+    NET_SV_Acknowledge(client, ackseq);
 
     // Has this been received out of sequence, ie. have we not received
     // all tics before the first tic in this packet?  If so, send a 
@@ -1202,7 +1294,7 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
 
     //printf("SV: %p: %i\n", client, seq);
 
-    resend_end = seq - recvwindow_start;
+    resend_end = seq - sv->recvwindow_start;
 
     if (resend_end <= 0)
         return;
@@ -1215,7 +1307,7 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
     
     while (index >= 0)
     {
-        recvobj = &recvwindow[index][player];
+        recvobj = &sv->recvwindow[index][player];
 
         if (recvobj->active)
         {
@@ -1238,12 +1330,14 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
     // Possibly send a resend request
     if (resend_start < resend_end)
     {
+        client->stats.tics_lost += resend_end - resend_start;
+
         NET_Log("server: request resend for %d-%d before %d",
-                recvwindow_start + resend_start,
-                recvwindow_start + resend_end - 1, seq);
+                sv->recvwindow_start + resend_start,
+                sv->recvwindow_start + resend_end - 1, seq);
         NET_SV_SendResendRequest(client, 
-                                 recvwindow_start + resend_start, 
-                                 recvwindow_start + resend_end - 1);
+                                 sv->recvwindow_start + resend_start, 
+                                 sv->recvwindow_start + resend_end - 1);
     }
 }
 
@@ -1253,10 +1347,10 @@ static void NET_SV_ParseGameDataACK(net_packet_t *packet, net_client_t *client)
 
     NET_Log("server: processing game data ack packet");
 
-    if (server_state != SERVER_IN_GAME)
+    if (sv->state != SERVER_IN_GAME)
     {
         NET_Log("server: error: not in game state, server_state=%d",
-                server_state);
+                sv->state);
         return;
     }
 
@@ -1274,19 +1368,19 @@ static void NET_SV_ParseGameDataACK(net_packet_t *packet, net_client_t *client)
 
     // Higher acknowledgement point than we already have?
 
-    if (ackseq > client->acknowledged)
-    {
-        NET_Log("server: acknowledged up to %d", ackseq);
-        client->acknowledged = ackseq;
-    }
+    NET_SV_Acknowledge(client, ackseq);
 }
 
 static void NET_SV_SendTics(net_client_t *client, 
                             unsigned int start, unsigned int end)
 {
     net_packet_t *packet;
+    net_ticpacker_t packer;
+    boolean packed;
     unsigned int i;
 
+    packed = client->connection.protocol == NET_PROTOCOL_APDOOM_PACKED_0;
+
     packet = NET_NewPacket(500);
 
     NET_WriteInt16(packet, NET_PACKET_TYPE_GAMEDATA);
@@ -1298,6 +1392,8 @@ static void NET_SV_SendTics(net_client_t *client,
 
     // Write the tics
 
+    NET_InitTicPacker(&packer, packet);
+
     for (i=start; i<=end; ++i)
     {
         net_full_ticcmd_t *cmd;
@@ -1311,8 +1407,17 @@ static void NET_SV_SendTics(net_client_t *client,
 
         // Add command
        
-        NET_WriteFullTiccmd(packet, cmd, sv_settings.lowres_turn);
+        if (packed)
+        {
+            NET_WritePackedFullTiccmd(&packer, cmd, sv->settings.lowres_turn);
+        }
+        else
+        {
+            NET_WriteFullTiccmd(packet, cmd, sv->settings.lowres_turn);
+        }
     }
+
+    NET_FinishTicPacker(&packer);
     
     // Send packet
 
@@ -1366,6 +1471,7 @@ static void NET_SV_ParseResendRequest(net_packet_t *packet, net_client_t *client
 
     // Resend those tics
     NET_Log("server: resending tics %d-%d", start, last);
+    client->stats.tics_resent += last - start + 1;
     NET_SV_SendTics(client, start, last);
 }
 
@@ -1383,7 +1489,7 @@ void NET_SV_SendQueryResponse(net_addr_t *addr)
 
     // Server state
 
-    querydata.server_state = server_state;
+    querydata.server_state = sv->state;
 
     // Number of players/maximum players
 
@@ -1392,8 +1498,8 @@ void NET_SV_SendQueryResponse(net_addr_t *addr)
 
     // Game mode/mission
 
-    querydata.gamemode = sv_gamemode;
-    querydata.gamemission = sv_gamemission;
+    querydata.gamemode = sv->gamemode;
+    querydata.gamemission = sv->gamemission;
 
     //!
     // @category net
@@ -1422,6 +1528,119 @@ void NET_SV_SendQueryResponse(net_addr_t *addr)
     NET_FreePacket(reply);
 }
 
+// [AP] Statistics for a client, as they are sent and logged
+
+static void NET_SV_GetClientStats(net_client_t *client,
+                                  net_clientstats_t *stats)
+{
+    *stats = client->stats;
+    stats->name = client->name;
+    stats->player_number = client->drone ? -1 : client->player_number;
+    stats->backlog = client->sendseq - client->acknowledged;
+}
+
+static int NET_SV_StatsPeriod(void)
+{
+    int p;
+
+    if (stats_period < 0)
+    {
+        //!
+        // @category net
+        // @arg <secs>
+        //
+        // When running a server, print lag statistics for each client
+        // every <secs> seconds during the game, and answer statistics
+        // queries (-querystats).
+        //
+
+        p = M_CheckParmWithArgs("-netstats", 1);
+        stats_period = p > 0 ? atoi(myargv[p + 1]) : 0;
+
+        if (p > 0 && stats_period < 1)
+        {
+            stats_period = 1;
+        }
+    }
+
+    return stats_period;
+}
+
+static void NET_SV_SendStatsResponse(net_addr_t *addr)
+{
+    net_packet_t *reply;
+    net_clientstats_t stats;
+    int num_clients;
+    int i;
+
+    // Off unless asked for: the reply is much larger than the query
+
+    if (NET_SV_StatsPeriod() == 0)
+    {
+        return;
+    }
+
+    num_clients = 0;
+
+    for (i = 0; i < MAXNETNODES; ++i)
+    {
+        if (ClientConnected(&sv->clients[i]))
+        {
+            ++num_clients;
+        }
+    }
+
+    reply = NET_NewPacket(64 + num_clients * 96);
+    NET_WriteInt16(reply, NET_PACKET_TYPE_STATS_RESPONSE);
+    NET_WriteInt8(reply, num_clients);
+
+    for (i = 0; i < MAXNETNODES; ++i)
+    {
+        if (ClientConnected(&sv->clients[i]))
+        {
+            NET_SV_GetClientStats(&sv->clients[i], &stats);
+            NET_WriteClientStats(reply, &stats);
+        }
+    }
+
+    NET_Log("server: sending stats response to %s", NET_AddrToString(addr));
+    NET_SendPacket(addr, reply);
+    NET_FreePacket(reply);
+}
+
+static void NET_SV_LogStats(void)
+{
+    net_clientstats_t stats;
+    int i;
+
+    for (i = 0; i < MAXNETNODES; ++i)
+    {
+        if (!ClientConnected(&sv->clients[i]))
+        {
+            continue;
+        }
+
+        NET_SV_GetClientStats(&sv->clients[i], &stats);
+
+        printf("SV: %s: rtt %ums [%u %u %u %u %u %u %u %u], "
+               "%u/%u tics lost, %u resend requests, %u tics resent, "
+               "backlog %u, %u deadlocks\n",
+               stats.name, stats.rtt,
+               stats.rtt_histogram[0], stats.rtt_histogram[1],
+               stats.rtt_histogram[2], stats.rtt_histogram[3],
+               stats.rtt_histogram[4], stats.rtt_histogram[5],
+               stats.rtt_histogram[6], stats.rtt_histogram[7],
+               stats.tics_lost, stats.tics_received + stats.tics_lost,
+               stats.resend_requests, stats.tics_resent,
+               stats.backlog, stats.deadlocks);
+        NET_Log("server: stats for %s: rtt %u, lost %u, resends %u/%u, "
+                "backlog %u, deadlocks %u",
+                stats.name, stats.rtt, stats.tics_lost,
+                stats.resend_requests, stats.tics_resent,
+                stats.backlog, stats.deadlocks);
+    }
+}
+
 static void NET_SV_ParseHolePunch(net_packet_t *packet)
 {
     const char *addr_string;
@@ -1435,7 +1654,7 @@ static void NET_SV_ParseHolePunch(net_packet_t *packet)
         return;
     }
 
-    addr = NET_ResolveAddress(server_context, addr_string);
+    addr = NET_ResolveAddress(sv->context, addr_string);
     if (addr == NULL)
     {
         NET_Log("server: error: failed to resolve address: %s", addr_string);
@@ -1486,7 +1705,7 @@ static void NET_SV_Packet(net_packet_t *packet, net_addr_t *addr)
 
     // Response from master server?
 
-    if (addr != NULL && addr == master_server)
+    if (addr != NULL && addr == sv->master_server)
     {
         NET_SV_MasterPacket(packet);
         return;
@@ -1517,6 +1736,10 @@ static void NET_SV_Packet(net_packet_t *packet, net_addr_t *addr)
     {
         NET_SV_SendQueryResponse(addr);
     }
+    else if (packet_type == NET_PACKET_TYPE_STATS_QUERY)
+    {
+        NET_SV_SendStatsResponse(addr);
+    }
     else if (client == NULL)
     {
         // Must come from a valid client; ignore otherwise
@@ -1573,7 +1796,7 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
     
     // Work out the index into the receive window
    
-    recv_index = client->sendseq - recvwindow_start;
+    recv_index = client->sendseq - sv->recvwindow_start;
 
     if (recv_index < 0 || recv_index >= BACKUPTICS)
     {
@@ -1587,19 +1810,19 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
 
     for (i=0; i<NET_MAXPLAYERS; ++i)
     {
-        if (sv_players[i] == client)
+        if (sv->players[i] == client)
         {
             // Client does not rely on itself for data
 
             continue;
         }
 
-        if (sv_players[i] == NULL || !ClientConnected(sv_players[i]))
+        if (sv->players[i] == NULL || !ClientConnected(sv->players[i]))
         {
             continue;
         }
 
-        if (!recvwindow[recv_index][i].active)
+        if (!sv->recvwindow[recv_index][i].active)
         {
             // We do not have this player's ticcmd, so we cannot
             // generate a complete command yet.
@@ -1616,7 +1839,7 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
     // and never stopping. Don't let the server get too far ahead
     // of the client.
 
-    if (num_players == 0 && client->sendseq > recvwindow_start + 10)
+    if (num_players == 0 && client->sendseq > sv->recvwindow_start + 10)
     {
         return;
     }
@@ -1633,7 +1856,7 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
     {
         net_client_recv_t *recvobj;
 
-        if (sv_players[i] == client)
+        if (sv->players[i] == client)
         {
             // Not the player we are sending to
 
@@ -1641,7 +1864,7 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
             continue;
         }
         
-        if (sv_players[i] == NULL || !recvwindow[recv_index][i].active)
+        if (sv->players[i] == NULL || !sv->recvwindow[recv_index][i].active)
         {
             cmd.playeringame[i] = false;
             continue;
@@ -1649,7 +1872,7 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
 
         cmd.playeringame[i] = true;
 
-        recvobj = &recvwindow[recv_index][i];
+        recvobj = &sv->recvwindow[recv_index][i];
 
         cmd.cmds[i] = recvobj->diff;
 
@@ -1662,12 +1885,26 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
     // Add into the queue
 
     client->sendqueue[client->sendseq % BACKUPTICS] = cmd;
+    client->send_time[client->sendseq % BACKUPTICS] = I_GetTimeMS();
 
     // Transmit the new tic to the client
 
-    starttic = client->sendseq - sv_settings.extratics;
+    starttic = client->sendseq - sv->settings.extratics;
     endtic = client->sendseq;
 
+    // [AP] Along with everything the client hasn't acknowledged yet
+
+    if (client->connection.protocol == NET_PROTOCOL_APDOOM_PACKED_0
+     && (int) client->acknowledged < starttic)
+    {
+        starttic = client->sendseq - NET_TicRedundancy();
+
+        if (starttic < (int) client->acknowledged)
+            starttic = client->acknowledged;
+        if (starttic > endtic - sv->settings.extratics)
+            starttic = endtic - sv->settings.extratics;
+    }
+
     if (starttic < 0)
         starttic = 0;
 
@@ -1712,18 +1949,19 @@ void NET_SV_CheckDeadlock(net_client_t *client)
 
         for (i=0; i<BACKUPTICS; ++i)
         {
-            if (!recvwindow[i][client->player_number].active)
+            if (!sv->recvwindow[i][client->player_number].active)
             {
                 NET_Log("server: deadlock: sending resend request for %d-%d",
-                        recvwindow_start + i, recvwindow_start + i + 5);
+                        sv->recvwindow_start + i, sv->recvwindow_start + i + 5);
 
                 // Found a tic we haven't received.  Send a resend request.
 
                 NET_SV_SendResendRequest(client,
-                                         recvwindow_start + i,
-                                         recvwindow_start + i + 5);
+                                         sv->recvwindow_start + i,
+                                         sv->recvwindow_start + i + 5);
 
                 client->last_gamedata_time = nowtime;
+                ++client->stats.deadlocks;
                 break;
             }
         }
@@ -1749,14 +1987,14 @@ static void NET_SV_GameEnded(void)
 {
     int i;
 
-    server_state = SERVER_WAITING_LAUNCH;
-    sv_gamemode = indetermined;
+    sv->state = SERVER_WAITING_LAUNCH;
+    sv->gamemode = indetermined;
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (clients[i].active)
+        if (sv->clients[i].active)
         {
-            NET_SV_DisconnectClient(&clients[i]);
+            NET_SV_DisconnectClient(&sv->clients[i]);
         }
     }
 }
@@ -1787,7 +2025,7 @@ static void NET_SV_RunClient(net_client_t *client)
         // If we were about to start a game, any player disconnecting
         // should cause an abort.
 
-        if (server_state == SERVER_WAITING_START && !client->drone)
+        if (sv->state == SERVER_WAITING_START && !client->drone)
         {
             NET_SV_BroadcastMessage("Game startup aborted because "
                                     "player '%s' disconnected.",
@@ -1796,6 +2034,8 @@ static void NET_SV_RunClient(net_client_t *client)
         }
 
         free(client->name);
+        free(client->sendqueue);
+        client->sendqueue = NULL;
         NET_ReleaseAddress(client->addr);
 
         // Are there any clients left connected?  If not, return the
@@ -1817,7 +2057,7 @@ static void NET_SV_RunClient(net_client_t *client)
         return;
     }
 
-    if (server_state == SERVER_WAITING_LAUNCH)
+    if (sv->state == SERVER_WAITING_LAUNCH)
     {
         // Waiting for the game to start
 
@@ -1831,19 +2071,41 @@ static void NET_SV_RunClient(net_client_t *client)
         }
     }
 
-    if (server_state == SERVER_IN_GAME)
+    if (sv->state == SERVER_IN_GAME)
     {
         NET_SV_PumpSendQueue(client);
         NET_SV_CheckDeadlock(client);
     }
 }
 
+// Allocate another server; select it, then set it up with NET_SV_Init
+// as usual
+
+net_server_t *NET_SV_NewServer(void)
+{
+    net_server_t *server;
+
+    server = calloc(1, sizeof(net_server_t));
+
+    if (server == NULL)
+    {
+        I_Error("NET_SV_NewServer: out of memory");
+    }
+
+    return server;
+}
+
+void NET_SV_SelectServer(net_server_t *server)
+{
+    sv = server != NULL ? server : &default_server;
+}
+
 // Add a network module to the server context
 
 void NET_SV_AddModule(net_module_t *module)
 {
     module->InitServer();
-    NET_AddModule(server_context, module);
+    NET_AddModule(sv->context, module);
 }
 
 // Initialize server and wait for connections
@@ -1854,20 +2116,20 @@ void NET_SV_Init(void)
 
     // initialize send/receive context
 
-    server_context = NET_NewContext();
+    sv->context = NET_NewContext();
 
     // no clients yet
    
     for (i=0; i<MAXNETNODES; ++i) 
     {
-        clients[i].active = false;
+        sv->clients[i].active = false;
     }
 
     NET_SV_AssignPlayers();
 
-    server_state = SERVER_WAITING_LAUNCH;
-    sv_gamemode = indetermined;
-    server_initialized = true;
+    sv->state = SERVER_WAITING_LAUNCH;
+    sv->gamemode = indetermined;
+    sv->initialized = true;
 }
 
 static void UpdateMasterServer(void)
@@ -1879,23 +2141,23 @@ static void UpdateMasterServer(void)
     // The address of the master server can change. Periodically
     // re-resolve the master server to update.
 
-    if (now - master_resolve_time > MASTER_RESOLVE_PERIOD * 1000)
+    if (now - sv->master_resolve_time > MASTER_RESOLVE_PERIOD * 1000)
     {
         net_addr_t *new_addr;
 
-        new_addr = NET_Query_ResolveMaster(server_context);
-        NET_ReleaseAddress(master_server);
-        master_server = new_addr;
+        new_addr = NET_Query_ResolveMaster(sv->context);
+        NET_ReleaseAddress(sv->master_server);
+        sv->master_server = new_addr;
 
-        master_resolve_time = now;
+        sv->master_resolve_time = now;
     }
 
     // Possibly refresh our registration with the master server.
 
-    if (now - master_refresh_time > MASTER_REFRESH_PERIOD * 1000)
+    if (now - sv->master_refresh_time > MASTER_REFRESH_PERIOD * 1000)
     {
-        NET_Query_AddToMaster(master_server);
-        master_refresh_time = now;
+        NET_Query_AddToMaster(sv->master_server);
+        sv->master_refresh_time = now;
     }
 }
 
@@ -1910,20 +2172,20 @@ void NET_SV_RegisterWithMaster(void)
 
     if (!M_CheckParm("-privateserver"))
     {
-        master_server = NET_Query_ResolveMaster(server_context);
+        sv->master_server = NET_Query_ResolveMaster(sv->context);
     }
     else
     {
-        master_server = NULL;
+        sv->master_server = NULL;
     }
 
     // Send request.
 
-    if (master_server != NULL)
+    if (sv->master_server != NULL)
     {
-        NET_Query_AddToMaster(master_server);
-        master_refresh_time = I_GetTimeMS();
-        master_resolve_time = master_refresh_time;
+        NET_Query_AddToMaster(sv->master_server);
+        sv->master_refresh_time = I_GetTimeMS();
+        sv->master_resolve_time = sv->master_refresh_time;
     }
 }
 
@@ -1936,19 +2198,19 @@ void NET_SV_Run(void)
     net_packet_t *packet;
     int i;
 
-    if (!server_initialized)
+    if (!sv->initialized)
     {
         return;
     }
 
-    while (NET_RecvPacket(server_context, &addr, &packet))
+    while (NET_RecvPacket(sv->context, &addr, &packet))
     {
         NET_SV_Packet(packet, addr);
         NET_FreePacket(packet);
         NET_ReleaseAddress(addr);
     }
 
-    if (master_server != NULL)
+    if (sv->master_server != NULL)
     {
         UpdateMasterServer();
     }
@@ -1958,13 +2220,13 @@ void NET_SV_Run(void)
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (clients[i].active)
+        if (sv->clients[i].active)
         {
-            NET_SV_RunClient(&clients[i]);
+            NET_SV_RunClient(&sv->clients[i]);
         }
     }
 
-    switch (server_state)
+    switch (sv->state)
     {
         case SERVER_WAITING_LAUNCH:
             break;
@@ -1978,13 +2240,22 @@ void NET_SV_Run(void)
 
             for (i = 0; i < NET_MAXPLAYERS; ++i)
             {
-                if (sv_players[i] != NULL && ClientConnected(sv_players[i]))
+                if (sv->players[i] != NULL && ClientConnected(sv->players[i]))
                 {
-                    NET_SV_CheckResends(sv_players[i]);
+                    NET_SV_CheckResends(sv->players[i]);
                 }
             }
+
+            if (NET_SV_StatsPeriod() > 0
+             && I_GetTimeMS() - sv->stats_time >= NET_SV_StatsPeriod() * 1000)
+            {
+                NET_SV_LogStats();
+                sv->stats_time = I_GetTimeMS();
+            }
             break;
     }
+
+    NET_FlushPackets(sv->context);
 }
 
 void NET_SV_Shutdown(void)
@@ -1993,7 +2264,7 @@ void NET_SV_Shutdown(void)
     boolean running;
     int start_time;
 
-    if (!server_initialized)
+    if (!sv->initialized)
     {
         return;
     }
@@ -2004,9 +2275,9 @@ void NET_SV_Shutdown(void)
     
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (clients[i].active)
+        if (sv->clients[i].active)
         {
-            NET_SV_DisconnectClient(&clients[i]);
+            NET_SV_DisconnectClient(&sv->clients[i]);
         }
     }
 
@@ -2023,7 +2294,7 @@ void NET_SV_Shutdown(void)
 
         for (i=0; i<MAXNETNODES; ++i)
         {
-            if (clients[i].active)
+            if (sv->clients[i].active)
             {
                 running = true;
             }
@@ -17,6 +17,18 @@
 #ifndef NET_SERVER_H
 #define NET_SERVER_H
 
+typedef struct _net_server_s net_server_t;
+
+// [AP] Create a server of its own, for hosting another game in the same
+// process. Select it before calling NET_SV_Init and the rest.
+
+net_server_t *NET_SV_NewServer(void);
+
+// [AP] Make the other NET_SV_* functions act on the given server, or
+// on the default one if NULL.
+
+void NET_SV_SelectServer(net_server_t *server);
+
 // initialize server and wait for connections
 
 void NET_SV_Init(void);
@@ -32,6 +32,7 @@ static struct
     const char *name;
 } protocol_names[] = {
     {NET_PROTOCOL_CHOCOLATE_DOOM_0, "CHOCOLATE_DOOM_0"},
+    {NET_PROTOCOL_APDOOM_PACKED_0, "APDOOM_PACKED_0"},
 };
 
 void NET_WriteConnectData(net_packet_t *packet, net_connect_data_t *data)
@@ -171,6 +172,59 @@ void NET_WriteQueryData(net_packet_t *packet, net_querydata_t *query)
     NET_WriteProtocolList(packet);
 }
 
+boolean NET_ReadClientStats(net_packet_t *packet, net_clientstats_t *stats)
+{
+    signed int player_number;
+    int i;
+
+    stats->name = NET_ReadSafeString(packet);
+
+    if (stats->name == NULL
+     || !NET_ReadSInt8(packet, &player_number)
+     || !NET_ReadInt32(packet, &stats->rtt))
+    {
+        return false;
+    }
+
+    stats->player_number = player_number;
+
+    for (i = 0; i < NET_RTT_BUCKETS; ++i)
+    {
+        if (!NET_ReadInt32(packet, &stats->rtt_histogram[i]))
+        {
+            return false;
+        }
+    }
+
+    return NET_ReadInt32(packet, &stats->tics_received)
+        && NET_ReadInt32(packet, &stats->tics_lost)
+        && NET_ReadInt32(packet, &stats->resend_requests)
+        && NET_ReadInt32(packet, &stats->tics_resent)
+        && NET_ReadInt32(packet, &stats->deadlocks)
+        && NET_ReadInt32(packet, &stats->backlog);
+}
+
+void NET_WriteClientStats(net_packet_t *packet, net_clientstats_t *stats)
+{
+    int i;
+
+    NET_WriteString(packet, stats->name);
+    NET_WriteInt8(packet, stats->player_number);
+    NET_WriteInt32(packet, stats->rtt);
+
+    for (i = 0; i < NET_RTT_BUCKETS; ++i)
+    {
+        NET_WriteInt32(packet, stats->rtt_histogram[i]);
+    }
+
+    NET_WriteInt32(packet, stats->tics_received);
+    NET_WriteInt32(packet, stats->tics_lost);
+    NET_WriteInt32(packet, stats->resend_requests);
+    NET_WriteInt32(packet, stats->tics_resent);
+    NET_WriteInt32(packet, stats->deadlocks);
+    NET_WriteInt32(packet, stats->backlog);
+}
+
 void NET_WriteTiccmdDiff(net_packet_t *packet, net_ticdiff_t *diff,
                          boolean lowres_turn)
 {
@@ -457,6 +511,337 @@ void NET_WriteFullTiccmd(net_packet_t *packet, net_full_ticcmd_t *cmd, boolean l
     }
 }
 
+//
+// [AP] Bit-packed tics
+//
+// Bits are gathered LSB first into bytes. Each tic costs a bit for the
+// latency and one for the players in game when they are the same as in
+// the previous tic of the run, and a bit per player whose ticcmd didn't
+// change; only the changed fields are written in full.
+//
+
+void NET_InitTicPacker(net_ticpacker_t *packer, net_packet_t *packet)
+{
+    packer->packet = packet;
+    packer->bits = 0;
+    packer->numbits = 0;
+    packer->latency = 0;
+    packer->ingame = 0;
+}
+
+static void WriteBits(net_ticpacker_t *packer, unsigned int value, int n)
+{
+    packer->bits |= (value & ((1u << n) - 1)) << packer->numbits;
+    packer->numbits += n;
+
+    while (packer->numbits >= 8)
+    {
+        NET_WriteInt8(packer->packet, packer->bits & 0xff);
+        packer->bits >>= 8;
+        packer->numbits -= 8;
+    }
+}
+
+static boolean ReadBits(net_ticpacker_t *packer, unsigned int *value, int n)
+{
+    unsigned int b;
+
+    while (packer->numbits < n)
+    {
+        if (!NET_ReadInt8(packer->packet, &b))
+        {
+            return false;
+        }
+
+        packer->bits |= b << packer->numbits;
+        packer->numbits += 8;
+    }
+
+    *value = packer->bits & ((1u << n) - 1);
+    packer->bits >>= n;
+    packer->numbits -= n;
+
+    return true;
+}
+
+static boolean ReadSignedBits(net_ticpacker_t *packer, signed int *value, int n)
+{
+    unsigned int u;
+
+    if (!ReadBits(packer, &u, n))
+    {
+        return false;
+    }
+
+    // Sign extend
+    *value = (signed int) (u ^ (1u << (n - 1))) - (1 << (n - 1));
+
+    return true;
+}
+
+void NET_FinishTicPacker(net_ticpacker_t *packer)
+{
+    if (packer->numbits > 0)
+    {
+        WriteBits(packer, 0, 8 - packer->numbits);
+    }
+}
+
+static void WriteLatency(net_ticpacker_t *packer, signed int latency)
+{
+    if (latency == packer->latency)
+    {
+        WriteBits(packer, 1, 1);
+    }
+    else
+    {
+        WriteBits(packer, 0, 1);
+        WriteBits(packer, latency, 16);
+        packer->latency = latency;
+    }
+}
+
+static boolean ReadLatency(net_ticpacker_t *packer, signed int *latency)
+{
+    unsigned int same;
+
+    if (!ReadBits(packer, &same, 1))
+    {
+        return false;
+    }
+
+    if (!same && !ReadSignedBits(packer, &packer->latency, 16))
+    {
+        return false;
+    }
+
+    *latency = packer->latency;
+
+    return true;
+}
+
+static void WritePackedDiff(net_ticpacker_t *packer, net_ticdiff_t *diff,
+                            boolean lowres_turn)
+{
+    if (diff->diff == 0)
+    {
+        WriteBits(packer, 1, 1);
+        return;
+    }
+
+    WriteBits(packer, 0, 1);
+    WriteBits(packer, diff->diff, 8);
+
+    if (diff->diff & NET_TICDIFF_FORWARD)
+        WriteBits(packer, diff->cmd.forwardmove, 8);
+    if (diff->diff & NET_TICDIFF_SIDE)
+        WriteBits(packer, diff->cmd.sidemove, 8);
+    if (diff->diff & NET_TICDIFF_TURN)
+    {
+        if (lowres_turn)
+        {
+            WriteBits(packer, diff->cmd.angleturn / 256, 8);
+        }
+        else
+        {
+            WriteBits(packer, diff->cmd.angleturn, 16);
+        }
+    }
+    if (diff->diff & NET_TICDIFF_BUTTONS)
+        WriteBits(packer, diff->cmd.buttons, 8);
+    if (diff->diff & NET_TICDIFF_CONSISTANCY)
+        WriteBits(packer, diff->cmd.consistancy, 8);
+    if (diff->diff & NET_TICDIFF_CHATCHAR)
+        WriteBits(packer, diff->cmd.chatchar, 8);
+    if (diff->diff & NET_TICDIFF_RAVEN)
+    {
+        WriteBits(packer, diff->cmd.lookfly, 8);
+        WriteBits(packer, diff->cmd.arti, 8);
+    }
+    if (diff->diff & NET_TICDIFF_STRIFE)
+    {
+        WriteBits(packer, diff->cmd.buttons2, 8);
+        WriteBits(packer, diff->cmd.inventory, 16);
+    }
+}
+
+static boolean ReadPackedDiff(net_ticpacker_t *packer, net_ticdiff_t *diff,
+                              boolean lowres_turn)
+{
+    unsigned int val;
+    signed int sval;
+
+    if (!ReadBits(packer, &val, 1))
+        return false;
+
+    if (val)
+    {
+        diff->diff = 0;
+        return true;
+    }
+
+    if (!ReadBits(packer, &diff->diff, 8))
+        return false;
+
+    if (diff->diff & NET_TICDIFF_FORWARD)
+    {
+        if (!ReadSignedBits(packer, &sval, 8))
+            return false;
+        diff->cmd.forwardmove = sval;
+    }
+
+    if (diff->diff & NET_TICDIFF_SIDE)
+    {
+        if (!ReadSignedBits(packer, &sval, 8))
+            return false;
+        diff->cmd.sidemove = sval;
+    }
+
+    if (diff->diff & NET_TICDIFF_TURN)
+    {
+        if (lowres_turn)
+        {
+            if (!ReadSignedBits(packer, &sval, 8))
+                return false;
+            diff->cmd.angleturn = sval * 256;
+        }
+        else
+        {
+            if (!ReadSignedBits(packer, &sval, 16))
+                return false;
+            diff->cmd.angleturn = sval;
+        }
+    }
+
+    if (diff->diff & NET_TICDIFF_BUTTONS)
+    {
+        if (!ReadBits(packer, &val, 8))
+            return false;
+        diff->cmd.buttons = val;
+    }
+
+    if (diff->diff & NET_TICDIFF_CONSISTANCY)
+    {
+        if (!ReadBits(packer, &val, 8))
+            return false;
+        diff->cmd.consistancy = val;
+    }
+
+    if (diff->diff & NET_TICDIFF_CHATCHAR)
+    {
+        if (!ReadBits(packer, &val, 8))
+            return false;
+        diff->cmd.chatchar = val;
+    }
+
+    if (diff->diff & NET_TICDIFF_RAVEN)
+    {
+        if (!ReadBits(packer, &val, 8))
+            return false;
+        diff->cmd.lookfly = val;
+
+        if (!ReadBits(packer, &val, 8))
+            return false;
+        diff->cmd.arti = val;
+    }
+
+    if (diff->diff & NET_TICDIFF_STRIFE)
+    {
+        if (!ReadBits(packer, &val, 8))
+            return false;
+        diff->cmd.buttons2 = val;
+
+        if (!ReadBits(packer, &val, 16))
+            return false;
+        diff->cmd.inventory = val;
+    }
+
+    return true;
+}
+
+void NET_WritePackedTiccmdDiff(net_ticpacker_t *packer, signed int latency,
+                               net_ticdiff_t *diff, boolean lowres_turn)
+{
+    WriteLatency(packer, latency);
+    WritePackedDiff(packer, diff, lowres_turn);
+}
+
+boolean NET_ReadPackedTiccmdDiff(net_ticpacker_t *packer, signed int *latency,
+                                 net_ticdiff_t *diff, boolean lowres_turn)
+{
+    return ReadLatency(packer, latency)
+        && ReadPackedDiff(packer, diff, lowres_turn);
+}
+
+void NET_WritePackedFullTiccmd(net_ticpacker_t *packer,
+                               net_full_ticcmd_t *cmd, boolean lowres_turn)
+{
+    unsigned int bitfield;
+    int i;
+
+    WriteLatency(packer, cmd->latency);
+
+    bitfield = 0;
+
+    for (i=0; i<NET_MAXPLAYERS; ++i)
+    {
+        if (cmd->playeringame[i])
+        {
+            bitfield |= 1 << i;
+        }
+    }
+
+    if (bitfield == packer->ingame)
+    {
+        WriteBits(packer, 1, 1);
+    }
+    else
+    {
+        WriteBits(packer, 0, 1);
+        WriteBits(packer, bitfield, NET_MAXPLAYERS);
+        packer->ingame = bitfield;
+    }
+
+    for (i=0; i<NET_MAXPLAYERS; ++i)
+    {
+        if (cmd->playeringame[i])
+        {
+            WritePackedDiff(packer, &cmd->cmds[i], lowres_turn);
+        }
+    }
+}
+
+boolean NET_ReadPackedFullTiccmd(net_ticpacker_t *packer,
+                                 net_full_ticcmd_t *cmd, boolean lowres_turn)
+{
+    unsigned int same;
+    int i;
+
+    if (!ReadLatency(packer, &cmd->latency)
+     || !ReadBits(packer, &same, 1))
+    {
+        return false;
+    }
+
+    if (!same && !ReadBits(packer, &packer->ingame, NET_MAXPLAYERS))
+    {
+        return false;
+    }
+
+    for (i=0; i<NET_MAXPLAYERS; ++i)
+    {
+        cmd->playeringame[i] = (packer->ingame & (1 << i)) != 0;
+
+        if (cmd->playeringame[i]
+         && !ReadPackedDiff(packer, &cmd->cmds[i], lowres_turn))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void NET_WriteWaitData(net_packet_t *packet, net_waitdata_t *data)
 {
     int i;
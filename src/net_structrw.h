@@ -29,6 +29,9 @@ extern boolean NET_ReadSettings(net_packet_t *packet, net_gamesettings_t *settin
 extern void NET_WriteQueryData(net_packet_t *packet, net_querydata_t *querydata);
 extern boolean NET_ReadQueryData(net_packet_t *packet, net_querydata_t *querydata);
 
+extern void NET_WriteClientStats(net_packet_t *packet, net_clientstats_t *stats);
+extern boolean NET_ReadClientStats(net_packet_t *packet, net_clientstats_t *stats);
+
 extern void NET_WriteTiccmdDiff(net_packet_t *packet, net_ticdiff_t *diff, boolean lowres_turn);
 extern boolean NET_ReadTiccmdDiff(net_packet_t *packet, net_ticdiff_t *diff, boolean lowres_turn);
 extern void NET_TiccmdDiff(ticcmd_t *tic1, ticcmd_t *tic2, net_ticdiff_t *diff);
@@ -37,6 +40,29 @@ extern void NET_TiccmdPatch(ticcmd_t *src, net_ticdiff_t *diff, ticcmd_t *dest);
 boolean NET_ReadFullTiccmd(net_packet_t *packet, net_full_ticcmd_t *cmd, boolean lowres_turn);
 void NET_WriteFullTiccmd(net_packet_t *packet, net_full_ticcmd_t *cmd, boolean lowres_turn);
 
+// [AP] Bit-packed tics, for NET_PROTOCOL_APDOOM_PACKED_0. A run of tics
+// is read or written through one packer, which also remembers what the
+// previous tic looked like. All tics must be written before finishing.
+typedef struct
+{
+    net_packet_t *packet;
+    unsigned int bits;
+    int numbits;
+    signed int latency;
+    unsigned int ingame;
+} net_ticpacker_t;
+
+void NET_InitTicPacker(net_ticpacker_t *packer, net_packet_t *packet);
+void NET_FinishTicPacker(net_ticpacker_t *packer);
+void NET_WritePackedTiccmdDiff(net_ticpacker_t *packer, signed int latency,
+                               net_ticdiff_t *diff, boolean lowres_turn);
+boolean NET_ReadPackedTiccmdDiff(net_ticpacker_t *packer, signed int *latency,
+                                 net_ticdiff_t *diff, boolean lowres_turn);
+void NET_WritePackedFullTiccmd(net_ticpacker_t *packer,
+                               net_full_ticcmd_t *cmd, boolean lowres_turn);
+boolean NET_ReadPackedFullTiccmd(net_ticpacker_t *packer,
+                                 net_full_ticcmd_t *cmd, boolean lowres_turn);
+
 boolean NET_ReadSHA1Sum(net_packet_t *packet, sha1_digest_t digest);
 void NET_WriteSHA1Sum(net_packet_t *packet, sha1_digest_t digest);
 
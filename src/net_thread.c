@@ -0,0 +1,280 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Network I/O thread.
+//
+//     Receiving, acks and resend timers used to run from NetUpdate, so
+//     a long frame held them all up and the server resent tics that
+//     had arrived long before. Once the game starts, the thread runs
+//     NET_CL_Run and NET_SV_Run on its own, and nothing else touches
+//     the client or server until it stops. Ticcmds go across in two
+//     single-producer, single-consumer rings; the clock offset goes in
+//     an atomic.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "d_loop.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "net_client.h"
+#include "net_defs.h"
+#include "net_server.h"
+#include "net_thread.h"
+#include "net_udp.h"
+
+#define MAXTHREADTICS BACKUPTICS
+
+typedef struct
+{
+    ticcmd_t cmd;
+    int maketic;
+} net_sendtic_t;
+
+typedef struct
+{
+    ticcmd_t cmds[NET_MAXPLAYERS];
+    boolean ingame[NET_MAXPLAYERS];
+    boolean disconnected;
+} net_recvtic_t;
+
+static SDL_Thread *net_thread;
+static SDL_atomic_t net_thread_quit;
+static SDL_sem *recv_sem;
+
+// Game thread -> I/O thread
+
+static net_sendtic_t send_ring[MAXTHREADTICS];
+static SDL_atomic_t send_head, send_tail;
+
+// I/O thread -> game thread
+
+static net_recvtic_t recv_ring[MAXTHREADTICS];
+static SDL_atomic_t recv_head, recv_tail;
+
+static SDL_atomic_t thread_offset;
+
+static void RunSendRing(void)
+{
+    int head = SDL_AtomicGet(&send_head);
+    int tail = SDL_AtomicGet(&send_tail);
+
+    while (head != tail)
+    {
+        // Dropped once disconnected, as d_loop.c does without the thread
+        if (net_client_connected)
+        {
+            NET_CL_SendTiccmd(&send_ring[head].cmd, send_ring[head].maketic);
+        }
+
+        head = (head + 1) % MAXTHREADTICS;
+    }
+
+    SDL_AtomicSet(&send_head, head);
+}
+
+static int NET_IOThread(void *unused)
+{
+    net_module_t *module = NET_UDP_DefaultModule();
+
+    while (!SDL_AtomicGet(&net_thread_quit))
+    {
+        int start;
+
+        RunSendRing();
+
+        NET_CL_Run();
+        NET_SV_Run();
+
+        // Sleep until a packet comes in. Ticcmds from the game thread
+        // wait for the 1ms timeout; a module without a socket to wait
+        // on returns straight away, so sleep instead.
+
+        start = I_GetTimeMS();
+
+        if (module->WaitPacket == NULL
+         || (!module->WaitPacket(1) && I_GetTimeMS() == start))
+        {
+            SDL_Delay(1);
+        }
+    }
+
+    return 0;
+}
+
+void NET_StartThread(void)
+{
+    if (net_thread != NULL)
+    {
+        return;
+    }
+
+    //!
+    // @category net
+    //
+    // Run network I/O on the game thread, as before, instead of on a
+    // thread of its own.
+    //
+
+    if (M_CheckParm("-nonetthread"))
+    {
+        return;
+    }
+
+    SDL_AtomicSet(&net_thread_quit, 0);
+    SDL_AtomicSet(&send_head, 0);
+    SDL_AtomicSet(&send_tail, 0);
+    SDL_AtomicSet(&recv_head, 0);
+    SDL_AtomicSet(&recv_tail, 0);
+    SDL_AtomicSet(&thread_offset, offsetms);
+
+    recv_sem = SDL_CreateSemaphore(0);
+    net_thread = SDL_CreateThread(NET_IOThread, "NET_IO", NULL);
+
+    if (net_thread == NULL)
+    {
+        fprintf(stderr, "NET_StartThread: %s\n", SDL_GetError());
+        SDL_DestroySemaphore(recv_sem);
+        recv_sem = NULL;
+    }
+}
+
+void NET_StopThread(void)
+{
+    // Also not from an I_Error on the thread itself
+
+    if (net_thread == NULL || SDL_ThreadID() == SDL_GetThreadID(net_thread))
+    {
+        return;
+    }
+
+    SDL_AtomicSet(&net_thread_quit, 1);
+    SDL_WaitThread(net_thread, NULL);
+    net_thread = NULL;
+
+    // Nothing more will be received by the game, but our last tics
+    // should still go out
+
+    RunSendRing();
+
+    SDL_DestroySemaphore(recv_sem);
+    recv_sem = NULL;
+}
+
+boolean NET_ThreadRunning(void)
+{
+    return net_thread != NULL;
+}
+
+void NET_ThreadSendTiccmd(ticcmd_t *ticcmd, int maketic)
+{
+    int tail = SDL_AtomicGet(&send_tail);
+    int next = (tail + 1) % MAXTHREADTICS;
+
+    // Only full if the thread has been stuck for seconds
+
+    while (next == SDL_AtomicGet(&send_head))
+    {
+        SDL_Delay(1);
+    }
+
+    send_ring[tail].cmd = *ticcmd;
+    send_ring[tail].maketic = maketic;
+    SDL_AtomicSet(&send_tail, next);
+}
+
+void NET_ThreadReceiveTics(void)
+{
+    int head = SDL_AtomicGet(&recv_head);
+    int tail = SDL_AtomicGet(&recv_tail);
+
+    offsetms = SDL_AtomicGet(&thread_offset);
+
+    while (head != tail)
+    {
+        net_recvtic_t *tic = &recv_ring[head];
+
+        if (tic->disconnected)
+        {
+            D_ReceiveTic(NULL, NULL);
+        }
+        else
+        {
+            D_ReceiveTic(tic->cmds, tic->ingame);
+        }
+
+        head = (head + 1) % MAXTHREADTICS;
+        SDL_AtomicSet(&recv_head, head);
+    }
+}
+
+boolean NET_ThreadWaitTic(int timeout_ms)
+{
+    if (SDL_AtomicGet(&recv_head) != SDL_AtomicGet(&recv_tail))
+    {
+        return true;
+    }
+
+    return SDL_SemWaitTimeout(recv_sem, timeout_ms) == 0;
+}
+
+boolean NET_ThreadCanPushTic(void)
+{
+    int next = (SDL_AtomicGet(&recv_tail) + 1) % MAXTHREADTICS;
+
+    return next != SDL_AtomicGet(&recv_head);
+}
+
+void NET_ThreadPushTic(ticcmd_t *ticcmds, boolean *ingame)
+{
+    int tail = SDL_AtomicGet(&recv_tail);
+    net_recvtic_t *tic = &recv_ring[tail];
+
+    // Callers check for room first, except on disconnect, which must
+    // get through
+
+    while (!NET_ThreadCanPushTic())
+    {
+        if (SDL_AtomicGet(&net_thread_quit))
+        {
+            return;
+        }
+
+        SDL_Delay(1);
+    }
+
+    tic->disconnected = ticcmds == NULL;
+
+    if (!tic->disconnected)
+    {
+        memcpy(tic->cmds, ticcmds, sizeof(tic->cmds));
+        memcpy(tic->ingame, ingame, sizeof(tic->ingame));
+    }
+
+    SDL_AtomicSet(&recv_tail, (tail + 1) % MAXTHREADTICS);
+
+    if (SDL_SemValue(recv_sem) == 0)
+    {
+        SDL_SemPost(recv_sem);
+    }
+}
+
+void NET_ThreadSetOffset(fixed_t offset)
+{
+    SDL_AtomicSet(&thread_offset, offset);
+}
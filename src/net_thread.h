@@ -0,0 +1,57 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Network I/O thread. Once a netgame has started, the client and
+//     any local server run here, and ticcmds cross to and from the game
+//     thread through lock-free rings.
+//
+
+#ifndef NET_THREAD_H
+#define NET_THREAD_H
+
+#include "doomtype.h"
+#include "d_ticcmd.h"
+#include "m_fixed.h"
+
+// Hand the client and server over to the I/O thread, unless
+// -nonetthread was given. Call once the game has started.
+void NET_StartThread(void);
+
+// Stop the thread; the client and server belong to the caller again.
+void NET_StopThread(void);
+
+// True while the I/O thread owns the client and server.
+boolean NET_ThreadRunning(void);
+
+// Game thread: queue a ticcmd for NET_CL_SendTiccmd.
+void NET_ThreadSendTiccmd(ticcmd_t *ticcmd, int maketic);
+
+// Game thread: pass the tics received so far on to D_ReceiveTic, and
+// pick up the latest clock offset.
+void NET_ThreadReceiveTics(void);
+
+// Game thread: wait up to timeout_ms for received tics.
+boolean NET_ThreadWaitTic(int timeout_ms);
+
+// I/O thread: whether NET_ThreadPushTic has room.
+boolean NET_ThreadCanPushTic(void);
+
+// I/O thread: queue a complete set of ticcmds for the game thread, or
+// the disconnect if both are NULL.
+void NET_ThreadPushTic(ticcmd_t *ticcmds, boolean *ingame);
+
+// I/O thread: publish a new clock offset (offsetms).
+void NET_ThreadSetOffset(fixed_t offset);
+
+#endif /* #ifndef NET_THREAD_H */
@@ -0,0 +1,775 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Networking module which uses native UDP sockets.
+//
+//     Where recvmmsg() is available, one call reads every datagram
+//     waiting on the socket (up to RECV_BATCH) and RecvPacket hands
+//     them out one at a time. Where sendmmsg() is available, sent
+//     packets are queued and go out in one call when the module is
+//     flushed. Elsewhere, including Windows, it is one datagram per
+//     call, as with SDL_net. Addresses are compatible with net_sdl's:
+//     IPv4 only, with the same string form.
+//
+
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // recvmmsg(), sendmmsg()
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "config.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "doomtype.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "net_defs.h"
+#include "net_io.h"
+#include "net_packet.h"
+#include "net_sdl.h"
+#include "net_udp.h"
+
+#ifdef _WIN32
+typedef SOCKET udpsocket_t;
+#define BAD_SOCKET INVALID_SOCKET
+#define CloseSocket closesocket
+#define SocketErrno() WSAGetLastError()
+// An ICMP port unreachable for an earlier send shows up as WSAECONNRESET
+// on the next receive; it's only a lost datagram.
+#define WouldBlock(e) ((e) == WSAEWOULDBLOCK || (e) == WSAECONNRESET)
+#define Interrupted(e) ((e) == WSAEINTR)
+#else
+typedef int udpsocket_t;
+#define BAD_SOCKET (-1)
+#define CloseSocket close
+#define SocketErrno() errno
+#define WouldBlock(e) ((e) == EAGAIN || (e) == EWOULDBLOCK)
+#define Interrupted(e) ((e) == EINTR)
+#endif
+
+#define DEFAULT_PORT 2342
+#define MAX_DATAGRAM 1500
+#define RECV_BATCH 32
+#define SEND_BATCH 32
+#define SOCKET_BUFFER (256 * 1024)
+
+typedef struct
+{
+    net_addr_t net_addr;
+    struct sockaddr_in sa;
+} addrpair_t;
+
+static boolean initted = false;
+static int port = DEFAULT_PORT;
+static udpsocket_t udpsocket = BAD_SOCKET;
+
+// A dedicated server hosting several games has a socket for each;
+// udpsocket is the selected one. The first is the one opened by the
+// Init functions.
+
+static udpsocket_t sockets[NET_UDP_MAXSOCKETS];
+static int num_sockets;
+
+// Datagrams read by the last receive, handed out one at a time
+
+static byte recv_data[RECV_BATCH][MAX_DATAGRAM];
+static int recv_len[RECV_BATCH];
+static struct sockaddr_in recv_from[RECV_BATCH];
+static int recv_count, recv_next;
+
+#ifdef HAVE_SENDMMSG
+
+// Packets waiting for the next flush. They are shared, not copied.
+
+static net_packet_t *send_packets[SEND_BATCH];
+static struct sockaddr_in send_to[SEND_BATCH];
+static struct iovec send_iov[SEND_BATCH];
+static struct mmsghdr send_msgs[SEND_BATCH];
+static int send_count;
+
+#endif
+
+static const char *SocketError(int e)
+{
+#ifdef _WIN32
+    static char buf[32];
+
+    M_snprintf(buf, sizeof(buf), "Winsock error %i", e);
+
+    return buf;
+#else
+    return strerror(e);
+#endif
+}
+
+// Open addressing table of the addresses in use, keyed by host and port
+// and probed linearly, as in net_sdl.c.
+
+static addrpair_t **addr_table;
+static unsigned int addr_table_size = 0;  // Power of two
+static unsigned int addr_table_used = 0;
+
+static unsigned int AddressHash(const struct sockaddr_in *sa)
+{
+    unsigned int h;
+
+    h = (unsigned int) sa->sin_addr.s_addr * 0x9e3779b1u;
+    h ^= (unsigned int) sa->sin_port * 0x85ebca6bu;
+    h ^= h >> 15;
+
+    return h & (addr_table_size - 1);
+}
+
+static boolean AddressesEqual(const struct sockaddr_in *a,
+                              const struct sockaddr_in *b)
+{
+    return a->sin_addr.s_addr == b->sin_addr.s_addr
+        && a->sin_port == b->sin_port;
+}
+
+static void NET_UDP_ResizeAddrTable(unsigned int new_size)
+{
+    addrpair_t **old_table = addr_table;
+    unsigned int old_size = addr_table_size;
+    unsigned int i, j;
+
+    addr_table = calloc(new_size, sizeof(addrpair_t *));
+
+    if (addr_table == NULL)
+    {
+        I_Error("NET_UDP_ResizeAddrTable: Failed to allocate address table");
+    }
+
+    addr_table_size = new_size;
+
+    for (i = 0; i < old_size; ++i)
+    {
+        if (old_table[i] == NULL)
+        {
+            continue;
+        }
+
+        for (j = AddressHash(&old_table[i]->sa); addr_table[j] != NULL;
+             j = (j + 1) & (addr_table_size - 1));
+
+        addr_table[j] = old_table[i];
+    }
+
+    free(old_table);
+}
+
+// Finds an address in the table.  If the address is not found,
+// it is added to the table.
+
+static net_addr_t *NET_UDP_FindAddress(const struct sockaddr_in *sa)
+{
+    addrpair_t *new_entry;
+    unsigned int i;
+
+    if (addr_table_size == 0)
+    {
+        NET_UDP_ResizeAddrTable(16);
+    }
+
+    for (i = AddressHash(sa); addr_table[i] != NULL;
+         i = (i + 1) & (addr_table_size - 1))
+    {
+        if (AddressesEqual(sa, &addr_table[i]->sa))
+        {
+            return &addr_table[i]->net_addr;
+        }
+    }
+
+    if ((addr_table_used + 1) * 2 > addr_table_size)
+    {
+        NET_UDP_ResizeAddrTable(addr_table_size * 2);
+
+        for (i = AddressHash(sa); addr_table[i] != NULL;
+             i = (i + 1) & (addr_table_size - 1));
+    }
+
+    new_entry = malloc(sizeof(addrpair_t));
+
+    if (new_entry == NULL)
+    {
+        I_Error("NET_UDP_FindAddress: Failed to allocate address");
+    }
+
+    memset(&new_entry->sa, 0, sizeof(new_entry->sa));
+    new_entry->sa.sin_family = AF_INET;
+    new_entry->sa.sin_addr = sa->sin_addr;
+    new_entry->sa.sin_port = sa->sin_port;
+    new_entry->net_addr.refcount = 0;
+    new_entry->net_addr.handle = &new_entry->sa;
+    new_entry->net_addr.module = &net_udp_module;
+
+    addr_table[i] = new_entry;
+    ++addr_table_used;
+
+    return &new_entry->net_addr;
+}
+
+static void NET_UDP_FreeAddress(net_addr_t *addr)
+{
+    unsigned int i, j, home;
+
+    if (addr_table_size == 0)
+    {
+        I_Error("NET_UDP_FreeAddress: Attempted to remove an unused address!");
+    }
+
+    for (i = AddressHash(addr->handle); addr_table[i] != NULL;
+         i = (i + 1) & (addr_table_size - 1))
+    {
+        if (&addr_table[i]->net_addr == addr)
+        {
+            break;
+        }
+    }
+
+    if (addr_table[i] == NULL)
+    {
+        I_Error("NET_UDP_FreeAddress: Attempted to remove an unused address!");
+    }
+
+    free(addr_table[i]);
+    addr_table[i] = NULL;
+    --addr_table_used;
+
+    for (j = (i + 1) & (addr_table_size - 1); addr_table[j] != NULL;
+         j = (j + 1) & (addr_table_size - 1))
+    {
+        home = AddressHash(&addr_table[j]->sa);
+
+        // Leave it alone if its home slot is cyclically in (i, j]
+        if (((j - home) & (addr_table_size - 1))
+          < ((j - i) & (addr_table_size - 1)))
+        {
+            continue;
+        }
+
+        addr_table[i] = addr_table[j];
+        addr_table[j] = NULL;
+        i = j;
+    }
+}
+
+static boolean NET_UDP_OpenSocket(int bind_port)
+{
+    struct sockaddr_in sa;
+    int value;
+#ifdef _WIN32
+    WSADATA wsadata;
+    u_long nonblock = 1;
+
+    if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
+    {
+        return false;
+    }
+#endif
+
+    udpsocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (udpsocket == BAD_SOCKET)
+    {
+        return false;
+    }
+
+    // Bursts from every client arrive at once on a busy server
+
+    value = SOCKET_BUFFER;
+    setsockopt(udpsocket, SOL_SOCKET, SO_RCVBUF,
+               (const char *) &value, sizeof(value));
+    setsockopt(udpsocket, SOL_SOCKET, SO_SNDBUF,
+               (const char *) &value, sizeof(value));
+
+    value = 1;
+    setsockopt(udpsocket, SOL_SOCKET, SO_BROADCAST,
+               (const char *) &value, sizeof(value));
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);
+    sa.sin_port = htons(bind_port);
+
+    if (bind(udpsocket, (struct sockaddr *) &sa, sizeof(sa)) != 0)
+    {
+        CloseSocket(udpsocket);
+        udpsocket = BAD_SOCKET;
+        return false;
+    }
+
+#ifdef _WIN32
+    ioctlsocket(udpsocket, FIONBIO, &nonblock);
+#else
+    fcntl(udpsocket, F_SETFL, fcntl(udpsocket, F_GETFL) | O_NONBLOCK);
+#endif
+
+    return true;
+}
+
+static void NET_UDP_ParsePort(void)
+{
+    int p;
+
+    // -port is documented in net_sdl.c
+
+    p = M_CheckParmWithArgs("-port", 1);
+    if (p > 0)
+        port = atoi(myargv[p+1]);
+}
+
+static boolean NET_UDP_InitClient(void)
+{
+    if (initted)
+        return true;
+
+    NET_UDP_ParsePort();
+
+    if (!NET_UDP_OpenSocket(0))
+    {
+        I_Error("NET_UDP_InitClient: Unable to open a socket!");
+    }
+
+    sockets[0] = udpsocket;
+    num_sockets = 1;
+    initted = true;
+
+    return true;
+}
+
+static boolean NET_UDP_InitServer(void)
+{
+    if (initted)
+        return true;
+
+    NET_UDP_ParsePort();
+
+    if (!NET_UDP_OpenSocket(port))
+    {
+        I_Error("NET_UDP_InitServer: Unable to bind to port %i", port);
+    }
+
+    sockets[0] = udpsocket;
+    num_sockets = 1;
+    initted = true;
+
+    return true;
+}
+
+static void NET_UDP_SendTo(const struct sockaddr_in *sa,
+                           const byte *data, int len)
+{
+    int e;
+
+    while (sendto(udpsocket, (const char *) data, len, 0,
+                  (const struct sockaddr *) sa, sizeof(*sa)) < 0)
+    {
+        e = SocketErrno();
+
+        if (WouldBlock(e))
+        {
+            // Send buffer full; lose it, as a congested link would
+            return;
+        }
+        else if (!Interrupted(e))
+        {
+            I_Error("NET_UDP_SendPacket: Error transmitting packet: %s",
+                    SocketError(e));
+        }
+    }
+}
+
+static void NET_UDP_Flush(void)
+{
+#ifdef HAVE_SENDMMSG
+    int sent = 0;
+    int result;
+    int i;
+
+    while (sent < send_count)
+    {
+        result = sendmmsg(udpsocket, send_msgs + sent, send_count - sent, 0);
+
+        if (result < 0)
+        {
+            if (WouldBlock(errno))
+            {
+                break;
+            }
+            else if (!Interrupted(errno))
+            {
+                I_Error("NET_UDP_SendPacket: Error transmitting packet: %s",
+                        SocketError(errno));
+            }
+        }
+        else
+        {
+            sent += result;
+        }
+    }
+
+    for (i = 0; i < send_count; ++i)
+    {
+        NET_FreePacket(send_packets[i]);
+    }
+
+    send_count = 0;
+#endif
+}
+
+static void NET_UDP_SendPacket(net_addr_t *addr, net_packet_t *packet)
+{
+    struct sockaddr_in sa;
+
+    if (addr == &net_broadcast_addr)
+    {
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+        sa.sin_port = htons(port);
+    }
+    else
+    {
+        sa = *((struct sockaddr_in *) addr->handle);
+    }
+
+#ifdef HAVE_SENDMMSG
+    if (send_count == SEND_BATCH)
+    {
+        NET_UDP_Flush();
+    }
+
+    send_packets[send_count] = NET_PacketShare(packet);
+    send_to[send_count] = sa;
+    send_iov[send_count].iov_base = send_packets[send_count]->data;
+    send_iov[send_count].iov_len = send_packets[send_count]->len;
+    memset(&send_msgs[send_count], 0, sizeof(send_msgs[send_count]));
+    send_msgs[send_count].msg_hdr.msg_name = &send_to[send_count];
+    send_msgs[send_count].msg_hdr.msg_namelen = sizeof(sa);
+    send_msgs[send_count].msg_hdr.msg_iov = &send_iov[send_count];
+    send_msgs[send_count].msg_hdr.msg_iovlen = 1;
+    ++send_count;
+#else
+    NET_UDP_SendTo(&sa, packet->data, packet->len);
+#endif
+}
+
+// Reads whatever is waiting on the socket into recv_data.
+
+static void NET_UDP_ReceiveBatch(void)
+{
+#ifdef HAVE_RECVMMSG
+    static struct iovec iov[RECV_BATCH];
+    static struct mmsghdr msgs[RECV_BATCH];
+    int result;
+    int i;
+
+    for (i = 0; i < RECV_BATCH; ++i)
+    {
+        iov[i].iov_base = recv_data[i];
+        iov[i].iov_len = MAX_DATAGRAM;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name = &recv_from[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(recv_from[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    do
+    {
+        result = recvmmsg(udpsocket, msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+    } while (result < 0 && Interrupted(errno));
+
+    if (result < 0)
+    {
+        if (!WouldBlock(errno))
+        {
+            I_Error("NET_UDP_RecvPacket: Error receiving packet: %s",
+                    SocketError(errno));
+        }
+
+        result = 0;
+    }
+
+    for (i = 0; i < result; ++i)
+    {
+        recv_len[i] = msgs[i].msg_len;
+    }
+
+    recv_count = result;
+#else
+    socklen_t fromlen;
+    int result;
+    int e;
+
+    do
+    {
+        fromlen = sizeof(recv_from[0]);
+        result = recvfrom(udpsocket, (char *) recv_data[0], MAX_DATAGRAM, 0,
+                          (struct sockaddr *) &recv_from[0], &fromlen);
+        e = result < 0 ? SocketErrno() : 0;
+    } while (result < 0 && Interrupted(e));
+
+    if (result < 0)
+    {
+        if (!WouldBlock(e))
+        {
+            I_Error("NET_UDP_RecvPacket: Error receiving packet: %s",
+                    SocketError(e));
+        }
+
+        recv_count = 0;
+    }
+    else
+    {
+        recv_len[0] = result;
+        recv_count = 1;
+    }
+#endif
+
+    recv_next = 0;
+}
+
+static boolean NET_UDP_RecvPacket(net_addr_t **addr, net_packet_t **packet)
+{
+    int i;
+
+    if (!initted)
+    {
+        return false;
+    }
+
+    if (recv_next >= recv_count)
+    {
+        // Replies go out before looking for more
+
+        NET_UDP_Flush();
+        NET_UDP_ReceiveBatch();
+
+        if (recv_count == 0)
+        {
+            return false;
+        }
+    }
+
+    i = recv_next++;
+
+    *packet = NET_NewPacket(recv_len[i]);
+    memcpy((*packet)->data, recv_data[i], recv_len[i]);
+    (*packet)->len = recv_len[i];
+
+    *addr = NET_UDP_FindAddress(&recv_from[i]);
+
+    return true;
+}
+
+static boolean NET_UDP_WaitPacket(int timeout_ms)
+{
+#ifdef _WIN32
+    fd_set fds;
+    struct timeval tv;
+#else
+    struct pollfd pfds[NET_UDP_MAXSOCKETS];
+#endif
+    int i;
+
+    if (!initted)
+    {
+        return false;
+    }
+
+    NET_UDP_Flush();
+
+    if (recv_next < recv_count)
+    {
+        return true;
+    }
+
+    // Any of the games' sockets will do
+
+#ifdef _WIN32
+    FD_ZERO(&fds);
+
+    for (i = 0; i < num_sockets; ++i)
+    {
+        FD_SET(sockets[i], &fds);
+    }
+
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    return select(0, &fds, NULL, NULL, &tv) > 0;
+#else
+    for (i = 0; i < num_sockets; ++i)
+    {
+        pfds[i].fd = sockets[i];
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
+    }
+
+    return poll(pfds, num_sockets, timeout_ms) > 0;
+#endif
+}
+
+int NET_UDP_OpenGameSocket(void)
+{
+    udpsocket_t selected = udpsocket;
+    int bind_port = port + num_sockets;
+
+    if (!initted || num_sockets == NET_UDP_MAXSOCKETS)
+    {
+        I_Error("NET_UDP_OpenGameSocket: No more than %i games",
+                NET_UDP_MAXSOCKETS);
+    }
+
+    if (!NET_UDP_OpenSocket(bind_port))
+    {
+        I_Error("NET_UDP_OpenGameSocket: Unable to bind to port %i",
+                bind_port);
+    }
+
+    sockets[num_sockets] = udpsocket;
+    udpsocket = selected;
+
+    return num_sockets++;
+}
+
+void NET_UDP_SelectSocket(int index)
+{
+    // Whatever was sent goes out of the socket it was sent on
+
+    NET_UDP_Flush();
+
+    // Everything received has been read by now, as NET_RecvPacket is
+    // called until there is nothing left
+
+    recv_count = recv_next = 0;
+
+    udpsocket = sockets[index];
+}
+
+void NET_UDP_AddrToString(net_addr_t *addr, char *buffer, int buffer_len)
+{
+    struct sockaddr_in *sa;
+    uint32_t host;
+    uint16_t addr_port;
+
+    sa = (struct sockaddr_in *) addr->handle;
+    host = ntohl(sa->sin_addr.s_addr);
+    addr_port = ntohs(sa->sin_port);
+
+    M_snprintf(buffer, buffer_len, "%i.%i.%i.%i",
+               (host >> 24) & 0xff, (host >> 16) & 0xff,
+               (host >> 8) & 0xff, host & 0xff);
+
+    // As in net_sdl.c, the port is only shown if it isn't the default,
+    // so the string can be given back to -connect.
+    if (addr_port != DEFAULT_PORT)
+    {
+        char portbuf[10];
+        M_snprintf(portbuf, sizeof(portbuf), ":%i", addr_port);
+        M_StringConcat(buffer, portbuf, buffer_len);
+    }
+}
+
+net_addr_t *NET_UDP_ResolveAddress(const char *address)
+{
+    struct addrinfo hints, *result;
+    struct sockaddr_in sa;
+    char *addr_hostname;
+    int addr_port;
+    char *colon;
+
+    colon = strchr(address, ':');
+
+    addr_hostname = M_StringDuplicate(address);
+    if (colon != NULL)
+    {
+        addr_hostname[colon - address] = '\0';
+        addr_port = atoi(colon + 1);
+    }
+    else
+    {
+        addr_port = port;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    if (getaddrinfo(addr_hostname, NULL, &hints, &result) != 0)
+    {
+        // unable to resolve
+
+        free(addr_hostname);
+        return NULL;
+    }
+
+    free(addr_hostname);
+
+    sa = *((struct sockaddr_in *) result->ai_addr);
+    sa.sin_port = htons(addr_port);
+    freeaddrinfo(result);
+
+    return NET_UDP_FindAddress(&sa);
+}
+
+net_module_t *NET_UDP_DefaultModule(void)
+{
+    //!
+    // @category net
+    //
+    // Use SDL_net for network games instead of the native sockets.
+    //
+
+    if (M_CheckParm("-sdlnet") > 0)
+    {
+        return &net_sdl_module;
+    }
+
+    return &net_udp_module;
+}
+
+// Complete module
+
+net_module_t net_udp_module =
+{
+    NET_UDP_InitClient,
+    NET_UDP_InitServer,
+    NET_UDP_SendPacket,
+    NET_UDP_RecvPacket,
+    NET_UDP_AddrToString,
+    NET_UDP_FreeAddress,
+    NET_UDP_ResolveAddress,
+    NET_UDP_Flush,
+    NET_UDP_WaitPacket,
+};
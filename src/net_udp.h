@@ -0,0 +1,40 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Networking module which uses native UDP sockets, receiving and
+//     sending datagrams in batches where the platform allows it.
+//
+
+#ifndef NET_UDP_H
+#define NET_UDP_H
+
+#include "net_defs.h"
+
+#define NET_UDP_MAXSOCKETS 64
+
+extern net_module_t net_udp_module;
+
+// The module to use for games over the network: the native one, unless
+// -sdlnet was given.
+net_module_t *NET_UDP_DefaultModule(void);
+
+// For a dedicated server hosting several games: bind a socket on the
+// port after the last one, returning its index. The first socket, from
+// InitServer, is index 0.
+int NET_UDP_OpenGameSocket(void);
+
+// Send and receive on the given socket from now on.
+void NET_UDP_SelectSocket(int index);
+
+#endif /* #ifndef NET_UDP_H */
@@ -0,0 +1,114 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Visplane storage and lookup shared by the games' renderers.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "i_system.h"
+#include "r_visplane.h"
+
+static unsigned int VisplaneHash(fixed_t height, int picnum, int lightlevel,
+                                 int special)
+{
+    return ((unsigned int) picnum * 3 + (unsigned int) lightlevel
+          + (unsigned int) height * 7 + (unsigned int) special * 5)
+         & (VISPLANEHASHSIZE - 1);
+}
+
+void R_ClearVisplanePool(visplanepool_t *pool)
+{
+    int i;
+
+    pool->count = 0;
+
+    for (i = 0; i < VISPLANEHASHSIZE; ++i)
+    {
+        pool->hash[i] = -1;
+        pool->hashtail[i] = -1;
+    }
+}
+
+void *R_FindVisplane(visplanepool_t *pool, fixed_t height, int picnum,
+                     int lightlevel, int special)
+{
+    visplanekey_t *key;
+    int i;
+
+    for (i = pool->hash[VisplaneHash(height, picnum, lightlevel, special)];
+         i != -1; i = key->next)
+    {
+        key = &pool->keys[i];
+
+        if (key->height == height && key->picnum == picnum
+         && key->lightlevel == lightlevel && key->special == special)
+        {
+            return R_Visplane(pool, i);
+        }
+    }
+
+    return NULL;
+}
+
+void *R_NewVisplane(visplanepool_t *pool, fixed_t height, int picnum,
+                    int lightlevel, int special)
+{
+    visplanekey_t *key;
+    unsigned int hash;
+
+    // [crispy] remove MAXVISPLANES limit
+    if (pool->count == pool->numchunks * pool->chunksize)
+    {
+        pool->chunks = I_Realloc(pool->chunks,
+                                 (pool->numchunks + 1) * sizeof(*pool->chunks));
+        pool->chunks[pool->numchunks] =
+            I_Realloc(NULL, pool->chunksize * pool->size);
+        memset(pool->chunks[pool->numchunks], 0,
+               pool->chunksize * pool->size);
+        pool->numchunks++;
+        pool->keys = I_Realloc(pool->keys, pool->numchunks * pool->chunksize
+                                           * sizeof(*pool->keys));
+
+        if (pool->count)
+        {
+            fprintf(stderr, "R_FindPlane: Hit MAXVISPLANES limit at %d, "
+                            "raised to %d.\n",
+                    pool->count, pool->numchunks * pool->chunksize);
+        }
+    }
+
+    key = &pool->keys[pool->count];
+    key->height = height;
+    key->picnum = picnum;
+    key->lightlevel = lightlevel;
+    key->special = special;
+    key->next = -1;
+
+    hash = VisplaneHash(height, picnum, lightlevel, special);
+
+    if (pool->hashtail[hash] == -1)
+    {
+        pool->hash[hash] = pool->count;
+    }
+    else
+    {
+        pool->keys[pool->hashtail[hash]].next = pool->count;
+    }
+
+    pool->hashtail[hash] = pool->count;
+
+    return R_Visplane(pool, pool->count++);
+}
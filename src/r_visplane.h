@@ -0,0 +1,83 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Visplane storage and lookup shared by the games' renderers.
+//
+//	Each game has its own visplane_t, so the pool only knows its size.
+//	Visplanes live in chunks that are kept between frames and never
+//	move, so floorplane, ceilingplane and other pointers into them stay
+//	valid as the count grows. Plane i is the i-th made this frame, which
+//	keeps the vanilla drawing order.
+//
+//	Lookups go through a hash on the plane's key. Each bucket is kept in
+//	creation order, so the first match is the same plane the vanilla
+//	linear search would find.
+//
+
+#ifndef __R_VISPLANE__
+#define __R_VISPLANE__
+
+#include "doomtype.h"
+#include "m_fixed.h"
+
+#define VISPLANEHASHSIZE 512 // Power of 2
+
+// What R_FindPlane matches visplanes on. special is only used by
+// Heretic and Hexen; Doom and Strife pass 0.
+typedef struct
+{
+    fixed_t height;
+    int picnum;
+    int lightlevel;
+    int special;
+    int next;                   // next plane in the same bucket, or -1
+} visplanekey_t;
+
+typedef struct
+{
+    size_t size;                // sizeof the game's visplane_t
+    int chunksize;              // visplanes per chunk, MAXVISPLANES
+    int count;                  // in use this frame
+
+    byte **chunks;
+    int numchunks;
+    visplanekey_t *keys;        // by plane number
+
+    int hash[VISPLANEHASHSIZE];
+    int hashtail[VISPLANEHASHSIZE];
+} visplanepool_t;
+
+// A pool for visplanes of type, numvisplanes at a time.
+#define VISPLANEPOOL(type, numvisplanes) { sizeof(type), (numvisplanes) }
+
+// Empties the pool for a new frame.
+void R_ClearVisplanePool(visplanepool_t *pool);
+
+// The first plane made this frame with the given key, or NULL.
+void *R_FindVisplane(visplanepool_t *pool, fixed_t height, int picnum,
+                     int lightlevel, int special);
+
+// Makes a new plane with the given key. Its fields are left as the last
+// frame had them; the pool only records the key.
+void *R_NewVisplane(visplanepool_t *pool, fixed_t height, int picnum,
+                    int lightlevel, int special);
+
+// Plane number i of this frame, for 0 <= i < pool->count.
+static inline void *R_Visplane(visplanepool_t *pool, int i)
+{
+    return pool->chunks[i / pool->chunksize]
+         + (size_t) (i % pool->chunksize) * pool->size;
+}
+
+#endif
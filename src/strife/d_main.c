@@ -1654,6 +1654,22 @@ void D_DoomMain (void)
         exit(0);
     }
 
+    //!
+    // @arg <address>
+    // @category net
+    //
+    // Print the lag statistics for each client of the server running
+    // on the given address. The server must be started with -netstats.
+    //
+
+    p = M_CheckParmWithArgs("-querystats", 1);
+
+    if (p)
+    {
+        NET_QueryStats(myargv[p+1]);
+        exit(0);
+    }
+
     //!
     // @category net
     //
@@ -103,7 +103,8 @@ static loop_interface_t strife_loop_interface = {
     D_ProcessEvents,
     G_BuildTiccmd,
     RunTic,
-    NullMenuTicker
+    NullMenuTicker,
+    NULL
 };
 
 
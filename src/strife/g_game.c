@@ -1862,7 +1862,7 @@ void G_DoLoadGame (boolean userload)
 
     gameaction = ga_nothing;
 
-    save_stream = M_fopen(loadpath, "rb");
+    save_stream = mem_fopen_file(loadpath);
 
     // [STRIFE] If the file does not exist, G_DoLoadLevel is called.
     if (save_stream == NULL)
@@ -1878,7 +1878,7 @@ void G_DoLoadGame (boolean userload)
 
     if (!P_ReadSaveGameHeader())
     {
-        fclose(save_stream);
+        mem_fclose(save_stream);
         return;
     }
 
@@ -1913,7 +1913,7 @@ void G_DoLoadGame (boolean userload)
     if (!P_ReadSaveGameEOF())
         I_Error ("Bad savegame");
 
-    fclose(save_stream);
+    mem_fclose(save_stream);
     
     if (setsizeneeded)
         R_ExecuteSetViewSize ();
@@ -2011,17 +2011,12 @@ void G_DoSaveGame (char *path)
     M_WriteFile(current_path, gamemapbytes, 4);
     Z_Free(current_path);
 
-    // Open the savegame file for writing.  We write to a temporary file
-    // and then rename it at the end if it was successfully written.
+    // The savegame is built in memory, then written to a temporary file
+    // and renamed at the end if it was successfully written.
     // This prevents an existing savegame from being overwritten by 
     // a corrupted one, or if a savegame buffer overrun occurs.
 
-    save_stream = M_fopen(temp_savegame_file, "wb");
-
-    if (save_stream == NULL)
-    {
-        return;
-    }
+    save_stream = mem_fopen_write();
 
     savegame_error = false;
 
@@ -2040,15 +2035,22 @@ void G_DoSaveGame (char *path)
     // except if the vanilla_savegame_limit setting is turned off.
     // [STRIFE]: Verified subject to same limit.
 
-    if (vanilla_savegame_limit && ftell(save_stream) > SAVEGAMESIZE)
+    if (vanilla_savegame_limit && mem_ftell(save_stream) > SAVEGAMESIZE)
     {
         I_Error ("Savegame buffer overrun");
     }
     */
     
-    // Finish up, close the savegame file.
+    // Finish up, write out the savegame file.
+
+    if (!mem_fwrite_file(save_stream, temp_savegame_file))
+    {
+        mem_fclose(save_stream);
+        Z_Free(savegame_file);
+        return;
+    }
 
-    fclose(save_stream);
+    mem_fclose(save_stream);
 
     // Now rename the temporary savegame file to the actual savegame
     // file, overwriting the old savegame if there was one there.
@@ -58,6 +58,27 @@
     memcpy(field, ptr, len);        \
     ptr += len;
 
+// [AP] Number of speaker ID hash chains in a dialog script.
+#define DIALOG_HASHSIZE 64
+
+//
+// Types
+//
+
+// [AP] A parsed SCRIPTxx lump. The dialogs with the same speaker ID are
+// chained in the order they are in the lump, so P_DialogFind finds the
+// same one the linear search through the lump used to. Scripts stay
+// loaded once parsed, so going back to a map doesn't parse it again.
+typedef struct dialogscript_s
+{
+    int lumpnum;
+    int numdialogs;
+    mapdialog_t *dialogs;
+    int *nextspeaker;               // next dialog with the same speaker, or -1
+    int firstspeaker[DIALOG_HASHSIZE];
+    struct dialogscript_s *next;    // next script in the cache
+} dialogscript_t;
+
 //
 // Globals
 //
@@ -75,22 +96,16 @@ char mission_objective[OBJECTIVE_LEN];
 // Static Globals
 //
 
-// True if SCRIPT00 is loaded.
-static boolean script0loaded;
+// The current level's script, or NULL if it has none. The dialogs in it
+// didn't exist in Strife, but are new to account for structure
+// alignment/packing concerns, given that Chocolate Doom is multiplatform.
+static dialogscript_t *levelscript;
 
-// Number of dialogs defined in the current level's script.
-static int numleveldialogs;
+// The SCRIPT00 script, or NULL if it is not loaded yet.
+static dialogscript_t *script0;
 
-// The actual level dialogs. This didn't exist in Strife, but is new to account
-// for structure alignment/packing concerns, given that Chocolate Doom is
-// multiplatform.
-static mapdialog_t *leveldialogs;
-
-// The actual script00 dialogs. As above.
-static mapdialog_t *script0dialogs;
-
-// Number of dialogs defined in the SCRIPT00 lump.
-static int numscript0dialogs;
+// [AP] All the scripts parsed so far.
+static dialogscript_t *dialogscripts;
 
 // The player engaged in dialog. This is always player 1, though, since Rogue
 // never completed the ability to use dialog outside of single-player mode.
@@ -437,6 +452,68 @@ static void P_ParseDialogLump(byte *lump, mapdialog_t **dialogs,
     }
 }
 
+//
+// P_DialogHash
+//
+// [AP] Hash chain for a speaker ID.
+//
+static int P_DialogHash(int speakerid)
+{
+    return (unsigned int) speakerid % DIALOG_HASHSIZE;
+}
+
+//
+// P_DialogScript
+//
+// [AP] Returns the parsed script of a dialog lump, parsing it and chaining
+// its dialogs by speaker ID the first time.
+//
+static dialogscript_t *P_DialogScript(int lumpnum)
+{
+    dialogscript_t *script;
+    int *lastspeaker[DIALOG_HASHSIZE];
+    byte *lumpptr;
+    int i;
+
+    for(script = dialogscripts; script != NULL; script = script->next)
+    {
+        if(script->lumpnum == lumpnum)
+            return script;
+    }
+
+    script = Z_Malloc(sizeof(dialogscript_t), PU_STATIC, NULL);
+    script->lumpnum = lumpnum;
+    script->numdialogs = W_LumpLength(lumpnum) / ORIG_MAPDIALOG_SIZE;
+
+    lumpptr = W_CacheLumpNum(lumpnum, PU_STATIC);
+    P_ParseDialogLump(lumpptr, &script->dialogs, script->numdialogs,
+                      PU_STATIC);
+    Z_Free(lumpptr); // haleyjd: free the original lump
+
+    script->nextspeaker = Z_Malloc(script->numdialogs * sizeof(int),
+                                   PU_STATIC, NULL);
+
+    for(i = 0; i < DIALOG_HASHSIZE; i++)
+    {
+        script->firstspeaker[i] = -1;
+        lastspeaker[i] = &script->firstspeaker[i];
+    }
+
+    for(i = 0; i < script->numdialogs; i++)
+    {
+        int hash = P_DialogHash(script->dialogs[i].speakerid);
+
+        script->nextspeaker[i] = -1;
+        *lastspeaker[hash] = i;
+        lastspeaker[hash] = &script->nextspeaker[i];
+    }
+
+    script->next = dialogscripts;
+    dialogscripts = script;
+
+    return script;
+}
+
 //
 // P_DialogLoad
 //
@@ -452,29 +529,16 @@ void P_DialogLoad(void)
     // load the SCRIPTxy lump corresponding to MAPxy, if it exists.
     DEH_snprintf(lumpname, sizeof(lumpname), "script%02d", gamemap);
     if((lumpnum = W_CheckNumForName(lumpname)) == -1)
-        numleveldialogs = 0;
+        levelscript = NULL;
     else
-    {
-        byte *leveldialogptr = W_CacheLumpNum(lumpnum, PU_STATIC);
-        numleveldialogs = W_LumpLength(lumpnum) / ORIG_MAPDIALOG_SIZE;
-        P_ParseDialogLump(leveldialogptr, &leveldialogs, numleveldialogs, 
-                          PU_LEVEL);
-        Z_Free(leveldialogptr); // haleyjd: free the original lump
-    }
+        levelscript = P_DialogScript(lumpnum);
 
     // also load SCRIPT00 if it has not been loaded yet
-    if(!script0loaded)
+    if(script0 == NULL)
     {
-        byte *script0ptr;
-
-        script0loaded = true; 
         // BUG: Rogue should have used W_GetNumForName here...
         lumpnum = W_CheckNumForName(DEH_String("script00")); 
-        script0ptr = W_CacheLumpNum(lumpnum, PU_STATIC);
-        numscript0dialogs = W_LumpLength(lumpnum) / ORIG_MAPDIALOG_SIZE;
-        P_ParseDialogLump(script0ptr, &script0dialogs, numscript0dialogs,
-                          PU_STATIC);
-        Z_Free(script0ptr); // haleyjd: free the original lump
+        script0 = P_DialogScript(lumpnum);
     }
 }
 
@@ -522,29 +586,34 @@ int P_PlayerHasItem(player_t *player, mobjtype_t type)
 //
 mapdialog_t *P_DialogFind(mobjtype_t type, int jumptoconv)
 {
+    int hash = P_DialogHash(type);
     int i;
 
     // check the map-specific dialogs first
-    for(i = 0; i < numleveldialogs; i++)
+    if(levelscript != NULL)
     {
-        if(type == leveldialogs[i].speakerid)
+        for(i = levelscript->firstspeaker[hash]; i != -1;
+            i = levelscript->nextspeaker[i])
         {
-            if(jumptoconv <= 1)
-                return &leveldialogs[i];
-            else
-                --jumptoconv;
+            if(type == levelscript->dialogs[i].speakerid)
+            {
+                if(jumptoconv <= 1)
+                    return &levelscript->dialogs[i];
+                else
+                    --jumptoconv;
+            }
         }
     }
 
     // check SCRIPT00 dialogs next
-    for(i = 0; i < numscript0dialogs; i++)
+    for(i = script0->firstspeaker[hash]; i != -1; i = script0->nextspeaker[i])
     {
-        if(type == script0dialogs[i].speakerid)
-            return &script0dialogs[i];
+        if(type == script0->dialogs[i].speakerid)
+            return &script0->dialogs[i];
     }
 
     // the default dialog is script 0 in the SCRIPT00 lump.
-    return &script0dialogs[0];
+    return &script0->dialogs[0];
 }
 
 //
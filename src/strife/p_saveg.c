@@ -37,7 +37,7 @@
 // haleyjd 09/28/10: [STRIFE] VERSIONSIZE == 8
 #define VERSIONSIZE 8 
 
-FILE *save_stream;
+MEMFILE *save_stream;
 int savegamelength;
 boolean savegame_error;
 static int restoretargets_fail; // [crispy]
@@ -83,9 +83,11 @@ char *P_SaveGameFile(int slot)
 
 static byte saveg_read8(void)
 {
-    byte result;
+    int result;
+
+    result = mem_fgetc(save_stream);
 
-    if (fread(&result, 1, 1, save_stream) < 1)
+    if (result == EOF)
     {
         if (!savegame_error)
         {
@@ -101,7 +103,7 @@ static byte saveg_read8(void)
 
 static void saveg_write8(byte value)
 {
-    if (fwrite(&value, 1, 1, save_stream) < 1)
+    if (mem_fputc(value, save_stream) == EOF)
     {
         if (!savegame_error)
         {
@@ -156,7 +158,7 @@ static void saveg_read_pad(void)
     int padding;
     int i;
 
-    pos = ftell(save_stream);
+    pos = mem_ftell(save_stream);
 
     padding = (4 - (pos & 3)) & 3;
 
@@ -172,7 +174,7 @@ static void saveg_write_pad(void)
     int padding;
     int i;
 
-    pos = ftell(save_stream);
+    pos = mem_ftell(save_stream);
 
     padding = (4 - (pos & 3)) & 3;
 
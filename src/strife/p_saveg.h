@@ -22,6 +22,8 @@
 
 #include <stdio.h>
 
+#include "memio.h"
+
 // maximum size of a savegame description
 
 #define SAVESTRINGSIZE 24
@@ -56,7 +58,7 @@ void P_ArchiveSpecials (void);
 void P_UnArchiveSpecials (void);
 void P_RestoreTargets (void); // [crispy]
 
-extern FILE *save_stream;
+extern MEMFILE *save_stream;
 extern boolean savegame_error;
 
 
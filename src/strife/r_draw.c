@@ -24,6 +24,7 @@
 #include "doomdef.h"
 #include "deh_main.h"
 
+#include "i_simd.h"
 #include "i_system.h"
 #include "z_zone.h"
 #include "w_wad.h"
@@ -627,8 +628,6 @@ void R_DrawSpan (void)
 //  unsigned int position, step;
     byte *dest;
     int count;
-    int spot;
-    unsigned int xtemp, ytemp;
 
 #ifdef RANGECHECK
     if (ds_x2 < ds_x1
@@ -657,25 +656,28 @@ void R_DrawSpan (void)
     dest = ylookup[ds_y] + columnofs[ds_x1];
 
     // We do not check for zero spans here?
-    count = ds_x2 - ds_x1;
+    count = ds_x2 - ds_x1 + 1;
 
-    do
+    // [AP] Texture indices come a batch at a time from I_SpanSpots (SIMD
+    // when available); the lookups stay per pixel.
+    while (count > 0)
     {
+	int spots[I_SPAN_SPOTS_BATCH];
+	int n = MIN(count, I_SPAN_SPOTS_BATCH);
+	int i;
+
 	// Calculate current texture index in u,v.
         // [crispy] fix flats getting more distorted the closer they are to the right
-        ytemp = (ds_yfrac >> 10) & 0x0fc0;
-        xtemp = (ds_xfrac >> 16) & 0x3f;
-        spot = xtemp | ytemp;
+	I_SpanSpots(spots, ds_xfrac, ds_yfrac, ds_xstep, ds_ystep, n);
 
 	// Lookup pixel from flat texture tile,
 	//  re-index using light/colormap.
-	*dest++ = ds_colormap[ds_source[spot]];
-
-//      position += step;
-        ds_xfrac += ds_xstep;
-        ds_yfrac += ds_ystep;
-
-    } while (count--);
+	for (i = 0; i < n; i++)
+	    *dest++ = ds_colormap[ds_source[spots[i]]];
+	ds_xfrac = (fixed_t) ((unsigned int) ds_xfrac + n * (unsigned int) ds_xstep);
+	ds_yfrac = (fixed_t) ((unsigned int) ds_yfrac + n * (unsigned int) ds_ystep);
+	count -= n;
+    }
 }
 
 
@@ -759,10 +761,8 @@ void R_DrawSpan (void)
 void R_DrawSpanLow (void)
 {
 //  unsigned int position, step;
-    unsigned int xtemp, ytemp;
     byte *dest;
     int count;
-    int spot;
 
 #ifdef RANGECHECK
     if (ds_x2 < ds_x1
@@ -783,7 +783,7 @@ void R_DrawSpanLow (void)
          | ((ds_ystep >> 6)  & 0x0000ffff);
 */
 
-    count = (ds_x2 - ds_x1);
+    count = ds_x2 - ds_x1 + 1;
 
     // Blocky mode, need to multiply by 2.
     ds_x1 <<= 1;
@@ -791,24 +791,27 @@ void R_DrawSpanLow (void)
 
     dest = ylookup[ds_y] + columnofs[ds_x1];
 
-    do
+    while (count > 0)
     {
+	int spots[I_SPAN_SPOTS_BATCH];
+	int n = MIN(count, I_SPAN_SPOTS_BATCH);
+	int i;
+
 	// Calculate current texture index in u,v.
         // [crispy] fix flats getting more distorted the closer they are to the right
-        ytemp = (ds_yfrac >> 10) & 0x0fc0;
-        xtemp = (ds_xfrac >> 16) & 0x3f;
-        spot = xtemp | ytemp;
+	I_SpanSpots(spots, ds_xfrac, ds_yfrac, ds_xstep, ds_ystep, n);
 
 	// Lowres/blocky mode does it twice,
 	//  while scale is adjusted appropriately.
-	*dest++ = ds_colormap[ds_source[spot]];
-	*dest++ = ds_colormap[ds_source[spot]];
-
-//	position += step;
-	ds_xfrac += ds_xstep;
-	ds_yfrac += ds_ystep;
-
-    } while (count--);
+	for (i = 0; i < n; i++)
+	{
+	    *dest++ = ds_colormap[ds_source[spots[i]]];
+	    *dest++ = ds_colormap[ds_source[spots[i]]];
+	}
+	ds_xfrac = (fixed_t) ((unsigned int) ds_xfrac + n * (unsigned int) ds_xstep);
+	ds_yfrac = (fixed_t) ((unsigned int) ds_yfrac + n * (unsigned int) ds_ystep);
+	count -= n;
+    }
 }
 
 //
@@ -31,6 +31,7 @@
 
 #include "r_local.h"
 #include "r_sky.h"
+#include "r_visplane.h"
 
 
 
@@ -44,11 +45,12 @@ planefunction_t		ceilingfunc;
 // Here comes the obnoxious "visplane".
 // haleyjd 08/29/10: [STRIFE] MAXVISPLANES increased to 200
 #define MAXVISPLANES	200*8
-visplane_t		visplanes[MAXVISPLANES];
-visplane_t*		lastvisplane;
 visplane_t*		floorplane;
 visplane_t*		ceilingplane;
 
+// [AP] See r_visplane.h
+static visplanepool_t	visplanepool = VISPLANEPOOL(visplane_t, MAXVISPLANES);
+
 // ?
 #define MAXOPENINGS	MAXWIDTH*64*4
 int			openings[MAXOPENINGS]; // [crispy] 32-bit integer math
@@ -196,7 +198,7 @@ void R_ClearPlanes (void)
 	ceilingclip[i] = -1;
     }
 
-    lastvisplane = visplanes;
+    R_ClearVisplanePool(&visplanepool);
     lastopening = openings;
     
     // texture calculation
@@ -213,6 +215,18 @@ void R_ClearPlanes (void)
 
 
 
+static visplane_t* R_NewPlane (fixed_t height, int picnum, int lightlevel)
+{
+    visplane_t* pl;
+
+    pl = R_NewVisplane(&visplanepool, height, picnum, lightlevel, 0);
+    pl->height = height;
+    pl->picnum = picnum;
+    pl->lightlevel = lightlevel;
+
+    return pl;
+}
+
 //
 // R_FindPlane
 //
@@ -230,28 +244,12 @@ R_FindPlane
 	lightlevel = 0;
     }
 	
-    for (check=visplanes; check<lastvisplane; check++)
-    {
-	if (height == check->height
-	    && picnum == check->picnum
-	    && lightlevel == check->lightlevel)
-	{
-	    break;
-	}
-    }
-    
-			
-    if (check < lastvisplane)
+    check = R_FindVisplane(&visplanepool, height, picnum, lightlevel, 0);
+
+    if (check)
 	return check;
-		
-    if (lastvisplane - visplanes == MAXVISPLANES)
-	I_Error ("R_FindPlane: no more visplanes");
-		
-    lastvisplane++;
 
-    check->height = height;
-    check->picnum = picnum;
-    check->lightlevel = lightlevel;
+    check = R_NewPlane(height, picnum, lightlevel);
     check->minx = SCREENWIDTH;
     check->maxx = -1;
     
@@ -312,11 +310,7 @@ R_CheckPlane
     }
 	
     // make a new visplane
-    lastvisplane->height = pl->height;
-    lastvisplane->picnum = pl->picnum;
-    lastvisplane->lightlevel = pl->lightlevel;
-    
-    pl = lastvisplane++;
+    pl = R_NewPlane(pl->height, pl->picnum, pl->lightlevel);
     pl->minx = start;
     pl->maxx = stop;
 
@@ -374,23 +368,22 @@ void R_DrawPlanes (void)
     int			stop;
     int			angle;
     int                 lumpnum;
+    int			i;
 				
 #ifdef RANGECHECK
     if (ds_p - drawsegs > MAXDRAWSEGS)
 	I_Error ("R_DrawPlanes: drawsegs overflow (%td)",
 		 ds_p - drawsegs);
     
-    if (lastvisplane - visplanes > MAXVISPLANES)
-	I_Error ("R_DrawPlanes: visplane overflow (%td)",
-		 lastvisplane - visplanes);
-    
     if (lastopening - openings > MAXOPENINGS)
 	I_Error ("R_DrawPlanes: opening overflow (%td)",
 		 lastopening - openings);
 #endif
 
-    for (pl = visplanes ; pl < lastvisplane ; pl++)
+    for (i = 0 ; i < visplanepool.count ; i++)
     {
+	pl = R_Visplane(&visplanepool, i);
+
 	if (pl->minx > pl->maxx)
 	    continue;
 
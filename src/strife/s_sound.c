@@ -616,6 +616,7 @@ static voiceinfo_t *S_getVoice(const char *name, int lumpnum)
         voice->sfx.numchannels = -1;
         voice->sfx.usefulness = -1;
         voice->sfx.lumpnum = lumpnum;
+        voice->sfx.stream = true; // [AP] Keep it out of the sound cache
 
         // throw it onto the table.
         voice->next = voices[hashkey];
@@ -60,10 +60,47 @@ extern char **crstr;
 #ifndef CRISPY_TRUECOLOR
 extern byte *tranmap;
 #else
-extern const pixel_t (*blendfunc) (const pixel_t fg, const pixel_t bg);
 extern const pixel_t I_BlendAdd (const pixel_t bg, const pixel_t fg);
 extern const pixel_t I_BlendDark (const pixel_t bg, const int d);
 extern const pixel_t I_BlendOver (const pixel_t bg, const pixel_t fg);
+
+// [AP] Inline versions of the above for the drawers. Every 32-bit format
+// SDL gives us keeps each channel in its own byte, so all the channels
+// are blended at once, two to a word for the multiplies.
+extern pixel_t blend_rgbmask, blend_amask;
+
+#define BLEND_ALPHA 0xa8
+
+static inline pixel_t V_BlendAdd (const pixel_t bg, const pixel_t fg)
+{
+    // Per-byte sum, wrapping, then bytes that carried are set to 0xff
+    const pixel_t sum = ((bg & 0x7f7f7f7f) + (fg & 0x7f7f7f7f))
+                      ^ ((bg ^ fg) & 0x80808080);
+    const pixel_t carry = ((bg & fg) | ((bg | fg) & ~sum)) & 0x80808080;
+
+    return ((sum | (carry - (carry >> 7)) | carry) & blend_rgbmask)
+         | blend_amask;
+}
+
+static inline pixel_t V_BlendDark (const pixel_t bg, const int d)
+{
+    const pixel_t ag = (((bg >> 8) & 0x00ff00ff) * d) & 0xff00ff00;
+    const pixel_t rb = (((bg & 0x00ff00ff) * d) >> 8) & 0x00ff00ff;
+
+    return ((ag | rb) & blend_rgbmask) | blend_amask;
+}
+
+static inline pixel_t V_BlendOver (const pixel_t bg, const pixel_t fg)
+{
+    const pixel_t ag = (((fg >> 8) & 0x00ff00ff) * BLEND_ALPHA
+                      + ((bg >> 8) & 0x00ff00ff) * (0xff - BLEND_ALPHA))
+                     & 0xff00ff00;
+    const pixel_t rb = ((((fg & 0x00ff00ff) * BLEND_ALPHA
+                      + (bg & 0x00ff00ff) * (0xff - BLEND_ALPHA)) >> 8))
+                     & 0x00ff00ff;
+
+    return ((ag | rb) & blend_rgbmask) | blend_amask;
+}
 #endif
 
 int V_GetPaletteIndex(byte *palette, int r, int g, int b);
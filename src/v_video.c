@@ -47,6 +47,7 @@
 #include "config.h"
 #ifdef HAVE_LIBPNG
 #include <png.h>
+#include "SDL.h" // [AP] screenshot thread
 #endif
 
 // TODO: There are separate RANGECHECK defines for different games, but this
@@ -73,6 +74,10 @@ static pixel_t *dest_screen = NULL;
 
 int dirtybox[4]; 
 
+// [AP] Set while a cached layer is being rendered, see V_DrawLayer
+static boolean layerbuilding;
+static int layerbox[4];
+
 // haleyjd 08/28/10: clipping callback function for patches.
 // This is needed for Chocolate Strife, which clips patches to the screen.
 static vpatchclipfunc_t patchclip_callback = NULL;
@@ -90,6 +95,11 @@ void V_MarkRect(int x, int y, int width, int height)
         M_AddToBox (dirtybox, x, y); 
         M_AddToBox (dirtybox, x + width-1, y + height-1); 
     }
+    else if (layerbuilding)
+    {
+        M_AddToBox (layerbox, x, y);
+        M_AddToBox (layerbox, x + width-1, y + height-1);
+    }
 } 
  
 
@@ -184,14 +194,14 @@ static const inline pixel_t drawpatchpx10 (const pixel_t dest, const pixel_t sou
 #ifndef CRISPY_TRUECOLOR
 {return tranmap[(dest<<8)+source];}
 #else
-{return I_BlendOver(dest, colormaps[source]);}
+{return V_BlendOver(dest, colormaps[source]);}
 #endif
 // (4) color-translated, translucent patch
 static const inline pixel_t drawpatchpx11 (const pixel_t dest, const pixel_t source)
 #ifndef CRISPY_TRUECOLOR
 {return tranmap[(dest<<8)+dp_translation[source]];}
 #else
-{return I_BlendOver(dest, colormaps[dp_translation[source]]);}
+{return V_BlendOver(dest, colormaps[dp_translation[source]]);}
 #endif
 // [crispy] array of function pointers holding the different rendering functions
 typedef const pixel_t drawpatchpx_t (const pixel_t dest, const pixel_t source);
@@ -199,6 +209,249 @@ static drawpatchpx_t *const drawpatchpx_a[2][2] = {{drawpatchpx11, drawpatchpx10
 
 static fixed_t dx, dxi, dy, dyi;
 
+// [AP] A run of opaque pixels in a decoded patch or cached layer
+typedef struct
+{
+    int x; // In screen pixels, from the left edge
+    int length; // In screen pixels
+    int offset; // Into pixels
+} patchrun_t;
+
+#ifndef CRISPY_TRUECOLOR
+// [AP] Pre-decoded patches for the common opaque, untranslated case at a
+// power of two scale. A patch is decoded once into runs of opaque pixels
+// per source row, already widened to the screen scale, so drawing it is
+// one memcpy per run and screen row instead of a drawpatchpx call per
+// pixel. Patches are keyed by address and checked against a hash of their
+// posts, since a purged patch's memory may come back as another one.
+// Only used when the whole patch is on screen; anything clipped takes the
+// regular path, which handles the clipping edge cases.
+
+#define PATCHCACHE_SLOTS 64
+#define PATCHCACHE_MAXBYTES (1 << 20) // Bigger decodes aren't kept
+
+typedef struct
+{
+    const patch_t *patch;
+    unsigned int hash;
+    int scale;
+    int width, height; // In source pixels, height covers every post
+    int *rowstart; // height + 1 entries into runs
+    patchrun_t *runs;
+    byte *pixels;
+} patchcache_t;
+
+static patchcache_t patchcache[PATCHCACHE_SLOTS];
+
+// Walks the posts the same way V_DrawPatch does, hashing everything the
+// decode depends on. Returns the hash and the bottom of the lowest post.
+static unsigned int V_HashPatchPosts(const patch_t *patch, int *bottom)
+{
+    unsigned int hash = 2166136261u;
+    int w = SHORT(patch->width);
+    int col;
+
+    *bottom = 0;
+    hash = (hash ^ (unsigned int) w) * 16777619u;
+
+    for (col = 0; col < w; col++)
+    {
+        const column_t *column = (const column_t *)((const byte *)patch + LONG(patch->columnofs[col]));
+        int topdelta = -1;
+
+        while (column->topdelta != 0xff)
+        {
+            const byte *p = (const byte *)column + 3;
+            int i;
+
+            if (column->topdelta <= topdelta)
+                topdelta += column->topdelta;
+            else
+                topdelta = column->topdelta;
+
+            hash = (hash ^ column->topdelta) * 16777619u;
+            hash = (hash ^ column->length) * 16777619u;
+
+            if (!column->length)
+                break;
+
+            for (i = 0; i < column->length; i++)
+                hash = (hash ^ p[i]) * 16777619u;
+
+            if (topdelta + column->length > *bottom)
+                *bottom = topdelta + column->length;
+
+            column = (const column_t *)((const byte *)column + column->length + 4);
+        }
+
+        hash = (hash ^ 0xff) * 16777619u;
+    }
+
+    return hash;
+}
+
+static boolean V_DecodePatch(patchcache_t *pc, const patch_t *patch, int scale,
+                             int height, unsigned int hash)
+{
+    int w = SHORT(patch->width);
+    byte *texels, *mask;
+    int numruns = 0, numpixels = 0;
+    int col, row;
+
+    if ((size_t) w * height * scale * (scale + 1) > PATCHCACHE_MAXBYTES)
+        return false;
+
+    // Paint the posts into a source sized bitmap, later posts over earlier
+    texels = calloc((size_t) w * height + 1, 1);
+    mask = calloc((size_t) w * height + 1, 1);
+
+    for (col = 0; col < w; col++)
+    {
+        const column_t *column = (const column_t *)((const byte *)patch + LONG(patch->columnofs[col]));
+        int topdelta = -1;
+
+        while (column->topdelta != 0xff)
+        {
+            const byte *source = (const byte *)column + 3;
+            int i;
+
+            if (column->topdelta <= topdelta)
+                topdelta += column->topdelta;
+            else
+                topdelta = column->topdelta;
+
+            if (!column->length)
+                break;
+
+            for (i = 0; i < column->length; i++)
+            {
+                texels[(topdelta + i) * w + col] = source[i];
+                mask[(topdelta + i) * w + col] = 1;
+            }
+
+            column = (const column_t *)((const byte *)column + column->length + 4);
+        }
+    }
+
+    for (row = 0; row < height; row++)
+    {
+        for (col = 0; col < w; col++)
+        {
+            if (mask[row * w + col] && (col == 0 || !mask[row * w + col - 1]))
+                numruns++;
+            numpixels += mask[row * w + col];
+        }
+    }
+
+    free(pc->rowstart);
+    free(pc->runs);
+    free(pc->pixels);
+    pc->rowstart = malloc((height + 1) * sizeof(*pc->rowstart));
+    pc->runs = malloc((numruns + 1) * sizeof(*pc->runs));
+    pc->pixels = malloc((size_t) numpixels * scale + 1);
+
+    numruns = 0;
+    numpixels = 0;
+
+    for (row = 0; row < height; row++)
+    {
+        pc->rowstart[row] = numruns;
+
+        for (col = 0; col < w; )
+        {
+            patchrun_t *run;
+            int i;
+
+            if (!mask[row * w + col])
+            {
+                col++;
+                continue;
+            }
+
+            run = &pc->runs[numruns++];
+            run->x = col * scale;
+            run->offset = numpixels;
+
+            for ( ; col < w && mask[row * w + col]; col++)
+            {
+                for (i = 0; i < scale; i++)
+                    pc->pixels[numpixels++] = texels[row * w + col];
+            }
+
+            run->length = numpixels - run->offset;
+        }
+    }
+    pc->rowstart[height] = numruns;
+
+    free(texels);
+    free(mask);
+
+    pc->patch = patch;
+    pc->hash = hash;
+    pc->scale = scale;
+    pc->width = w;
+    pc->height = height;
+
+    return true;
+}
+
+// Draws the patch from its decoded runs if it can, x and y being the
+// top left corner after offsets, in unscaled coordinates.
+static boolean V_DrawPatchCached(int x, int y, const patch_t *patch)
+{
+    patchcache_t *pc;
+    unsigned int hash;
+    pixel_t *desttop;
+    int scale, height, row, i;
+
+    // Exact, drift free stepping only happens at power of two scales, and
+    // at 1x there's nothing to gain over the regular path
+    scale = dx >> FRACBITS;
+    if (scale < 2 || (scale & (scale - 1))
+     || dx != scale << FRACBITS || dy != dx
+     || dxi * scale != FRACUNIT || dyi != dxi)
+        return false;
+
+    hash = V_HashPatchPosts(patch, &height);
+
+    if (x < 0 || y < 0
+     || (x + SHORT(patch->width)) * scale > SCREENWIDTH
+     || (y + height) * scale > SCREENHEIGHT)
+        return false;
+
+    pc = &patchcache[((uintptr_t) patch >> 4) % PATCHCACHE_SLOTS];
+
+    if (pc->patch != patch || pc->hash != hash || pc->scale != scale
+     || pc->width != SHORT(patch->width) || pc->height != height)
+    {
+        if (!V_DecodePatch(pc, patch, scale, height, hash))
+        {
+            pc->patch = NULL;
+            return false;
+        }
+    }
+
+    desttop = dest_screen + y * scale * SCREENWIDTH + x * scale;
+
+    for (row = 0; row < height; row++, desttop += scale * SCREENWIDTH)
+    {
+        const patchrun_t *run = &pc->runs[pc->rowstart[row]];
+        const patchrun_t *end = &pc->runs[pc->rowstart[row + 1]];
+
+        for ( ; run < end; run++)
+        {
+            for (i = 0; i < scale; i++)
+            {
+                memcpy(desttop + i * SCREENWIDTH + run->x,
+                       pc->pixels + run->offset, run->length);
+            }
+        }
+    }
+
+    return true;
+}
+#endif
+
 void V_DrawPatch(int x, int y, patch_t *patch)
 { 
     int count;
@@ -237,6 +490,14 @@ void V_DrawPatch(int x, int y, patch_t *patch)
 
     V_MarkRect(x, y, SHORT(patch->width), SHORT(patch->height));
 
+#ifndef CRISPY_TRUECOLOR
+    // [AP] Opaque patches fully on screen draw from their decoded runs
+    if (!dp_translucent && !dp_translation && V_DrawPatchCached(x, y, patch))
+    {
+        return;
+    }
+#endif
+
     col = 0;
     if (x < 0)
     {
@@ -949,6 +1210,259 @@ void V_DrawFullscreenRawOrPatch(lumpindex_t index)
         I_Error("Invalid fullscreen graphic.");
     }
 }
+// [AP] Cached layers for HUD elements drawn on top of the view every
+// frame. A layer keeps the pixels its draw function put down, as runs of
+// opaque pixels per screen row, so redrawing it is one memcpy per run
+// instead of every patch again. The caller passes a key holding
+// everything the drawing depends on; the layer is re-rendered when no
+// cached one matches it.
+//
+// A layer is only rendered on the second draw with the same key, so
+// lines that change every frame, like coordinates, never pay for it. What
+// was drawn is found by rendering twice, into scratch screens filled with
+// 0 and ~0: opaque pixels come out the same in both. Translucent drawing
+// depends on what is underneath, so it is never cached.
+
+#define LAYERCACHE_SLOTS 32
+#define LAYERCACHE_MAXKEY 192
+
+typedef struct
+{
+    byte key[LAYERCACHE_MAXKEY];
+    size_t keylen;
+    unsigned int lastuse;
+    boolean built;
+    int screenwidth, screenheight;
+    fixed_t scalex, scaley;
+    int box[4]; // For V_MarkRect, unscaled
+    byte *translation; // dp_translation after drawing
+    int x, y, height; // In screen pixels
+    int *rowstart; // height + 1 entries into runs
+    patchrun_t *runs;
+    pixel_t *pixels;
+} layercache_t;
+
+static layercache_t layercache[LAYERCACHE_SLOTS];
+static unsigned int layerclock;
+static pixel_t *layerscreen[2];
+static int layerscreensize;
+
+// Renders the layer. The scratch screens are left filled with 0 and ~0
+// again afterwards, so only the box drawn into needs clearing.
+static void V_BuildLayer(layercache_t *lc, void (*draw)(void *data),
+                         void *data)
+{
+    byte *translation = dp_translation;
+    int size = SCREENWIDTH * SCREENHEIGHT;
+    int x1, x2, y1, y2;
+    int numruns = 0, numpixels = 0;
+    int x, y;
+
+    if (layerscreensize != size)
+    {
+        free(layerscreen[0]);
+        free(layerscreen[1]);
+        layerscreen[0] = malloc(size * sizeof(pixel_t));
+        layerscreen[1] = malloc(size * sizeof(pixel_t));
+        memset(layerscreen[0], 0, size * sizeof(pixel_t));
+        memset(layerscreen[1], 0xff, size * sizeof(pixel_t));
+        layerscreensize = size;
+    }
+
+    M_ClearBox(layerbox);
+    layerbuilding = true;
+    V_UseBuffer(layerscreen[0]);
+    draw(data);
+    dp_translation = translation;
+    V_UseBuffer(layerscreen[1]);
+    draw(data);
+    V_RestoreBuffer();
+    layerbuilding = false;
+
+    lc->translation = dp_translation;
+    memcpy(lc->box, layerbox, sizeof(lc->box));
+
+    // Nothing drawn, keep an empty layer
+    if (layerbox[BOXRIGHT] < layerbox[BOXLEFT])
+    {
+        x1 = y1 = 0;
+        x2 = y2 = -1;
+    }
+    else
+    {
+        x1 = MAX((layerbox[BOXLEFT] * dx) >> FRACBITS, 0);
+        x2 = MIN(((layerbox[BOXRIGHT] + 1) * dx + FRACUNIT - 1) >> FRACBITS, SCREENWIDTH) - 1;
+        y1 = MAX((layerbox[BOXBOTTOM] * dy) >> FRACBITS, 0);
+        y2 = MIN(((layerbox[BOXTOP] + 1) * dy + FRACUNIT - 1) >> FRACBITS, SCREENHEIGHT) - 1;
+    }
+
+    for (y = y1; y <= y2; y++)
+    {
+        const pixel_t *a = layerscreen[0] + y * SCREENWIDTH;
+        const pixel_t *b = layerscreen[1] + y * SCREENWIDTH;
+
+        for (x = x1; x <= x2; x++)
+        {
+            if (a[x] == b[x])
+            {
+                if (x == x1 || a[x - 1] != b[x - 1])
+                    numruns++;
+                numpixels++;
+            }
+        }
+    }
+
+    free(lc->rowstart);
+    free(lc->runs);
+    free(lc->pixels);
+    lc->rowstart = malloc((MAX(y2 - y1 + 1, 0) + 1) * sizeof(*lc->rowstart));
+    lc->runs = malloc((numruns + 1) * sizeof(*lc->runs));
+    lc->pixels = malloc((numpixels + 1) * sizeof(*lc->pixels));
+
+    numruns = 0;
+    numpixels = 0;
+
+    for (y = y1; y <= y2; y++)
+    {
+        pixel_t *a = layerscreen[0] + y * SCREENWIDTH;
+        pixel_t *b = layerscreen[1] + y * SCREENWIDTH;
+
+        lc->rowstart[y - y1] = numruns;
+
+        for (x = x1; x <= x2; )
+        {
+            patchrun_t *run;
+
+            if (a[x] != b[x])
+            {
+                x++;
+                continue;
+            }
+
+            run = &lc->runs[numruns++];
+            run->x = x - x1;
+            run->offset = numpixels;
+
+            for ( ; x <= x2 && a[x] == b[x]; x++)
+                lc->pixels[numpixels++] = a[x];
+
+            run->length = numpixels - run->offset;
+        }
+
+        if (x2 >= x1)
+        {
+            memset(a + x1, 0, (x2 - x1 + 1) * sizeof(pixel_t));
+            memset(b + x1, 0xff, (x2 - x1 + 1) * sizeof(pixel_t));
+        }
+    }
+
+    lc->rowstart[MAX(y2 - y1 + 1, 0)] = numruns;
+    lc->x = x1;
+    lc->y = y1;
+    lc->height = MAX(y2 - y1 + 1, 0);
+    lc->built = true;
+}
+
+void V_DrawLayer(const void *key, size_t keylen,
+                 void (*draw)(void *data), void *data)
+{
+    layercache_t *lc = NULL;
+    pixel_t *desttop;
+    int i, row;
+
+    if (dp_translucent || dest_screen != I_VideoBuffer
+     || keylen > LAYERCACHE_MAXKEY)
+    {
+        draw(data);
+        return;
+    }
+
+    ++layerclock;
+
+    for (i = 0; i < LAYERCACHE_SLOTS; i++)
+    {
+        if (layercache[i].keylen == keylen
+         && layercache[i].screenwidth == SCREENWIDTH
+         && layercache[i].screenheight == SCREENHEIGHT
+         && layercache[i].scalex == dx && layercache[i].scaley == dy
+         && !memcmp(layercache[i].key, key, keylen))
+        {
+            lc = &layercache[i];
+            break;
+        }
+    }
+
+    // First sighting: remember the key in the least recently used slot
+    if (lc == NULL)
+    {
+        lc = &layercache[0];
+
+        for (i = 1; i < LAYERCACHE_SLOTS; i++)
+        {
+            if (layerclock - layercache[i].lastuse > layerclock - lc->lastuse)
+                lc = &layercache[i];
+        }
+
+        memcpy(lc->key, key, keylen);
+        lc->keylen = keylen;
+        lc->screenwidth = SCREENWIDTH;
+        lc->screenheight = SCREENHEIGHT;
+        lc->scalex = dx;
+        lc->scaley = dy;
+        lc->built = false;
+        lc->lastuse = layerclock;
+
+        draw(data);
+        return;
+    }
+
+    lc->lastuse = layerclock;
+
+    if (!lc->built)
+    {
+        V_BuildLayer(lc, draw, data);
+    }
+    else
+    {
+        // Leave dp_translation the way the draw function would have
+        dp_translation = lc->translation;
+    }
+
+    if (lc->box[BOXRIGHT] >= lc->box[BOXLEFT])
+    {
+        V_MarkRect(lc->box[BOXLEFT], lc->box[BOXBOTTOM],
+                   lc->box[BOXRIGHT] - lc->box[BOXLEFT] + 1,
+                   lc->box[BOXTOP] - lc->box[BOXBOTTOM] + 1);
+    }
+
+    desttop = dest_screen + lc->y * SCREENWIDTH + lc->x;
+
+    for (row = 0; row < lc->height; row++, desttop += SCREENWIDTH)
+    {
+        const patchrun_t *run = &lc->runs[lc->rowstart[row]];
+        const patchrun_t *end = &lc->runs[lc->rowstart[row + 1]];
+
+        for ( ; run < end; run++)
+        {
+            memcpy(desttop + run->x, lc->pixels + run->offset,
+                   run->length * sizeof(pixel_t));
+        }
+    }
+}
+
+// Called when what cached layers hold may no longer be what they draw,
+// such as when the truecolor colormaps are rebuilt.
+void V_FlushLayers(void)
+{
+    int i;
+
+    for (i = 0; i < LAYERCACHE_SLOTS; i++)
+    {
+        layercache[i].keylen = 0;
+        layercache[i].built = false;
+    }
+}
+
 //
 // V_Init
 // 
@@ -1085,131 +1599,197 @@ static void warning_fn(png_structp p, png_const_charp s)
     printf("libpng warning: %s\n", s);
 }
 
-void WritePNGfile(char *filename, pixel_t *data,
-                  int width, int height,
-                  byte *palette)
+// [AP] PNG screenshots are encoded and written on a thread. The game
+// thread only reads the frame back and creates the file, which keeps
+// the next screenshot from picking the same name; the captures queue
+// up and are written in order.
+
+typedef struct pngjob_s
+{
+    FILE *handle;
+    byte *pixels;
+    int width, height, pitch;
+    int level;
+    struct pngjob_s *next;
+} pngjob_t;
+
+static boolean pnginit;
+static SDL_Thread *pngthread;
+static SDL_mutex *pnglock;
+static SDL_cond *pngcond;
+static boolean pngquit;
+
+// Behind pnglock
+static pngjob_t *pngqueue, *pngqueuetail;
+
+static void EncodePNG(pngjob_t *job)
 {
     png_structp ppng;
     png_infop pinfo;
-//  png_colorp pcolor;
-    FILE *handle;
-    int i, j;
-//  int w_factor, h_factor;
     byte *rowbuf;
-
-    extern void I_RenderReadPixels(byte **data, int *w, int *h, int *p);
-
-/*
-    if (aspect_ratio_correct == 1)
-    {
-        // scale up to accommodate aspect ratio correction
-        w_factor = 5;
-        h_factor = 6;
-
-        width *= w_factor;
-        height *= h_factor;
-    }
-    else
-    {
-        w_factor = 1;
-        h_factor = 1;
-    }
-*/
-
-    handle = M_fopen(filename, "wb");
-    if (!handle)
-    {
-        return;
-    }
+    int i;
 
     ppng = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,
                                    error_fn, warning_fn);
     if (!ppng)
     {
-        fclose(handle);
         return;
     }
 
     pinfo = png_create_info_struct(ppng);
     if (!pinfo)
     {
-        fclose(handle);
         png_destroy_write_struct(&ppng, NULL);
         return;
     }
 
-    png_init_io(ppng, handle);
-
-    I_RenderReadPixels(&palette, &width, &height, &j);
-    rowbuf = palette; // [crispy] pointer abuse!
+    png_init_io(ppng, job->handle);
+    png_set_compression_level(ppng, job->level);
 
-    png_set_IHDR(ppng, pinfo, width, height,
+    png_set_IHDR(ppng, pinfo, job->width, job->height,
 #if SDL_VERSION_ATLEAST(2, 0, 5)
                  8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
 #else
                  8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
 #endif
                  PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-/*
-    png_set_IHDR(ppng, pinfo, width, height,
-                 8, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
-                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
-    pcolor = malloc(sizeof(*pcolor) * 256);
-    if (!pcolor)
-    {
-        fclose(handle);
-        png_destroy_write_struct(&ppng, &pinfo);
-        return;
-    }
+    png_write_info(ppng, pinfo);
+
+    rowbuf = job->pixels;
 
-    for (i = 0; i < 256; i++)
+    for (i = 0; i < job->height; i++)
     {
-        pcolor[i].red   = *(palette + 3 * i);
-        pcolor[i].green = *(palette + 3 * i + 1);
-        pcolor[i].blue  = *(palette + 3 * i + 2);
+        png_write_row(ppng, rowbuf);
+        rowbuf += job->pitch;
     }
 
-    png_set_PLTE(ppng, pinfo, pcolor, 256);
-    free(pcolor);
-*/
+    png_write_end(ppng, pinfo);
+    png_destroy_write_struct(&ppng, &pinfo);
+}
 
-    png_write_info(ppng, pinfo);
+static void FinishPNGJob(pngjob_t *job)
+{
+    EncodePNG(job);
+    fclose(job->handle);
+    free(job->pixels);
+    free(job);
+}
 
-/*
-    rowbuf = malloc(width);
+static int PNGThread(void *unused)
+{
+    pngjob_t *job;
 
-    if (rowbuf)
+    SDL_LockMutex(pnglock);
+
+    while (true)
     {
-        for (i = 0; i < SCREENHEIGHT; i++)
+        while (pngqueue == NULL && !pngquit)
         {
-            // expand the row 5x
-            for (j = 0; j < SCREENWIDTH; j++)
-            {
-                memset(rowbuf + j * w_factor, *(data + i*SCREENWIDTH + j), w_factor);
-            }
+            SDL_CondWait(pngcond, pnglock);
+        }
 
-            // write the row 6 times
-            for (j = 0; j < h_factor; j++)
-            {
-                png_write_row(ppng, rowbuf);
-            }
+        // Screenshots still queued are written before quitting
+        if (pngqueue == NULL)
+        {
+            break;
+        }
+
+        job = pngqueue;
+        pngqueue = job->next;
+
+        if (pngqueue == NULL)
+        {
+            pngqueuetail = NULL;
         }
 
-        free(rowbuf);
+        SDL_UnlockMutex(pnglock);
+        FinishPNGJob(job);
+        SDL_LockMutex(pnglock);
     }
-*/
 
-    for (i = 0; i < height; i++)
+    SDL_UnlockMutex(pnglock);
+
+    return 0;
+}
+
+static void ShutdownPNGThread(void)
+{
+    SDL_LockMutex(pnglock);
+    pngquit = true;
+    SDL_CondBroadcast(pngcond);
+    SDL_UnlockMutex(pnglock);
+
+    SDL_WaitThread(pngthread, NULL);
+    pngthread = NULL;
+}
+
+static boolean InitPNGThread(void)
+{
+    if (pnginit)
+    {
+        return pngthread != NULL;
+    }
+
+    pnginit = true;
+
+    pnglock = SDL_CreateMutex();
+    pngcond = SDL_CreateCond();
+    pngthread = SDL_CreateThread(PNGThread, "V_PNGThread", NULL);
+
+    if (pngthread == NULL)
     {
-        png_write_row(ppng, rowbuf);
-        rowbuf += j;
+        fprintf(stderr, "InitPNGThread: %s\n", SDL_GetError());
+        return false;
     }
-    free(palette);
 
-    png_write_end(ppng, pinfo);
-    png_destroy_write_struct(&ppng, &pinfo);
-    fclose(handle);
+    I_AtExit(ShutdownPNGThread, true);
+
+    return true;
+}
+
+void WritePNGfile(char *filename, pixel_t *data,
+                  int width, int height,
+                  byte *palette)
+{
+    extern void I_RenderReadPixels(byte **data, int *w, int *h, int *p);
+    pngjob_t *job;
+    FILE *handle;
+
+    handle = M_fopen(filename, "wb");
+    if (!handle)
+    {
+        return;
+    }
+
+    job = malloc(sizeof(*job));
+    job->handle = handle;
+    job->level = BETWEEN(1, 9, png_compression);
+    job->next = NULL;
+
+    I_RenderReadPixels(&job->pixels, &job->width, &job->height, &job->pitch);
+
+    if (!InitPNGThread())
+    {
+        FinishPNGJob(job);
+        return;
+    }
+
+    SDL_LockMutex(pnglock);
+
+    if (pngqueuetail != NULL)
+    {
+        pngqueuetail->next = job;
+    }
+    else
+    {
+        pngqueue = job;
+    }
+
+    pngqueuetail = job;
+
+    SDL_CondBroadcast(pngcond);
+    SDL_UnlockMutex(pnglock);
 }
 #endif
 
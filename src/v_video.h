@@ -94,6 +94,16 @@ void V_UseBuffer(pixel_t *buffer);
 
 void V_RestoreBuffer(void);
 
+// [AP] Draws with draw(data), through a cache of already rendered
+// layers. key must hold everything the drawing depends on.
+
+void V_DrawLayer(const void *key, size_t keylen,
+                 void (*draw)(void *data), void *data);
+
+// [AP] Drops every cached layer.
+
+void V_FlushLayers(void);
+
 // Save a screenshot of the current screen to a file, named in the 
 // format described in the string passed to the function, eg.
 // "DOOM%02i.pcx"
@@ -37,11 +37,30 @@ static wad_file_class_t *wad_file_classes[] =
     &stdc_wad_file,
 };
 
-wad_file_t *W_OpenFile(const char *path)
+static wad_file_t *W_OpenMappedFile(const char *path)
 {
     wad_file_t *result;
     int i;
 
+    // Try all classes in order until we find one that works
+
+    result = NULL;
+
+    for (i=0; i<arrlen(wad_file_classes); ++i)
+    {
+        result = wad_file_classes[i]->OpenFile(path);
+
+        if (result != NULL)
+        {
+            break;
+        }
+    }
+
+    return result;
+}
+
+wad_file_t *W_OpenFile(const char *path)
+{
     //!
     // @category obscure
     //
@@ -54,20 +73,43 @@ wad_file_t *W_OpenFile(const char *path)
         return stdc_wad_file.OpenFile(path);
     }
 
-    // Try all classes in order until we find one that works
+    return W_OpenMappedFile(path);
+}
 
-    result = NULL;
+// [AP] IWADs are mapped unless told otherwise. The PWAD problems that
+// got mapping turned off by default don't apply to stock IWAD data, and
+// their patches, flats and sounds then never get copied into the zone.
 
-    for (i=0; i<arrlen(wad_file_classes); ++i)
+wad_file_t *W_MapFile(wad_file_t *wad)
+{
+    wad_file_t *result;
+
+    //!
+    // @category obscure
+    //
+    // Don't map IWADs and PK3s into memory; read their lumps into the
+    // zone like any other WAD.
+    //
+
+    if (wad->mapped != NULL || M_CheckParm("-nommap"))
     {
-        result = wad_file_classes[i]->OpenFile(path);
+        return wad;
+    }
+
+    result = W_OpenMappedFile(wad->path);
 
+    if (result == NULL || result->mapped == NULL)
+    {
         if (result != NULL)
         {
-            break;
+            W_CloseFile(result);
         }
+
+        return wad;
     }
 
+    W_CloseFile(wad);
+
     return result;
 }
 
@@ -37,10 +37,16 @@ typedef struct
     // provided buffer.  Returns the number of bytes read.
     size_t (*Read)(wad_file_t *file, unsigned int offset,
                    void *buffer, size_t buffer_len);
+
+    // [AP] Optional, for files only some of whose lumps can be used in
+    // place: returns a pointer to the lump at offset, or NULL if it has
+    // to be read. Not used when the whole file is mapped.
+    byte *(*MapLump)(wad_file_t *file, unsigned int offset);
 } wad_file_class_t;
 
 
 extern wad_file_class_t stdc_wad_file;
+extern wad_file_class_t zip_wad_file;
 
 #ifdef _WIN32
 extern wad_file_class_t win32_wad_file;
@@ -72,6 +78,18 @@ struct _wad_file_s
 
 wad_file_t *W_OpenFile(const char *path);
 
+// [AP] Reopen an already opened file mapped into memory, if that's
+// possible and allowed. Returns the handle to use from now on; wad is
+// closed if it was replaced.
+
+wad_file_t *W_MapFile(wad_file_t *wad);
+
+// [AP] Directory of a file opened with zip_wad_file, in the order the
+// lumps should be added. position is what to pass to W_Read.
+
+int W_ZipNumLumps(wad_file_t *wad);
+void W_ZipLump(wad_file_t *wad, int i, char *name, int *position, int *size);
+
 // Close the specified WAD file.
 
 void W_CloseFile(wad_file_t *wad);
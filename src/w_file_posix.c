@@ -134,6 +134,25 @@ size_t W_POSIX_Read(wad_file_t *wad, unsigned int offset,
 
     posix_wad = (posix_wad_file_t *) wad;
 
+    // [AP] Already in memory, so skip the seek and the read calls
+
+    if (posix_wad->wad.mapped != NULL)
+    {
+        if (offset >= posix_wad->wad.length)
+        {
+            return 0;
+        }
+
+        if (buffer_len > posix_wad->wad.length - offset)
+        {
+            buffer_len = posix_wad->wad.length - offset;
+        }
+
+        memcpy(buffer, posix_wad->wad.mapped + offset, buffer_len);
+
+        return buffer_len;
+    }
+
     // Jump to the specified position in the file.
 
     lseek(posix_wad->handle, offset, SEEK_SET);
@@ -21,6 +21,7 @@
 #ifdef _WIN32
 
 #include <stdio.h>
+#include <string.h>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -121,7 +122,9 @@ static wad_file_t *W_Win32_OpenFile(const char *path)
     result->wad.file_class = &win32_wad_file;
     result->wad.length = GetFileLength(handle);
     result->wad.path = M_StringDuplicate(path);
+    result->wad.mapped = NULL;
     result->handle = handle;
+    result->handle_map = NULL;
 
     // Try to map the file into memory with mmap:
 
@@ -170,6 +173,25 @@ size_t W_Win32_Read(wad_file_t *wad, unsigned int offset,
 
     win32_wad = (win32_wad_file_t *) wad;
 
+    // [AP] Already in memory, so skip the seek and the read call
+
+    if (win32_wad->wad.mapped != NULL)
+    {
+        if (offset >= win32_wad->wad.length)
+        {
+            return 0;
+        }
+
+        if (buffer_len > win32_wad->wad.length - offset)
+        {
+            buffer_len = win32_wad->wad.length - offset;
+        }
+
+        memcpy(buffer, win32_wad->wad.mapped + offset, buffer_len);
+
+        return buffer_len;
+    }
+
     // Jump to the specified position in the file.
 
     result = SetFilePointer(win32_wad->handle, offset, NULL, FILE_BEGIN);
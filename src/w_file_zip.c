@@ -0,0 +1,508 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	PK3/ZIP containers.
+//
+//	Entries become lumps in central directory order, named after their
+//	base file name, so a ZIP built from a WAD's lumps (markers
+//	included) loads the same as the WAD. Directories only group files.
+//
+//	A lump's position is the offset of its entry's local header. Stored
+//	entries are read, or returned from the mapping, as is; deflated ones
+//	are inflated the first time W_CacheLumpNum asks for them.
+//
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include "i_swap.h"
+#include "i_system.h"
+#include "m_misc.h"
+#include "w_file.h"
+#include "z_zone.h"
+
+#define ZIP_EOCD_SIG    0x06054b50
+#define ZIP_CDIR_SIG    0x02014b50
+#define ZIP_LOCAL_SIG   0x04034b50
+
+#define ZIP_EOCD_SIZE   22
+#define ZIP_CDIR_SIZE   46
+#define ZIP_LOCAL_SIZE  30
+#define ZIP_MAX_COMMENT 0xffff
+
+#define ZIP_STORED      0
+#define ZIP_DEFLATED    8
+
+#define ZIP_STREAMCHUNK 16384 // Compressed bytes read at a time, unmapped
+
+typedef struct
+{
+    char name[8];
+    unsigned int offset; // Local header
+    unsigned int dataoffset; // Resolved on first read, 0 until then
+    unsigned int compsize;
+    unsigned int size;
+    int method;
+} zip_entry_t;
+
+typedef struct
+{
+    wad_file_t wad;
+    wad_file_t *file; // The ZIP itself, mapped if possible
+    zip_entry_t *entries; // Central directory order
+    zip_entry_t **sorted; // By offset, for Read
+    int numentries;
+} zip_wad_file_t;
+
+static unsigned int ReadU16(const byte *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int ReadU32(const byte *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+// Lump name for an entry: the base name up to the first dot, at most
+// eight characters. '^' stands in for '\', which ZIP paths can't hold.
+
+static void EntryLumpName(const char *path, int len, char *dest)
+{
+    int start, i, n;
+
+    for (start = len; start > 0 && path[start - 1] != '/'; --start);
+
+    memset(dest, 0, 8);
+
+    for (i = start, n = 0; i < len && path[i] != '.' && n < 8; ++i, ++n)
+    {
+        dest[n] = path[i] == '^' ? '\\' : path[i];
+    }
+}
+
+static int CompareEntryOffsets(const void *a, const void *b)
+{
+    const zip_entry_t *ea = *(const zip_entry_t **) a;
+    const zip_entry_t *eb = *(const zip_entry_t **) b;
+
+    return ea->offset < eb->offset ? -1 : ea->offset > eb->offset;
+}
+
+static byte *ReadBlock(wad_file_t *file, unsigned int offset, size_t len)
+{
+    byte *result;
+
+    result = Z_Malloc(len, PU_STATIC, NULL);
+
+    if (W_Read(file, offset, result, len) != len)
+    {
+        Z_Free(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+static boolean ReadDirectory(zip_wad_file_t *zip)
+{
+    wad_file_t *file = zip->file;
+    unsigned int taillen, tailofs, cdirofs, cdirlen;
+    byte *tail, *cdir, *p;
+    int i, n, count;
+
+    if (file->length < ZIP_EOCD_SIZE)
+    {
+        return false;
+    }
+
+    // The end of central directory record is followed by a comment of
+    // up to 64k, so look for its signature from the end backwards.
+
+    taillen = file->length;
+
+    if (taillen > ZIP_EOCD_SIZE + ZIP_MAX_COMMENT)
+    {
+        taillen = ZIP_EOCD_SIZE + ZIP_MAX_COMMENT;
+    }
+
+    tailofs = file->length - taillen;
+    tail = ReadBlock(file, tailofs, taillen);
+
+    if (tail == NULL)
+    {
+        return false;
+    }
+
+    for (p = tail + taillen - ZIP_EOCD_SIZE; p >= tail; --p)
+    {
+        if (ReadU32(p) == ZIP_EOCD_SIG)
+        {
+            break;
+        }
+    }
+
+    if (p < tail)
+    {
+        Z_Free(tail);
+        return false;
+    }
+
+    count = ReadU16(p + 10);
+    cdirlen = ReadU32(p + 12);
+    cdirofs = ReadU32(p + 16);
+    Z_Free(tail);
+
+    if (cdirofs > file->length || cdirlen > file->length - cdirofs)
+    {
+        return false;
+    }
+
+    cdir = ReadBlock(file, cdirofs, cdirlen);
+
+    if (cdir == NULL)
+    {
+        return false;
+    }
+
+    zip->entries = Z_Malloc(sizeof(*zip->entries) * (count + 1),
+                            PU_STATIC, NULL);
+    n = 0;
+
+    for (i = 0, p = cdir; i < count; ++i)
+    {
+        unsigned int namelen, extralen, commentlen;
+        zip_entry_t *entry;
+
+        if (p + ZIP_CDIR_SIZE > cdir + cdirlen || ReadU32(p) != ZIP_CDIR_SIG)
+        {
+            break;
+        }
+
+        namelen = ReadU16(p + 28);
+        extralen = ReadU16(p + 30);
+        commentlen = ReadU16(p + 32);
+
+        if (p + ZIP_CDIR_SIZE + namelen > cdir + cdirlen)
+        {
+            break;
+        }
+
+        // Directories
+        if (namelen > 0 && p[ZIP_CDIR_SIZE + namelen - 1] == '/')
+        {
+            p += ZIP_CDIR_SIZE + namelen + extralen + commentlen;
+            continue;
+        }
+
+        entry = &zip->entries[n++];
+        EntryLumpName((const char *) p + ZIP_CDIR_SIZE, namelen, entry->name);
+        entry->method = ReadU16(p + 10);
+        entry->compsize = ReadU32(p + 20);
+        entry->size = ReadU32(p + 24);
+        entry->offset = ReadU32(p + 42);
+        entry->dataoffset = 0;
+
+        p += ZIP_CDIR_SIZE + namelen + extralen + commentlen;
+    }
+
+    Z_Free(cdir);
+
+    if (i < count)
+    {
+        Z_Free(zip->entries);
+        return false;
+    }
+
+    zip->numentries = n;
+    zip->sorted = Z_Malloc(sizeof(*zip->sorted) * (n + 1), PU_STATIC, NULL);
+
+    for (i = 0; i < n; ++i)
+    {
+        zip->sorted[i] = &zip->entries[i];
+    }
+
+    qsort(zip->sorted, n, sizeof(*zip->sorted), CompareEntryOffsets);
+
+    return true;
+}
+
+static wad_file_t *W_Zip_OpenFile(const char *path)
+{
+    zip_wad_file_t *result;
+    wad_file_t *file;
+
+    file = stdc_wad_file.OpenFile(path);
+
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    // Stored entries can then be handed out straight from the mapping
+    file = W_MapFile(file);
+
+    result = Z_Malloc(sizeof(zip_wad_file_t), PU_STATIC, 0);
+    result->wad.file_class = &zip_wad_file;
+    result->wad.mapped = NULL; // Not all lumps can be; see W_Zip_MapLump
+    result->wad.length = file->length;
+    result->wad.path = M_StringDuplicate(path);
+    result->file = file;
+    result->entries = NULL;
+    result->sorted = NULL;
+    result->numentries = 0;
+
+    if (!ReadDirectory(result))
+    {
+        fprintf(stderr, "W_Zip_OpenFile: %s is not a valid ZIP file\n", path);
+        W_CloseFile(file);
+        Z_Free(result);
+        return NULL;
+    }
+
+    return &result->wad;
+}
+
+static void W_Zip_CloseFile(wad_file_t *wad)
+{
+    zip_wad_file_t *zip;
+
+    zip = (zip_wad_file_t *) wad;
+
+    W_CloseFile(zip->file);
+    Z_Free(zip->entries);
+    Z_Free(zip->sorted);
+    Z_Free(zip);
+}
+
+// Finds the entry whose local header is at offset, and works out where
+// its data starts.
+
+static zip_entry_t *FindEntry(zip_wad_file_t *zip, unsigned int offset)
+{
+    zip_entry_t *entry;
+    byte header[ZIP_LOCAL_SIZE];
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = zip->numentries - 1;
+    entry = NULL;
+
+    while (lo <= hi)
+    {
+        mid = (lo + hi) / 2;
+
+        if (zip->sorted[mid]->offset < offset)
+        {
+            lo = mid + 1;
+        }
+        else if (zip->sorted[mid]->offset > offset)
+        {
+            hi = mid - 1;
+        }
+        else
+        {
+            entry = zip->sorted[mid];
+            break;
+        }
+    }
+
+    if (entry == NULL || entry->dataoffset != 0)
+    {
+        return entry;
+    }
+
+    if (W_Read(zip->file, entry->offset, header, sizeof(header)) != sizeof(header)
+     || ReadU32(header) != ZIP_LOCAL_SIG)
+    {
+        I_Error("W_Zip_Read: Bad local header for %.8s in %s",
+                entry->name, zip->wad.path);
+    }
+
+    // The local header has its own copy of the name and extra fields,
+    // which don't have to match the central directory's
+    entry->dataoffset = entry->offset + ZIP_LOCAL_SIZE
+                      + ReadU16(header + 26) + ReadU16(header + 28);
+
+    if (entry->dataoffset > zip->file->length
+     || entry->compsize > zip->file->length - entry->dataoffset)
+    {
+        I_Error("W_Zip_Read: %.8s runs past the end of %s",
+                entry->name, zip->wad.path);
+    }
+
+    return entry;
+}
+
+#ifdef HAVE_LIBZ
+static size_t InflateEntry(zip_wad_file_t *zip, zip_entry_t *entry,
+                           byte *buffer, size_t buffer_len)
+{
+    z_stream zstream;
+    byte *chunk = NULL;
+    unsigned int left;
+    int err;
+
+    memset(&zstream, 0, sizeof(zstream));
+
+    // Raw deflate, no zlib header
+    if (inflateInit2(&zstream, -MAX_WBITS) != Z_OK)
+    {
+        I_Error("W_Zip_Read: Error during decompression initialization!");
+    }
+
+    zstream.next_out = buffer;
+    zstream.avail_out = buffer_len;
+
+    if (zip->file->mapped != NULL)
+    {
+        zstream.next_in = zip->file->mapped + entry->dataoffset;
+        zstream.avail_in = entry->compsize;
+        left = 0;
+    }
+    else
+    {
+        chunk = Z_Malloc(ZIP_STREAMCHUNK, PU_STATIC, NULL);
+        left = entry->compsize;
+    }
+
+    do
+    {
+        if (zstream.avail_in == 0 && left > 0)
+        {
+            unsigned int len = left < ZIP_STREAMCHUNK ? left : ZIP_STREAMCHUNK;
+
+            if (W_Read(zip->file, entry->dataoffset + entry->compsize - left,
+                       chunk, len) != len)
+            {
+                break;
+            }
+
+            zstream.next_in = chunk;
+            zstream.avail_in = len;
+            left -= len;
+        }
+
+        err = inflate(&zstream, Z_SYNC_FLUSH);
+    } while (err == Z_OK && zstream.avail_out > 0
+          && (zstream.avail_in > 0 || left > 0));
+
+    if (err != Z_OK && err != Z_STREAM_END)
+    {
+        I_Error("W_Zip_Read: Error inflating %.8s in %s: %s",
+                entry->name, zip->wad.path,
+                zstream.msg ? zstream.msg : "unknown error");
+    }
+
+    if (chunk != NULL)
+    {
+        Z_Free(chunk);
+    }
+
+    inflateEnd(&zstream);
+
+    return buffer_len - zstream.avail_out;
+}
+#endif
+
+// Only whole lumps can be read: offset must be the position W_AddFile
+// got from W_ZipLump.
+
+static size_t W_Zip_Read(wad_file_t *wad, unsigned int offset,
+                         void *buffer, size_t buffer_len)
+{
+    zip_wad_file_t *zip;
+    zip_entry_t *entry;
+
+    zip = (zip_wad_file_t *) wad;
+    entry = FindEntry(zip, offset);
+
+    if (entry == NULL)
+    {
+        return 0;
+    }
+
+    if (buffer_len > entry->size)
+    {
+        buffer_len = entry->size;
+    }
+
+    switch (entry->method)
+    {
+        case ZIP_STORED:
+            return W_Read(zip->file, entry->dataoffset, buffer, buffer_len);
+
+#ifdef HAVE_LIBZ
+        case ZIP_DEFLATED:
+            return InflateEntry(zip, entry, buffer, buffer_len);
+#endif
+
+        default:
+            I_Error("W_Zip_Read: %.8s in %s uses unsupported "
+                    "compression method %i",
+                    entry->name, zip->wad.path, entry->method);
+    }
+
+    return 0;
+}
+
+static byte *W_Zip_MapLump(wad_file_t *wad, unsigned int offset)
+{
+    zip_wad_file_t *zip;
+    zip_entry_t *entry;
+
+    zip = (zip_wad_file_t *) wad;
+
+    if (zip->file->mapped == NULL)
+    {
+        return NULL;
+    }
+
+    entry = FindEntry(zip, offset);
+
+    if (entry == NULL || entry->method != ZIP_STORED)
+    {
+        return NULL;
+    }
+
+    return zip->file->mapped + entry->dataoffset;
+}
+
+int W_ZipNumLumps(wad_file_t *wad)
+{
+    return ((zip_wad_file_t *) wad)->numentries;
+}
+
+void W_ZipLump(wad_file_t *wad, int i, char *name, int *position, int *size)
+{
+    zip_entry_t *entry = &((zip_wad_file_t *) wad)->entries[i];
+
+    memcpy(name, entry->name, 8);
+    *position = entry->offset;
+    *size = entry->size;
+}
+
+wad_file_class_t zip_wad_file =
+{
+    W_Zip_OpenFile,
+    W_Zip_CloseFile,
+    W_Zip_Read,
+    W_Zip_MapLump,
+};
@@ -210,7 +210,7 @@ void W_AutoLoadWADs(const char *path)
     const char *filename;
 
     glob = I_StartMultiGlob(path, GLOB_FLAG_NOCASE|GLOB_FLAG_SORTED,
-                            "*.wad", "*.lmp", NULL);
+                            "*.wad", "*.lmp", "*.pk3", NULL); // [AP] pk3
     for (;;)
     {
         filename = I_NextGlob(glob);
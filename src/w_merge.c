@@ -42,6 +42,12 @@ typedef struct
 {
     lumpinfo_t **lumps;
     int numlumps;
+
+    // [AP] Name index, built on the first FindInList. Chains go in list
+    // order, so the first match is the one the linear search found.
+    int *hash_first;
+    int *hash_next;
+    int hash_size;
 } searchlist_t;
 
 typedef struct
@@ -49,6 +55,7 @@ typedef struct
     char sprname[4];
     char frame;
     lumpinfo_t *angle_lumps[8];
+    int hash_next; // [AP] in sprite_frames_hash
 } sprite_frame_t;
 
 static searchlist_t iwad;
@@ -64,8 +71,47 @@ static sprite_frame_t *sprite_frames;
 static int num_sprite_frames;
 static int sprite_frames_alloced;
 
+// [AP] sprite_frames by name and frame, sprite_frames_alloced * 2 buckets
+static int *sprite_frames_hash;
+
+// [AP] Points the list at some lumps, dropping the index of the old ones
+
+static void SetListLumps(searchlist_t *list, lumpinfo_t **lumps, int numlumps)
+{
+    free(list->hash_first);
+    free(list->hash_next);
+    list->hash_first = NULL;
+    list->hash_next = NULL;
+    list->hash_size = 0;
+
+    list->lumps = lumps;
+    list->numlumps = numlumps;
+}
+
+static void BuildListIndex(searchlist_t *list)
+{
+    int i;
+
+    list->hash_size = 64;
+    while (list->hash_size < list->numlumps)
+        list->hash_size <<= 1;
+
+    list->hash_first = malloc(list->hash_size * sizeof(*list->hash_first));
+    list->hash_next = malloc((list->numlumps + 1) * sizeof(*list->hash_next));
+    memset(list->hash_first, -1, list->hash_size * sizeof(*list->hash_first));
+
+    for (i = list->numlumps - 1; i >= 0; --i)
+    {
+        unsigned int bucket = W_LumpNameHash(list->lumps[i]->name)
+                            & (list->hash_size - 1);
+
+        list->hash_next[i] = list->hash_first[bucket];
+        list->hash_first[bucket] = i;
+    }
+}
+
 // Search in a list to find a lump with a particular name
-// Linear search (slow!)
+// [AP] Hashed, the first lump with the name in list order
 //
 // Returns -1 if not found
 
@@ -73,7 +119,11 @@ static int FindInList(searchlist_t *list, const char *name)
 {
     int i;
 
-    for (i=0; i<list->numlumps; ++i)
+    if (list->hash_first == NULL)
+        BuildListIndex(list);
+
+    for (i = list->hash_first[W_LumpNameHash(name) & (list->hash_size - 1)];
+         i >= 0; i = list->hash_next[i])
     {
         if (!strncasecmp(list->lumps[i]->name, name, 8))
             return i;
@@ -88,7 +138,7 @@ static boolean SetupList(searchlist_t *list, searchlist_t *src_list,
 {
     int startlump, endlump;
 
-    list->numlumps = 0;
+    SetListLumps(list, NULL, 0);
     startlump = FindInList(src_list, startname);
 
     if (startname2 != NULL && startlump < 0)
@@ -107,8 +157,8 @@ static boolean SetupList(searchlist_t *list, searchlist_t *src_list,
 
         if (endlump > startlump)
         {
-            list->lumps = src_list->lumps + startlump + 1;
-            list->numlumps = endlump - startlump - 1;
+            SetListLumps(list, src_list->lumps + startlump + 1,
+                         endlump - startlump - 1);
             return true;
         }
     }
@@ -148,9 +198,31 @@ static void InitSpriteList(void)
         sprite_frames_alloced = 128;
         sprite_frames = Z_Malloc(sizeof(*sprite_frames) * sprite_frames_alloced,
                                  PU_STATIC, NULL);
+        sprite_frames_hash = I_Realloc(NULL, sprite_frames_alloced * 2
+                                           * sizeof(*sprite_frames_hash));
     }
 
     num_sprite_frames = 0;
+    memset(sprite_frames_hash, -1,
+           sprite_frames_alloced * 2 * sizeof(*sprite_frames_hash));
+}
+
+// [AP] Bucket of a sprite frame, from the 4 letter sprite name case
+// insensitively (as it's compared) and the frame letter as is
+
+static int SpriteFrameBucket(const char *name, int frame)
+{
+    unsigned int key = 0;
+    int i;
+
+    for (i = 0; i < 4; ++i)
+    {
+        key = (key << 8) | (unsigned char) toupper(name[i]);
+    }
+
+    key = (key ^ (unsigned char) frame) * 2654435761u;
+
+    return (key >> 8) & (sprite_frames_alloced * 2 - 1);
 }
 
 static boolean ValidSpriteLumpName(char *name)
@@ -183,11 +255,14 @@ static boolean ValidSpriteLumpName(char *name)
 static sprite_frame_t *FindSpriteFrame(char *name, int frame)
 {
     sprite_frame_t *result;
+    int bucket;
     int i;
 
     // Search the list and try to find the frame
 
-    for (i=0; i<num_sprite_frames; ++i)
+    bucket = SpriteFrameBucket(name, frame);
+
+    for (i = sprite_frames_hash[bucket]; i >= 0; i = sprite_frames[i].hash_next)
     {
         sprite_frame_t *cur = &sprite_frames[i];
 
@@ -212,6 +287,24 @@ static sprite_frame_t *FindSpriteFrame(char *name, int frame)
         Z_Free(sprite_frames);
         sprite_frames_alloced *= 2;
         sprite_frames = newframes;
+
+        // [AP] Twice the buckets, rehash everything
+        sprite_frames_hash = I_Realloc(sprite_frames_hash,
+                                       sprite_frames_alloced * 2
+                                       * sizeof(*sprite_frames_hash));
+        memset(sprite_frames_hash, -1,
+               sprite_frames_alloced * 2 * sizeof(*sprite_frames_hash));
+
+        for (i = num_sprite_frames - 1; i >= 0; --i)
+        {
+            int b = SpriteFrameBucket(sprite_frames[i].sprname,
+                                      sprite_frames[i].frame);
+
+            sprite_frames[i].hash_next = sprite_frames_hash[b];
+            sprite_frames_hash[b] = i;
+        }
+
+        bucket = SpriteFrameBucket(name, frame);
     }
 
     // Add to end of list
@@ -223,6 +316,9 @@ static sprite_frame_t *FindSpriteFrame(char *name, int frame)
     for (i=0; i<8; ++i)
         result->angle_lumps[i] = NULL;
 
+    result->hash_next = sprite_frames_hash[bucket];
+    sprite_frames_hash[bucket] = num_sprite_frames;
+
     ++num_sprite_frames;
 
     return result;
@@ -581,11 +677,8 @@ void W_MergeFile(const char *filename)
 
     // IWAD is at the start, PWAD was appended to the end
 
-    iwad.lumps = lumpinfo;
-    iwad.numlumps = old_numlumps;
-
-    pwad.lumps = lumpinfo + old_numlumps;
-    pwad.numlumps = numlumps - old_numlumps;
+    SetListLumps(&iwad, lumpinfo, old_numlumps);
+    SetListLumps(&pwad, lumpinfo + old_numlumps, numlumps - old_numlumps);
     
     // Setup sprite/flat lists
 
@@ -638,11 +731,8 @@ void W_NWTMergeFile(const char *filename, int flags)
 
     // IWAD is at the start, PWAD was appended to the end
 
-    iwad.lumps = lumpinfo;
-    iwad.numlumps = old_numlumps;
-
-    pwad.lumps = lumpinfo + old_numlumps;
-    pwad.numlumps = numlumps - old_numlumps;
+    SetListLumps(&iwad, lumpinfo, old_numlumps);
+    SetListLumps(&pwad, lumpinfo + old_numlumps, numlumps - old_numlumps);
 
     // Setup sprite/flat lists
 
@@ -690,11 +780,8 @@ void W_NWTDashMerge(const char *filename)
 
     // IWAD is at the start, PWAD was appended to the end
 
-    iwad.lumps = lumpinfo;
-    iwad.numlumps = old_numlumps;
-
-    pwad.lumps = lumpinfo + old_numlumps;
-    pwad.numlumps = numlumps - old_numlumps;
+    SetListLumps(&iwad, lumpinfo, old_numlumps);
+    SetListLumps(&pwad, lumpinfo + old_numlumps, numlumps - old_numlumps);
 
     // Setup sprite/flat lists
 
@@ -0,0 +1,368 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Background lump reads.
+//
+//	The zone and the wad_file_t readers belong to the game thread, so
+//	the I/O thread opens its own handle on each WAD and reads into
+//	malloc'd buffers. W_CacheLumpNum still does the Z_Malloc, then
+//	takes the buffer instead of reading. All shared state is behind
+//	one lock.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "w_file.h"
+#include "w_prefetch.h"
+#include "w_wad.h"
+
+#define MAXPREFETCH 4096 // Queued lumps; more are dropped
+#define MAXPREFETCHBYTES (32 << 20) // Read but not taken yet
+#define MAXPREFETCHFILES 16
+#define PREFETCHPAGE 4096
+
+enum
+{
+    PREFETCH_NONE,
+    PREFETCH_QUEUED,
+    PREFETCH_READING,
+    PREFETCH_DONE
+};
+
+typedef struct
+{
+    wad_file_t *wad;
+    FILE *fstream;
+} prefetchfile_t;
+
+static boolean prefetchinit;
+static SDL_Thread *prefetchthread;
+static SDL_mutex *prefetchlock;
+static SDL_cond *prefetchcond;
+static boolean prefetchquit;
+static boolean prefetchreading;
+
+static lumpindex_t prefetchqueue[MAXPREFETCH];
+static int prefetchhead, prefetchtail;
+
+// Indexed by lump
+static byte *prefetchstate;
+static byte **prefetchdata;
+static unsigned int numprefetch;
+static size_t prefetchbytes;
+
+// Only touched by the I/O thread, or with it idle
+static prefetchfile_t prefetchfiles[MAXPREFETCHFILES];
+static int numprefetchfiles;
+
+static FILE *PrefetchFile(wad_file_t *wad)
+{
+    int i;
+
+    for (i = 0; i < numprefetchfiles; ++i)
+    {
+        if (prefetchfiles[i].wad == wad)
+        {
+            return prefetchfiles[i].fstream;
+        }
+    }
+
+    if (numprefetchfiles == MAXPREFETCHFILES)
+    {
+        return NULL;
+    }
+
+    prefetchfiles[i].wad = wad;
+    prefetchfiles[i].fstream = M_fopen(wad->path, "rb");
+    numprefetchfiles++;
+
+    return prefetchfiles[i].fstream;
+}
+
+static byte *PrefetchRead(wad_file_t *wad, int position, int size)
+{
+    byte *result;
+    FILE *fstream;
+
+    if (wad->mapped != NULL)
+    {
+        // Just fault the pages in, volatile so the reads stay
+        const volatile byte *mapped = wad->mapped + position;
+        int i;
+
+        for (i = 0; i < size; i += PREFETCHPAGE)
+        {
+            (void) mapped[i];
+        }
+
+        return NULL;
+    }
+
+    fstream = PrefetchFile(wad);
+
+    if (fstream == NULL || size <= 0)
+    {
+        return NULL;
+    }
+
+    result = malloc(size);
+
+    if (result != NULL
+     && (fseek(fstream, position, SEEK_SET) != 0
+      || fread(result, 1, size, fstream) != (size_t) size))
+    {
+        free(result);
+        result = NULL;
+    }
+
+    return result;
+}
+
+static int PrefetchThread(void *unused)
+{
+    SDL_LockMutex(prefetchlock);
+
+    while (true)
+    {
+        lumpindex_t lump;
+        wad_file_t *wad;
+        int position, size;
+        byte *data;
+
+        while (prefetchhead == prefetchtail && !prefetchquit)
+        {
+            SDL_CondWait(prefetchcond, prefetchlock);
+        }
+
+        if (prefetchquit)
+        {
+            break;
+        }
+
+        lump = prefetchqueue[prefetchhead];
+        prefetchhead = (prefetchhead + 1) % MAXPREFETCH;
+
+        if (prefetchstate[lump] != PREFETCH_QUEUED)
+        {
+            continue;
+        }
+
+        wad = lumpinfo[lump]->wad_file;
+        position = lumpinfo[lump]->position;
+        size = lumpinfo[lump]->size;
+
+        if (wad->mapped == NULL && prefetchbytes + size > MAXPREFETCHBYTES)
+        {
+            prefetchstate[lump] = PREFETCH_NONE;
+            continue;
+        }
+
+        prefetchstate[lump] = PREFETCH_READING;
+        prefetchreading = true;
+        SDL_UnlockMutex(prefetchlock);
+
+        data = PrefetchRead(wad, position, size);
+
+        SDL_LockMutex(prefetchlock);
+        prefetchreading = false;
+
+        if (prefetchstate[lump] != PREFETCH_READING)
+        {
+            // Cancelled meanwhile
+            free(data);
+        }
+        else if (data != NULL)
+        {
+            prefetchdata[lump] = data;
+            prefetchbytes += size;
+            prefetchstate[lump] = PREFETCH_DONE;
+        }
+        else
+        {
+            // Paged in, or failed; either way W_CacheLumpNum does the rest
+            prefetchstate[lump] = wad->mapped ? PREFETCH_DONE : PREFETCH_NONE;
+        }
+
+        SDL_CondBroadcast(prefetchcond);
+    }
+
+    SDL_UnlockMutex(prefetchlock);
+
+    return 0;
+}
+
+static void W_ShutdownPrefetch(void)
+{
+    W_CancelPrefetch();
+
+    SDL_LockMutex(prefetchlock);
+    prefetchquit = true;
+    SDL_CondBroadcast(prefetchcond);
+    SDL_UnlockMutex(prefetchlock);
+
+    SDL_WaitThread(prefetchthread, NULL);
+    prefetchthread = NULL;
+}
+
+static boolean W_InitPrefetch(void)
+{
+    if (prefetchinit)
+    {
+        return prefetchthread != NULL;
+    }
+
+    prefetchinit = true;
+
+    //!
+    // @category obscure
+    //
+    // Don't read lumps the level will need ahead of time on a
+    // background thread.
+    //
+
+    if (M_CheckParm("-noprefetch"))
+    {
+        return false;
+    }
+
+    prefetchlock = SDL_CreateMutex();
+    prefetchcond = SDL_CreateCond();
+    prefetchthread = SDL_CreateThread(PrefetchThread, "W_Prefetch", NULL);
+
+    if (prefetchthread == NULL)
+    {
+        fprintf(stderr, "W_InitPrefetch: %s\n", SDL_GetError());
+        return false;
+    }
+
+    I_AtExit(W_ShutdownPrefetch, false);
+
+    return true;
+}
+
+void W_PrefetchLump(lumpindex_t lump)
+{
+    lumpinfo_t *l;
+
+    if (lump < 0 || lump >= numlumps || !W_InitPrefetch())
+    {
+        return;
+    }
+
+    l = lumpinfo[lump];
+
+    // PK3 entries are found and inflated by their reader, which isn't
+    // thread safe
+    if (l->cache != NULL || l->wad_file->file_class == &zip_wad_file)
+    {
+        return;
+    }
+
+    SDL_LockMutex(prefetchlock);
+
+    if (numprefetch < numlumps)
+    {
+        prefetchstate = I_Realloc(prefetchstate, numlumps * sizeof(*prefetchstate));
+        prefetchdata = I_Realloc(prefetchdata, numlumps * sizeof(*prefetchdata));
+        memset(prefetchstate + numprefetch, PREFETCH_NONE, numlumps - numprefetch);
+        memset(prefetchdata + numprefetch, 0,
+               (numlumps - numprefetch) * sizeof(*prefetchdata));
+        numprefetch = numlumps;
+    }
+
+    if (prefetchstate[lump] == PREFETCH_NONE
+     && (prefetchtail + 1) % MAXPREFETCH != prefetchhead)
+    {
+        prefetchstate[lump] = PREFETCH_QUEUED;
+        prefetchqueue[prefetchtail] = lump;
+        prefetchtail = (prefetchtail + 1) % MAXPREFETCH;
+        SDL_CondBroadcast(prefetchcond);
+    }
+
+    SDL_UnlockMutex(prefetchlock);
+}
+
+void W_CancelPrefetch(void)
+{
+    unsigned int i;
+
+    if (prefetchthread == NULL)
+    {
+        return;
+    }
+
+    SDL_LockMutex(prefetchlock);
+
+    prefetchhead = prefetchtail;
+
+    for (i = 0; i < numprefetch; ++i)
+    {
+        free(prefetchdata[i]);
+        prefetchdata[i] = NULL;
+        prefetchstate[i] = PREFETCH_NONE;
+    }
+
+    prefetchbytes = 0;
+
+    while (prefetchreading)
+    {
+        SDL_CondWait(prefetchcond, prefetchlock);
+    }
+
+    // The handles may be for files about to be closed or reloaded
+    for (i = 0; i < numprefetchfiles; ++i)
+    {
+        if (prefetchfiles[i].fstream != NULL)
+        {
+            fclose(prefetchfiles[i].fstream);
+        }
+    }
+
+    numprefetchfiles = 0;
+
+    SDL_UnlockMutex(prefetchlock);
+}
+
+boolean W_TakePrefetched(lumpindex_t lump, void *dest)
+{
+    boolean result = false;
+
+    if (prefetchthread == NULL)
+    {
+        return false;
+    }
+
+    SDL_LockMutex(prefetchlock);
+
+    if ((unsigned int) lump < numprefetch && prefetchdata[lump] != NULL)
+    {
+        memcpy(dest, prefetchdata[lump], lumpinfo[lump]->size);
+        free(prefetchdata[lump]);
+        prefetchdata[lump] = NULL;
+        prefetchbytes -= lumpinfo[lump]->size;
+        prefetchstate[lump] = PREFETCH_NONE;
+        result = true;
+    }
+
+    SDL_UnlockMutex(prefetchlock);
+
+    return result;
+}
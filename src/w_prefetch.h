@@ -0,0 +1,38 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Background lump reads. Lumps that will probably be needed soon are
+//	read by an I/O thread into its own buffers, and W_CacheLumpNum
+//	copies them into the zone instead of going to disk. Lumps of mapped
+//	files are only paged in.
+//
+
+#ifndef __W_PREFETCH__
+#define __W_PREFETCH__
+
+#include "doomtype.h"
+#include "w_wad.h"
+
+// Queues a lump to be read ahead. Does nothing for lumps already
+// cached or queued, or if -noprefetch was given.
+void W_PrefetchLump(lumpindex_t lump);
+
+// Drops everything queued or read but not yet used, and waits for the
+// read in progress. Must be called before the WAD directory changes.
+void W_CancelPrefetch(void);
+
+// Copies the lump into dest and returns true if it has been read ahead.
+boolean W_TakePrefetched(lumpindex_t lump, void *dest);
+
+#endif
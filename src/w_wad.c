@@ -28,9 +28,11 @@
 
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_trace.h"
 #include "i_video.h"
 #include "m_misc.h"
 #include "v_diskicon.h"
+#include "w_prefetch.h"
 #include "z_zone.h"
 
 #include "w_wad.h"
@@ -62,6 +64,37 @@ unsigned int numlumps = 0;
 // Hash table for fast lookups
 static lumpindex_t *lumphash;
 
+// [AP] Lump names packed into one integer, uppercased, so a lookup
+// compares a single value per chain entry. The hash table is a power of
+// two and, like the key and chain arrays, is only reallocated when the
+// directory outgrows it.
+typedef uint64_t lumpkey_t;
+
+static lumpkey_t *lumpkeys;
+static lumpindex_t *lumpnext;
+static unsigned int lumphashmask;
+static unsigned int lumptablesize;
+static boolean lumphashvalid;
+
+#define LUMPHASH(key) \
+    ((unsigned int) (((key) * 0x9e3779b97f4a7c15ull) >> 32) & lumphashmask)
+
+// [AP] Recent lookups, including misses, so the names menus and HUD
+// widgets ask for every frame don't walk a chain each time. Cleared
+// whenever the directory changes.
+#define NUMLUMPMEMO 256
+
+typedef struct
+{
+    lumpkey_t key;
+    lumpindex_t lump;
+} lumpmemo_t;
+
+static lumpmemo_t lumpmemo[NUMLUMPMEMO];
+
+#define LUMPMEMOSLOT(key) \
+    ((unsigned int) (((key) * 0x9e3779b97f4a7c15ull) >> 56) & (NUMLUMPMEMO - 1))
+
 // Variables for the reload hack: filename of the PWAD to reload, and the
 // lumps from WADs before the reload file, so we can resent numlumps and
 // load the file again.
@@ -103,6 +136,39 @@ unsigned int W_LumpNameHash(const char *s)
     return result;
 }
 
+static lumpkey_t W_LumpNameKey(const char *s)
+{
+    lumpkey_t result = 0;
+    unsigned int i;
+
+    for (i=0; i < 8 && s[i] != '\0'; ++i)
+    {
+        int c = (unsigned char) s[i];
+
+        if (c >= 'a' && c <= 'z')
+        {
+            c -= 'a' - 'A';
+        }
+
+        result |= (lumpkey_t) c << (i * 8);
+    }
+
+    return result;
+}
+
+static void W_ClearLumpMemo(void)
+{
+    memset(lumpmemo, 0, sizeof(lumpmemo));
+}
+
+static boolean W_IsZipFile(const char *filename)
+{
+    size_t len = strlen(filename);
+
+    return len > 4 && (!strcasecmp(filename + len - 4, ".pk3")
+                    || !strcasecmp(filename + len - 4, ".zip"));
+}
+
 //
 // LUMP BASED ROUTINES.
 //
@@ -148,7 +214,15 @@ wad_file_t *W_AddFile (const char *filename)
     }
 
     // Open the file and add to directory
-    wad_file = W_OpenFile(filename);
+    // [AP] PK3s get their own reader, whatever -mmap says
+    if (W_IsZipFile(filename))
+    {
+        wad_file = zip_wad_file.OpenFile(filename);
+    }
+    else
+    {
+        wad_file = W_OpenFile(filename);
+    }
 
     if (wad_file == NULL)
     {
@@ -156,7 +230,24 @@ wad_file_t *W_AddFile (const char *filename)
 	return NULL;
     }
 
-    if (strcasecmp(filename+strlen(filename)-3 , "wad" ) )
+    if (wad_file->file_class == &zip_wad_file)
+    {
+        // [AP] Same little-endian fake directory as for single lumps
+
+        numfilelumps = W_ZipNumLumps(wad_file);
+        fileinfo = Z_Malloc(sizeof(filelump_t) * (numfilelumps + 1),
+                            PU_STATIC, 0);
+
+        for (i = 0; i < numfilelumps; ++i)
+        {
+            int position, size;
+
+            W_ZipLump(wad_file, i, fileinfo[i].name, &position, &size);
+            fileinfo[i].filepos = LONG(position);
+            fileinfo[i].size = LONG(size);
+        }
+    }
+    else if (strcasecmp(filename+strlen(filename)-3 , "wad" ) )
     {
 	// single lump file
 
@@ -192,6 +283,12 @@ wad_file_t *W_AddFile (const char *filename)
 
 	    // ???modifiedgame = true;
 	}
+	else
+	{
+	    // [AP] Lumps from the IWAD are returned straight from the
+	    // mapping. The directory read below works either way.
+	    wad_file = W_MapFile(wad_file);
+	}
 
 	header.numlumps = LONG(header.numlumps);
 
@@ -241,11 +338,9 @@ wad_file_t *W_AddFile (const char *filename)
 
     Z_Free(fileinfo);
 
-    if (lumphash != NULL)
-    {
-        Z_Free(lumphash);
-        lumphash = NULL;
-    }
+    // [AP] Keep the buffers for the next W_GenerateHashTable
+    lumphashvalid = false;
+    W_ClearLumpMemo();
 
     // If this is the reload file, we need to save some details about the
     // file so that we can close it later on when we do a reload.
@@ -280,24 +375,37 @@ int W_NumLumps (void)
 lumpindex_t W_CheckNumForName(const char *name)
 {
     lumpindex_t i;
+    lumpkey_t key;
+
+    key = W_LumpNameKey(name);
 
     // Do we have a hash table yet?
 
-    if (lumphash != NULL)
+    if (lumphashvalid)
     {
-        int hash;
+        lumpmemo_t *memo;
 
         // We do! Excellent.
 
-        hash = W_LumpNameHash(name) % numlumps;
+        memo = &lumpmemo[LUMPMEMOSLOT(key)];
+
+        if (memo->key == key && key != 0)
+        {
+            return memo->lump;
+        }
 
-        for (i = lumphash[hash]; i != -1; i = lumpinfo[i]->next)
+        for (i = lumphash[LUMPHASH(key)]; i != -1; i = lumpnext[i])
         {
-            if (!strncasecmp(lumpinfo[i]->name, name, 8))
+            if (lumpkeys[i] == key)
             {
-                return i;
+                break;
             }
         }
+
+        memo->key = key;
+        memo->lump = i;
+
+        return i;
     }
     else
     {
@@ -307,7 +415,7 @@ lumpindex_t W_CheckNumForName(const char *name)
 
         for (i = numlumps - 1; i >= 0; --i)
         {
-            if (!strncasecmp(lumpinfo[i]->name, name, 8))
+            if (W_LumpNameKey(lumpinfo[i]->name) == key)
             {
                 return i;
             }
@@ -343,10 +451,13 @@ lumpindex_t W_GetNumForName(const char *name)
 lumpindex_t W_CheckNumForNameFromTo(const char *name, int from, int to)
 {
     lumpindex_t i;
+    lumpkey_t key;
+
+    key = W_LumpNameKey(name);
 
     for (i = from; i >= to; i--)
     {
-        if (!strncasecmp(lumpinfo[i]->name, name, 8))
+        if ((lumphashvalid ? lumpkeys[i] : W_LumpNameKey(lumpinfo[i]->name)) == key)
         {
             return i;
         }
@@ -437,20 +548,45 @@ void *W_CacheLumpNum(lumpindex_t lumpnum, int tag)
 
         result = lump->wad_file->mapped + lump->position;
     }
+    else if (lump->cache == NULL
+          && lump->wad_file->file_class->MapLump != NULL
+          && (result = lump->wad_file->file_class->MapLump(lump->wad_file,
+                                                           lump->position)))
+    {
+        // [AP] Lump that can be used where it is, like a stored PK3 entry
+    }
     else if (lump->cache != NULL)
     {
         // Already cached, so just switch the zone tag.
 
         result = lump->cache;
         Z_ChangeTag(lump->cache, tag);
+        Z_CountLookup(true); // [AP]
     }
     else
     {
         // Not yet loaded, so load it now
 
+        if (tracing)
+        {
+            char name[9];
+
+            memcpy(name, lump->name, 8);
+            name[8] = '\0';
+            I_TraceBegin("W_CacheLumpNum", name);
+        }
+
+        Z_CountLookup(false); // [AP]
         lump->cache = Z_Malloc(W_LumpLength(lumpnum), tag, &lump->cache);
-	W_ReadLump (lumpnum, lump->cache);
+
+        // [AP] Read ahead by the I/O thread, if we're lucky
+        if (!W_TakePrefetched(lumpnum, lump->cache))
+        {
+            W_ReadLump (lumpnum, lump->cache);
+        }
         result = lump->cache;
+
+        I_TraceEnd("W_CacheLumpNum");
     }
 	
     return result;
@@ -487,9 +623,9 @@ void W_ReleaseLumpNum(lumpindex_t lumpnum)
 
     lump = lumpinfo[lumpnum];
 
-    if (lump->wad_file->mapped != NULL)
+    if (lump->wad_file->mapped != NULL || lump->cache == NULL)
     {
-        // Memory-mapped file, so nothing needs to be done here.
+        // Memory-mapped file (or lump), so nothing needs to be done here.
     }
     else
     {
@@ -573,19 +709,37 @@ void W_Profile (void)
 void W_GenerateHashTable(void)
 {
     lumpindex_t i;
+    unsigned int size;
 
-    // Free the old hash table, if there is one:
-    if (lumphash != NULL)
-    {
-        Z_Free(lumphash);
-    }
+    W_ClearLumpMemo();
+    lumphashvalid = false;
 
     // Generate hash table
     if (numlumps > 0)
     {
-        lumphash = Z_Malloc(sizeof(lumpindex_t) * numlumps, PU_STATIC, NULL);
+        // [AP] Names may have been patched in place since the last call,
+        // so every key is packed again, but the buffers are reused.
 
-        for (i = 0; i < numlumps; ++i)
+        for (size = 1; size < numlumps; size <<= 1);
+
+        if (size > lumptablesize)
+        {
+            if (lumphash != NULL)
+            {
+                Z_Free(lumphash);
+                Z_Free(lumpkeys);
+                Z_Free(lumpnext);
+            }
+
+            lumphash = Z_Malloc(sizeof(*lumphash) * size, PU_STATIC, NULL);
+            lumpkeys = Z_Malloc(sizeof(*lumpkeys) * size, PU_STATIC, NULL);
+            lumpnext = Z_Malloc(sizeof(*lumpnext) * size, PU_STATIC, NULL);
+            lumptablesize = size;
+        }
+
+        lumphashmask = size - 1;
+
+        for (i = 0; i < size; ++i)
         {
             lumphash[i] = -1;
         }
@@ -594,13 +748,16 @@ void W_GenerateHashTable(void)
         {
             unsigned int hash;
 
-            hash = W_LumpNameHash(lumpinfo[i]->name) % numlumps;
+            lumpkeys[i] = W_LumpNameKey(lumpinfo[i]->name);
+            hash = LUMPHASH(lumpkeys[i]);
 
             // Hook into the hash table
 
-            lumpinfo[i]->next = lumphash[hash];
+            lumpnext[i] = lumphash[hash];
             lumphash[hash] = i;
         }
+
+        lumphashvalid = true;
     }
 
     // All done!
@@ -622,6 +779,9 @@ void W_Reload(void)
         return;
     }
 
+    // [AP] Read ahead lump numbers are about to mean something else
+    W_CancelPrefetch();
+
     // We must free any lumps being cached from the PWAD we're about to reload:
     for (i = reloadlump; i < numlumps; ++i)
     {
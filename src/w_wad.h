@@ -44,9 +44,6 @@ struct lumpinfo_s
     int		position;
     int		size;
     void       *cache;
-
-    // Used for hash table lookups
-    lumpindex_t next;
 };
 
 
@@ -236,7 +236,7 @@ static boolean ClearCache(int size)
 // You can pass a NULL user if the tag is < PU_PURGELEVEL.
 //
 
-void *Z_Malloc(int size, int tag, void *user)
+void *Z_Malloc2(int size, int tag, void *user, const char *file, int line)
 {
     memblock_t *newblock;
     unsigned char *data;
@@ -504,3 +504,8 @@ unsigned int Z_ZoneSize(void)
     return 0;
 }
 
+size_t Z_PeakUsage(void)
+{
+    return 0;
+}
+
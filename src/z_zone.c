@@ -16,11 +16,14 @@
 //	Zone Memory Allocation. Neat.
 //
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "doomtype.h"
 #include "i_system.h"
+#include "i_timer.h"
 #include "m_argv.h"
+#include "m_misc.h"
 
 #include "z_zone.h"
 
@@ -30,27 +33,43 @@
 //
 // There is never any space between memblocks,
 //  and there will never be two contiguous free memblocks.
-// The rover can be left pointing at a non-empty block.
 //
 // It is of no value to free a cachable block,
 //  because it will get overwritten automatically if needed.
+//
+// [AP] Free blocks are kept in lists by size class and blocks in use in
+// lists by tag, so an allocation looks at a few free blocks of about the
+// right size rather than walking the heap from a rover, and Z_FreeTags
+// only visits the blocks it frees. Purgable blocks go least recently
+// used first when no free block fits: Z_ChangeTag moves a block to the
+// end of its list, and a block Z_Touch marked gets passed over once
+// (CLOCK's second chance). When purging doesn't make room either,
+// another zone is added, twice as big as the last, as crispy did.
 // 
  
 #define MEM_ALIGN sizeof(void *)
 #define ZONEID	0x1d4a11
+#define ARENAID	0x1d4a12 // [AP] see Z_ArenaMalloc2
 
 typedef struct memblock_s
 {
     int			size;	// including the header and possibly tiny fragments
+    int			touched; // [AP] Z_Touch since purging last passed it
     void**		user;
     int			tag;	// PU_FREE if this is free
     int			id;	// should be ZONEID
     struct memblock_s*	next;
     struct memblock_s*	prev;
+    // [AP] Size class list if free, tag list if not
+    struct memblock_s*	lnext;
+    struct memblock_s*	lprev;
+#ifdef ZONE_DEBUG
+    int			site;	// [AP] index in sites
+#endif
 } memblock_t;
 
 
-typedef struct
+typedef struct memzone_s
 {
     // total bytes malloced, including header
     int		size;
@@ -58,69 +77,344 @@ typedef struct
     // start / end cap for linked list
     memblock_t	blocklist;
     
-    memblock_t*	rover;
+    struct memzone_s*	next; // [AP] zones added when this one ran full
     
 } memzone_t;
 
 
+// [AP] Free lists hold blocks of [64 << i, 128 << i) bytes, the last
+// one everything bigger, each most recently freed first
+#define NUMSIZECLASSES 24
 
-static memzone_t *mainzone;
+static memzone_t *mainzone; // Most recently added
+static memzone_t *firstzone;
+static memblock_t taglists[PU_NUM_TAGS]; // Oldest first
+static memblock_t freelists[NUMSIZECLASSES];
 static boolean zero_on_free;
 static boolean scan_on_free;
+static void (*purge_callback)(void); // [AP] see Z_SetPurgeCallback
+static size_t zone_used, zone_peak; // [AP] Bytes in blocks and arenas
+
+// [AP] Blocks in use by tag, for -zonestats
+static boolean zone_stats;
+static size_t tag_bytes[PU_NUM_TAGS];
+static int tag_blocks[PU_NUM_TAGS];
+static size_t tag_peak[PU_NUM_TAGS];
+
+// [AP] Purgable blocks, see Z_TrimCache and Z_CountLookup
+static size_t cache_budget; // -zonecache, 0 for none
+static unsigned long cache_hits, cache_misses;
+static unsigned long cache_evictions, cache_second_chances;
+
+static const char *tag_names[PU_NUM_TAGS] =
+{
+    "", "STATIC", "SOUND", "MUSIC", "FREE", "LEVEL", "LEVSPEC",
+    "PURGE", "CACHE",
+};
+
+#ifdef ZONE_DEBUG
+// [AP] Blocks in use by where they were allocated, hashed on the
+// file name's address. Site 0 takes whatever doesn't fit.
+#define NUMSITES 1024
+
+typedef struct
+{
+    const char*	file;
+    int		line;
+    size_t	bytes;
+    int		blocks;
+    size_t	peak;
+} zonesite_t;
+
+static zonesite_t sites[NUMSITES];
+
+static int Z_FindSite (const char *file, int line)
+{
+    unsigned int	hash;
+    int			i;
+
+    hash = (unsigned int) ((size_t) file >> 2) * 31 + line;
+
+    for (i = 0; i < NUMSITES - 1; i++)
+    {
+	int index = 1 + (hash + i) % (NUMSITES - 1);
+
+	if (sites[index].file == NULL)
+	{
+	    sites[index].file = file;
+	    sites[index].line = line;
+	}
+
+	if (sites[index].file == file && sites[index].line == line)
+	    return index;
+    }
+
+    return 0;
+}
+
+#define Z_SetSite(block, file, line) ((block)->site = Z_FindSite(file, line))
+#else
+#define Z_SetSite(block, file, line)
+#endif
+
+
+// [AP] Z_ArenaMalloc'd PU_LEVEL and PU_LEVSPEC blocks are bumped out of
+// chunks of their own, outside the zone, and all go at once when
+// Z_FreeTags covers their tag. Z_Free on them gives nothing back until
+// then, so only what lives as long as its level (the map geometry and
+// the like) comes from here. The chunks stay around for the next level.
+#define ARENACHUNK (1 << 20)
+
+typedef struct arenachunk_s
+{
+    struct arenachunk_s*	next;
+    size_t	size; // Usable, after the header
+    size_t	used;
+} arenachunk_t;
+
+typedef struct
+{
+    arenachunk_t*	first;
+    arenachunk_t*	current;
+    int			blocks;
+} arena_t;
+
+static arena_t arenas[2]; // PU_LEVEL, PU_LEVSPEC
+
+static void Z_AddUsage (memblock_t *block)
+{
+    int tag = block->tag;
+
+    zone_used += block->size;
+
+    if (zone_used > zone_peak)
+	zone_peak = zone_used;
+
+    tag_bytes[tag] += block->size;
+    tag_blocks[tag]++;
+
+    if (tag_bytes[tag] > tag_peak[tag])
+	tag_peak[tag] = tag_bytes[tag];
+
+#ifdef ZONE_DEBUG
+    {
+	zonesite_t *site = &sites[block->site];
+
+	site->bytes += block->size;
+	site->blocks++;
+
+	if (site->bytes > site->peak)
+	    site->peak = site->bytes;
+    }
+#endif
+}
+
+static void Z_RemoveUsage (memblock_t *block)
+{
+    zone_used -= block->size;
+    tag_bytes[block->tag] -= block->size;
+    tag_blocks[block->tag]--;
+
+#ifdef ZONE_DEBUG
+    sites[block->site].bytes -= block->size;
+    sites[block->site].blocks--;
+#endif
+}
+
+#define ARENACHUNKHEADER \
+    ((sizeof(arenachunk_t) + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1))
+
+// [AP] The caller accounts for the block
+static memblock_t *Z_ArenaBlock (size_t size, int tag)
+{
+    arena_t*		arena = &arenas[tag - PU_LEVEL];
+    arenachunk_t*	chunk = arena->current;
+    memblock_t*		block;
+
+    size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+    size += sizeof(memblock_t);
+
+    while (!chunk || chunk->used + size > chunk->size)
+    {
+	if (chunk && chunk->next)
+	{
+	    // left over from a bigger level
+	    chunk = chunk->next;
+	    continue;
+	}
+
+	{
+	    size_t	chunksize = size > ARENACHUNK ? size : ARENACHUNK;
+	    arenachunk_t*	newchunk = malloc(ARENACHUNKHEADER + chunksize);
+
+	    if (!newchunk)
+		I_Error ("Z_Malloc: failed on allocation of %i bytes", (int) size);
+
+	    newchunk->next = NULL;
+	    newchunk->size = chunksize;
+	    newchunk->used = 0;
+
+	    if (chunk)
+		chunk->next = newchunk;
+	    else
+		arena->first = newchunk;
+	    chunk = newchunk;
+	}
+    }
+
+    arena->current = chunk;
+
+    block = (memblock_t *) ((byte *) chunk + ARENACHUNKHEADER + chunk->used);
+    chunk->used += size;
+    arena->blocks++;
+
+    block->size = size;
+    block->touched = 0;
+    block->user = NULL;
+    block->tag = tag;
+    block->id = ARENAID;
+    block->next = block->prev = NULL;
+    block->lnext = block->lprev = NULL;
+
+    return block;
+}
+
+static void Z_ArenaReset (int tag)
+{
+    arena_t*		arena = &arenas[tag - PU_LEVEL];
+    arenachunk_t*	chunk;
+
+    for (chunk = arena->first; chunk; chunk = chunk->next)
+    {
+#ifdef ZONE_DEBUG
+	size_t	offset;
+
+	for (offset = 0; offset < chunk->used; )
+	{
+	    memblock_t *block = (memblock_t *)
+		((byte *) chunk + ARENACHUNKHEADER + offset);
+
+	    sites[block->site].bytes -= block->size;
+	    sites[block->site].blocks--;
+	    offset += block->size;
+	}
+#endif
+
+	if (zero_on_free)
+	    memset((byte *) chunk + ARENACHUNKHEADER, 0, chunk->used);
+	zone_used -= chunk->used;
+	tag_bytes[tag] -= chunk->used;
+	chunk->used = 0;
+    }
+
+    tag_blocks[tag] -= arena->blocks;
+    arena->blocks = 0;
+    arena->current = arena->first;
+}
+
+
+static int Z_SizeClass (int size)
+{
+    int cls = 0;
+
+    size >>= 7;
+    while (size && cls < NUMSIZECLASSES - 1)
+    {
+        size >>= 1;
+        cls++;
+    }
+
+    return cls;
+}
+
+static void Z_ListInit (memblock_t *head)
+{
+    head->lnext = head->lprev = head;
+}
+
+static void Z_ListAppend (memblock_t *head, memblock_t *block)
+{
+    block->lprev = head->lprev;
+    block->lnext = head;
+    head->lprev->lnext = block;
+    head->lprev = block;
+}
+
+static void Z_ListPush (memblock_t *head, memblock_t *block)
+{
+    block->lnext = head->lnext;
+    block->lprev = head;
+    head->lnext->lprev = block;
+    head->lnext = block;
+}
+
+static void Z_ListRemove (memblock_t *block)
+{
+    block->lprev->lnext = block->lnext;
+    block->lnext->lprev = block->lprev;
+}
+
+static void Z_AddFreeBlock (memblock_t *block)
+{
+    block->tag = PU_FREE;
+    Z_ListPush(&freelists[Z_SizeClass(block->size)], block);
+}
 
 
 //
-// Z_ClearZone
+// Z_AddZone
+// [AP] Gets another zone from the system and frees all of it.
 //
-void Z_ClearZone (memzone_t* zone)
+static void Z_AddZone (void)
 {
-    memblock_t*		block;
-	
+    memzone_t*	zone;
+    memblock_t*	block;
+    int		size;
+
+    zone = (memzone_t *)I_ZoneBase (&size);
+    zone->size = size;
+    zone->next = NULL;
+
     // set the entire zone to one free block
     zone->blocklist.next =
 	zone->blocklist.prev =
 	block = (memblock_t *)( (byte *)zone + sizeof(memzone_t) );
-    
+
     zone->blocklist.user = (void *)zone;
     zone->blocklist.tag = PU_STATIC;
-    zone->rover = block;
-	
-    block->prev = block->next = &zone->blocklist;
-    
-    // a free block.
-    block->tag = PU_FREE;
 
+    block->prev = block->next = &zone->blocklist;
+    block->user = NULL;
+    block->id = 0;
     block->size = zone->size - sizeof(memzone_t);
+
+    // free block
+    Z_AddFreeBlock(block);
+
+    if (mainzone)
+	mainzone->next = zone;
+    else
+	firstzone = zone;
+    mainzone = zone;
 }
 
 
 
+static void Z_ReportStats (void);
+
 //
 // Z_Init
 //
 void Z_Init (void)
 {
-    memblock_t*	block;
-    int		size;
-
-    mainzone = (memzone_t *)I_ZoneBase (&size);
-    mainzone->size = size;
-
-    // set the entire zone to one free block
-    mainzone->blocklist.next =
-	mainzone->blocklist.prev =
-	block = (memblock_t *)( (byte *)mainzone + sizeof(memzone_t) );
+    int		i;
 
-    mainzone->blocklist.user = (void *)mainzone;
-    mainzone->blocklist.tag = PU_STATIC;
-    mainzone->rover = block;
+    for (i = 0; i < PU_NUM_TAGS; i++)
+	Z_ListInit(&taglists[i]);
+    for (i = 0; i < NUMSIZECLASSES; i++)
+	Z_ListInit(&freelists[i]);
 
-    block->prev = block->next = &mainzone->blocklist;
-
-    // free block
-    block->tag = PU_FREE;
-
-    block->size = mainzone->size - sizeof(memzone_t);
+    Z_AddZone();
 
     // [Deliberately undocumented]
     // Zone memory debugging flag. If set, memory is zeroed after it is freed
@@ -133,19 +427,47 @@ void Z_Init (void)
     // heap is scanned to look for remaining pointers to the freed block.
     //
     scan_on_free = M_ParmExists("-zonescan");
+
+    //!
+    // @category obscure
+    //
+    // Show how much zone memory each purge tag has in use while the FPS
+    // counter is up, and print the totals on exit. Built with ZONE_DEBUG,
+    // also list the places that allocated the most.
+    //
+    zone_stats = M_ParmExists("-zonestats");
+
+    if (zone_stats)
+	I_AtExit(Z_ReportStats, true);
+
+    //!
+    // @category obscure
+    // @arg <kib>
+    //
+    // Keep at most <kib> KiB of purgable blocks (cached lumps, texture
+    // composites), purging the least recently used ones past that.
+    // By default they only go when the zone runs out of room.
+    //
+    i = M_CheckParmWithArgs("-zonecache", 1);
+
+    if (i > 0)
+	cache_budget = (size_t) atoi(myargv[i + 1]) * 1024;
 }
 
 // Scan the zone heap for pointers within the specified range, and warn about
 // any remaining pointers.
 static void ScanForBlock(void *start, void *end)
 {
+    memzone_t *zone;
     memblock_t *block;
     void **mem;
     int i, len, tag;
 
-    block = mainzone->blocklist.next;
+    for (zone = firstzone; zone; zone = zone->next)
+    {
+    block = zone->blocklist.next;
 
-    while (block->next != &mainzone->blocklist)
+    while (block->next != &zone->blocklist)
     {
         tag = block->tag;
 
@@ -170,17 +492,18 @@ static void ScanForBlock(void *start, void *end)
 
         block = block->next;
     }
+    }
 }
 
 //
-// Z_Free
+// Z_FreeBlock
+// [AP] Frees a block in use and returns the free block it ends up in,
+// after merging with its free neighbors.
 //
-void Z_Free (void* ptr)
+static memblock_t *Z_FreeBlock (memblock_t* block)
 {
-    memblock_t*		block;
     memblock_t*		other;
-
-    block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
+    void*		ptr = (byte *)block + sizeof(memblock_t);
 
     if (block->id != ZONEID)
 	I_Error ("Z_Free: freed a pointer without ZONEID");
@@ -191,6 +514,9 @@ void Z_Free (void* ptr)
 	    *block->user = 0;
     }
 
+    Z_ListRemove(block);
+    Z_RemoveUsage(block);
+
     // mark as free
     block->tag = PU_FREE;
     block->user = NULL;
@@ -213,13 +539,11 @@ void Z_Free (void* ptr)
     if (other->tag == PU_FREE)
     {
         // merge with previous free block
+        Z_ListRemove(other);
         other->size += block->size;
         other->next = block->next;
         other->next->prev = other;
 
-        if (block == mainzone->rover)
-            mainzone->rover = other;
-
         block = other;
     }
 
@@ -227,12 +551,182 @@ void Z_Free (void* ptr)
     if (other->tag == PU_FREE)
     {
         // merge the next free block onto the end
+        Z_ListRemove(other);
         block->size += other->size;
         block->next = other->next;
         block->next->prev = block;
+    }
+
+    Z_AddFreeBlock(block);
+
+    return block;
+}
+
+//
+// Z_Free
+//
+void Z_Free (void* ptr)
+{
+    memblock_t*		block;
+
+    block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
+
+    // [AP] Arena blocks go with the rest of their level
+    if (block->id == ARENAID)
+    {
+	block->id = 0;
+	return;
+    }
+
+    Z_FreeBlock(block);
+}
+
+
+
+//
+// Z_ArenaMalloc2
+// [AP] For blocks that are only freed with their level, see Z_ArenaBlock
+//
+void*
+Z_ArenaMalloc2
+( int		size,
+  int		tag,
+  const char*	file,
+  int		line )
+{
+    memblock_t*	base;
+
+    if (tag != PU_LEVEL && tag != PU_LEVSPEC)
+	I_Error ("Z_ArenaMalloc: tag %i is not a level tag", tag);
+
+    base = Z_ArenaBlock(size, tag);
+    Z_SetSite(base, file, line);
+    Z_AddUsage(base);
+
+    return (byte *) base + sizeof(memblock_t);
+}
 
-        if (other == mainzone->rover)
-            mainzone->rover = block;
+
+
+//
+// Z_FindFreeBlock
+// [AP] Any free block of at least size bytes, NULL if there's none. In
+// size's own class the blocks may be smaller, in the ones above never.
+//
+static memblock_t *Z_FindFreeBlock (int size)
+{
+    memblock_t*	block;
+    int		cls = Z_SizeClass(size);
+
+    for (block = freelists[cls].lnext ;
+	 block != &freelists[cls] ;
+	 block = block->lnext)
+    {
+	if (block->size >= size)
+	    return block;
+    }
+
+    for (cls++ ; cls < NUMSIZECLASSES ; cls++)
+    {
+	if (freelists[cls].lnext != &freelists[cls])
+	    return freelists[cls].lnext;
+    }
+
+    return NULL;
+}
+
+//
+// Z_PurgeOldest
+// [AP] Frees the least recently used block of a purgable tag and returns
+// the free block it ends up in. Blocks touched since they were last
+// looked at move to the end instead, untouched. NULL once the tag has
+// no blocks left.
+//
+static memblock_t *Z_PurgeOldest (int tag)
+{
+    memblock_t*	head = &taglists[tag];
+    memblock_t*	block;
+
+    while ((block = head->lnext) != head)
+    {
+	if (block->touched)
+	{
+	    block->touched = 0;
+	    Z_ListRemove(block);
+	    Z_ListAppend(head, block);
+	    cache_second_chances++;
+	    continue;
+	}
+
+	cache_evictions++;
+	return Z_FreeBlock(block);
+    }
+
+    return NULL;
+}
+
+//
+// Z_PurgeForBlock
+// [AP] Frees purgable blocks, least recently used first, until one of
+// them leaves a free block of at least size bytes. NULL if they all
+// went without.
+//
+static memblock_t *Z_PurgeForBlock (int size)
+{
+    memblock_t*	block;
+    int		tag;
+
+    // let whoever still reads purgable blocks finish first
+    if (purge_callback)
+    {
+        purge_callback();
+    }
+
+    for (tag = PU_NUM_TAGS - 1 ; tag >= PU_PURGELEVEL ; tag--)
+    {
+	while ((block = Z_PurgeOldest(tag)) != NULL)
+	{
+	    if (block->size >= size)
+		return block;
+	}
+    }
+
+    return NULL;
+}
+
+static size_t Z_PurgableBytes (void)
+{
+    size_t	bytes = 0;
+    int		tag;
+
+    for (tag = PU_PURGELEVEL ; tag < PU_NUM_TAGS ; tag++)
+	bytes += tag_bytes[tag];
+
+    return bytes;
+}
+
+//
+// Z_TrimCache
+// [AP] -zonecache: purges down to the budget. Only from Z_Malloc, which
+// could always purge, so a PU_CACHE pointer is still good until the
+// next allocation and no longer.
+//
+static void Z_TrimCache (void)
+{
+    int		tag;
+
+    if (!cache_budget || Z_PurgableBytes() <= cache_budget)
+	return;
+
+    if (purge_callback)
+    {
+        purge_callback();
+    }
+
+    for (tag = PU_NUM_TAGS - 1 ; tag >= PU_PURGELEVEL ; tag--)
+    {
+	while (Z_PurgableBytes() > cache_budget && Z_PurgeOldest(tag))
+	    ;
     }
 }
 
@@ -246,79 +740,38 @@ void Z_Free (void* ptr)
 
 
 void*
-Z_Malloc
+Z_Malloc2
 ( int		size,
   int		tag,
-  void*		user )
+  void*		user,
+  const char*	file,
+  int		line )
 {
     int		extra;
-    memblock_t*	start;
-    memblock_t* rover;
     memblock_t* newblock;
     memblock_t*	base;
     void *result;
 
     size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
     
-    // scan through the block list,
-    // looking for the first free block
-    // of sufficient size,
-    // throwing out any purgable blocks along the way.
-
     // account for size of block header
     size += sizeof(memblock_t);
-    
-    // if there is a free block behind the rover,
-    //  back up over them
-    base = mainzone->rover;
-    
-    if (base->prev->tag == PU_FREE)
-        base = base->prev;
-	
-    rover = base;
-    start = base->prev;
-	
-    do
-    {
-        if (rover == start)
-        {
-            // scanned all the way around the list
-//          I_Error ("Z_Malloc: failed on allocation of %i bytes", size);
 
-            // [crispy] allocate another zone twice as big
-            Z_Init();
-
-            base = mainzone->rover;
-            rover = base;
-            start = base->prev;
-        }
-	
-        if (rover->tag != PU_FREE)
-        {
-            if (rover->tag < PU_PURGELEVEL)
-            {
-                // hit a block that can't be purged,
-                // so move base past it
-                base = rover = rover->next;
-            }
-            else
-            {
-                // free the rover block (adding the size to base)
+    Z_TrimCache(); // [AP]
+    
+    base = Z_FindFreeBlock(size);
 
-                // the rover can be the base block
-                base = base->prev;
-                Z_Free ((byte *)rover+sizeof(memblock_t));
-                base = base->next;
-                rover = base->next;
-            }
-        }
-        else
-        {
-            rover = rover->next;
-        }
+    if (!base)
+	base = Z_PurgeForBlock(size);
 
-    } while (base->tag != PU_FREE || base->size < size);
+    while (!base)
+    {
+        // [crispy] allocate another zone twice as big
+        Z_AddZone();
+        base = Z_FindFreeBlock(size);
+    }
 
+    Z_ListRemove(base);
     
     // found a block big enough
     extra = base->size - size;
@@ -329,14 +782,16 @@ Z_Malloc
         newblock = (memblock_t *) ((byte *)base + size );
         newblock->size = extra;
 	
-        newblock->tag = PU_FREE;
         newblock->user = NULL;	
+        newblock->id = 0;
         newblock->prev = base;
         newblock->next = base->next;
         newblock->next->prev = newblock;
 
         base->next = newblock;
         base->size = size;
+
+        Z_AddFreeBlock(newblock);
     }
 	
 	if (user == NULL && tag >= PU_PURGELEVEL)
@@ -344,6 +799,10 @@ Z_Malloc
 
     base->user = user;
     base->tag = tag;
+    base->touched = 0;
+    Z_ListAppend(&taglists[tag], base);
+    Z_SetSite(base, file, line);
+    Z_AddUsage(base);
 
     result  = (void *) ((byte *)base + sizeof(memblock_t));
 
@@ -352,9 +811,6 @@ Z_Malloc
         *base->user = result;
     }
 
-    // next allocation will start looking here
-    mainzone->rover = base->next;	
-	
     base->id = ZONEID;
    
     return result;
@@ -370,22 +826,24 @@ Z_FreeTags
 ( int		lowtag,
   int		hightag )
 {
-    memblock_t*	block;
-    memblock_t*	next;
-	
-    for (block = mainzone->blocklist.next ;
-	 block != &mainzone->blocklist ;
-	 block = next)
-    {
-	// get link before freeing
-	next = block->next;
+    int		tag;
+
+    if (lowtag < 0)
+	lowtag = 0;
+    if (hightag >= PU_NUM_TAGS)
+	hightag = PU_NUM_TAGS - 1;
 
-	// free block?
-	if (block->tag == PU_FREE)
+    for (tag = lowtag ; tag <= hightag ; tag++)
+    {
+	// free blocks aren't in any tag list
+	if (tag == PU_FREE)
 	    continue;
-	
-	if (block->tag >= lowtag && block->tag <= hightag)
-	    Z_Free ( (byte *)block+sizeof(memblock_t));
+
+	while (taglists[tag].lnext != &taglists[tag])
+	    Z_FreeBlock(taglists[tag].lnext);
+
+	if (tag == PU_LEVEL || tag == PU_LEVSPEC)
+	    Z_ArenaReset(tag); // [AP]
     }
 }
 
@@ -400,21 +858,24 @@ Z_DumpHeap
 ( int		lowtag,
   int		hightag )
 {
+    memzone_t*	zone;
     memblock_t*	block;
 	
+    for (zone = firstzone ; zone ; zone = zone->next)
+    {
     printf ("zone size: %i  location: %p\n",
-	    mainzone->size,mainzone);
+	    zone->size,zone);
     
     printf ("tag range: %i to %i\n",
 	    lowtag, hightag);
 	
-    for (block = mainzone->blocklist.next ; ; block = block->next)
+    for (block = zone->blocklist.next ; ; block = block->next)
     {
 	if (block->tag >= lowtag && block->tag <= hightag)
 	    printf ("block:%p    size:%7i    user:%p    tag:%3i\n",
 		    block, block->size, block->user, block->tag);
 		
-	if (block->next == &mainzone->blocklist)
+	if (block->next == &zone->blocklist)
 	{
 	    // all blocks have been hit
 	    break;
@@ -429,6 +890,7 @@ Z_DumpHeap
 	if (block->tag == PU_FREE && block->next->tag == PU_FREE)
 	    printf ("ERROR: two consecutive free blocks\n");
     }
+    }
 }
 
 
@@ -437,16 +899,19 @@ Z_DumpHeap
 //
 void Z_FileDumpHeap (FILE* f)
 {
+    memzone_t*	zone;
     memblock_t*	block;
 	
-    fprintf (f,"zone size: %i  location: %p\n",mainzone->size,mainzone);
+    for (zone = firstzone ; zone ; zone = zone->next)
+    {
+    fprintf (f,"zone size: %i  location: %p\n",zone->size,zone);
 	
-    for (block = mainzone->blocklist.next ; ; block = block->next)
+    for (block = zone->blocklist.next ; ; block = block->next)
     {
 	fprintf (f,"block:%p    size:%7i    user:%p    tag:%3i\n",
 		 block, block->size, block->user, block->tag);
 		
-	if (block->next == &mainzone->blocklist)
+	if (block->next == &zone->blocklist)
 	{
 	    // all blocks have been hit
 	    break;
@@ -461,6 +926,7 @@ void Z_FileDumpHeap (FILE* f)
 	if (block->tag == PU_FREE && block->next->tag == PU_FREE)
 	    fprintf (f,"ERROR: two consecutive free blocks\n");
     }
+    }
 }
 
 
@@ -470,11 +936,14 @@ void Z_FileDumpHeap (FILE* f)
 //
 void Z_CheckHeap (void)
 {
+    memzone_t*	zone;
     memblock_t*	block;
 	
-    for (block = mainzone->blocklist.next ; ; block = block->next)
+    for (zone = firstzone ; zone ; zone = zone->next)
+    {
+    for (block = zone->blocklist.next ; ; block = block->next)
     {
-	if (block->next == &mainzone->blocklist)
+	if (block->next == &zone->blocklist)
 	{
 	    // all blocks have been hit
 	    break;
@@ -489,6 +958,7 @@ void Z_CheckHeap (void)
 	if (block->tag == PU_FREE && block->next->tag == PU_FREE)
 	    I_Error ("Z_CheckHeap: two consecutive free blocks\n");
     }
+    }
 }
 
 
@@ -503,6 +973,15 @@ void Z_ChangeTag2(void *ptr, int tag, const char *file, int line)
 	
     block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
 
+    // [AP] Arena blocks can't outlive their level, or go any sooner
+    if (block->id == ARENAID)
+    {
+        if (tag != PU_LEVEL && tag != PU_LEVSPEC)
+            I_Error("%s:%i: Z_ChangeTag: level block can't change "
+                    "to tag %i", file, line, tag);
+        return;
+    }
+
     if (block->id != ZONEID)
         I_Error("%s:%i: Z_ChangeTag: block without a ZONEID!",
                 file, line);
@@ -511,7 +990,29 @@ void Z_ChangeTag2(void *ptr, int tag, const char *file, int line)
         I_Error("%s:%i: Z_ChangeTag: an owner is required "
                 "for purgable blocks", file, line);
 
+    // [AP] Moves to the end of the new tag's list, as the newest
+    Z_ListRemove(block);
+    Z_RemoveUsage(block);
     block->tag = tag;
+    Z_ListAppend(&taglists[tag], block);
+    Z_AddUsage(block);
+}
+
+// [AP] Marks a block as used, for purgable blocks that are read again
+// without going through Z_ChangeTag. Purging then passes it over once.
+void Z_Touch(void *ptr)
+{
+    ((memblock_t *) ((byte *) ptr - sizeof(memblock_t)))->touched = 1;
+}
+
+// [AP] A cache lookup (W_CacheLumpNum) found its block, or had to make
+// it. Only counted, for -zonestats.
+void Z_CountLookup(boolean hit)
+{
+    if (hit)
+        cache_hits++;
+    else
+        cache_misses++;
 }
 
 void Z_ChangeUser(void *ptr, void **user)
@@ -522,6 +1023,7 @@ void Z_ChangeUser(void *ptr, void **user)
 
     if (block->id != ZONEID)
     {
+        // [AP] Including arena blocks, which never clear their owner
         I_Error("Z_ChangeUser: Tried to change user for invalid block!");
     }
 
@@ -538,15 +1040,28 @@ int Z_FreeMemory (void)
 {
     memblock_t*		block;
     int			free;
+    int			i;
 	
     free = 0;
     
-    for (block = mainzone->blocklist.next ;
-         block != &mainzone->blocklist;
-         block = block->next)
+    for (i = 0; i < NUMSIZECLASSES; i++)
     {
-        if (block->tag == PU_FREE || block->tag >= PU_PURGELEVEL)
+        for (block = freelists[i].lnext;
+             block != &freelists[i];
+             block = block->lnext)
+        {
+            free += block->size;
+        }
+    }
+
+    for (i = PU_PURGELEVEL; i < PU_NUM_TAGS; i++)
+    {
+        for (block = taglists[i].lnext;
+             block != &taglists[i];
+             block = block->lnext)
+        {
             free += block->size;
+        }
     }
 
     return free;
@@ -554,6 +1069,231 @@ int Z_FreeMemory (void)
 
 unsigned int Z_ZoneSize(void)
 {
-    return mainzone->size;
+    memzone_t*		zone;
+    unsigned int	size = 0;
+
+    for (zone = firstzone; zone; zone = zone->next)
+        size += zone->size;
+
+    return size;
 }
 
+// [AP] Most bytes ever in use at once, block headers included
+size_t Z_PeakUsage(void)
+{
+    return zone_peak;
+}
+
+// [AP] Called before Z_Malloc purges a cached block to make room
+void Z_SetPurgeCallback(void (*callback)(void))
+{
+    purge_callback = callback;
+}
+
+//
+// Z_GetStats
+// [AP] Walks the free lists, so not something to call every frame.
+//
+void Z_GetStats (zonestats_t *stats)
+{
+    memzone_t*		zone;
+    memblock_t*		block;
+    arenachunk_t*	chunk;
+    int			i;
+
+    memset(stats, 0, sizeof(*stats));
+
+    memcpy(stats->tag_bytes, tag_bytes, sizeof(tag_bytes));
+    memcpy(stats->tag_blocks, tag_blocks, sizeof(tag_blocks));
+    memcpy(stats->tag_peak, tag_peak, sizeof(tag_peak));
+    stats->used = zone_used;
+    stats->peak = zone_peak;
+    stats->cache_budget = cache_budget;
+    stats->cache_bytes = Z_PurgableBytes();
+    stats->cache_hits = cache_hits;
+    stats->cache_misses = cache_misses;
+    stats->cache_evictions = cache_evictions;
+    stats->cache_second_chances = cache_second_chances;
+
+    for (zone = firstzone; zone; zone = zone->next)
+    {
+	stats->zone_size += zone->size;
+	stats->zones++;
+    }
+
+    for (i = 0; i < arrlen(arenas); i++)
+    {
+	for (chunk = arenas[i].first; chunk; chunk = chunk->next)
+	    stats->arena_size += chunk->size;
+    }
+
+    for (i = 0; i < NUMSIZECLASSES; i++)
+    {
+	for (block = freelists[i].lnext;
+	     block != &freelists[i];
+	     block = block->lnext)
+	{
+	    stats->free_bytes += block->size;
+	    stats->free_blocks++;
+
+	    if ((size_t) block->size > stats->largest_free)
+		stats->largest_free = block->size;
+	}
+    }
+
+    if (stats->free_bytes > 0)
+	stats->fragmentation =
+	    1.0 - (double) stats->largest_free / stats->free_bytes;
+}
+
+// [AP] For the overlay, recounted once a second
+static zonestats_t overlay_stats;
+static int overlay_time = -1000;
+
+boolean Z_StatsText (int line, char *buf, size_t buf_len)
+{
+    int		now;
+    int		tag;
+
+    if (!zone_stats)
+	return false;
+
+    now = I_GetTimeMS();
+
+    if (line == 0 && now - overlay_time >= 1000)
+    {
+	Z_GetStats(&overlay_stats);
+	overlay_time = now;
+    }
+
+    if (line == 0)
+    {
+	M_snprintf(buf, buf_len, "ZONE %luK/%luK PEAK %luK",
+		   (unsigned long) (overlay_stats.used / 1024),
+		   (unsigned long) (overlay_stats.zone_size / 1024),
+		   (unsigned long) (overlay_stats.peak / 1024));
+	return true;
+    }
+
+    if (line == 1)
+    {
+	M_snprintf(buf, buf_len, "FREE %luK IN %d FRAG %d%%",
+		   (unsigned long) (overlay_stats.free_bytes / 1024),
+		   overlay_stats.free_blocks,
+		   (int) (overlay_stats.fragmentation * 100));
+	return true;
+    }
+
+    if (line == 2)
+    {
+	unsigned long lookups = overlay_stats.cache_hits
+	                      + overlay_stats.cache_misses;
+
+	M_snprintf(buf, buf_len, "CACHE %luK HIT %d%% EVICT %lu",
+		   (unsigned long) (overlay_stats.cache_bytes / 1024),
+		   lookups ? (int) (overlay_stats.cache_hits * 100 / lookups) : 0,
+		   overlay_stats.cache_evictions);
+	return true;
+    }
+
+    // Then a line for each tag with blocks in use
+    for (tag = PU_STATIC; tag < PU_NUM_TAGS; tag++)
+    {
+	if (tag == PU_FREE || overlay_stats.tag_blocks[tag] == 0
+	 || --line > 2)
+	    continue;
+
+	M_snprintf(buf, buf_len, "%-7s %6luK %5d", tag_names[tag],
+		   (unsigned long) (overlay_stats.tag_bytes[tag] / 1024),
+		   overlay_stats.tag_blocks[tag]);
+	return true;
+    }
+
+    return false;
+}
+
+#ifdef ZONE_DEBUG
+static int Z_CompareSites (const void *a, const void *b)
+{
+    const zonesite_t *x = *(const zonesite_t **) a;
+    const zonesite_t *y = *(const zonesite_t **) b;
+
+    return (x->peak < y->peak) - (x->peak > y->peak);
+}
+#endif
+
+//
+// Z_ReportStats
+// [AP] -zonestats, on exit
+//
+static void Z_ReportStats (void)
+{
+    zonestats_t	stats;
+    int		tag;
+
+    Z_GetStats(&stats);
+
+    printf("Zone: %d zones, %lu KiB, %lu KiB in use, peak %lu KiB\n",
+	   stats.zones, (unsigned long) (stats.zone_size / 1024),
+	   (unsigned long) (stats.used / 1024),
+	   (unsigned long) (stats.peak / 1024));
+    printf("  level arenas %lu KiB\n",
+	   (unsigned long) (stats.arena_size / 1024));
+    printf("  free %lu KiB in %d blocks, largest %lu KiB, "
+	   "fragmentation %.1f%%\n",
+	   (unsigned long) (stats.free_bytes / 1024), stats.free_blocks,
+	   (unsigned long) (stats.largest_free / 1024),
+	   stats.fragmentation * 100);
+    printf("  cache %lu KiB", (unsigned long) (stats.cache_bytes / 1024));
+    if (stats.cache_budget)
+	printf(" of %lu KiB", (unsigned long) (stats.cache_budget / 1024));
+    printf(", %lu hits, %lu misses, %lu evicted, %lu second chances\n",
+	   stats.cache_hits, stats.cache_misses, stats.cache_evictions,
+	   stats.cache_second_chances);
+    printf("  %-8s %10s %8s %10s\n", "tag", "KiB", "blocks", "peak KiB");
+
+    for (tag = PU_STATIC; tag < PU_NUM_TAGS; tag++)
+    {
+	if (tag == PU_FREE)
+	    continue;
+
+	printf("  %-8s %10lu %8d %10lu\n", tag_names[tag],
+	       (unsigned long) (stats.tag_bytes[tag] / 1024),
+	       stats.tag_blocks[tag],
+	       (unsigned long) (stats.tag_peak[tag] / 1024));
+    }
+
+#ifdef ZONE_DEBUG
+    {
+	static zonesite_t *sorted[NUMSITES];
+	int	i, n = 0;
+
+	for (i = 0; i < NUMSITES; i++)
+	{
+	    if (sites[i].peak > 0)
+		sorted[n++] = &sites[i];
+	}
+
+	qsort(sorted, n, sizeof(*sorted), Z_CompareSites);
+
+	printf("  %-32s %10s %8s %10s\n", "allocated at", "KiB", "blocks",
+	       "peak KiB");
+
+	for (i = 0; i < n && i < 20; i++)
+	{
+	    char	where[64];
+
+	    if (sorted[i]->file)
+		M_snprintf(where, sizeof(where), "%s:%d",
+			   M_BaseName(sorted[i]->file), sorted[i]->line);
+	    else
+		M_StringCopy(where, "(others)", sizeof(where));
+
+	    printf("  %-32s %10lu %8d %10lu\n", where,
+		   (unsigned long) (sorted[i]->bytes / 1024),
+		   sorted[i]->blocks,
+		   (unsigned long) (sorted[i]->peak / 1024));
+	}
+    }
+#endif
+}
@@ -26,6 +26,8 @@
 
 #include <stdio.h>
 
+#include "doomtype.h"
+
 //
 // ZONE MEMORY
 // PU - purge tags.
@@ -48,10 +50,34 @@ enum
 
     PU_NUM_TAGS
 };
+
+// [AP] See Z_GetStats. Sizes include the block headers.
+typedef struct
+{
+    size_t	tag_bytes[PU_NUM_TAGS];
+    int		tag_blocks[PU_NUM_TAGS];
+    size_t	tag_peak[PU_NUM_TAGS];
+    size_t	used;
+    size_t	peak;
+    size_t	zone_size;	// All zones together
+    int		zones;
+    size_t	arena_size;	// Chunks held for PU_LEVEL and PU_LEVSPEC
+    size_t	free_bytes;	// In the zones, not counting purgable blocks
+    size_t	largest_free;
+    int		free_blocks;
+    double	fragmentation;	// 1 - largest_free / free_bytes
+    size_t	cache_budget;	// -zonecache, 0 for none
+    size_t	cache_bytes;	// In purgable blocks
+    unsigned long	cache_hits;	// See Z_CountLookup
+    unsigned long	cache_misses;
+    unsigned long	cache_evictions;	// Purged to make room
+    unsigned long	cache_second_chances;	// Passed over, see Z_Touch
+} zonestats_t;
         
 
 void	Z_Init (void);
-void*	Z_Malloc (int size, int tag, void *ptr);
+void*	Z_Malloc2 (int size, int tag, void *ptr, const char *file, int line);
+void*	Z_ArenaMalloc2 (int size, int tag, const char *file, int line);
 void    Z_Free (void *ptr);
 void    Z_FreeTags (int lowtag, int hightag);
 void    Z_DumpHeap (int lowtag, int hightag);
@@ -59,8 +85,14 @@ void    Z_FileDumpHeap (FILE *f);
 void    Z_CheckHeap (void);
 void    Z_ChangeTag2 (void *ptr, int tag, const char *file, int line);
 void    Z_ChangeUser(void *ptr, void **user);
+void    Z_Touch(void *ptr);
+void    Z_CountLookup(boolean hit);
 int     Z_FreeMemory (void);
 unsigned int Z_ZoneSize(void);
+size_t  Z_PeakUsage(void);
+void    Z_SetPurgeCallback(void (*callback)(void));
+void    Z_GetStats(zonestats_t *stats);
+boolean Z_StatsText(int line, char *buf, size_t buf_len);
 
 //
 // This is used to get the local FILE:LINE info from CPP
@@ -69,5 +101,25 @@ unsigned int Z_ZoneSize(void);
 #define Z_ChangeTag(p,t)                                       \
     Z_ChangeTag2((p), (t), __FILE__, __LINE__)
 
+// [AP] Built with ZONE_DEBUG, -zonestats also totals what is in use by
+// where it was allocated.
+#ifdef ZONE_DEBUG
+#define Z_Malloc(s,t,p)                                        \
+    Z_Malloc2((s), (t), (p), __FILE__, __LINE__)
+#else
+#define Z_Malloc(s,t,p)                                        \
+    Z_Malloc2((s), (t), (p), NULL, 0)
+#endif
+
+// [AP] PU_LEVEL or PU_LEVSPEC memory that's never freed before its
+// level is. Cheaper than Z_Malloc, but Z_Free on it gives nothing back.
+#ifdef ZONE_DEBUG
+#define Z_ArenaMalloc(s,t)                                     \
+    Z_ArenaMalloc2((s), (t), __FILE__, __LINE__)
+#else
+#define Z_ArenaMalloc(s,t)                                     \
+    Z_ArenaMalloc2((s), (t), NULL, 0)
+#endif
+
 
 #endif
@@ -56,6 +56,17 @@ static SDL_Surface *screenbuffer;
 static unsigned char *screendata;
 static SDL_Renderer *renderer;
 
+// [AP] screenbuffer is only drawn, converted and uploaded where the
+// characters changed. drawndata is what screendata was when each
+// character was last drawn, drawn_blink the blink phase of the last
+// full screen update.
+static unsigned char *drawndata;
+static int drawn_blink;
+static int redraw_all;
+static int present_needed; // The window was exposed, resized...
+static SDL_Surface *screenbuffer32;
+static SDL_Texture *screentx;
+
 // Current input mode.
 static txt_input_mode_t input_mode = TXT_INPUT_NORMAL;
 
@@ -302,6 +313,13 @@ int TXT_Init(void)
     screendata = malloc(TXT_SCREEN_W * TXT_SCREEN_H * 2);
     memset(screendata, 0, TXT_SCREEN_W * TXT_SCREEN_H * 2);
 
+    drawndata = malloc(TXT_SCREEN_W * TXT_SCREEN_H * 2);
+    screenbuffer32 = SDL_CreateRGBSurfaceWithFormat(0,
+                                                    screenbuffer->w,
+                                                    screenbuffer->h,
+                                                    32, SDL_PIXELFORMAT_ARGB8888);
+    redraw_all = 1;
+
     return 1;
 }
 
@@ -309,6 +327,15 @@ void TXT_Shutdown(void)
 {
     free(screendata);
     screendata = NULL;
+    free(drawndata);
+    drawndata = NULL;
+    if (screentx != NULL)
+    {
+        SDL_DestroyTexture(screentx);
+        screentx = NULL;
+    }
+    SDL_FreeSurface(screenbuffer32);
+    screenbuffer32 = NULL;
     SDL_FreeSurface(screenbuffer);
     screenbuffer = NULL;
     SDL_QuitSubSystem(SDL_INIT_VIDEO);
@@ -321,6 +348,8 @@ void TXT_SetColor(txt_color_t color, int r, int g, int b)
     SDL_LockSurface(screenbuffer);
     SDL_SetPaletteColors(screenbuffer->format->palette, &c, color, 1);
     SDL_UnlockSurface(screenbuffer);
+
+    redraw_all = 1; // [AP] Converted with the old colors
 }
 
 unsigned char *TXT_GetScreenData(void)
@@ -419,11 +448,25 @@ static void GetDestRect(SDL_Rect *rect)
 
 void TXT_UpdateScreenArea(int x, int y, int w, int h)
 {
-    SDL_Texture *screentx;
     SDL_Rect rect;
     int x1, y1;
     int x_end;
     int y_end;
+    int blink;
+    int dirty_x1 = TXT_SCREEN_W, dirty_y1 = TXT_SCREEN_H;
+    int dirty_x2 = 0, dirty_y2 = 0;
+
+    if (screentx == NULL)
+    {
+        SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+
+        screentx = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                     SDL_TEXTUREACCESS_STREAMING,
+                                     screenbuffer->w, screenbuffer->h);
+        redraw_all = 1;
+    }
+
+    blink = (SDL_GetTicks() / BLINK_PERIOD) % 2;
 
     SDL_LockSurface(screenbuffer);
 
@@ -432,28 +475,78 @@ void TXT_UpdateScreenArea(int x, int y, int w, int h)
     x = LimitToRange(x, 0, TXT_SCREEN_W);
     y = LimitToRange(y, 0, TXT_SCREEN_H);
 
+    if (redraw_all)
+    {
+        x = 0;
+        y = 0;
+        x_end = TXT_SCREEN_W;
+        y_end = TXT_SCREEN_H;
+    }
+
     for (y1=y; y1<y_end; ++y1)
     {
         for (x1=x; x1<x_end; ++x1)
         {
+            const unsigned char *p = &screendata[(y1 * TXT_SCREEN_W + x1) * 2];
+            unsigned char *d = &drawndata[(y1 * TXT_SCREEN_W + x1) * 2];
+
+            // [AP] Blinking ones change with the phase
+            if (!redraw_all && p[0] == d[0] && p[1] == d[1]
+             && (!(p[1] & 0x80) || blink == drawn_blink))
+            {
+                continue;
+            }
+
             UpdateCharacter(x1, y1);
+            d[0] = p[0];
+            d[1] = p[1];
+
+            if (x1 < dirty_x1) dirty_x1 = x1;
+            if (y1 < dirty_y1) dirty_y1 = y1;
+            if (x1 >= dirty_x2) dirty_x2 = x1 + 1;
+            if (y1 >= dirty_y2) dirty_y2 = y1 + 1;
         }
     }
 
     SDL_UnlockSurface(screenbuffer);
 
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+    // Anything blinking in the rest is drawn in the old phase still
+    if (x == 0 && y == 0 && x_end == TXT_SCREEN_W && y_end == TXT_SCREEN_H)
+    {
+        drawn_blink = blink;
+    }
 
-    // TODO: This is currently creating a new texture every time we render
-    // the screen; find a more efficient way to do it.
-    screentx = SDL_CreateTextureFromSurface(renderer, screenbuffer);
+    redraw_all = 0;
+
+    // [AP] Only the rectangle around the changes is converted and
+    // uploaded, and nothing is presented when nothing changed
+    if (dirty_x2 > dirty_x1)
+    {
+        SDL_Rect src, dst;
+
+        src.x = dirty_x1 * font->w;
+        src.y = dirty_y1 * font->h;
+        src.w = (dirty_x2 - dirty_x1) * font->w;
+        src.h = (dirty_y2 - dirty_y1) * font->h;
+        dst = src;
+        SDL_BlitSurface(screenbuffer, &src, screenbuffer32, &dst);
+
+        SDL_UpdateTexture(screentx, &src,
+                          (unsigned char *) screenbuffer32->pixels
+                        + src.y * screenbuffer32->pitch + src.x * 4,
+                          screenbuffer32->pitch);
+    }
+    else if (!present_needed)
+    {
+        return;
+    }
+
+    present_needed = 0;
 
     SDL_RenderClear(renderer);
     GetDestRect(&rect);
     SDL_RenderCopy(renderer, screentx, NULL, &rect);
     SDL_RenderPresent(renderer);
-
-    SDL_DestroyTexture(screentx);
 }
 
 void TXT_UpdateScreen(void)
@@ -670,6 +763,11 @@ signed int TXT_GetChar(void)
                 // Quit = escape
                 return 27;
 
+            case SDL_WINDOWEVENT:
+                // [AP] TXT_UpdateScreen only presents what changed
+                present_needed = 1;
+                break;
+
             case SDL_MOUSEMOTION:
                 if (MouseHasMoved())
                 {